@@ -0,0 +1,61 @@
+#!/bin/bash
+
+SRC="$1"
+SCRATCH="$2"
+THREADS="$3"
+BINDIR="$4"
+
+echo ""
+echo "===== TESTING BAM READER: 1 vs. $THREADS BGZF inflate threads =="
+echo "source          : $SRC"
+echo "scratch-space at: $SCRATCH"
+echo "binaries in     : $BINDIR"
+echo ""
+
+BAM="${SCRATCH}bgzf.ok.bam"
+TRUNC="${SCRATCH}bgzf.trunc.bam"
+CORRUPT="${SCRATCH}bgzf.corrupt.bam"
+
+clear_files()
+{
+    rm -f $BAM $TRUNC $CORRUPT ${SCRATCH}bgzf.*.t*.txt 2>&1 > /dev/null
+}
+
+clear_files
+
+CMD="$BINDIR/sam-dump --bam --output-file $BAM $SRC"
+echo "$CMD"
+$CMD
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+
+#cut the file in the middle of a block, and zero a stretch of another block
+SIZE=$( stat -c %s $BAM )
+head -c $(( SIZE * 2 / 3 + 7 )) $BAM > $TRUNC
+cp $BAM $CORRUPT
+dd if=/dev/zero of=$CORRUPT bs=1 seek=$(( SIZE / 2 )) count=64 conv=notrunc 2>/dev/null
+
+for F in $BAM $TRUNC $CORRUPT
+do
+    for T in 1 $THREADS
+    do
+        OUT="${F%.bam}.t$T.txt"
+        #the records read, and the error that ended the read if any
+        $BINDIR/samview -t $T $F > $OUT 2> $OUT.err
+        grep -o "Final RC.*\|err: .*\|warn: .*" $OUT.err >> $OUT
+        rm -f $OUT.err
+    done
+
+    if [[ ! -s ${F%.bam}.t1.txt ]]; then echo "samview of $F produced no output"; exit 1; fi
+
+    CMD="diff ${F%.bam}.t1.txt ${F%.bam}.t$THREADS.txt"
+    echo "$CMD"
+    $CMD 2>&1 > /dev/null
+    rc=$?;
+    if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+done
+
+echo ">>>SUCCESS!"
+
+clear_files
+
+exit 0
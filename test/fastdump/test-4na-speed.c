@@ -0,0 +1,258 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test and micro-benchmark for pack_4na() / unpack_4na() in tools/fastdump/helper.c
+    every kernel the CPU supports is forced in turn:
+        - pack and unpack are checked against a scalar reference for lengths around the
+          vector-widths ( odd lengths, tails that are not a multiple of 16 / 32 bytes ),
+          with buffers of the exact size and a guard-byte behind them
+        - the throughput is reported in GB/s ( counted in unpacked bases )
+    fails if any kernel disagrees with the reference
+-------------------------------------------------------------------------------------------- */
+
+#include "helper.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <klib/time.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_LEN 150
+#define NUM_READS ( 64 * 1024 )
+#define ROUNDS 50
+#define MAX_CHECK_LEN 300
+#define GUARD 0xA5
+
+const char UsageDefaultName[] = "test-4na-speed";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+static const char x4na_to_ASCII[ 16 ] =
+{
+    'N', 'A', 'C', 'N', 'G', 'N', 'N', 'N', 'T', 'N', 'N', 'N', 'N', 'N', 'N', 'N'
+};
+
+static const char * kernels[] = { "portable", "sse2", "avx2" };
+
+/* 1 and the neighbours of the 16 / 32 / 64 - byte blocks in both directions, plus the read-lengths */
+static const uint32_t check_lengths[] =
+{
+    1, 2, 3, 15, 16, 17, 31, 32, 33, 63, 64, 65, 95, 127, 128, 129, 150, 151, 255, 256, 257, MAX_CHECK_LEN
+};
+
+static double gb_per_sec( uint64_t bytes, KTimeMs_t ms )
+{
+    if ( ms == 0 ) ms = 1;
+    return ( ( double )bytes / ( 1024.0 * 1024.0 * 1024.0 ) ) / ( ( double )ms / 1000.0 );
+}
+
+static rc_t check_len( uint32_t len )
+{
+    rc_t rc = 0;
+    char unpacked[ MAX_CHECK_LEN ];
+    uint8_t expected[ 2 + ( MAX_CHECK_LEN + 1 ) / 2 ];
+    uint8_t packed[ 2 + ( MAX_CHECK_LEN + 1 ) / 2 + 1 ];
+    char ascii[ MAX_CHECK_LEN + 2 + 1 ];
+    size_t packed_len = 2 + ( len + 1 ) / 2;
+    size_t ascii_len = 2 * ( packed_len - 2 ) + 1;  /* odd length: one padding-base + terminator */
+    uint32_t i;
+    String S;
+    SBuffer buf;
+
+    /* all 16 codes, the upper nibble must be ignored */
+    for ( i = 0; i < len; ++i )
+        unpacked[ i ] = ( char )( rand() & 0xFF );
+
+    expected[ 0 ] = ( uint8_t )( len >> 8 );
+    expected[ 1 ] = ( uint8_t )( len & 0xFF );
+    for ( i = 0; i < len; ++i )
+    {
+        uint8_t nibble = unpacked[ i ] & 0x0F;
+        if ( i & 1 )
+            expected[ 2 + i / 2 ] |= nibble;
+        else
+            expected[ 2 + i / 2 ] = ( uint8_t )( nibble << 4 );
+    }
+
+    memset( packed, GUARD, sizeof packed );
+    StringInit( &S, unpacked, len, len );
+    buf.S.addr = ( char * )packed;
+    buf.buffer_size = packed_len;
+    pack_4na( &S, &buf );
+    if ( buf.S.len != packed_len || memcmp( packed, expected, packed_len ) != 0 )
+    {
+        KOutMsg( "pack_4na( len = %u ) produced the wrong bytes\n", len );
+        rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+    }
+    else if ( packed[ packed_len ] != GUARD )
+    {
+        KOutMsg( "pack_4na( len = %u ) wrote past the buffer\n", len );
+        rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+    }
+
+    if ( rc == 0 )
+    {
+        memset( ascii, GUARD, sizeof ascii );
+        StringInit( &S, ( const char * )packed, packed_len, packed_len );
+        buf.S.addr = ascii;
+        buf.buffer_size = ascii_len;
+        unpack_4na( &S, &buf );
+        if ( buf.S.len != len || ascii[ len ] != 0 )
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        for ( i = 0; rc == 0 && i < len; ++i )
+        {
+            if ( ascii[ i ] != x4na_to_ASCII[ unpacked[ i ] & 0x0F ] )
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        }
+        if ( rc != 0 )
+            KOutMsg( "unpack_4na( len = %u ) produced the wrong bases\n", len );
+        else if ( ( uint8_t )ascii[ ascii_len ] != GUARD )
+        {
+            KOutMsg( "unpack_4na( len = %u ) wrote past the buffer\n", len );
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        }
+    }
+    return rc;
+}
+
+static rc_t check_kernel( void )
+{
+    rc_t rc = 0;
+    uint32_t i;
+    for ( i = 0; rc == 0 && i < sizeof check_lengths / sizeof check_lengths[ 0 ]; ++i )
+        rc = check_len( check_lengths[ i ] );
+    return rc;
+}
+
+static rc_t bench_kernel( const char * unpacked, char * packed, size_t packed_len, SBuffer * out )
+{
+    rc_t rc = 0;
+    uint64_t total = ( uint64_t )NUM_READS * READ_LEN * ROUNDS;
+    KTimeMs_t start, pack_ms, unpack_ms;
+    uint32_t i, r;
+
+    start = KTimeMsStamp();
+    for ( r = 0; r < ROUNDS; ++r )
+    {
+        for ( i = 0; i < NUM_READS; ++i )
+        {
+            String S;
+            SBuffer dst;
+            StringInit( &S, &unpacked[ ( size_t )i * READ_LEN ], READ_LEN, READ_LEN );
+            dst.S.addr = &packed[ ( size_t )i * packed_len ];
+            dst.buffer_size = packed_len;
+            pack_4na( &S, &dst );
+        }
+    }
+    pack_ms = KTimeMsStamp() - start;
+
+    start = KTimeMsStamp();
+    for ( r = 0; rc == 0 && r < ROUNDS; ++r )
+    {
+        for ( i = 0; rc == 0 && i < NUM_READS; ++i )
+        {
+            String S;
+            StringInit( &S, &packed[ ( size_t )i * packed_len ], packed_len, packed_len );
+            unpack_4na( &S, out );
+            if ( r == 0 )
+            {
+                /* verify the round-trip once */
+                uint32_t j;
+                const char * src = &unpacked[ ( size_t )i * READ_LEN ];
+                if ( out->S.len != READ_LEN )
+                    rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                for ( j = 0; rc == 0 && j < READ_LEN; ++j )
+                {
+                    if ( out->S.addr[ j ] != x4na_to_ASCII[ src[ j ] & 0x0F ] )
+                        rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                }
+                if ( rc != 0 )
+                    KOutMsg( "round-trip failed for read #%u\n", i );
+            }
+        }
+    }
+    unpack_ms = KTimeMsStamp() - start;
+
+    if ( rc == 0 )
+    {
+        KOutMsg( "%-8s pack   : %lu bases in %lu ms = %.2f GB/s\n",
+                 get_4na_kernel_name(), total, pack_ms, gb_per_sec( total, pack_ms ) );
+        KOutMsg( "%-8s unpack : %lu bases in %lu ms = %.2f GB/s\n",
+                 get_4na_kernel_name(), total, unpack_ms, gb_per_sec( total, unpack_ms ) );
+    }
+    return rc;
+}
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    rc_t rc = 0;
+    size_t packed_len = 2 + ( READ_LEN + 1 ) / 2;
+    char * unpacked = malloc( ( size_t )NUM_READS * READ_LEN );
+    char * packed = malloc( ( size_t )NUM_READS * packed_len );
+    SBuffer out;
+
+    if ( unpacked == NULL || packed == NULL )
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+        rc = make_SBuffer( &out, 4096 );
+
+    if ( rc == 0 )
+    {
+        uint32_t i, tested = 0;
+
+        srand( 42 );
+        for ( i = 0; i < NUM_READS * READ_LEN; ++i )
+            unpacked[ i ] = ( char )( 1 << ( rand() & 3 ) );
+        unpacked[ 0 ] = 0x0F; /* make shure the 'N'-path is hit too */
+
+        KOutMsg( "selected kernel : %s\n", get_4na_kernel_name() );
+        for ( i = 0; rc == 0 && i < sizeof kernels / sizeof kernels[ 0 ]; ++i )
+        {
+            if ( !set_4na_kernel( kernels[ i ] ) )
+                KOutMsg( "%-8s not supported by this CPU - skipped\n", kernels[ i ] );
+            else
+            {
+                rc = check_kernel();
+                if ( rc != 0 )
+                    KOutMsg( "%-8s FAILED\n", kernels[ i ] );
+                else
+                    rc = bench_kernel( unpacked, packed, packed_len, &out );
+                tested++;
+            }
+        }
+        if ( rc == 0 && tested == 0 )
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcParam, rcInvalid );
+        release_SBuffer( &out );
+    }
+    if ( unpacked != NULL ) free( unpacked );
+    if ( packed != NULL ) free( packed );
+    return rc;
+}
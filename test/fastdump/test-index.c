@@ -0,0 +1,162 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    boundary-test for get_nearest_offset() in tools/fastdump/index.c
+    writes a small index, then looks up keys before, at and after its entries
+    with the buffered and with the memory-mapped index-reader
+-------------------------------------------------------------------------------------------- */
+
+#include "index.h"
+#include "helper.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <kfs/directory.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+
+#define INDEX_FILE "test-index.idx"
+#define FREQUENCY 10
+#define KEY_COUNT 100
+#define LAST_KEY 99
+
+const char UsageDefaultName[] = "test-index";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+/* the writer stores key 1, then every key > last stored key + FREQUENCY
+   ( it starts counting at 0 ): 1, 11, 22, 33, 44, 55, 66, 77, 88, 99 */
+static rc_t write_test_index( KDirectory * dir )
+{
+    struct index_writer * writer;
+    rc_t rc = make_index_writer( dir, &writer, 4096, FREQUENCY, "%s", INDEX_FILE );
+    if ( rc == 0 )
+    {
+        uint64_t key;
+        for ( key = 2; rc == 0 && key <= KEY_COUNT; ++key )
+            rc = write_key( writer, key, key * 100 );
+        release_index_writer( writer );
+    }
+    return rc;
+}
+
+
+typedef struct nearest_case
+{
+    uint64_t key_to_find;
+    bool found;
+    uint64_t key_found;
+} nearest_case;
+
+static const nearest_case cases[] =
+{
+    {   0, true,    1 },    /* before the first entry: the first entry */
+    {   1, true,    1 },
+    {  10, true,    1 },
+    {  11, true,   11 },
+    {  50, true,   44 },
+    {  98, true,   88 },
+    {  99, true,   99 },    /* the last entry itself */
+    { 100, false,   0 },    /* beyond the last entry: not found */
+    { 0xFFFFFFFF, false, 0 }
+};
+
+
+static rc_t check_reader( const struct index_reader * reader, const char * kind )
+{
+    rc_t rc = 0;
+    uint64_t max_key;
+    uint32_t i;
+
+    rc = get_max_key( reader, &max_key );
+    if ( rc == 0 && max_key != LAST_KEY )
+    {
+        KOutMsg( "%s: max_key = %lu, expected %lu\n", kind, max_key, ( uint64_t )LAST_KEY );
+        rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+    }
+
+    for ( i = 0; rc == 0 && i < ( sizeof cases / sizeof cases[ 0 ] ); ++i )
+    {
+        const nearest_case * c = &cases[ i ];
+        uint64_t key_found = 0, offset = 0;
+        rc_t rc1 = get_nearest_offset( reader, c->key_to_find, &key_found, &offset );
+        if ( c->found )
+        {
+            if ( rc1 != 0 || key_found != c->key_found || offset != ( key_found == 1 ? 0 : key_found * 100 ) )
+            {
+                KOutMsg( "%s: key %lu -> rc=%R key=%lu offset=%lu, expected key=%lu\n",
+                         kind, c->key_to_find, rc1, key_found, offset, c->key_found );
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+            }
+        }
+        else if ( GetRCState( rc1 ) != rcNotFound )
+        {
+            KOutMsg( "%s: key %lu -> rc=%R key=%lu, expected NotFound\n",
+                     kind, c->key_to_find, rc1, key_found );
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        }
+    }
+    if ( rc == 0 )
+        KOutMsg( "%s index-reader: ok\n", kind );
+    return rc;
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    KDirectory * dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc == 0 )
+    {
+        rc = write_test_index( dir );
+        if ( rc == 0 )
+        {
+            struct index_reader * reader;
+            rc = make_index_reader( dir, &reader, 4096, "%s", INDEX_FILE );
+            if ( rc == 0 )
+            {
+                rc = check_reader( reader, "buffered" );
+                release_index_reader( reader );
+            }
+        }
+        if ( rc == 0 )
+        {
+            struct index_reader * reader;
+            rc = make_index_reader_mmap( dir, &reader, INDEX_FILE );
+            if ( rc == 0 )
+            {
+                rc = check_reader( reader, "mmap" );
+                release_index_reader( reader );
+            }
+        }
+        KDirectoryRemove( dir, true, "%s", INDEX_FILE );
+        KDirectoryRelease( dir );
+    }
+    return rc;
+}
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+ACC="$1"
+SCRATCH="$2"
+THREADS="$3"
+BINDIR="$4"
+
+echo ""
+echo "===== TESTING FASTDUMP: TEST #3 ( FASTQ, --split-files )==================="
+echo "accession       : $ACC"
+echo "scratch-space at: $SCRATCH"
+echo "parallel threads: $THREADS"
+echo "binaries in     : $BINDIR"
+echo ""
+
+FASTDUMP_OUT="$SCRATCH$ACC.fastdump.txt"
+JOINED_OUT="$SCRATCH$ACC.joined.txt"
+VDB_DUMP_OUT="$SCRATCH$ACC.vdb_dump.txt"
+
+clear_files()
+{
+    CMD="rm -rf $FASTDUMP_OUT* $JOINED_OUT $VDB_DUMP_OUT"
+    $CMD 2>&1 > /dev/null
+}
+
+clear_files
+
+#one output-file per thread, each thread writes its range of rows straight into it
+CMD="$BINDIR/fastdump $ACC -t $SCRATCH -f fastq -o $FASTDUMP_OUT -e $THREADS -F"
+echo "$CMD"
+$CMD
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+
+#exactly one file per thread, concatenated in order
+for (( i=0; i<$THREADS; i++ )); do
+    if [[ ! -f "$FASTDUMP_OUT.$i" ]]; then echo "split-file $FASTDUMP_OUT.$i missing"; exit 3; fi
+    cat "$FASTDUMP_OUT.$i" >> $JOINED_OUT
+done
+if [[ -f "$FASTDUMP_OUT.$THREADS" ]]; then echo "more split-files than threads"; exit 3; fi
+if [[ $(ls -1 $FASTDUMP_OUT* | wc -l) != $THREADS ]]; then echo "part-files left next to the split-files"; exit 3; fi
+
+#produce the same output using vdb-dump with internal schema-joins
+CMD="$BINDIR/vdb-dump $ACC -f fastq"
+echo "$CMD"
+$CMD > $VDB_DUMP_OUT
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+
+#verify that the concatenated split-files are the output of vdb-dump
+CMD="diff $JOINED_OUT $VDB_DUMP_OUT"
+echo "$CMD"
+$CMD 2>&1 > /dev/null
+rc=$?;
+if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+if [[ $rc == 0 ]]; then echo ">>>SUCCESS!"; fi
+
+clear_files
+
+exit $rc
@@ -0,0 +1,246 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the read-filters of fastq-dump ( tools/fastq-dump/filters.cpp )
+    every combination of --minReadLen, --maxNPercent, --minMeanQuality and --maxBasePercent
+    is run over the same synthetic reads twice: read by read ( checkRead, the path of checkIt )
+    and batch by batch ( checkBatch, as dumpRange does it ), both have to accept the same
+    reads and give the same report; batches without qualities are used where no filter
+    looks at them
+-------------------------------------------------------------------------------------------- */
+
+#include "filters.hpp"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#define NUM_READS ( 10 * 1000 + 17 )
+#define MAX_READ_LEN 160
+
+using namespace ngs;
+
+extern "C" {
+
+const char UsageDefaultName[] = "test-filters";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+}
+
+struct SynthRead
+{
+    std::string name;
+    std::string bases;
+    std::string qualities;
+};
+
+/* the options of one run, 0 / 100 ... filter not set, as in setupFilters() */
+struct FilterSetup
+{
+    uint64_t min_read_len;
+    uint64_t max_n_percent;
+    uint64_t min_mean_quality;
+    uint64_t max_base_percent;
+};
+
+static const FilterSetup setups[] =
+{
+    {  0, 100,  0, 100 },
+    { 50, 100,  0, 100 },
+    {  0,  10,  0, 100 },
+    {  0,   0,  0, 100 },
+    {  0, 100, 20, 100 },
+    {  0, 100,  0,  60 },
+    { 30,  10, 20,  60 },
+    {  0,  25, 30,  40 },
+};
+
+static void make_reads( std::vector< SynthRead > & reads )
+{
+    static const char bases[] = "ACGTN";
+    srand( 42 );
+    for ( size_t i = 0; i < reads.size(); ++i )
+    {
+        SynthRead & r = reads[ i ];
+        /* empty reads, short ones and up to MAX_READ_LEN */
+        size_t len = ( i % 97 == 0 ) ? 0 : rand() % MAX_READ_LEN + 1;
+        /* some reads rich in N, some of low complexity, some of low quality */
+        uint32_t n_rate = ( i % 5 == 0 ) ? 40 : 2;
+        bool low_complexity = ( i % 7 == 0 );
+        uint32_t qual_max = ( i % 3 == 0 ) ? 25 : 41;
+
+        r.name = "read";
+        r.bases.resize( len );
+        r.qualities.resize( len );
+        for ( size_t j = 0; j < len; ++j )
+        {
+            if ( ( uint32_t )( rand() % 100 ) < n_rate )
+                r.bases[ j ] = 'N';
+            else if ( low_complexity && rand() % 4 != 0 )
+                r.bases[ j ] = 'A';
+            else
+                r.bases[ j ] = bases[ rand() % 4 ];
+            r.qualities[ j ] = ( char )( '!' + rand() % qual_max );
+        }
+    }
+}
+
+static void setup_filters( AFilters & filters, const FilterSetup & s )
+{
+    if ( s.min_read_len != 0 )
+        filters.addLengthFilter( s.min_read_len );
+    if ( s.max_n_percent < 100 )
+        filters.addMaxNFilter( s.max_n_percent );
+    if ( s.min_mean_quality != 0 )
+        filters.addMeanQualityFilter( s.min_mean_quality );
+    if ( s.max_base_percent < 100 )
+        filters.addLowComplexityFilter( s.max_base_percent );
+}
+
+static void per_read( const FilterSetup & s, const std::vector< SynthRead > & reads,
+                      std::vector< bool > & accepted, String & report )
+{
+    AFilters filters( "SRR0000001" );
+    setup_filters( filters, s );
+    for ( size_t i = 0; i < reads.size(); ++i )
+    {
+        const SynthRead & r = reads[ i ];
+        accepted[ i ] = filters.checkRead( r.bases.data(), r.bases.size(),
+                                           r.qualities.data(), r.qualities.size() );
+    }
+    report = filters.report();
+}
+
+static void per_batch( const FilterSetup & s, const std::vector< SynthRead > & reads,
+                       std::vector< bool > & accepted, String & report )
+{
+    AFilters filters( "SRR0000001" );
+    setup_filters( filters, s );
+
+    /* the way dumpRange decides it for FASTA-output */
+    AReadBatch batch( filters.needsQualities() );
+    AReadMask mask;
+    size_t first = 0;
+    for ( size_t i = 0; i <= reads.size(); ++i )
+    {
+        if ( batch.full() || ( i == reads.size() && batch.count() != 0 ) )
+        {
+            filters.checkBatch( batch, mask );
+            for ( size_t j = 0; j < batch.count(); ++j )
+                accepted[ first + j ] = ( ( mask[ j / 64 ] >> ( j % 64 ) ) & 1 ) != 0;
+            first += batch.count();
+            batch.clear();
+        }
+        if ( i < reads.size() )
+        {
+            const SynthRead & r = reads[ i ];
+            if ( batch.withQualities() )
+                batch.add( i + 1, r.name.data(), r.name.size(), r.bases.data(), r.bases.size(),
+                           r.qualities.data(), r.qualities.size() );
+            else
+                batch.add( i + 1, r.name.data(), r.name.size(), r.bases.data(), r.bases.size(), NULL, 0 );
+        }
+    }
+    report = filters.report();
+}
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    std::vector< SynthRead > reads( NUM_READS );
+    rc_t rc = 0;
+
+    make_reads( reads );
+    for ( size_t s = 0; rc == 0 && s < sizeof setups / sizeof setups[ 0 ]; ++s )
+    {
+        const FilterSetup & setup = setups[ s ];
+        std::vector< bool > by_read( reads.size() ), by_batch( reads.size() );
+        String report_read, report_batch;
+        uint32_t n_accepted = 0;
+
+        try
+        {
+            AFilters filters( "SRR0000001" );
+            setup_filters( filters, setup );
+            /* only the mean-quality looks at the qualities */
+            if ( filters.needsQualities() != ( setup.min_mean_quality != 0 ) )
+            {
+                KOutMsg( "setup #%u: needsQualities() is wrong\n", ( uint32_t )s );
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                break;
+            }
+            per_read( setup, reads, by_read, report_read );
+            per_batch( setup, reads, by_batch, report_batch );
+        }
+        catch ( ErrorMsg & x )
+        {
+            KOutMsg( "setup #%u: %s\n", ( uint32_t )s, x.what() );
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+            break;
+        }
+
+        for ( size_t i = 0; i < reads.size(); ++i )
+        {
+            if ( by_read[ i ] != by_batch[ i ] )
+            {
+                KOutMsg( "setup #%u: read #%u is %s read by read, %s batch by batch\n", ( uint32_t )s, ( uint32_t )i,
+                         by_read[ i ] ? "accepted" : "rejected", by_batch[ i ] ? "accepted" : "rejected" );
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                break;
+            }
+            if ( by_read[ i ] )
+                ++n_accepted;
+        }
+        if ( rc == 0 && report_read != report_batch )
+        {
+            KOutMsg( "setup #%u: reports differ\n%s---\n%s", ( uint32_t )s, report_read.c_str(), report_batch.c_str() );
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        }
+        /* every filter that is set has to reject something, but not everything */
+        if ( rc == 0 )
+        {
+            bool filtered = ( setup.min_read_len != 0 || setup.max_n_percent < 100 ||
+                              setup.min_mean_quality != 0 || setup.max_base_percent < 100 );
+            if ( filtered ? ( n_accepted == 0 || n_accepted == reads.size() ) : ( n_accepted != reads.size() ) )
+            {
+                KOutMsg( "setup #%u: %u of %u reads accepted\n", ( uint32_t )s, n_accepted, ( uint32_t )reads.size() );
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+            }
+        }
+        if ( rc == 0 )
+            KOutMsg( "setup #%u: %u of %u reads accepted\n%s", ( uint32_t )s, n_accepted, ( uint32_t )reads.size(), report_read.c_str() );
+    }
+    if ( rc == 0 )
+        KOutMsg( "filters: ok\n" );
+    return rc;
+}
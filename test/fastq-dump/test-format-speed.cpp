@@ -0,0 +1,241 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    micro-benchmark for AFormatter in tools/fastq-dump/formatter.cpp
+    formats a synthetic read collection as FASTQ and as wrapped FASTA, once through
+    iostreams the way fastq-dump did it before, once through AFormatter, and reports
+    reads/sec for both; fails if both ways do not produce the same bytes
+-------------------------------------------------------------------------------------------- */
+
+#include "formatter.hpp"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <klib/time.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#define READ_LEN 150
+#define NUM_READS ( 64 * 1024 )
+#define ROUNDS 20
+#define FASTA_WIDTH 70
+
+using namespace ngs;
+
+extern "C" {
+
+const char UsageDefaultName[] = "test-format-speed";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+}
+
+struct SynthRead
+{
+    std::string name;
+    std::string bases;
+    std::string qualities;
+};
+
+/* stands for kout : a buffered stream, which throws the content away */
+class NullBuf : public std::streambuf
+{
+public:
+    NullBuf() { setp( m_buf, m_buf + sizeof m_buf ); }
+protected:
+    int overflow( int c ) { setp( m_buf, m_buf + sizeof m_buf ); return c == EOF ? 0 : c; }
+private:
+    char m_buf[ 128 * 1024 ];
+};
+
+/* the iostream-path, as it was in dumpFastQ() */
+static void old_fastq( std::ostream & out, const String & coll, int64_t spot, const SynthRead & r )
+{
+    out << "@" << coll << '.' << spot << ' ' << r.name << " length=" << r.bases.size() << '\n';
+    out << r.bases << '\n';
+    out << '+' << coll << '.' << spot << ' ' << r.name << " length=" << r.qualities.size() << '\n';
+    out << r.qualities << '\n';
+}
+
+/* the iostream-path, as it was in dumpFastA() */
+static void old_fasta( std::ostream & out, const String & coll, int64_t spot, const SynthRead & r, uint64_t width )
+{
+    uint64_t l = r.bases.size();
+    uint64_t p = 0;
+    const char * s = r.bases.data();
+    out << '>' << coll << '.' << spot << ' ' << r.name << " length=" << l << '\n';
+    if ( 0 < width )
+    {
+        while ( p < l )
+        {
+            uint64_t t = std::min( width, l - p );
+            out << std::string( s, ( std::string::size_type )p, ( std::string::size_type )t ) << "\n";
+            p += t;
+        }
+    }
+    else
+        out << r.bases << "\n";
+}
+
+static void make_reads( std::vector< SynthRead > & reads )
+{
+    static const char bases[] = "ACGTN";
+    srand( 42 );
+    for ( size_t i = 0; i < reads.size(); ++i )
+    {
+        SynthRead & r = reads[ i ];
+        std::ostringstream name;
+        /* vary the length a little, so the wrapping has a tail line */
+        size_t len = READ_LEN - ( i % 7 );
+        name << "HWI-ST" << ( i % 13 ) << ":" << ( i % 8 ) << ":" << i;
+        r.name = name.str();
+        r.bases.resize( len );
+        r.qualities.resize( len );
+        for ( size_t j = 0; j < len; ++j )
+        {
+            r.bases[ j ] = bases[ rand() % 5 ];
+            r.qualities[ j ] = ( char )( '!' + rand() % 41 );
+        }
+    }
+}
+
+static double reads_per_sec( uint64_t reads, KTimeMs_t ms )
+{
+    if ( ms == 0 ) ms = 1;
+    return ( double )reads / ( ( double )ms / 1000.0 );
+}
+
+static void fmt_fastq( AFormatter & fmt, int64_t spot, const SynthRead & r )
+{
+    fmt.fastQ( spot, r.name.data(), r.name.size(), r.bases.data(), r.bases.size(),
+               r.qualities.data(), r.qualities.size() );
+}
+
+static void fmt_fasta( AFormatter & fmt, int64_t spot, const SynthRead & r, uint64_t width = FASTA_WIDTH )
+{
+    fmt.fastA( spot, r.name.data(), r.name.size(), r.bases.data(), r.bases.size(), width );
+}
+
+static bool verify( const String & coll, const std::vector< SynthRead > & all_reads )
+{
+    std::ostringstream q, a, u;
+    AFormatter fq( coll, false ), fa( coll, false ), fu( coll, false );
+    std::vector< SynthRead > reads( all_reads.begin(), all_reads.begin() + 1000 );
+    int64_t spot = -3; /* negative and zero spot-id's are formatted too */
+
+    /* the edge-cases of the line-wrap: empty reads, reads of exactly one and two lines */
+    reads[ 5 ].bases.clear();
+    reads[ 5 ].qualities.clear();
+    reads[ 6 ].bases.resize( FASTA_WIDTH );
+    reads[ 6 ].qualities.resize( FASTA_WIDTH );
+    reads[ 7 ].bases.resize( 2 * FASTA_WIDTH );
+    reads[ 7 ].qualities.resize( 2 * FASTA_WIDTH );
+    reads[ 8 ].bases.resize( 1 );
+    reads[ 8 ].qualities.resize( 1 );
+    for ( size_t i = 0; i < reads.size(); ++i, ++spot )
+    {
+        old_fastq( q, coll, spot, reads[ i ] );
+        old_fasta( a, coll, spot, reads[ i ], FASTA_WIDTH );
+        old_fasta( u, coll, spot, reads[ i ], 0 );
+        fmt_fastq( fq, spot, reads[ i ] );
+        fmt_fasta( fa, spot, reads[ i ] );
+        fmt_fasta( fu, spot, reads[ i ], 0 );
+    }
+    return q.str() == std::string( fq.data(), fq.size() ) &&
+           a.str() == std::string( fa.data(), fa.size() ) &&
+           u.str() == std::string( fu.data(), fu.size() );
+}
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    const String coll( "SRR0000001" );
+    std::vector< SynthRead > reads( NUM_READS );
+    uint64_t total = ( uint64_t )NUM_READS * ROUNDS;
+    KTimeMs_t start, old_q, new_q, old_a, new_a;
+    uint32_t i, r;
+
+    make_reads( reads );
+    if ( !verify( coll, reads ) )
+    {
+        KOutMsg( "AFormatter output differs from iostream output\n" );
+        return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+    }
+
+    {
+        NullBuf nb;
+        std::ostream out( &nb );
+
+        start = KTimeMsStamp();
+        for ( r = 0; r < ROUNDS; ++r )
+            for ( i = 0; i < NUM_READS; ++i )
+                old_fastq( out, coll, ( int64_t )r * NUM_READS + i + 1, reads[ i ] );
+        old_q = KTimeMsStamp() - start;
+
+        start = KTimeMsStamp();
+        for ( r = 0; r < ROUNDS; ++r )
+            for ( i = 0; i < NUM_READS; ++i )
+                old_fasta( out, coll, ( int64_t )r * NUM_READS + i + 1, reads[ i ], FASTA_WIDTH );
+        old_a = KTimeMsStamp() - start;
+    }
+
+    {
+        /* no auto-flush : the buffer is dropped instead of written, like the NullBuf above */
+        AFormatter fmt( coll, false );
+
+        start = KTimeMsStamp();
+        for ( r = 0; r < ROUNDS; ++r )
+            for ( i = 0; i < NUM_READS; ++i )
+            {
+                fmt_fastq( fmt, ( int64_t )r * NUM_READS + i + 1, reads[ i ] );
+                if ( fmt.size() >= AFormatter::_sM_flushSize ) fmt.clear();
+            }
+        new_q = KTimeMsStamp() - start;
+
+        start = KTimeMsStamp();
+        for ( r = 0; r < ROUNDS; ++r )
+            for ( i = 0; i < NUM_READS; ++i )
+            {
+                fmt_fasta( fmt, ( int64_t )r * NUM_READS + i + 1, reads[ i ] );
+                if ( fmt.size() >= AFormatter::_sM_flushSize ) fmt.clear();
+            }
+        new_a = KTimeMsStamp() - start;
+    }
+
+    KOutMsg( "fastq iostream    : %lu reads in %lu ms = %.0f reads/s\n", total, old_q, reads_per_sec( total, old_q ) );
+    KOutMsg( "fastq AFormatter  : %lu reads in %lu ms = %.0f reads/s\n", total, new_q, reads_per_sec( total, new_q ) );
+    KOutMsg( "fasta iostream    : %lu reads in %lu ms = %.0f reads/s\n", total, old_a, reads_per_sec( total, old_a ) );
+    KOutMsg( "fasta AFormatter  : %lu reads in %lu ms = %.0f reads/s\n", total, new_a, reads_per_sec( total, new_a ) );
+    return 0;
+}
@@ -0,0 +1,533 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the BAM-output of sam-dump ( tools/sra-pileup/bam_out.c, bgzf_writer.c, bam_index.c )
+        - the same records as SAM-text and through the bam_out_begin_record/tag/end-functions
+          have to give the same BAM
+        - the BGZF-blocks have to inflate ( checksum and size ), the file ends in the EOF-block,
+          the compressed bytes must not depend on the number of compressing threads
+        - records encoded by a worker-encoder ( sam-dump --threads ) travel as frames through
+          the output-buffer, they have to arrive intact even if the frames are split up
+        - a BAI-index for short references, a CSI-index if a reference is longer than 2^29
+-------------------------------------------------------------------------------------------- */
+
+#include "bam_out.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <klib/printf.h>
+
+#include <sysalloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define NUM_RECORDS 20000
+#define READ_LEN 50
+#define INDEX_BASE "test-bam-out.bam"
+
+const char UsageDefaultName[] = "test-bam-out";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+static const char HDR_SHORT[] = "@HD\tVN:1.4\tSO:coordinate\n@SQ\tSN:chr1\tLN:1000000\n";
+static const char HDR_LONG[] = "@HD\tVN:1.4\tSO:coordinate\n@SQ\tSN:chr1\tLN:1000000000\n";
+
+static const uint8_t BGZF_EOF[ 28 ] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+typedef struct membuf
+{
+    uint8_t * data;
+    size_t used, size;
+} membuf;
+
+
+static rc_t fail( const char * what, uint32_t idx )
+{
+    KOutMsg( "FAILED: %s ( #%u )\n", what, idx );
+    return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+}
+
+
+static rc_t membuf_put( membuf * self, const void * data, size_t size )
+{
+    if ( self->used + size > self->size )
+    {
+        size_t new_size = ( self->size == 0 ) ? 64 * 1024 : self->size;
+        uint8_t * tmp;
+        while ( new_size < self->used + size )
+            new_size *= 2;
+        tmp = realloc( self->data, new_size );
+        if ( tmp == NULL )
+            return RC( rcExe, rcNoTarg, rcWriting, rcMemory, rcExhausted );
+        self->data = tmp;
+        self->size = new_size;
+    }
+    memmove( self->data + self->used, data, size );
+    self->used += size;
+    return 0;
+}
+
+
+static rc_t CC membuf_writer( void * data, const char * buffer, size_t bytes, size_t * num_writ )
+{
+    *num_writ = bytes;
+    return membuf_put( data, buffer, bytes );
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static void make_read( uint32_t idx, char * seq, char * qual )
+{
+    uint32_t i;
+    for ( i = 0; i < READ_LEN; ++i )
+    {
+        seq[ i ] = "ACGTN"[ ( idx + i * 7 ) % 5 ];
+        qual[ i ] = ( char )( 33 + ( ( idx * 3 + i ) % 41 ) );
+    }
+    seq[ READ_LEN ] = 0;
+    qual[ READ_LEN ] = 0;
+}
+
+
+/* the record idx as SAM-text, the last one is unaligned */
+static rc_t record_text( membuf * dst, uint32_t idx )
+{
+    char seq[ READ_LEN + 1 ], qual[ READ_LEN + 1 ], line[ 1024 ];
+    size_t num_writ;
+    rc_t rc;
+    make_read( idx, seq, qual );
+    if ( idx + 1 < NUM_RECORDS )
+        rc = string_printf( line, sizeof line, &num_writ,
+                            "r%u\t%u\tchr1\t%u\t60\t20M2D30M\t*\t0\t0\t%s\t%s\tNM:i:%u\tRG:Z:grp%u\tXS:A:+\tMD:Z:20^AC30\tXI:i:%u\n",
+                            idx, ( idx & 1 ) ? 16 : 0, idx * 10 + 1, seq, qual, idx % 3, idx % 2, idx * 100000 );
+    else
+    {
+        /* the native record hands over the read as stored: not yet reversed, phred-values */
+        char rev_seq[ READ_LEN + 1 ], rev_qual[ READ_LEN + 1 ];
+        uint32_t i;
+        for ( i = 0; i < READ_LEN; ++i )
+        {
+            char c = seq[ READ_LEN - 1 - i ];
+            rev_seq[ i ] = ( c == 'A' ) ? 'T' : ( c == 'C' ) ? 'G' : ( c == 'G' ) ? 'C' : ( c == 'T' ) ? 'A' : 'N';
+            rev_qual[ i ] = qual[ READ_LEN - 1 - i ];
+        }
+        rev_seq[ READ_LEN ] = 0;
+        rev_qual[ READ_LEN ] = 0;
+        rc = string_printf( line, sizeof line, &num_writ,
+                            "r%u\t20\t*\t0\t0\t*\t*\t0\t0\t%s\t%s\tRG:Z:grp0\n", idx, rev_seq, rev_qual );
+    }
+    if ( rc == 0 )
+        rc = membuf_put( dst, line, num_writ );
+    return rc;
+}
+
+
+/* the record idx handed over field by field */
+static rc_t record_native( struct bam_out * bam, uint32_t idx )
+{
+    char seq[ READ_LEN + 1 ], qual[ READ_LEN + 1 ], qname[ 32 ], rg[ 16 ];
+    size_t qname_len, rg_len;
+    bam_rec_fields f;
+    rc_t rc;
+
+    make_read( idx, seq, qual );
+    rc = string_printf( qname, sizeof qname, &qname_len, "r%u", idx );
+    if ( rc == 0 )
+        rc = string_printf( rg, sizeof rg, &rg_len, "grp%u", ( idx + 1 < NUM_RECORDS ) ? idx % 2 : 0 );
+    if ( rc != 0 )
+        return rc;
+
+    memset( &f, 0, sizeof f );
+    f.qname = qname;
+    f.qname_len = ( uint32_t )qname_len;
+    f.rnext = "*";
+    f.rnext_len = 1;
+    f.pnext = -1;
+    f.seq = seq;
+    f.seq_len = READ_LEN;
+    f.qual = qual;
+    f.qual_len = READ_LEN;
+    if ( idx + 1 < NUM_RECORDS )
+    {
+        f.flag = ( idx & 1 ) ? 16 : 0;
+        f.rname = "chr1";
+        f.rname_len = 4;
+        f.pos = idx * 10;
+        f.mapq = 60;
+        f.cigar = "20M2D30M";
+        f.cigar_len = 8;
+        f.qual_offset = 33;
+    }
+    else
+    {
+        uint32_t i;
+        for ( i = 0; i < READ_LEN; ++i )
+            qual[ i ] -= 33;
+        f.flag = 20;
+        f.rname = "*";
+        f.rname_len = 1;
+        f.pos = -1;
+        f.cigar = "*";
+        f.cigar_len = 1;
+        f.qual_offset = 0;
+        f.reverse = true;
+    }
+
+    rc = bam_out_begin_record( bam, &f );
+    if ( rc == 0 && idx + 1 < NUM_RECORDS )
+    {
+        rc = bam_out_tag_int( bam, "NM", idx % 3 );
+        if ( rc == 0 )
+            rc = bam_out_tag_string( bam, "RG", rg, rg_len );
+        if ( rc == 0 )
+            rc = bam_out_tag_char( bam, "XS", '+' );
+        if ( rc == 0 )
+            rc = bam_out_tag_text( bam, "\tMD:Z:20^AC30", 13 );
+        if ( rc == 0 )
+            rc = bam_out_tag_int( bam, "XI", ( int64_t )idx * 100000 );
+    }
+    else if ( rc == 0 )
+        rc = bam_out_tag_string( bam, "RG", rg, rg_len );
+    if ( rc == 0 )
+        rc = bam_out_end_record( bam );
+    return rc;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static uint32_t get_le( const uint8_t * src, uint32_t bytes )
+{
+    uint32_t res = 0, i;
+    for ( i = 0; i < bytes; ++i )
+        res |= ( ( uint32_t )src[ i ] ) << ( 8 * i );
+    return res;
+}
+
+
+/* inflates every block of a BGZF-stream into dst, checks the checksums and the EOF-block */
+static rc_t inflate_bgzf( const uint8_t * src, size_t size, membuf * dst )
+{
+    uint32_t block_nr = 0;
+    size_t at = 0;
+    rc_t rc = 0;
+
+    if ( size < sizeof BGZF_EOF || memcmp( src + size - sizeof BGZF_EOF, BGZF_EOF, sizeof BGZF_EOF ) != 0 )
+        return fail( "BGZF-stream does not end in the EOF-block", 0 );
+
+    while ( rc == 0 && at < size )
+    {
+        const uint8_t * block = src + at;
+        uint32_t block_size, isize;
+        uint8_t out[ 0x10000 ];
+        z_stream zs;
+
+        if ( size - at < 26 || block[ 0 ] != 0x1f || block[ 1 ] != 0x8b || block[ 3 ] != 4 ||
+             get_le( block + 10, 2 ) != 6 || block[ 12 ] != 'B' || block[ 13 ] != 'C' )
+            return fail( "not a BGZF-block", block_nr );
+        block_size = get_le( block + 16, 2 ) + 1;
+        if ( block_size > size - at )
+            return fail( "BGZF-block larger than the stream", block_nr );
+        isize = get_le( block + block_size - 4, 4 );
+
+        memset( &zs, 0, sizeof zs );
+        if ( inflateInit2( &zs, -15 ) != Z_OK )
+            return fail( "inflateInit2", block_nr );
+        zs.next_in = ( Bytef * )( block + 18 );
+        zs.avail_in = block_size - 26;
+        zs.next_out = out;
+        zs.avail_out = sizeof out;
+        if ( inflate( &zs, Z_FINISH ) != Z_STREAM_END || zs.total_out != isize )
+            rc = fail( "BGZF-block does not inflate", block_nr );
+        else if ( crc32( crc32( 0, NULL, 0 ), out, isize ) != get_le( block + block_size - 8, 4 ) )
+            rc = fail( "BGZF-block checksum", block_nr );
+        else
+            rc = membuf_put( dst, out, isize );
+        inflateEnd( &zs );
+
+        at += block_size;
+        ++block_nr;
+    }
+    return rc;
+}
+
+
+/* the BAM of all records, written as SAM-text */
+static rc_t bam_from_text( membuf * dst, uint32_t threads, const char * hdr, const char * bam_filename )
+{
+    struct bam_out * bam;
+    rc_t rc = make_bam_out( &bam, membuf_writer, dst, threads, bam_filename );
+    if ( rc == 0 )
+    {
+        membuf text;
+        uint32_t idx;
+        memset( &text, 0, sizeof text );
+        rc = membuf_put( &text, hdr, strlen( hdr ) );
+        for ( idx = 0; rc == 0 && idx < NUM_RECORDS; ++idx )
+            rc = record_text( &text, idx );
+        /* in odd pieces: the lines must not need to arrive in one piece */
+        if ( rc == 0 )
+        {
+            size_t at;
+            for ( at = 0; rc == 0 && at < text.used; at += 4093 )
+                rc = bam_out_write( bam, ( const char * )text.data + at,
+                                    ( text.used - at < 4093 ) ? text.used - at : 4093 );
+        }
+        if ( rc == 0 )
+            rc = finish_bam_out( bam );
+        release_bam_out( bam );
+        free( text.data );
+    }
+    return rc;
+}
+
+
+/* the same records through the encoder-API */
+static rc_t bam_from_native( membuf * dst, uint32_t threads )
+{
+    struct bam_out * bam;
+    rc_t rc = make_bam_out( &bam, membuf_writer, dst, threads, NULL );
+    if ( rc == 0 )
+    {
+        uint32_t idx;
+        rc = bam_out_write( bam, HDR_SHORT, strlen( HDR_SHORT ) );
+        for ( idx = 0; rc == 0 && idx < NUM_RECORDS; ++idx )
+            rc = record_native( bam, idx );
+        if ( rc == 0 )
+            rc = finish_bam_out( bam );
+        release_bam_out( bam );
+    }
+    return rc;
+}
+
+
+/* the records encoded by a worker-encoder into the KOut-stream ( as in the out_buffers of
+   the sam-dump-threads ), with a text-line in between, fed to the parent in small pieces */
+static rc_t bam_from_worker( membuf * dst, uint32_t threads )
+{
+    struct bam_out * bam;
+    rc_t rc = make_bam_out( &bam, membuf_writer, dst, threads, NULL );
+    if ( rc == 0 )
+    {
+        struct bam_out * worker = NULL;
+        membuf frames;
+
+        memset( &frames, 0, sizeof frames );
+        rc = bam_out_write( bam, HDR_SHORT, strlen( HDR_SHORT ) );
+        if ( rc == 0 )
+            rc = bam_out_write_header( bam );
+        if ( rc == 0 )
+            rc = make_bam_out_worker( &worker, bam );
+        if ( rc == 0 )
+        {
+            KWrtWriter org_writer = KOutWriterGet();
+            void * org_data = KOutDataGet();
+            rc = KOutHandlerSet( membuf_writer, &frames );
+            if ( rc == 0 )
+            {
+                uint32_t idx;
+                attach_bam_out( worker );
+                if ( bam_redir_current() != worker )
+                    rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                for ( idx = 0; rc == 0 && idx < NUM_RECORDS; ++idx )
+                {
+                    if ( idx == NUM_RECORDS / 2 )
+                    {
+                        membuf line;
+                        memset( &line, 0, sizeof line );
+                        rc = record_text( &line, idx );
+                        if ( rc == 0 )
+                            rc = KOutMsg( "%.*s", ( uint32_t )line.used, line.data );
+                        free( line.data );
+                    }
+                    else
+                        rc = record_native( worker, idx );
+                }
+                attach_bam_out( NULL );
+                KOutHandlerSet( org_writer, org_data );
+            }
+            release_bam_out( worker );
+        }
+        if ( rc == 0 )
+        {
+            size_t at;
+            for ( at = 0; rc == 0 && at < frames.used; at += 7 )
+                rc = bam_out_write( bam, ( const char * )frames.data + at,
+                                    ( frames.used - at < 7 ) ? frames.used - at : 7 );
+        }
+        if ( rc == 0 )
+            rc = finish_bam_out( bam );
+        release_bam_out( bam );
+        free( frames.data );
+    }
+    return rc;
+}
+
+
+static rc_t compare( const membuf * a, const membuf * b, const char * what )
+{
+    if ( a->used != b->used || memcmp( a->data, b->data, a->used ) != 0 )
+        return fail( what, 0 );
+    return 0;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static rc_t test_bgzf( void )
+{
+    membuf text1, text4, native, worker, bam1, bam2;
+    rc_t rc;
+
+    memset( &text1, 0, sizeof text1 );
+    memset( &text4, 0, sizeof text4 );
+    memset( &native, 0, sizeof native );
+    memset( &worker, 0, sizeof worker );
+    memset( &bam1, 0, sizeof bam1 );
+    memset( &bam2, 0, sizeof bam2 );
+
+    rc = bam_from_text( &text1, 1, HDR_SHORT, NULL );
+    if ( rc == 0 )
+        rc = bam_from_text( &text4, 4, HDR_SHORT, NULL );
+    if ( rc == 0 )
+        rc = compare( &text1, &text4, "BGZF-output depends on the number of threads" );
+    if ( rc == 0 )
+        rc = inflate_bgzf( text1.data, text1.used, &bam1 );
+    if ( rc == 0 && ( bam1.used < 4 || memcmp( bam1.data, "BAM\1", 4 ) != 0 ) )
+        rc = fail( "BAM-magic", 0 );
+    if ( rc == 0 && bam1.used < 4 * 0x10000 )
+        rc = fail( "expected more than one BGZF-block", 0 );
+
+    if ( rc == 0 )
+        rc = bam_from_native( &native, 3 );
+    if ( rc == 0 )
+        rc = inflate_bgzf( native.data, native.used, &bam2 );
+    if ( rc == 0 )
+        rc = compare( &bam1, &bam2, "encoder-API differs from SAM-text" );
+
+    if ( rc == 0 )
+    {
+        bam2.used = 0;
+        rc = bam_from_worker( &worker, 2 );
+    }
+    if ( rc == 0 )
+        rc = inflate_bgzf( worker.data, worker.used, &bam2 );
+    if ( rc == 0 )
+        rc = compare( &bam1, &bam2, "worker-encoder differs from SAM-text" );
+
+    free( text1.data );
+    free( text4.data );
+    free( native.data );
+    free( worker.data );
+    free( bam1.data );
+    free( bam2.data );
+    if ( rc == 0 )
+        KOutMsg( "bam-out bgzf: ok\n" );
+    return rc;
+}
+
+
+/* reads the start of the index-file and removes it */
+static rc_t read_index( const char * extension, uint8_t * buf, size_t buf_size, size_t * num_read )
+{
+    char filename[ 256 ];
+    size_t num_writ;
+    rc_t rc = string_printf( filename, sizeof filename, &num_writ, "%s.%s", INDEX_BASE, extension );
+    if ( rc == 0 )
+    {
+        FILE * f = fopen( filename, "rb" );
+        if ( f == NULL )
+            rc = fail( "index-file not written", 0 );
+        else
+        {
+            *num_read = fread( buf, 1, buf_size, f );
+            fclose( f );
+            remove( filename );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t test_index( void )
+{
+    static uint8_t buf[ 1024 * 1024 ];
+    membuf out, csi;
+    size_t num_read;
+    rc_t rc;
+
+    memset( &out, 0, sizeof out );
+    memset( &csi, 0, sizeof csi );
+
+    rc = bam_from_text( &out, 2, HDR_SHORT, INDEX_BASE );
+    if ( rc == 0 )
+        rc = read_index( "bai", buf, sizeof buf, &num_read );
+    if ( rc == 0 && ( num_read < 8 || memcmp( buf, "BAI\1", 4 ) != 0 ) )
+        rc = fail( "BAI-magic", 0 );
+    if ( rc == 0 && get_le( buf + 4, 4 ) != 1 )
+        rc = fail( "BAI: number of references", get_le( buf + 4, 4 ) );
+
+    if ( rc == 0 )
+    {
+        out.used = 0;
+        rc = bam_from_text( &out, 2, HDR_LONG, INDEX_BASE );
+    }
+    if ( rc == 0 )
+        rc = read_index( "csi", buf, sizeof buf, &num_read );
+    if ( rc == 0 && num_read == sizeof buf )
+        rc = fail( "CSI-index unexpectedly large", 0 );
+    /* a CSI-index is BGZF-compressed */
+    if ( rc == 0 )
+        rc = inflate_bgzf( buf, num_read, &csi );
+    if ( rc == 0 && ( csi.used < 20 || memcmp( csi.data, "CSI\1", 4 ) != 0 ) )
+        rc = fail( "CSI-magic", 0 );
+    if ( rc == 0 && get_le( csi.data + 16, 4 ) != 1 )
+        rc = fail( "CSI: number of references", get_le( csi.data + 16, 4 ) );
+
+    free( out.data );
+    free( csi.data );
+    if ( rc == 0 )
+        KOutMsg( "bam-out index: ok\n" );
+    return rc;
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    rc_t rc = test_bgzf();
+    if ( rc == 0 )
+        rc = test_index();
+    return rc;
+}
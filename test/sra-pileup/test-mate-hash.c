@@ -0,0 +1,342 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the open-addressing hash-table of the mate-cache ( tools/sra-pileup/mate_hash.c )
+    every operation is mirrored in a plain array, the table has to agree with it:
+        - inserts into an empty table ( it grows several times ), overwrites
+        - removes ( backward-shift deletion, no tombstones ), also in a cluster that wraps around
+        - eviction by callback while the table is scanned: every entry has to be offered
+        - the sorted mode: order, lookups, removes, eviction and turning back into a table
+-------------------------------------------------------------------------------------------- */
+
+#include "mate_hash.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_KEYS ( 100 * 1000 )
+
+const char UsageDefaultName[] = "test-mate-hash";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+typedef struct model
+{
+    int64_t keys[ NUM_KEYS ];
+    uint64_t values[ NUM_KEYS ];
+    bool present[ NUM_KEYS ];
+    bool offered[ NUM_KEYS ];
+    uint64_t count;
+} model;
+
+
+static int64_t key_of( uint32_t idx )
+{
+    /* distinct, never 0, positive and negative, clustered and spread */
+    int64_t k = ( int64_t )( idx + 1 ) * 0x10001;
+    return ( idx & 1 ) ? -k : k;
+}
+
+
+/* the value carries the index of the key in the model */
+static uint32_t idx_of_value( uint64_t value )
+{
+    return ( uint32_t )( value & 0xFFFFFFFF );
+}
+
+
+static rc_t fail( const char * what )
+{
+    KOutMsg( "FAILED: %s\n", what );
+    return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+}
+
+
+/* the table has exactly the entries of the model */
+static rc_t compare( const mate_hash * h, const model * m, const char * what )
+{
+    uint32_t idx;
+    if ( h->count != m->count )
+    {
+        KOutMsg( "%s: count = %lu, expected %lu\n", what, h->count, m->count );
+        return fail( what );
+    }
+    for ( idx = 0; idx < NUM_KEYS; ++idx )
+    {
+        uint64_t value, aux;
+        bool found = mate_hash_get( h, m->keys[ idx ], &value, &aux );
+        if ( found != m->present[ idx ] ||
+             ( found && ( value != m->values[ idx ] || aux != ( uint64_t )m->keys[ idx ] ) ) )
+        {
+            KOutMsg( "%s: key #%u\n", what, idx );
+            return fail( what );
+        }
+    }
+    return 0;
+}
+
+
+static rc_t put( mate_hash * h, model * m, uint32_t idx, uint64_t generation )
+{
+    uint64_t value = ( generation << 32 ) | idx;
+    rc_t rc = mate_hash_put( h, m->keys[ idx ], value, ( uint64_t )m->keys[ idx ] );
+    if ( rc == 0 )
+    {
+        if ( !m->present[ idx ] )
+            m->count++;
+        m->present[ idx ] = true;
+        m->values[ idx ] = value;
+    }
+    return rc;
+}
+
+
+static rc_t remove_key( mate_hash * h, model * m, uint32_t idx, const char * what )
+{
+    bool removed = mate_hash_remove( h, m->keys[ idx ] );
+    if ( removed != m->present[ idx ] )
+        return fail( what );
+    if ( removed )
+    {
+        m->present[ idx ] = false;
+        m->count--;
+    }
+    return 0;
+}
+
+
+/* evicts every key whose index is divisible by 'divisor', records what has been offered */
+typedef struct evict_ctx
+{
+    model * m;
+    uint32_t divisor;
+} evict_ctx;
+
+static bool CC evict_cb( const mate_hash_entry * entry, void * data )
+{
+    evict_ctx * ctx = data;
+    uint32_t idx = idx_of_value( entry->value );
+    ctx->m->offered[ idx ] = true;
+    return ( ( idx % ctx->divisor ) == 0 );
+}
+
+static rc_t evict( mate_hash * h, model * m, uint32_t divisor, const char * what )
+{
+    evict_ctx ctx;
+    uint64_t expected = 0, removed;
+    uint32_t idx;
+
+    ctx.m = m;
+    ctx.divisor = divisor;
+    memset( m->offered, 0, sizeof m->offered );
+    removed = mate_hash_evict( h, evict_cb, &ctx );
+    for ( idx = 0; idx < NUM_KEYS; ++idx )
+    {
+        if ( m->present[ idx ] )
+        {
+            /* an entry moved by a delete must not be skipped by the scan */
+            if ( !m->offered[ idx ] )
+            {
+                KOutMsg( "%s: key #%u has not been offered\n", what, idx );
+                return fail( what );
+            }
+            if ( ( idx % divisor ) == 0 )
+            {
+                m->present[ idx ] = false;
+                m->count--;
+                expected++;
+            }
+        }
+    }
+    if ( removed != expected )
+        return fail( what );
+    return compare( h, m, what );
+}
+
+
+/* a cluster at the end of a table with 1024 slots wraps around to slot 0,
+   every key is removed once from it, in a different place each time */
+#define WRAP_KEYS 24
+
+static rc_t check_wrap_around( void )
+{
+    rc_t rc = 0;
+    int64_t keys[ WRAP_KEYS ];
+    uint32_t n = 0, removed;
+    int64_t k;
+
+    /* the same hashing as mate_hash_slot() for 1024 slots */
+    for ( k = 1; n < WRAP_KEYS; ++k )
+    {
+        if ( ( ( ( uint64_t )k * 0x9E3779B97F4A7C15ULL ) >> 54 ) >= 1020 )
+            keys[ n++ ] = k;
+    }
+    for ( removed = 0; rc == 0 && removed < WRAP_KEYS; ++removed )
+    {
+        mate_hash h;
+        uint32_t idx;
+        rc = init_mate_hash( &h, 1024 );
+        for ( idx = 0; rc == 0 && idx < WRAP_KEYS; ++idx )
+            rc = mate_hash_put( &h, keys[ idx ], idx, 0 );
+        if ( rc == 0 && ( h.capacity != 1024 || h.entries[ 0 ].key == 0 ) )
+            rc = fail( "the cluster wraps around" );
+        if ( rc == 0 && !mate_hash_remove( &h, keys[ removed ] ) )
+            rc = fail( "remove from a wrapped cluster" );
+        for ( idx = 0; rc == 0 && idx < WRAP_KEYS; ++idx )
+        {
+            uint64_t value;
+            bool found = mate_hash_get( &h, keys[ idx ], &value, NULL );
+            if ( found != ( idx != removed ) || ( found && value != idx ) )
+                rc = fail( "lookup in a wrapped cluster after remove" );
+        }
+        release_mate_hash( &h );
+    }
+    return rc;
+}
+
+
+static rc_t check_sorted( const mate_hash * h, const char * what )
+{
+    uint64_t idx;
+    if ( !h->sorted )
+        return fail( what );
+    for ( idx = 1; idx < h->count; ++idx )
+    {
+        if ( h->entries[ idx - 1 ].key >= h->entries[ idx ].key )
+            return fail( what );
+    }
+    return 0;
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    rc_t rc = 0;
+    mate_hash h;
+    model * m = calloc( 1, sizeof * m );
+    uint32_t idx;
+
+    if ( m == NULL )
+        return RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    for ( idx = 0; idx < NUM_KEYS; ++idx )
+        m->keys[ idx ] = key_of( idx );
+
+    /* capacity 0: nothing allocated until the first put, then it grows */
+    rc = init_mate_hash( &h, 0 );
+    if ( rc == 0 && ( h.entries != NULL || mate_hash_get( &h, 1, NULL, NULL ) || mate_hash_remove( &h, 1 ) ) )
+        rc = fail( "empty table" );
+    if ( rc == 0 && mate_hash_put( &h, 0, 1, 1 ) == 0 )
+        rc = fail( "key 0 is rejected" );
+
+    for ( idx = 0; rc == 0 && idx < NUM_KEYS; ++idx )
+        rc = put( &h, m, idx, 1 );
+    if ( rc == 0 )
+        rc = compare( &h, m, "insert and grow" );
+    if ( rc == 0 && ( h.count * 4 > h.capacity * 3 ) )
+        rc = fail( "load-factor below 3/4" );
+
+    if ( rc == 0 )
+        rc = check_wrap_around();
+
+    /* overwrite every 3rd key: the count must not change */
+    for ( idx = 0; rc == 0 && idx < NUM_KEYS; idx += 3 )
+        rc = put( &h, m, idx, 2 );
+    if ( rc == 0 )
+        rc = compare( &h, m, "overwrite" );
+
+    /* remove every 2nd key, then some twice */
+    for ( idx = 0; rc == 0 && idx < NUM_KEYS; idx += 2 )
+        rc = remove_key( &h, m, idx, "remove" );
+    for ( idx = 0; rc == 0 && idx < NUM_KEYS; idx += 10 )
+        rc = remove_key( &h, m, idx, "remove a removed key" );
+    if ( rc == 0 )
+        rc = compare( &h, m, "backward-shift delete" );
+
+    /* put the removed keys back: the clusters are intact */
+    for ( idx = 0; rc == 0 && idx < NUM_KEYS; idx += 4 )
+        rc = put( &h, m, idx, 3 );
+    if ( rc == 0 )
+        rc = compare( &h, m, "insert after delete" );
+
+    /* evict during the scan, twice, the second time the table shrinks */
+    if ( rc == 0 )
+        rc = evict( &h, m, 3, "evict 1/3" );
+    if ( rc == 0 )
+        rc = evict( &h, m, 1, "evict all" );
+    if ( rc == 0 && ( h.entries != NULL || h.capacity != 0 ) )
+        rc = fail( "an empty table gives its memory back" );
+
+    for ( idx = 0; rc == 0 && idx < NUM_KEYS; ++idx )
+        rc = put( &h, m, idx, 4 );
+    if ( rc == 0 )
+        rc = evict( &h, m, 5, "evict 1/5 after refill" );
+
+    /* the sorted mode */
+    if ( rc == 0 )
+    {
+        mate_hash_sort( &h );
+        rc = check_sorted( &h, "sort" );
+    }
+    if ( rc == 0 )
+        rc = compare( &h, m, "lookup in sorted mode" );
+    for ( idx = 1; rc == 0 && idx < NUM_KEYS; idx += 7 )
+        rc = remove_key( &h, m, idx, "remove in sorted mode" );
+    if ( rc == 0 )
+        rc = check_sorted( &h, "sorted after remove" );
+    if ( rc == 0 )
+        rc = compare( &h, m, "remove in sorted mode" );
+    if ( rc == 0 )
+        rc = evict( &h, m, 11, "evict in sorted mode" );
+    if ( rc == 0 )
+        rc = check_sorted( &h, "sorted after evict" );
+
+    /* a put turns it back into a hash-table */
+    if ( rc == 0 )
+        rc = put( &h, m, 1, 5 );
+    if ( rc == 0 && h.sorted )
+        rc = fail( "put leaves the sorted mode" );
+    if ( rc == 0 )
+        rc = compare( &h, m, "back from sorted mode" );
+
+    if ( rc == 0 )
+    {
+        mate_hash_clear( &h );
+        if ( h.count != 0 || mate_hash_bytes( &h ) != 0 )
+            rc = fail( "clear" );
+    }
+
+    release_mate_hash( &h );
+    free( m );
+    if ( rc == 0 )
+        KOutMsg( "mate-hash: ok\n" );
+    return rc;
+}
@@ -0,0 +1,204 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the spill-file of the mate-cache ( tools/sra-pileup/matecache.c, --mate-cache-mem )
+    a walker moves over one reference, at every position it
+        - advances the cache ( that reloads the spilled runs that are due )
+        - finds and removes the alignments whose mate is at this position
+        - inserts an alignment whose mate is further ahead
+    the memory-limit is so small that the cache has to spill and reload many times,
+    every alignment has to be found at its mate-position with its values intact
+-------------------------------------------------------------------------------------------- */
+
+#include "matecache.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_FILES 2
+#define NUM_POSITIONS ( 300 * 1000 )
+#define MAX_DISTANCE 40000
+#define MEM_LIMIT ( 64 * 1024 )
+
+const char UsageDefaultName[] = "test-matecache";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+/* per input-file: the alignment inserted at pos has its mate at mate_pos[ pos ] */
+typedef struct walk
+{
+    INSDC_coord_zero mate_pos[ NUM_FILES ][ NUM_POSITIONS ];
+    /* the positions an alignment has its mate at, as a list per position */
+    int32_t first[ NUM_FILES ][ NUM_POSITIONS + MAX_DISTANCE + 1 ];
+    int32_t next[ NUM_FILES ][ NUM_POSITIONS ];
+    uint64_t found;
+} walk;
+
+
+static rc_t fail( const char * what, uint32_t db_idx, INSDC_coord_zero pos )
+{
+    KOutMsg( "FAILED: %s ( file #%u, pos %d )\n", what, db_idx, pos );
+    return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+}
+
+
+static void init_walk( walk * w )
+{
+    uint32_t db_idx;
+    INSDC_coord_zero pos;
+    memset( w->first, 0xFF, sizeof w->first );
+    for ( db_idx = 0; db_idx < NUM_FILES; ++db_idx )
+    {
+        for ( pos = 0; pos < NUM_POSITIONS; ++pos )
+        {
+            /* near and far mates mixed, the second file has more distant ones */
+            uint32_t d = ( ( uint32_t )pos * 7919 + db_idx * 104729 ) % ( MAX_DISTANCE / ( 2 - db_idx ) );
+            INSDC_coord_zero mate = pos + 1 + d;
+            w->mate_pos[ db_idx ][ pos ] = mate;
+            w->next[ db_idx ][ pos ] = w->first[ db_idx ][ mate ];
+            w->first[ db_idx ][ mate ] = pos;
+        }
+    }
+    w->found = 0;
+}
+
+
+static int64_t key_of( INSDC_coord_zero pos ) { return ( int64_t )pos * 3 + 1; }
+static uint32_t flags_of( INSDC_coord_zero pos ) { return ( pos & 0xFFF ); }
+static INSDC_coord_len tlen_of( INSDC_coord_zero pos ) { return ( ( uint32_t )pos * 11 ) ^ 0x80000000; }
+
+
+/* the alignments whose mate is at pos */
+static rc_t check_mates( matecache * mc, walk * w, uint32_t db_idx, INSDC_coord_zero pos )
+{
+    rc_t rc = 0;
+    int32_t p;
+    for ( p = w->first[ db_idx ][ pos ]; rc == 0 && p >= 0; p = w->next[ db_idx ][ p ] )
+    {
+        INSDC_coord_zero ref_pos;
+        uint32_t flags;
+        INSDC_coord_len tlen;
+        if ( matecache_lookup_same_ref( mc, db_idx, key_of( p ), &ref_pos, &flags, &tlen ) != 0 )
+            rc = fail( "mate not found", db_idx, pos );
+        else if ( ref_pos != p || flags != flags_of( p ) || tlen != tlen_of( p ) )
+            rc = fail( "wrong values for the mate", db_idx, pos );
+        else
+        {
+            rc = matecache_remove_same_ref( mc, db_idx, key_of( p ) );
+            w->found++;
+        }
+    }
+    return rc;
+}
+
+
+/* alignments are inserted up to end, the walk stops at stop */
+static rc_t walk_reference( matecache * mc, walk * w, INSDC_coord_zero end, INSDC_coord_zero stop )
+{
+    rc_t rc = 0;
+    INSDC_coord_zero pos;
+    for ( pos = 0; rc == 0 && pos < stop; ++pos )
+    {
+        uint32_t db_idx;
+        rc = matecache_advance_same_ref( mc, pos );
+        for ( db_idx = 0; rc == 0 && db_idx < NUM_FILES; ++db_idx )
+        {
+            rc = check_mates( mc, w, db_idx, pos );
+            if ( rc == 0 && pos < end )
+                rc = matecache_insert_same_ref( mc, db_idx, key_of( pos ), pos,
+                            flags_of( pos ), tlen_of( pos ), w->mate_pos[ db_idx ][ pos ] );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t check_empty( const matecache * mc, const char * what )
+{
+    uint32_t db_idx;
+    for ( db_idx = 0; db_idx < NUM_FILES; ++db_idx )
+    {
+        if ( mc->per_file[ db_idx ].same_ref.count != 0 || mc->per_file[ db_idx ].run_count != 0 )
+            return fail( what, db_idx, 0 );
+    }
+    return 0;
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    matecache * mc;
+    walk * w = malloc( sizeof * w );
+    rc_t rc = ( w == NULL ) ? RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted ) : 0;
+
+    if ( rc == 0 )
+    {
+        init_walk( w );
+        rc = make_matecache( &mc, NUM_FILES, MEM_LIMIT );
+    }
+    if ( rc == 0 )
+    {
+        /* a reference that ends in the middle, with runs still in the spill-file:
+           the next reference starts from scratch and reuses the spill-file */
+        rc = walk_reference( mc, w, NUM_POSITIONS, NUM_POSITIONS / 3 );
+        if ( rc == 0 && mc->spills == 0 )
+            rc = fail( "the first reference has to spill", 0, 0 );
+        if ( rc == 0 && mc->per_file[ 0 ].run_count + mc->per_file[ 1 ].run_count == 0 )
+            rc = fail( "the first reference ends with spilled runs", 0, 0 );
+        if ( rc == 0 )
+            rc = matecache_clear_same_ref( mc );
+        if ( rc == 0 )
+            rc = check_empty( mc, "clear" );
+
+        if ( rc == 0 )
+        {
+            uint32_t spills = mc->spills;
+            init_walk( w );
+            rc = walk_reference( mc, w, NUM_POSITIONS, NUM_POSITIONS + MAX_DISTANCE + 1 );
+            if ( rc == 0 && w->found != ( uint64_t )NUM_FILES * NUM_POSITIONS )
+                rc = fail( "not every mate found", 0, 0 );
+            if ( rc == 0 && mc->spills == spills )
+                rc = fail( "the second reference has to spill", 0, 0 );
+        }
+        if ( rc == 0 && ( mc->per_file[ 0 ].reloaded == 0 || mc->per_file[ 1 ].reloaded == 0 ) )
+            rc = fail( "nothing reloaded", 0, 0 );
+        if ( rc == 0 )
+            rc = check_empty( mc, "end of the reference" );
+        if ( rc == 0 )
+            rc = matecache_report( mc );
+        release_matecache( mc );
+    }
+    free( w );
+    if ( rc == 0 )
+        KOutMsg( "matecache: ok\n" );
+    return rc;
+}
@@ -0,0 +1,256 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the reader for the columnar pileup-format ( tools/sra-pileup/pileup_columnar_reader.c )
+    writes a valid file ( one plain and one deflated block ) and files with broken headers,
+    the reader has to return the blocks of the valid one and reject the others without
+    reading past the end of the file
+    the file is written byte by byte in little-endian order, independent of the host
+-------------------------------------------------------------------------------------------- */
+
+#include "pileup_columnar_reader.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+
+#include <sysalloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define TEST_FILE "test-pcol-reader.pcol"
+#define COUNT 100
+#define REF_NAME "chr1"
+
+const char UsageDefaultName[] = "test-pcol-reader";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+static uint8_t raw[ PCOL_RAW_SIZE( COUNT ) ];
+static uint8_t packed[ 2 * PCOL_RAW_SIZE( COUNT ) + 64 ];
+static uint8_t file_buf[ 4 * PCOL_RAW_SIZE( COUNT ) + 1024 ];
+
+
+static void put_le( uint8_t * dst, uint64_t value, uint32_t bytes )
+{
+    uint32_t i;
+    for ( i = 0; i < bytes; ++i )
+        dst[ i ] = ( uint8_t )( value >> ( 8 * i ) );
+}
+
+
+/* values > 0xFFFF, so that a wrong byte-order shows */
+static uint32_t column_value( uint32_t column, uint32_t idx )
+{
+    return ( column == pcol_pos ) ? 0x12340000 + idx : column * 0x10101 * idx;
+}
+
+
+static void make_raw( void )
+{
+    uint32_t i, c;
+    for ( c = 0; c < pcol_u32_columns; ++c )
+    {
+        for ( i = 0; i < COUNT; ++i )
+            put_le( raw + ( ( ( size_t )c * COUNT + i ) * sizeof( uint32_t ) ), column_value( c, i ), 4 );
+    }
+    for ( i = 0; i < COUNT; ++i )
+        raw[ ( size_t )pcol_u32_columns * COUNT * sizeof( uint32_t ) + i ] = "ACGT"[ i & 3 ];
+}
+
+
+static void store_header( size_t at, const pcol_block_header * hdr )
+{
+    uint8_t * dst = file_buf + at;
+    memmove( dst, hdr->magic, sizeof hdr->magic );
+    put_le( dst + 4, hdr->version, 2 );
+    put_le( dst + 6, hdr->flags, 2 );
+    put_le( dst + 8, hdr->name_len, 4 );
+    put_le( dst + 12, hdr->count, 4 );
+    put_le( dst + 16, hdr->payload_size, 8 );
+    put_le( dst + 24, hdr->raw_size, 8 );
+}
+
+
+/* appends a block, the header can be changed after the payload is in place */
+static size_t put_block( size_t at, const uint8_t * payload, uint64_t payload_size, uint16_t flags,
+                         pcol_block_header * hdr )
+{
+    size_t name_len = strlen( REF_NAME );
+    memset( hdr, 0, sizeof * hdr );
+    memmove( hdr->magic, PCOL_MAGIC, sizeof hdr->magic );
+    hdr->version = PCOL_VERSION;
+    hdr->flags = flags;
+    hdr->name_len = ( uint32_t )name_len;
+    hdr->count = COUNT;
+    hdr->payload_size = payload_size;
+    hdr->raw_size = PCOL_RAW_SIZE( COUNT );
+    store_header( at, hdr );
+    memset( file_buf + at + sizeof * hdr, 0, PCOL_PAD8( name_len ) );
+    memmove( file_buf + at + sizeof * hdr, REF_NAME, name_len );
+    at += sizeof * hdr + PCOL_PAD8( name_len );
+    memset( file_buf + at, 0, PCOL_PAD8( payload_size ) );
+    memmove( file_buf + at, payload, payload_size );
+    return at + PCOL_PAD8( payload_size );
+}
+
+
+static int write_file( size_t size )
+{
+    FILE * f = fopen( TEST_FILE, "wb" );
+    int res = ( f == NULL ) ? -1 : 0;
+    if ( f != NULL )
+    {
+        if ( fwrite( file_buf, 1, size, f ) != size )
+            res = -1;
+        fclose( f );
+    }
+    return res;
+}
+
+
+/* reads all blocks, returns the number of valid blocks or the negative error */
+static int read_blocks( bool verify )
+{
+    pcol_reader * reader;
+    int res = pcol_reader_open( &reader, TEST_FILE );
+    if ( res != 0 )
+        return -res;
+    else
+    {
+        pcol_block block;
+        int blocks = 0;
+        while ( ( res = pcol_reader_next( reader, &block ) ) == 1 )
+        {
+            if ( verify )
+            {
+                uint32_t c, i;
+                if ( block.count != COUNT || block.ref_name_len != strlen( REF_NAME ) ||
+                     memcmp( block.ref_name, REF_NAME, block.ref_name_len ) != 0 )
+                    res = -EINVAL;
+                for ( c = 0; res == 1 && c < pcol_u32_columns; ++c )
+                {
+                    for ( i = 0; res == 1 && i < COUNT; ++i )
+                    {
+                        if ( block.column[ c ][ i ] != column_value( c, i ) )
+                            res = -EINVAL;
+                    }
+                }
+                for ( i = 0; res == 1 && i < COUNT; ++i )
+                {
+                    if ( block.ref_base[ i ] != "ACGT"[ i & 3 ] )
+                        res = -EINVAL;
+                }
+                if ( res != 1 )
+                    break;
+            }
+            blocks++;
+        }
+        pcol_reader_close( reader );
+        return ( res < 0 ) ? res : blocks;
+    }
+}
+
+
+static rc_t expect( const char * what, int res, int expected )
+{
+    if ( res == expected )
+        return 0;
+    KOutMsg( "%s: %d, expected %d\n", what, res, expected );
+    return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    rc_t rc = 0;
+    pcol_block_header hdr;
+    uLongf packed_size = sizeof packed;
+    size_t first_end, size;
+
+    make_raw();
+    if ( compress( packed, &packed_size, raw, sizeof raw ) != Z_OK )
+        return RC( rcExe, rcNoTarg, rcConstructing, rcData, rcInvalid );
+
+    /* a valid file: one plain, one deflated block */
+    first_end = put_block( 0, raw, sizeof raw, 0, &hdr );
+    size = put_block( first_end, packed, packed_size, PCOL_FLAG_DEFLATE, &hdr );
+    if ( write_file( size ) == 0 )
+        rc = expect( "valid file", read_blocks( true ), 2 );
+
+    /* the file ends inside the payload of the second block */
+    if ( rc == 0 && write_file( size - 16 ) == 0 )
+        rc = expect( "truncated file", read_blocks( false ), -EINVAL );
+
+    /* payload_size that wraps around when padded to 8 */
+    if ( rc == 0 )
+    {
+        hdr.payload_size = ( uint64_t )-3;
+        store_header( first_end, &hdr );
+        if ( write_file( size ) == 0 )
+            rc = expect( "payload_size = 2^64-3", read_blocks( false ), -EINVAL );
+    }
+
+    /* payload_size beyond the end of the file */
+    if ( rc == 0 )
+    {
+        hdr.payload_size = size;
+        store_header( first_end, &hdr );
+        if ( write_file( size ) == 0 )
+            rc = expect( "payload_size > file", read_blocks( false ), -EINVAL );
+    }
+
+    /* a reference-name longer than the file */
+    if ( rc == 0 )
+    {
+        hdr.payload_size = packed_size;
+        hdr.name_len = 0xFFFFFFFF;
+        store_header( first_end, &hdr );
+        if ( write_file( size ) == 0 )
+            rc = expect( "name_len = 2^32-1", read_blocks( false ), -EINVAL );
+    }
+
+    /* more positions than a block can have */
+    if ( rc == 0 )
+    {
+        hdr.name_len = ( uint32_t )strlen( REF_NAME );
+        hdr.count = 0xFFFFFFFF;
+        hdr.raw_size = PCOL_RAW_SIZE( hdr.count );
+        store_header( first_end, &hdr );
+        if ( write_file( size ) == 0 )
+            rc = expect( "count = 2^32-1", read_blocks( false ), -EINVAL );
+    }
+
+    if ( rc == 0 )
+        KOutMsg( "columnar reader: ok\n" );
+    unlink( TEST_FILE );
+    return rc;
+}
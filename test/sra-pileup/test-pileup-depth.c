@@ -0,0 +1,314 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test and depth-stress benchmark for the per-position counters in tools/sra-pileup/pileup_histogram.c
+    every kernel the CPU supports is forced in turn:
+        - it counts random codes of odd lengths, lengths around the vector-widths and
+          lengths that need the 255-rounds widening, and has to agree with a per-code count
+        - positions with a very high coverage ( amplicon-data ) are simulated, one byte per
+          alignment is collected like the walker does and counted, the result has to agree
+          with a straight per-alignment count, the throughput is reported
+
+    test-pileup-depth [ depth ]     ( runtests uses a small depth )
+-------------------------------------------------------------------------------------------- */
+
+#include "pileup_histogram.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <klib/time.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_DEPTH ( 256 * 1024 )
+#define POSITIONS 64
+#define ROUNDS 5
+#define QUAL_LEN 8
+#define MIN_BASE_QUAL 20
+
+const char UsageDefaultName[] = "test-pileup-depth";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+static const char * kernels[] = { "portable", "sse2", "avx2" };
+
+/* around the 16 / 32 - byte vectors, and around 255 rounds of them ( the byte-lanes are widened ) */
+static const uint32_t check_lengths[] =
+{
+    0, 1, 2, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 151,
+    255 * 16 - 1, 255 * 16, 255 * 16 + 1, 255 * 16 + 17,
+    255 * 32 - 1, 255 * 32, 255 * 32 + 1, 255 * 32 + 33,
+    2 * 255 * 32 + 7
+};
+
+#define MAX_CHECK_LEN ( 2 * 255 * 32 + 7 )
+
+/* a random state: mostly matches, some mismatches / skips / indels */
+static int32_t random_state( void )
+{
+    int32_t r = rand() % 100;
+    int32_t state;
+    if ( r < 85 )
+        state = align_iter_match;
+    else if ( r < 95 )
+        state = 1 << ( rand() & 3 );        /* mismatch A/C/G/T */
+    else if ( r < 97 )
+        state = 0;                          /* mismatch N */
+    else
+        state = align_iter_skip;
+    if ( ( rand() % 50 ) == 0 ) state |= align_iter_insert;
+    if ( ( rand() % 50 ) == 0 ) state |= align_iter_delete;
+    if ( ( rand() % 1000 ) == 0 ) state |= align_iter_invalid;
+    return state;
+}
+
+
+/* the way the counters were updated before: one branch per alignment */
+static void count_straight( const int32_t * states, const tool_rec * xrecs, uint32_t depth,
+                            uint32_t min_base_qual, pileup_hist * hist )
+{
+    uint32_t i;
+    memset( hist, 0, sizeof * hist );
+    for ( i = 0; i < depth; ++i )
+    {
+        int32_t state = states[ i ];
+        uint32_t strand = xrecs[ i ].reverse ? 1 : 0;
+        bool low_qual = ( xrecs[ i ].quality[ 0 ] < min_base_qual );
+
+        if ( ( state & align_iter_invalid ) == align_iter_invalid )
+            continue;
+        if ( low_qual )
+            hist->low_quality++;
+        if ( ( state & align_iter_skip ) != align_iter_skip && !low_qual )
+        {
+            if ( ( state & align_iter_match ) == align_iter_match )
+                hist->bases[ phist_match ][ strand ]++;
+            else
+            {
+                switch( state & 0x0F )
+                {
+                    case 1 : hist->bases[ phist_a ][ strand ]++; break;
+                    case 2 : hist->bases[ phist_c ][ strand ]++; break;
+                    case 4 : hist->bases[ phist_g ][ strand ]++; break;
+                    case 8 : hist->bases[ phist_t ][ strand ]++; break;
+                    default : hist->bases[ phist_n ][ strand ]++; break;
+                }
+            }
+        }
+        if ( strand ) hist->reverse++;
+        if ( ( state & align_iter_insert ) == align_iter_insert ) hist->inserts++;
+        if ( ( state & align_iter_delete ) == align_iter_delete ) hist->deletes++;
+    }
+}
+
+
+/* the meaning of the code-bits, one code at a time */
+static void count_codes_straight( const uint8_t * codes, uint32_t count, pileup_hist * hist )
+{
+    uint32_t i;
+    memset( hist, 0, sizeof * hist );
+    for ( i = 0; i < count; ++i )
+    {
+        uint8_t code = codes[ i ];
+        uint32_t cls = code & PHIST_CLASS_MASK;
+        uint32_t strand = ( code & PHIST_REVERSE ) ? 1 : 0;
+        if ( cls < PHIST_COUNTED_CLASSES && ( code & PHIST_LOW_QUAL ) == 0 )
+            hist->bases[ cls ][ strand ]++;
+        if ( code & PHIST_REVERSE ) hist->reverse++;
+        if ( code & PHIST_LOW_QUAL ) hist->low_quality++;
+        if ( code & PHIST_INSERT ) hist->inserts++;
+        if ( code & PHIST_DELETE ) hist->deletes++;
+    }
+}
+
+
+/* the current kernel against the per-code count, the codes start at an odd address */
+static rc_t check_kernel( uint8_t * buffer )
+{
+    rc_t rc = 0;
+    uint32_t l;
+    for ( l = 0; rc == 0 && l < sizeof check_lengths / sizeof check_lengths[ 0 ]; ++l )
+    {
+        uint32_t count = check_lengths[ l ];
+        uint8_t * codes = buffer + 1;
+        pileup_hist expected, hist;
+        uint32_t i;
+
+        for ( i = 0; i < count; ++i )
+            codes[ i ] = ( uint8_t )( rand() & 0x7F );
+        /* a run of one value, so that a byte-lane has to count up to 255 */
+        if ( count > 255 * 16 )
+            memset( codes, phist_match, 255 * 16 );
+        count_codes_straight( codes, count, &expected );
+        pileup_hist_count( codes, count, &hist );
+        if ( memcmp( &hist, &expected, sizeof hist ) != 0 )
+        {
+            KOutMsg( "%-8s : histogram of %u codes differs\n", get_pileup_hist_kernel_name(), count );
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        }
+    }
+    return rc;
+}
+
+
+static double m_per_sec( uint64_t n, KTimeMs_t ms )
+{
+    if ( ms == 0 ) ms = 1;
+    return ( ( double )n / 1000000.0 ) / ( ( double )ms / 1000.0 );
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    rc_t rc = 0;
+    uint32_t depth = DEFAULT_DEPTH;
+    int32_t * states;
+    tool_rec * xrecs;
+    uint8_t * qualities;
+    uint8_t * check_buffer;
+    pileup_codes codes;
+
+    if ( argc > 1 )
+        depth = ( uint32_t )strtoul( argv[ 1 ], NULL, 10 );
+    if ( depth == 0 )
+        depth = DEFAULT_DEPTH;
+
+    states = malloc( ( size_t )depth * POSITIONS * sizeof * states );
+    xrecs = malloc( ( size_t )depth * sizeof * xrecs );
+    qualities = malloc( ( size_t )depth * QUAL_LEN );
+    check_buffer = malloc( MAX_CHECK_LEN + 1 );
+    init_pileup_codes( &codes );
+
+    if ( states == NULL || xrecs == NULL || qualities == NULL || check_buffer == NULL )
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    else
+        rc = reserve_pileup_codes( &codes, depth );
+
+    if ( rc == 0 )
+    {
+        pileup_options options;
+        walk_data data;
+        uint64_t total = ( uint64_t )depth * POSITIONS * ROUNDS;
+        KTimeMs_t start, straight_ms;
+        pileup_hist expected[ POSITIONS ];
+        uint32_t i, k, p, r, tested = 0;
+
+        srand( 42 );
+        for ( i = 0; i < depth * POSITIONS; ++i )
+            states[ i ] = random_state();
+        for ( i = 0; i < depth; ++i )
+        {
+            qualities[ ( size_t )i * QUAL_LEN ] = ( uint8_t )( rand() % 41 );
+            xrecs[ i ].reverse = ( rand() & 1 );
+            xrecs[ i ].tlen = 0;
+            xrecs[ i ].quality_len = QUAL_LEN;
+            xrecs[ i ].quality = &qualities[ ( size_t )i * QUAL_LEN ];
+        }
+
+        memset( &options, 0, sizeof options );
+        options.min_base_qual = MIN_BASE_QUAL;
+        memset( &data, 0, sizeof data );
+        data.options = &options;
+        data.seq_pos = 0;
+
+        start = KTimeMsStamp();
+        for ( r = 0; r < ROUNDS; ++r )
+        {
+            for ( p = 0; p < POSITIONS; ++p )
+                count_straight( &states[ ( size_t )p * depth ], xrecs, depth, MIN_BASE_QUAL, &expected[ p ] );
+        }
+        straight_ms = KTimeMsStamp() - start;
+
+        KOutMsg( "selected : %s\n", get_pileup_hist_kernel_name() );
+        KOutMsg( "depth    : %u x %u positions x %u rounds\n", depth, POSITIONS, ROUNDS );
+        KOutMsg( "straight : %lu alignments in %lu ms = %.1f M/s\n",
+                 total, straight_ms, m_per_sec( total, straight_ms ) );
+
+        for ( k = 0; rc == 0 && k < sizeof kernels / sizeof kernels[ 0 ]; ++k )
+        {
+            KTimeMs_t collect_ms = 0, count_ms = 0;
+
+            if ( !set_pileup_hist_kernel( kernels[ k ] ) )
+            {
+                KOutMsg( "%-8s : not supported by this CPU - skipped\n", kernels[ k ] );
+                continue;
+            }
+            tested++;
+            rc = check_kernel( check_buffer );
+
+            for ( r = 0; rc == 0 && r < ROUNDS; ++r )
+            {
+                for ( p = 0; rc == 0 && p < POSITIONS; ++p )
+                {
+                    const int32_t * pos_states = &states[ ( size_t )p * depth ];
+                    pileup_hist hist;
+
+                    start = KTimeMsStamp();
+                    codes.count = 0;
+                    for ( i = 0; rc == 0 && i < depth; ++i )
+                    {
+                        data.state = pos_states[ i ];
+                        data.xrec = &xrecs[ i ];
+                        rc = add_pileup_code( &codes, &data );
+                    }
+                    collect_ms += KTimeMsStamp() - start;
+
+                    start = KTimeMsStamp();
+                    count_pileup_codes( &codes, &hist );
+                    count_ms += KTimeMsStamp() - start;
+
+                    if ( rc == 0 && memcmp( &hist, &expected[ p ], sizeof hist ) != 0 )
+                    {
+                        rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                        KOutMsg( "%-8s : histogram differs at position #%u\n", kernels[ k ], p );
+                    }
+                }
+            }
+
+            if ( rc == 0 )
+            {
+                KOutMsg( "%-8s : collect %lu alignments in %lu ms = %.1f M/s\n",
+                         kernels[ k ], total, collect_ms, m_per_sec( total, collect_ms ) );
+                KOutMsg( "%-8s : count   %lu alignments in %lu ms = %.1f M/s\n",
+                         kernels[ k ], total, count_ms, m_per_sec( total, count_ms ) );
+            }
+            else
+                KOutMsg( "%-8s : FAILED\n", kernels[ k ] );
+        }
+        if ( rc == 0 && tested == 0 )
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcParam, rcInvalid );
+    }
+    release_pileup_codes( &codes );
+    if ( states != NULL ) free( states );
+    if ( xrecs != NULL ) free( xrecs );
+    if ( qualities != NULL ) free( qualities );
+    if ( check_buffer != NULL ) free( check_buffer );
+    return rc;
+}
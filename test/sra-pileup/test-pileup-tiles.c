@@ -0,0 +1,164 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the tile-plan of sra-pileup --threads ( tools/sra-pileup/pileup_tiles.c )
+    the sections of two input-files are added the way the collection-walk does it,
+    the tiles have to come out in the order of the single-threaded walk:
+    references in the order of their first appearance over both inputs,
+    the sections of one reference merged and in position-order
+-------------------------------------------------------------------------------------------- */
+
+#include "pileup_tiles.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+
+#include <sysalloc.h>
+#include <string.h>
+
+const char UsageDefaultName[] = "test-pileup-tiles";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+typedef struct tile
+{
+    const char * ref_name;
+    uint32_t start;
+    uint32_t end;
+} tile;
+
+typedef struct check_ctx
+{
+    const tile * expected;
+    uint32_t count;
+    uint32_t seen;
+} check_ctx;
+
+
+static rc_t CC check_tile( const char * ref_name, uint32_t start, uint32_t end, void * data )
+{
+    check_ctx * ctx = data;
+    if ( ctx->seen >= ctx->count )
+    {
+        KOutMsg( "unexpected tile #%u: %s %u..%u\n", ctx->seen, ref_name, start, end );
+        return RC( rcExe, rcNoTarg, rcValidating, rcData, rcExcessive );
+    }
+    else
+    {
+        const tile * t = &ctx->expected[ ctx->seen++ ];
+        if ( strcmp( t->ref_name, ref_name ) != 0 || t->start != start || t->end != end )
+        {
+            KOutMsg( "tile #%u: %s %u..%u, expected %s %u..%u\n",
+                     ctx->seen - 1, ref_name, start, end, t->ref_name, t->start, t->end );
+            return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+        }
+    }
+    return 0;
+}
+
+
+/* adds the sections of the inputs one after the other, checks the tiles */
+static rc_t check_plan( const char * what, const tile * input1, uint32_t count1,
+                        const tile * input2, uint32_t count2, uint32_t tile_len,
+                        const tile * expected, uint32_t expected_count )
+{
+    tile_plan plan;
+    check_ctx ctx;
+    uint32_t idx;
+    rc_t rc = 0;
+
+    init_tile_plan( &plan );
+    for ( idx = 0; rc == 0 && idx < count1; ++idx )
+        rc = tile_plan_add_section( &plan, input1[ idx ].ref_name, input1[ idx ].start, input1[ idx ].end );
+    for ( idx = 0; rc == 0 && idx < count2; ++idx )
+        rc = tile_plan_add_section( &plan, input2[ idx ].ref_name, input2[ idx ].start, input2[ idx ].end );
+
+    ctx.expected = expected;
+    ctx.count = expected_count;
+    ctx.seen = 0;
+    if ( rc == 0 )
+        rc = tile_plan_foreach_tile( &plan, tile_len, check_tile, &ctx );
+    if ( rc == 0 && ctx.seen != expected_count )
+    {
+        KOutMsg( "%u tiles, expected %u\n", ctx.seen, expected_count );
+        rc = RC( rcExe, rcNoTarg, rcValidating, rcData, rcInsufficient );
+    }
+    release_tile_plan( &plan );
+
+    KOutMsg( "%-40s : %s\n", what, ( rc == 0 ) ? "ok" : "FAILED" );
+    return rc;
+}
+
+#define N( a ) ( sizeof a / sizeof a[ 0 ] )
+#define M ( 1024 * 1024 )
+
+/* whole files: the 2nd input has a reference the 1st one does not have, and the shared ones in another order */
+static const tile whole_1[] = { { "chr1", 1, 10 * M }, { "chr2", 1, 3 * M } };
+static const tile whole_2[] = { { "chr2", 1, 3 * M }, { "chr3", 1, 5 * M }, { "chr1", 1, 10 * M } };
+static const tile whole_tiles[] =
+{
+    { "chr1", 1, 4 * M }, { "chr1", 4 * M + 1, 8 * M }, { "chr1", 8 * M + 1, 10 * M },
+    { "chr2", 1, 3 * M },
+    { "chr3", 1, 4 * M }, { "chr3", 4 * M + 1, 5 * M }
+};
+
+/* requested regions: sections of one reference from both inputs overlap, touch or are apart */
+static const tile region_1[] = { { "chrX", 100, 200 }, { "chrX", 1000, 2000 }, { "chrX", 5000, 5099 } };
+static const tile region_2[] = { { "chrY", 5, 50 }, { "chrX", 150, 1200 }, { "chrX", 5100, 5200 } };
+static const tile region_tiles[] =
+{
+    { "chrX", 100, 599 }, { "chrX", 600, 1099 }, { "chrX", 1100, 1599 }, { "chrX", 1600, 2000 },
+    { "chrX", 5000, 5200 },
+    { "chrY", 5, 50 }
+};
+
+/* the reference only the 2nd input has comes after all of the 1st input */
+static const tile only_1[] = { { "chrA", 1, 10 }, { "chrB", 1, 10 } };
+static const tile only_2[] = { { "chrC", 1, 10 }, { "chrA", 1, 10 } };
+static const tile only_tiles[] = { { "chrA", 1, 10 }, { "chrB", 1, 10 }, { "chrC", 1, 10 } };
+
+/* the last tile reaches the end of the coordinate-space */
+static const tile max_1[] = { { "chrZ", 0xFFFFFF00, 0xFFFFFFFF } };
+static const tile max_tiles[] = { { "chrZ", 0xFFFFFF00, 0xFFFFFF7F }, { "chrZ", 0xFFFFFF80, 0xFFFFFFFF } };
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    rc_t rc = check_plan( "two whole files", whole_1, N( whole_1 ), whole_2, N( whole_2 ),
+                          4 * M, whole_tiles, N( whole_tiles ) );
+    if ( rc == 0 )
+        rc = check_plan( "two files, overlapping regions", region_1, N( region_1 ), region_2, N( region_2 ),
+                         500, region_tiles, N( region_tiles ) );
+    if ( rc == 0 )
+        rc = check_plan( "reference only in the 2nd file", only_1, N( only_1 ), only_2, N( only_2 ),
+                         4 * M, only_tiles, N( only_tiles ) );
+    if ( rc == 0 )
+        rc = check_plan( "tile at the end of the coordinates", max_1, N( max_1 ), NULL, 0,
+                         128, max_tiles, N( max_tiles ) );
+    return rc;
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+
+SRC="$1"
+SCRATCH="$2"
+THREADS="$3"
+BINDIR="$4"
+
+echo ""
+echo "===== TESTING SAM-DUMP: serial vs. --threads $THREADS =="
+echo "source          : $SRC"
+echo "scratch-space at: $SCRATCH"
+echo "binaries in     : $BINDIR"
+echo ""
+
+OUT1="${SCRATCH}sam-dump.t1.sam"
+OUTN="${SCRATCH}sam-dump.t$THREADS.sam"
+
+clear_files()
+{
+    rm -rf $OUT1 $OUTN 2>&1 > /dev/null
+}
+
+clear_files
+
+CMD="$BINDIR/sam-dump -u $SRC"
+echo "$CMD"
+$CMD > $OUT1
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+if [[ ! -s $OUT1 ]]; then echo "$CMD produced no output"; exit 1; fi
+
+#the default windows, then windows small enough to cut every reference,
+#with a memory-limit that stalls the workers behind almost every job
+for WINDOW_OPTS in "" "--thread-window 10000" "--thread-window 10000 --thread-mem 1"
+do
+    CMD="$BINDIR/sam-dump -u --threads $THREADS $WINDOW_OPTS $SRC"
+    echo "$CMD"
+    $CMD > $OUTN
+    rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+
+    CMD="diff $OUT1 $OUTN"
+    echo "$CMD"
+    $CMD 2>&1 > /dev/null
+    rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+done
+
+echo ">>>SUCCESS!"
+
+clear_files
+
+exit 0
@@ -0,0 +1,216 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* --------------------------------------------------------------------------------------------
+    test of the source-identity of a sam-projection ( tools/sra-pileup/sam-projection.c )
+    - the content-stamp depends on the md5-files of the columns and on where they are,
+      not on the location of the database or on the other files
+    - a database without md5-files has no stamp
+    - a local input resolves to the same absolute path however it is written,
+      an accession stays as it is
+    the databases are built as plain directories in the current directory and removed again
+-------------------------------------------------------------------------------------------- */
+
+#include "sam-projection.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <klib/printf.h>
+#include <kfs/file.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_DIR "test-sam-projection.tmp"
+
+const char UsageDefaultName[] = "test-sam-projection";
+
+rc_t CC UsageSummary( const char * progname ) { return 0; }
+rc_t CC Usage( const Args * args ) { return 0; }
+
+
+static rc_t fail( const char * what, const char * detail )
+{
+    KOutMsg( "FAILED: %s ( %s )\n", what, detail );
+    return RC( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+}
+
+
+static rc_t write_file( KDirectory * dir, const char * db, const char * path, const char * content )
+{
+    KFile * f;
+    rc_t rc = KDirectoryCreateFile( dir, &f, false, 0664, kcmInit | kcmParents,
+                                    "%s/%s/%s", TEST_DIR, db, path );
+    if ( rc == 0 )
+    {
+        size_t num_writ;
+        rc = KFileWriteAll( f, 0, content, string_size( content ), &num_writ );
+        KFileRelease( f );
+    }
+    if ( rc != 0 )
+        KOutMsg( "cannot write '%s/%s': %R\n", db, path, rc );
+    return rc;
+}
+
+
+/* a database as the loaders write it with kcmMD5 */
+static rc_t make_db( KDirectory * dir, const char * db, const char * cigar_md5, const char * flags_dir )
+{
+    char path[ 256 ];
+    rc_t rc = write_file( dir, db, "md5", "0123456789abcdef0123456789abcdef *md/cur\n" );
+    if ( rc == 0 )
+        rc = write_file( dir, db, "md/cur", "metadata" );
+    if ( rc == 0 )
+        rc = write_file( dir, db, "tbl/PRIMARY_ALIGNMENT/col/CIGAR/md5", cigar_md5 );
+    if ( rc == 0 )
+        rc = write_file( dir, db, "tbl/PRIMARY_ALIGNMENT/col/CIGAR/data", "the cigar-data" );
+    if ( rc == 0 )
+        rc = string_printf( path, sizeof path, NULL, "tbl/PRIMARY_ALIGNMENT/col/%s/md5", flags_dir );
+    if ( rc == 0 )
+        rc = write_file( dir, db, path, "fedcba9876543210fedcba9876543210 *data\n" );
+    return rc;
+}
+
+
+static rc_t stamp_of( const KDirectory * dir, const char * db, char * stamp, size_t stamp_size )
+{
+    const KDirectory * db_dir;
+    rc_t rc = KDirectoryOpenDirRead( dir, &db_dir, false, "%s/%s", TEST_DIR, db );
+    if ( rc == 0 )
+    {
+        rc = sam_proj_source_stamp( db_dir, stamp, stamp_size );
+        KDirectoryRelease( db_dir );
+    }
+    return rc;
+}
+
+
+static rc_t test_stamp( KDirectory * dir )
+{
+    static const char cigar_md5[] = "00112233445566778899aabbccddeeff *data\n"
+                                    "ffeeddccbbaa99887766554433221100 *idx\n";
+    static const char other_md5[] = "00112233445566778899aabbccddeeff *data\n"
+                                    "ffeeddccbbaa99887766554433221101 *idx\n";
+    char stamp[ 64 ], same[ 64 ], other[ 64 ];
+    rc_t rc = make_db( dir, "src", cigar_md5, "SAM_FLAGS" );
+    if ( rc == 0 )
+        rc = make_db( dir, "copy", cigar_md5, "SAM_FLAGS" );
+    if ( rc == 0 )
+        rc = make_db( dir, "changed", other_md5, "SAM_FLAGS" );
+    if ( rc == 0 )
+        rc = make_db( dir, "moved", cigar_md5, "SAM_FLAGZ" );
+    if ( rc == 0 )
+        rc = write_file( dir, "unchecked", "tbl/PRIMARY_ALIGNMENT/col/CIGAR/data", "the cigar-data" );
+
+    if ( rc == 0 )
+    {
+        rc = stamp_of( dir, "src", stamp, sizeof stamp );
+        if ( rc != 0 || string_size( stamp ) != 32 )
+            rc = fail( "no stamp for a database with md5-files", "src" );
+    }
+    /* the data-files are not read, only the checksums the loader wrote */
+    if ( rc == 0 )
+        rc = write_file( dir, "copy", "tbl/PRIMARY_ALIGNMENT/col/CIGAR/data", "other cigar-data" );
+    if ( rc == 0 )
+        rc = stamp_of( dir, "copy", same, sizeof same );
+    if ( rc == 0 && strcmp( stamp, same ) != 0 )
+        rc = fail( "the same checksums at another location give another stamp", "copy" );
+
+    if ( rc == 0 )
+        rc = stamp_of( dir, "changed", other, sizeof other );
+    if ( rc == 0 && strcmp( stamp, other ) == 0 )
+        rc = fail( "a changed checksum gives the same stamp", "changed" );
+
+    if ( rc == 0 )
+        rc = stamp_of( dir, "moved", other, sizeof other );
+    if ( rc == 0 && strcmp( stamp, other ) == 0 )
+        rc = fail( "a checksum of another column gives the same stamp", "moved" );
+
+    if ( rc == 0 )
+    {
+        rc_t rc2 = stamp_of( dir, "unchecked", other, sizeof other );
+        if ( GetRCObject( rc2 ) != rcChecksum || GetRCState( rc2 ) != rcNotFound )
+            rc = fail( "a database without md5-files has a stamp", "unchecked" );
+    }
+
+    /* too small a buffer is refused, not truncated */
+    if ( rc == 0 && stamp_of( dir, "src", other, 32 ) == 0 )
+        rc = fail( "stamp written into a buffer without room for the terminator", "src" );
+
+    if ( rc == 0 )
+        KOutMsg( "sam-projection stamp: ok\n" );
+    return rc;
+}
+
+
+static rc_t test_source_id( KDirectory * dir )
+{
+    char id[ 4096 ], same[ 4096 ];
+    rc_t rc = sam_proj_source_id( dir, TEST_DIR "/src", id, sizeof id );
+    if ( rc == 0 && ( id[ 0 ] != '/' || strstr( id, "/" TEST_DIR "/src" ) == NULL ) )
+        rc = fail( "not resolved to an absolute path", id );
+    if ( rc == 0 )
+        rc = sam_proj_source_id( dir, "./" TEST_DIR "/../" TEST_DIR "/src", same, sizeof same );
+    if ( rc == 0 && strcmp( id, same ) != 0 )
+        rc = fail( "the same input resolves to another path", same );
+    if ( rc == 0 )
+        rc = sam_proj_source_id( dir, id, same, sizeof same );
+    if ( rc == 0 && strcmp( id, same ) != 0 )
+        rc = fail( "an absolute path resolves to another path", same );
+
+    /* another input is another source, even with the same content */
+    if ( rc == 0 )
+        rc = sam_proj_source_id( dir, TEST_DIR "/copy", same, sizeof same );
+    if ( rc == 0 && strcmp( id, same ) == 0 )
+        rc = fail( "two inputs resolve to the same path", same );
+
+    if ( rc == 0 )
+        rc = sam_proj_source_id( dir, "SRR0000001", id, sizeof id );
+    if ( rc == 0 && strcmp( id, "SRR0000001" ) != 0 )
+        rc = fail( "an accession was changed", id );
+
+    if ( rc == 0 )
+        KOutMsg( "sam-projection source-id: ok\n" );
+    return rc;
+}
+
+
+rc_t CC KMain( int argc, char *argv [] )
+{
+    KDirectory * dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc == 0 )
+    {
+        KDirectoryRemove( dir, true, "%s", TEST_DIR );
+        rc = test_stamp( dir );
+        if ( rc == 0 )
+            rc = test_source_id( dir );
+        KDirectoryRemove( dir, true, "%s", TEST_DIR );
+        KDirectoryRelease( dir );
+    }
+    return rc;
+}
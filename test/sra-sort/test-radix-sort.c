@@ -0,0 +1,299 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+/*--------------------------------------------------------------------------
+ * benchmark of the IdxMapping / IdPosLen sorts in tools/sra-sort
+ *  times the KSORT path against the radix sort on one and on several
+ *  threads, and fails if the radix sort does not reproduce KSORT's order
+ *
+ *  test-radix-sort [ count [ threads ] ]
+ */
+
+#include "idx-mapping.h"
+#include "radix-sort.h"
+#include "caps.h"
+#include "ctx.h"
+#include "mem.h"
+#include "except.h"
+#include "sra-sort.h"
+
+#include <kapp/main.h>
+#include <klib/out.h>
+#include <klib/sort.h>
+#include <klib/time.h>
+#include <klib/rc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+FILE_ENTRY ( test-radix-sort );
+
+#define DEFAULT_COUNT ( 100 * 1000 * 1000 )
+#define DEFAULT_THREADS 8
+
+/* ( id, poslen ) as sorted by ref-alignid-col.c */
+typedef struct IdPosLen IdPosLen;
+struct IdPosLen
+{
+    int64_t id;
+    uint64_t poslen;
+};
+
+const char UsageDefaultName [] = "test-radix-sort";
+
+rc_t CC UsageSummary ( const char *prog_name ) { return 0; }
+rc_t CC Usage ( const Args *args ) { return 0; }
+
+
+static uint64_t rnd_state = 0x9E3779B97F4A7C15ULL;
+
+static
+uint64_t rnd ( void )
+{
+    /* xorshift64* */
+    rnd_state ^= rnd_state >> 12;
+    rnd_state ^= rnd_state << 25;
+    rnd_state ^= rnd_state >> 27;
+    return rnd_state * 0x2545F4914F6CDD1DULL;
+}
+
+
+/* the sorts as they were before the radix sort */
+static
+void ksort_idx_mapping_old ( IdxMapping *self, size_t count )
+{
+#define T( x ) ( ( const IdxMapping* ) ( x ) )
+#define SWAP( a, b, off, size ) KSORT_TSWAP ( IdxMapping, a, b )
+#define CMP( a, b ) \
+    ( ( T ( a ) -> old_id < T ( b ) -> old_id ) ? -1 : ( T ( a ) -> old_id > T ( b ) -> old_id ) )
+
+    KSORT ( self, count, sizeof * self, 0, sizeof * self );
+
+#undef CMP
+#undef SWAP
+#undef T
+}
+
+static
+void ksort_id_poslen ( IdPosLen *self, size_t count )
+{
+#define T( x ) ( ( const IdPosLen* ) ( x ) )
+#define SWAP( a, b, off, size ) KSORT_TSWAP ( IdPosLen, a, b )
+#define CMP( a, b )                                                         \
+    ( ( T ( a ) -> poslen == T ( b ) -> poslen ) ?                          \
+      ( ( T ( a ) -> id < T ( b ) -> id ) ? -1 : ( T ( a ) -> id > T ( b ) -> id ) ) : \
+      ( ( T ( a ) -> poslen < T ( b ) -> poslen ) ? -1 : 1 ) )
+
+    KSORT ( self, count, sizeof * self, 0, sizeof * self );
+
+#undef CMP
+#undef SWAP
+#undef T
+}
+
+
+static
+double m_per_sec ( uint64_t n, KTimeMs_t ms )
+{
+    if ( ms == 0 )
+        ms = 1;
+    return ( ( double ) n / 1000000.0 ) / ( ( double ) ms / 1000.0 );
+}
+
+static
+void report ( const char *what, size_t count, KTimeMs_t ms )
+{
+    KOutMsg ( "%-24s: %,zu records in %lu ms = %.1f M/s\n", what, count, ( uint64_t ) ms, m_per_sec ( count, ms ) );
+}
+
+
+/* IdxMapping
+ *  old ids are a shuffled 1..count, new ids are the original slots
+ *  as produced when an id column is sorted
+ */
+static
+void bench_idx_mapping ( const ctx_t *ctx, Tool *tp, size_t count, uint32_t threads )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    size_t i, bytes = sizeof ( IdxMapping ) * count;
+    IdxMapping *orig, *expect, *work;
+
+    TRY ( orig = MemAlloc ( ctx, bytes, false ) )
+    {
+        TRY ( expect = MemAlloc ( ctx, bytes, false ) )
+        {
+            TRY ( work = MemAlloc ( ctx, bytes, false ) )
+            {
+                uint32_t r, runs [ 2 ];
+                KTimeMs_t start;
+
+                for ( i = 0; i < count; ++ i )
+                {
+                    orig [ i ] . old_id = i + 1;
+                    orig [ i ] . new_id = i + 1;
+                }
+                for ( i = count; i > 1; -- i )
+                {
+                    size_t j = ( size_t ) ( rnd () % i );
+                    int64_t tmp = orig [ i - 1 ] . old_id;
+                    orig [ i - 1 ] . old_id = orig [ j ] . old_id;
+                    orig [ j ] . old_id = tmp;
+                }
+
+                memcpy ( expect, orig, bytes );
+                start = KTimeMsStamp ();
+                ksort_idx_mapping_old ( expect, count );
+                report ( "IdxMapping KSORT", count, KTimeMsStamp () - start );
+
+                /* one thread, then all of them */
+                runs [ 0 ] = 1;
+                runs [ 1 ] = threads;
+                for ( r = 0; ! FAILED () && r < ( threads > 1 ? 2U : 1U ); ++ r )
+                {
+                    char what [ 64 ];
+                    uint32_t t = runs [ r ];
+
+                    tp -> num_threads = t;
+                    memcpy ( work, orig, bytes );
+                    start = KTimeMsStamp ();
+                    IdxMappingSortOld ( work, ctx, count );
+                    sprintf ( what, "IdxMapping radix x%u", t );
+                    report ( what, count, KTimeMsStamp () - start );
+
+                    if ( memcmp ( work, expect, bytes ) != 0 )
+                    {
+                        rc = RC ( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                        ERROR ( rc, "radix sort on %u threads differs from KSORT", t );
+                    }
+                }
+
+                MemFree ( ctx, work, bytes );
+            }
+
+            MemFree ( ctx, expect, bytes );
+        }
+
+        MemFree ( ctx, orig, bytes );
+    }
+}
+
+
+/* IdPosLen
+ *  ids in ascending order, as read from the REFERENCE table, with
+ *  heavily repeated positions so that stability is exercised
+ */
+static
+void bench_id_poslen ( const ctx_t *ctx, Tool *tp, size_t count, uint32_t threads )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    size_t i, bytes = sizeof ( IdPosLen ) * count;
+    IdPosLen *orig, *expect, *work;
+
+    TRY ( orig = MemAlloc ( ctx, bytes, false ) )
+    {
+        TRY ( expect = MemAlloc ( ctx, bytes, false ) )
+        {
+            TRY ( work = MemAlloc ( ctx, bytes, false ) )
+            {
+                KTimeMs_t start;
+                uint64_t num_pos = count / 16 + 1;
+
+                for ( i = 0; i < count; ++ i )
+                {
+                    orig [ i ] . id = i + 1;
+                    orig [ i ] . poslen = ( ( rnd () % num_pos ) << 32 ) | ( 100 + rnd () % 4 );
+                }
+
+                memcpy ( expect, orig, bytes );
+                start = KTimeMsStamp ();
+                ksort_id_poslen ( expect, count );
+                report ( "IdPosLen KSORT", count, KTimeMsStamp () - start );
+
+                tp -> num_threads = threads;
+                memcpy ( work, orig, bytes );
+                start = KTimeMsStamp ();
+                if ( ! RadixSort16 ( work, ctx, count, 1, false ) )
+                    ksort_id_poslen ( work, count );
+                report ( "IdPosLen radix", count, KTimeMsStamp () - start );
+
+                if ( memcmp ( work, expect, bytes ) != 0 )
+                {
+                    rc = RC ( rcExe, rcNoTarg, rcValidating, rcData, rcInvalid );
+                    ERROR ( rc, "radix sort of ( id, poslen ) differs from KSORT" );
+                }
+
+                MemFree ( ctx, work, bytes );
+            }
+
+            MemFree ( ctx, expect, bytes );
+        }
+
+        MemFree ( ctx, orig, bytes );
+    }
+}
+
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    DECLARE_CTX_INFO ();
+
+    Caps caps;
+    ctx_t main_ctx = { & caps, NULL, & ctx_info };
+    const ctx_t *ctx = & main_ctx;
+
+    Tool tp;
+    size_t count = DEFAULT_COUNT;
+    uint32_t threads = DEFAULT_THREADS;
+
+    if ( argc > 1 )
+        count = ( size_t ) strtoull ( argv [ 1 ], NULL, 10 );
+    if ( argc > 2 )
+        threads = ( uint32_t ) strtoul ( argv [ 2 ], NULL, 10 );
+    if ( threads == 0 )
+        threads = 1;
+
+    CapsInit ( & caps, NULL );
+    memset ( & tp, 0, sizeof tp );
+    caps . tool = & tp;
+
+    TRY ( caps . mem = MemBankMake ( ctx, -1 ) )
+    {
+        TRY ( bench_idx_mapping ( ctx, & tp, count, threads ) )
+        {
+            bench_id_poslen ( ctx, & tp, count, threads );
+        }
+    }
+
+    CapsWhack ( & caps, ctx );
+
+    return main_ctx . rc;
+}
@@ -0,0 +1,111 @@
+#!/bin/bash
+
+SRC="$1"
+SCRATCH="$2"
+BINDIR="$3"
+
+echo ""
+echo "===== TESTING SRA-SORT: interrupted --resume vs. uninterrupted =="
+echo "source          : $SRC"
+echo "scratch-space at: $SCRATCH"
+echo "binaries in     : $BINDIR"
+echo ""
+
+OUT1="${SCRATCH}sra-sort.full"
+OUTR="${SCRATCH}sra-sort.resumed"
+CKPT="$OUTR.sra-sort-ckpt"
+
+clear_files()
+{
+    rm -rf $OUT1 $OUTR $CKPT $OUT1.txt $OUTR.txt 2>&1 > /dev/null
+}
+
+clear_files
+
+CMD="$BINDIR/sra-sort --tempdir $SCRATCH $SRC $OUT1"
+echo "$CMD"
+$CMD
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+
+#kill a resumable sort once it has committed some but not all of its work,
+#waiting a little longer each time it gets nowhere or runs to completion.
+#with a scratch-space on disk, the id maps of the alignment tables are kept:
+#prefer an interruption after one of them was recorded, so it is taken up again
+CMD="$BINDIR/sra-sort --resume --tempdir $SCRATCH $SRC $OUTR"
+INTERRUPTED=0
+MAPPED=0
+for DELAY in 0.1 0.2 0.5 1 2 4 8 16 32
+do
+    rm -rf $OUTR $CKPT
+    echo "$CMD ( killed after $DELAY seconds )"
+    $CMD &
+    PID=$!
+    sleep $DELAY
+    if kill -9 $PID 2>/dev/null
+    then
+        wait $PID 2>/dev/null
+        if grep -q "^column " $CKPT 2>/dev/null
+        then
+            INTERRUPTED=1
+            if grep -q "^map " $CKPT 2>/dev/null
+            then
+                MAPPED=1
+                break
+            fi
+        fi
+    else
+        wait $PID
+        #ran to completion: a shorter delay did better
+        if [[ $INTERRUPTED == 1 ]]; then break; fi
+    fi
+done
+
+if [[ $INTERRUPTED == 0 ]]; then echo "could not interrupt $CMD after committing a column"; exit 1; fi
+if [[ $MAPPED == 1 ]]
+then
+    echo "interrupted with $( grep -c '^column ' $CKPT ) columns and $( grep -c '^map ' $CKPT ) id maps committed"
+else
+    #the last kill may have come too late: interrupt again without waiting for a map
+    for DELAY in 0.1 0.2 0.5 1 2 4 8
+    do
+        rm -rf $OUTR $CKPT
+        $CMD &
+        PID=$!
+        sleep $DELAY
+        if kill -9 $PID 2>/dev/null
+        then
+            wait $PID 2>/dev/null
+            if grep -q "^column " $CKPT 2>/dev/null; then break; fi
+        else
+            wait $PID
+        fi
+    done
+    if ! grep -q "^column " $CKPT 2>/dev/null; then echo "could not interrupt $CMD after committing a column"; exit 1; fi
+    echo "interrupted with $( grep -c '^column ' $CKPT ) columns committed, no id map was kept"
+fi
+
+echo "$CMD"
+$CMD
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+if [[ -e $CKPT ]]; then echo "$CKPT was not removed"; exit 1; fi
+if ls ${SCRATCH}sra-sort-*.old.???????? > /dev/null 2>&1; then echo "kept id maps were not removed"; exit 1; fi
+
+#dump every table of both outputs and compare them
+for TBL in SEQUENCE PRIMARY_ALIGNMENT SECONDARY_ALIGNMENT EVIDENCE_ALIGNMENT EVIDENCE_INTERVAL REFERENCE
+do
+    $BINDIR/vdb-dump $OUT1 -T $TBL >> $OUT1.txt 2>/dev/null
+    $BINDIR/vdb-dump $OUTR -T $TBL >> $OUTR.txt 2>/dev/null
+done
+
+if [[ ! -s $OUT1.txt ]]; then echo "vdb-dump of $OUT1 produced no output"; exit 1; fi
+
+CMD="diff $OUT1.txt $OUTR.txt"
+echo "$CMD"
+$CMD 2>&1 > /dev/null
+rc=$?;
+if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+if [[ $rc == 0 ]]; then echo ">>>SUCCESS!"; fi
+
+clear_files
+
+exit $rc
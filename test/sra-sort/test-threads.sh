@@ -0,0 +1,61 @@
+#!/bin/bash
+
+SRC="$1"
+SCRATCH="$2"
+THREADS="$3"
+BINDIR="$4"
+
+echo ""
+echo "===== TESTING SRA-SORT: --threads 1 vs. --threads $THREADS =="
+echo "source          : $SRC"
+echo "scratch-space at: $SCRATCH"
+echo "binaries in     : $BINDIR"
+echo ""
+
+OUT1="${SCRATCH}sra-sort.t1"
+OUTN="${SCRATCH}sra-sort.t$THREADS"
+
+clear_files()
+{
+    rm -rf $OUT1 $OUTN $OUT1.txt $OUTN.txt $OUTN.log 2>&1 > /dev/null
+}
+
+clear_files
+
+CMD="$BINDIR/sra-sort --threads 1 --tempdir $SCRATCH $SRC $OUT1"
+echo "$CMD"
+$CMD
+rc=$?; if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+
+#the status-messages tell which column slices ran on which table
+CMD="$BINDIR/sra-sort -v -v -v --threads $THREADS --tempdir $SCRATCH $SRC $OUTN"
+echo "$CMD"
+$CMD 2> $OUTN.log
+rc=$?; if [[ $rc != 0 ]]; then cat $OUTN.log; echo "$CMD failed"; exit $rc; fi
+
+#the cSRA tables have to be copied by more than one worker
+for TBL in PRIMARY_ALIGNMENT SEQUENCE
+do
+    awk -v tbl="$TBL'" '/copying table/ { cur = $0 } /copying column slice 2 of/ && index( cur, tbl ) { found = 1 } END { exit !found }' $OUTN.log
+    rc=$?; if [[ $rc != 0 ]]; then echo "the columns of $TBL were not copied in parallel"; exit $rc; fi
+done
+
+#dump every table of both outputs and compare them
+for TBL in SEQUENCE PRIMARY_ALIGNMENT SECONDARY_ALIGNMENT EVIDENCE_ALIGNMENT EVIDENCE_INTERVAL REFERENCE
+do
+    $BINDIR/vdb-dump $OUT1 -T $TBL >> $OUT1.txt 2>/dev/null
+    $BINDIR/vdb-dump $OUTN -T $TBL >> $OUTN.txt 2>/dev/null
+done
+
+if [[ ! -s $OUT1.txt ]]; then echo "vdb-dump of $OUT1 produced no output"; exit 1; fi
+
+CMD="diff $OUT1.txt $OUTN.txt"
+echo "$CMD"
+$CMD 2>&1 > /dev/null
+rc=$?;
+if [[ $rc != 0 ]]; then echo "$CMD failed"; exit $rc; fi
+if [[ $rc == 0 ]]; then echo ">>>SUCCESS!"; fi
+
+clear_files
+
+exit $rc
@@ -61,6 +61,7 @@ typedef struct globals
     unsigned maxWarnCount_DupConflict;
     unsigned pid;
     unsigned minMatchCount; /* minimum number of matches to count as an alignment */
+    unsigned bgzfThreads; /* number of threads inflating BGZF blocks */
     int minMapQual;
     enum LoaderModes mode;
     enum LoaderModes globalMode;
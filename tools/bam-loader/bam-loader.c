@@ -98,6 +98,7 @@ Rare or Esoteric Options:
   unsorted                          expect unsorted input (requires more memory)
   sorted                            require sorted input
   TI                                look for trace id optional tag
+  bgzf-threads <count>              number of threads decompressing the BAM file (default 4)
   unaligned <file>                  file without aligned reads
 
 Deprecated Options:
@@ -149,6 +150,7 @@ static char const option_accept_hard_clip[] = "accept-hard-clip";
 static char const option_allow_multi_map[] = "allow-multi-map";
 static char const option_allow_secondary[] = "make-spots-with-secondary";
 static char const option_defer_secondary[] = "defer-secondary";
+static char const option_bgzf_threads[] = "bgzf-threads";
 
 #define OPTION_INPUT option_input
 #define OPTION_OUTPUT option_output
@@ -174,6 +176,7 @@ static char const option_defer_secondary[] = "defer-secondary";
 #define OPTION_ALLOW_MULTI_MAP option_allow_multi_map
 #define OPTION_ALLOW_SECONDARY option_allow_secondary
 #define OPTION_DEFER_SECONDARY option_defer_secondary
+#define OPTION_BGZF_THREADS option_bgzf_threads
 
 #define ALIAS_INPUT  "i"
 #define ALIAS_OUTPUT "o"
@@ -254,6 +257,13 @@ char const * cache_size_usage[] =
     NULL
 };
 
+static
+char const * bgzf_threads_usage[] = 
+{
+    "Set the number of threads decompressing BGZF blocks, 1 to decompress on the reader thread (default 4)",
+    NULL
+};
+
 static
 char const * mrc_usage[] = 
 {
@@ -458,7 +468,8 @@ OptDef Options[] =
     { OPTION_ACCEPT_HARD_CLIP, NULL, NULL, use_accept_hard_clip, 1, false, false },
     { OPTION_ALLOW_MULTI_MAP, NULL, NULL, use_allow_multi_map, 1, false, false },
     { OPTION_ALLOW_SECONDARY, NULL, NULL, use_allow_secondary, 1, false, false },
-    { OPTION_DEFER_SECONDARY, NULL, NULL, use_defer_secondary, 1, false, false }
+    { OPTION_DEFER_SECONDARY, NULL, NULL, use_defer_secondary, 1, false, false },
+    { OPTION_BGZF_THREADS, NULL, NULL, bgzf_threads_usage, 1, true, false }
 };
 
 const char* OptHelpParam[] =
@@ -496,7 +507,8 @@ const char* OptHelpParam[] =
     NULL,				/* allow hard clipping */
     NULL,				/* allow multimapping */
     NULL,				/* allow secondary */
-    NULL				/* defer secondary */
+    NULL,				/* defer secondary */
+    "count"				/* BGZF threads */
 };
 
 rc_t UsageSummary (char const * progname)
@@ -879,6 +891,23 @@ static rc_t main_1(int argc, char *argv[], bool const continuing, unsigned const
             }
         }
         
+        rc = ArgsOptionCount (args, OPTION_BGZF_THREADS, &pcount);
+        if (rc)
+            break;
+        if (pcount == 1)
+        {
+            rc = ArgsOptionValue (args, OPTION_BGZF_THREADS, 0, (const void **)&value);
+            if (rc)
+                break;
+            G.bgzfThreads = strtoul(value, &dummy, 0);
+            if (G.bgzfThreads == 0) {
+                rc = RC(rcApp, rcArgv, rcAccessing, rcParam, rcIncorrect);
+                OUTMSG (("bgzf-threads: bad value\n"));
+                MiniUsage (args);
+                break;
+            }
+        }
+        
         rc = ArgsOptionCount (args, OPTION_MAX_WARN_DUP_FLAG, &pcount);
         if (rc)
             break;
@@ -1248,6 +1277,7 @@ rc_t CC KMain(int argc, char *argv[])
     G.cache_size = ((size_t)16) << 30;
     G.maxErrCount = 1000;
     G.minMatchCount = 10;
+    G.bgzfThreads = 4;
     
     set_pid();
 
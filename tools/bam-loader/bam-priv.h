@@ -31,6 +31,7 @@ typedef struct BAMIndex BAMIndex;
 typedef struct BufferedFile BufferedFile;
 typedef struct SAMFile SAMFile;
 typedef struct BGZFile BGZFile;
+typedef struct BGZPipeline BGZPipeline;
 
 #define ZLIB_BLOCK_SIZE  (64u * 1024u)
 #define RGLR_BUFFER_SIZE (16u * ZLIB_BLOCK_SIZE)
@@ -68,6 +69,7 @@ struct SAMFile {
 struct BGZFile {
     BufferedFile file;
     z_stream zs;
+    BGZPipeline *pipe;  /* NULL unless blocks are inflated on threads */
 };
 
 struct BAM_File {
@@ -35,6 +35,9 @@
 #include <klib/log.h>
 #include <klib/text.h>
 #include <klib/refcount.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <kproc/thread.h>
 #include <sysalloc.h>
 
 #include <atomic32.h>
@@ -207,6 +210,8 @@ static rc_t BGZFileGetMoreBytes(BGZFile *self)
     return 0;
 }
 
+static rc_t BGZPipelineRead(BGZPipeline *self, zlib_block_t dst, unsigned *pNumRead);
+
 static rc_t BGZFileRead(BGZFile *self, zlib_block_t dst, unsigned *pNumRead)
 {
 #if VALIDATE_BGZF_HEADER
@@ -217,6 +222,9 @@ static rc_t BGZFileRead(BGZFile *self, zlib_block_t dst, unsigned *pNumRead)
     unsigned loops;
     int zr;
     
+    if (self->pipe)
+        return BGZPipelineRead(self->pipe, dst, pNumRead);
+
     *pNumRead = 0;
     if (self->file.bmax == 0 || self->zs.avail_in == 0) {
         rc = BGZFileGetMoreBytes(self);
@@ -309,8 +317,437 @@ static rc_t BGZFileRead(BGZFile *self, zlib_block_t dst, unsigned *pNumRead)
     return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
 }
 
+/* MARK: BGZFile parallel inflate
+ *
+ * BGZF blocks are independent gzip members whose compressed size is
+ * recorded in the BC extra field, so they can be cut out of the stream
+ * without inflating them. The worker threads take turns reading whole
+ * blocks into a ring of slots, in file order, and inflate any slot that
+ * has been read. BGZFileRead hands the slots back in ring order.
+ */
+
+#define BGZF_MAX_THREADS (64u)
+#define BGZF_SLOTS_PER_THREAD (4u)
+
+enum BGZSlotState {
+    bgzs_Empty,
+    bgzs_Read,          /* holds a compressed block */
+    bgzs_Inflating,
+    bgzs_Done           /* holds an uncompressed block or an error */
+};
+
+typedef struct BGZSlot BGZSlot;
+struct BGZSlot {
+    uint64_t end;       /* position in file after this block */
+    unsigned size;      /* compressed size until inflated, then uncompressed size */
+    rc_t rc;
+    enum BGZSlotState state;
+    uint8_t in[ZLIB_BLOCK_SIZE];
+    zlib_block_t out;
+};
+
+typedef struct BGZWorker BGZWorker;
+struct BGZWorker {
+    BGZPipeline *pipe;
+    KThread *th;
+    z_stream zs;
+};
+
+struct BGZPipeline {
+    BufferedFile *file; /* owned by the reading worker */
+    KLock *lock;
+    KCondition *have_block;
+    KCondition *need_work;
+    BGZSlot *slot;
+    BGZWorker *worker;
+    uint64_t pos;       /* position in file after the last block handed out */
+    uint64_t head;      /* sequence number of the next block to hand out */
+    uint64_t tail;      /* sequence number of the next block to read */
+    unsigned slots;
+    unsigned threads;
+    bool started;       /* every worker is running; nothing is read before */
+    bool reading;
+    bool eof;           /* no more blocks will be read */
+    bool quit;
+};
+
+static rc_t BGZFileReadBytes(BufferedFile *const file, uint8_t dst[], size_t const len, size_t *const nread)
+{
+    size_t n = 0;
+    
+    while (n < len) {
+        size_t m;
+        
+        if (file->bpos == file->bmax) {
+            rc_t const rc = BufferedFileRead(file);
+            if (rc)
+                return rc;
+            if (file->bmax == 0)
+                break;
+        }
+        m = file->bmax - file->bpos;
+        if (m > len - n)
+            m = len - n;
+        memcpy(&dst[n], &((uint8_t const *)file->buf)[file->bpos], m);
+        file->bpos += m;
+        n += m;
+    }
+    *nread = n;
+    return 0;
+}
+
+/* reads one whole BGZF block
+ * returns (rcData, rcInsufficient) if eof at a block boundary */
+static rc_t BGZSlotReadBlock(BGZSlot *const slot, BufferedFile *const file)
+{
+    uint8_t *const in = slot->in;
+    unsigned bsize = 0;
+    unsigned xlen;
+    unsigned i;
+    size_t nread;
+    rc_t rc;
+    
+    rc = BGZFileReadBytes(file, in, 12, &nread);
+    if (rc)
+        return rc;
+    if (nread == 0)
+        return RC(rcAlign, rcFile, rcReading, rcData, rcInsufficient);
+    if (nread < 12)
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+    if (in[0] != 31 || in[1] != 139 || in[2] != 8 || (in[3] & 4) == 0) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("GZIP Header not found\n"));
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    xlen = LE2HUI16(&in[10]);
+    if (12 + xlen + 8 > sizeof(slot->in))
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid);
+    rc = BGZFileReadBytes(file, &in[12], xlen, &nread);
+    if (rc)
+        return rc;
+    if (nread < xlen)
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+
+    for (i = 0; i + 4 <= xlen; ) {
+        uint8_t const si1 = in[12 + i + 0];
+        uint8_t const si2 = in[12 + i + 1];
+        unsigned const slen = LE2HUI16(&in[12 + i + 2]);
+        
+        if (si1 == 'B' && si2 == 'C' && slen == 2 && i + 6 <= xlen) {
+            bsize = 1 + LE2HUI16(&in[12 + i + 4]);
+            break;
+        }
+        i += slen + 4;
+    }
+    /* header, extra, crc32 and isize must fit */
+    if (bsize < 12 + xlen + 8) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("BGZF Header extra field BC not found\n"));
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid); /* not BGZF */
+    }
+    rc = BGZFileReadBytes(file, &in[12 + xlen], bsize - 12 - xlen, &nread);
+    if (rc)
+        return rc;
+    if (nread < bsize - 12 - xlen) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("EOF in Zlib block after %lu bytes\n", BufferedFileGetPos(file)));
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+    }
+    slot->size = bsize;
+    slot->end = BufferedFileGetPos(file);
+    return 0;
+}
+
+static rc_t BGZSlotInflate(BGZSlot *const slot, z_stream *const zs)
+{
+    rc_t rc = 0;
+    int zr;
+    
+    zs->next_in = (Bytef *)slot->in;
+    zs->avail_in = (uInt)slot->size;
+    zs->next_out = (Bytef *)slot->out;
+    zs->avail_out = sizeof(slot->out);
+    
+    zr = inflate(zs, Z_FINISH);
+    if (zr == Z_STREAM_END && zs->total_in == slot->size) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Zlib block size (before/after): %u/%u\n", zs->total_in, zs->total_out));
+        slot->size = (unsigned)zs->total_out; /* <= 64k */
+    }
+    else {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Unexpected Zlib result %i: %s\n", zr, zs->msg ? zs->msg : "unknown"));
+        rc = RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    zr = inflateReset(zs);
+    assert(zr == Z_OK);
+    return rc;
+}
+
+/* returns the oldest slot that is waiting to be inflated */
+static BGZSlot *BGZPipelineNextRead(BGZPipeline *const self)
+{
+    uint64_t seq;
+    
+    for (seq = self->head; seq < self->tail; ++seq) {
+        BGZSlot *const slot = &self->slot[seq % self->slots];
+        if (slot->state == bgzs_Read)
+            return slot;
+    }
+    return NULL;
+}
+
+static rc_t BGZPipelineThreadMain(KThread const *const th, void *const vp)
+{
+    BGZWorker *const worker = (BGZWorker *)vp;
+    BGZPipeline *const self = worker->pipe;
+    
+    KLockAcquire(self->lock);
+    while (!self->started && !self->quit)
+        KConditionWait(self->need_work, self->lock);
+    while (!self->quit) {
+        BGZSlot *slot = BGZPipelineNextRead(self);
+        
+        if (slot) {
+            rc_t rc;
+            
+            slot->state = bgzs_Inflating;
+            KLockUnlock(self->lock);
+            
+            rc = BGZSlotInflate(slot, &worker->zs);
+            
+            KLockAcquire(self->lock);
+            slot->rc = rc;
+            slot->state = bgzs_Done;
+            KConditionSignal(self->have_block);
+        }
+        else if (!self->reading && !self->eof && self->tail - self->head < self->slots) {
+            rc_t rc;
+            
+            /* the ring slot is empty since it is outside of [head, tail) */
+            slot = &self->slot[self->tail % self->slots];
+            self->reading = true;
+            KLockUnlock(self->lock);
+            
+            rc = BGZSlotReadBlock(slot, self->file);
+            
+            KLockAcquire(self->lock);
+            self->reading = false;
+            ++self->tail;
+            if (rc) {
+                /* eof and errors are handed out in order like any block */
+                slot->rc = rc;
+                slot->size = 0;
+                slot->state = bgzs_Done;
+                self->eof = true;
+                KConditionSignal(self->have_block);
+            }
+            else {
+                slot->rc = 0;
+                slot->state = bgzs_Read;
+            }
+            KConditionBroadcast(self->need_work);
+        }
+        else
+            KConditionWait(self->need_work, self->lock);
+    }
+    KLockUnlock(self->lock);
+    return 0;
+}
+
+static rc_t BGZPipelineRead(BGZPipeline *const self, zlib_block_t dst, unsigned *const pNumRead)
+{
+    BGZSlot *slot;
+    rc_t rc;
+    
+    *pNumRead = 0;
+    KLockAcquire(self->lock);
+    for ( ; ; ) {
+        slot = &self->slot[self->head % self->slots];
+        if (self->head < self->tail && slot->state == bgzs_Done)
+            break;
+        KConditionWait(self->have_block, self->lock);
+    }
+    KLockUnlock(self->lock);
+    
+    /* the slot stays Done, and is not touched by the workers, until it is released */
+    rc = slot->rc;
+    if (rc)
+        return rc;
+    memcpy(dst, slot->out, slot->size);
+    *pNumRead = slot->size;
+    self->pos = slot->end;
+    
+    KLockAcquire(self->lock);
+    slot->state = bgzs_Empty;
+    ++self->head;
+    KConditionBroadcast(self->need_work);
+    KLockUnlock(self->lock);
+    
+    return 0;
+}
+
+static void BGZPipelineWhack(BGZPipeline *const self)
+{
+    unsigned i;
+    
+    KLockAcquire(self->lock);
+    self->quit = true;
+    KConditionBroadcast(self->need_work);
+    KLockUnlock(self->lock);
+    
+    for (i = 0; i < self->threads; ++i) {
+        KThreadWait(self->worker[i].th, NULL);
+        KThreadRelease(self->worker[i].th);
+        inflateEnd(&self->worker[i].zs);
+    }
+    KConditionRelease(self->need_work);
+    KConditionRelease(self->have_block);
+    KLockRelease(self->lock);
+    free(self->worker);
+    free(self->slot);
+    free(self);
+}
+
+/* starts inflating at the current position in the file
+ * which must be at a block boundary
+ * the workers do not touch the file until all of them are running,
+ * so on failure the file is where it was */
+static rc_t BGZPipelineMake(BGZPipeline **const rslt, BufferedFile *const file, unsigned const threads)
+{
+    BGZPipeline *const self = calloc(1, sizeof(*self));
+    rc_t rc;
+    
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    
+    self->file = file;
+    self->pos = BufferedFileGetPos(file);
+    self->slots = threads * BGZF_SLOTS_PER_THREAD;
+    self->slot = malloc(self->slots * sizeof(self->slot[0]));
+    self->worker = calloc(threads, sizeof(self->worker[0]));
+    if (self->slot == NULL || self->worker == NULL) {
+        free(self->worker);
+        free(self->slot);
+        free(self);
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    }
+    {
+        unsigned i;
+        for (i = 0; i < self->slots; ++i)
+            self->slot[i].state = bgzs_Empty;
+    }
+    rc = KLockMake(&self->lock);
+    if (rc == 0) {
+        rc = KConditionMake(&self->have_block);
+        if (rc == 0) {
+            rc = KConditionMake(&self->need_work);
+            if (rc == 0) {
+                KLockAcquire(self->lock);
+                for ( ; self->threads < threads; ++self->threads) {
+                    BGZWorker *const worker = &self->worker[self->threads];
+                    
+                    worker->pipe = self;
+                    if (inflateInit2(&worker->zs, MAX_WBITS + 16) != Z_OK) { /* max + enable gzip headers */
+                        rc = RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+                        break;
+                    }
+                    rc = KThreadMake(&worker->th, BGZPipelineThreadMain, worker);
+                    if (rc) {
+                        inflateEnd(&worker->zs);
+                        break;
+                    }
+                }
+                if (rc == 0) {
+                    self->started = true;
+                    KConditionBroadcast(self->need_work);
+                    KLockUnlock(self->lock);
+                    DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Inflating BGZF blocks on %u threads from position %lu\n", threads, self->pos));
+                    *rslt = self;
+                    return 0;
+                }
+                KLockUnlock(self->lock);
+                /* stops and releases the threads that were started */
+                BGZPipelineWhack(self);
+                return rc;
+            }
+            KConditionRelease(self->have_block);
+        }
+        KLockRelease(self->lock);
+    }
+    free(self->worker);
+    free(self->slot);
+    free(self);
+    return rc;
+}
+
+/* points the serial inflater at the current position in the file */
+static void BGZFileResetInflater(BGZFile *const self)
+{
+    int const zr = inflateReset(&self->zs);
+    assert(zr == Z_OK);
+    self->zs.next_in = (Bytef *)&((uint8_t *)self->file.buf)[self->file.bpos];
+    self->zs.avail_in = (uInt)(self->file.bmax - self->file.bpos);
+}
+
+/* on failure, reading carries on serially from the same position */
+static rc_t BGZFileStartPipeline(BGZFile *const self, unsigned const threads)
+{
+    uint64_t const pos = BufferedFileGetPos(&self->file);
+    rc_t const rc = BGZPipelineMake(&self->pipe, &self->file, threads);
+    
+    if (rc) {
+        self->pipe = NULL;
+        if (BufferedFileGetPos(&self->file) != pos)
+            BufferedFileSetPos(&self->file, pos);
+        BGZFileResetInflater(self);
+    }
+    return rc;
+}
+
+/* the workers read ahead, so this cannot be undone on a stream */
+static rc_t BGZFileSetThreads(BGZFile *const self, unsigned threads)
+{
+    if (self->pipe)
+        return RC(rcAlign, rcFile, rcUpdating, rcSelf, rcBusy);
+    if (threads < 2)
+        return 0;
+    if (threads > BGZF_MAX_THREADS)
+        threads = BGZF_MAX_THREADS;
+    return BGZFileStartPipeline(self, threads);
+}
+
+static uint64_t BGZFileGetPos(BGZFile const *const self)
+{
+    return self->pipe ? self->pipe->pos : BufferedFileGetPos(&self->file);
+}
+
+static float BGZFileProPos(BGZFile const *const self)
+{
+    return self->file.fmax == 0 ? -1.0 : (BGZFileGetPos(self) / (double)self->file.fmax);
+}
+
+static rc_t BGZFileSetPos(BGZFile *const self, uint64_t const pos)
+{
+    if (self->pipe) {
+        unsigned const threads = self->pipe->threads;
+        rc_t rc;
+        
+        BGZPipelineWhack(self->pipe);
+        self->pipe = NULL;
+        rc = BufferedFileSetPos(&self->file, pos);
+        BGZFileResetInflater(self);
+        if (rc)
+            return rc;
+        if (BGZFileStartPipeline(self, threads) != 0) {
+            DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Failed to restart BGZF threads at position %lu; inflating serially\n", pos));
+        }
+        return 0;
+    }
+    return BufferedFileSetPos(&self->file, pos);
+}
+
 static void BGZFileWhack(BGZFile *self)
 {
+    if (self->pipe) {
+        BGZPipelineWhack(self->pipe);
+        self->pipe = NULL;
+    }
     inflateEnd(&self->zs);
 }
 
@@ -319,14 +756,15 @@ static rc_t BGZFileInit(BGZFile *const self, RawFile_vt *const vt)
     int i;
     static RawFile_vt const my_vt = {
         (rc_t (*)(void *, zlib_block_t, unsigned *))BGZFileRead,
-        (uint64_t (*)(void const *))BufferedFileGetPos,
-        (float (*)(void const *))BufferedFileProPos,
+        (uint64_t (*)(void const *))BGZFileGetPos,
+        (float (*)(void const *))BGZFileProPos,
         (uint64_t (*)(void const *))BufferedFileGetSize,
-        (rc_t (*)(void *, uint64_t))BufferedFileSetPos,
+        (rc_t (*)(void *, uint64_t))BGZFileSetPos,
         (void (*)(void *))BGZFileWhack
     };
     
     *vt = my_vt;
+    self->pipe = NULL;
 
     i = inflateInit2(&self->zs, MAX_WBITS + 16); /* max + enable gzip headers */
     switch (i) {
@@ -1477,6 +1915,18 @@ rc_t BAM_FileRelease(const BAM_File *cself) {
     return 0;
 }
 
+/* MARK: BAM File decompression threads */
+
+rc_t BAM_FileSetInflateThreads(const BAM_File *cself, unsigned threads) {
+    BAM_File *self = (BAM_File *)cself;
+    
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcUpdating, rcSelf, rcNull);
+    if (self->isSAM)
+        return 0;
+    return BGZFileSetThreads(&self->file.bam, threads);
+}
+
 /* MARK: BAM File positioning */
 
 float BAM_FileGetProportionalPosition(const BAM_File *self)
@@ -505,6 +505,17 @@ rc_t BAM_FileAddRef ( const BAM_File *self );
 rc_t BAM_FileRelease ( const BAM_File *self );
 
 
+/* SetInflateThreads
+ *  inflate BGZF blocks on a pool of threads ahead of the reader
+ *  blocks are still handed to the reader in file order
+ *  may be called once, before the first alignment is read
+ *  does nothing for SAM files or if "threads" is less than 2
+ *
+ *  "threads" [ IN ] - number of decompression threads
+ */
+rc_t BAM_FileSetInflateThreads ( const BAM_File *self, unsigned threads );
+
+
 /* GetPosition
  *  get the position of the about-to-be read alignment
  *  this position can be stored
@@ -826,6 +826,12 @@ static rc_t OpenBAM(const BAM_File **bam, VDatabase *db, const char bamFile[])
             }
         }
     }
+    if (rc == 0) {
+        rc_t const rc2 = BAM_FileSetInflateThreads(*bam, G.bgzfThreads);
+        if (rc2) {
+            (void)LOGERR(klogWarn, rc2, "Failed to start BGZF decompression threads; decompressing on the reader thread");
+        }
+    }
 
     return rc;
 }
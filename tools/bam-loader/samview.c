@@ -31,6 +31,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bam.h"
 
@@ -58,11 +59,13 @@ static rc_t writeSAM(BAM_Alignment const *const rec)
 }
 
 static
-void samview(char const path[])
+void samview(char const path[], unsigned threads)
 {
     BAM_File const *bam = NULL;
     rc_t rc = BAM_FileMake(&bam, NULL, NULL, path);
 
+    if (rc == 0 && threads > 1)
+        rc = BAM_FileSetInflateThreads(bam, threads);
     if (rc == 0) {
         BAM_Alignment const *rec = NULL;
 
@@ -73,10 +76,10 @@ void samview(char const path[])
             if (rc2)
                 break;
         }
-        BAM_FileRelease(bam);
         if (GetRCObject(rc) == rcRow && GetRCState(rc) == rcNotFound)
             rc = 0;
     }
+    BAM_FileRelease(bam);
     if (rc)
         LOGERR(klogWarn, rc, "Final RC");
 }
@@ -91,14 +94,22 @@ rc_t CC Usage(Args const *args)
     return 0;
 }
 
+/* samview [-t <bgzf-threads>] [file ...] */
 rc_t CC KMain(int argc, char *argv[])
 {
+    unsigned threads = 0;
+
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        threads = (unsigned)atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
     if (argc == 1) {
-        samview("/dev/stdin");
+        samview("/dev/stdin", threads);
         return 0;
     }
     while (--argc) {
-        samview(*++argv);
+        samview(*++argv, threads);
     }
     return 0;
 }
@@ -35,11 +35,28 @@
 #include <vdb/schema.h>
 #include <vdb/table.h>
 #include <vdb/cursor.h>
+#include <vdb/blob.h>
 #include <vdb/database.h>
 
 #include <os-native.h>
 #include <sysalloc.h>
 
+/* --------------------------------------------------------------------------------------------
+    the cells are not requested one by one from the cursor, instead the whole blob of a column
+    is kept and the cells of the following rows are taken out of it by pointer ( no copy ),
+    a new blob is fetched only if the row is outside of the id-range of the current one
+-------------------------------------------------------------------------------------------- */
+#define CMN_MAX_BLOBS 8
+
+typedef struct cmn_blob
+{
+    const VBlob * blob;
+    int64_t first;
+    uint64_t count;
+    uint32_t col_id;
+} cmn_blob;
+
+
 typedef struct cmn_iter
 {
     const VDBManager * mgr;
@@ -53,6 +70,8 @@ typedef struct cmn_iter
     struct progressbar * progressbar;
     uint64_t count;
     int64_t first, row_id;
+    cmn_blob blobs[ CMN_MAX_BLOBS ];
+    uint32_t num_blobs;
 } cmn_iter;
 
 
@@ -65,6 +84,11 @@ void destroy_cmn_iter( struct cmn_iter * iter )
 
         if ( iter->row_iter != NULL ) num_gen_iterator_destroy( iter->row_iter );
         if ( iter->ranges != NULL ) num_gen_destroy( iter->ranges );
+        while ( iter->num_blobs > 0 )
+        {
+            const VBlob * blob = iter->blobs[ --iter->num_blobs ].blob;
+            if ( blob != NULL ) VBlobRelease( blob );
+        }
         if ( iter->cursor != NULL ) VCursorRelease( iter->cursor );
         if ( iter->tbl != NULL ) VTableRelease( iter->tbl );
         if ( iter->db != NULL ) VDatabaseRelease( iter->db );
@@ -208,14 +232,97 @@ rc_t cmn_iter_range( struct cmn_iter * iter, uint32_t col_id )
 }
 
 
+/* restrict an open iterator to a new row-range, cursor and cached blobs are kept */
+rc_t cmn_iter_set_rows( struct cmn_iter * iter, int64_t first, uint64_t count )
+{
+    rc_t rc = num_gen_clear( iter->ranges );
+    if ( rc != 0 )
+        ErrMsg( "cmn_iter_set_rows.num_gen_clear() -> %R\n", rc );
+    else
+    {
+        rc = num_gen_add( iter->ranges, first, count );
+        if ( rc != 0 )
+            ErrMsg( "cmn_iter_set_rows.num_gen_add( %ld.%lu ) -> %R\n", first, count, rc );
+    }
+    if ( rc == 0 )
+    {
+        if ( iter->row_iter != NULL )
+        {
+            num_gen_iterator_destroy( iter->row_iter );
+            iter->row_iter = NULL;
+        }
+        /* iter->first / iter->count are the id-range of the table ( see cmn_iter_range ) */
+        rc = make_row_iter( iter->ranges, iter->first, iter->count, &iter->row_iter );
+        if ( rc != 0 )
+            ErrMsg( "cmn_iter_set_rows.make_row_iter() -> %R\n", rc );
+    }
+    return rc;
+}
+
+
+static cmn_blob * get_blob_slot( struct cmn_iter * iter, uint32_t col_id )
+{
+    uint32_t idx;
+    for ( idx = 0; idx < iter->num_blobs; ++idx )
+    {
+        if ( iter->blobs[ idx ].col_id == col_id )
+            return &iter->blobs[ idx ];
+    }
+    if ( iter->num_blobs < CMN_MAX_BLOBS )
+    {
+        cmn_blob * b = &iter->blobs[ iter->num_blobs++ ];
+        b->blob = NULL;
+        b->col_id = col_id;
+        return b;
+    }
+    return NULL; /* more columns than slots: read this one from the cursor */
+}
+
+
+static rc_t cmn_read_cell( struct cmn_iter * iter, uint32_t col_id, uint32_t * elem_bits,
+                           const void ** base, uint32_t * boff, uint32_t * row_len )
+{
+    rc_t rc = 0;
+    int64_t row_id = iter->row_id;
+    cmn_blob * b = get_blob_slot( iter, col_id ); /* above */
+    if ( b == NULL )
+        return VCursorCellDataDirect( iter->cursor, row_id, col_id, elem_bits, base, boff, row_len );
+
+    if ( b->blob == NULL || row_id < b->first || ( uint64_t )( row_id - b->first ) >= b->count )
+    {
+        if ( b->blob != NULL )
+        {
+            VBlobRelease( b->blob );
+            b->blob = NULL;
+        }
+        rc = VCursorGetBlobDirect( iter->cursor, &b->blob, row_id, col_id );
+        if ( rc != 0 )
+            ErrMsg( "VCursorGetBlobDirect( #%ld ) -> %R\n", row_id, rc );
+        else
+        {
+            rc = VBlobIdRange( b->blob, &b->first, &b->count );
+            if ( rc != 0 )
+            {
+                ErrMsg( "VBlobIdRange( #%ld ) -> %R\n", row_id, rc );
+                VBlobRelease( b->blob );
+                b->blob = NULL;
+            }
+        }
+    }
+    if ( rc == 0 )
+        rc = VBlobCellData( b->blob, row_id, elem_bits, base, boff, row_len );
+    return rc;
+}
+
+
 rc_t cmn_read_uint64( struct cmn_iter * iter, uint32_t col_id, uint64_t *value )
 {
     uint32_t elem_bits, boff, row_len;
     const uint64_t * value_ptr;
-    rc_t rc = VCursorCellDataDirect( iter->cursor, iter->row_id, col_id, &elem_bits,
+    rc_t rc = cmn_read_cell( iter, col_id, &elem_bits,
                                  (const void **)&value_ptr, &boff, &row_len );
     if ( rc != 0 )
-        ErrMsg( "VCursorCellDataDirect( #%ld ) -> %R\n", iter->row_id, rc );
+        ErrMsg( "cmn_read_cell( #%ld ) -> %R\n", iter->row_id, rc );
     else if ( elem_bits != 64 || boff != 0 || row_len < 1 )
     {
         ErrMsg( "row#%ld : bits=%d, boff=%d, len=%d\n", iter->row_id, elem_bits, boff, row_len );
@@ -232,10 +339,10 @@ rc_t cmn_read_uint64_array( struct cmn_iter * iter, uint32_t col_id, uint64_t *v
 {
     uint32_t elem_bits, boff, row_len;
     const uint64_t * value_ptr;
-    rc_t rc = VCursorCellDataDirect( iter->cursor, iter->row_id, col_id, &elem_bits,
+    rc_t rc = cmn_read_cell( iter, col_id, &elem_bits,
                                  (const void **)&value_ptr, &boff, &row_len );
     if ( rc != 0 )
-        ErrMsg( "VCursorCellDataDirect( #%ld ) -> %R\n", iter->row_id, rc );
+        ErrMsg( "cmn_read_cell( #%ld ) -> %R\n", iter->row_id, rc );
     else if ( elem_bits != 64 || boff != 0 || row_len < 1 )
     {
         ErrMsg( "row#%ld : bits=%d, boff=%d, len=%d\n", iter->row_id, elem_bits, boff, row_len );
@@ -255,10 +362,10 @@ rc_t cmn_read_uint32( struct cmn_iter * iter, uint32_t col_id, uint32_t *value )
 {
     uint32_t elem_bits, boff, row_len;
     const uint32_t * value_ptr;
-    rc_t rc = VCursorCellDataDirect( iter->cursor, iter->row_id, col_id, &elem_bits,
+    rc_t rc = cmn_read_cell( iter, col_id, &elem_bits,
                                  (const void **)&value_ptr, &boff, &row_len );
     if ( rc != 0 )
-        ErrMsg( "VCursorCellDataDirect( #%ld ) -> %R\n", iter->row_id, rc );
+        ErrMsg( "cmn_read_cell( #%ld ) -> %R\n", iter->row_id, rc );
     else if ( elem_bits != 32 || boff != 0 || row_len < 1 )
     {
         ErrMsg( "row#%ld : bits=%d, boff=%d, len=%d\n", iter->row_id, elem_bits, boff, row_len );
@@ -272,10 +379,10 @@ rc_t cmn_read_uint32( struct cmn_iter * iter, uint32_t col_id, uint32_t *value )
 rc_t cmn_read_String( struct cmn_iter * iter, uint32_t col_id, String *value )
 {
     uint32_t elem_bits, boff;
-    rc_t rc = VCursorCellDataDirect( iter->cursor, iter->row_id, col_id, &elem_bits,
+    rc_t rc = cmn_read_cell( iter, col_id, &elem_bits,
                                  (const void **)&value->addr, &boff, &value->len );
     if ( rc != 0 )
-        ErrMsg( "VCursorCellDataDirect( #%ld ) -> %R\n", iter->row_id, rc );
+        ErrMsg( "cmn_read_cell( #%ld ) -> %R\n", iter->row_id, rc );
     else if ( elem_bits != 8 || boff != 0 )
     {
         ErrMsg( "row#%ld : bits=%d, boff=%d, len=%d\n", iter->row_id, elem_bits, boff, value->len );
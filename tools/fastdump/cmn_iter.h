@@ -63,6 +63,7 @@ rc_t make_cmn_iter( cmn_params * params, const char * tblname, struct cmn_iter *
 
 rc_t cmn_iter_add_column( struct cmn_iter * iter, const char * name, uint32_t * id );
 rc_t cmn_iter_range( struct cmn_iter * iter, uint32_t col_id );
+rc_t cmn_iter_set_rows( struct cmn_iter * iter, int64_t first, uint64_t count );
 
 bool cmn_iter_next( struct cmn_iter * iter, rc_t * rc );
 int64_t cmn_iter_row_id( const struct cmn_iter * iter );
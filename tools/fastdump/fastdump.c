@@ -33,6 +33,7 @@
 #include "lookup_reader.h"
 #include "join.h"
 #include "sorter.h"
+#include "packed_store.h"
 #include "helper.h"
 
 #include <kapp/main.h>
@@ -94,6 +95,22 @@ static const char * detail_usage[] = { "print details", NULL };
 #define OPTION_DETAILS  "details"
 #define ALIAS_DETAILS    "x"
 
+static const char * mmap_usage[] = { "memory-map lookup- and index-file for the join", NULL };
+#define OPTION_MMAP     "mmap"
+#define ALIAS_MMAP      "M"
+
+static const char * streaming_usage[] = { "keep the lookup-table in memory if it fits into the memory limit", NULL };
+#define OPTION_STREAMING "streaming"
+#define ALIAS_STREAMING  "S"
+
+static const char * unordered_usage[] = { "threads write into the output-file directly, the order of the spots is not kept", NULL };
+#define OPTION_UNORDERED "unordered"
+#define ALIAS_UNORDERED  "U"
+
+static const char * split_usage[] = { "one output-file per thread ( output.0, output.1, ... )", NULL };
+#define OPTION_SPLIT    "split-files"
+#define ALIAS_SPLIT     "F"
+
 OptDef ToolOptions[] =
 {
     { OPTION_RANGE,     ALIAS_RANGE,     NULL, range_usage,      1, true,   false },
@@ -107,7 +124,11 @@ OptDef ToolOptions[] =
     { OPTION_THREADS,   ALIAS_THREADS,   NULL, threads_usage,    1, true,   false },
     { OPTION_INDEX,     ALIAS_INDEX,     NULL, index_usage,      1, true,   false },
     { OPTION_PROGRESS,  ALIAS_PROGRESS,  NULL, progress_usage,   1, false,  false },
-    { OPTION_DETAILS,   ALIAS_DETAILS,   NULL, detail_usage,     1, false,  false }
+    { OPTION_DETAILS,   ALIAS_DETAILS,   NULL, detail_usage,     1, false,  false },
+    { OPTION_MMAP,      ALIAS_MMAP,      NULL, mmap_usage,       1, false,  false },
+    { OPTION_STREAMING, ALIAS_STREAMING, NULL, streaming_usage,  1, false,  false },
+    { OPTION_UNORDERED, ALIAS_UNORDERED, NULL, unordered_usage,  1, false,  false },
+    { OPTION_SPLIT,     ALIAS_SPLIT,     NULL, split_usage,      1, false,  false }
 };
 
 const char UsageDefaultName[] = "fastdump";
@@ -158,6 +179,8 @@ typedef struct fd_ctx
     const char * temp_path;
     size_t buf_size, mem_limit;
     uint64_t num_threads;
+    bool use_mmap, streaming;
+    join_output_t output_mode;
 } fd_ctx;
 
 
@@ -174,6 +197,8 @@ static void init_sorter_params( const fd_ctx * fd_ctx, sorter_params * sp )
     sp->buf_size = fd_ctx->buf_size;
     sp->cursor_cache = fd_ctx->cmn.cursor_cache;
     sp->sort_progress = NULL;
+    sp->streaming_store = NULL;
+    sp->queue = NULL;
     sp->num_threads = 0;
     sp->show_progress = fd_ctx->cmn.show_progress;
 }
@@ -184,7 +209,7 @@ static void init_sorter_params( const fd_ctx * fd_ctx, sorter_params * sp )
     reading SEQ_SPOT_ID, SEQ_READ_ID and RAW_READ
     SEQ_SPOT_ID and SEQ_READ_ID is merged into a 64-bit-key
     RAW_READ is read as 4na-unpacked ( Schema does not provide 4na-packed for this column )
-    these key-pairs are temporarely stored in a KVector until a limit is reached
+    these key-pairs are temporarely stored in a packed_store ( arena + radix-sort ) until a limit is reached
     after that limit is reached they are writen sorted into the file-system as sub-files
     this repeats until the requested row-range is exhausted ( row_range ... NULL -> all rows )
     These sub-files are than merge-sorted into the final output-file.
@@ -193,12 +218,13 @@ static void init_sorter_params( const fd_ctx * fd_ctx, sorter_params * sp )
     KEY... 64-bit value as SEQ_SPOT_ID shifted left by 1 bit, zero-bit contains SEQ_READ_ID
     RAW_READ... 16-bit binary-chunk-lenght, followed by n bytes of packed 4na
 -------------------------------------------------------------------------------------------- */
-static rc_t single_threaded_make_lookup( fd_ctx * fd_ctx )
+static rc_t single_threaded_make_lookup( fd_ctx * fd_ctx, struct packed_store ** streaming_store )
 {
     sorter_params sp;
     struct raw_read_iter * iter;
     
     init_sorter_params( fd_ctx, &sp );
+    sp.streaming_store = streaming_store;
     rc_t rc = make_raw_read_iter( &fd_ctx->cmn, &iter );
     if ( rc == 0 )
     {
@@ -229,6 +255,8 @@ static rc_t multi_threaded_make_lookup( fd_ctx * fd_ctx )
 static rc_t perform_join( fd_ctx * fd_ctx, format_t fmt )
 {
     rc_t rc = 0;
+    struct packed_store * store = NULL;
+    
     if ( !file_exists( fd_ctx->cmn.dir, "%s", fd_ctx->lookup_filename ) )
     {
         const char * temp = fd_ctx->output_filename;
@@ -237,10 +265,14 @@ static rc_t perform_join( fd_ctx * fd_ctx, format_t fmt )
             KOutMsg( "lookup :" );
         
         fd_ctx->output_filename = fd_ctx->lookup_filename;
-        if ( fd_ctx->num_threads > 1 )
+        if ( fd_ctx->streaming )
+            /* the sorted lookup-table stays in memory, it falls back to writing
+               the lookup-file ( store == NULL ) if it does not fit into mem_limit */
+            rc = single_threaded_make_lookup( fd_ctx, &store );
+        else if ( fd_ctx->num_threads > 1 )
             rc = multi_threaded_make_lookup( fd_ctx );
         else
-            rc = single_threaded_make_lookup( fd_ctx );
+            rc = single_threaded_make_lookup( fd_ctx, NULL );
 
         fd_ctx->output_filename = temp;
     }
@@ -262,10 +294,15 @@ static rc_t perform_join( fd_ctx * fd_ctx, format_t fmt )
         jp.num_threads      = fd_ctx->num_threads;
         jp.first            = 0;
         jp.count            = 0;
+        jp.use_mmap         = fd_ctx->use_mmap;
+        jp.store            = store;
+        jp.shared_out       = NULL;
+        jp.output_mode      = fd_ctx->output_mode;
         jp.fmt              = fmt;
         
         rc = execute_join( &jp ); /* join.c */
     }
+    release_packed_store( store ); /* packed_store.c */
     return rc;
 }
 
@@ -312,6 +349,14 @@ rc_t CC KMain ( int argc, char *argv [] )
             fd_ctx.buf_size = get_size_t_option( args, OPTION_BUFSIZE, 1024 * 1024 );
             fd_ctx.mem_limit = get_size_t_option( args, OPTION_MEM, 1024L * 1024 * 100 );
             fd_ctx.num_threads = get_uint64_t_option( args, OPTION_THREADS, 1 );
+            fd_ctx.use_mmap = get_bool_option( args, OPTION_MMAP );
+            fd_ctx.streaming = get_bool_option( args, OPTION_STREAMING );
+            if ( get_bool_option( args, OPTION_SPLIT ) )
+                fd_ctx.output_mode = jo_split;
+            else if ( get_bool_option( args, OPTION_UNORDERED ) )
+                fd_ctx.output_mode = jo_unordered;
+            else
+                fd_ctx.output_mode = jo_concat;
 
 			if ( fd_ctx.cmn.show_details )
 			{
@@ -91,6 +91,12 @@ bool get_from_fastq_iter( struct fastq_iter * iter, fastq_rec * rec, rc_t * rc )
 
 }
 
+rc_t set_fastq_iter_rows( struct fastq_iter * iter, int64_t first, uint64_t count )
+{
+    return cmn_iter_set_rows( iter->cmn, first, count );
+}
+
+
 uint64_t get_row_count_of_fastq_iter( struct fastq_iter * iter )
 {
     return cmn_iter_row_count( iter->cmn );
@@ -60,6 +60,9 @@ rc_t make_fastq_iter( cmn_params * params, struct fastq_iter ** iter );
 
 bool get_from_fastq_iter( struct fastq_iter * iter, fastq_rec * rec, rc_t * rc );
 
+/* continue with a different row-range, without opening the table again */
+rc_t set_fastq_iter_rows( struct fastq_iter * iter, int64_t first, uint64_t count );
+
 uint64_t get_row_count_of_fastq_iter( struct fastq_iter * iter );
 
 #ifdef __cplusplus
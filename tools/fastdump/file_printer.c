@@ -28,13 +28,90 @@
 #include "helper.h"
 
 #include <kfs/file.h>
-#include <kfs/buffile.h>
+#include <kproc/lock.h>
 
+#include <string.h>
 
-typedef struct file_printer
+/* --------------------------------------------------------------------------------------------
+    a shared_file is written by many printers ( threads ) at once:
+    each printer collects whole records in a chunk, and reserves space for the chunk at the
+    end of the file only when it is full, the lock is held just for that reservation,
+    the write itself happens without lock at the reserved offset
+-------------------------------------------------------------------------------------------- */
+typedef struct shared_file
 {
     struct KFile * f;
-    SBuffer print_buffer;
+    KLock * lock;
+    uint64_t next_pos;
+} shared_file;
+
+
+void release_shared_file( struct shared_file * sf )
+{
+    if ( sf != NULL )
+    {
+        if ( sf->f != NULL ) KFileRelease( sf->f );
+        if ( sf->lock != NULL ) KLockRelease( sf->lock );
+        free( ( void * ) sf );
+    }
+}
+
+
+rc_t make_shared_file( KDirectory *dir, struct shared_file ** sf, const char * fmt, ... )
+{
+    rc_t rc = 0;
+    shared_file * f = calloc( 1, sizeof * f );
+    if ( f == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "make_shared_file.calloc( %d ) -> %R", ( sizeof * f ), rc );
+    }
+    else
+    {
+        va_list args;
+        va_start ( args, fmt );
+        /* no KBufFile here: a KBufFile cannot be written by multiple threads */
+        rc = KDirectoryVCreateFile( dir, &f->f, false, 0664, kcmInit, fmt, args );
+        va_end ( args );
+        if ( rc != 0 )
+            ErrMsg( "make_shared_file.KDirectoryVCreateFile() -> %R", rc );
+        else
+        {
+            rc = KLockMake( &f->lock );
+            if ( rc != 0 )
+                ErrMsg( "make_shared_file.KLockMake() -> %R", rc );
+        }
+        if ( rc == 0 )
+            *sf = f;
+        else
+            release_shared_file( f );
+    }
+    return rc;
+}
+
+
+static rc_t reserve_in_shared_file( struct shared_file * sf, size_t size, uint64_t * pos )
+{
+    rc_t rc = KLockAcquire( sf->lock );
+    if ( rc != 0 )
+        ErrMsg( "reserve_in_shared_file.KLockAcquire() -> %R", rc );
+    else
+    {
+        *pos = sf->next_pos;
+        sf->next_pos += size;
+        KLockUnlock( sf->lock );
+    }
+    return rc;
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef struct file_printer
+{
+    struct KFile * f;               /* NULL if shared */
+    struct shared_file * shared;    /* not owned, NULL if the printer has its own file */
+    SBuffer print_buffer;           /* for file_print() only */
+    SBuffer out;                    /* whole records are collected here, written when full */
     uint64_t file_pos;
 } file_printer;
 
@@ -43,61 +120,138 @@ void destroy_file_printer( struct file_printer * printer )
 {
     if ( printer != NULL )
     {
+        flush_file_printer( printer );
         if ( printer->f != NULL ) KFileRelease( printer->f );
         release_SBuffer( &printer->print_buffer );
+        release_SBuffer( &printer->out );
         free( ( void * ) printer );
     }
 }
 
 
+static rc_t init_file_printer( file_printer * p, size_t out_buffer_size, size_t print_buffer_size )
+{
+    rc_t rc = make_SBuffer( &p->print_buffer, print_buffer_size );
+    if ( rc == 0 )
+        rc = make_SBuffer( &p->out, out_buffer_size > print_buffer_size ? out_buffer_size : print_buffer_size );
+    return rc;
+}
+
+
+/* the printer does its own buffering, so the file is not wrapped into a KBufFile */
 rc_t make_file_printer( KDirectory *dir, struct file_printer ** printer,
         size_t file_buffer_size, size_t print_buffer_size, const char * fmt, ... )
 {
-    rc_t rc;
-    struct KFile * f;
-    
-    va_list args;
-    va_start ( args, fmt );
+    rc_t rc = 0;
+    file_printer * p = calloc( 1, sizeof * p );
+    if ( p == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "calloc( %d ) -> %R", ( sizeof * p ), rc );
+    }
+    else
+    {
+        va_list args;
+        va_start ( args, fmt );
+        rc = KDirectoryVCreateFile( dir, &p->f, false, 0664, kcmInit, fmt, args );
+        va_end ( args );
+        if ( rc != 0 )
+            ErrMsg( "KDirectoryVCreateFile() -> %R", rc );
+        else
+            rc = init_file_printer( p, file_buffer_size, print_buffer_size ); /* above */
+        if ( rc == 0 )
+            *printer = p;
+        else
+            destroy_file_printer( p );
+    }
+    return rc;
+}
 
-    rc = KDirectoryVCreateFile( dir, &f, false, 0664, kcmInit, fmt, args );
-    if ( rc != 0 )
-        ErrMsg( "KDirectoryVCreateFile() -> %R", rc );
+
+rc_t make_shared_file_printer( struct shared_file * sf, struct file_printer ** printer,
+        size_t chunk_size, size_t print_buffer_size )
+{
+    rc_t rc = 0;
+    file_printer * p = calloc( 1, sizeof * p );
+    if ( p == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "calloc( %d ) -> %R", ( sizeof * p ), rc );
+    }
     else
     {
-        struct KFile * temp_file = f;
-        if ( file_buffer_size > 0 )
+        p->shared = sf;
+        rc = init_file_printer( p, chunk_size, print_buffer_size ); /* above */
+        if ( rc == 0 )
+            *printer = p;
+        else
+            destroy_file_printer( p );
+    }
+    return rc;
+}
+
+
+static rc_t write_at( struct KFile * f, uint64_t pos, const char * src, size_t to_write )
+{
+    size_t num_writ;
+    rc_t rc = KFileWriteAll( f, pos, src, to_write, &num_writ );
+    if ( rc != 0 )
+        ErrMsg( "KFileWriteAll( at %lu ) -> %R", pos, rc );
+    else if ( num_writ != to_write )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+        ErrMsg( "KFileWriteAll( at %lu ) ( %d vs %d ) -> %R", pos, to_write, num_writ, rc );
+    }
+    return rc;
+}
+
+
+rc_t flush_file_printer( struct file_printer * printer )
+{
+    rc_t rc = 0;
+    size_t to_write = printer->out.S.size;
+    if ( to_write > 0 )
+    {
+        if ( printer->shared != NULL )
         {
-            rc = KBufFileMakeWrite( &temp_file, f, false, file_buffer_size );
-            KFileRelease( f );
-            if ( rc != 0 )
-                ErrMsg( "KBufFileMakeWrite() -> %R", rc );
+            uint64_t pos;
+            rc = reserve_in_shared_file( printer->shared, to_write, &pos ); /* above */
+            if ( rc == 0 )
+                rc = write_at( printer->shared->f, pos, printer->out.S.addr, to_write ); /* above */
         }
-        if ( rc == 0 )
+        else
         {
-            file_printer * p = calloc( 1, sizeof * p );
-            if ( p == NULL )
-            {
-                KFileRelease( temp_file );
-                rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
-                ErrMsg( "calloc( %d ) -> %R", ( sizeof * p ), rc );
-            }
-            else
-            {
-                rc = make_SBuffer( &p->print_buffer, print_buffer_size );
-                if ( rc != 0 )
-                    KFileRelease( temp_file );
-                else
-                {
-                    p->f = temp_file;
-                    *printer = p;
-                }
-            }
+            rc = write_at( printer->f, printer->file_pos, printer->out.S.addr, to_write ); /* above */
+            if ( rc == 0 )
+                printer->file_pos += to_write;
         }
+        printer->out.S.size = printer->out.S.len = 0;
     }
-
-    va_end ( args );
     return rc;
+}
+
 
+/* makes room for a record of 'needed' bytes in the out-buffer, and returns where to write it,
+   the out-buffer always ends on a record-boundary, so records of different threads never interleave */
+static char * reserve_in_out( struct file_printer * printer, size_t needed, rc_t * rc )
+{
+    SBuffer * out = &printer->out;
+    *rc = 0;
+    if ( out->S.size + needed > out->buffer_size )
+    {
+        *rc = flush_file_printer( printer );
+        if ( *rc == 0 && needed > out->buffer_size )
+        {
+            /* a single record bigger than the buffer ( very unlikely ) */
+            release_SBuffer( out );
+            *rc = make_SBuffer( out, needed );
+        }
+    }
+    if ( *rc != 0 )
+        return NULL;
+    out->S.size += needed;
+    out->S.len = out->S.size;
+    return ( char * )&out->S.addr[ out->S.size - needed ];
 }
 
 
@@ -110,21 +264,157 @@ rc_t file_print( struct file_printer * printer, const char * fmt, ... )
     rc = print_to_SBufferV( &printer->print_buffer, fmt, args );
     if ( rc == 0 )
     {
-        size_t num_writ, to_write;
-        to_write = printer->print_buffer.S.size;
-        const char * src = printer->print_buffer.S.addr;
-        rc = KFileWriteAll( printer->f, printer->file_pos, src, to_write, &num_writ );
-        if ( rc != 0 )
-            ErrMsg( "KFileWriteAll( at %lu ) -> %R", printer->file_pos, rc );
-        else if ( num_writ != to_write )
-        {
-            rc = RC( rcVDB, rcNoTarg, rcWriting, rcFormat, rcInvalid );
-            ErrMsg( "KFileWriteAll( at %lu ) ( %d vs %d ) -> %R", printer->file_pos, to_write, num_writ, rc );
-        }
-        else
-            printer->file_pos += num_writ;
+        size_t needed = printer->print_buffer.S.size;
+        char * dst = reserve_in_out( printer, needed, &rc ); /* above */
+        if ( dst != NULL )
+            memmove( dst, printer->print_buffer.S.addr, needed );
     }
     
     va_end ( args );
     return rc;
 }
+
+
+/* --------------------------------------------------------------------------------------------
+    direct formatters: the exact size of a record is computed first, then the record is
+    assembled in the out-buffer with memmove() and a table-based integer-to-ascii conversion,
+    no printf-format has to be parsed per record
+-------------------------------------------------------------------------------------------- */
+
+static const char digit_pairs[ 201 ] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static size_t num_digits( uint64_t value )
+{
+    size_t res = 1;
+    while ( value >= 10000 ) { value /= 10000; res += 4; }
+    if ( value >= 1000 ) return res + 3;
+    if ( value >= 100 ) return res + 2;
+    if ( value >= 10 ) return res + 1;
+    return res;
+}
+
+static size_t int_len( int64_t value )
+{
+    if ( value < 0 )
+        return 1 + num_digits( ( uint64_t )( -( value + 1 ) ) + 1 );
+    return num_digits( ( uint64_t )value );
+}
+
+/* writes the decimal representation of value to dst, returns the position after it */
+static char * write_int( char * dst, int64_t value )
+{
+    uint64_t v;
+    char * end;
+    if ( value < 0 )
+    {
+        *dst++ = '-';
+        v = ( uint64_t )( -( value + 1 ) ) + 1;
+    }
+    else
+        v = ( uint64_t )value;
+    end = dst + num_digits( v );
+    dst = end;
+    while ( v >= 100 )
+    {
+        uint32_t idx = ( uint32_t )( v % 100 ) * 2;
+        v /= 100;
+        *--dst = digit_pairs[ idx + 1 ];
+        *--dst = digit_pairs[ idx ];
+    }
+    if ( v >= 10 )
+    {
+        *--dst = digit_pairs[ v * 2 + 1 ];
+        *--dst = digit_pairs[ v * 2 ];
+    }
+    else
+        *--dst = ( char )( '0' + v );
+    return end;
+}
+
+static char * write_str( char * dst, const char * src, size_t len )
+{
+    memmove( dst, src, len );
+    return dst + len;
+}
+
+static size_t string_len( const String * S )
+{
+    return S != NULL ? S->size : 0;
+}
+
+
+rc_t file_print_special( struct file_printer * printer, int64_t row_id,
+                         const String * bases1, const String * bases2, const String * spot_group )
+{
+    /* "%ld\t%S%S\t%S\n" */
+    rc_t rc;
+    size_t needed = int_len( row_id ) + 1 + string_len( bases1 ) + string_len( bases2 ) + 1 +
+                    string_len( spot_group ) + 1;
+    char * dst = reserve_in_out( printer, needed, &rc ); /* above */
+    if ( dst != NULL )
+    {
+        dst = write_int( dst, row_id );
+        *dst++ = '\t';
+        dst = write_str( dst, bases1->addr, bases1->size );
+        if ( bases2 != NULL )
+            dst = write_str( dst, bases2->addr, bases2->size );
+        *dst++ = '\t';
+        if ( spot_group != NULL )
+            dst = write_str( dst, spot_group->addr, spot_group->size );
+        *dst = '\n';
+    }
+    return rc;
+}
+
+
+rc_t file_print_fastq( struct file_printer * printer, const String * acc, int64_t row_id,
+                       const String * bases1, const String * bases2, const String * quality )
+{
+    /* "@%s.%ld %ld length=%d\n%S%S\n+%s.%ld %ld length=%d\n%S\n" */
+    static const char length_str[] = " length=";
+    rc_t rc;
+    size_t row_id_len = int_len( row_id );
+    uint32_t bases_len = bases1->len + ( bases2 != NULL ? bases2->len : 0 );
+    size_t header_len = acc->size + 1 + row_id_len + 1 + row_id_len + ( sizeof length_str - 1 );
+    size_t needed = 1 + header_len + num_digits( bases_len ) + 1 +
+                    string_len( bases1 ) + string_len( bases2 ) + 1 +
+                    1 + header_len + num_digits( quality->len ) + 1 +
+                    quality->size + 1;
+    char * dst = reserve_in_out( printer, needed, &rc ); /* above */
+    if ( dst != NULL )
+    {
+        char * header;
+        *dst++ = '@';
+        header = dst;
+        dst = write_str( dst, acc->addr, acc->size );
+        *dst++ = '.';
+        dst = write_int( dst, row_id );
+        *dst++ = ' ';
+        dst = write_int( dst, row_id );
+        dst = write_str( dst, length_str, sizeof length_str - 1 );
+        dst = write_int( dst, bases_len );
+        *dst++ = '\n';
+        dst = write_str( dst, bases1->addr, bases1->size );
+        if ( bases2 != NULL )
+            dst = write_str( dst, bases2->addr, bases2->size );
+        *dst++ = '\n';
+        *dst++ = '+';
+        /* the 2nd header is the same as the 1st one up to the length */
+        dst = write_str( dst, header, header_len );
+        dst = write_int( dst, quality->len );
+        *dst++ = '\n';
+        dst = write_str( dst, quality->addr, quality->size );
+        *dst = '\n';
+    }
+    return rc;
+}
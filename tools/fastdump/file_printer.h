@@ -35,6 +35,10 @@ extern "C" {
 #include <klib/rc.h>
 #endif
 
+#ifndef _h_klib_text_
+#include <klib/text.h>
+#endif
+
 #ifndef _h_kfs_directory_
 #include <kfs/directory.h>
 #endif
@@ -48,6 +52,28 @@ rc_t make_file_printer( KDirectory *dir, struct file_printer ** printer,
 
 rc_t file_print( struct file_printer * printer, const char * fmt, ... );
 
+/* same output as file_print( "%ld\t%S%S\t%S\n" ), bases2 and spot_group can be NULL */
+rc_t file_print_special( struct file_printer * printer, int64_t row_id,
+                         const String * bases1, const String * bases2, const String * spot_group );
+
+/* same output as file_print( "@%s.%ld %ld length=%d\n%S%S\n+%s.%ld %ld length=%d\n%S\n" ), bases2 can be NULL */
+rc_t file_print_fastq( struct file_printer * printer, const String * acc, int64_t row_id,
+                       const String * bases1, const String * bases2, const String * quality );
+
+/* writes what a printer on a shared_file has collected, nothing to do for the other printers */
+rc_t flush_file_printer( struct file_printer * printer );
+
+/* one output-file, written by many printers on different threads: the records stay intact,
+   but the order of the records of different printers is not defined */
+struct shared_file;
+
+void release_shared_file( struct shared_file * sf );
+
+rc_t make_shared_file( KDirectory *dir, struct shared_file ** sf, const char * fmt, ... );
+
+rc_t make_shared_file_printer( struct shared_file * sf, struct file_printer ** printer,
+        size_t chunk_size, size_t print_buffer_size );
+
 
 #ifdef __cplusplus
 }
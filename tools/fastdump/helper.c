@@ -33,7 +33,13 @@
 #include <kfs/defs.h>
 #include <kfs/file.h>
 #include <kfs/buffile.h>
+#include <kfs/mmap.h>
 #include <kproc/thread.h>
+#include <string.h>
+
+#if ! WINDOWS
+#include <sys/mman.h>
+#endif
 
 rc_t ErrMsg( const char * fmt, ... )
 {
@@ -266,58 +272,272 @@ uint64_t make_key( int64_t seq_spot_id, uint32_t seq_read_id )
 }
 
 
-void pack_4na( const String * unpacked, SBuffer * packed )
+/* --------------------------------------------------------------------------------------------
+    pack_4na() / unpack_4na() kernels:
+    the portable versions work on pairs of bases without branches,
+    the SSE2 / AVX2 versions are compiled via target-attributes ( no special compiler-flags needed )
+    and are selected at runtime, when the CPU supports them
+    packed layout: [16-bit dna-len, big endian][ 2 bases per byte, 1st base in the high nibble ]
+-------------------------------------------------------------------------------------------- */
+
+#if defined( __GNUC__ ) && !defined( __INTEL_COMPILER ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define X86_4NA_KERNELS 1
+#include <immintrin.h>
+#endif
+
+typedef void ( * pack_4na_kernel )( const uint8_t * src, uint32_t pairs, uint8_t * dst );
+typedef void ( * unpack_4na_kernel )( const uint8_t * src, uint32_t bytes, uint8_t * dst );
+
+static const char x4na_to_ASCII[ 16 ] =
+{
+    /* 0x00 0x01 0x02 0x03 0x04 0x05 0x06 0x07 0x08 0x09 0x0A 0x0B 0x0C 0x0D 0x0E 0x0F */
+       'N', 'A', 'C', 'N', 'G', 'N', 'N', 'N', 'T', 'N', 'N', 'N', 'N', 'N', 'N', 'N'
+};
+
+
+static void pack_4na_portable( const uint8_t * src, uint32_t pairs, uint8_t * dst )
+{
+    uint32_t i;
+    for ( i = 0; i < pairs; ++i )
+        dst[ i ] = ( uint8_t )( ( ( src[ 2 * i ] & 0x0F ) << 4 ) | ( src[ 2 * i + 1 ] & 0x0F ) );
+}
+
+
+static void unpack_4na_portable( const uint8_t * src, uint32_t bytes, uint8_t * dst )
 {
     uint32_t i;
-    char * src = ( char * )unpacked->addr;
-    char * dst = ( char * )packed->S.addr;
-    uint16_t dna_len = ( unpacked->len & 0xFFFF );
-    uint32_t len = 0;
-    dst[ len++ ] = ( dna_len >> 8 );
-    dst[ len++ ] = ( dna_len & 0xFF );
-    for ( i = 0; i < unpacked->len; ++i )
-    {
-        if ( len < packed->buffer_size )
+    for ( i = 0; i < bytes; ++i )
+    {
+        uint8_t packed_byte = src[ i ];
+        dst[ 2 * i ] = x4na_to_ASCII[ packed_byte >> 4 ];
+        dst[ 2 * i + 1 ] = x4na_to_ASCII[ packed_byte & 0x0F ];
+    }
+}
+
+#ifdef X86_4NA_KERNELS
+
+/* 32 bases -> 16 bytes per round: the 16-bit lanes hold ( base0 | base1 << 8 ) */
+__attribute__ (( target( "sse2" ) ))
+static void pack_4na_sse2( const uint8_t * src, uint32_t pairs, uint8_t * dst )
+{
+    const __m128i lo_mask = _mm_set1_epi16( 0x000F );
+    uint32_t i = 0;
+    for ( ; i + 16 <= pairs; i += 16 )
+    {
+        __m128i a = _mm_loadu_si128( ( const __m128i * )&src[ 2 * i ] );
+        __m128i b = _mm_loadu_si128( ( const __m128i * )&src[ 2 * i + 16 ] );
+        a = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( a, lo_mask ), 4 ),
+                          _mm_and_si128( _mm_srli_epi16( a, 8 ), lo_mask ) );
+        b = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( b, lo_mask ), 4 ),
+                          _mm_and_si128( _mm_srli_epi16( b, 8 ), lo_mask ) );
+        _mm_storeu_si128( ( __m128i * )&dst[ i ], _mm_packus_epi16( a, b ) );
+    }
+    pack_4na_portable( &src[ 2 * i ], pairs - i, &dst[ i ] );
+}
+
+
+/* SSE2 has no byte-shuffle: the 4 valid codes are selected with compares, everything else is 'N' */
+__attribute__ (( target( "sse2" ) ))
+static __m128i x4na_to_ASCII_sse2( __m128i v )
+{
+    __m128i res = _mm_set1_epi8( 'N' );
+    __m128i m;
+    m = _mm_cmpeq_epi8( v, _mm_set1_epi8( 1 ) );
+    res = _mm_or_si128( _mm_andnot_si128( m, res ), _mm_and_si128( m, _mm_set1_epi8( 'A' ) ) );
+    m = _mm_cmpeq_epi8( v, _mm_set1_epi8( 2 ) );
+    res = _mm_or_si128( _mm_andnot_si128( m, res ), _mm_and_si128( m, _mm_set1_epi8( 'C' ) ) );
+    m = _mm_cmpeq_epi8( v, _mm_set1_epi8( 4 ) );
+    res = _mm_or_si128( _mm_andnot_si128( m, res ), _mm_and_si128( m, _mm_set1_epi8( 'G' ) ) );
+    m = _mm_cmpeq_epi8( v, _mm_set1_epi8( 8 ) );
+    res = _mm_or_si128( _mm_andnot_si128( m, res ), _mm_and_si128( m, _mm_set1_epi8( 'T' ) ) );
+    return res;
+}
+
+
+__attribute__ (( target( "sse2" ) ))
+static void unpack_4na_sse2( const uint8_t * src, uint32_t bytes, uint8_t * dst )
+{
+    const __m128i nibble_mask = _mm_set1_epi8( 0x0F );
+    uint32_t i = 0;
+    for ( ; i + 16 <= bytes; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128( ( const __m128i * )&src[ i ] );
+        __m128i hi = x4na_to_ASCII_sse2( _mm_and_si128( _mm_srli_epi16( v, 4 ), nibble_mask ) );
+        __m128i lo = x4na_to_ASCII_sse2( _mm_and_si128( v, nibble_mask ) );
+        _mm_storeu_si128( ( __m128i * )&dst[ 2 * i ], _mm_unpacklo_epi8( hi, lo ) );
+        _mm_storeu_si128( ( __m128i * )&dst[ 2 * i + 16 ], _mm_unpackhi_epi8( hi, lo ) );
+    }
+    unpack_4na_portable( &src[ i ], bytes - i, &dst[ 2 * i ] );
+}
+
+
+/* 64 bases -> 32 bytes per round, packus works per 128-bit lane: fix the order with a permute */
+__attribute__ (( target( "avx2" ) ))
+static void pack_4na_avx2( const uint8_t * src, uint32_t pairs, uint8_t * dst )
+{
+    const __m256i lo_mask = _mm256_set1_epi16( 0x000F );
+    uint32_t i = 0;
+    for ( ; i + 32 <= pairs; i += 32 )
+    {
+        __m256i a = _mm256_loadu_si256( ( const __m256i * )&src[ 2 * i ] );
+        __m256i b = _mm256_loadu_si256( ( const __m256i * )&src[ 2 * i + 32 ] );
+        a = _mm256_or_si256( _mm256_slli_epi16( _mm256_and_si256( a, lo_mask ), 4 ),
+                             _mm256_and_si256( _mm256_srli_epi16( a, 8 ), lo_mask ) );
+        b = _mm256_or_si256( _mm256_slli_epi16( _mm256_and_si256( b, lo_mask ), 4 ),
+                             _mm256_and_si256( _mm256_srli_epi16( b, 8 ), lo_mask ) );
+        _mm256_storeu_si256( ( __m256i * )&dst[ i ],
+                             _mm256_permute4x64_epi64( _mm256_packus_epi16( a, b ), 0xD8 ) );
+    }
+    pack_4na_sse2( &src[ 2 * i ], pairs - i, &dst[ i ] );
+}
+
+
+__attribute__ (( target( "avx2" ) ))
+static void unpack_4na_avx2( const uint8_t * src, uint32_t bytes, uint8_t * dst )
+{
+    const __m256i nibble_mask = _mm256_set1_epi8( 0x0F );
+    const __m256i table = _mm256_setr_epi8(
+        'N', 'A', 'C', 'N', 'G', 'N', 'N', 'N', 'T', 'N', 'N', 'N', 'N', 'N', 'N', 'N',
+        'N', 'A', 'C', 'N', 'G', 'N', 'N', 'N', 'T', 'N', 'N', 'N', 'N', 'N', 'N', 'N' );
+    uint32_t i = 0;
+    for ( ; i + 32 <= bytes; i += 32 )
+    {
+        __m256i v = _mm256_loadu_si256( ( const __m256i * )&src[ i ] );
+        __m256i hi = _mm256_shuffle_epi8( table, _mm256_and_si256( _mm256_srli_epi16( v, 4 ), nibble_mask ) );
+        __m256i lo = _mm256_shuffle_epi8( table, _mm256_and_si256( v, nibble_mask ) );
+        __m256i r0 = _mm256_unpacklo_epi8( hi, lo );    /* bytes 0..7 and 16..23 */
+        __m256i r1 = _mm256_unpackhi_epi8( hi, lo );    /* bytes 8..15 and 24..31 */
+        _mm256_storeu_si256( ( __m256i * )&dst[ 2 * i ], _mm256_permute2x128_si256( r0, r1, 0x20 ) );
+        _mm256_storeu_si256( ( __m256i * )&dst[ 2 * i + 32 ], _mm256_permute2x128_si256( r0, r1, 0x31 ) );
+    }
+    unpack_4na_sse2( &src[ i ], bytes - i, &dst[ 2 * i ] );
+}
+
+#endif /* X86_4NA_KERNELS */
+
+static pack_4na_kernel pack_kernel = NULL;
+static unpack_4na_kernel unpack_kernel = NULL;
+static const char * kernel_name = NULL;
+
+/* all threads come to the same result, a race here is harmless */
+static void select_4na_kernels( void )
+{
+    pack_4na_kernel p = pack_4na_portable;
+    unpack_4na_kernel u = unpack_4na_portable;
+    const char * name = "portable";
+#ifdef X86_4NA_KERNELS
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        p = pack_4na_avx2;
+        u = unpack_4na_avx2;
+        name = "avx2";
+    }
+    else if ( __builtin_cpu_supports( "sse2" ) )
+    {
+        p = pack_4na_sse2;
+        u = unpack_4na_sse2;
+        name = "sse2";
+    }
+#endif
+    kernel_name = name;
+    unpack_kernel = u;
+    pack_kernel = p;
+}
+
+
+const char * get_4na_kernel_name( void )
+{
+    if ( kernel_name == NULL )
+        select_4na_kernels();
+    return kernel_name;
+}
+
+
+bool set_4na_kernel( const char * name )
+{
+    bool res = false;
+    if ( name != NULL )
+    {
+        if ( 0 == strcmp( name, "portable" ) )
         {
-            char base = ( src[ i ] & 0x0F );
-            if ( 0 == ( i & 0x01 ) )
-                dst[ len ] = ( base << 4 );
-            else
-                dst[ len++ ] |= base;
+            pack_kernel = pack_4na_portable;
+            unpack_kernel = unpack_4na_portable;
+            kernel_name = "portable";
+            res = true;
         }
+#ifdef X86_4NA_KERNELS
+        else
+        {
+            __builtin_cpu_init();
+            if ( 0 == strcmp( name, "sse2" ) && __builtin_cpu_supports( "sse2" ) )
+            {
+                pack_kernel = pack_4na_sse2;
+                unpack_kernel = unpack_4na_sse2;
+                kernel_name = "sse2";
+                res = true;
+            }
+            else if ( 0 == strcmp( name, "avx2" ) && __builtin_cpu_supports( "avx2" ) )
+            {
+                pack_kernel = pack_4na_avx2;
+                unpack_kernel = unpack_4na_avx2;
+                kernel_name = "avx2";
+                res = true;
+            }
+        }
+#endif
     }
-    if ( unpacked->len & 0x01 )
-        len++;
-    packed->S.size = packed->S.len = len;
+    return res;
 }
 
 
-static char x4na_to_ASCII[ 16 ] =
+void pack_4na( const String * unpacked, SBuffer * packed )
 {
-    /* 0x00 0x01 0x02 0x03 0x04 0x05 0x06 0x07 0x08 0x09 0x0A 0x0B 0x0C 0x0D 0x0E 0x0F */
-       'N', 'A', 'C', 'N', 'G', 'N', 'N', 'N', 'T', 'N', 'N', 'N', 'N', 'N', 'N', 'N'
-};
+    const uint8_t * src = ( const uint8_t * )unpacked->addr;
+    uint8_t * dst = ( uint8_t * )packed->S.addr;
+    uint32_t n = unpacked->len;
+    uint16_t dna_len = ( n & 0xFFFF );
+    size_t avail = packed->buffer_size > 2 ? packed->buffer_size - 2 : 0;
+    uint32_t pairs = n >> 1;
+    uint32_t len;
+
+    if ( pack_kernel == NULL )
+        select_4na_kernels();
+
+    dst[ 0 ] = ( dna_len >> 8 );
+    dst[ 1 ] = ( dna_len & 0xFF );
+    if ( pairs > avail )
+        pairs = avail;
+    pack_kernel( src, pairs, &dst[ 2 ] );
+    len = 2 + pairs;
+    if ( n & 0x01 )
+    {
+        if ( pairs < avail )
+            dst[ len ] = ( uint8_t )( ( src[ n - 1 ] & 0x0F ) << 4 );
+        len++;
+    }
+    packed->S.size = packed->S.len = len;
+}
 
 
 void unpack_4na( const String * packed, SBuffer * unpacked )
 {
-    uint32_t i;
-    char * src = ( char * )packed->addr;
-    char * dst = ( char * )unpacked->S.addr;
-    uint32_t dst_idx = 0;
+    const uint8_t * src = ( const uint8_t * )packed->addr;
+    uint8_t * dst = ( uint8_t * )unpacked->S.addr;
+    uint32_t bytes = packed->len > 2 ? packed->len - 2 : 0;
     uint16_t dna_len = src[ 0 ];
     dna_len <<= 8;
     dna_len |= src[ 1 ];
-    for ( i = 2; i < packed->len; ++i )
-    {
-        uint8_t packed_byte = src[ i ];
-        if ( dst_idx < unpacked->buffer_size )
-            dst[ dst_idx++ ] = x4na_to_ASCII[ ( packed_byte >> 4 ) & 0x0F ];
-        if ( dst_idx < unpacked->buffer_size )
-            dst[ dst_idx++ ] = x4na_to_ASCII[ packed_byte & 0x0F ];
-    }
+
+    if ( unpack_kernel == NULL )
+        select_4na_kernels();
+
+    if ( bytes > ( unpacked->buffer_size >> 1 ) )
+        bytes = ( unpacked->buffer_size >> 1 );
+    unpack_kernel( &src[ 2 ], bytes, dst );
     unpacked->S.len = unpacked->S.size = dna_len;
-    dst[ dna_len + 2 ] = 0;
+    if ( dna_len < unpacked->buffer_size )
+        dst[ dna_len ] = 0;
 }
 
 
@@ -628,6 +848,81 @@ void join_multi_progress( KThread *t, multi_progress * progress_data )
 }
 
 
+/* small enough that a slow chunk does not hold up the others for long,
+   big enough that opening the cursors per chunk does not matter */
+#define ROW_CHUNKS_PER_THREAD 8
+#define MIN_ROWS_PER_CHUNK 0x10000
+
+void init_row_queue( row_queue * q, int64_t first, uint64_t row_count, uint32_t num_threads )
+{
+    uint64_t chunk_count = ( uint64_t )( num_threads > 0 ? num_threads : 1 ) * ROW_CHUNKS_PER_THREAD;
+    uint64_t chunk_size = ( row_count / chunk_count ) + 1;
+    if ( chunk_size < MIN_ROWS_PER_CHUNK )
+        chunk_size = MIN_ROWS_PER_CHUNK;
+    atomic_set( &q->next_chunk, 0 );
+    q->first = first;
+    q->row_count = row_count;
+    q->chunk_size = chunk_size;
+    q->chunk_count = ( uint32_t )( ( row_count + chunk_size - 1 ) / chunk_size );
+    q->starts = NULL;
+}
+
+
+bool next_row_chunk( row_queue * q, uint32_t * chunk_id, int64_t * first, uint64_t * count )
+{
+    uint32_t id = ( uint32_t )atomic_read_and_add( &q->next_chunk, 1 );
+    if ( id >= q->chunk_count )
+        return false;
+    *chunk_id = id;
+    if ( q->starts != NULL )
+    {
+        *first = q->starts[ id ];
+        *count = ( uint64_t )( q->starts[ id + 1 ] - q->starts[ id ] );
+        return true;
+    }
+    *first = q->first + ( id * q->chunk_size );
+    *count = q->chunk_size;
+    if ( ( id + 1 ) * q->chunk_size > q->row_count )
+        *count = q->row_count - ( id * q->chunk_size );
+    return true;
+}
+
+
+rc_t align_row_queue( row_queue * q, int64_t ( * align )( int64_t row, void * data ), void * data )
+{
+    rc_t rc = 0;
+    int64_t * starts = calloc( ( size_t )q->chunk_count + 1, sizeof * starts );
+    if ( starts == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "align_row_queue().calloc( %d ) -> %R", ( q->chunk_count + 1 ) * ( sizeof * starts ), rc );
+    }
+    else
+    {
+        uint32_t id, n = 0;
+        starts[ n++ ] = q->first;
+        for ( id = 1; id < q->chunk_count; ++id )
+        {
+            int64_t row = align( q->first + ( id * q->chunk_size ), data );
+            if ( row > starts[ n - 1 ] )
+                starts[ n++ ] = row;
+        }
+        starts[ n ] = q->first + q->row_count;
+        free( ( void * ) q->starts );
+        q->starts = starts;
+        q->chunk_count = n;
+    }
+    return rc;
+}
+
+
+void release_row_queue( row_queue * q )
+{
+    free( ( void * ) q->starts );
+    q->starts = NULL;
+}
+
+
 rc_t make_prefixed( char * buffer, size_t bufsize, const char * prefix,
                     const char * path, const char * postfix )
 {
@@ -671,3 +966,72 @@ rc_t make_prefixed( char * buffer, size_t bufsize, const char * prefix,
         ErrMsg( "make_prefixed.string_printf() -> %R", rc );
     return rc;
 }
+
+
+rc_t make_mapped_file( const KDirectory * dir, mapped_file * mf, bool sequential, const char * fmt, ... )
+{
+    rc_t rc;
+    va_list args;
+    va_start ( args, fmt );
+
+    mf->f = NULL;
+    mf->mm = NULL;
+    mf->addr = NULL;
+    mf->size = 0;
+    rc = KDirectoryVOpenFileRead( dir, &mf->f, fmt, args );
+    if ( rc != 0 )
+        ErrMsg( "make_mapped_file.KDirectoryVOpenFileRead() -> %R", rc );
+    else
+    {
+        rc = KFileSize( mf->f, &mf->size );
+        if ( rc != 0 )
+            ErrMsg( "make_mapped_file.KFileSize() -> %R", rc );
+        else if ( mf->size > 0 )
+        {
+            rc = KMMapMakeRead( &mf->mm, mf->f );
+            if ( rc != 0 )
+                ErrMsg( "make_mapped_file.KMMapMakeRead() -> %R", rc );
+            else
+            {
+                size_t map_size;
+                const void * addr;
+                rc = KMMapSize( mf->mm, &map_size );
+                if ( rc == 0 )
+                    rc = KMMapAddrRead( mf->mm, &addr );
+                if ( rc != 0 )
+                    ErrMsg( "make_mapped_file.KMMapAddrRead() -> %R", rc );
+                else if ( map_size != mf->size )
+                {
+                    /* a file too big for the address-space is not mapped completely */
+                    rc = RC( rcVDB, rcNoTarg, rcConstructing, rcSize, rcInsufficient );
+                    ErrMsg( "make_mapped_file() mapped only %lu of %lu bytes -> %R", map_size, mf->size, rc );
+                }
+                else
+                {
+                    mf->addr = addr;
+#if ! WINDOWS
+                    madvise( ( void * )addr, map_size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED );
+#endif
+                }
+            }
+        }
+    }
+    if ( rc != 0 )
+        release_mapped_file( mf );
+    va_end ( args );
+    return rc;
+}
+
+
+void release_mapped_file( mapped_file * mf )
+{
+    if ( mf != NULL )
+    {
+        if ( mf->mm != NULL ) KMMapRelease( mf->mm );
+        if ( mf->f != NULL ) KFileRelease( mf->f );
+        mf->mm = NULL;
+        mf->f = NULL;
+        mf->addr = NULL;
+        mf->size = 0;
+    }
+}
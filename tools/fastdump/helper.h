@@ -108,6 +108,13 @@ uint64_t make_key( int64_t seq_spot_id, uint32_t seq_read_id );
 void pack_4na( const String * unpacked, SBuffer * packed );
 void unpack_4na( const String * packed, SBuffer * unpacked );
 
+/* name of the pack/unpack-kernel selected at runtime: "avx2", "sse2" or "portable" */
+const char * get_4na_kernel_name( void );
+
+/* force a kernel ( "avx2", "sse2" or "portable" ) - for tests,
+   returns false if the name is unknown or the CPU does not support it */
+bool set_4na_kernel( const char * name );
+
 uint64_t calc_percent( uint64_t max, uint64_t value, uint16_t digits );
 
 bool file_exists( const KDirectory * dir, const char * fmt, ... );
@@ -131,9 +138,42 @@ void init_progress_data( multi_progress * progress_data, uint64_t row_count );
 rc_t start_multi_progress( KThread **t, multi_progress * progress_data );
 void join_multi_progress( KThread *t, multi_progress * progress_data );
 
+/* work-queue of row-chunks: every thread takes the next chunk when it is done with the last one,
+   so a thread that got a dense part of the table does not hold up the others */
+typedef struct row_queue
+{
+    atomic_t next_chunk;
+    int64_t first;
+    uint64_t row_count, chunk_size;
+    uint32_t chunk_count;
+    int64_t * starts;   /* NULL or chunk_count + 1 ascending chunk-boundaries, made by align_row_queue */
+} row_queue;
+
+void init_row_queue( row_queue * q, int64_t first, uint64_t row_count, uint32_t num_threads );
+bool next_row_chunk( row_queue * q, uint32_t * chunk_id, int64_t * first, uint64_t * count );
+
+/* moves the start of every chunk but the first to align( row, data ) <= row,
+   chunks that become empty that way are dropped */
+rc_t align_row_queue( row_queue * q, int64_t ( * align )( int64_t row, void * data ), void * data );
+void release_row_queue( row_queue * q );
+
 rc_t make_prefixed( char * buffer, size_t bufsize, const char * prefix,
                     const char * path, const char * postfix );
 
+
+/* a read-only memory-map of a whole file, can be shared between threads */
+typedef struct mapped_file
+{
+    const struct KFile * f;
+    const struct KMMap * mm;
+    const uint8_t * addr;
+    uint64_t size;
+} mapped_file;
+
+/* sequential = true : hint to the OS for read-ahead, otherwise the mapped pages are requested */
+rc_t make_mapped_file( const KDirectory * dir, mapped_file * mf, bool sequential, const char * fmt, ... );
+void release_mapped_file( mapped_file * mf );
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,8 @@
 #include <kfs/file.h>
 #include <kfs/buffile.h>
 
+#include <string.h>
+
 typedef struct index_writer
 {
     struct KFile * f;
@@ -147,7 +149,8 @@ rc_t make_index_writer( KDirectory * dir, struct index_writer ** writer,
 typedef struct index_reader
 {
     const struct KFile * f;
-    uint64_t frequency, file_size, max_key;
+    mapped_file map;    /* if map.addr is not NULL, the index is memory-mapped */
+    uint64_t frequency, file_size, max_key, entry_count;
 } index_reader;
 
 
@@ -156,19 +159,53 @@ void release_index_reader( struct index_reader * reader )
     if ( reader != NULL )
     {
         if ( reader->f != NULL ) KFileRelease( reader->f );
+        release_mapped_file( &reader->map ); /* helper.c */
         free( ( void * ) reader );
     }
 }
 
 
-static rc_t read_value( struct index_reader * reader, uint64_t pos, uint64_t * value )
+static rc_t read_value( const struct index_reader * reader, uint64_t pos, uint64_t * value )
 {
-    size_t num_read;
-    rc_t rc = KFileRead( reader->f, pos, ( void *)value, sizeof *value, &num_read );
-    if ( rc != 0 )
-        ErrMsg( "read_value.KFileRead( at %ld ) -> %R", pos, rc );
-    else if ( num_read != sizeof *value )
-        rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
+    rc_t rc = 0;
+    if ( reader->map.addr != NULL )
+    {
+        if ( pos + ( sizeof *value ) > reader->map.size )
+            rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
+        else
+            memmove( value, &reader->map.addr[ pos ], sizeof *value );
+    }
+    else
+    {
+        size_t num_read;
+        rc = KFileRead( reader->f, pos, ( void *)value, sizeof *value, &num_read );
+        if ( rc != 0 )
+            ErrMsg( "read_value.KFileRead( at %ld ) -> %R", pos, rc );
+        else if ( num_read != sizeof *value )
+            rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
+    }
+    return rc;
+}
+
+
+/* layout of the index-file: [frequency] followed by pairs of [key][offset] */
+static rc_t read_entry( const struct index_reader * reader, uint64_t idx, uint64_t * key, uint64_t * offset )
+{
+    uint64_t pos = ( sizeof reader->frequency ) + ( idx * 2 * ( sizeof reader->frequency ) );
+    rc_t rc = read_value( reader, pos, key );
+    if ( rc == 0 )
+        rc = read_value( reader, pos + ( sizeof reader->frequency ), offset );
+    return rc;
+}
+
+
+static rc_t init_index_reader( index_reader * r )
+{
+    rc_t rc = read_value( r, 0, &r->frequency );
+    if ( rc == 0 && r->file_size >= ( sizeof r->frequency ) )
+        r->entry_count = ( r->file_size - ( sizeof r->frequency ) ) / ( 2 * ( sizeof r->frequency ) );
+    if ( rc == 0 )
+        get_max_key( r, &r->max_key );
     return rc;
 }
 
@@ -206,15 +243,12 @@ rc_t make_index_reader( KDirectory * dir, struct index_reader ** reader,
             else
             {
                 r->f = temp_file;
-                rc = read_value( r, 0, &r->frequency );
+                rc = KFileSize( temp_file, &r->file_size );
                 if ( rc == 0 )
-                    rc = KFileSize( temp_file, &r->file_size );
+                    rc = init_index_reader( r );
 
                 if ( rc == 0 )
-                {
-                    get_max_key( r, &r->max_key );
                     *reader = r;
-                }
                 else
                     release_index_reader( r );
             }
@@ -225,87 +259,111 @@ rc_t make_index_reader( KDirectory * dir, struct index_reader ** reader,
 }
 
 
-static uint64_t key_to_pos_guess( const struct index_reader * reader, uint64_t key )
+rc_t make_index_reader_mmap( const KDirectory * dir, struct index_reader ** reader, const char * filename )
 {
-    uint64_t chunk_id = ( key / reader->frequency );
-    return ( ( sizeof reader->frequency ) + ( chunk_id * ( 2 * ( sizeof reader->frequency ) ) ) );
+    rc_t rc = 0;
+    index_reader * r = calloc( 1, sizeof * r );
+    if ( r == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "calloc( %d ) -> %R", ( sizeof * r ), rc );
+    }
+    else
+    {
+        rc = make_mapped_file( dir, &r->map, false, "%s", filename ); /* helper.c */
+        if ( rc == 0 && r->map.addr == NULL )
+            rc = RC( rcVDB, rcNoTarg, rcConstructing, rcFormat, rcInvalid ); /* empty index-file */
+        if ( rc == 0 )
+        {
+            r->file_size = r->map.size;
+            rc = init_index_reader( r );
+        }
+        if ( rc == 0 )
+            *reader = r;
+        else
+            release_index_reader( r );
+    }
+    return rc;
 }
 
 
-static rc_t read_3( const struct index_reader * reader, uint64_t pos, uint64_t * data, size_t to_read )
+/* binary search for the last entry with a key <= key_to_find,
+   a key beyond the last entry is not found ( the callers detect the end of the range with it ) */
+rc_t get_nearest_offset( const struct index_reader * reader, uint64_t key_to_find,
+                   uint64_t * key_found, uint64_t * offset )
 {
-    size_t num_read;
-    rc_t rc = KFileRead( reader->f, pos, ( void *)data, to_read, &num_read );
-    if ( rc != 0 )
-        ErrMsg( "read_3.KFileRead( at %ld ) -> %R", pos, rc );
-    else if ( num_read != to_read )
-        rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
+    rc_t rc = 0;
+    if ( reader == NULL || key_found == NULL || offset == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcReading, rcParam, rcInvalid );
+        ErrMsg( "get_nearest_offset() -> %R", rc );
+    }
+    else if ( reader->entry_count == 0 || key_to_find > reader->max_key )
+        rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
+    else
+    {
+        uint64_t lo = 0, hi = reader->entry_count;  /* the entry we look for is in [ lo, hi ) */
+        while ( rc == 0 && hi - lo > 1 )
+        {
+            uint64_t mid = lo + ( ( hi - lo ) >> 1 );
+            uint64_t mid_key, mid_offset;
+            rc = read_entry( reader, mid, &mid_key, &mid_offset );
+            if ( rc == 0 )
+            {
+                if ( mid_key <= key_to_find )
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+        }
+        /* if key_to_find is smaller than the first key, we return the first entry */
+        if ( rc == 0 )
+            rc = read_entry( reader, lo, key_found, offset );
+    }
     return rc;
 }
 
 
-rc_t get_nearest_offset( const struct index_reader * reader, uint64_t key_to_find,
-                   uint64_t * key_found, uint64_t * offset )
+/* where a forward scan for key_to_find has to start: at the last entry with a key <= key_to_find,
+   or directly at the entry after it if key_to_find lies more than frequency beyond that entry
+   ( the writer would have made an index-entry of every lookup-key in between ),
+   rcTooBig if key_to_find lies more than frequency beyond the last entry: no lookup-key is left */
+rc_t get_scan_start( const struct index_reader * reader, uint64_t key_to_find,
+                     uint64_t * key_found, uint64_t * offset )
 {
     rc_t rc = 0;
     if ( reader == NULL || key_found == NULL || offset == NULL )
     {
         rc = RC( rcVDB, rcNoTarg, rcReading, rcParam, rcInvalid );
-        ErrMsg( "get_nearest_offset() -> %R", rc );
+        ErrMsg( "get_scan_start() -> %R", rc );
     }
+    else if ( reader->entry_count == 0 )
+        rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
     else
     {
-        uint64_t data[ 6 ];
-        /*
-            data[ 0 ] ... key0      data[ 1 ] ... offset0
-            data[ 2 ] ... key1      data[ 3 ] ... offset1
-            data[ 4 ] ... key2      data[ 5 ] ... offset2
-        */
-        uint64_t pos = key_to_pos_guess( reader, key_to_find );
-        bool found = false;
-        while ( rc == 0 && !found && pos < reader->file_size )
-        {        
-            rc = read_3( reader, pos, data, sizeof data );
+        uint64_t lo = 0, hi = reader->entry_count;  /* the entry we look for is in [ lo, hi ) */
+        while ( rc == 0 && hi - lo > 1 )
+        {
+            uint64_t mid = lo + ( ( hi - lo ) >> 1 );
+            uint64_t mid_key, mid_offset;
+            rc = read_entry( reader, mid, &mid_key, &mid_offset );
             if ( rc == 0 )
             {
-                if ( key_to_find >= data[ 0 ] && key_to_find < data[ 2 ] )
-                {
-                    /* key_to_find is between key0 and key1 */
-                    found = true;
-                    *key_found = data[ 0 ];
-                    *offset = data[ 1 ];
-                }
-                else if ( key_to_find >= data[ 2 ] && key_to_find < data[ 4 ] )
-                {
-                    /* key_to_find is between key1 and key2 */
-                    found = true;
-                    *key_found = data[ 2 ];
-                    *offset = data[ 3 ];
-                }
-                if ( !found )
-                {
-                    if ( key_to_find < data[ 0 ] )
-                    {
-                        /* key_to_find is smaller than our guess */
-                        if ( pos > sizeof reader->frequency )
-                            pos -= ( 2 * ( sizeof reader->frequency ) );
-                        else
-                        {
-                            found = true;
-                            *key_found = data[ 0 ];
-                            *offset = data[ 1 ];
-                        }
-                    }
-                    else if ( key_to_find > data[ 4 ] )
-                    {
-                        /* key_to_find is bigger than our guess */
-                        pos += ( 2 * ( sizeof reader->frequency ) );
-                    }
-                }
+                if ( mid_key <= key_to_find )
+                    lo = mid;
+                else
+                    hi = mid;
             }
         }
-        if ( !found )
-            rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
+        if ( rc == 0 )
+            rc = read_entry( reader, lo, key_found, offset );
+        if ( rc == 0 && key_to_find > *key_found + reader->frequency )
+        {
+            if ( lo + 1 < reader->entry_count )
+                rc = read_entry( reader, lo + 1, key_found, offset );
+            else
+                rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcTooBig );
+        }
     }
     return rc;
 }
@@ -323,13 +381,12 @@ rc_t get_max_key( const struct index_reader * reader, uint64_t * max_key )
     {
         *max_key = reader->max_key;
     }
+    else if ( reader->entry_count == 0 )
+        rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
     else
     {
-        uint64_t data[ 6 ];
-        uint64_t pos = reader->file_size - ( sizeof data );
-        rc = read_3( reader, pos, data, sizeof data );
-        if ( rc == 0 )
-             *max_key = data[ 4 ];
+        uint64_t offset;
+        rc = read_entry( reader, reader->entry_count - 1, max_key, &offset );
     }
     return rc;
-}
\ No newline at end of file
+}
@@ -55,9 +55,16 @@ struct index_reader;
 void release_index_reader( struct index_reader * reader );
 rc_t make_index_reader( KDirectory * dir, struct index_reader ** reader,
                         size_t buf_size, const char * fmt, ... );
+
+/* memory-mapped index-reader: it can be shared between threads */
+rc_t make_index_reader_mmap( const KDirectory * dir, struct index_reader ** reader, const char * filename );
 rc_t get_nearest_offset( const struct index_reader * reader, uint64_t key_to_find,
                    uint64_t * key_found, uint64_t * offset );
 
+/* the offset a seek for key_to_find scans forward from: at most frequency keys before it */
+rc_t get_scan_start( const struct index_reader * reader, uint64_t key_to_find,
+                     uint64_t * key_found, uint64_t * offset );
+
 rc_t get_max_key( const struct index_reader * reader, uint64_t * max_key );
 
 #ifdef __cplusplus
@@ -59,7 +59,41 @@ static void release_join_ctx( join * j )
 }
 
 
-static rc_t init_join( const join_params * jp, struct join *j, struct index_reader * index )
+static rc_t open_join_printer( const join_params * jp, struct join *j )
+{
+    rc_t rc = 0;
+    if ( jp->shared_out != NULL )
+        rc = make_shared_file_printer( jp->shared_out, &j->printer, jp->buf_size, 4096 * 4 ); /* file_printer.c */
+    else if ( jp->output_filename != NULL )
+        rc = make_file_printer( jp->dir, &j->printer, jp->buf_size, 4096 * 4, "%s", jp->output_filename );
+    if ( rc != 0 )
+        ErrMsg( "init_join().make_file_printer() -> %R", rc );
+    return rc;
+}
+
+
+/* the rc-code of seek_lookup_reader is not checked, because if the row-id to be seeked to is in
+   the range of the fully unaligned data - seek will fail, because the are no alignments = lookup-records
+   in this area !*/
+static rc_t seek_join( const join_params * jp, struct join *j )
+{
+    rc_t rc = 0;
+    if ( jp->first > 1 )
+    {
+        uint64_t key_to_find = jp->first << 1;
+        uint64_t key_found = 0;
+        rc_t rc1 = seek_lookup_reader( j->lookup, key_to_find, &key_found, true );
+        if ( GetRCState( rc1 ) != rcTooBig && GetRCState( rc1 ) != rcNotFound )
+            rc = rc1;
+        if ( rc != 0 )
+            ErrMsg( "init_join().seek_lookup_reader( %lu ) -> %R", key_to_find, rc );
+    }
+    return rc;
+}
+
+
+static rc_t init_join( const join_params * jp, struct join *j, struct index_reader * index,
+                       const mapped_file * lookup_map )
 {
     rc_t rc;
     
@@ -68,14 +102,14 @@ static rc_t init_join( const join_params * jp, struct join *j, struct index_read
     j->B1.S.addr = NULL;
     j->B2.S.addr = NULL;
     
-    rc = make_lookup_reader( jp->dir, index, &j->lookup, jp->buf_size, "%s", jp->lookup_filename );
+    if ( jp->store != NULL )
+        rc = make_lookup_reader_store( jp->store, &j->lookup ); /* lookup_reader.c */
+    else if ( lookup_map != NULL )
+        rc = make_lookup_reader_mmap( lookup_map, index, &j->lookup ); /* lookup_reader.c */
+    else
+        rc = make_lookup_reader( jp->dir, index, &j->lookup, jp->buf_size, "%s", jp->lookup_filename );
     if ( rc == 0 )
-    {
-        if ( jp->output_filename != NULL )
-            rc = make_file_printer( jp->dir, &j->printer, jp->buf_size, 4096 * 4, "%s", jp->output_filename );
-        if ( rc != 0 )
-            ErrMsg( "init_join().make_file_printer() -> %R", rc );
-    }
+        rc = open_join_printer( jp, j ); /* above */
     else
         ErrMsg( "init_join().make_lookup_reader() -> %R", rc );
     if ( rc == 0 )
@@ -90,20 +124,8 @@ static rc_t init_join( const join_params * jp, struct join *j, struct index_read
         if ( rc != 0 )
             ErrMsg( "init_join().make_SBuffer( B2 ) -> %R", rc );
     }
-
-    /* the rc-code of seek_lookup_reader is not checked, because if the row-id to be seeked to is in
-       the range of the fully unaligned data - seek will fail, because the are no alignments = lookup-records
-       in this area !*/
-    if ( rc == 0 && jp->first > 1 )
-    {
-        uint64_t key_to_find = jp->first << 1;
-        uint64_t key_found = 0;
-        rc_t rc1 = seek_lookup_reader( j->lookup, key_to_find, &key_found, true );
-        if ( GetRCState( rc1 ) != rcTooBig && GetRCState( rc1 ) != rcNotFound )
-            rc = rc1;
-        if ( rc != 0 )
-            ErrMsg( "init_join().seek_lookup_reader( %lu ) -> %R", key_to_find, rc );
-    }
+    if ( rc == 0 )
+        rc = seek_join( jp, j ); /* above */
     if ( rc != 0 )
         release_join_ctx( j );
     return rc;
@@ -117,6 +139,8 @@ static void copy_join_params( join_params * dst, const join_params * src )
     dst->lookup_filename    = src->lookup_filename;
     dst->index_filename     = src->index_filename;
     dst->output_filename    = src->output_filename;
+    dst->output_mode        = src->output_mode;
+    dst->shared_out         = src->shared_out;
     dst->temp_path          = src->temp_path;
     dst->join_progress      = src->join_progress;
     dst->buf_size           = src->buf_size;
@@ -125,6 +149,8 @@ static void copy_join_params( join_params * dst, const join_params * src )
     dst->first              = src->first;
     dst->count              = src->count;
     dst->show_progress      = src->show_progress;
+    dst->use_mmap           = src->use_mmap;
+    dst->store              = src->store;
     dst->fmt                = src->fmt;
 }
 
@@ -149,7 +175,7 @@ static rc_t print_special_1_read( special_rec * rec, join * j )
     {
         /* read is unaligned, print what is in row->cmp_read ( !!! no lookup !!! ) */
         if ( j->printer != NULL )
-            rc = file_print( j->printer, "%ld\t%S\t%S\n", row_id, &rec->cmp_read, &rec->spot_group );
+            rc = file_print_special( j->printer, row_id, &rec->cmp_read, NULL, &rec->spot_group );
         else
             rc = KOutMsg( "%ld\t%S\t%S\n", row_id, &rec->cmp_read, &rec->spot_group );
     }
@@ -160,7 +186,7 @@ static rc_t print_special_1_read( special_rec * rec, join * j )
         if ( rc == 0 )
         {
             if ( j->printer != NULL )
-                rc = file_print( j->printer, "%ld\t%S\t%S\n", row_id, &j->B1.S, &rec->spot_group );
+                rc = file_print_special( j->printer, row_id, &j->B1.S, NULL, &rec->spot_group );
             else
                 rc = KOutMsg( "%ld\t%S\t%S\n", row_id, &j->B1.S, &rec->spot_group );
         }
@@ -180,7 +206,7 @@ static rc_t print_special_2_reads( special_rec * rec, join * j )
         {
             /* both unaligned, print what is in row->cmp_read ( !!! no lookup !!! )*/
             if ( j->printer != NULL )
-                rc = file_print( j->printer, "%ld\t%S\t%S\n", row_id, &rec->cmp_read, &rec->spot_group );
+                rc = file_print_special( j->printer, row_id, &rec->cmp_read, NULL, &rec->spot_group );
             else
                 rc = KOutMsg( "%ld\t%S\t%S\n", row_id, &rec->cmp_read, &rec->spot_group );
         }
@@ -191,7 +217,7 @@ static rc_t print_special_2_reads( special_rec * rec, join * j )
             if ( rc == 0 )
             {
                 if ( j->printer != NULL )
-                    rc = file_print( j->printer, "%ld\t%S%S\t%S\n", row_id, &rec->cmp_read, &j->B2.S, &rec->spot_group );
+                    rc = file_print_special( j->printer, row_id, &rec->cmp_read, &j->B2.S, &rec->spot_group );
                 else
                     rc = KOutMsg( "%ld\t%S%S\t%S\n", row_id, &rec->cmp_read, &j->B2.S, &rec->spot_group );
             }
@@ -206,7 +232,7 @@ static rc_t print_special_2_reads( special_rec * rec, join * j )
             if ( rc == 0 )
             {
                 if ( j->printer != NULL )
-                    rc = file_print( j->printer, "%ld\t%S%S\t%S\n", row_id, &j->B1.S, &rec->cmp_read, &rec->spot_group );
+                    rc = file_print_special( j->printer, row_id, &j->B1.S, &rec->cmp_read, &rec->spot_group );
                 else
                     rc = KOutMsg( "%ld\t%S%S\t%S\n", row_id, &j->B1.S, &rec->cmp_read, &rec->spot_group );
             }
@@ -220,7 +246,7 @@ static rc_t print_special_2_reads( special_rec * rec, join * j )
             if ( rc == 0 )
             {
                 if ( j->printer != NULL )
-                    rc = file_print( j->printer, "%ld\t%S%S\t%S\n", row_id, &j->B1.S, &j->B2.S, &rec->spot_group );
+                    rc = file_print_special( j->printer, row_id, &j->B1.S, &j->B2.S, &rec->spot_group );
                 else
                     rc = KOutMsg( "%ld\t%S%S\t%S\n", row_id, &j->B1.S, &j->B2.S, &rec->spot_group );
             }
@@ -230,7 +256,7 @@ static rc_t print_special_2_reads( special_rec * rec, join * j )
 }
 
 
-static rc_t print_fastq_1_read( fastq_rec * rec, join * j, const char * acc )
+static rc_t print_fastq_1_read( fastq_rec * rec, join * j, const String * acc )
 {
     rc_t rc = 0;
     int64_t row_id = rec->row_id;
@@ -238,11 +264,9 @@ static rc_t print_fastq_1_read( fastq_rec * rec, join * j, const char * acc )
     if ( rec->prim_alig_id[ 0 ] == 0 )
     {
         /* read is unaligned, print what is in row->cmp_read (no lookup)*/
-        const char * fmt = "@%s.%ld %ld length=%d\n%S\n+%s.%ld %ld length=%d\n%S\n";
+        const char * fmt = "@%S.%ld %ld length=%d\n%S\n+%S.%ld %ld length=%d\n%S\n";
         if ( j->printer != NULL )
-            rc = file_print( j->printer, fmt,
-                acc, row_id, row_id, rec->cmp_read.len, &rec->cmp_read,
-                acc, row_id, row_id, rec->quality.len, &rec->quality );
+            rc = file_print_fastq( j->printer, acc, row_id, &rec->cmp_read, NULL, &rec->quality );
         else
             rc = KOutMsg( fmt,
                 acc, row_id, row_id, rec->cmp_read.len, &rec->cmp_read,
@@ -254,11 +278,9 @@ static rc_t print_fastq_1_read( fastq_rec * rec, join * j, const char * acc )
         rc = lookup_bases( j->lookup, row_id, 1, &j->B1 );
         if ( rc == 0 )
         {
-            const char * fmt = "@%s.%ld %ld length=%d\n%S\n+%s.%ld %ld length=%d\n%S\n";
+            const char * fmt = "@%S.%ld %ld length=%d\n%S\n+%S.%ld %ld length=%d\n%S\n";
             if ( j->printer != NULL )
-                rc = file_print( j->printer, fmt,
-                    acc, row_id, row_id, j->B1.S.len, &j->B1.S,
-                    acc, row_id, row_id, rec->quality.len, &rec->quality );
+                rc = file_print_fastq( j->printer, acc, row_id, &j->B1.S, NULL, &rec->quality );
             else
                 rc = KOutMsg( fmt,
                     acc, row_id, row_id, j->B1.S.len, &j->B1.S,
@@ -269,7 +291,7 @@ static rc_t print_fastq_1_read( fastq_rec * rec, join * j, const char * acc )
 }
 
 
-static rc_t print_fastq_2_reads( fastq_rec * rec, join * j, const char * acc )
+static rc_t print_fastq_2_reads( fastq_rec * rec, join * j, const String * acc )
 {
     rc_t rc = 0;
     int64_t row_id = rec->row_id;
@@ -279,11 +301,9 @@ static rc_t print_fastq_2_reads( fastq_rec * rec, join * j, const char * acc )
         if ( rec->prim_alig_id[ 1 ] == 0 )
         {
             /* both unaligned, print what is in row->cmp_read (no lookup)*/
-            const char * fmt = "@%s.%ld %ld length=%d\n%S\n+%s.%ld %ld length=%d\n%S\n";
+            const char * fmt = "@%S.%ld %ld length=%d\n%S\n+%S.%ld %ld length=%d\n%S\n";
             if ( j->printer != NULL )
-                rc = file_print( j->printer, fmt,
-                    acc, row_id, row_id, rec->cmp_read.len, &rec->cmp_read,
-                    acc, row_id, row_id, rec->quality.len, &rec->quality );
+                rc = file_print_fastq( j->printer, acc, row_id, &rec->cmp_read, NULL, &rec->quality );
             else
                 rc = KOutMsg( fmt,
                     acc, row_id, row_id, rec->cmp_read.len, &rec->cmp_read,
@@ -296,11 +316,9 @@ static rc_t print_fastq_2_reads( fastq_rec * rec, join * j, const char * acc )
             rc = lookup_bases( j->lookup, row_id, 2, &j->B2 );
             if ( rc == 0 )
             {
-                const char * fmt = "@%s.%ld %ld length=%d\n%S%S\n+%s.%ld %ld length=%d\n%S\n";
+                const char * fmt = "@%S.%ld %ld length=%d\n%S%S\n+%S.%ld %ld length=%d\n%S\n";
                 if ( j->printer != NULL )
-                    rc = file_print( j->printer, fmt,
-                        acc, row_id, row_id, rec->cmp_read.len + j->B2.S.len, &rec->cmp_read, &j->B2.S,
-                        acc, row_id, row_id, rec->quality.len, &rec->quality );
+                    rc = file_print_fastq( j->printer, acc, row_id, &rec->cmp_read, &j->B2.S, &rec->quality );
                 else
                     rc = KOutMsg( fmt,
                         acc, row_id, row_id, rec->cmp_read.len + j->B2.S.len, &rec->cmp_read, &j->B2.S,
@@ -316,11 +334,9 @@ static rc_t print_fastq_2_reads( fastq_rec * rec, join * j, const char * acc )
             rc = lookup_bases( j->lookup, row_id, 1, &j->B1 );
             if ( rc == 0 )
             {
-                const char * fmt = "@%s.%ld %ld length=%d\n%S%S\n+%s.%ld %ld length=%d\n%S\n";
+                const char * fmt = "@%S.%ld %ld length=%d\n%S%S\n+%S.%ld %ld length=%d\n%S\n";
                 if ( j->printer != NULL )
-                    rc = file_print( j->printer, fmt,
-                        acc, row_id, row_id, rec->cmp_read.len + j->B1.S.len, &j->B1.S, &rec->cmp_read,
-                        acc, row_id, row_id, rec->quality.len, &rec->quality );
+                    rc = file_print_fastq( j->printer, acc, row_id, &j->B1.S, &rec->cmp_read, &rec->quality );
                 else
                     rc = KOutMsg( fmt,
                         acc, row_id, row_id, rec->cmp_read.len + j->B1.S.len, &j->B1.S, &rec->cmp_read,
@@ -335,11 +351,9 @@ static rc_t print_fastq_2_reads( fastq_rec * rec, join * j, const char * acc )
                 rc = lookup_bases( j->lookup, row_id, 2, &j->B2 );
             if ( rc == 0 )
             {
-                const char * fmt = "@%s.%ld %ld length=%d\n%S%S\n+%s.%ld %ld length=%d\n%S\n";
+                const char * fmt = "@%S.%ld %ld length=%d\n%S%S\n+%S.%ld %ld length=%d\n%S\n";
                 if ( j->printer != NULL )
-                    rc = file_print( j->printer, fmt,
-                        acc, row_id, row_id, j->B1.S.len + j->B2.S.len, &j->B1.S, &j->B2.S,
-                        acc, row_id, row_id, rec->quality.len, &rec->quality );
+                    rc = file_print_fastq( j->printer, acc, row_id, &j->B1.S, &j->B2.S, &rec->quality );
                 else
                     rc = KOutMsg( fmt,
                         acc, row_id, row_id, j->B1.S.len + j->B2.S.len, &j->B1.S, &j->B2.S,
@@ -384,9 +398,117 @@ static rc_t extract_row_count_cmn( const join_params * jp, uint64_t * row_count
     return rc;
 }
 
+/* ------------------------------------------------------------------------------------------ */
+
+static const char * leaf_of( const char * src )
+{
+    const char * last_slash = string_rchr( src, string_size ( src ), '/' );
+    if ( last_slash != NULL )
+        return last_slash + 1;
+    return src;
+}
+
+/* the output of one chunk, concatenated in chunk-order into the output-file */
+static rc_t make_part_filename( const join_params * jp, char * buffer, size_t bufsize, uint32_t id )
+{
+    rc_t rc;
+    size_t num_writ;
+    if ( jp->temp_path != NULL )
+    {
+        uint32_t l = string_measure( jp->temp_path, NULL );
+        if ( l == 0 )
+        {
+            rc = RC( rcVDB, rcNoTarg, rcConstructing, rcParam, rcInvalid );
+            ErrMsg( "make_part_filename.string_measure() = 0 -> %R", rc );
+        }
+        else
+        {
+            const char * output_file_leaf = leaf_of( jp->output_filename ); /* above */
+            
+            if ( jp->temp_path[ l-1 ] == '/' )
+                rc = string_printf( buffer, bufsize, &num_writ, "%s%s.%d",
+                        jp->temp_path, output_file_leaf, id );
+            else
+                rc = string_printf( buffer, bufsize, &num_writ, "%s/%s.%d",
+                        jp->temp_path, output_file_leaf, id );
+        }
+    }
+    else
+        rc = string_printf( buffer, bufsize, &num_writ, "%s.%d", jp->output_filename, id );
+        
+    if ( rc != 0 )
+        ErrMsg( "make_part_filename.string_printf() -> %R", rc );
+    return rc;
+}
+
+
+/* the row-chunks a join-thread works on: one after the other, with the same iterator and lookup-reader */
+typedef struct join_chunks
+{
+    const join_params * jp;     /* the original parameters, for the names of the part-files */
+    row_queue * queue;
+    char part_file[ 4096 ];
+} join_chunks;
+
+
+/* moves the join to the next chunk: a new part-file, the lookup-reader at the first row of it
+   ( it is there already if the chunk continues where the last one ended ) */
+static bool next_join_chunk( join_chunks * chunks, join_params * cjp, join * j, rc_t * rc )
+{
+    uint32_t chunk_id;
+    int64_t end = cjp->first + cjp->count;
+    bool res = ( chunks != NULL &&
+                 next_row_chunk( chunks->queue, &chunk_id, &cjp->first, &cjp->count ) ); /* helper.c */
+    if ( res )
+    {
+        *rc = make_part_filename( chunks->jp, chunks->part_file, sizeof chunks->part_file, chunk_id ); /* above */
+        if ( *rc == 0 && cjp->shared_out == NULL )
+        {
+            destroy_file_printer( j->printer ); /* file_printer.c */
+            j->printer = NULL;
+            cjp->output_filename = chunks->part_file;
+            *rc = open_join_printer( cjp, j ); /* above */
+        }
+        if ( *rc == 0 && cjp->first != end )
+            *rc = seek_join( cjp, j ); /* above */
+        if ( *rc != 0 )
+            res = false;
+    }
+    return res;
+}
+
+
+static bool next_special_chunk( join_chunks * chunks, join_params * cjp, join * j,
+                                struct special_iter * iter, rc_t * rc )
+{
+    bool res = next_join_chunk( chunks, cjp, j, rc ); /* above */
+    if ( res )
+    {
+        *rc = set_special_iter_rows( iter, cjp->first, cjp->count ); /* special_iter.c */
+        res = ( *rc == 0 );
+    }
+    return res;
+}
+
+
+static bool next_fastq_chunk( join_chunks * chunks, join_params * cjp, join * j,
+                              struct fastq_iter * iter, rc_t * rc )
+{
+    bool res = next_join_chunk( chunks, cjp, j, rc ); /* above */
+    if ( res )
+    {
+        *rc = set_fastq_iter_rows( iter, cjp->first, cjp->count ); /* fastq_iter.c */
+        res = ( *rc == 0 );
+    }
+    return res;
+}
+
+
 rc_t CC Quitting();
 
-static rc_t perform_special_join( const join_params * jp, struct index_reader * index )
+/* chunks is NULL if jp is the whole job */
+static rc_t perform_special_join( const join_params * jp, struct index_reader * index,
+                                  const mapped_file * lookup_map, join_chunks * chunks )
 {
     rc_t rc;
     struct special_iter * iter;
@@ -397,24 +519,32 @@ static rc_t perform_special_join( const join_params * jp, struct index_reader *
     if ( rc == 0 )
     {
         join j;
-        rc = init_join( jp, &j, index );
+        rc = init_join( jp, &j, index, lookup_map );
         if ( rc == 0 )
         {
-            special_rec rec;
-            while ( get_from_special_iter( iter, &rec, &rc ) && rc == 0 )
+            join_params cjp;
+
+            copy_join_params( &cjp, jp );
+            do
             {
-                rc = Quitting();
-                if ( rc == 0 )
+                special_rec rec;
+                while ( get_from_special_iter( iter, &rec, &rc ) && rc == 0 )
                 {
-                    if ( rec.num_reads == 1 )
-                        rc = print_special_1_read( &rec, &j );
-                    else
-                        rc = print_special_2_reads( &rec, &j );
+                    rc = Quitting();
+                    if ( rc == 0 )
+                    {
+                        if ( rec.num_reads == 1 )
+                            rc = print_special_1_read( &rec, &j );
+                        else
+                            rc = print_special_2_reads( &rec, &j );
 
-                    if ( jp->join_progress != NULL )
-                        atomic_inc( jp->join_progress );
+                        if ( jp->join_progress != NULL )
+                            atomic_inc( jp->join_progress );
+                    }
                 }
-            }
+                if ( rc == 0 && j.printer != NULL )
+                    rc = flush_file_printer( j.printer ); /* file_printer.c */
+            } while ( rc == 0 && next_special_chunk( chunks, &cjp, &j, iter, &rc ) ); /* above */
             release_join_ctx( &j );
         }
         else
@@ -427,7 +557,9 @@ static rc_t perform_special_join( const join_params * jp, struct index_reader *
 }
 
 
-static rc_t perform_fastq_join( const join_params * jp, struct index_reader * index )
+/* chunks is NULL if jp is the whole job */
+static rc_t perform_fastq_join( const join_params * jp, struct index_reader * index,
+                                const mapped_file * lookup_map, join_chunks * chunks )
 {
     rc_t rc;
     struct fastq_iter * iter;
@@ -439,27 +571,36 @@ static rc_t perform_fastq_join( const join_params * jp, struct index_reader * in
     {
         join j;
         
-        rc = init_join( jp, &j, index );
+        rc = init_join( jp, &j, index, lookup_map );
         if ( rc == 0 )
         {
-            fastq_rec rec;
+            join_params cjp;
             uint64_t n = 0;
+            String acc;
             
-            while ( get_from_fastq_iter( iter, &rec, &rc ) && rc == 0 )
+            copy_join_params( &cjp, jp );
+            StringInitCString( &acc, jp->accession );
+            do
             {
-                rc = Quitting();
-                if ( rc == 0 )
+                fastq_rec rec;
+                while ( get_from_fastq_iter( iter, &rec, &rc ) && rc == 0 )
                 {
-                    if ( rec.num_reads == 1 )
-                        rc = print_fastq_1_read( &rec, &j, jp->accession );
-                    else
-                        rc = print_fastq_2_reads( &rec, &j, jp->accession );
-
-                    if ( jp->join_progress != NULL )
-                        atomic_inc( jp->join_progress );
-                    n++;
+                    rc = Quitting();
+                    if ( rc == 0 )
+                    {
+                        if ( rec.num_reads == 1 )
+                            rc = print_fastq_1_read( &rec, &j, &acc );
+                        else
+                            rc = print_fastq_2_reads( &rec, &j, &acc );
+
+                        if ( jp->join_progress != NULL )
+                            atomic_inc( jp->join_progress );
+                        n++;
+                    }
                 }
-            }
+                if ( rc == 0 && j.printer != NULL )
+                    rc = flush_file_printer( j.printer ); /* file_printer.c */
+            } while ( rc == 0 && next_fastq_chunk( chunks, &cjp, &j, iter, &rc ) ); /* above */
             release_join_ctx( &j );
         }
         else
@@ -472,67 +613,44 @@ static rc_t perform_fastq_join( const join_params * jp, struct index_reader * in
 }
 
 
+static rc_t perform_join( const join_params * jp, struct index_reader * index,
+                          const mapped_file * lookup_map, join_chunks * chunks )
+{
+    rc_t rc = 0;
+    switch( jp->fmt )
+    {
+        case ft_special : rc = perform_special_join( jp, index, lookup_map, chunks ); break; /* above */
+        case ft_fastq   : rc = perform_fastq_join( jp, index, lookup_map, chunks ); break; /* above */
+        default : break;
+    }
+    return rc;
+}
+
 
 /* ------------------------------------------------------------------------------------------ */
 
 typedef struct join_thread_data
 {
     const join_params * jp;
-    int64_t first;
+    struct index_reader * index;        /* shared between threads if memory-mapped */
+    const mapped_file * lookup_map;     /* NULL if not memory-mapped */
+    struct shared_file * shared_out;    /* NULL if not jo_unordered */
+    row_queue * queue;                  /* the threads pull row-chunks from it, NULL if jo_split */
+    int64_t first;                      /* jo_split: the rows of this thread ... */
     uint64_t count;
-    uint32_t idx;
+    uint32_t split_id;                  /* ... written straight into 'output.split_id' */
 } join_thread_data;
 
 
-static const char * leaf_of( const char * src )
-{
-    const char * last_slash = string_rchr( src, string_size ( src ), '/' );
-    if ( last_slash != NULL )
-        return last_slash + 1;
-    return src;
-}
-
-static rc_t make_part_filename( const join_params * jp, char * buffer, size_t bufsize, uint32_t id )
-{
-    rc_t rc;
-    size_t num_writ;
-    if ( jp->temp_path != NULL )
-    {
-        uint32_t l = string_measure( jp->temp_path, NULL );
-        if ( l == 0 )
-        {
-            rc = RC( rcVDB, rcNoTarg, rcConstructing, rcParam, rcInvalid );
-            ErrMsg( "make_part_filename.string_measure() = 0 -> %R", rc );
-        }
-        else
-        {
-            const char * output_file_leaf = leaf_of( jp->output_filename ); /* above */
-            
-            if ( jp->temp_path[ l-1 ] == '/' )
-                rc = string_printf( buffer, bufsize, &num_writ, "%s%s.%d",
-                        jp->temp_path, output_file_leaf, id );
-            else
-                rc = string_printf( buffer, bufsize, &num_writ, "%s/%s.%d",
-                        jp->temp_path, output_file_leaf, id );
-        }
-    }
-    else
-        rc = string_printf( buffer, bufsize, &num_writ, "%s.%d", jp->output_filename, id );
-        
-    if ( rc != 0 )
-        ErrMsg( "make_part_filename.string_printf() -> %R", rc );
-    return rc;
-}
-
-
-static rc_t concat_part_files( const join_params * jp, uint32_t count )
+/* the part-files of the chunks first ... end-1, in this order into output */
+static rc_t concat_part_files( const join_params * jp, uint32_t first, uint32_t end, const char * output )
 {
     struct VNamelist * files;
-    rc_t rc = VNamelistMake( &files, count );
+    rc_t rc = VNamelistMake( &files, end > first ? end - first : 1 );
     if ( rc == 0 )
     {
         uint32_t idx;
-        for ( idx = 0; rc == 0 && idx < count; ++idx )
+        for ( idx = first; rc == 0 && idx < end; ++idx )
         {
             char part_file[ 4096 ];
             rc = make_part_filename( jp, part_file, sizeof part_file, idx ); /* above */
@@ -540,7 +658,7 @@ static rc_t concat_part_files( const join_params * jp, uint32_t count )
                 rc = VNamelistAppend( files, part_file );
         }
         if ( rc == 0 )
-            rc = concat_files( jp->dir, files, jp->buf_size, jp->output_filename, jp->show_progress ); /* helper.c */
+            rc = concat_files( jp->dir, files, jp->buf_size, output, jp->show_progress ); /* helper.c */
         if ( rc == 0 )
             rc = delete_files( jp->dir, files );
         VNamelistRelease( files );
@@ -548,6 +666,30 @@ static rc_t concat_part_files( const join_params * jp, uint32_t count )
     return rc;
 }
 
+
+/* a chunk that starts on the row of an index-entry is found by the binary search of the index alone,
+   a row that is more than the index-frequency behind the entry before it is found that way too */
+static int64_t align_to_index( int64_t row, void * data )
+{
+    const struct index_reader * index = data;
+    uint64_t key_to_find = ( ( uint64_t )row ) << 1;
+    uint64_t key_found, offset;
+    if ( get_scan_start( index, key_to_find, &key_found, &offset ) == 0 && key_found < key_to_find ) /* index.c */
+        return ( int64_t )( ( key_found + 1 ) >> 1 );
+    return row;
+}
+
+
+/* jo_split: the first row of thread idx, the end of the rows of the last thread for idx == num_threads */
+static int64_t split_start( uint64_t row_count, uint32_t num_threads, uint32_t idx,
+                            const struct index_reader * index )
+{
+    int64_t row = 1 + ( int64_t )( ( row_count * idx ) / num_threads );
+    if ( idx > 0 && idx < num_threads && index != NULL )
+        row = align_to_index( row, ( void * )index ); /* above */
+    return row;
+}
+
 /* ------------------------------------------------------------------------------------------ */
 
 static rc_t CC cmn_thread_func( const KThread *self, void *data )
@@ -555,38 +697,67 @@ static rc_t CC cmn_thread_func( const KThread *self, void *data )
     rc_t rc = 0;
     join_thread_data * jtd = data;
     const join_params * jp = jtd->jp;
-    struct index_reader * index = NULL;
+    struct index_reader * index = jtd->index;
     
-    if ( jp->index_filename != NULL )
+    if ( index == NULL && jp->store == NULL && jp->index_filename != NULL )
     {
         if ( file_exists( jp->dir, "%s", jp->index_filename ) )
             rc = make_index_reader( jp->dir, &index, jp->buf_size, "%s", jp->index_filename ); /* index.c */
     }
 
-    if ( rc == 0 && index != NULL )
+    if ( rc == 0 && ( index != NULL || jp->store != NULL ) )
     {
-        char part_file[ 4096 ];
-        rc = make_part_filename( jp, part_file, sizeof part_file, jtd->idx ); /* above */
-        if ( rc == 0 )
+        uint32_t chunk_id;
+        join_params cjp;
+        join_chunks chunks;
+
+        copy_join_params( &cjp, jp );
+        cjp.num_threads = 0;
+        cjp.shared_out = jtd->shared_out;
+        cjp.show_progress = false;
+        chunks.jp = jp;
+        chunks.queue = jtd->queue;
+
+        if ( jtd->queue == NULL )
         {
-            join_params cjp;
-
-            copy_join_params( &cjp, jp );
-            cjp.num_threads = 0;
+            /* jo_split: one range of rows, no part-files */
+            size_t num_writ;
             cjp.first = jtd->first;
             cjp.count = jtd->count;
-            cjp.output_filename = part_file;
-            cjp.show_progress = false;
-            
-            switch( jp->fmt )
+            rc = string_printf( chunks.part_file, sizeof chunks.part_file, &num_writ, "%s.%d",
+                                jp->output_filename, jtd->split_id );
+            if ( rc != 0 )
+                ErrMsg( "cmn_thread_func.string_printf() -> %R", rc );
+            else
             {
-                case ft_special : rc = perform_special_join( &cjp, index ); break; /* above */
-                case ft_fastq   : rc = perform_fastq_join( &cjp, index ); break; /* above */
-                default : break;
-                
+                cjp.output_filename = chunks.part_file;
+                if ( cjp.count > 0 )
+                    rc = perform_join( &cjp, index, jtd->lookup_map, NULL ); /* above */
+                else
+                {
+                    /* no rows left for this thread, but every thread has its split-file */
+                    struct file_printer * printer;
+                    rc = make_file_printer( jp->dir, &printer, jp->buf_size, 4096 * 4, "%s", cjp.output_filename );
+                    if ( rc != 0 )
+                        ErrMsg( "cmn_thread_func.make_file_printer( '%s' ) -> %R", cjp.output_filename, rc );
+                    else
+                        destroy_file_printer( printer ); /* file_printer.c */
+                }
             }
         }
-        release_index_reader( index ); /* index.c */    
+        /* one part-file per chunk, the part-files are concatenated in chunk-order;
+           the first chunk opens the iterator and the lookup-reader, the following ones reuse them */
+        else if ( next_row_chunk( jtd->queue, &chunk_id, &cjp.first, &cjp.count ) ) /* helper.c */
+        {
+            rc = make_part_filename( jp, chunks.part_file, sizeof chunks.part_file, chunk_id ); /* above */
+            if ( rc == 0 )
+            {
+                cjp.output_filename = chunks.part_file;
+                rc = perform_join( &cjp, index, jtd->lookup_map, &chunks ); /* above */
+            }
+        }
+        if ( index != jtd->index )
+            release_index_reader( index ); /* index.c */    
     }
     
     free( ( void * ) data );
@@ -594,22 +765,50 @@ static rc_t CC cmn_thread_func( const KThread *self, void *data )
 }
 
 
+/* one memory-map of the lookup-file and the index, shared by all join-threads */
+static rc_t make_join_maps( const join_params * jp, mapped_file * lookup_map, struct index_reader ** index )
+{
+    rc_t rc = make_mapped_file( jp->dir, lookup_map, true, "%s", jp->lookup_filename ); /* helper.c */
+    if ( rc != 0 )
+        ErrMsg( "make_join_maps().make_mapped_file( '%s' ) -> %R", jp->lookup_filename, rc );
+    else if ( jp->index_filename != NULL && file_exists( jp->dir, "%s", jp->index_filename ) )
+    {
+        rc = make_index_reader_mmap( jp->dir, index, jp->index_filename ); /* index.c */
+        if ( rc != 0 )
+        {
+            ErrMsg( "make_join_maps().make_index_reader_mmap( '%s' ) -> %R", jp->index_filename, rc );
+            release_mapped_file( lookup_map ); /* helper.c */
+        }
+    }
+    return rc;
+}
+
+
 rc_t execute_join( const join_params * jp )
 {
     rc_t rc = 0;
+    mapped_file map;
+    const mapped_file * lookup_map = NULL;
+    struct index_reader * index = NULL;
     
-    if ( jp->show_progress )
+    if ( jp->use_mmap && jp->store == NULL )
+    {
+        rc = make_join_maps( jp, &map, &index ); /* above */
+        if ( rc == 0 )
+            lookup_map = &map;
+    }
+
+    if ( rc == 0 && jp->show_progress )
         KOutMsg( "join   :" );
 
-    if ( jp->num_threads < 2 )
+    if ( rc != 0 )
+    {
+        /* nothing to do, error has been reported */
+    }
+    else if ( jp->num_threads < 2 )
     {
         /* on the main thread */
-        switch( jp->fmt )
-        {
-            case ft_special : rc = perform_special_join( jp, NULL ); break; /* above */
-            case ft_fastq   : rc = perform_fastq_join( jp, NULL ); break; /* above */
-            default : break;
-        }
+        rc = perform_join( jp, index, lookup_map, NULL ); /* above */
     }
     else
     {
@@ -618,13 +817,28 @@ rc_t execute_join( const join_params * jp )
         if ( rc == 0 && row_count > 0 )
         {
             Vector threads;
-            int64_t first = 1;
-            uint64_t i, per_thread = ( row_count / jp->num_threads ) + 1;
+            uint32_t i, thread_count;
+            row_queue queue;
             KThread * progress_thread = NULL;
+            struct shared_file * shared_out = NULL;
+            struct index_reader * align_index = index;
             multi_progress progress;
 
             init_progress_data( &progress, row_count ); /* helper.c */
-            VectorInit( &threads, 0, jp->num_threads );
+            init_row_queue( &queue, 1, row_count, jp->num_threads ); /* helper.c */
+
+            /* the threads open their own index-reader, if it is not memory-mapped */
+            if ( align_index == NULL && jp->store == NULL && jp->index_filename != NULL &&
+                 file_exists( jp->dir, "%s", jp->index_filename ) )
+                rc = make_index_reader( jp->dir, &align_index, jp->buf_size, "%s", jp->index_filename ); /* index.c */
+            if ( rc == 0 && align_index != NULL && jp->output_mode != jo_split )
+                rc = align_row_queue( &queue, align_to_index, align_index ); /* helper.c */
+
+            /* jo_split: one range of rows per thread, written straight into its split-file */
+            thread_count = jp->num_threads;
+            if ( jp->output_mode != jo_split && thread_count > queue.chunk_count )
+                thread_count = queue.chunk_count;
+            VectorInit( &threads, 0, thread_count );
             
             if ( jp->show_progress )
             {
@@ -632,7 +846,9 @@ rc_t execute_join( const join_params * jp )
                 nc_jp->join_progress = &progress.progress_rows;
                 rc = start_multi_progress( &progress_thread, &progress ); /* helper.c */
             }
-            for ( i = 0; rc == 0 && i < jp->num_threads; ++i )
+            if ( rc == 0 && jp->output_mode == jo_unordered )
+                rc = make_shared_file( jp->dir, &shared_out, "%s", jp->output_filename ); /* file_printer.c */
+            for ( i = 0; rc == 0 && i < thread_count; ++i )
             {
                 join_thread_data * jtd = calloc( 1, sizeof * jtd );
                 if ( jtd != NULL )
@@ -640,9 +856,18 @@ rc_t execute_join( const join_params * jp )
                     KThread * thread;
                     
                     jtd->jp = jp;
-                    jtd->first = first;
-                    jtd->count = per_thread;
-                    jtd->idx = i;
+                    jtd->index = index;
+                    jtd->lookup_map = lookup_map;
+                    jtd->shared_out = shared_out;
+                    if ( jp->output_mode == jo_split )
+                    {
+                        int64_t end = split_start( row_count, thread_count, i + 1, align_index ); /* above */
+                        jtd->first = split_start( row_count, thread_count, i, align_index ); /* above */
+                        jtd->count = ( end > jtd->first ) ? ( uint64_t )( end - jtd->first ) : 0;
+                        jtd->split_id = i;
+                    }
+                    else
+                        jtd->queue = &queue;
 
                     rc = KThreadMake( &thread, cmn_thread_func, jtd );
                     if ( rc != 0 )
@@ -653,18 +878,30 @@ rc_t execute_join( const join_params * jp )
                         if ( rc != 0 )
                             ErrMsg( "VectorAppend( sort-thread #%d ) -> %R", i, rc );
                     }
-                    first += per_thread;
                 }
             }
             
             join_and_release_threads( &threads ); /* helper.c */
             join_multi_progress( progress_thread, &progress ); /* helper.c */
-            
-            if ( jp->show_progress )
-                KOutMsg( "concat :" );
-            
-            rc = concat_part_files( jp, jp->num_threads ); /* above */
+            release_shared_file( shared_out ); /* file_printer.c */
+            if ( align_index != index )
+                release_index_reader( align_index ); /* index.c */
+
+            /* jo_unordered, jo_split: the threads have written the final output already */
+            if ( rc == 0 && jp->output_mode == jo_concat )
+            {
+                if ( jp->show_progress )
+                    KOutMsg( "concat :" );
+                rc = concat_part_files( jp, 0, queue.chunk_count, jp->output_filename ); /* above */
+            }
+            release_row_queue( &queue ); /* helper.c */
         }
     }
+
+    if ( lookup_map != NULL )
+    {
+        release_index_reader( index ); /* index.c */
+        release_mapped_file( &map ); /* helper.c */
+    }
     return rc;
 }
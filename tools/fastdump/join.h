@@ -51,6 +51,17 @@ extern "C" {
 #include "helper.h"
 #endif
 
+struct packed_store;
+struct shared_file;
+
+/* how the output of multiple join-threads ends up in the file-system */
+typedef enum join_output_t
+{
+    jo_concat,      /* one part-file per chunk, concatenated at the end ( in order ) */
+    jo_unordered,   /* all threads write into the output-file, records of threads are interleaved */
+    jo_split        /* one output-file per thread: 'output.0', 'output.1', ... ( the rows in order ) */
+} join_output_t;
+
 typedef struct join_params
 {
     KDirectory * dir;
@@ -64,6 +75,10 @@ typedef struct join_params
     int64_t first;
     uint64_t count;
     bool show_progress;
+    bool use_mmap;
+    const struct packed_store * store;  /* if not NULL: the lookup-table is in memory, no lookup-file */
+    struct shared_file * shared_out;    /* set internally for jo_unordered */
+    join_output_t output_mode;
     format_t fmt;
 } join_params;
 
@@ -26,6 +26,7 @@
 
 #include "lookup_reader.h"
 #include "helper.h"
+#include "packed_store.h"
 
 #include <klib/printf.h>
 #include <kfs/file.h>
@@ -37,9 +38,11 @@
 typedef struct lookup_reader
 {
     const struct KFile * f;
+    const mapped_file * map;    /* not owned, shared between the readers of all threads */
+    const struct packed_store * store;  /* not owned, sorted, in-memory instead of a lookup-file */
     const struct index_reader * index;
     SBuffer buf;
-    uint64_t pos;
+    uint64_t pos;   /* file-offset, or entry-index if reading from a store */
 } lookup_reader;
 
 
@@ -109,11 +112,77 @@ rc_t make_lookup_reader( const KDirectory *dir, const struct index_reader * inde
 }
 
 
+rc_t make_lookup_reader_mmap( const mapped_file * map, const struct index_reader * index,
+                              struct lookup_reader ** reader )
+{
+    rc_t rc = 0;
+    lookup_reader * r = calloc( 1, sizeof * r );
+    if ( r == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "make_lookup_reader_mmap.calloc( %d ) -> %R", ( sizeof * r ), rc );
+    }
+    else
+    {
+        r->map = map;
+        r->index = index;
+        rc = make_SBuffer( &r->buf, 4096 );
+        if ( rc == 0 )
+            *reader = r;
+        else
+            release_lookup_reader( r );
+    }
+    return rc;
+}
+
+
+rc_t make_lookup_reader_store( const struct packed_store * store, struct lookup_reader ** reader )
+{
+    rc_t rc = 0;
+    lookup_reader * r = calloc( 1, sizeof * r );
+    if ( r == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "make_lookup_reader_store.calloc( %d ) -> %R", ( sizeof * r ), rc );
+    }
+    else
+    {
+        r->store = store;
+        rc = make_SBuffer( &r->buf, 4096 );
+        if ( rc == 0 )
+            *reader = r;
+        else
+            release_lookup_reader( r );
+    }
+    return rc;
+}
+
+
+/* reads from the memory-map if there is one, from the file otherwise */
+static rc_t read_at( const struct lookup_reader * reader, uint64_t pos, void * buffer, size_t to_read, size_t * num_read )
+{
+    rc_t rc = 0;
+    if ( reader->map != NULL )
+    {
+        uint64_t size = reader->map->size;
+        size_t n = 0;
+        if ( pos < size )
+            n = ( pos + to_read > size ) ? ( size_t )( size - pos ) : to_read;
+        if ( n > 0 )
+            memmove( buffer, &reader->map->addr[ pos ], n );
+        *num_read = n;
+    }
+    else
+        rc = KFileRead( reader->f, pos, buffer, to_read, num_read );
+    return rc;
+}
+
+
 static rc_t read_key_and_len( struct lookup_reader * reader, uint64_t pos, uint64_t *key, size_t *len )
 {
     size_t num_read;
-    char buffer[ 10 ];
-    rc_t rc = KFileRead( reader->f, pos, buffer, sizeof buffer, &num_read );
+    uint8_t buffer[ 10 ];
+    rc_t rc = read_at( reader, pos, buffer, sizeof buffer, &num_read );
     if ( rc != 0 )
     {
         ErrMsg( "read_key_and_len.KFileRead( at %ld, to_read %u ) -> %R", pos, sizeof buffer, rc );
@@ -148,6 +217,7 @@ static bool keys_equal( uint64_t key1, uint64_t key2 )
     return res;
 }
 
+/* if the key is not there, offset is left at the first key behind it ( or at the end of the file ) */
 static rc_t loop_until_key_found( struct lookup_reader * reader, uint64_t key_to_find,
         uint64_t *key_found , uint64_t *offset )
 {
@@ -158,7 +228,12 @@ static rc_t loop_until_key_found( struct lookup_reader * reader, uint64_t key_to
     {
         size_t found_len;
         rc = read_key_and_len( reader, curr, key_found, &found_len );
-        if ( keys_equal( key_to_find, *key_found ) )
+        if ( rc != 0 )
+        {
+            if ( GetRCState( rc ) == rcNotFound )
+                *offset = curr;
+        }
+        else if ( keys_equal( key_to_find, *key_found ) )
         {
             done = true;
             *offset = curr;
@@ -168,6 +243,7 @@ static rc_t loop_until_key_found( struct lookup_reader * reader, uint64_t key_to
         else
         {
             done = true;
+            *offset = curr;
             rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
         }
     }
@@ -196,45 +272,34 @@ static rc_t full_table_seek( struct lookup_reader * reader, uint64_t key_to_find
 
 static rc_t indexed_seek( struct lookup_reader * reader, uint64_t key_to_find, uint64_t * key_found, bool exactly )
 {
-    /* we have a index! find set pos to the found offset */
+    /* we have a index! it brings us to at most frequency keys before the one we look for */
     uint64_t offset = 0;
-    uint64_t max_key;
-    rc_t rc = get_max_key( reader->index, &max_key );
-    if ( rc == 0 )
+    rc_t rc = get_scan_start( reader->index, key_to_find, key_found, &offset ); /* in index.c */
+    if ( rc == 0 && !keys_equal( key_to_find, *key_found ) )
     {
-        if ( key_to_find > max_key )
-            rc = RC( rcVDB, rcNoTarg, rcReading, rcId, rcTooBig );
+        if ( exactly && key_to_find > *key_found )
+            rc = loop_until_key_found( reader, key_to_find, key_found, &offset ); /* above */
         else
-        {
-            rc = get_nearest_offset( reader->index, key_to_find, key_found, &offset ); /* in index.c */
-            if ( rc == 0 )
-            {
-                if ( keys_equal( key_to_find, *key_found ) )
-                    reader->pos = offset;
-                else
-                {
-                    if ( exactly )
-                    {
-                        rc = loop_until_key_found( reader, key_to_find, key_found, &offset );
-                        if ( rc == 0 )
-                        {
-                            if ( keys_equal( key_to_find, *key_found ) )
-                                reader->pos = offset;
-                            else
-                                rc = RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
-                        }
-                        else
-                            rc = RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
-                    }
-                    else
-                    {
-                        reader->pos = offset;
-                        rc = RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
-                    }
-                }
-            }
-        }
+            rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
     }
+    /* not found: positioned on the next key, the caller can go on from there */
+    if ( rc == 0 || GetRCState( rc ) == rcNotFound )
+        reader->pos = offset;
+    return rc;
+}
+
+
+static rc_t store_seek( struct lookup_reader * reader, uint64_t key_to_find, uint64_t * key_found )
+{
+    /* the store is sorted: binary search, position on the next entry if the key is not there */
+    String packed;
+    uint64_t idx = find_in_packed_store( reader->store, key_to_find ); /* packed_store.c */
+    rc_t rc = get_packed_store_entry( reader->store, idx, key_found, &packed ); /* packed_store.c */
+    reader->pos = idx;
+    if ( rc != 0 )
+        rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcTooBig );
+    else if ( !keys_equal( key_to_find, *key_found ) )
+        rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
     return rc;
 }
 
@@ -247,12 +312,15 @@ rc_t seek_lookup_reader( struct lookup_reader * reader, uint64_t key_to_find, ui
         rc = RC( rcVDB, rcNoTarg, rcReading, rcParam, rcInvalid );
         ErrMsg( "seek_lookup_reader() -> %R", rc );
     }
+    else if ( reader->store != NULL )
+        rc = store_seek( reader, key_to_find, key_found ); /* above */
     else
     {
         if ( reader->index != NULL )
         {
+            /* a key that is not in the table is not searched for again from the start */
             rc = indexed_seek( reader, key_to_find, key_found, exactly );
-            if ( rc != 0 )
+            if ( rc != 0 && GetRCState( rc ) != rcNotFound && GetRCState( rc ) != rcTooBig )
                 rc = full_table_seek( reader, key_to_find, key_found );
         }
         else
@@ -271,11 +339,25 @@ rc_t get_packed_and_key_from_lookup_reader( struct lookup_reader * reader,
         rc = RC( rcVDB, rcNoTarg, rcReading, rcParam, rcInvalid );
         ErrMsg( "get_packed_and_key_from_lookup_reader() -> %R", rc );
     }
+    else if ( reader->store != NULL )
+    {
+        String packed;
+        rc = get_packed_store_entry( reader->store, reader->pos, key, &packed ); /* packed_store.c */
+        if ( rc == 0 )
+        {
+            size_t to_copy = packed.size;
+            if ( to_copy > packed_bases->buffer_size )
+                to_copy = packed_bases->buffer_size;
+            memmove( ( char * )packed_bases->S.addr, packed.addr, to_copy );
+            packed_bases->S.len = packed_bases->S.size = to_copy;
+            reader->pos++;
+        }
+    }
     else
     {
         size_t num_read;
-        char buffer1[ 10 ];
-        rc = KFileRead( reader->f, reader->pos, buffer1, sizeof buffer1, &num_read );
+        uint8_t buffer1[ 10 ];
+        rc = read_at( reader, reader->pos, buffer1, sizeof buffer1, &num_read );
         if ( rc != 0 )
             ErrMsg( "KFileRead( at %ld, to_read %u ) -> %R", reader->pos, sizeof buffer1, rc );
         else if ( num_read != sizeof buffer1 )
@@ -299,7 +381,7 @@ rc_t get_packed_and_key_from_lookup_reader( struct lookup_reader * reader,
                 to_read = ( packed_bases->buffer_size - 2 );
             if ( rc == 0 )
             {
-                rc = KFileRead( reader->f, reader->pos + 10, dst, to_read, &num_read );
+                rc = read_at( reader, reader->pos + 10, dst, to_read, &num_read );
                 if ( rc != 0 )
                     ErrMsg( "KFileRead( at %ld, to_read %u ) -> %R", reader->pos + 10, to_read, rc );
                 else if ( num_read != to_read )
@@ -335,9 +417,27 @@ rc_t get_packed_from_lookup_reader( struct lookup_reader * reader,
 rc_t get_bases_from_lookup_reader( struct lookup_reader * reader,
                         int64_t * seq_spot_id, uint32_t * seq_read_id, SBuffer * bases )
 {
-    rc_t rc = get_packed_from_lookup_reader( reader, seq_spot_id, seq_read_id, &reader->buf );
-    if ( rc == 0 )
-        unpack_4na( &reader->buf.S, bases );
+    rc_t rc;
+    if ( reader != NULL && reader->store != NULL )
+    {
+        /* unpack straight out of the store, no copy into reader->buf */
+        uint64_t key;
+        String packed;
+        rc = get_packed_store_entry( reader->store, reader->pos, &key, &packed ); /* packed_store.c */
+        if ( rc == 0 )
+        {
+            reader->pos++;
+            *seq_spot_id = key >> 1;
+            *seq_read_id = key & 1 ? 2 : 1;
+            unpack_4na( &packed, bases );
+        }
+    }
+    else
+    {
+        rc = get_packed_from_lookup_reader( reader, seq_spot_id, seq_read_id, &reader->buf );
+        if ( rc == 0 )
+            unpack_4na( &reader->buf.S, bases );
+    }
     return rc;
 }
 
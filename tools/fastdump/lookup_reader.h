@@ -55,6 +55,14 @@ void release_lookup_reader( struct lookup_reader * reader );
 rc_t make_lookup_reader( const KDirectory *dir, const struct index_reader * index,
                          struct lookup_reader ** reader, size_t buf_size, const char * fmt, ... );
 
+/* reads from a memory-mapped lookup-file, the map has to outlive the reader */
+rc_t make_lookup_reader_mmap( const mapped_file * map, const struct index_reader * index,
+                              struct lookup_reader ** reader );
+
+/* reads from a sorted in-memory packed_store instead of a lookup-file ( see sorter.h ) */
+struct packed_store;
+rc_t make_lookup_reader_store( const struct packed_store * store, struct lookup_reader ** reader );
+
 rc_t seek_lookup_reader( struct lookup_reader * reader, uint64_t key, uint64_t * key_found, bool exactly );
 
 rc_t get_packed_and_key_from_lookup_reader( struct lookup_reader * reader,
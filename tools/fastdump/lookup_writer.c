@@ -28,23 +28,83 @@
 #include "helper.h"
 
 #include <kfs/file.h>
-#include <kfs/buffile.h>
+
+/* --------------------------------------------------------------------------------------------
+    the records ( [64-bit key][16-bit dna-len][packed 4na] ) are serialized into a
+    user-space batch-buffer, which is written with one KFileWriteAll() when it is full,
+    the index-entries are emitted for the records of a batch when it is flushed
+-------------------------------------------------------------------------------------------- */
+
+/* the batch has to hold at least one maximal record: 8 + 2 + ( 0xFFFF + 1 ) / 2 bytes */
+#define MIN_BATCH_SIZE ( 64 * 1024 )
 
 typedef struct lookup_writer
 {
     struct KFile * f;
     struct index_writer * idx;
-    SBuffer buf;
-    uint64_t pos;
+    uint8_t * batch;
+    size_t batch_size, batch_used;
+    uint64_t pos;   /* file-position of the start of the batch */
 } lookup_writer;
 
 
+static rc_t emit_index_entries( struct lookup_writer * writer )
+{
+    rc_t rc = 0;
+    size_t offset = 0;
+    while ( rc == 0 && offset < writer->batch_used )
+    {
+        const uint8_t * rec = &writer->batch[ offset ];
+        uint64_t key;
+        uint16_t dna_len = rec[ 8 ];
+        dna_len <<= 8;
+        dna_len |= rec[ 9 ];
+        memmove( &key, rec, sizeof key );
+        rc = write_key( writer->idx, key, writer->pos + offset ); /* index.c */
+        offset += ( ( sizeof key ) + 2 + ( ( dna_len + 1 ) >> 1 ) );
+    }
+    return rc;
+}
+
+
+rc_t flush_lookup_writer( struct lookup_writer * writer )
+{
+    rc_t rc = 0;
+    if ( writer->batch_used > 0 )
+    {
+        size_t num_writ;
+        rc = KFileWriteAll( writer->f, writer->pos, writer->batch, writer->batch_used, &num_writ );
+        if ( rc != 0 )
+            ErrMsg( "flush_lookup_writer.KFileWriteAll( at %lu ) -> %R", writer->pos, rc );
+        else if ( num_writ != writer->batch_used )
+        {
+            rc = RC( rcVDB, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+            ErrMsg( "flush_lookup_writer.KFileWriteAll( at %lu ) ( %d vs %d ) -> %R",
+                    writer->pos, writer->batch_used, num_writ, rc );
+        }
+        else
+        {
+            if ( writer->idx != NULL )
+                rc = emit_index_entries( writer );
+            writer->pos += num_writ;
+            writer->batch_used = 0;
+        }
+    }
+    return rc;
+}
+
+
 void release_lookup_writer( struct lookup_writer * writer )
 {
     if ( writer != NULL )
     {
-        if ( writer->f != NULL ) KFileRelease( writer->f );
-        release_SBuffer( &writer->buf );
+        if ( writer->f != NULL )
+        {
+            flush_lookup_writer( writer );
+            KFileRelease( writer->f );
+        }
+        if ( writer->batch != NULL )
+            free( ( void * ) writer->batch );
         free( ( void * ) writer );
     }
 }
@@ -65,30 +125,28 @@ rc_t make_lookup_writer( KDirectory *dir, struct index_writer * idx,
         ErrMsg( "KDirectoryVCreateFile() -> %R", rc );
     else
     {
-        struct KFile * temp_file;
-        rc = KBufFileMakeWrite( &temp_file, f, false, buf_size );
-        KFileRelease( f );
-        if ( rc != 0 )
-            ErrMsg( "KBufFileMakeWrite() -> %R", rc );
+        lookup_writer * w = calloc( 1, sizeof * w );
+        if ( w == NULL )
+        {
+            KFileRelease( f );
+            rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            ErrMsg( "calloc( %d ) -> %R", ( sizeof * w ), rc );
+        }
         else
         {
-            lookup_writer * w = calloc( 1, sizeof * w );
-            if ( w == NULL )
+            /* no KBufFile underneath, the batch is the write-buffer */
+            w->f = f;
+            w->idx = idx;
+            w->batch_size = buf_size > MIN_BATCH_SIZE ? buf_size : MIN_BATCH_SIZE;
+            w->batch = malloc( w->batch_size );
+            if ( w->batch == NULL )
             {
-                KFileRelease( temp_file );
                 rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
-                ErrMsg( "calloc( %d ) -> %R", ( sizeof * w ), rc );
+                ErrMsg( "malloc( %d ) -> %R", w->batch_size, rc );
+                release_lookup_writer( w );
             }
             else
-            {
-                w->f = temp_file;
-                w->idx = idx;
-                rc = make_SBuffer( &w->buf, 4096 );
-                if ( rc == 0 )
-                    *writer = w;
-                else
-                    release_lookup_writer( w );
-            }
+                *writer = w;
         }
     }
     va_end ( args );
@@ -96,43 +154,60 @@ rc_t make_lookup_writer( KDirectory *dir, struct index_writer * idx,
 }
 
 
+/* returns a pointer into the batch where a record of 'rec_size' bytes can be written */
+static rc_t reserve_in_batch( struct lookup_writer * writer, size_t rec_size, uint8_t ** dst )
+{
+    rc_t rc = 0;
+    if ( writer->batch_used + rec_size > writer->batch_size )
+        rc = flush_lookup_writer( writer );
+    if ( rc == 0 )
+    {
+        if ( rec_size > writer->batch_size )
+        {
+            rc = RC( rcVDB, rcNoTarg, rcWriting, rcBuffer, rcInsufficient );
+            ErrMsg( "reserve_in_batch( %d ) -> %R", rec_size, rc );
+        }
+        else
+        {
+            *dst = &writer->batch[ writer->batch_used ];
+            writer->batch_used += rec_size;
+        }
+    }
+    return rc;
+}
+
+
 rc_t write_unpacked_to_lookup_writer( struct lookup_writer * writer,
             int64_t seq_spot_id, uint32_t seq_read_id, const String * bases_as_unpacked_4na )
 {
-    pack_4na( bases_as_unpacked_4na, &writer->buf );
-    return write_packed_to_lookup_writer( writer, make_key( seq_spot_id, seq_read_id ), &writer->buf.S );
+    uint64_t key = make_key( seq_spot_id, seq_read_id );
+    uint16_t dna_len = ( bases_as_unpacked_4na->len & 0xFFFF );
+    size_t packed_size = 2 + ( ( dna_len + 1 ) >> 1 );
+    uint8_t * dst;
+    rc_t rc = reserve_in_batch( writer, ( sizeof key ) + packed_size, &dst );
+    if ( rc == 0 )
+    {
+        /* pack directly into the batch */
+        SBuffer view;
+        view.S.addr = ( const char * )&dst[ sizeof key ];
+        view.S.size = view.S.len = 0;
+        view.buffer_size = packed_size;
+        memmove( dst, &key, sizeof key );
+        pack_4na( bases_as_unpacked_4na, &view );
+    }
+    return rc;
 }
 
+
 rc_t write_packed_to_lookup_writer( struct lookup_writer * writer,
             uint64_t key, const String * bases_as_packed_4na )
 {
-    size_t num_writ;
-    rc_t rc = KFileWrite( writer->f, writer->pos, &key, sizeof key, &num_writ );
-    if ( rc != 0 )
-        ErrMsg( "KFileWriteAll( key ) -> %R", rc );
-    else if ( num_writ != sizeof key )
-    {
-        rc = RC( rcVDB, rcNoTarg, rcWriting, rcFormat, rcInvalid );
-        ErrMsg( "KFileWriteAll( key ) -> %R", rc );
-    }
-    else
+    uint8_t * dst;
+    rc_t rc = reserve_in_batch( writer, ( sizeof key ) + bases_as_packed_4na->size, &dst );
+    if ( rc == 0 )
     {
-        uint64_t start_pos = writer->pos;
-        writer->pos += num_writ;
-        rc = KFileWrite( writer->f, writer->pos, bases_as_packed_4na->addr, bases_as_packed_4na->size, &num_writ );
-        if ( rc != 0 )
-            ErrMsg( "KFileWriteAll( bases ) -> %R", rc );
-        else if ( num_writ != bases_as_packed_4na->size )
-        {
-            rc = RC( rcVDB, rcNoTarg, rcWriting, rcFormat, rcInvalid );
-            ErrMsg( "KFileWriteAll( bases ) -> %R", rc );
-        }
-        else
-        {
-            if ( writer->idx != NULL )
-                rc = write_key( writer->idx, key, start_pos );
-            writer->pos += num_writ;
-        }
+        memmove( dst, &key, sizeof key );
+        memmove( &dst[ sizeof key ], bases_as_packed_4na->addr, bases_as_packed_4na->size );
     }
     return rc;
 }
@@ -60,6 +60,9 @@ rc_t write_unpacked_to_lookup_writer( struct lookup_writer * writer,
 rc_t write_packed_to_lookup_writer( struct lookup_writer * writer,
             uint64_t key, const String * bases_as_packed_4na );
 
+/* writes the pending batch, release_lookup_writer() does that too - but cannot report errors */
+rc_t flush_lookup_writer( struct lookup_writer * writer );
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,17 +24,30 @@
 *
 */
 #include "merge_sorter.h"
-#include "lookup_reader.h"
 #include "lookup_writer.h"
 #include "index.h"
 #include "helper.h"
 
+#include <kfs/file.h>
+
+/* every source reads ahead at least this many bytes with one KFileRead-call */
+#define MERGE_READ_AHEAD ( 4 * 1024 * 1024 )
+
+/* --------------------------------------------------------------------------------------------
+    a merge-source reads the sub-file in big chunks into its own buffer,
+    the records are parsed from the buffer, the packed bases of the current record
+    point directly into the buffer ( valid until the source is advanced )
+    record-layout: [64-bit key][16-bit dna-len][packed 4na]
+-------------------------------------------------------------------------------------------- */
 typedef struct merge_src
 {
-    struct lookup_reader * reader;
+    const struct KFile * f;
+    uint8_t * buffer;
+    size_t buffer_size, filled, pos;
+    uint64_t file_pos;
     uint64_t key;
-    SBuffer packed_bases;
-    rc_t rc;
+    String packed_bases;
+    bool done;
 } merge_src;
 
 
@@ -42,6 +55,7 @@ typedef struct merge_sorter
 {
     const merge_sorter_params * params;
     merge_src * src_list;
+    uint32_t * tree;    /* loser-tree: tree[ 0 ] is the winner, the others are losers */
     struct lookup_writer * dst;
     struct index_writer * idx;
 } merge_sorter;
@@ -59,12 +73,15 @@ void release_merge_sorter( struct merge_sorter *ms )
             for ( i = 0; i < ms->params->count; ++i )
             {
                 merge_src * src = &ms->src_list[ i ];
-                release_lookup_reader( src->reader );
-                release_SBuffer( &src->packed_bases );
+                if ( src->f != NULL )
+                    KFileRelease( src->f );
+                if ( src->buffer != NULL )
+                    free( ( void * ) src->buffer );
             }
             free( ( void * ) ms->src_list );
         }
-
+        if ( ms->tree != NULL )
+            free( ( void * ) ms->tree );
         free( ( void * ) ms );
     }
 }
@@ -81,6 +98,7 @@ rc_t make_merge_sorter( struct merge_sorter ** ms, const merge_sorter_params * p
     }
     else
     {
+        m->params = params;
         if ( params->index_filename != NULL )
             rc = make_index_writer( params->dir, &m->idx, params->buf_size,
                         20000, "%s", params->index_filename );
@@ -92,14 +110,18 @@ rc_t make_merge_sorter( struct merge_sorter ** ms, const merge_sorter_params * p
             if ( rc == 0 )
             {
                 m->src_list = calloc( params->count, sizeof * m->src_list );
-                if ( m->src_list == NULL )
+                m->tree = calloc( params->count, sizeof * m->tree );
+                if ( m->src_list == NULL || m->tree == NULL )
                 {
                     rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
                     ErrMsg( "calloc( %d ) -> %R", ( ( sizeof * m->src_list ) * params->count ), rc );
                 }
                 else
                 {
-                    m->params = params;
+                    uint32_t i;
+                    /* sources not added are treated as empty */
+                    for ( i = 0; i < params->count; ++i )
+                        m->src_list[ i ].done = true;
                     *ms = m;
                 }
             }
@@ -111,6 +133,74 @@ rc_t make_merge_sorter( struct merge_sorter ** ms, const merge_sorter_params * p
 }
 
 
+/* moves the unparsed rest to the front of the buffer and fills it up from the file */
+static rc_t refill_merge_src( merge_src * src )
+{
+    size_t num_read, rest = src->filled - src->pos;
+    rc_t rc;
+    if ( rest > 0 && src->pos > 0 )
+        memmove( src->buffer, &src->buffer[ src->pos ], rest );
+    src->filled = rest;
+    src->pos = 0;
+    rc = KFileReadAll( src->f, src->file_pos, &src->buffer[ rest ], src->buffer_size - rest, &num_read );
+    if ( rc != 0 )
+        ErrMsg( "refill_merge_src.KFileReadAll( at %lu ) -> %R", src->file_pos, rc );
+    else
+    {
+        src->file_pos += num_read;
+        src->filled += num_read;
+    }
+    return rc;
+}
+
+
+static rc_t next_merge_src( merge_src * src )
+{
+    rc_t rc = 0;
+    if ( src->filled - src->pos < 10 )
+        rc = refill_merge_src( src );
+    if ( rc == 0 )
+    {
+        size_t avail = src->filled - src->pos;
+        if ( avail == 0 )
+            src->done = true;
+        else if ( avail < 10 )
+        {
+            rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
+            ErrMsg( "next_merge_src() truncated record at %lu -> %R", src->file_pos, rc );
+        }
+        else
+        {
+            const uint8_t * rec = &src->buffer[ src->pos ];
+            uint16_t dna_len = rec[ 8 ];
+            size_t packed_len, rec_len;
+            dna_len <<= 8;
+            dna_len |= rec[ 9 ];
+            packed_len = ( dna_len + 1 ) >> 1;
+            rec_len = 10 + packed_len;
+            if ( avail < rec_len )
+            {
+                rc = refill_merge_src( src );
+                if ( rc == 0 && src->filled - src->pos < rec_len )
+                {
+                    rc = RC( rcVDB, rcNoTarg, rcReading, rcFormat, rcInvalid );
+                    ErrMsg( "next_merge_src() truncated record at %lu -> %R", src->file_pos, rc );
+                }
+                rec = &src->buffer[ src->pos ];
+            }
+            if ( rc == 0 )
+            {
+                memmove( &src->key, rec, sizeof src->key );
+                src->packed_bases.addr = ( const char * )&rec[ 8 ];
+                src->packed_bases.size = src->packed_bases.len = 2 + packed_len;
+                src->pos += rec_len;
+            }
+        }
+    }
+    return rc;
+}
+
+
 rc_t add_merge_sorter_src( struct merge_sorter *ms, const char * filename, uint32_t id )
 {
     rc_t rc;
@@ -122,52 +212,107 @@ rc_t add_merge_sorter_src( struct merge_sorter *ms, const char * filename, uint3
     else
     {
         merge_src * src = &ms->src_list[ id ];
-        rc = make_lookup_reader( ms->params->dir, NULL, &src->reader, ms->params->buf_size, "%s", filename );
-        if ( rc == 0 )
+        rc = KDirectoryOpenFileRead( ms->params->dir, &src->f, "%s", filename );
+        if ( rc != 0 )
+            ErrMsg( "add_merge_sorter_src.KDirectoryOpenFileRead( '%s' ) -> %R", filename, rc );
+        else
         {
-            rc = make_SBuffer( &src->packed_bases, 4096 );
-            if ( rc == 0 )
-                src->rc = get_packed_and_key_from_lookup_reader( src->reader, &src->key, &src->packed_bases );
+            src->buffer_size = ms->params->buf_size > MERGE_READ_AHEAD ? ms->params->buf_size : MERGE_READ_AHEAD;
+            src->buffer = malloc( src->buffer_size );
+            if ( src->buffer == NULL )
+            {
+                rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+                ErrMsg( "add_merge_sorter_src.malloc( %lu ) -> %R", src->buffer_size, rc );
+            }
+            else
+            {
+                src->done = false;
+                rc = next_merge_src( src );
+            }
         }
     }
     return rc;
 }
 
 
-static merge_src * get_min_merge_src( merge_src * src, uint32_t count )
+/* --------------------------------------------------------------------------------------------
+    loser-tree ( tournament-tree ) over the sources:
+    choosing the next record costs O( log k ) comparisons instead of O( k )
+    index 'count' is a virtual source that wins against everything, it is used to build the tree
+-------------------------------------------------------------------------------------------- */
+static bool merge_src_wins( const merge_sorter * ms, uint32_t a, uint32_t b )
 {
-    merge_src * res = NULL;
-    uint32_t i;
-    for ( i = 0; i < count; ++i )
+    uint32_t count = ms->params->count;
+    const merge_src * sa;
+    const merge_src * sb;
+    if ( a == count ) return true;
+    if ( b == count ) return false;
+    sa = &ms->src_list[ a ];
+    sb = &ms->src_list[ b ];
+    if ( sa->done ) return false;
+    if ( sb->done ) return true;
+    if ( sa->key != sb->key )
+        return ( sa->key < sb->key );
+    return ( a < b );
+}
+
+
+static void adjust_loser_tree( merge_sorter * ms, uint32_t winner )
+{
+    uint32_t * tree = ms->tree;
+    uint32_t t = ( winner + ms->params->count ) >> 1;
+    while ( t > 0 )
     {
-        merge_src * item = &src[ i ];
-        if ( item->rc == 0 )
+        if ( merge_src_wins( ms, tree[ t ], winner ) )
         {
-            if ( res == NULL )
-                res = item;
-            else if ( item->key < res->key )
-                res = item;
+            uint32_t tmp = tree[ t ];
+            tree[ t ] = winner;
+            winner = tmp;
         }
+        t >>= 1;
     }
-    return res;
-} 
+    tree[ 0 ] = winner;
+}
+
+
+static void build_loser_tree( merge_sorter * ms )
+{
+    uint32_t i, count = ms->params->count;
+    for ( i = 0; i < count; ++i )
+        ms->tree[ i ] = count;
+    for ( i = count; i > 0; --i )
+        adjust_loser_tree( ms, i - 1 );
+}
+
 
 rc_t CC Quitting();
 
 rc_t run_merge_sorter( struct merge_sorter *ms )
 {
     rc_t rc = 0;
-    merge_src * to_write = get_min_merge_src( ms->src_list, ms->params->count );
-    while( rc == 0 && to_write != NULL )
+    if ( ms->params->count > 0 )
     {
-        rc = Quitting();
-        if ( rc == 0 )
+        merge_src * to_write;
+
+        build_loser_tree( ms );
+        to_write = &ms->src_list[ ms->tree[ 0 ] ];
+        while( rc == 0 && !to_write->done )
         {
-            rc = write_packed_to_lookup_writer( ms->dst, to_write->key, &to_write->packed_bases.S );
+            rc = Quitting();
             if ( rc == 0 )
-                to_write->rc = get_packed_and_key_from_lookup_reader( to_write->reader, &to_write->key, &to_write->packed_bases );
-            to_write = get_min_merge_src( ms->src_list, ms->params->count );
+            {
+                rc = write_packed_to_lookup_writer( ms->dst, to_write->key, &to_write->packed_bases );
+                if ( rc == 0 )
+                    rc = next_merge_src( to_write );
+                if ( rc == 0 )
+                {
+                    adjust_loser_tree( ms, ms->tree[ 0 ] );
+                    to_write = &ms->src_list[ ms->tree[ 0 ] ];
+                }
+            }
         }
+        if ( rc == 0 )
+            rc = flush_lookup_writer( ms->dst );
     }
     return rc;
 }
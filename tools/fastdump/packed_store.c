@@ -0,0 +1,388 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "packed_store.h"
+#include "helper.h"
+
+#include <os-native.h>
+#include <sysalloc.h>
+
+typedef struct ps_chunk
+{
+    struct ps_chunk * next;
+    size_t size, used;
+    uint8_t data[ 1 ];
+} ps_chunk;
+
+
+typedef struct ps_entry
+{
+    uint64_t key;
+    const uint8_t * rec;
+} ps_entry;
+
+
+typedef struct packed_store
+{
+    ps_chunk * chunks;      /* all chunks ever allocated */
+    ps_chunk * curr;        /* the chunk we are writing into */
+    ps_entry * entries;     /* key / record-ptr array */
+    ps_entry * scratch;     /* 2nd array for the radix-sort */
+    uint64_t count, capacity, scratch_capacity;
+    uint64_t arena_used;
+    size_t chunk_size;
+} packed_store;
+
+
+void release_packed_store( struct packed_store * store )
+{
+    if ( store != NULL )
+    {
+        ps_chunk * c = store->chunks;
+        while ( c != NULL )
+        {
+            ps_chunk * next = c->next;
+            free( ( void * ) c );
+            c = next;
+        }
+        if ( store->entries != NULL )
+            free( ( void * ) store->entries );
+        if ( store->scratch != NULL )
+            free( ( void * ) store->scratch );
+        free( ( void * ) store );
+    }
+}
+
+
+static ps_chunk * make_chunk( size_t size )
+{
+    ps_chunk * c = malloc( ( sizeof * c ) + size );
+    if ( c != NULL )
+    {
+        c->next = NULL;
+        c->size = size;
+        c->used = 0;
+    }
+    return c;
+}
+
+
+rc_t make_packed_store( struct packed_store ** store, size_t chunk_size )
+{
+    rc_t rc = 0;
+    packed_store * s = calloc( 1, sizeof * s );
+    if ( s == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "make_packed_store.calloc( %d ) -> %R", ( sizeof * s ), rc );
+    }
+    else
+    {
+        s->chunk_size = chunk_size > 0x10000 ? chunk_size : 0x10000;
+        s->chunks = make_chunk( s->chunk_size );
+        if ( s->chunks == NULL )
+        {
+            rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            ErrMsg( "make_packed_store.malloc( %lu ) -> %R", s->chunk_size, rc );
+            release_packed_store( s );
+        }
+        else
+        {
+            s->curr = s->chunks;
+            *store = s;
+        }
+    }
+    return rc;
+}
+
+
+/* returns a pointer into the arena, where 'needed' bytes can be written */
+static uint8_t * arena_alloc( packed_store * store, size_t needed )
+{
+    ps_chunk * c = store->curr;
+    if ( c->used + needed > c->size )
+    {
+        /* try to reuse a chunk from a previous round, allocate only if there is none */
+        ps_chunk * prev = c;
+        c = c->next;
+        while ( c != NULL && c->size < needed )
+        {
+            prev = c;
+            c = c->next;
+        }
+        if ( c == NULL )
+        {
+            c = make_chunk( needed > store->chunk_size ? needed : store->chunk_size );
+            if ( c == NULL )
+                return NULL;
+            prev->next = c;
+        }
+        c->used = 0;
+        store->curr = c;
+    }
+    c->used += needed;
+    store->arena_used += needed;
+    return &c->data[ c->used - needed ];
+}
+
+
+static rc_t grow_entries( packed_store * store )
+{
+    rc_t rc = 0;
+    uint64_t new_capacity = store->capacity > 0 ? store->capacity * 2 : 0x10000;
+    ps_entry * tmp = realloc( store->entries, new_capacity * ( sizeof * tmp ) );
+    if ( tmp == NULL )
+    {
+        rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        ErrMsg( "grow_entries.realloc( %lu ) -> %R", new_capacity * ( sizeof * tmp ), rc );
+    }
+    else
+    {
+        store->entries = tmp;
+        store->capacity = new_capacity;
+    }
+    return rc;
+}
+
+
+rc_t write_unpacked_to_packed_store( struct packed_store * store, uint64_t key,
+                                     const String * bases_as_unpacked_4na )
+{
+    rc_t rc = 0;
+    if ( store->count >= store->capacity )
+        rc = grow_entries( store );
+    if ( rc == 0 )
+    {
+        uint16_t dna_len = ( bases_as_unpacked_4na->len & 0xFFFF );
+        size_t needed = 2 + ( ( dna_len + 1 ) >> 1 );
+        uint8_t * dst = arena_alloc( store, needed );
+        if ( dst == NULL )
+        {
+            rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            ErrMsg( "write_unpacked_to_packed_store.malloc( %lu ) -> %R", store->chunk_size, rc );
+        }
+        else
+        {
+            /* pack directly into the arena, pack_4na() does not write beyond buffer_size */
+            SBuffer view;
+            ps_entry * e = &store->entries[ store->count++ ];
+            view.S.addr = ( const char * )dst;
+            view.S.size = view.S.len = 0;
+            view.buffer_size = needed;
+            pack_4na( bases_as_unpacked_4na, &view );
+            e->key = key;
+            e->rec = dst;
+        }
+    }
+    return rc;
+}
+
+
+uint64_t get_packed_store_size( const struct packed_store * store )
+{
+    /* every entry needs room in the entries- and in the scratch-array */
+    return store->arena_used + ( store->count * 2 * ( sizeof( ps_entry ) ) );
+}
+
+
+uint64_t get_packed_store_count( const struct packed_store * store )
+{
+    return store->count;
+}
+
+
+/* --------------------------------------------------------------------------------------------
+    LSD radix-sort over the 64-bit key, one byte per pass
+    the histograms for all 8 bytes are computed in one pass over the data,
+    passes where all keys have the same byte-value are skipped ( the high bytes of our
+    keys are zero most of the time ), so usually only 4 or 5 passes are needed
+-------------------------------------------------------------------------------------------- */
+static void radix_sort_entries( ps_entry ** src_ptr, ps_entry ** dst_ptr, uint64_t count )
+{
+    uint64_t hist[ 8 ][ 256 ];
+    uint64_t i;
+    uint32_t pass;
+    ps_entry * src = *src_ptr;
+    ps_entry * dst = *dst_ptr;
+
+    memset( hist, 0, sizeof hist );
+    for ( i = 0; i < count; ++i )
+    {
+        uint64_t key = src[ i ].key;
+        for ( pass = 0; pass < 8; ++pass )
+        {
+            hist[ pass ][ key & 0xFF ]++;
+            key >>= 8;
+        }
+    }
+
+    for ( pass = 0; pass < 8; ++pass )
+    {
+        uint64_t * h = hist[ pass ];
+        uint32_t shift = pass * 8;
+        uint64_t sum = 0;
+        uint32_t b;
+
+        /* skip this pass if all keys fall into the same bucket */
+        if ( h[ ( src[ 0 ].key >> shift ) & 0xFF ] == count )
+            continue;
+
+        for ( b = 0; b < 256; ++b )
+        {
+            uint64_t n = h[ b ];
+            h[ b ] = sum;
+            sum += n;
+        }
+        for ( i = 0; i < count; ++i )
+            dst[ h[ ( src[ i ].key >> shift ) & 0xFF ]++ ] = src[ i ];
+
+        {
+            ps_entry * tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+    }
+    *src_ptr = src;
+    *dst_ptr = dst;
+}
+
+
+rc_t sort_packed_store( struct packed_store * store )
+{
+    rc_t rc = 0;
+    if ( store->count > 1 )
+    {
+        if ( store->scratch_capacity < store->capacity )
+        {
+            /* the scratch-array survives clear_packed_store(), it is allocated once per size */
+            ps_entry * tmp = realloc( store->scratch, store->capacity * ( sizeof * tmp ) );
+            if ( tmp == NULL )
+            {
+                rc = RC( rcVDB, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+                ErrMsg( "sort_packed_store.realloc( %lu ) -> %R", store->capacity * ( sizeof * tmp ), rc );
+            }
+            else
+            {
+                store->scratch = tmp;
+                store->scratch_capacity = store->capacity;
+            }
+        }
+        if ( rc == 0 )
+        {
+            ps_entry * entries = store->entries;
+            ps_entry * scratch = store->scratch;
+            radix_sort_entries( &entries, &scratch, store->count );
+            /* after an odd number of passes the sorted data is in the former scratch-array */
+            if ( entries != store->entries )
+            {
+                uint64_t tmp_cap = store->capacity;
+                store->capacity = store->scratch_capacity;
+                store->scratch_capacity = tmp_cap;
+                store->entries = entries;
+                store->scratch = scratch;
+            }
+        }
+    }
+    return rc;
+}
+
+
+static void entry_to_string( const ps_entry * e, String * packed )
+{
+    uint16_t dna_len = e->rec[ 0 ];
+    dna_len <<= 8;
+    dna_len |= e->rec[ 1 ];
+    packed->addr = ( const char * )e->rec;
+    packed->size = packed->len = 2 + ( ( dna_len + 1 ) >> 1 );
+}
+
+
+rc_t visit_packed_store( const struct packed_store * store,
+            rc_t ( CC * on_entry )( uint64_t key, const String * bases_as_packed_4na, void * data ),
+            void * data )
+{
+    rc_t rc = 0;
+    uint64_t i;
+    for ( i = 0; rc == 0 && i < store->count; ++i )
+    {
+        const ps_entry * e = &store->entries[ i ];
+        String packed;
+        entry_to_string( e, &packed ); /* above */
+        rc = on_entry( e->key, &packed, data );
+    }
+    return rc;
+}
+
+
+rc_t get_packed_store_entry( const struct packed_store * store, uint64_t idx,
+                             uint64_t * key, String * bases_as_packed_4na )
+{
+    rc_t rc = 0;
+    if ( idx >= store->count )
+        rc = SILENT_RC( rcVDB, rcNoTarg, rcReading, rcId, rcNotFound );
+    else
+    {
+        const ps_entry * e = &store->entries[ idx ];
+        *key = e->key;
+        entry_to_string( e, bases_as_packed_4na );
+    }
+    return rc;
+}
+
+
+uint64_t find_in_packed_store( const struct packed_store * store, uint64_t key )
+{
+    uint64_t lo = 0, hi = store->count;
+    while ( lo < hi )
+    {
+        uint64_t mid = lo + ( ( hi - lo ) >> 1 );
+        if ( store->entries[ mid ].key < key )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+void trim_packed_store( struct packed_store * store )
+{
+    if ( store->scratch != NULL )
+    {
+        free( ( void * ) store->scratch );
+        store->scratch = NULL;
+        store->scratch_capacity = 0;
+    }
+}
+
+
+void clear_packed_store( struct packed_store * store )
+{
+    store->curr = store->chunks;
+    store->curr->used = 0;
+    store->count = 0;
+    store->arena_used = 0;
+}
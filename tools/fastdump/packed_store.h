@@ -0,0 +1,88 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_packed_store_
+#define _h_packed_store_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _h_klib_rc_
+#include <klib/rc.h>
+#endif
+
+#ifndef _h_klib_text_
+#include <klib/text.h>
+#endif
+
+/* --------------------------------------------------------------------------------------------
+    a packed_store keeps 4na-packed reads in a few large memory-chunks ( arena ),
+    the records have the same layout as in the lookup-file: [16-bit dna-len][packed 4na]
+    next to the arena an array of ( key / record-ptr ) - pairs is maintained,
+    this array is sorted by key with a LSD radix-sort before it is visited
+    clearing the store keeps the chunks, so they can be reused without new allocations
+-------------------------------------------------------------------------------------------- */
+
+struct packed_store;
+
+void release_packed_store( struct packed_store * store );
+
+rc_t make_packed_store( struct packed_store ** store, size_t chunk_size );
+
+/* packs the unpacked bases directly into the arena */
+rc_t write_unpacked_to_packed_store( struct packed_store * store, uint64_t key,
+                                     const String * bases_as_unpacked_4na );
+
+/* how many bytes are used by the store: arena + key-array + sort-scratch */
+uint64_t get_packed_store_size( const struct packed_store * store );
+
+uint64_t get_packed_store_count( const struct packed_store * store );
+
+rc_t sort_packed_store( struct packed_store * store );
+
+/* the entries are visited in the order of the key-array ( sort it first ) */
+rc_t visit_packed_store( const struct packed_store * store,
+            rc_t ( CC * on_entry )( uint64_t key, const String * bases_as_packed_4na, void * data ),
+            void * data );
+
+/* random access to a sorted store, idx >= count returns rcNotFound */
+rc_t get_packed_store_entry( const struct packed_store * store, uint64_t idx,
+                             uint64_t * key, String * bases_as_packed_4na );
+
+/* binary search in a sorted store: index of the first entry with a key >= key, count if there is none */
+uint64_t find_in_packed_store( const struct packed_store * store, uint64_t key );
+
+/* frees the sort-scratch-array, for a store that will not be sorted again */
+void trim_packed_store( struct packed_store * store );
+
+void clear_packed_store( struct packed_store * store );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
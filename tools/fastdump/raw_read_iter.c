@@ -94,6 +94,12 @@ bool get_from_raw_read_iter( struct raw_read_iter * iter, raw_read_rec * rec, rc
 }
 
 
+rc_t set_raw_read_iter_rows( struct raw_read_iter * iter, int64_t first, uint64_t count )
+{
+    return cmn_iter_set_rows( iter->cmn, first, count );
+}
+
+
 uint64_t get_row_count_of_raw_read( struct raw_read_iter * iter )
 {
     return cmn_iter_row_count( iter->cmn );
@@ -58,6 +58,9 @@ rc_t make_raw_read_iter( cmn_params * params, struct raw_read_iter ** iter );
 
 bool get_from_raw_read_iter( struct raw_read_iter * iter, raw_read_rec * rec, rc_t * rc );
 
+/* continue with a different row-range, without opening the table again */
+rc_t set_raw_read_iter_rows( struct raw_read_iter * iter, int64_t first, uint64_t count );
+
 uint64_t get_row_count_of_raw_read( struct raw_read_iter * iter );
 
 #ifdef __cplusplus
@@ -28,6 +28,7 @@
 #include "lookup_writer.h"
 #include "lookup_reader.h"
 #include "merge_sorter.h"
+#include "packed_store.h"
 #include "helper.h"
 
 #include <klib/vector.h>
@@ -46,9 +47,7 @@
 typedef struct sorter
 {
     sorter_params params;
-    KVector * store;
-    SBuffer buf;
-    uint64_t bytes_in_store;
+    struct packed_store * store;
     uint32_t sub_file_id;
 } sorter;
 
@@ -57,35 +56,35 @@ static void release_sorter( struct sorter * sorter )
 {
     if ( sorter != NULL )
     {
-        release_SBuffer( &sorter->buf );
         if ( sorter->params.src != NULL )
             destroy_raw_read_iter( sorter->params.src );
-        if ( sorter->store != NULL )
-            KVectorRelease( sorter->store );
+        release_packed_store( sorter->store );
     }
 }
 
+/* the arena grows in chunks of this size, but never in chunks bigger than the mem-limit */
+#define SORTER_CHUNK_SIZE ( 32 * 1024 * 1024 )
+
 static rc_t init_sorter( struct sorter * sorter, const sorter_params * params )
 {
-    rc_t rc = KVectorMake( &sorter->store );
-    if ( rc != 0 )
-        ErrMsg( "KVectorMake() -> %R", rc );
-    else
+    size_t chunk_size = SORTER_CHUNK_SIZE;
+    rc_t rc;
+
+    if ( params->mem_limit > 0 && params->mem_limit < chunk_size )
+        chunk_size = params->mem_limit;
+    rc = make_packed_store( &sorter->store, chunk_size ); /* packed_store.c */
+    if ( rc == 0 )
     {
-        rc = make_SBuffer( &sorter->buf, 4096 );
-        if ( rc == 0 )
-        {
-            sorter->params.dir = params->dir;
-            sorter->params.output_filename = params->output_filename;
-            sorter->params.index_filename = NULL;
-            sorter->params.temp_path = params->temp_path;
-            sorter->params.src = params->src;
-            sorter->params.buf_size = params->buf_size;
-            sorter->params.mem_limit = params->mem_limit;
-            sorter->params.prefix = params->prefix;
-            sorter->bytes_in_store = 0;
-            sorter->sub_file_id = 0;
-        }
+        sorter->params.dir = params->dir;
+        sorter->params.output_filename = params->output_filename;
+        sorter->params.index_filename = NULL;
+        sorter->params.temp_path = params->temp_path;
+        sorter->params.src = params->src;
+        sorter->params.buf_size = params->buf_size;
+        sorter->params.mem_limit = params->mem_limit;
+        sorter->params.prefix = params->prefix;
+        sorter->params.queue = params->queue;
+        sorter->sub_file_id = 0;
     }
     return rc;
 }
@@ -159,20 +158,17 @@ static rc_t make_dst_filename( const sorter_params * params, char * buffer, size
 }
 
 
-static rc_t CC on_store_entry( uint64_t key, const void *value, void *user_data )
+static rc_t CC on_store_entry( uint64_t key, const String * bases, void * data )
 {
-    const String * bases = value;
-    struct lookup_writer * writer = user_data;
-    rc_t rc = write_packed_to_lookup_writer( writer, key, bases );
-    StringWhack( bases );
-    return rc;
+    struct lookup_writer * writer = data;
+    return write_packed_to_lookup_writer( writer, key, bases );
 }
 
 
 static rc_t save_store( struct sorter * sorter )
 {
     rc_t rc = 0;
-    if ( sorter->bytes_in_store > 0 )
+    if ( get_packed_store_count( sorter->store ) > 0 )
     {
         char buffer[ 4096 ];
         struct lookup_writer * writer;
@@ -186,28 +182,21 @@ static rc_t save_store( struct sorter * sorter )
         else
             rc = make_dst_filename( &sorter->params, buffer, sizeof buffer );
 
+        if ( rc == 0 )
+            rc = sort_packed_store( sorter->store ); /* packed_store.c */
+
         if ( rc == 0 )
             rc = make_lookup_writer( sorter->params.dir, NULL, &writer, sorter->params.buf_size, "%s", buffer );
         
         if ( rc == 0 )
         {
-            rc = KVectorVisitPtr( sorter->store, false, on_store_entry, writer );
+            rc = visit_packed_store( sorter->store, on_store_entry, writer ); /* packed_store.c */
+            if ( rc == 0 )
+                rc = flush_lookup_writer( writer );
             release_lookup_writer( writer );
         }
         if ( rc == 0 )
-        {
-            sorter->bytes_in_store = 0;
-            rc = KVectorRelease( sorter->store );
-            if ( rc != 0 )
-                ErrMsg( "KVectorRelease() -> %R", rc );
-            else
-            {
-                sorter->store = NULL;
-                rc = KVectorMake( &sorter->store );
-                if ( rc != 0 )
-                    ErrMsg( "KVectorMake() -> %R", rc );
-            }
-        }
+            clear_packed_store( sorter->store ); /* keeps the arena-chunks for the next round */
     }
     return rc;
 }
@@ -216,29 +205,12 @@ static rc_t save_store( struct sorter * sorter )
 static rc_t write_to_sorter( struct sorter * sorter, int64_t seq_spot_id, uint32_t seq_read_id,
         const String * unpacked_bases )
 {
-    /* we write it to the store...*/
-    rc_t rc;
-    const String * to_store;    
-    pack_4na( unpacked_bases, &sorter->buf );
-    rc = StringCopy( &to_store, &sorter->buf.S );
-    if ( rc != 0 )
-        ErrMsg( "StringCopy() -> %R", rc );
-    else
-    {
-        uint64_t key = make_key( seq_spot_id, seq_read_id );
-        rc = KVectorSetPtr( sorter->store, key, (const void *)to_store );
-        if ( rc != 0 )
-            ErrMsg( "KVectorSetPtr() -> %R", rc );
-        else
-        {
-            size_t item_size = ( sizeof key ) + ( sizeof *to_store ) + to_store->size;
-            sorter->bytes_in_store += item_size;
-        }
-    }
-    
+    /* we pack it directly into the arena of the store...*/
+    uint64_t key = make_key( seq_spot_id, seq_read_id );
+    rc_t rc = write_unpacked_to_packed_store( sorter->store, key, unpacked_bases ); /* packed_store.c */
     if ( rc == 0 &&
          sorter->params.mem_limit > 0 &&
-         sorter->bytes_in_store >= sorter->params.mem_limit )
+         get_packed_store_size( sorter->store ) >= sorter->params.mem_limit )
         rc = save_store( sorter );
     return rc;
 }
@@ -302,29 +274,68 @@ static rc_t final_merge_sort( const sorter_params * params, uint32_t count )
 
 rc_t CC Quitting();
 
+/* the sorted output does not depend on which rows a thread has seen, so the chunks
+   from the queue can simply be fed into the same store one after the other */
+static bool next_sorter_chunk( struct sorter * sorter, rc_t * rc )
+{
+    uint32_t chunk_id;
+    int64_t first;
+    uint64_t count;
+    bool res = ( sorter->params.queue != NULL &&
+                 next_row_chunk( sorter->params.queue, &chunk_id, &first, &count ) ); /* helper.c */
+    if ( res )
+    {
+        *rc = set_raw_read_iter_rows( sorter->params.src, first, count ); /* raw_read_iter.c */
+        if ( *rc != 0 )
+            res = false;
+    }
+    return res;
+}
+
+
 rc_t run_sorter( const sorter_params * params )
 {
     sorter sorter;
     rc_t rc = init_sorter( &sorter, params );
     if ( rc == 0 )
     {
-        raw_read_rec rec;
-        while ( rc == 0 && get_from_raw_read_iter( sorter.params.src, &rec, &rc ) )
+        do
+        {
+            raw_read_rec rec;
+            while ( rc == 0 && get_from_raw_read_iter( sorter.params.src, &rec, &rc ) )
+            {
+                rc = Quitting();
+                if ( rc == 0 )
+                {
+                    rc = write_to_sorter( &sorter, rec.seq_spot_id, rec.seq_read_id, &rec.raw_read );
+                    if ( rc == 0 && params->sort_progress != NULL )
+                        atomic_inc( params->sort_progress );
+                }
+            }
+        } while ( rc == 0 && next_sorter_chunk( &sorter, &rc ) );
+        
+        if ( params->streaming_store != NULL )
+            *params->streaming_store = NULL;
+
+        if ( rc == 0 && params->streaming_store != NULL && sorter.sub_file_id == 0 )
         {
-            rc = Quitting();
+            /* the mem-limit was never reached: keep everything in memory, write no file at all */
+            rc = sort_packed_store( sorter.store ); /* packed_store.c */
             if ( rc == 0 )
             {
-                rc = write_to_sorter( &sorter, rec.seq_spot_id, rec.seq_read_id, &rec.raw_read );
-                if ( rc == 0 && params->sort_progress != NULL )
-                    atomic_inc( params->sort_progress );
+                trim_packed_store( sorter.store ); /* packed_store.c */
+                *params->streaming_store = sorter.store;
+                sorter.store = NULL;
             }
         }
-        
-        if ( rc == 0 )
-            rc = save_store( &sorter );
+        else
+        {
+            if ( rc == 0 )
+                rc = save_store( &sorter );
 
-        if ( rc == 0 && sorter.params.mem_limit > 0 )
-            rc = final_merge_sort( params, sorter.sub_file_id );
+            if ( rc == 0 && sorter.params.mem_limit > 0 )
+                rc = final_merge_sort( params, sorter.sub_file_id );
+        }
             
         release_sorter( &sorter );
     }
@@ -407,7 +418,7 @@ static rc_t delete_tmp_files( const sorter_params * params, uint32_t count )
 }
 
 
-static rc_t merge_pool_files( const sorter_params * params )
+static rc_t merge_pool_files( const sorter_params * params, uint32_t count )
 {
     rc_t rc;
     merge_sorter_params msp;
@@ -416,14 +427,14 @@ static rc_t merge_pool_files( const sorter_params * params )
     msp.dir = params->dir;
     msp.output_filename = params->output_filename;
     msp.index_filename = params->index_filename;
-    msp.count = params->num_threads;
+    msp.count = count;
     msp.buf_size = params->buf_size;
 
     rc = make_merge_sorter( &ms, &msp );
     if ( rc == 0 )
     {
         uint32_t i;
-        for ( i = 0; rc == 0 && i < params->num_threads; ++i )
+        for ( i = 0; rc == 0 && i < count; ++i )
         {
             char buffer[ 4096 ];
             rc = make_pool_src_filename( params, i + 1, buffer, sizeof buffer );
@@ -437,7 +448,7 @@ static rc_t merge_pool_files( const sorter_params * params )
     }
 
     if ( rc == 0 ) 
-       rc = delete_tmp_files( params, params->num_threads );
+       rc = delete_tmp_files( params, count );
 
     return rc;
 }
@@ -493,20 +504,26 @@ rc_t run_sorter_pool( const sorter_params * params )
         KThread * progress_thread = NULL;
         uint32_t prefix = 1;
         multi_progress progress;
+        row_queue queue;
+        uint32_t chunk_id;
 
         init_progress_data( &progress, row_count );
         VectorInit( &threads, 0, params->num_threads );
         init_cmn_params( &cp, params, row_count );
+        init_row_queue( &queue, 1, row_count, params->num_threads ); /* helper.c */
         
         if ( params->show_progress )
             rc = start_multi_progress( &progress_thread, &progress );
             
-        while ( rc == 0 && cp.first < row_count )
+        /* every thread starts with one chunk, and pulls more from the queue when done with it */
+        while ( rc == 0 && prefix <= params->num_threads &&
+                next_row_chunk( &queue, &chunk_id, &cp.first, &cp.count ) )
         {
             sorter_params * sp = calloc( 1, sizeof *sp );
             if ( sp != NULL )
             {
                 init_sorter_params( sp, params, prefix++ );
+                sp->queue = &queue;
                 rc = make_raw_read_iter( &cp, &sp->src );
                 
                 if ( rc == 0 )
@@ -525,14 +542,13 @@ rc_t run_sorter_pool( const sorter_params * params )
                             ErrMsg( "VectorAppend( sort-thread #%d ) -> %R", prefix - 1, rc );
                     }
                 }
-                cp.first  += cp.count;
             }
         }
 
         join_and_release_threads( &threads );
         /* all sorter-threads are done now, tell the progress-thread to terminate! */
         join_multi_progress( progress_thread, &progress );
-        rc = merge_pool_files( params );
+        rc = merge_pool_files( params, prefix - 1 );
     }
     return rc;
 }
@@ -52,6 +52,9 @@ extern "C" {
 #endif
 
 
+struct packed_store;
+struct row_queue;
+
 typedef struct sorter_params
 {
     KDirectory * dir;
@@ -62,9 +65,14 @@ typedef struct sorter_params
     struct raw_read_iter * src;
     size_t buf_size, mem_limit, prefix, num_threads, cursor_cache;
     atomic_t * sort_progress;
+    struct packed_store ** streaming_store; /* if not NULL: see run_sorter() */
+    struct row_queue * queue;               /* if not NULL: src continues with the next chunk of it */
     bool show_progress;
 } sorter_params;
 
+/* if params->streaming_store is not NULL and all reads fit into the mem-limit,
+   no file is written, the sorted store is handed over in *params->streaming_store
+   ( to be released by the caller ), otherwise it is set to NULL and the lookup-file is written */
 rc_t run_sorter( const sorter_params * params );
 rc_t run_sorter_pool( const sorter_params * params );
 
@@ -92,6 +92,12 @@ bool get_from_special_iter( struct special_iter * iter, special_rec * rec, rc_t
 
 }
 
+rc_t set_special_iter_rows( struct special_iter * iter, int64_t first, uint64_t count )
+{
+    return cmn_iter_set_rows( iter->cmn, first, count );
+}
+
+
 uint64_t get_row_count_of_special_iter( struct special_iter * iter )
 {
     return cmn_iter_row_count( iter->cmn );
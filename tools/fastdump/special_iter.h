@@ -60,6 +60,9 @@ rc_t make_special_iter( cmn_params * params, struct special_iter ** iter );
 
 bool get_from_special_iter( struct special_iter * iter, special_rec * rec, rc_t * rc );
 
+/* continue with a different row-range, without opening the table again */
+rc_t set_special_iter_rows( struct special_iter * iter, int64_t first, uint64_t count );
+
 uint64_t get_row_count_of_special_iter( struct special_iter * iter );
 
 #ifdef __cplusplus
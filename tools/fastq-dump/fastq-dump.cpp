@@ -8,17 +8,23 @@
 #include <klib/rc.h>
 #include <kfc/rc.h>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 #include <sysalloc.h>
 #include <algorithm>        /* min */
 
 #include <string.h>         /* strcmp () */
 
 #include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
 
 #include "args.hpp"
 #include "filters.hpp"
-
-#include "koutstream"
+#include "formatter.hpp"
 
 namespace ngs {
 
@@ -32,12 +38,17 @@ public :
     static const char * _sM_maxSpotIdName;
     static const char * _sM_spotIdName;
     static const char * _sM_minReadLengthName;
+    static const char * _sM_maxNPercentName;
+    static const char * _sM_minMeanQualityName;
+    static const char * _sM_maxBasePercentName;
     static const char * _sM_categoryName;
     static const char * _sM_fastaName;
     static const char * _sM_legacyReportName;
+    static const char * _sM_threadsName;
 
     static const int64_t _sM_minSpotIdDefValue = 1;
     static const int64_t _sM_maxSpotIdDefValue = 0;
+    static const uint32_t _sM_threadsDefValue = 1;
 
 public :
     typedef AArgs PAPAHEN;
@@ -58,6 +69,15 @@ public :
     inline uint64_t minReadLength () const
                 { return _M_minReadLength; };
 
+    inline uint64_t maxNPercent () const
+                { return _M_maxNPercent; };
+
+    inline uint64_t minMeanQuality () const
+                { return _M_minMeanQuality; };
+
+    inline uint64_t maxBasePercent () const
+                { return _M_maxBasePercent; };
+
     inline ReadCategory category () const
                 { return _M_category; };
 
@@ -70,6 +90,9 @@ public :
     inline bool legacyReport () const
                 { return _M_legacyReport; };
 
+    inline uint32_t threads () const
+                { return _M_threads; };
+
 protected :
     void __customInit ();
     void __customParse ();
@@ -83,9 +106,13 @@ private :
     int64_t _M_minSpotId;      /* -N | --minSpotId < rowid > */
     int64_t _M_maxSpotId;      /* -X | --maxSpotId < rowid > */
     uint64_t _M_minReadLength;  /* -M | --minReadLen <len> */
+    uint64_t _M_maxNPercent;    /* --maxNPercent <percent> */
+    uint64_t _M_minMeanQuality; /* --minMeanQuality <phred> */
+    uint64_t _M_maxBasePercent; /* --maxBasePercent <percent> */
     ReadCategory _M_category;   /* -Y | --category */
     uint64_t _M_fasta;          /* -A | --fasta */
     bool _M_legacyReport;       /* -L | --legacy-report */
+    uint32_t _M_threads;        /* -e | --threads <count> */
 };
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -96,9 +123,13 @@ const char * DumpArgs :: _sM_minSpotIdName = "minSpotId";
 const char * DumpArgs :: _sM_maxSpotIdName = "maxSpotId";
 const char * DumpArgs :: _sM_spotIdName = "spotId";
 const char * DumpArgs :: _sM_minReadLengthName = "minReadLength";
+const char * DumpArgs :: _sM_maxNPercentName = "maxNPercent";
+const char * DumpArgs :: _sM_minMeanQualityName = "minMeanQuality";
+const char * DumpArgs :: _sM_maxBasePercentName = "maxBasePercent";
 const char * DumpArgs :: _sM_categoryName = "category";
 const char * DumpArgs :: _sM_fastaName = "fasta";
 const char * DumpArgs :: _sM_legacyReportName = "legacy-report";
+const char * DumpArgs :: _sM_threadsName = "threads";
 
 DumpArgs :: DumpArgs ()
 :   AArgs ()
@@ -106,9 +137,13 @@ DumpArgs :: DumpArgs ()
 ,   _M_minSpotId ( _sM_minSpotIdDefValue )
 ,   _M_maxSpotId ( _sM_maxSpotIdDefValue )
 ,   _M_minReadLength ( 0 )
+,   _M_maxNPercent ( 100 )
+,   _M_minMeanQuality ( 0 )
+,   _M_maxBasePercent ( 100 )
 ,   _M_category ( Read :: all )
 ,   _M_fasta ( 0 )
 ,   _M_legacyReport ( false )
+,   _M_threads ( _sM_threadsDefValue )
 {
 }   /* DumpArgs :: DumpArgs () */
 
@@ -177,6 +212,45 @@ DumpArgs :: __customInit ()
         addOpt ( TheOpt );
     }
 
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_maxNPercentName );
+        TheOpt . setParam ( "percent" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Filter out reads with more than <percent> of N bases" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_minMeanQualityName );
+        TheOpt . setParam ( "phred" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Filter out reads with mean quality < <phred>" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_maxBasePercentName );
+        TheOpt . setParam ( "percent" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Low complexity filter : filter out reads where a single base makes more than <percent> of bases" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
+
     {
         AOptDef TheOpt;
 
@@ -217,6 +291,20 @@ DumpArgs :: __customInit ()
 
         addOpt ( TheOpt );
     }
+
+    {
+        AOptDef TheOpt;
+
+        TheOpt . setName ( _sM_threadsName );
+        TheOpt . setAliases ( "e" );
+        TheOpt . setParam ( "count" );
+        TheOpt . setNeedValue ( true );
+        TheOpt . setRequired ( false );
+        TheOpt . setHlp ( "Number of threads to format spots with, output order is kept. Used with category <all> only. Optional, default value 1" );
+        TheOpt . setMaxCount ( 1 );
+
+        addOpt ( TheOpt );
+    }
 }   /* DumpArgs :: __customInit () */
 
 void
@@ -226,9 +314,13 @@ DumpArgs :: __customDispose ()
     _M_minSpotId = _sM_minSpotIdDefValue;
     _M_maxSpotId = _sM_maxSpotIdDefValue;
     _M_minReadLength = 0;
+    _M_maxNPercent = 100;
+    _M_minMeanQuality = 0;
+    _M_maxBasePercent = 100;
     _M_category = Read :: all;
     _M_fasta = 0;
     _M_legacyReport = false;
+    _M_threads = _sM_threadsDefValue;
 }   /* DumpArgs :: __customDispose () */
 
 void
@@ -301,6 +393,42 @@ DumpArgs :: __customParse ()
         _M_minReadLength = optV . uint64Val ();
     }
 
+    _M_maxNPercent = 100;
+    optV = optVal ( _sM_maxNPercentName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_maxNPercentName + "\" values");
+        }
+
+        _M_maxNPercent = optV . uint64Val ();
+        if ( 100 < _M_maxNPercent ) {
+            throw ErrorMsg ( String ( "__customParse: ERROR: Invalid value for option \"" ) + _sM_maxNPercentName + "\"" );
+        }
+    }
+
+    _M_minMeanQuality = 0;
+    optV = optVal ( _sM_minMeanQualityName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_minMeanQualityName + "\" values");
+        }
+
+        _M_minMeanQuality = optV . uint64Val ();
+    }
+
+    _M_maxBasePercent = 100;
+    optV = optVal ( _sM_maxBasePercentName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_maxBasePercentName + "\" values");
+        }
+
+        _M_maxBasePercent = optV . uint64Val ();
+        if ( 100 < _M_maxBasePercent ) {
+            throw ErrorMsg ( String ( "__customParse: ERROR: Invalid value for option \"" ) + _sM_maxBasePercentName + "\"" );
+        }
+    }
+
     _M_category = Read :: all;
     optV = optVal ( _sM_categoryName );
     if ( optV . exist () ) {
@@ -352,6 +480,21 @@ DumpArgs :: __customParse ()
 
     _M_legacyReport = optVal ( _sM_legacyReportName ) . exist ();
 
+    _M_threads = _sM_threadsDefValue;
+    optV = optVal ( _sM_threadsName );
+    if ( optV . exist () ) {
+        if ( optV . valCount () != 1 ) {
+            throw ErrorMsg ( String ( "__custromParse: ERROR: Too many \"" ) + _sM_threadsName + "\" values");
+        }
+
+        uint64_t __t = optV . uint64Val ();
+        if ( __t == 0 || 1024 < __t ) {
+            throw ErrorMsg ( String ( "__customParse: ERROR: Invalid value for option \"" ) + _sM_threadsName + "\"" );
+        }
+
+        _M_threads = ( uint32_t ) __t;
+    }
+
 }   /* DumpArgs :: __customParse () */
 
 }; /* namespace ngs */
@@ -473,111 +616,449 @@ setupFilters ( AFilters & Filters, const DumpArgs & TheArgs )
     if ( TheArgs . minReadLength () != 0 ) {
         Filters . addLengthFilter ( TheArgs . minReadLength () );
     }
+
+    if ( TheArgs . maxNPercent () < 100 ) {
+        Filters . addMaxNFilter ( TheArgs . maxNPercent () );
+    }
+
+    if ( TheArgs . minMeanQuality () != 0 ) {
+        Filters . addMeanQualityFilter ( TheArgs . minMeanQuality () );
+    }
+
+    if ( TheArgs . maxBasePercent () < 100 ) {
+        Filters . addLowComplexityFilter ( TheArgs . maxBasePercent () );
+    }
 }   /* setupFilters () */
 
 static
 void
 dumpFastQ (
-        int64_t SpotId,
-        const ngs :: String & CollectionName,
-        const ReadIterator & Iterator
+        AFormatter & Out,
+        const AReadBatch & Batch,
+        size_t Idx
 )
 {
-        /*)  We do not check values for arguments validity!
-         (*/
-    StringRef ReadName = Iterator . getReadName ();
-    StringRef Bases = Iterator . getReadBases ();
-    StringRef Qualities = Iterator . getReadQualities ();
-
-        /*)  First, we are doint base header
-         (*/
-    kout << "@"
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Bases . size ()
-        << '\n'
-        ;
-
-        /*)  Second is going base itsefl
-         (*/
-    kout << Bases
-        << '\n'
-        ;
-
-        /*)  Third, header for qualities
-         (*/
-    kout << '+'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << Qualities . size ()
-        << '\n'
-        ;
-
-        /*)  Finally there are qualities
-         (*/
-    kout << Qualities
-        << '\n'
-        ;
+    Out . fastQ (
+            Batch . spotId ( Idx ),
+            Batch . name ( Idx ),
+            Batch . nameSize ( Idx ),
+            Batch . bases ( Idx ),
+            Batch . basesSize ( Idx ),
+            Batch . qualities ( Idx ),
+            Batch . qualitiesSize ( Idx )
+            );
 }   /* dumpFastQ () */
 
 static
 void
 dumpFastA (
-        int64_t SpotId,
-        const ngs :: String & CollectionName,
-        const ReadIterator & Iterator,
+        AFormatter & Out,
+        const AReadBatch & Batch,
+        size_t Idx,
         uint64_t Width
 )
 {
-        /*)  We do not check values for arguments validity!
-         (*/
-    StringRef ReadName = Iterator . getReadName ();
-    StringRef Bases = Iterator . getReadBases ();
+    Out . fastA (
+            Batch . spotId ( Idx ),
+            Batch . name ( Idx ),
+            Batch . nameSize ( Idx ),
+            Batch . bases ( Idx ),
+            Batch . basesSize ( Idx ),
+            Width
+            );
+}   /* dumpFastA () */
+
+    /*)  Runs filters on the whole batch, and dumps accepted reads
+     (*/
+static
+void
+dumpBatch (
+        AFormatter & Out,
+        const DumpArgs & TheArgs,
+        AReadBatch & Batch,
+        AReadMask & Mask,
+        AFilters & Filters
+)
+{
+    Filters . checkBatch ( Batch, Mask );
+
+    for ( size_t llp = 0; llp < Batch . count (); llp ++ ) {
+        if ( ( Mask [ llp / 64 ] >> ( llp % 64 ) ) & 1 ) {
+            if ( TheArgs . fastaDump () ) {
+                dumpFastA ( Out, Batch, llp, TheArgs . fastaDumpWidth () );
+            }
+            else { 
+                dumpFastQ ( Out, Batch, llp );
+            }
+        }
+    }
+
+    Batch . clear ();
+}   /* dumpBatch () */
+
+    /*)  Dumps reads of spots [ First, First + Count ) to Out.
+     //  SpotId is the number printed for first read of range.
+     //  Reads are collected into batches and filtered batch by batch
+    (*/
+static
+void
+dumpRange (
+        AFormatter & Out,
+        const DumpArgs & TheArgs,
+        ReadCollection & RCol,
+        int64_t First,
+        uint64_t Count,
+        int64_t SpotId,
+        AFilters & Filters
+)
+{
+    ReadIterator Iterator = RCol.getReadRange (
+                                            First,
+                                            Count,
+                                            TheArgs . category ()
+                                            );
+
+        /* Qualities are fetched only if they are written or filtered on
+         */
+    AReadBatch Batch ( ! TheArgs . fastaDump () || Filters . needsQualities () );
+    AReadMask Mask;
+
+    for ( int64_t llp = SpotId ; Iterator.nextRead (); llp ++ ) {
+        Batch . add ( llp, Iterator );
+
+        if ( Batch . full () ) {
+            dumpBatch ( Out, TheArgs, Batch, Mask, Filters );
+        }
+    }
+
+    if ( Batch . count () != 0 ) {
+        dumpBatch ( Out, TheArgs, Batch, Mask, Filters );
+    }
+}   /* dumpRange () */
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/* Multithreaded dump                                              */
+/*                                                                 */
+/* Spot range is cut into chunks. Every worker has it's own        */
+/* ReadCollection and AFilters, takes chunks in order and formats  */
+/* them into own AFormatter. Main thread flushes formatters        */
+/* strictly in chunk order. Worker can not take chunk which is     */
+/* more than _M_window chunks ahead of writer, so the amount of    */
+/* formatted but not written data is bounded.                      */
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+class __KLocker {
+public :
+    __KLocker ( KLock * Lock ) : _M_lock ( Lock )
+                { KLockAcquire ( _M_lock ); };
+    ~__KLocker ()
+                { KLockUnlock ( _M_lock ); };
+
+private :
+    KLock * _M_lock;
+};  /* class __KLocker */
+
+class ThreadedDump {
+public :
+    static const uint64_t _sM_chunkSpots = 16384;
+    static const uint64_t _sM_chunksPerThread = 2;
 
-    uint64_t __l = Bases . size ();
+public :
+    ThreadedDump (
+                const DumpArgs & TheArgs,
+                int64_t MinSpot,
+                int64_t MaxSpot,
+                uint32_t NumThreads
+                );
+    ~ThreadedDump ();
 
-        /*)  First, we are doing base header
+        /*)  Dumps everything and adds statistics to Filters
          (*/
-    kout << '>'
-        << CollectionName
-        << '.'
-        << SpotId
-        << ' '
-        << ReadName
-        << " length="
-        << __l
-        << '\n'
-        ;
-
-        /*)  Second is going base itself by width
+    void run ( AFilters & Filters );
+
+private :
+    struct __Worker {
+        ThreadedDump * _M_dump;
+        AFilters * _M_filters;
+        KThread * _M_thread;
+    };
+
+    static rc_t CC __threadFunc ( const KThread * Self, void * Data );
+
+    void __work ( AFilters & Filters );
+    bool __takeChunk ( uint64_t & ChunkId );
+    void __putChunk ( uint64_t ChunkId, AFormatter * Out );
+    void __write ();
+    void __fail ( const ngs :: String & Message );
+
+private :
+    const DumpArgs & _M_args;
+
+    int64_t _M_minSpot;
+    int64_t _M_maxSpot;
+    uint64_t _M_chunkCount;
+    uint32_t _M_numThreads;
+    uint64_t _M_window;
+
+    KLock * _M_lock;
+    KCondition * _M_cond;
+
+    uint64_t _M_nextChunk;      /* next chunk to be taken by worker */
+    uint64_t _M_nextWrite;      /* next chunk to be written */
+    std :: map < uint64_t, AFormatter * > _M_ready;
+
+    bool _M_failed;
+    ngs :: String _M_error;
+};  /* class ThreadedDump */
+
+ThreadedDump :: ThreadedDump (
+                            const DumpArgs & TheArgs,
+                            int64_t MinSpot,
+                            int64_t MaxSpot,
+                            uint32_t NumThreads
+)
+:   _M_args ( TheArgs )
+,   _M_minSpot ( MinSpot )
+,   _M_maxSpot ( MaxSpot )
+,   _M_chunkCount ( 0 )
+,   _M_numThreads ( NumThreads )
+,   _M_window ( 0 )
+,   _M_lock ( NULL )
+,   _M_cond ( NULL )
+,   _M_nextChunk ( 0 )
+,   _M_nextWrite ( 0 )
+,   _M_ready ()
+,   _M_failed ( false )
+,   _M_error ( "" )
+{
+    uint64_t __c = ( uint64_t ) ( _M_maxSpot - _M_minSpot ) + 1;
+    _M_chunkCount = ( __c + _sM_chunkSpots - 1 ) / _sM_chunkSpots;
+
+    if ( _M_chunkCount < _M_numThreads ) {
+        _M_numThreads = ( uint32_t ) _M_chunkCount;
+    }
+
+    _M_window = _M_numThreads * _sM_chunksPerThread;
+
+    if ( KLockMake ( & _M_lock ) != 0 ) {
+        throw ErrorMsg ( "ThreadedDump: can not make lock" );
+    }
+
+    if ( KConditionMake ( & _M_cond ) != 0 ) {
+        KLockRelease ( _M_lock );
+        throw ErrorMsg ( "ThreadedDump: can not make condition" );
+    }
+}   /* ThreadedDump :: ThreadedDump () */
+
+ThreadedDump :: ~ThreadedDump ()
+{
+    std :: map < uint64_t, AFormatter * > :: iterator __i;
+    for ( __i = _M_ready . begin (); __i != _M_ready . end (); __i ++ ) {
+        delete __i -> second;
+    }
+    _M_ready . clear ();
+
+    KConditionRelease ( _M_cond );
+    _M_cond = NULL;
+
+    KLockRelease ( _M_lock );
+    _M_lock = NULL;
+}   /* ThreadedDump :: ~ThreadedDump () */
+
+rc_t CC
+ThreadedDump :: __threadFunc ( const KThread * Self, void * Data )
+{
+    __Worker * __w = ( __Worker * ) Data;
+
+    __w -> _M_dump -> __work ( * ( __w -> _M_filters ) );
+
+    return 0;
+}   /* ThreadedDump :: __threadFunc () */
+
+void
+ThreadedDump :: __work ( AFilters & Filters )
+{
+    try {
+        ngs :: String Acc ( _M_args . accession () . c_str () );
+        ReadCollection RCol = ncbi :: NGS :: openReadCollection ( Acc );
+        ngs :: String ReadCollectionName = RCol.getName ();
+
+        uint64_t ChunkId;
+        while ( __takeChunk ( ChunkId ) ) {
+            int64_t First = _M_minSpot + ( int64_t ) ( ChunkId * _sM_chunkSpots );
+            uint64_t Count = std :: min (
+                                    _sM_chunkSpots,
+                                    ( uint64_t ) ( _M_maxSpot - First ) + 1
+                                    );
+
+            AFormatter * Out = new AFormatter ( ReadCollectionName, false );
+            try {
+                dumpRange (
+                        * Out,
+                        _M_args,
+                        RCol,
+                        First,
+                        Count,
+                        _M_args . minSpotId () + ( First - _M_minSpot ),
+                        Filters
+                        );
+            }
+            catch ( ... ) {
+                delete Out;
+                throw;
+            }
+
+            __putChunk ( ChunkId, Out );
+        }
+    }
+    catch ( std :: exception & E ) {
+        __fail ( E . what () );
+    }
+    catch ( ... ) {
+        __fail ( "UNKNOWN exception in dump thread" );
+    }
+}   /* ThreadedDump :: __work () */
+
+bool
+ThreadedDump :: __takeChunk ( uint64_t & ChunkId )
+{
+    __KLocker Locker ( _M_lock );
+
+    if ( _M_failed || _M_chunkCount <= _M_nextChunk ) {
+        return false;
+    }
+
+    ChunkId = _M_nextChunk ++;
+
+        /*)  Waiting for writer to come closer
          (*/
+    while ( ! _M_failed && _M_nextWrite + _M_window <= ChunkId ) {
+        KConditionWait ( _M_cond, _M_lock );
+    }
+
+    return ! _M_failed;
+}   /* ThreadedDump :: __takeChunk () */
+
+void
+ThreadedDump :: __putChunk ( uint64_t ChunkId, AFormatter * Out )
+{
+    __KLocker Locker ( _M_lock );
+
+    _M_ready [ ChunkId ] = Out;
 
-    uint64_t __p = 0;
-    const char * __s = Bases . data ();
+    KConditionBroadcast ( _M_cond );
+}   /* ThreadedDump :: __putChunk () */
 
+void
+ThreadedDump :: __fail ( const ngs :: String & Message )
+{
+    __KLocker Locker ( _M_lock );
+
+    if ( ! _M_failed ) {
+        _M_failed = true;
+        _M_error = Message;
+    }
+
+    KConditionBroadcast ( _M_cond );
+}   /* ThreadedDump :: __fail () */
+
+void
+ThreadedDump :: __write ()
+{
+    while ( true ) {
+        AFormatter * Out = NULL;
 
-    if ( 0 < Width ) {
-        while ( __p < __l ) {
-            uint64_t __t = std :: min ( Width, __l - __p );
+        {
+            __KLocker Locker ( _M_lock );
 
-            kout << std :: string ( __s, ( std :: string :: size_type ) __p, ( std :: string :: size_type ) __t ) << "\n" ;
+            std :: map < uint64_t, AFormatter * > :: iterator __i = _M_ready . end ();
+            while ( ! _M_failed && _M_nextWrite < _M_chunkCount ) {
+                __i = _M_ready . find ( _M_nextWrite );
+                if ( __i != _M_ready . end () ) {
+                    break;
+                }
 
-            __p += __t;
+                KConditionWait ( _M_cond, _M_lock );
+            }
+
+            if ( _M_failed || _M_chunkCount <= _M_nextWrite ) {
+                return;
+            }
+
+            Out = __i -> second;
+            _M_ready . erase ( __i );
+            _M_nextWrite ++;
+
+            KConditionBroadcast ( _M_cond );
+        }
+
+        try {
+            Out -> flush ();
         }
+        catch ( ... ) {
+            delete Out;
+            throw;
+        }
+
+        delete Out;
     }
-    else {
-        kout << __s << "\n" ;
+}   /* ThreadedDump :: __write () */
+
+void
+ThreadedDump :: run ( AFilters & Filters )
+{
+    std :: vector < __Worker > Workers ( _M_numThreads );
+
+    for ( uint32_t llp = 0; llp < _M_numThreads; llp ++ ) {
+        __Worker & W = Workers [ llp ];
+
+        W . _M_dump = this;
+        W . _M_filters = new AFilters ( Filters . source () );
+        W . _M_thread = NULL;
+        setupFilters ( * W . _M_filters, _M_args );
     }
 
-}   /* dumpFastA () */
+    for ( uint32_t llp = 0; llp < _M_numThreads; llp ++ ) {
+        __Worker & W = Workers [ llp ];
+
+        if ( KThreadMake ( & W . _M_thread, __threadFunc, & W ) != 0 ) {
+            W . _M_thread = NULL;
+            __fail ( "ThreadedDump: can not start thread" );
+            break;
+        }
+    }
+
+    try {
+        __write ();
+    }
+    catch ( std :: exception & E ) {
+        __fail ( E . what () );
+    }
+    catch ( ... ) {
+        __fail ( "UNKNOWN exception while writing output" );
+    }
+
+    for ( uint32_t llp = 0; llp < _M_numThreads; llp ++ ) {
+        __Worker & W = Workers [ llp ];
+
+        if ( W . _M_thread != NULL ) {
+            KThreadWait ( W . _M_thread, NULL );
+            KThreadRelease ( W . _M_thread );
+            W . _M_thread = NULL;
+        }
+
+        if ( ! _M_failed ) {
+            Filters . merge ( * W . _M_filters );
+        }
+
+        delete W . _M_filters;
+        W . _M_filters = NULL;
+    }
+
+    if ( _M_failed ) {
+        throw ErrorMsg ( _M_error );
+    }
+}   /* ThreadedDump :: run () */
 
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
@@ -610,32 +1091,39 @@ run ( const DumpArgs & TheArgs )
         maxSpot = Id;
     }
 
-    ReadIterator Iterator = RCol.getReadRange (
-                                            minSpot,
-                                            maxSpot - minSpot + 1,
-                                            TheArgs . category ()
-                                            );
-
-    ngs :: String ReadCollectionName = RCol.getName ();
-
     AFilters Filters ( TheArgs . accession () );
     setupFilters ( Filters, TheArgs );
 
-    for ( int64_t llp = TheArgs . minSpotId () ; Iterator.nextRead (); llp ++ ) {
+        /*)  Spot numbers printed are counted from the start of range,
+         //  so chunks can be numbered independently only if every
+         //  spot in range is read, which is true for category <all>
+        (*/
+    bool Threaded = 1 < TheArgs . threads ();
+    if ( Threaded && TheArgs . category () != Read :: all ) {
+        std :: cerr << "WARNING: option \"" << DumpArgs :: _sM_threadsName << "\" is ignored for category other than <all>" << std :: endl;
+        Threaded = false;
+    }
 
-        if ( Filters . checkIt ( Iterator ) ) {
-            if ( TheArgs . fastaDump () ) {
-                dumpFastA ( llp, ReadCollectionName, Iterator, TheArgs . fastaDumpWidth () );
-            }
-            else { 
-                dumpFastQ ( llp, ReadCollectionName, Iterator );
-            }
-        }
+    if ( Threaded ) {
+        ThreadedDump TheDump ( TheArgs, minSpot, maxSpot, TheArgs . threads () );
+        TheDump . run ( Filters );
     }
+    else {
+        AFormatter Out ( RCol.getName (), true );
+
+        dumpRange (
+                Out,
+                TheArgs,
+                RCol,
+                minSpot,
+                maxSpot - minSpot + 1,
+                TheArgs . minSpotId (),
+                Filters
+                );
 
-    kout.flush ();
+        Out . flush ();
+    }
 
     std :: cerr << Filters . report ( TheArgs . legacyReport () );
 
 }   /* run () */
-
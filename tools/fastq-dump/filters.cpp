@@ -34,6 +34,8 @@
 
 #include <sstream>
 
+#include <string.h>
+
 #include "filters.hpp"
 
 using namespace std;
@@ -42,6 +44,116 @@ using namespace ngs;
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 
+static
+inline
+uint64_t
+__bitCount ( uint64_t Bits )
+{
+    Bits = Bits - ( ( Bits >> 1 ) & 0x5555555555555555ULL );
+    Bits = ( Bits & 0x3333333333333333ULL )
+            + ( ( Bits >> 2 ) & 0x3333333333333333ULL );
+    Bits = ( Bits + ( Bits >> 4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+
+    return ( Bits * 0x0101010101010101ULL ) >> 56;
+}   /* __bitCount () */
+
+/*))
+ //     AReadBatch
+((*/
+AReadBatch :: AReadBatch ( bool WithQualities )
+:   _M_withQualities ( WithQualities )
+{
+    _M_spotId . reserve ( _sM_maxReads );
+    _M_nameOff . reserve ( _sM_maxReads );
+    _M_nameSize . reserve ( _sM_maxReads );
+    _M_basesOff . reserve ( _sM_maxReads );
+    _M_basesSize . reserve ( _sM_maxReads );
+    _M_qualitiesOff . reserve ( _sM_maxReads );
+    _M_qualitiesSize . reserve ( _sM_maxReads );
+}   /* AReadBatch :: AReadBatch () */
+
+AReadBatch :: ~AReadBatch ()
+{
+}   /* AReadBatch :: ~AReadBatch () */
+
+void
+AReadBatch :: clear ()
+{
+        /* Capacity is kept, so filled batch does not allocate
+         */
+    _M_spotId . clear ();
+    _M_nameOff . clear ();
+    _M_nameSize . clear ();
+    _M_basesOff . clear ();
+    _M_basesSize . clear ();
+    _M_qualitiesOff . clear ();
+    _M_qualitiesSize . clear ();
+    _M_data . clear ();
+}   /* AReadBatch :: clear () */
+
+size_t
+AReadBatch :: __append ( const char * Data, size_t Size )
+{
+    size_t __o = _M_data . size ();
+
+    if ( 0 < Size ) {
+        _M_data . resize ( __o + Size );
+        memcpy ( & _M_data [ __o ], Data, Size );
+    }
+
+    return __o;
+}   /* AReadBatch :: __append () */
+
+void
+AReadBatch :: add (
+                int64_t SpotId,
+                const char * Name,
+                size_t NameSize,
+                const char * Bases,
+                size_t BasesSize,
+                const char * Qualities,
+                size_t QualitiesSize
+)
+{
+    _M_spotId . push_back ( SpotId );
+
+    _M_nameOff . push_back ( __append ( Name, NameSize ) );
+    _M_nameSize . push_back ( NameSize );
+
+    _M_basesOff . push_back ( __append ( Bases, BasesSize ) );
+    _M_basesSize . push_back ( BasesSize );
+
+    _M_qualitiesOff . push_back ( __append ( Qualities, QualitiesSize ) );
+    _M_qualitiesSize . push_back ( QualitiesSize );
+}   /* AReadBatch :: add () */
+
+void
+AReadBatch :: add ( int64_t SpotId, const ReadIterator & Rit )
+{
+    StringRef __n = Rit . getReadName ();
+    StringRef __b = Rit . getReadBases ();
+
+    if ( _M_withQualities ) {
+        StringRef __q = Rit . getReadQualities ();
+
+        add (
+            SpotId,
+            __n . data (),
+            __n . size (),
+            __b . data (),
+            __b . size (),
+            __q . data (),
+            __q . size ()
+            );
+    }
+    else {
+            /* FASTA output and no filter on qualities : it is
+             * not worth to fetch them
+             */
+        add ( SpotId, __n . data (), __n . size (), __b . data (), __b . size (), NULL, 0 );
+    }
+}   /* AReadBatch :: add () */
+
 /*))
  //     AFilter
 ((*/
@@ -61,6 +173,39 @@ AFilter :: checkIt ( const ReadIterator & pos ) const
     throw ErrorMsg ( ":: checkIt() - is not implemented for class" );
 }   /* AFilter :: checkIt () */
 
+bool
+AFilter :: checkRead (
+                    const char * Bases,
+                    size_t BasesSize,
+                    const char * Qualities,
+                    size_t QualitiesSize
+) const
+{
+    throw ErrorMsg ( ":: checkRead() - is not implemented for class" );
+}   /* AFilter :: checkRead () */
+
+bool
+AFilter :: needsQualities () const
+{
+    return false;
+}   /* AFilter :: needsQualities () */
+
+void
+AFilter :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    throw ErrorMsg ( ":: checkBatch() - is not implemented for class" );
+}   /* AFilter :: checkBatch () */
+
+void
+AFilter :: applyKeep ( AReadMask & Mask, size_t Word, uint64_t Keep ) const
+{
+    uint64_t __m = Mask [ Word ];
+
+    _M_rejected += __bitCount ( __m & ~ Keep );
+
+    Mask [ Word ] = __m & Keep;
+}   /* AFilter :: applyKeep () */
+
 String
 AFilter :: report () const
 {
@@ -82,6 +227,12 @@ AFilter :: report () const
     return "";
 }   /* AFilter :: report () */
 
+void
+AFilter :: merge ( const AFilter & Other )
+{
+    _M_rejected += Other . _M_rejected;
+}   /* AFilter :: merge () */
+
 String
 AFilter :: reason () const
 {
@@ -100,6 +251,8 @@ public :
     __NReadFilter ( const String & source );
 
     bool checkIt ( const ReadIterator & Rit ) const;
+    bool checkRead ( const char * Bases, size_t BasesSize, const char * Qualities, size_t QualitiesSize ) const;
+    void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
 
     String report () const;
 
@@ -114,11 +267,25 @@ __NReadFilter :: __NReadFilter ( const string & source )
 
 bool
 __NReadFilter :: checkIt ( const ReadIterator & ) const
+{
+    return checkRead ( NULL, 0, NULL, 0 );
+}   /* __NReadFilter :: checkIt () */ 
+
+bool
+__NReadFilter :: checkRead ( const char *, size_t, const char *, size_t ) const
 {
     reject ();
 
     return true;
-}   /* __NReadFilter :: checkIt () */ 
+}   /* __NReadFilter :: checkRead () */
+
+void
+__NReadFilter :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    for ( size_t __w = 0; __w < Batch . maskWords (); __w ++ ) {
+        reject ( __bitCount ( Mask [ __w ] ) );
+    }
+}   /* __NReadFilter :: checkBatch () */
 
 String
 __NReadFilter :: report () const
@@ -145,6 +312,8 @@ public :
     __SpotLengthFilter ( uint64_t MinLength );
 
     bool checkIt ( const ReadIterator & Rit ) const;
+    bool checkRead ( const char * Bases, size_t BasesSize, const char * Qualities, size_t QualitiesSize ) const;
+    void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
 
 protected :
     String reason () const;
@@ -161,15 +330,37 @@ __SpotLengthFilter :: __SpotLengthFilter ( uint64_t MinLength )
 bool
 __SpotLengthFilter :: checkIt ( const ReadIterator & Rit ) const
 {
-    uint64_t __l = Rit . getReadBases () . size ();
-    if ( __l < _M_minLength ) {
+    StringRef __b = Rit . getReadBases ();
+
+    return checkRead ( __b . data (), __b . size (), NULL, 0 );
+}   /* __SpotLengthFilter :: checkIt () */ 
+
+bool
+__SpotLengthFilter :: checkRead ( const char *, size_t BasesSize, const char *, size_t ) const
+{
+    if ( BasesSize < _M_minLength ) {
         reject ();
 
         return false;
     }
 
     return true;
-}   /* __SpotLengthFilter :: checkIt () */ 
+}   /* __SpotLengthFilter :: checkRead () */
+
+struct __SpotLengthPred {
+    __SpotLengthPred ( uint64_t MinLength ) : _M_minLength ( MinLength ) {};
+
+    inline bool operator () ( const AReadBatch & Batch, size_t Idx ) const
+                { return _M_minLength <= Batch . basesSize ( Idx ); };
+
+    uint64_t _M_minLength;
+};
+
+void
+__SpotLengthFilter :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    applyBatch ( Batch, Mask, __SpotLengthPred ( _M_minLength ) );
+}   /* __SpotLengthFilter :: checkBatch () */
 
 String
 __SpotLengthFilter :: reason () const
@@ -181,6 +372,310 @@ __SpotLengthFilter :: reason () const
     return __s . str ();
 }   /* __SpotLengthFilter :: reason () */
 
+/*))
+ //     Kernels for filters below. Those are plain loops without
+ //     branches, which compiler turns into SIMD compares and adds
+((*/
+static
+inline
+uint64_t
+__countBase ( const char * Bases, size_t Size, char Base )
+{
+    uint64_t __n = 0;
+
+    for ( size_t __i = 0; __i < Size; __i ++ ) {
+        __n += ( Bases [ __i ] == Base ) ? 1 : 0;
+    }
+
+    return __n;
+}   /* __countBase () */
+
+static
+inline
+uint64_t
+__sumQualities ( const char * Qualities, size_t Size )
+{
+    const uint8_t * __q = ( const uint8_t * ) Qualities;
+    uint64_t __s = 0;
+
+    for ( size_t __i = 0; __i < Size; __i ++ ) {
+        __s += __q [ __i ];
+    }
+
+    return __s;
+}   /* __sumQualities () */
+
+static
+inline
+uint64_t
+__maxBaseCount ( const char * Bases, size_t Size )
+{
+    uint64_t __a = 0, __c = 0, __g = 0, __t = 0;
+
+    for ( size_t __i = 0; __i < Size; __i ++ ) {
+        char __b = Bases [ __i ];
+        __a += ( __b == 'A' ) ? 1 : 0;
+        __c += ( __b == 'C' ) ? 1 : 0;
+        __g += ( __b == 'G' ) ? 1 : 0;
+        __t += ( __b == 'T' ) ? 1 : 0;
+    }
+
+    uint64_t __m = __a < __c ? __c : __a;
+    __m = __m < __g ? __g : __m;
+    return __m < __t ? __t : __m;
+}   /* __maxBaseCount () */
+
+/*))
+ //     Rejects reads with more than MaxPercent of N bases
+((*/
+class __MaxNFilter : public AFilter {
+public :
+    __MaxNFilter ( uint64_t MaxPercent );
+
+    bool checkIt ( const ReadIterator & Rit ) const;
+    bool checkRead ( const char * Bases, size_t BasesSize, const char * Qualities, size_t QualitiesSize ) const;
+    void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
+
+protected :
+    String reason () const;
+
+private :
+    uint64_t _M_maxPercent;
+};
+
+struct __MaxNPred {
+    __MaxNPred ( uint64_t MaxPercent ) : _M_maxPercent ( MaxPercent ) {};
+
+    inline bool operator () ( const char * Bases, size_t Size ) const
+                {
+                    uint64_t __n = __countBase ( Bases, Size, 'N' );
+                    return __n * 100 <= _M_maxPercent * Size;
+                };
+
+    inline bool operator () ( const AReadBatch & Batch, size_t Idx ) const
+                {
+                    return ( * this ) (
+                                    Batch . bases ( Idx ),
+                                    Batch . basesSize ( Idx )
+                                    );
+                };
+
+    uint64_t _M_maxPercent;
+};
+
+__MaxNFilter :: __MaxNFilter ( uint64_t MaxPercent )
+:   _M_maxPercent ( MaxPercent )
+{
+}   /* __MaxNFilter :: __MaxNFilter () */
+
+bool
+__MaxNFilter :: checkIt ( const ReadIterator & Rit ) const
+{
+    StringRef __b = Rit . getReadBases ();
+
+    return checkRead ( __b . data (), __b . size (), NULL, 0 );
+}   /* __MaxNFilter :: checkIt () */
+
+bool
+__MaxNFilter :: checkRead ( const char * Bases, size_t BasesSize, const char *, size_t ) const
+{
+    if ( ! __MaxNPred ( _M_maxPercent ) ( Bases, BasesSize ) ) {
+        reject ();
+
+        return false;
+    }
+
+    return true;
+}   /* __MaxNFilter :: checkRead () */
+
+void
+__MaxNFilter :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    applyBatch ( Batch, Mask, __MaxNPred ( _M_maxPercent ) );
+}   /* __MaxNFilter :: checkBatch () */
+
+String
+__MaxNFilter :: reason () const
+{
+    stringstream __s;
+
+    __s << "N > " << _M_maxPercent << "%";
+
+    return __s . str ();
+}   /* __MaxNFilter :: reason () */
+
+/*))
+ //     Rejects reads with mean phred quality below MinMean. Qualities
+ //     are ASCII encoded with offset 33
+((*/
+class __MeanQualityFilter : public AFilter {
+public :
+    __MeanQualityFilter ( uint64_t MinMean );
+
+    bool checkIt ( const ReadIterator & Rit ) const;
+    bool checkRead ( const char * Bases, size_t BasesSize, const char * Qualities, size_t QualitiesSize ) const;
+    void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
+
+    bool needsQualities () const;
+
+protected :
+    String reason () const;
+
+private :
+    uint64_t _M_minMean;
+};
+
+struct __MeanQualityPred {
+    __MeanQualityPred ( uint64_t MinMean ) : _M_minMean ( MinMean ) {};
+
+    inline bool operator () ( const char * Qualities, size_t Size ) const
+                {
+                    uint64_t __s = __sumQualities ( Qualities, Size );
+                    return ( _M_minMean + 33 ) * Size <= __s;
+                };
+
+    inline bool operator () ( const AReadBatch & Batch, size_t Idx ) const
+                {
+                    return ( * this ) (
+                                    Batch . qualities ( Idx ),
+                                    Batch . qualitiesSize ( Idx )
+                                    );
+                };
+
+    uint64_t _M_minMean;
+};
+
+__MeanQualityFilter :: __MeanQualityFilter ( uint64_t MinMean )
+:   _M_minMean ( MinMean )
+{
+}   /* __MeanQualityFilter :: __MeanQualityFilter () */
+
+bool
+__MeanQualityFilter :: checkIt ( const ReadIterator & Rit ) const
+{
+    StringRef __q = Rit . getReadQualities ();
+
+    return checkRead ( NULL, 0, __q . data (), __q . size () );
+}   /* __MeanQualityFilter :: checkIt () */
+
+bool
+__MeanQualityFilter :: checkRead ( const char *, size_t, const char * Qualities, size_t QualitiesSize ) const
+{
+    if ( ! __MeanQualityPred ( _M_minMean ) ( Qualities, QualitiesSize ) ) {
+        reject ();
+
+        return false;
+    }
+
+    return true;
+}   /* __MeanQualityFilter :: checkRead () */
+
+bool
+__MeanQualityFilter :: needsQualities () const
+{
+    return true;
+}   /* __MeanQualityFilter :: needsQualities () */
+
+void
+__MeanQualityFilter :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    if ( ! Batch . withQualities () ) {
+        throw ErrorMsg ( "__MeanQualityFilter :: checkBatch () - batch without qualities" );
+    }
+
+    applyBatch ( Batch, Mask, __MeanQualityPred ( _M_minMean ) );
+}   /* __MeanQualityFilter :: checkBatch () */
+
+String
+__MeanQualityFilter :: reason () const
+{
+    stringstream __s;
+
+    __s << "MEAN QUALITY < " << _M_minMean;
+
+    return __s . str ();
+}   /* __MeanQualityFilter :: reason () */
+
+/*))
+ //     Low complexity filter : rejects reads where a single base
+ //     makes more than MaxPercent of read
+((*/
+class __LowComplexityFilter : public AFilter {
+public :
+    __LowComplexityFilter ( uint64_t MaxPercent );
+
+    bool checkIt ( const ReadIterator & Rit ) const;
+    bool checkRead ( const char * Bases, size_t BasesSize, const char * Qualities, size_t QualitiesSize ) const;
+    void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
+
+protected :
+    String reason () const;
+
+private :
+    uint64_t _M_maxPercent;
+};
+
+struct __LowComplexityPred {
+    __LowComplexityPred ( uint64_t MaxPercent ) : _M_maxPercent ( MaxPercent ) {};
+
+    inline bool operator () ( const char * Bases, size_t Size ) const
+                {
+                    uint64_t __m = __maxBaseCount ( Bases, Size );
+                    return __m * 100 <= _M_maxPercent * Size;
+                };
+
+    inline bool operator () ( const AReadBatch & Batch, size_t Idx ) const
+                {
+                    return ( * this ) (
+                                    Batch . bases ( Idx ),
+                                    Batch . basesSize ( Idx )
+                                    );
+                };
+
+    uint64_t _M_maxPercent;
+};
+
+__LowComplexityFilter :: __LowComplexityFilter ( uint64_t MaxPercent )
+:   _M_maxPercent ( MaxPercent )
+{
+}   /* __LowComplexityFilter :: __LowComplexityFilter () */
+
+bool
+__LowComplexityFilter :: checkIt ( const ReadIterator & Rit ) const
+{
+    StringRef __b = Rit . getReadBases ();
+
+    return checkRead ( __b . data (), __b . size (), NULL, 0 );
+}   /* __LowComplexityFilter :: checkIt () */
+
+bool
+__LowComplexityFilter :: checkRead ( const char * Bases, size_t BasesSize, const char *, size_t ) const
+{
+    if ( ! __LowComplexityPred ( _M_maxPercent ) ( Bases, BasesSize ) ) {
+        reject ();
+
+        return false;
+    }
+
+    return true;
+}   /* __LowComplexityFilter :: checkRead () */
+
+void
+__LowComplexityFilter :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    applyBatch ( Batch, Mask, __LowComplexityPred ( _M_maxPercent ) );
+}   /* __LowComplexityFilter :: checkBatch () */
+
+String
+__LowComplexityFilter :: reason () const
+{
+    stringstream __s;
+
+    __s << "LOW COMPLEXITY ( single base > " << _M_maxPercent << "% )";
+
+    return __s . str ();
+}   /* __LowComplexityFilter :: reason () */
+
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 /*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
 
@@ -259,6 +754,66 @@ AFilters :: __checkIt ( const ReadIterator & Rit ) const
     return true;
 }   /* AFilters :: __checkIt () */
 
+bool
+AFilters :: checkRead (
+                    const char * Bases,
+                    size_t BasesSize,
+                    const char * Qualities,
+                    size_t QualitiesSize
+) const
+{
+    for ( TVecCI __b = _M_filters . begin (); __b != _M_filters . end (); __b ++ ) {
+        AFilter * __f = * __b;
+
+        if ( __f != NULL ) {
+            if ( ! __f -> checkRead ( Bases, BasesSize, Qualities, QualitiesSize ) ) {
+                return false;
+            }
+        }
+    }
+
+    _M_confirmed ++;
+
+    return true;
+}   /* AFilters :: checkRead () */
+
+bool
+AFilters :: needsQualities () const
+{
+    for ( TVecCI __b = _M_filters . begin (); __b != _M_filters . end (); __b ++ ) {
+        AFilter * __f = * __b;
+
+        if ( __f != NULL && __f -> needsQualities () ) {
+            return true;
+        }
+    }
+
+    return false;
+}   /* AFilters :: needsQualities () */
+
+void
+AFilters :: checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const
+{
+    size_t __c = Batch . count ();
+
+    Mask . assign ( Batch . maskWords (), ~ ( uint64_t ) 0 );
+    if ( ( __c % 64 ) != 0 ) {
+        Mask . back () = ( ( uint64_t ) 1 << ( __c % 64 ) ) - 1;
+    }
+
+    for ( TVecCI __b = _M_filters . begin (); __b != _M_filters . end (); __b ++ ) {
+        AFilter * __f = * __b;
+
+        if ( __f != NULL ) {
+            __f -> checkBatch ( Batch, Mask );
+        }
+    }
+
+    for ( size_t __w = 0; __w < Mask . size (); __w ++ ) {
+        _M_confirmed += __bitCount ( Mask [ __w ] );
+    }
+}   /* AFilters :: checkBatch () */
+
 void
 AFilters :: addFilter ( AFilter * Flt )
 {
@@ -273,6 +828,24 @@ AFilters :: addLengthFilter ( uint64_t minLength )
     addFilter ( new __SpotLengthFilter ( minLength ) );
 }   /* AFilters :: addLengthFilter () */
 
+void
+AFilters :: addMaxNFilter ( uint64_t maxPercent )
+{
+    addFilter ( new __MaxNFilter ( maxPercent ) );
+}   /* AFilters :: addMaxNFilter () */
+
+void
+AFilters :: addMeanQualityFilter ( uint64_t minMeanQuality )
+{
+    addFilter ( new __MeanQualityFilter ( minMeanQuality ) );
+}   /* AFilters :: addMeanQualityFilter () */
+
+void
+AFilters :: addLowComplexityFilter ( uint64_t maxBasePercent )
+{
+    addFilter ( new __LowComplexityFilter ( maxBasePercent ) );
+}   /* AFilters :: addLowComplexityFilter () */
+
 String
 AFilters :: report ( bool legacyStyle ) const
 {
@@ -298,3 +871,20 @@ AFilters :: report ( bool legacyStyle ) const
 
     return __s . str ();
 }   /* AFilters :: report () */
+
+void
+AFilters :: merge ( const AFilters & Other )
+{
+    if ( _M_filters . size () != Other . _M_filters . size () ) {
+        throw ErrorMsg ( "AFilters :: merge () - filter sets do not match" );
+    }
+
+    TVecCI __o = Other . _M_filters . begin ();
+    for ( TVecI __b = _M_filters . begin (); __b != _M_filters . end (); __b ++, __o ++ ) {
+        if ( * __b != NULL && * __o != NULL ) {
+            ( * __b ) -> merge ( * * __o );
+        }
+    }
+
+    _M_confirmed += Other . _M_confirmed;
+}   /* AFilters :: merge () */
@@ -45,6 +45,84 @@ namespace ngs {
 ((*/
 class ReadIterator;
 
+/*))
+ // Bit mask over reads of AReadBatch : bit ( i % 64 ) of word ( i / 64 )
+ // is set if read i is still accepted
+((*/
+typedef std :: vector < uint64_t > AReadMask;
+
+/*))
+ // Batch of reads stored as struct of arrays. Names, bases and
+ // qualities are copied into one arena, so batch does not depend
+ // on lifetime of data returned by ReadIterator. If WithQualities
+ // is false, qualities are not fetched from ReadIterator at all,
+ // and every read has empty qualities
+((*/
+class AReadBatch {
+public :
+    static const size_t _sM_maxReads = 1024;
+
+public :
+    AReadBatch ( bool WithQualities = true );
+    ~AReadBatch ();
+
+    inline bool withQualities () const { return _M_withQualities; };
+
+    void clear ();
+
+    void add ( int64_t SpotId, const ReadIterator & Rit );
+    void add (
+            int64_t SpotId,
+            const char * Name,
+            size_t NameSize,
+            const char * Bases,
+            size_t BasesSize,
+            const char * Qualities,
+            size_t QualitiesSize
+            );
+
+    inline bool full () const { return _sM_maxReads <= _M_spotId . size (); };
+    inline size_t count () const { return _M_spotId . size (); };
+    inline size_t maskWords () const { return ( count () + 63 ) / 64; };
+
+    inline int64_t spotId ( size_t Idx ) const
+                { return _M_spotId [ Idx ]; };
+
+    inline const char * name ( size_t Idx ) const
+                { return __at ( _M_nameOff [ Idx ] ); };
+    inline size_t nameSize ( size_t Idx ) const
+                { return _M_nameSize [ Idx ]; };
+
+    inline const char * bases ( size_t Idx ) const
+                { return __at ( _M_basesOff [ Idx ] ); };
+    inline size_t basesSize ( size_t Idx ) const
+                { return _M_basesSize [ Idx ]; };
+
+    inline const char * qualities ( size_t Idx ) const
+                { return __at ( _M_qualitiesOff [ Idx ] ); };
+    inline size_t qualitiesSize ( size_t Idx ) const
+                { return _M_qualitiesSize [ Idx ]; };
+
+private :
+    inline const char * __at ( size_t Off ) const
+                { return _M_data . empty () ? NULL : & _M_data [ 0 ] + Off; };
+
+    size_t __append ( const char * Data, size_t Size );
+
+private :
+    std :: vector < int64_t > _M_spotId;
+    std :: vector < size_t > _M_nameOff;
+    std :: vector < size_t > _M_nameSize;
+    std :: vector < size_t > _M_basesOff;
+    std :: vector < size_t > _M_basesSize;
+    std :: vector < size_t > _M_qualitiesOff;
+    std :: vector < size_t > _M_qualitiesSize;
+
+    std :: vector < char > _M_data;
+
+    bool _M_withQualities;
+};  /* class AReadBatch */
+
 class AFilter {
 public :
     AFilter ();
@@ -52,16 +130,80 @@ public :
 
     virtual bool checkIt ( const ReadIterator & pos ) const = 0;
 
+        /* Same as checkIt (), but for read data which are not
+         * behind ReadIterator. Predefined filters implement checkIt ()
+         * through that method
+         */
+    virtual bool checkRead (
+                        const char * Bases,
+                        size_t BasesSize,
+                        const char * Qualities,
+                        size_t QualitiesSize
+                        ) const;
+
+        /* Filter looks at qualities, so they have to be fetched
+         */
+    virtual bool needsQualities () const;
+
+        /* Clears bits of Mask for reads which are rejected. Bits
+         * which are clear already should not be looked at or be
+         * counted
+         */
+    virtual void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
+
     virtual String report () const;
 
+        /* Adds statistics collected by the same kind of filter
+         * in another thread
+         */
+    void merge ( const AFilter & Other );
+
 protected :
         /* That method should be called from 'checkIt()' for stat
          */
     inline void reject () const { _M_rejected ++; };
+    inline void reject ( uint64_t Count ) const { _M_rejected += Count; };
     inline uint64_t rejected () const { return _M_rejected; };
 
     virtual String reason () const;
 
+        /* Keeps in Mask word Word only bits set in Keep, counts
+         * cleared bits as rejected
+         */
+    void applyKeep ( AReadMask & Mask, size_t Word, uint64_t Keep ) const;
+
+        /* Runs predicate Pred ( Batch, Idx ) for every read which is
+         * still set in Mask, and clears bits of those where it is
+         * false. Predicate is called word by word, so it could be
+         * inlined, and it's inner loops are vectorized by compiler
+         */
+    template < class Pred >
+    void applyBatch (
+                const AReadBatch & Batch,
+                AReadMask & Mask,
+                const Pred & P
+                ) const
+        {
+            size_t __c = Batch . count ();
+
+            for ( size_t __w = 0; __w < Batch . maskWords (); __w ++ ) {
+                uint64_t __m = Mask [ __w ];
+                if ( __m == 0 ) {
+                    continue;
+                }
+
+                size_t __b = __w * 64;
+                size_t __e = __c < __b + 64 ? __c : __b + 64;
+
+                uint64_t __k = 0;
+                for ( size_t __i = __b; __i < __e; __i ++ ) {
+                    __k |= ( uint64_t ) ( P ( Batch, __i ) ? 1 : 0 ) << ( __i - __b );
+                }
+
+                applyKeep ( Mask, __w, __k );
+            }
+        };
+
 private :
     mutable uint64_t _M_rejected;
 
@@ -79,6 +221,26 @@ public :
 
     bool checkIt ( const ReadIterator & pos ) const;
 
+        /* Same as checkIt (), for read data which are not behind
+         * ReadIterator
+         */
+    bool checkRead (
+                const char * Bases,
+                size_t BasesSize,
+                const char * Qualities,
+                size_t QualitiesSize
+                ) const;
+
+        /* Any of filters looks at qualities
+         */
+    bool needsQualities () const;
+
+        /* Sets Mask bit for every read of Batch, which passes all
+         * filters. Filters are evaluated one after another on the
+         * whole batch, not read after read
+         */
+    void checkBatch ( const AReadBatch & Batch, AReadMask & Mask ) const;
+
         /* Adds new user_defined filter ...
          */
     void addFilter ( AFilter * pFilter );
@@ -86,6 +248,9 @@ public :
         /* There are some standard predefined filters to add
          */
     void addLengthFilter ( uint64_t minLength );
+    void addMaxNFilter ( uint64_t maxPercent );
+    void addMeanQualityFilter ( uint64_t minMeanQuality );
+    void addLowComplexityFilter ( uint64_t maxBasePercent );
 
         /* Misc stuff
          */
@@ -93,6 +258,12 @@ public :
 
     String report ( bool legacyStyle = false ) const;
 
+        /* Adds statistics of filters set, which was set up in same
+         * way and used by another thread, so report () would cover
+         * both of them
+         */
+    void merge ( const AFilters & Other );
+
 private :
     void init ();
     void dispose ();
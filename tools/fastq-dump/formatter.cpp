@@ -0,0 +1,302 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <sysalloc.h>
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <klib/out.h>
+#include <klib/writer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "formatter.hpp"
+
+using namespace std;
+using namespace ngs;
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/* Integer formatting                                              */
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+static const char __digitPairs [ 201 ] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899"
+    ;
+
+    /*)  Max length of decimal uint64_t
+     (*/
+static const size_t __maxDigits = 20;
+
+    /*)  Writes value to the end of ( Pos - __maxDigits, Pos ], returns
+     //  pointer to the first digit
+    (*/
+static
+char *
+__utoa ( uint64_t Value, char * Pos )
+{
+    while ( 100 <= Value ) {
+        unsigned __i = ( unsigned ) ( Value % 100 ) * 2;
+        Value /= 100;
+        * -- Pos = __digitPairs [ __i + 1 ];
+        * -- Pos = __digitPairs [ __i ];
+    }
+
+    if ( Value < 10 ) {
+        * -- Pos = ( char ) ( '0' + Value );
+    }
+    else {
+        unsigned __i = ( unsigned ) Value * 2;
+        * -- Pos = __digitPairs [ __i + 1 ];
+        * -- Pos = __digitPairs [ __i ];
+    }
+
+    return Pos;
+}   /* __utoa () */
+
+    /*)  Appends decimal Value to Dst, returns the end of it
+     (*/
+static
+char *
+__itoa ( int64_t Value, char * Dst )
+{
+    char __t [ __maxDigits + 1 ];
+    char * __e = __t + sizeof ( __t );
+
+    uint64_t __v = ( uint64_t ) Value;
+    if ( Value < 0 ) {
+        * Dst ++ = '-';
+        __v = 0 - __v;
+    }
+
+    char * __b = __utoa ( __v, __e );
+    size_t __l = __e - __b;
+
+    memcpy ( Dst, __b, __l );
+
+    return Dst + __l;
+}   /* __itoa () */
+
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+/*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*_*/
+
+/*))
+ //     AFormatter
+((*/
+AFormatter :: AFormatter ( const String & CollectionName, bool AutoFlush )
+:   _M_name ( CollectionName )
+,   _M_autoFlush ( AutoFlush )
+,   _M_buffer ( NULL )
+,   _M_size ( 0 )
+,   _M_capacity ( 0 )
+{
+    __grow ( _sM_flushSize + 64 * 1024 );
+}   /* AFormatter :: AFormatter () */
+
+AFormatter :: ~AFormatter ()
+{
+    if ( _M_buffer != NULL ) {
+        free ( _M_buffer );
+    }
+
+    _M_buffer = NULL;
+    _M_size = 0;
+    _M_capacity = 0;
+}   /* AFormatter :: ~AFormatter () */
+
+void
+AFormatter :: __grow ( size_t Size )
+{
+    size_t __c = _M_capacity == 0 ? 4096 : _M_capacity;
+    while ( __c < Size ) {
+        __c *= 2;
+    }
+
+    char * __b = ( char * ) realloc ( _M_buffer, __c );
+    if ( __b == NULL ) {
+        throw ErrorMsg ( "AFormatter: out of memory" );
+    }
+
+    _M_buffer = __b;
+    _M_capacity = __c;
+}   /* AFormatter :: __grow () */
+
+void
+AFormatter :: __header (
+                    char Marker,
+                    int64_t SpotId,
+                    const char * ReadName,
+                    size_t ReadNameSize,
+                    uint64_t Length
+)
+{
+        /*)  "@NAME.SPOTID READNAME length=LENGTH\n"
+         (*/
+    size_t __n = 1 + _M_name . size () + 1 + 1 + __maxDigits
+                + 1 + ReadNameSize + 8 + __maxDigits + 1;
+
+    char * __p = __reserve ( __n );
+    char * __s = __p;
+
+    * __p ++ = Marker;
+
+    memcpy ( __p, _M_name . data (), _M_name . size () );
+    __p += _M_name . size ();
+
+    * __p ++ = '.';
+    __p = __itoa ( SpotId, __p );
+    * __p ++ = ' ';
+
+    memcpy ( __p, ReadName, ReadNameSize );
+    __p += ReadNameSize;
+
+    memcpy ( __p, " length=", 8 );
+    __p += 8;
+
+    char __t [ __maxDigits ];
+    char * __b = __utoa ( Length, __t + sizeof ( __t ) );
+    memcpy ( __p, __b, ( __t + sizeof ( __t ) ) - __b );
+    __p += ( __t + sizeof ( __t ) ) - __b;
+
+    * __p ++ = '\n';
+
+    _M_size += __p - __s;
+}   /* AFormatter :: __header () */
+
+void
+AFormatter :: fastQ (
+                int64_t SpotId,
+                const char * ReadName,
+                size_t ReadNameSize,
+                const char * Bases,
+                size_t BasesSize,
+                const char * Qualities,
+                size_t QualitiesSize
+)
+{
+        /*)  We do not check values for arguments validity!
+         (*/
+    __header ( '@', SpotId, ReadName, ReadNameSize, BasesSize );
+
+    char * __p = __reserve ( BasesSize + 1 );
+    memcpy ( __p, Bases, BasesSize );
+    __p [ BasesSize ] = '\n';
+    _M_size += BasesSize + 1;
+
+    __header ( '+', SpotId, ReadName, ReadNameSize, QualitiesSize );
+
+    __p = __reserve ( QualitiesSize + 1 );
+    memcpy ( __p, Qualities, QualitiesSize );
+    __p [ QualitiesSize ] = '\n';
+    _M_size += QualitiesSize + 1;
+
+    __done ();
+}   /* AFormatter :: fastQ () */
+
+void
+AFormatter :: fastA (
+                int64_t SpotId,
+                const char * ReadName,
+                size_t ReadNameSize,
+                const char * Bases,
+                size_t BasesSize,
+                uint64_t Width
+)
+{
+        /*)  We do not check values for arguments validity!
+         (*/
+    __header ( '>', SpotId, ReadName, ReadNameSize, BasesSize );
+
+        /*)  An empty read gets no line when wrapped ( as the iostream
+         |   version did ), but an empty line when not wrapped
+         (*/
+    if ( Width == 0 || ( 0 < BasesSize && BasesSize <= Width ) ) {
+        char * __p = __reserve ( BasesSize + 1 );
+        memcpy ( __p, Bases, BasesSize );
+        __p [ BasesSize ] = '\n';
+        _M_size += BasesSize + 1;
+    }
+    else {
+        size_t __lines = ( BasesSize + Width - 1 ) / Width;
+        char * __p = __reserve ( BasesSize + __lines );
+        char * __s = __p;
+
+        for ( size_t __o = 0; __o < BasesSize; __o += Width ) {
+            size_t __t = BasesSize - __o < Width ? BasesSize - __o : Width;
+
+            memcpy ( __p, Bases + __o, __t );
+            __p += __t;
+            * __p ++ = '\n';
+        }
+
+        _M_size += __p - __s;
+    }
+
+    __done ();
+}   /* AFormatter :: fastA () */
+
+void
+AFormatter :: __done ()
+{
+    if ( _M_autoFlush && _sM_flushSize <= _M_size ) {
+        flush ();
+    }
+}   /* AFormatter :: __done () */
+
+void
+AFormatter :: flush ()
+{
+    KWrtWriter __w = KOutWriterGet ();
+    void * __d = KOutDataGet ();
+
+    if ( __w == NULL ) {
+        throw ErrorMsg ( "AFormatter: no output writer" );
+    }
+
+    size_t __o = 0;
+    while ( __o < _M_size ) {
+        size_t __n = 0;
+        rc_t __rc = __w ( __d, _M_buffer + __o, _M_size - __o, & __n );
+        if ( __rc != 0 || __n == 0 ) {
+            throw ErrorMsg ( "AFormatter: can not write output" );
+        }
+
+        __o += __n;
+    }
+
+    _M_size = 0;
+}   /* AFormatter :: flush () */
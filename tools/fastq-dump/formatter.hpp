@@ -0,0 +1,119 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_outpost_formatter_
+#define _h_outpost_formatter_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#include <ngs/ErrorMsg.hpp>
+
+/*)))   Namespace
+ (((*/
+namespace ngs {
+
+/*))
+ //     Formats FASTQ/FASTA records directly into a reusable char
+ //     buffer : no iostreams, no temporary strings. Buffer grows
+ //     if needed, and it is written out through KOutWriter by
+ //     flush (). With AutoFlush set, flush () is called as soon as
+ //     buffer holds more than _sM_flushSize bytes, otherwise buffer
+ //     keeps everything until flush () or clear ().
+((*/
+class AFormatter {
+public :
+    static const size_t _sM_flushSize = 4 * 1024 * 1024;
+
+public :
+    AFormatter ( const String & CollectionName, bool AutoFlush );
+    ~AFormatter ();
+
+        /* Four lines FASTQ record
+         */
+    void fastQ (
+            int64_t SpotId,
+            const char * ReadName,
+            size_t ReadNameSize,
+            const char * Bases,
+            size_t BasesSize,
+            const char * Qualities,
+            size_t QualitiesSize
+            );
+
+        /* FASTA record with bases wrapped by Width, zero Width
+         * means no wrapping
+         */
+    void fastA (
+            int64_t SpotId,
+            const char * ReadName,
+            size_t ReadNameSize,
+            const char * Bases,
+            size_t BasesSize,
+            uint64_t Width
+            );
+
+        /* Writes content of buffer by KOutWriter and clears it
+         */
+    void flush ();
+
+    inline void clear () { _M_size = 0; };
+
+    inline const char * data () const { return _M_buffer; };
+    inline size_t size () const { return _M_size; };
+
+private :
+    AFormatter ( const AFormatter & );
+    AFormatter & operator = ( const AFormatter & );
+
+    void __header ( char Marker, int64_t SpotId, const char * ReadName, size_t ReadNameSize, uint64_t Length );
+
+    inline char * __reserve ( size_t Size )
+        {
+            if ( _M_capacity < _M_size + Size ) {
+                __grow ( _M_size + Size );
+            }
+            return _M_buffer + _M_size;
+        };
+
+    void __grow ( size_t Size );
+    void __done ();
+
+private :
+    String _M_name;
+    bool _M_autoFlush;
+
+    char * _M_buffer;
+    size_t _M_size;
+    size_t _M_capacity;
+};  /* class AFormatter */
+
+/*)))   Namespace
+ (((*/
+}; /* namespace ngs */
+
+#endif /* _h_outpost_formatter_ */
@@ -0,0 +1,539 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bam_index.h"
+#include "bgzf_writer.h"
+
+#include <klib/vector.h>
+#include <klib/sort.h>
+#include <kfs/directory.h>
+#include <kfs/buffile.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IDX_MIN_SHIFT 14
+#define BAI_DEPTH 5
+
+typedef struct idx_chunk
+{
+    uint32_t bin;
+    uint64_t beg;
+    uint64_t end;
+} idx_chunk;
+
+
+typedef struct idx_ref
+{
+    idx_chunk * chunks;
+    uint32_t chunk_count;
+    uint32_t chunk_size;
+
+    /* bin -> 1 + index of the last chunk of this bin */
+    KVector * last_chunk;
+
+    /* the smallest offset of a record overlapping a 16k-window */
+    uint64_t * linear;
+    uint32_t linear_count;
+    uint32_t linear_size;
+
+    /* the content of the pseudo-bin */
+    uint64_t off_beg;
+    uint64_t off_end;
+    uint64_t n_mapped;
+    uint64_t n_unmapped;
+} idx_ref;
+
+
+typedef struct bam_index
+{
+    idx_ref * refs;
+    uint32_t ref_count;
+    int32_t depth;
+    bool csi;
+
+    int32_t last_ref_id;
+    int64_t last_beg;
+    uint64_t n_no_coor;
+    bool sorted;
+} bam_index;
+
+
+static uint32_t reg2bin( int64_t beg, int64_t end, int32_t min_shift, int32_t depth )
+{
+    int32_t l, s = min_shift, t = ( ( 1 << ( depth * 3 ) ) - 1 ) / 7;
+    for ( --end, l = depth; l > 0; --l, s += 3, t -= 1 << ( l * 3 ) )
+    {
+        if ( beg >> s == end >> s )
+            return t + ( uint32_t )( beg >> s );
+    }
+    return 0;
+}
+
+
+uint16_t bam_reg2bin( int64_t beg, int64_t end )
+{
+    /* the bin-field of a BAM-record cannot express positions beyond 2^29,
+       readers of CSI-indexed files do not use it */
+    if ( end > ( ( int64_t )1 << 29 ) )
+        return 0;
+    return ( uint16_t )reg2bin( beg, end, IDX_MIN_SHIFT, BAI_DEPTH );
+}
+
+
+rc_t make_bam_index( struct bam_index ** self, uint32_t ref_count, const uint32_t * ref_lengths )
+{
+    rc_t rc = 0;
+    bam_index * idx = calloc( 1, sizeof * idx );
+    *self = NULL;
+    if ( idx == NULL )
+        rc = RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+    else
+    {
+        uint32_t max_len = 0;
+        uint32_t i;
+        uint64_t s;
+
+        for ( i = 0; i < ref_count; ++i )
+        {
+            if ( ref_lengths[ i ] > max_len )
+                max_len = ref_lengths[ i ];
+        }
+        for ( idx->depth = 0, s = ( 1 << IDX_MIN_SHIFT ); max_len > s; ++idx->depth, s <<= 3 ) { }
+        idx->csi = ( idx->depth > BAI_DEPTH );
+        if ( !idx->csi )
+            idx->depth = BAI_DEPTH;
+
+        idx->ref_count = ref_count;
+        idx->last_ref_id = -1;
+        idx->sorted = true;
+        if ( ref_count > 0 )
+        {
+            idx->refs = calloc( ref_count, sizeof *( idx->refs ) );
+            if ( idx->refs == NULL )
+                rc = RC( rcExe, rcIndex, rcConstructing, rcMemory, rcExhausted );
+        }
+        if ( rc == 0 )
+            *self = idx;
+        else
+            release_bam_index( idx );
+    }
+    if ( rc != 0 )
+        LOGERR( klogErr, rc, "cannot create bam-index" );
+    return rc;
+}
+
+
+static rc_t add_chunk( idx_ref * ref, uint32_t bin, uint64_t offset_beg, uint64_t offset_end )
+{
+    uint64_t last = 0;
+    rc_t rc = 0;
+
+    if ( ref->last_chunk == NULL )
+        rc = KVectorMake( &ref->last_chunk );
+    if ( rc == 0 )
+    {
+        rc = KVectorGetU64( ref->last_chunk, bin, &last );
+        if ( GetRCState( rc ) == rcNotFound )
+        {
+            last = 0;
+            rc = 0;
+        }
+    }
+    if ( rc == 0 )
+    {
+        /* a record following the last chunk of its bin in the same block extends this chunk */
+        if ( last > 0 && ( ref->chunks[ last - 1 ].end >> 16 ) == ( offset_beg >> 16 ) )
+            ref->chunks[ last - 1 ].end = offset_end;
+        else
+        {
+            if ( ref->chunk_count >= ref->chunk_size )
+            {
+                uint32_t new_size = ( ref->chunk_size > 0 ) ? ref->chunk_size * 2 : 64;
+                idx_chunk * tmp = realloc( ref->chunks, new_size * ( sizeof * tmp ) );
+                if ( tmp == NULL )
+                    return RC( rcExe, rcIndex, rcInserting, rcMemory, rcExhausted );
+                ref->chunks = tmp;
+                ref->chunk_size = new_size;
+            }
+            ref->chunks[ ref->chunk_count ].bin = bin;
+            ref->chunks[ ref->chunk_count ].beg = offset_beg;
+            ref->chunks[ ref->chunk_count ].end = offset_end;
+            ref->chunk_count++;
+            rc = KVectorSetU64( ref->last_chunk, bin, ref->chunk_count );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t add_linear( idx_ref * ref, int64_t beg, int64_t end, uint64_t offset_beg )
+{
+    uint32_t first = ( uint32_t )( beg >> IDX_MIN_SHIFT );
+    uint32_t last = ( uint32_t )( ( end - 1 ) >> IDX_MIN_SHIFT );
+    uint32_t w;
+
+    if ( last >= ref->linear_size )
+    {
+        uint32_t new_size = ( ref->linear_size > 0 ) ? ref->linear_size : 1024;
+        uint64_t * tmp;
+        while ( new_size <= last )
+            new_size *= 2;
+        tmp = realloc( ref->linear, new_size * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+            return RC( rcExe, rcIndex, rcInserting, rcMemory, rcExhausted );
+        memset( tmp + ref->linear_size, 0, ( new_size - ref->linear_size ) * ( sizeof * tmp ) );
+        ref->linear = tmp;
+        ref->linear_size = new_size;
+    }
+    for ( w = first; w <= last; ++w )
+    {
+        if ( ref->linear[ w ] == 0 )
+            ref->linear[ w ] = offset_beg;
+    }
+    if ( last >= ref->linear_count )
+        ref->linear_count = last + 1;
+    return 0;
+}
+
+
+rc_t bam_index_add( struct bam_index * self, int32_t ref_id, int64_t beg, int64_t end, bool mapped,
+                    uint64_t offset_beg, uint64_t offset_end )
+{
+    rc_t rc = 0;
+    if ( !self->sorted )
+        return 0;
+
+    if ( ref_id < 0 )
+    {
+        self->n_no_coor++;
+        self->last_ref_id = ( int32_t )self->ref_count;
+    }
+    else if ( ( uint32_t )ref_id >= self->ref_count ||
+              ref_id < self->last_ref_id ||
+              ( ref_id == self->last_ref_id && beg < self->last_beg ) )
+    {
+        /* nothing more to do for an unsorted file, we give up on the index */
+        self->sorted = false;
+    }
+    else
+    {
+        idx_ref * ref = &self->refs[ ref_id ];
+
+        if ( end <= beg )
+            end = beg + 1;
+        self->last_ref_id = ref_id;
+        self->last_beg = beg;
+
+        if ( ref->n_mapped == 0 && ref->n_unmapped == 0 )
+            ref->off_beg = offset_beg;
+        ref->off_end = offset_end;
+        if ( mapped )
+            ref->n_mapped++;
+        else
+            ref->n_unmapped++;
+
+        rc = add_chunk( ref, reg2bin( beg, end, IDX_MIN_SHIFT, self->depth ), offset_beg, offset_end );
+        if ( rc == 0 )
+            rc = add_linear( ref, beg, end, offset_beg );
+        if ( rc != 0 )
+            LOGERR( klogErr, rc, "cannot insert into bam-index" );
+    }
+    return rc;
+}
+
+
+bool bam_index_valid( const struct bam_index * self )
+{
+    return self->sorted;
+}
+
+
+const char * bam_index_extension( const struct bam_index * self )
+{
+    return self->csi ? "csi" : "bai";
+}
+
+
+void release_bam_index( struct bam_index * self )
+{
+    if ( self != NULL )
+    {
+        if ( self->refs != NULL )
+        {
+            uint32_t i;
+            for ( i = 0; i < self->ref_count; ++i )
+            {
+                idx_ref * ref = &self->refs[ i ];
+                if ( ref->chunks != NULL )
+                    free( ref->chunks );
+                if ( ref->linear != NULL )
+                    free( ref->linear );
+                if ( ref->last_chunk != NULL )
+                    KVectorRelease( ref->last_chunk );
+            }
+            free( self->refs );
+        }
+        free( self );
+    }
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+
+/* the index is written raw ( BAI ) or BGZF-compressed ( CSI ) */
+typedef struct idx_out
+{
+    KFile * f;
+    uint64_t pos;
+    struct bgzf_writer * bgzf;
+    const struct bgzf_writer * bam;
+} idx_out;
+
+
+static rc_t CC idx_file_writer( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
+{
+    idx_out * out = self;
+    rc_t rc = KFileWriteAll( out->f, out->pos, buffer, bufsize, num_writ );
+    if ( rc == 0 )
+        out->pos += *num_writ;
+    return rc;
+}
+
+
+static rc_t idx_write( idx_out * out, const void * data, size_t size )
+{
+    rc_t rc;
+    if ( out->bgzf != NULL )
+        rc = bgzf_writer_write( out->bgzf, data, size );
+    else
+    {
+        size_t num_writ;
+        rc = idx_file_writer( out, data, size, &num_writ );
+        if ( rc == 0 && num_writ != size )
+            rc = RC( rcExe, rcIndex, rcWriting, rcTransfer, rcIncomplete );
+    }
+    return rc;
+}
+
+
+static rc_t idx_write_u32( idx_out * out, uint32_t value )
+{
+    uint8_t b[ 4 ];
+    b[ 0 ] = ( uint8_t )value;
+    b[ 1 ] = ( uint8_t )( value >> 8 );
+    b[ 2 ] = ( uint8_t )( value >> 16 );
+    b[ 3 ] = ( uint8_t )( value >> 24 );
+    return idx_write( out, b, sizeof b );
+}
+
+
+static rc_t idx_write_u64( idx_out * out, uint64_t value )
+{
+    rc_t rc = idx_write_u32( out, ( uint32_t )value );
+    if ( rc == 0 )
+        rc = idx_write_u32( out, ( uint32_t )( value >> 32 ) );
+    return rc;
+}
+
+
+static rc_t idx_write_voffset( idx_out * out, uint64_t block_offset )
+{
+    return idx_write_u64( out, bgzf_writer_voffset( out->bam, block_offset ) );
+}
+
+
+static int64_t CC cmp_chunk( const void * a, const void * b, void * data )
+{
+    const idx_chunk * ca = a;
+    const idx_chunk * cb = b;
+    if ( ca->bin != cb->bin )
+        return ( ca->bin < cb->bin ) ? -1 : 1;
+    if ( ca->beg != cb->beg )
+        return ( ca->beg < cb->beg ) ? -1 : 1;
+    return 0;
+}
+
+
+/* the linear offset of the first window of a bin, only written into CSI */
+static uint64_t bin_loffset( const bam_index * self, const uint64_t * linear, uint32_t linear_count, uint32_t bin )
+{
+    int32_t l;
+    for ( l = self->depth; l >= 0; --l )
+    {
+        uint32_t t = ( ( 1 << ( l * 3 ) ) - 1 ) / 7;
+        if ( bin >= t )
+        {
+            uint64_t beg = ( uint64_t )( bin - t ) << ( IDX_MIN_SHIFT + 3 * ( self->depth - l ) );
+            uint64_t w = beg >> IDX_MIN_SHIFT;
+            if ( linear_count == 0 )
+                return 0;
+            return ( w < linear_count ) ? linear[ w ] : linear[ linear_count - 1 ];
+        }
+    }
+    return 0;
+}
+
+
+static rc_t write_ref_index( const bam_index * self, idx_out * out, idx_ref * ref )
+{
+    rc_t rc = 0;
+    uint32_t n_bin = 0;
+    uint32_t i;
+    uint32_t meta_bin = ( ( 1 << ( ( self->depth + 1 ) * 3 ) ) - 1 ) / 7 + 1;
+    bool has_records = ( ref->n_mapped + ref->n_unmapped > 0 );
+
+    /* windows without records take the offset of the previous window */
+    for ( i = 1; i < ref->linear_count; ++i )
+    {
+        if ( ref->linear[ i ] == 0 )
+            ref->linear[ i ] = ref->linear[ i - 1 ];
+    }
+
+    ksort( ref->chunks, ref->chunk_count, sizeof *( ref->chunks ), cmp_chunk, NULL );
+    for ( i = 0; i < ref->chunk_count; ++i )
+    {
+        if ( i == 0 || ref->chunks[ i ].bin != ref->chunks[ i - 1 ].bin )
+            n_bin++;
+    }
+
+    rc = idx_write_u32( out, has_records ? n_bin + 1 : 0 );
+    for ( i = 0; rc == 0 && i < ref->chunk_count; )
+    {
+        uint32_t bin = ref->chunks[ i ].bin;
+        uint32_t n = 1;
+        while ( i + n < ref->chunk_count && ref->chunks[ i + n ].bin == bin )
+            n++;
+
+        rc = idx_write_u32( out, bin );
+        if ( rc == 0 && self->csi )
+            rc = idx_write_voffset( out, bin_loffset( self, ref->linear, ref->linear_count, bin ) );
+        if ( rc == 0 )
+            rc = idx_write_u32( out, n );
+        for ( ; rc == 0 && n > 0; --n, ++i )
+        {
+            rc = idx_write_voffset( out, ref->chunks[ i ].beg );
+            if ( rc == 0 )
+                rc = idx_write_voffset( out, ref->chunks[ i ].end );
+        }
+    }
+
+    /* the pseudo-bin with the offsets and counts of this reference */
+    if ( rc == 0 && has_records )
+    {
+        rc = idx_write_u32( out, meta_bin );
+        if ( rc == 0 && self->csi )
+            rc = idx_write_u64( out, 0 );
+        if ( rc == 0 )
+            rc = idx_write_u32( out, 2 );
+        if ( rc == 0 )
+            rc = idx_write_voffset( out, ref->off_beg );
+        if ( rc == 0 )
+            rc = idx_write_voffset( out, ref->off_end );
+        if ( rc == 0 )
+            rc = idx_write_u64( out, ref->n_mapped );
+        if ( rc == 0 )
+            rc = idx_write_u64( out, ref->n_unmapped );
+    }
+
+    if ( rc == 0 && !self->csi )
+    {
+        rc = idx_write_u32( out, ref->linear_count );
+        for ( i = 0; rc == 0 && i < ref->linear_count; ++i )
+            rc = idx_write_voffset( out, ref->linear[ i ] );
+    }
+    return rc;
+}
+
+
+rc_t write_bam_index( const struct bam_index * self, const char * filename, const struct bgzf_writer * bam )
+{
+    KDirectory * dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc != 0 )
+        LOGERR( klogInt, rc, "KDirectoryNativeDir() failed" );
+    else
+    {
+        KFile * f;
+        rc = KDirectoryCreateFile( dir, &f, false, 0664, kcmInit, "%s", filename );
+        if ( rc != 0 )
+        {
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create index-file '$(t)'", "t=%s", filename ) );
+        }
+        else
+        {
+            idx_out out;
+
+            memset( &out, 0, sizeof out );
+            out.bam = bam;
+            rc = KBufFileMakeWrite( &out.f, f, false, 64 * 1024 );
+            if ( rc == 0 && self->csi )
+                rc = make_bgzf_writer( &out.bgzf, idx_file_writer, &out, 1 ); /* bgzf_writer.c */
+
+            if ( rc == 0 )
+            {
+                uint32_t i;
+                if ( self->csi )
+                {
+                    rc = idx_write( &out, "CSI\1", 4 );
+                    if ( rc == 0 )
+                        rc = idx_write_u32( &out, IDX_MIN_SHIFT );
+                    if ( rc == 0 )
+                        rc = idx_write_u32( &out, self->depth );
+                    if ( rc == 0 )
+                        rc = idx_write_u32( &out, 0 ); /* no aux-data */
+                }
+                else
+                    rc = idx_write( &out, "BAI\1", 4 );
+
+                if ( rc == 0 )
+                    rc = idx_write_u32( &out, self->ref_count );
+                for ( i = 0; rc == 0 && i < self->ref_count; ++i )
+                    rc = write_ref_index( self, &out, &self->refs[ i ] );
+                if ( rc == 0 )
+                    rc = idx_write_u64( &out, self->n_no_coor );
+
+                if ( out.bgzf != NULL )
+                {
+                    if ( rc == 0 )
+                        rc = finish_bgzf_writer( out.bgzf ); /* bgzf_writer.c */
+                    release_bgzf_writer( out.bgzf ); /* bgzf_writer.c */
+                }
+                if ( out.f != NULL )
+                    KFileRelease( out.f );
+                if ( rc != 0 )
+                {
+                    (void)PLOGERR( klogErr, ( klogErr, rc, "cannot write index-file '$(t)'", "t=%s", filename ) );
+                }
+            }
+            KFileRelease( f );
+        }
+        KDirectoryRelease( dir );
+    }
+    return rc;
+}
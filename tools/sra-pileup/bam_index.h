@@ -0,0 +1,74 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_bam_index_
+#define _h_bam_index_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <klib/log.h>
+
+struct bgzf_writer;
+
+/*
+    collects the index of a coordinate-sorted BAM-file while it is written
+    the offsets given to bam_index_add() are block-offsets of the bgzf_writer,
+    they are translated into virtual offsets when the index is written
+
+    a BAI-index is produced if all references are shorter than 2^29,
+    a CSI-index otherwise
+*/
+struct bam_index;
+
+rc_t make_bam_index( struct bam_index ** self, uint32_t ref_count, const uint32_t * ref_lengths );
+
+/* ref_id < 0 ... a record without coordinates */
+rc_t bam_index_add( struct bam_index * self, int32_t ref_id, int64_t beg, int64_t end, bool mapped,
+                    uint64_t offset_beg, uint64_t offset_end );
+
+/* false if the records were not sorted by coordinate */
+bool bam_index_valid( const struct bam_index * self );
+
+/* "bai" or "csi" */
+const char * bam_index_extension( const struct bam_index * self );
+
+rc_t write_bam_index( const struct bam_index * self, const char * filename, const struct bgzf_writer * bam );
+
+void release_bam_index( struct bam_index * self );
+
+/* the bin of the BAM-record-field */
+uint16_t bam_reg2bin( int64_t beg, int64_t end );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1453 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bam_out.h"
+#include "bgzf_writer.h"
+#include "bam_index.h"
+
+#include <klib/text.h>
+#include <klib/printf.h>
+#include <klib/sort.h>
+#include <klib/out.h>
+#include <sysalloc.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CIGAR_OPS 0xFFFF
+
+/* a record of a worker-encoder travels through the output of the worker-thread as a frame,
+   its first byte never starts a line of SAM-text:
+   mark, ref-id, pos, end, mapped ( for the index ), then the record with its block_size */
+#define FRAME_MARK 0x01
+#define FRAME_HDR 14
+#define FRAME_MIN ( FRAME_HDR + 4 )
+
+typedef struct bam_buf
+{
+    uint8_t * data;
+    size_t used;
+    size_t size;
+} bam_buf;
+
+
+typedef struct bam_ref
+{
+    const char * name;  /* points into the header-text */
+    uint32_t name_len;
+    uint32_t len;
+} bam_ref;
+
+
+typedef struct bam_out
+{
+    const struct bam_out * parent;  /* a worker-encoder: no bgzf, the refs belong to the parent */
+    struct bgzf_writer * bgzf;
+    struct bam_index * idx;
+    char * bam_filename;
+
+    bam_buf line;       /* an incomplete line of SAM-text, or an incomplete frame */
+    bool in_frame;
+    bam_buf hdr;        /* the header-text, until the first record */
+    bam_buf rec;        /* the record beeing encoded */
+    bam_buf cigar;      /* the cigar-operations of this record */
+    bool hdr_written;
+
+    bool rec_open;      /* the fixed part of rec is encoded, the tags are missing */
+    bool rec_mapped;
+    int32_t rec_ref_id;
+    uint32_t rec_n_ops;
+    int64_t rec_pos;
+    int64_t rec_end;
+
+    bam_ref * refs;     /* in the order of the @SQ-lines */
+    uint32_t * sorted;  /* indices into refs, sorted by name */
+    uint32_t ref_count;
+    uint32_t ref_size;
+    int32_t last_ref;   /* the reference found by the last lookup */
+
+    uint8_t nt16[ 256 ];    /* ascii -> 4-bit base */
+} bam_out;
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static rc_t buf_reserve( bam_buf * buf, size_t size )
+{
+    if ( buf->used + size > buf->size )
+    {
+        size_t new_size = ( buf->size > 0 ) ? buf->size : 4096;
+        uint8_t * tmp;
+        while ( new_size < buf->used + size )
+            new_size *= 2;
+        tmp = realloc( buf->data, new_size );
+        if ( tmp == NULL )
+            return RC( rcExe, rcBuffer, rcResizing, rcMemory, rcExhausted );
+        buf->data = tmp;
+        buf->size = new_size;
+    }
+    return 0;
+}
+
+
+static rc_t buf_append( bam_buf * buf, const void * data, size_t size )
+{
+    rc_t rc = buf_reserve( buf, size );
+    if ( rc == 0 )
+    {
+        memmove( buf->data + buf->used, data, size );
+        buf->used += size;
+    }
+    return rc;
+}
+
+
+static rc_t buf_u8( bam_buf * buf, uint8_t value )
+{
+    return buf_append( buf, &value, 1 );
+}
+
+
+static rc_t buf_u16( bam_buf * buf, uint16_t value )
+{
+    uint8_t b[ 2 ];
+    b[ 0 ] = ( uint8_t )value;
+    b[ 1 ] = ( uint8_t )( value >> 8 );
+    return buf_append( buf, b, sizeof b );
+}
+
+
+static rc_t buf_u32( bam_buf * buf, uint32_t value )
+{
+    uint8_t b[ 4 ];
+    b[ 0 ] = ( uint8_t )value;
+    b[ 1 ] = ( uint8_t )( value >> 8 );
+    b[ 2 ] = ( uint8_t )( value >> 16 );
+    b[ 3 ] = ( uint8_t )( value >> 24 );
+    return buf_append( buf, b, sizeof b );
+}
+
+
+static void put_u32( uint8_t * dst, uint32_t value )
+{
+    dst[ 0 ] = ( uint8_t )value;
+    dst[ 1 ] = ( uint8_t )( value >> 8 );
+    dst[ 2 ] = ( uint8_t )( value >> 16 );
+    dst[ 3 ] = ( uint8_t )( value >> 24 );
+}
+
+
+static uint32_t get_u32( const uint8_t * src )
+{
+    return ( uint32_t )src[ 0 ] | ( ( uint32_t )src[ 1 ] << 8 ) |
+           ( ( uint32_t )src[ 2 ] << 16 ) | ( ( uint32_t )src[ 3 ] << 24 );
+}
+
+
+static void set_u32( bam_buf * buf, size_t at, uint32_t value )
+{
+    put_u32( buf->data + at, value );
+}
+
+
+static void release_buf( bam_buf * buf )
+{
+    if ( buf->data != NULL )
+        free( buf->data );
+    buf->data = NULL;
+    buf->used = buf->size = 0;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+typedef struct field
+{
+    const char * s;
+    size_t len;
+} field;
+
+
+static bool parse_i64( const field * f, int64_t * value )
+{
+    size_t i = 0;
+    bool neg = false;
+    int64_t v = 0;
+
+    if ( f->len == 0 )
+        return false;
+    if ( f->s[ 0 ] == '-' || f->s[ 0 ] == '+' )
+    {
+        neg = ( f->s[ 0 ] == '-' );
+        i = 1;
+        if ( f->len == 1 )
+            return false;
+    }
+    for ( ; i < f->len; ++i )
+    {
+        char c = f->s[ i ];
+        if ( c < '0' || c > '9' )
+            return false;
+        v = v * 10 + ( c - '0' );
+    }
+    *value = neg ? -v : v;
+    return true;
+}
+
+
+static bool parse_float( const char * s, size_t len, float * value )
+{
+    char tmp[ 64 ];
+    char * end;
+    if ( len == 0 || len >= sizeof tmp )
+        return false;
+    memmove( tmp, s, len );
+    tmp[ len ] = 0;
+    *value = ( float )strtod( tmp, &end );
+    return ( end == tmp + len );
+}
+
+
+/* splits s at the separator, the separator is consumed */
+static bool next_token( field * src, char separator, field * token )
+{
+    const char * p;
+    if ( src->s == NULL )
+        return false;
+    p = memchr( src->s, separator, src->len );
+    token->s = src->s;
+    if ( p == NULL )
+    {
+        token->len = src->len;
+        src->s = NULL;
+        src->len = 0;
+    }
+    else
+    {
+        token->len = p - src->s;
+        src->len -= ( token->len + 1 );
+        src->s = p + 1;
+    }
+    return true;
+}
+
+
+static bool field_is( const field * f, const char * s )
+{
+    size_t len = strlen( s );
+    return ( f->len == len && memcmp( f->s, s, len ) == 0 );
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static int64_t CC cmp_ref_idx( const void * a, const void * b, void * data )
+{
+    const bam_ref * refs = data;
+    const bam_ref * ra = &refs[ *( const uint32_t * )a ];
+    const bam_ref * rb = &refs[ *( const uint32_t * )b ];
+    uint32_t len = ( ra->name_len < rb->name_len ) ? ra->name_len : rb->name_len;
+    int64_t res = memcmp( ra->name, rb->name, len );
+    if ( res == 0 )
+        res = ( int64_t )ra->name_len - ( int64_t )rb->name_len;
+    return res;
+}
+
+
+static int cmp_name( const field * f, const bam_ref * ref )
+{
+    size_t len = ( f->len < ref->name_len ) ? f->len : ref->name_len;
+    int res = memcmp( f->s, ref->name, len );
+    if ( res == 0 )
+        res = ( f->len < ref->name_len ) ? -1 : ( ( f->len > ref->name_len ) ? 1 : 0 );
+    return res;
+}
+
+
+/* '*' is -1, an unknown reference is an error */
+static rc_t lookup_ref( bam_out * self, const field * name, int32_t * ref_id )
+{
+    uint32_t lo = 0, hi = self->ref_count;
+
+    if ( field_is( name, "*" ) )
+    {
+        *ref_id = -1;
+        return 0;
+    }
+    if ( self->last_ref >= 0 && cmp_name( name, &self->refs[ self->last_ref ] ) == 0 )
+    {
+        *ref_id = self->last_ref;
+        return 0;
+    }
+    while ( lo < hi )
+    {
+        uint32_t mid = ( lo + hi ) / 2;
+        int cmp = cmp_name( name, &self->refs[ self->sorted[ mid ] ] );
+        if ( cmp == 0 )
+        {
+            *ref_id = self->last_ref = ( int32_t )self->sorted[ mid ];
+            return 0;
+        }
+        if ( cmp < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    {
+        rc_t rc = RC( rcExe, rcNoTarg, rcWriting, rcId, rcNotFound );
+        (void)PLOGERR( klogErr, ( klogErr, rc, "reference '$(t)' not in the header ( needed for BAM-output )",
+                                  "t=%.*s", ( int )name->len, name->s ) );
+        return rc;
+    }
+}
+
+
+/* the @SQ-lines are only parsed, after the whole header is collected ( the text does not move anymore ) */
+static rc_t parse_header_refs( bam_out * self )
+{
+    rc_t rc = 0;
+    field text;
+
+    text.s = ( const char * )self->hdr.data;
+    text.len = self->hdr.used;
+    while ( rc == 0 && text.s != NULL && text.len > 0 )
+    {
+        field line, tag;
+        next_token( &text, '\n', &line );
+        if ( next_token( &line, '\t', &tag ) && field_is( &tag, "@SQ" ) )
+        {
+            bam_ref ref;
+            int64_t len = -1;
+
+            memset( &ref, 0, sizeof ref );
+            while ( next_token( &line, '\t', &tag ) )
+            {
+                if ( tag.len > 3 && memcmp( tag.s, "SN:", 3 ) == 0 )
+                {
+                    ref.name = tag.s + 3;
+                    ref.name_len = ( uint32_t )( tag.len - 3 );
+                }
+                else if ( tag.len > 3 && memcmp( tag.s, "LN:", 3 ) == 0 )
+                {
+                    field f;
+                    f.s = tag.s + 3;
+                    f.len = tag.len - 3;
+                    if ( !parse_i64( &f, &len ) )
+                        len = -1;
+                }
+            }
+            if ( ref.name == NULL || len < 0 || len > 0x7FFFFFFF )
+            {
+                rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                LOGERR( klogErr, rc, "invalid @SQ-line in the header" );
+            }
+            else
+            {
+                if ( self->ref_count >= self->ref_size )
+                {
+                    uint32_t new_size = ( self->ref_size > 0 ) ? self->ref_size * 2 : 64;
+                    bam_ref * tmp = realloc( self->refs, new_size * ( sizeof * tmp ) );
+                    if ( tmp == NULL )
+                        rc = RC( rcExe, rcNoTarg, rcParsing, rcMemory, rcExhausted );
+                    else
+                    {
+                        self->refs = tmp;
+                        self->ref_size = new_size;
+                    }
+                }
+                if ( rc == 0 )
+                {
+                    ref.len = ( uint32_t )len;
+                    self->refs[ self->ref_count++ ] = ref;
+                }
+            }
+        }
+    }
+
+    if ( rc == 0 && self->ref_count > 0 )
+    {
+        self->sorted = malloc( self->ref_count * ( sizeof *( self->sorted ) ) );
+        if ( self->sorted == NULL )
+            rc = RC( rcExe, rcNoTarg, rcParsing, rcMemory, rcExhausted );
+        else
+        {
+            uint32_t i;
+            for ( i = 0; i < self->ref_count; ++i )
+                self->sorted[ i ] = i;
+            ksort( self->sorted, self->ref_count, sizeof *( self->sorted ), cmp_ref_idx, self->refs );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t write_header( bam_out * self )
+{
+    rc_t rc = parse_header_refs( self );
+    if ( rc == 0 )
+    {
+        bam_buf * b = &self->rec;
+        uint32_t i;
+
+        b->used = 0;
+        rc = buf_append( b, "BAM\1", 4 );
+        if ( rc == 0 )
+            rc = buf_u32( b, ( uint32_t )self->hdr.used );
+        if ( rc == 0 )
+            rc = buf_append( b, self->hdr.data, self->hdr.used );
+        if ( rc == 0 )
+            rc = buf_u32( b, self->ref_count );
+        for ( i = 0; rc == 0 && i < self->ref_count; ++i )
+        {
+            rc = buf_u32( b, self->refs[ i ].name_len + 1 );
+            if ( rc == 0 )
+                rc = buf_append( b, self->refs[ i ].name, self->refs[ i ].name_len );
+            if ( rc == 0 )
+                rc = buf_u8( b, 0 );
+            if ( rc == 0 )
+                rc = buf_u32( b, self->refs[ i ].len );
+        }
+        if ( rc == 0 )
+            rc = bgzf_writer_write( self->bgzf, b->data, b->used ); /* bgzf_writer.c */
+
+        if ( rc == 0 && self->bam_filename != NULL )
+        {
+            uint32_t * lengths = calloc( self->ref_count + 1, sizeof * lengths );
+            if ( lengths == NULL )
+                rc = RC( rcExe, rcNoTarg, rcWriting, rcMemory, rcExhausted );
+            else
+            {
+                for ( i = 0; i < self->ref_count; ++i )
+                    lengths[ i ] = self->refs[ i ].len;
+                rc = make_bam_index( &self->idx, self->ref_count, lengths ); /* bam_index.c */
+                free( lengths );
+            }
+        }
+    }
+    self->hdr_written = true;
+    return rc;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static void init_nt16_table( uint8_t * table )
+{
+    const char * nt16 = "=ACMGRSVTWYHKDBN";
+    uint32_t i;
+    for ( i = 0; i < 256; ++i )
+        table[ i ] = 15;
+    for ( i = 0; i < 16; ++i )
+    {
+        table[ ( uint8_t )nt16[ i ] ] = ( uint8_t )i;
+        table[ ( uint8_t )tolower( nt16[ i ] ) ] = ( uint8_t )i;
+    }
+}
+
+
+static int32_t cigar_op_code( char c )
+{
+    switch( c )
+    {
+        case 'M' : return 0;
+        case 'I' : return 1;
+        case 'D' : return 2;
+        case 'N' : return 3;
+        case 'S' : return 4;
+        case 'H' : return 5;
+        case 'P' : return 6;
+        case '=' : return 7;
+        case 'X' : return 8;
+    }
+    return -1;
+}
+
+
+/* parses the cigar-string into self->cigar, returns the length on the reference */
+static rc_t encode_cigar( bam_out * self, const field * cigar, uint32_t * n_ops, int64_t * ref_len )
+{
+    rc_t rc = 0;
+    size_t i;
+    uint32_t len = 0;
+    bool have_len = false;
+
+    self->cigar.used = 0;
+    *n_ops = 0;
+    *ref_len = 0;
+    if ( field_is( cigar, "*" ) )
+        return 0;
+
+    for ( i = 0; rc == 0 && i < cigar->len; ++i )
+    {
+        char c = cigar->s[ i ];
+        if ( c >= '0' && c <= '9' )
+        {
+            len = len * 10 + ( c - '0' );
+            have_len = true;
+        }
+        else
+        {
+            int32_t op = cigar_op_code( c );
+            if ( op < 0 || !have_len || len > 0x0FFFFFFF )
+                rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+            else
+            {
+                rc = buf_u32( &self->cigar, ( len << 4 ) | ( uint32_t )op );
+                if ( op == 0 || op == 2 || op == 3 || op == 7 || op == 8 )
+                    *ref_len += len;
+                ( *n_ops )++;
+            }
+            len = 0;
+            have_len = false;
+        }
+    }
+    if ( rc == 0 && have_len )
+        rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+    return rc;
+}
+
+
+static rc_t encode_int_tag( bam_buf * b, int64_t v )
+{
+    rc_t rc;
+    if ( v < 0 )
+    {
+        if ( v >= -128 )
+        {
+            rc = buf_u8( b, 'c' );
+            if ( rc == 0 ) rc = buf_u8( b, ( uint8_t )( int8_t )v );
+        }
+        else if ( v >= -32768 )
+        {
+            rc = buf_u8( b, 's' );
+            if ( rc == 0 ) rc = buf_u16( b, ( uint16_t )( int16_t )v );
+        }
+        else
+        {
+            rc = buf_u8( b, 'i' );
+            if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )( int32_t )v );
+        }
+    }
+    else
+    {
+        if ( v <= 0xFF )
+        {
+            rc = buf_u8( b, 'C' );
+            if ( rc == 0 ) rc = buf_u8( b, ( uint8_t )v );
+        }
+        else if ( v <= 0xFFFF )
+        {
+            rc = buf_u8( b, 'S' );
+            if ( rc == 0 ) rc = buf_u16( b, ( uint16_t )v );
+        }
+        else
+        {
+            rc = buf_u8( b, 'I' );
+            if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )v );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t encode_array_tag( bam_buf * b, const field * value )
+{
+    field src = *value, item;
+    char sub;
+    size_t count_at;
+    uint32_t count = 0;
+    rc_t rc;
+
+    if ( !next_token( &src, ',', &item ) || item.len != 1 )
+        return RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+    sub = item.s[ 0 ];
+    rc = buf_u8( b, 'B' );
+    if ( rc == 0 )
+        rc = buf_u8( b, ( uint8_t )sub );
+    count_at = b->used;
+    if ( rc == 0 )
+        rc = buf_u32( b, 0 );
+    while ( rc == 0 && next_token( &src, ',', &item ) )
+    {
+        int64_t v;
+        float f;
+        switch( sub )
+        {
+            case 'c' :
+            case 'C' : if ( !parse_i64( &item, &v ) ) rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                       else rc = buf_u8( b, ( uint8_t )v );
+                       break;
+            case 's' :
+            case 'S' : if ( !parse_i64( &item, &v ) ) rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                       else rc = buf_u16( b, ( uint16_t )v );
+                       break;
+            case 'i' :
+            case 'I' : if ( !parse_i64( &item, &v ) ) rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                       else rc = buf_u32( b, ( uint32_t )v );
+                       break;
+            case 'f' : if ( !parse_float( item.s, item.len, &f ) ) rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                       else
+                       {
+                           uint32_t u;
+                           memmove( &u, &f, sizeof u );
+                           rc = buf_u32( b, u );
+                       }
+                       break;
+            default  : rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid ); break;
+        }
+        count++;
+    }
+    if ( rc == 0 )
+        set_u32( b, count_at, count );
+    return rc;
+}
+
+
+/* TAG:TYPE:VALUE */
+static rc_t encode_tag( bam_buf * b, const field * tag )
+{
+    rc_t rc;
+    field value;
+    char type;
+
+    if ( tag->len < 5 || tag->s[ 2 ] != ':' || tag->s[ 4 ] != ':' )
+        return RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+    type = tag->s[ 3 ];
+    value.s = tag->s + 5;
+    value.len = tag->len - 5;
+
+    rc = buf_append( b, tag->s, 2 );
+    if ( rc == 0 )
+    {
+        switch( type )
+        {
+            case 'A' : if ( value.len != 1 )
+                           rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                       else
+                       {
+                           rc = buf_u8( b, 'A' );
+                           if ( rc == 0 ) rc = buf_u8( b, ( uint8_t )value.s[ 0 ] );
+                       }
+                       break;
+
+            case 'i' : {
+                           int64_t v;
+                           if ( !parse_i64( &value, &v ) || v < -2147483647LL - 1 || v > 0xFFFFFFFFLL )
+                               rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                           else
+                               rc = encode_int_tag( b, v );
+                       }
+                       break;
+
+            case 'f' : {
+                           float f;
+                           if ( !parse_float( value.s, value.len, &f ) )
+                               rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+                           else
+                           {
+                               uint32_t u;
+                               memmove( &u, &f, sizeof u );
+                               rc = buf_u8( b, 'f' );
+                               if ( rc == 0 ) rc = buf_u32( b, u );
+                           }
+                       }
+                       break;
+
+            case 'Z' :
+            case 'H' : rc = buf_u8( b, ( uint8_t )type );
+                       if ( rc == 0 ) rc = buf_append( b, value.s, value.len );
+                       if ( rc == 0 ) rc = buf_u8( b, 0 );
+                       break;
+
+            case 'B' : rc = encode_array_tag( b, &value ); break;
+
+            default  : rc = RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid ); break;
+        }
+    }
+    return rc;
+}
+
+
+/* the 4-bit bases and the phred-values, reversed ( and complemented ) if asked for */
+static rc_t encode_seq_qual( bam_out * self, const bam_rec_fields * r )
+{
+    /* the complement of a 4-bit base is the base with the bits reversed */
+    static const uint8_t cmp16[ 16 ] = { 0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15 };
+    bam_buf * b = &self->rec;
+    size_t l_seq = r->seq_len;
+    rc_t rc = buf_reserve( b, ( l_seq + 1 ) / 2 + l_seq );
+    if ( rc == 0 )
+    {
+        uint8_t * dst = b->data + b->used;
+        const uint8_t * nt16 = self->nt16;
+        const uint8_t * seq = ( const uint8_t * )r->seq;
+        const uint8_t * qual = ( const uint8_t * )r->qual;
+        uint8_t ofs = ( uint8_t )r->qual_offset;
+        size_t j;
+
+        if ( !r->reverse )
+        {
+            for ( j = 0; j + 1 < l_seq; j += 2 )
+                *dst++ = ( nt16[ seq[ j ] ] << 4 ) | nt16[ seq[ j + 1 ] ];
+            if ( j < l_seq )
+                *dst++ = nt16[ seq[ j ] ] << 4;
+        }
+        else
+        {
+            for ( j = 0; j + 1 < l_seq; j += 2 )
+                *dst++ = ( cmp16[ nt16[ seq[ l_seq - 1 - j ] ] ] << 4 ) | cmp16[ nt16[ seq[ l_seq - 2 - j ] ] ];
+            if ( j < l_seq )
+                *dst++ = cmp16[ nt16[ seq[ 0 ] ] ] << 4;
+        }
+
+        if ( qual == NULL )
+            memset( dst, 0xFF, l_seq );
+        else
+        {
+            for ( j = 0; j < l_seq; ++j )
+            {
+                uint8_t q = ( uint8_t )( qual[ r->reverse ? l_seq - 1 - j : j ] - ofs );
+                dst[ j ] = ( r->qual_map != NULL ) ? r->qual_map[ q ] : q;
+            }
+        }
+        b->used += ( l_seq + 1 ) / 2 + l_seq;
+    }
+    return rc;
+}
+
+
+/* encodes the fixed part of a record into self->rec, the record stays open for the tags */
+static rc_t encode_fields( bam_out * self, const bam_rec_fields * r )
+{
+    rc_t rc = 0;
+    field name, cigar;
+    int64_t ref_len;
+    int32_t ref_id, next_ref_id;
+    uint32_t n_ops;
+    size_t l_seq = r->seq_len;
+    bam_buf * b = &self->rec;
+
+    if ( r->qname_len == 0 || r->qname_len > 254 || ( r->qual != NULL && r->qual_len != l_seq ) )
+        return RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+
+    name.s = r->rname;
+    name.len = r->rname_len;
+    rc = lookup_ref( self, &name, &ref_id );
+    if ( rc == 0 )
+    {
+        name.s = r->rnext;
+        name.len = r->rnext_len;
+        if ( field_is( &name, "=" ) )
+            next_ref_id = ref_id;
+        else
+            rc = lookup_ref( self, &name, &next_ref_id );
+    }
+    if ( rc == 0 )
+    {
+        cigar.s = r->cigar;
+        cigar.len = r->cigar_len;
+        rc = encode_cigar( self, &cigar, &n_ops, &ref_len );
+    }
+    if ( rc != 0 )
+        return rc;
+
+    self->rec_ref_id = ref_id;
+    self->rec_pos = r->pos;
+    self->rec_end = ( ( r->flag & 4 ) == 0 && ref_len > 0 ) ? r->pos + ref_len : r->pos + 1;
+    self->rec_mapped = ( ( r->flag & 4 ) == 0 );
+    self->rec_n_ops = n_ops;
+
+    b->used = 0;
+    rc = buf_u32( b, 0 );    /* block_size, set at the end */
+    if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )ref_id );
+    if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )( int32_t )r->pos );
+    if ( rc == 0 ) rc = buf_u8( b, ( uint8_t )( r->qname_len + 1 ) );
+    if ( rc == 0 ) rc = buf_u8( b, ( uint8_t )r->mapq );
+    if ( rc == 0 ) rc = buf_u16( b, bam_reg2bin( self->rec_pos, self->rec_end ) ); /* bam_index.c */
+    /* too many cigar-operations are moved into the CG-tag, the record gets a placeholder */
+    if ( rc == 0 ) rc = buf_u16( b, ( uint16_t )( n_ops > MAX_CIGAR_OPS ? 2 : n_ops ) );
+    if ( rc == 0 ) rc = buf_u16( b, ( uint16_t )r->flag );
+    if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )l_seq );
+    if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )next_ref_id );
+    if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )( int32_t )r->pnext );
+    if ( rc == 0 ) rc = buf_u32( b, ( uint32_t )( int32_t )r->tlen );
+    if ( rc == 0 ) rc = buf_append( b, r->qname, r->qname_len );
+    if ( rc == 0 ) rc = buf_u8( b, 0 );
+
+    if ( rc == 0 )
+    {
+        if ( n_ops > MAX_CIGAR_OPS )
+        {
+            rc = buf_u32( b, ( ( uint32_t )l_seq << 4 ) | 4 );
+            if ( rc == 0 ) rc = buf_u32( b, ( ( uint32_t )ref_len << 4 ) | 3 );
+        }
+        else
+            rc = buf_append( b, self->cigar.data, self->cigar.used );
+    }
+
+    if ( rc == 0 && l_seq > 0 )
+        rc = encode_seq_qual( self, r );
+    if ( rc == 0 )
+        self->rec_open = true;
+    return rc;
+}
+
+
+/* compresses the encoded record and adds it to the index */
+static rc_t write_rec( bam_out * self, const uint8_t * rec, size_t len,
+                       int32_t ref_id, int64_t pos, int64_t end, bool mapped )
+{
+    uint64_t offset_beg, offset_end;
+
+    /* a record is not split across blocks, if it fits into one */
+    rc_t rc = bgzf_writer_reserve( self->bgzf, len ); /* bgzf_writer.c */
+    offset_beg = bgzf_writer_tell( self->bgzf );
+    if ( rc == 0 )
+        rc = bgzf_writer_write( self->bgzf, rec, len ); /* bgzf_writer.c */
+    offset_end = bgzf_writer_tell( self->bgzf );
+
+    if ( rc == 0 && self->idx != NULL )
+        rc = bam_index_add( self->idx, pos < 0 ? -1 : ref_id, pos, end, mapped,
+                            offset_beg, offset_end ); /* bam_index.c */
+    return rc;
+}
+
+
+/* the writer of the worker-thread is its out_buffer, not the parent */
+static rc_t kout_write( const void * data, size_t size )
+{
+    rc_t rc = 0;
+    KWrtWriter writer = KOutWriterGet();
+    void * writer_data = KOutDataGet();
+    const char * src = data;
+    while ( rc == 0 && size > 0 )
+    {
+        size_t num_writ = 0;
+        rc = writer( writer_data, src, size, &num_writ );
+        if ( rc == 0 && num_writ == 0 )
+            rc = RC( rcExe, rcNoTarg, rcWriting, rcTransfer, rcIncomplete );
+        src += num_writ;
+        size -= num_writ;
+    }
+    return rc;
+}
+
+
+static rc_t print_frame( bam_out * self )
+{
+    uint8_t hdr[ FRAME_HDR ];
+    rc_t rc;
+
+    hdr[ 0 ] = FRAME_MARK;
+    put_u32( hdr + 1, ( uint32_t )self->rec_ref_id );
+    put_u32( hdr + 5, ( uint32_t )( int32_t )self->rec_pos );
+    put_u32( hdr + 9, ( uint32_t )( int32_t )self->rec_end );
+    hdr[ 13 ] = self->rec_mapped ? 1 : 0;
+    rc = kout_write( hdr, sizeof hdr );
+    if ( rc == 0 )
+        rc = kout_write( self->rec.data, self->rec.used );
+    return rc;
+}
+
+
+/* a complete frame, as printed by print_frame() */
+static rc_t write_frame( bam_out * self, const uint8_t * frame, size_t len )
+{
+    return write_rec( self, frame + FRAME_HDR, len - FRAME_HDR,
+                      ( int32_t )get_u32( frame + 1 ),
+                      ( int32_t )get_u32( frame + 5 ),
+                      ( int32_t )get_u32( frame + 9 ),
+                      frame[ 13 ] != 0 );
+}
+
+
+/* the bytes of the frame in self->line still missing */
+static size_t frame_missing( const bam_out * self )
+{
+    if ( self->line.used < FRAME_MIN )
+        return FRAME_MIN - self->line.used;
+    return FRAME_MIN + get_u32( self->line.data + FRAME_HDR ) - self->line.used;
+}
+
+
+/* encodes the tab-separated tags into the open record and writes it */
+static rc_t finish_record( bam_out * self, field * tags )
+{
+    rc_t rc = 0;
+    bam_buf * b = &self->rec;
+    field tag;
+
+    self->rec_open = false;
+    while ( rc == 0 && next_token( tags, '\t', &tag ) )
+        rc = encode_tag( b, &tag );
+
+    if ( rc == 0 && self->rec_n_ops > MAX_CIGAR_OPS )
+    {
+        rc = buf_append( b, "CGBI", 4 );
+        if ( rc == 0 ) rc = buf_u32( b, self->rec_n_ops );
+        if ( rc == 0 ) rc = buf_append( b, self->cigar.data, self->cigar.used );
+    }
+
+    if ( rc == 0 )
+    {
+        set_u32( b, 0, ( uint32_t )( b->used - 4 ) );
+        if ( self->parent != NULL )
+            rc = print_frame( self );
+        else
+            rc = write_rec( self, b->data, b->used, self->rec_ref_id,
+                            self->rec_pos, self->rec_end, self->rec_mapped );
+    }
+    return rc;
+}
+
+
+/* QNAME FLAG RNAME POS MAPQ CIGAR RNEXT PNEXT TLEN SEQ QUAL [TAGS] */
+static rc_t encode_record( bam_out * self, const char * line, size_t len )
+{
+    rc_t rc;
+    field src, f[ 11 ];
+    int64_t flag, pos, mapq, pnext, tlen;
+    bam_rec_fields r;
+    uint32_t i;
+
+    src.s = line;
+    src.len = len;
+    for ( i = 0; i < 11; ++i )
+    {
+        if ( !next_token( &src, '\t', &f[ i ] ) )
+            return RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInsufficient );
+    }
+
+    if ( !parse_i64( &f[ 1 ], &flag ) || !parse_i64( &f[ 3 ], &pos ) || !parse_i64( &f[ 4 ], &mapq ) ||
+         !parse_i64( &f[ 7 ], &pnext ) || !parse_i64( &f[ 8 ], &tlen ) )
+        return RC( rcExe, rcNoTarg, rcParsing, rcFormat, rcInvalid );
+
+    r.qname = f[ 0 ].s;     r.qname_len = ( uint32_t )f[ 0 ].len;
+    r.rname = f[ 2 ].s;     r.rname_len = ( uint32_t )f[ 2 ].len;
+    r.rnext = f[ 6 ].s;     r.rnext_len = ( uint32_t )f[ 6 ].len;
+    r.cigar = f[ 5 ].s;     r.cigar_len = ( uint32_t )f[ 5 ].len;
+    r.seq = f[ 9 ].s;       r.seq_len = field_is( &f[ 9 ], "*" ) ? 0 : ( uint32_t )f[ 9 ].len;
+    r.qual = f[ 10 ].s;     r.qual_len = ( uint32_t )f[ 10 ].len;
+    r.qual_map = NULL;
+    r.qual_offset = 33;
+    r.reverse = false;
+    if ( field_is( &f[ 10 ], "*" ) )
+    {
+        r.qual = NULL;
+        r.qual_len = 0;
+    }
+    r.pos = pos - 1;        /* BAM is 0-based */
+    r.pnext = pnext - 1;
+    r.tlen = tlen;
+    r.flag = ( uint32_t )flag;
+    r.mapq = ( uint32_t )mapq;
+
+    rc = encode_fields( self, &r );
+    if ( rc == 0 )
+        rc = finish_record( self, &src );
+    return rc;
+}
+
+
+static rc_t process_line( bam_out * self, const char * line, size_t len )
+{
+    rc_t rc = 0;
+
+    if ( len > 0 && line[ len - 1 ] == '\r' )
+        len--;
+
+    if ( self->rec_open )
+    {
+        /* the rest of a record started by bam_out_begin_record(): only the tags */
+        field tags;
+        tags.s = line;
+        tags.len = len;
+        if ( len > 0 && line[ 0 ] == '\t' )
+        {
+            tags.s++;
+            tags.len--;
+        }
+        else if ( len == 0 )
+            tags.s = NULL;
+        rc = finish_record( self, &tags );
+        if ( GetRCState( rc ) == rcInvalid )
+        {
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot encode the tags '$(t)' into BAM",
+                                      "t=%.*s", ( int )( len > 80 ? 80 : len ), line ) );
+        }
+        return rc;
+    }
+    if ( len == 0 )
+        return 0;
+
+    if ( line[ 0 ] == '@' )
+    {
+        if ( self->hdr_written )
+        {
+            rc = RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+            LOGERR( klogErr, rc, "header-line after the first alignment, cannot be written into BAM" );
+        }
+        else
+        {
+            rc = buf_append( &self->hdr, line, len );
+            if ( rc == 0 )
+                rc = buf_u8( &self->hdr, '\n' );
+        }
+    }
+    else
+    {
+        if ( !self->hdr_written )
+            rc = write_header( self );
+        if ( rc == 0 )
+        {
+            rc = encode_record( self, line, len );
+            if ( GetRCState( rc ) == rcInvalid || GetRCState( rc ) == rcInsufficient )
+            {
+                (void)PLOGERR( klogErr, ( klogErr, rc, "cannot encode '$(t)' into BAM",
+                                          "t=%.*s", ( int )( len > 80 ? 80 : len ), line ) );
+            }
+        }
+    }
+    return rc;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+rc_t make_bam_out( struct bam_out ** self, KWrtWriter writer, void * writer_data,
+                   uint32_t threads, const char * bam_filename )
+{
+    rc_t rc = 0;
+    bam_out * o = calloc( 1, sizeof * o );
+    *self = NULL;
+    if ( o == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        LOGERR( klogErr, rc, "cannot create bam-writer" );
+    }
+    else
+    {
+        o->last_ref = -1;
+        init_nt16_table( o->nt16 );
+        if ( bam_filename != NULL )
+        {
+            o->bam_filename = string_dup_measure( bam_filename, NULL );
+            if ( o->bam_filename == NULL )
+                rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        }
+        if ( rc == 0 )
+            rc = make_bgzf_writer( &o->bgzf, writer, writer_data, threads ); /* bgzf_writer.c */
+        if ( rc == 0 )
+            *self = o;
+        else
+            release_bam_out( o );
+    }
+    return rc;
+}
+
+
+rc_t bam_out_write( struct bam_out * self, const char * text, size_t size )
+{
+    rc_t rc = 0;
+    while ( rc == 0 && size > 0 )
+    {
+        const char * nl;
+
+        if ( self->in_frame ||
+             ( self->line.used == 0 && !self->rec_open && ( uint8_t )text[ 0 ] == FRAME_MARK ) )
+        {
+            /* a record, encoded by a worker-encoder */
+            const uint8_t * src = ( const uint8_t * )text;
+            size_t n;
+            if ( !self->in_frame && size >= FRAME_MIN && size - FRAME_MIN >= get_u32( src + FRAME_HDR ) )
+            {
+                n = FRAME_MIN + get_u32( src + FRAME_HDR );
+                rc = write_frame( self, src, n );
+            }
+            else
+            {
+                /* the frame continues in the next call */
+                self->in_frame = true;
+                n = frame_missing( self );
+                if ( n > size )
+                    n = size;
+                rc = buf_append( &self->line, text, n );
+                if ( rc == 0 && frame_missing( self ) == 0 )
+                {
+                    rc = write_frame( self, self->line.data, self->line.used );
+                    self->line.used = 0;
+                    self->in_frame = false;
+                }
+            }
+            text += n;
+            size -= n;
+        }
+        else if ( ( nl = memchr( text, '\n', size ) ) == NULL )
+        {
+            /* keep the incomplete line for the next call */
+            rc = buf_append( &self->line, text, size );
+            size = 0;
+        }
+        else
+        {
+            size_t len = nl - text;
+            if ( self->line.used == 0 )
+                rc = process_line( self, text, len );
+            else
+            {
+                rc = buf_append( &self->line, text, len );
+                if ( rc == 0 )
+                    rc = process_line( self, ( const char * )self->line.data, self->line.used );
+                self->line.used = 0;
+            }
+            text += len + 1;
+            size -= len + 1;
+        }
+    }
+    return rc;
+}
+
+
+rc_t bam_out_begin_record( struct bam_out * self, const bam_rec_fields * fields )
+{
+    rc_t rc = 0;
+    /* what was printed before as text has to be complete */
+    if ( self->line.used > 0 )
+    {
+        rc = process_line( self, ( const char * )self->line.data, self->line.used );
+        self->line.used = 0;
+    }
+    if ( rc == 0 && self->rec_open )
+    {
+        rc = RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+        LOGERR( klogInt, rc, "the previous BAM-record was not finished" );
+    }
+    if ( rc == 0 && !self->hdr_written )
+        rc = write_header( self );
+    if ( rc == 0 )
+    {
+        rc = encode_fields( self, fields );
+        if ( GetRCState( rc ) == rcInvalid )
+        {
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot encode '$(t)' into BAM",
+                                      "t=%.*s", ( int )fields->qname_len, fields->qname ) );
+        }
+    }
+    return rc;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static rc_t tag_begin( bam_out * self, const char * tag, char type )
+{
+    rc_t rc;
+    if ( !self->rec_open )
+    {
+        rc = RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+        LOGERR( klogInt, rc, "no BAM-record started for the optional field" );
+    }
+    else
+    {
+        rc = buf_append( &self->rec, tag, 2 );
+        if ( rc == 0 && type != 0 )
+            rc = buf_u8( &self->rec, ( uint8_t )type );
+    }
+    return rc;
+}
+
+
+rc_t bam_out_tag_int( struct bam_out * self, const char * tag, int64_t value )
+{
+    rc_t rc = tag_begin( self, tag, 0 );
+    if ( rc == 0 )
+    {
+        if ( value < -2147483647LL - 1 || value > 0xFFFFFFFFLL )
+            rc = RC( rcExe, rcNoTarg, rcWriting, rcRange, rcExcessive );
+        else
+            rc = encode_int_tag( &self->rec, value );
+    }
+    return rc;
+}
+
+
+rc_t bam_out_tag_char( struct bam_out * self, const char * tag, char value )
+{
+    rc_t rc = tag_begin( self, tag, 'A' );
+    if ( rc == 0 )
+        rc = buf_u8( &self->rec, ( uint8_t )value );
+    return rc;
+}
+
+
+rc_t bam_out_tag_string( struct bam_out * self, const char * tag, const char * value, size_t len )
+{
+    rc_t rc = tag_begin( self, tag, 'Z' );
+    if ( rc == 0 && len > 0 )
+        rc = buf_append( &self->rec, value, len );
+    if ( rc == 0 )
+        rc = buf_u8( &self->rec, 0 );
+    return rc;
+}
+
+
+rc_t bam_out_tag_text( struct bam_out * self, const char * text, size_t len )
+{
+    rc_t rc = 0;
+    field src, tag;
+
+    if ( !self->rec_open )
+    {
+        rc = RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+        LOGERR( klogInt, rc, "no BAM-record started for the optional field" );
+        return rc;
+    }
+    src.s = text;
+    src.len = len;
+    while ( rc == 0 && src.len > 0 && next_token( &src, '\t', &tag ) )
+    {
+        if ( tag.len > 0 )
+            rc = encode_tag( &self->rec, &tag );
+    }
+    if ( GetRCState( rc ) == rcInvalid )
+    {
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot encode the tags '$(t)' into BAM",
+                                  "t=%.*s", ( int )( len > 80 ? 80 : len ), text ) );
+    }
+    return rc;
+}
+
+
+rc_t bam_out_end_record( struct bam_out * self )
+{
+    field no_tags;
+    if ( !self->rec_open )
+    {
+        rc_t rc = RC( rcExe, rcNoTarg, rcWriting, rcFormat, rcInvalid );
+        LOGERR( klogInt, rc, "no BAM-record started" );
+        return rc;
+    }
+    no_tags.s = NULL;
+    no_tags.len = 0;
+    return finish_record( self, &no_tags );
+}
+
+
+rc_t finish_bam_out( struct bam_out * self )
+{
+    rc_t rc = 0;
+    if ( self->in_frame )
+    {
+        rc = RC( rcExe, rcNoTarg, rcWriting, rcTransfer, rcIncomplete );
+        LOGERR( klogInt, rc, "incomplete BAM-record from a worker-thread" );
+    }
+    else if ( self->line.used > 0 )
+    {
+        rc = process_line( self, ( const char * )self->line.data, self->line.used );
+        self->line.used = 0;
+    }
+    if ( rc == 0 && self->rec_open )
+    {
+        field no_tags;
+        no_tags.s = NULL;
+        no_tags.len = 0;
+        rc = finish_record( self, &no_tags );
+    }
+    if ( rc == 0 && !self->hdr_written )
+        rc = write_header( self );
+    if ( rc == 0 )
+        rc = finish_bgzf_writer( self->bgzf ); /* bgzf_writer.c */
+
+    if ( rc == 0 && self->idx != NULL )
+    {
+        if ( !bam_index_valid( self->idx ) )
+            LOGMSG( klogWarn, "the output is not sorted by coordinate, no index written" );
+        else
+        {
+            char filename[ 4096 ];
+            size_t num_writ;
+            rc = string_printf( filename, sizeof filename, &num_writ, "%s.%s",
+                                self->bam_filename, bam_index_extension( self->idx ) );
+            if ( rc == 0 )
+                rc = write_bam_index( self->idx, filename, self->bgzf ); /* bam_index.c */
+        }
+    }
+    return rc;
+}
+
+
+void release_bam_out( struct bam_out * self )
+{
+    if ( self != NULL )
+    {
+        release_bgzf_writer( self->bgzf );
+        release_bam_index( self->idx );
+        release_buf( &self->line );
+        release_buf( &self->hdr );
+        release_buf( &self->rec );
+        release_buf( &self->cigar );
+        if ( self->parent == NULL && self->refs != NULL )
+            free( self->refs );
+        if ( self->parent == NULL && self->sorted != NULL )
+            free( self->sorted );
+        if ( self->bam_filename != NULL )
+            free( self->bam_filename );
+        free( self );
+    }
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+rc_t bam_out_write_header( struct bam_out * self )
+{
+    rc_t rc = 0;
+    if ( self->line.used > 0 )
+    {
+        rc = process_line( self, ( const char * )self->line.data, self->line.used );
+        self->line.used = 0;
+    }
+    if ( rc == 0 && !self->hdr_written )
+        rc = write_header( self );
+    return rc;
+}
+
+
+rc_t make_bam_out_worker( struct bam_out ** self, const struct bam_out * parent )
+{
+    rc_t rc = 0;
+    bam_out * o;
+
+    *self = NULL;
+    if ( !parent->hdr_written )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcFormat, rcIncomplete );
+        LOGERR( klogInt, rc, "the BAM-header is not written before the worker-encoders are made" );
+        return rc;
+    }
+    o = calloc( 1, sizeof * o );
+    if ( o == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        LOGERR( klogErr, rc, "cannot create bam-writer" );
+    }
+    else
+    {
+        /* the parent does not change its references after the header is written */
+        o->parent = parent;
+        o->refs = parent->refs;
+        o->sorted = parent->sorted;
+        o->ref_count = parent->ref_count;
+        o->hdr_written = true;
+        o->last_ref = -1;
+        memmove( o->nt16, parent->nt16, sizeof o->nt16 );
+        *self = o;
+    }
+    return rc;
+}
+
+
+/* the worker-encoder attached to the calling thread */
+#if defined( _MSC_VER )
+static __declspec( thread ) bam_out * tl_bam_out = NULL;
+#else
+static __thread bam_out * tl_bam_out = NULL;
+#endif
+
+
+void attach_bam_out( struct bam_out * self )
+{
+    tl_bam_out = self;
+}
+
+
+/* ----------------------------------------------------------------------------------------- */
+
+static rc_t CC bam_redir_callback( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
+{
+    bam_redir * redir = ( bam_redir * )self;
+    rc_t rc = bam_out_write( redir->bam, buffer, bufsize );
+    *num_writ = ( rc == 0 ) ? bufsize : 0;
+    return rc;
+}
+
+
+rc_t init_bam_redir( bam_redir * self, uint32_t threads, const char * bam_filename )
+{
+    rc_t rc;
+    self->org_writer = KOutWriterGet();
+    self->org_data = KOutDataGet();
+    rc = make_bam_out( &self->bam, self->org_writer, self->org_data, threads, bam_filename );
+    if ( rc == 0 )
+    {
+        rc = KOutHandlerSet( bam_redir_callback, self );
+        if ( rc != 0 )
+            LOGERR( klogInt, rc, "KOutHandlerSet() failed" );
+    }
+    if ( rc != 0 )
+    {
+        release_bam_out( self->bam );
+        self->bam = NULL;
+        self->org_writer = NULL;
+    }
+    return rc;
+}
+
+
+struct bam_out * bam_redir_current( void )
+{
+    if ( tl_bam_out != NULL )
+        return tl_bam_out;
+    if ( KOutWriterGet() == bam_redir_callback )
+    {
+        bam_redir * redir = KOutDataGet();
+        if ( redir != NULL )
+            return redir->bam;
+    }
+    return NULL;
+}
+
+
+rc_t finish_bam_redir( bam_redir * self )
+{
+    rc_t rc = 0;
+    if ( self->bam != NULL )
+        rc = finish_bam_out( self->bam );
+    return rc;
+}
+
+
+void release_bam_redir( bam_redir * self )
+{
+    if( self->org_writer != NULL )
+    {
+        KOutHandlerSet( self->org_writer, self->org_data );
+    }
+    self->org_writer = NULL;
+    release_bam_out( self->bam );
+    self->bam = NULL;
+}
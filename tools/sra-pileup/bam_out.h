@@ -0,0 +1,146 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_bam_out_
+#define _h_bam_out_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/writer.h>
+
+/*
+    turns the SAM-text produced by sam-dump into BAM:
+    the header-lines are collected until the first record, the reference-dictionary
+    is taken from the @SQ-lines, every following line is encoded into a binary record
+    the records are written in BGZF-blocks, compressed by 'threads' worker-threads
+    the printers of the records hand the fields over directly ( bam_out_begin_record,
+    bam_out_tag_..., bam_out_end_record ), SAM-text is still accepted for everything else
+
+    if bam_filename is not NULL, a BAI/CSI-index is built in the same pass and written
+    into bam_filename.bai or bam_filename.csi ( if a reference is longer than 2^29 )
+*/
+struct bam_out;
+
+rc_t make_bam_out( struct bam_out ** self, KWrtWriter writer, void * writer_data,
+                   uint32_t threads, const char * bam_filename );
+
+/* the text does not need to be aligned to lines */
+rc_t bam_out_write( struct bam_out * self, const char * text, size_t size );
+
+/* the fixed fields of a record, handed over directly instead of as SAM-text */
+typedef struct bam_rec_fields
+{
+    const char * qname;
+    const char * rname;         /* "*" ... no reference */
+    const char * rnext;         /* "=" ... same as rname, "*" ... no mate */
+    const char * cigar;         /* cigar-string, "*" or empty ... none */
+    const char * seq;
+    const char * qual;          /* phred + 33, NULL ... not available */
+    const uint8_t * qual_map;   /* maps the phred-values ( quantization ), can be NULL */
+    uint32_t qual_offset;       /* 33 ... qual is SAM-text, 0 ... qual are phred-values */
+    bool reverse;               /* seq is reverse-complemented, qual reversed */
+    uint32_t qname_len;
+    uint32_t rname_len;
+    uint32_t rnext_len;
+    uint32_t cigar_len;
+    uint32_t seq_len;
+    uint32_t qual_len;
+    int64_t pos;                /* 0-based, -1 ... none */
+    int64_t pnext;              /* 0-based, -1 ... none */
+    int64_t tlen;
+    uint32_t flag;
+    uint32_t mapq;
+} bam_rec_fields;
+
+/* starts a record from the fields, the optional fields follow either via bam_out_tag_...()
+   and bam_out_end_record(), or as the text written next up to the newline ( TAB TAG:TYPE:VALUE ) */
+rc_t bam_out_begin_record( struct bam_out * self, const bam_rec_fields * fields );
+
+/* optional fields of the started record, tag has 2 characters */
+rc_t bam_out_tag_int( struct bam_out * self, const char * tag, int64_t value );
+
+rc_t bam_out_tag_char( struct bam_out * self, const char * tag, char value );
+
+rc_t bam_out_tag_string( struct bam_out * self, const char * tag, const char * value, size_t len );
+
+/* pre-formatted optional fields: TAG:TYPE:VALUE, separated by TAB */
+rc_t bam_out_tag_text( struct bam_out * self, const char * text, size_t len );
+
+/* the started record is complete */
+rc_t bam_out_end_record( struct bam_out * self );
+
+/* writes the last block, the EOF-marker and the index */
+rc_t finish_bam_out( struct bam_out * self );
+
+void release_bam_out( struct bam_out * self );
+
+
+/* an encoder for a worker-thread that prints into an out_buffer ( out_buffer.h ):
+   it uses the reference-dictionary of the parent and prints each record as a binary
+   frame via KOutMsg(), the parent writes the frames it receives without encoding them again
+   the header of the parent has to be complete: see bam_out_write_header() */
+rc_t make_bam_out_worker( struct bam_out ** self, const struct bam_out * parent );
+
+/* ends the header of the parent, has to be called before worker-encoders are made */
+rc_t bam_out_write_header( struct bam_out * self );
+
+/* attach the encoder to the calling thread, bam_redir_current() returns it, NULL detaches */
+void attach_bam_out( struct bam_out * self );
+
+
+/* GLOBAL VARIABLES
+   installed on top of the out_redir, everything printed via KOutMsg() is turned
+   into BAM and written into the writer that was installed before */
+typedef struct bam_redir
+{
+    KWrtWriter org_writer;
+    void* org_data;
+    struct bam_out * bam;
+} bam_redir;
+
+
+rc_t init_bam_redir( bam_redir * self, uint32_t threads, const char * bam_filename );
+
+/* the encoder attached to the calling thread, or the bam_out behind the current KOutMsg()-handler,
+   NULL if the output is not turned into BAM */
+struct bam_out * bam_redir_current( void );
+
+/* writes what is pending, must be called before the out_redir is released */
+rc_t finish_bam_redir( bam_redir * self );
+
+void release_bam_redir( bam_redir * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,462 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "bgzf_writer.h"
+
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/* the largest BGZF-block, header and footer included */
+#define BGZF_MAX_BLOCK_SIZE 0x10000
+#define BGZF_HDR_SIZE 18
+#define BGZF_FOOTER_SIZE 8
+
+enum slot_state
+{
+    ss_free = 0,    /* can be filled by the caller */
+    ss_full,        /* waits for a worker-thread to compress it */
+    ss_done         /* compressed, waits to be written */
+};
+
+typedef struct bgzf_slot
+{
+    uint8_t udata[ BGZF_BLOCK_SIZE ];
+    uint8_t cdata[ BGZF_MAX_BLOCK_SIZE ];
+    uint32_t usize;
+    uint32_t csize;
+    rc_t rc;
+    enum slot_state state;
+} bgzf_slot;
+
+
+typedef struct bgzf_writer
+{
+    KWrtWriter writer;
+    void * writer_data;
+    uint64_t pos;
+
+    bgzf_slot * slots;
+    uint32_t slot_count;
+
+    uint64_t fill_nr;       /* the block the caller is filling */
+    uint64_t compress_nr;   /* the next block a worker compresses */
+    uint64_t write_nr;      /* the next block to be written */
+
+    /* the compressed offset of every block written */
+    uint64_t * offsets;
+    uint64_t offsets_size;
+
+    KLock * lock;
+    KCondition * block_full;
+    KCondition * block_done;
+    KThread ** threads;
+    uint32_t thread_count;
+    bool quit;
+} bgzf_writer;
+
+
+static const uint8_t bgzf_eof[ 28 ] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+
+static void put_u16( uint8_t * dst, uint16_t value )
+{
+    dst[ 0 ] = ( uint8_t )value;
+    dst[ 1 ] = ( uint8_t )( value >> 8 );
+}
+
+
+static void put_u32( uint8_t * dst, uint32_t value )
+{
+    dst[ 0 ] = ( uint8_t )value;
+    dst[ 1 ] = ( uint8_t )( value >> 8 );
+    dst[ 2 ] = ( uint8_t )( value >> 16 );
+    dst[ 3 ] = ( uint8_t )( value >> 24 );
+}
+
+
+static int deflate_block( bgzf_slot * slot, int level )
+{
+    z_stream zs;
+    int zrc;
+
+    memset( &zs, 0, sizeof zs );
+    zrc = deflateInit2( &zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY );
+    if ( zrc == Z_OK )
+    {
+        zs.next_in = slot->udata;
+        zs.avail_in = slot->usize;
+        zs.next_out = slot->cdata + BGZF_HDR_SIZE;
+        zs.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HDR_SIZE - BGZF_FOOTER_SIZE;
+        zrc = deflate( &zs, Z_FINISH );
+        if ( zrc == Z_STREAM_END )
+        {
+            slot->csize = BGZF_HDR_SIZE + ( uint32_t )zs.total_out + BGZF_FOOTER_SIZE;
+            zrc = Z_OK;
+        }
+        else if ( zrc == Z_OK )
+            zrc = Z_BUF_ERROR; /* did not fit into the block */
+        deflateEnd( &zs );
+    }
+    return zrc;
+}
+
+
+static rc_t compress_slot( bgzf_slot * slot )
+{
+    rc_t rc = 0;
+    int zrc = deflate_block( slot, Z_DEFAULT_COMPRESSION );
+    if ( zrc == Z_BUF_ERROR )
+        zrc = deflate_block( slot, Z_NO_COMPRESSION ); /* incompressible data grows a little */
+    if ( zrc != Z_OK )
+        rc = RC( rcExe, rcFile, rcPacking, rcData, rcInvalid );
+    else
+    {
+        uint8_t * h = slot->cdata;
+        uint8_t * f = slot->cdata + slot->csize - BGZF_FOOTER_SIZE;
+
+        memmove( h, bgzf_eof, BGZF_HDR_SIZE );
+        put_u16( h + 16, ( uint16_t )( slot->csize - 1 ) );
+        put_u32( f, ( uint32_t )crc32( crc32( 0L, Z_NULL, 0 ), slot->udata, slot->usize ) );
+        put_u32( f + 4, slot->usize );
+    }
+    return rc;
+}
+
+
+static rc_t CC bgzf_worker( const KThread * self, void * data )
+{
+    bgzf_writer * w = data;
+
+    KLockAcquire( w->lock );
+    while ( true )
+    {
+        bgzf_slot * slot;
+        rc_t rc;
+
+        while ( !w->quit && w->compress_nr == w->fill_nr )
+            KConditionWait( w->block_full, w->lock );
+        if ( w->compress_nr == w->fill_nr )
+            break;
+
+        slot = &w->slots[ w->compress_nr++ % w->slot_count ];
+        KLockUnlock( w->lock );
+
+        rc = compress_slot( slot );
+
+        KLockAcquire( w->lock );
+        slot->rc = rc;
+        slot->state = ss_done;
+        KConditionBroadcast( w->block_done );
+    }
+    KLockUnlock( w->lock );
+    return 0;
+}
+
+
+static rc_t record_block_offset( bgzf_writer * self, uint64_t block_nr )
+{
+    if ( block_nr >= self->offsets_size )
+    {
+        uint64_t new_size = ( self->offsets_size > 0 ) ? self->offsets_size * 2 : 1024;
+        uint64_t * tmp = realloc( self->offsets, new_size * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+            return RC( rcExe, rcFile, rcWriting, rcMemory, rcExhausted );
+        self->offsets = tmp;
+        self->offsets_size = new_size;
+    }
+    self->offsets[ block_nr ] = self->pos;
+    return 0;
+}
+
+
+static rc_t write_raw( bgzf_writer * self, const void * data, size_t size )
+{
+    rc_t rc = 0;
+    const uint8_t * src = data;
+    while ( rc == 0 && size > 0 )
+    {
+        size_t num_writ = 0;
+        rc = self->writer( self->writer_data, ( const char * )src, size, &num_writ );
+        if ( rc == 0 && num_writ == 0 )
+            rc = RC( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        src += num_writ;
+        size -= num_writ;
+        self->pos += num_writ;
+    }
+    if ( rc != 0 )
+        LOGERR( klogErr, rc, "cannot write BGZF-block" );
+    return rc;
+}
+
+
+/* writes the oldest block, waits for a worker-thread to finish it if necessary */
+static rc_t write_oldest( bgzf_writer * self )
+{
+    bgzf_slot * slot = &self->slots[ self->write_nr % self->slot_count ];
+    rc_t rc;
+
+    if ( self->thread_count > 0 )
+    {
+        KLockAcquire( self->lock );
+        while ( slot->state != ss_done )
+            KConditionWait( self->block_done, self->lock );
+        KLockUnlock( self->lock );
+    }
+
+    rc = slot->rc;
+    if ( rc != 0 )
+        LOGERR( klogErr, rc, "cannot compress BGZF-block" );
+    else
+        rc = record_block_offset( self, self->write_nr );
+    if ( rc == 0 )
+        rc = write_raw( self, slot->cdata, slot->csize );
+
+    slot->usize = 0;
+    slot->state = ss_free;
+    self->write_nr++;
+    return rc;
+}
+
+
+static bool oldest_is_done( bgzf_writer * self )
+{
+    bool res = false;
+    if ( self->write_nr < self->fill_nr )
+    {
+        KLockAcquire( self->lock );
+        res = ( self->slots[ self->write_nr % self->slot_count ].state == ss_done );
+        KLockUnlock( self->lock );
+    }
+    return res;
+}
+
+
+/* hands the current block over to compression */
+static rc_t submit_block( bgzf_writer * self )
+{
+    rc_t rc = 0;
+    bgzf_slot * slot = &self->slots[ self->fill_nr % self->slot_count ];
+
+    if ( self->thread_count == 0 )
+    {
+        slot->rc = compress_slot( slot );
+        slot->state = ss_done;
+        self->fill_nr++;
+        rc = write_oldest( self );
+    }
+    else
+    {
+        KLockAcquire( self->lock );
+        slot->state = ss_full;
+        self->fill_nr++;
+        KConditionSignal( self->block_full );
+        KLockUnlock( self->lock );
+
+        /* the next slot to be filled must be free */
+        while ( rc == 0 && self->fill_nr - self->write_nr >= self->slot_count )
+            rc = write_oldest( self );
+
+        while ( rc == 0 && oldest_is_done( self ) )
+            rc = write_oldest( self );
+    }
+    return rc;
+}
+
+
+static void stop_workers( bgzf_writer * self )
+{
+    uint32_t idx;
+
+    KLockAcquire( self->lock );
+    self->quit = true;
+    KConditionBroadcast( self->block_full );
+    KLockUnlock( self->lock );
+
+    for ( idx = 0; idx < self->thread_count; ++idx )
+    {
+        rc_t rc_thread;
+        KThreadWait( self->threads[ idx ], &rc_thread );
+        KThreadRelease( self->threads[ idx ] );
+    }
+    self->thread_count = 0;
+}
+
+
+rc_t make_bgzf_writer( struct bgzf_writer ** self, KWrtWriter writer, void * writer_data, uint32_t threads )
+{
+    rc_t rc = 0;
+    bgzf_writer * w = calloc( 1, sizeof * w );
+    *self = NULL;
+    if ( w == NULL )
+    {
+        rc = RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+        LOGERR( klogErr, rc, "cannot create bgzf-writer" );
+    }
+    else
+    {
+        w->writer = writer;
+        w->writer_data = writer_data;
+        w->slot_count = ( threads > 1 ) ? threads * 2 : 1;
+        w->slots = calloc( w->slot_count, sizeof *( w->slots ) );
+        if ( w->slots == NULL )
+        {
+            rc = RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot create bgzf-blocks" );
+        }
+        else if ( threads > 1 )
+        {
+            rc = KLockMake( &w->lock );
+            if ( rc == 0 )
+                rc = KConditionMake( &w->block_full );
+            if ( rc == 0 )
+                rc = KConditionMake( &w->block_done );
+            if ( rc == 0 )
+            {
+                w->threads = calloc( threads, sizeof *( w->threads ) );
+                if ( w->threads == NULL )
+                    rc = RC( rcExe, rcFile, rcConstructing, rcMemory, rcExhausted );
+            }
+            while ( rc == 0 && w->thread_count < threads )
+            {
+                rc = KThreadMake( &w->threads[ w->thread_count ], bgzf_worker, w );
+                if ( rc == 0 )
+                    w->thread_count++;
+            }
+            if ( rc != 0 )
+                LOGERR( klogErr, rc, "cannot create bgzf-compression-threads" );
+        }
+
+        if ( rc == 0 )
+            *self = w;
+        else
+            release_bgzf_writer( w );
+    }
+    return rc;
+}
+
+
+rc_t bgzf_writer_write( struct bgzf_writer * self, const void * data, size_t size )
+{
+    rc_t rc = 0;
+    const uint8_t * src = data;
+    while ( rc == 0 && size > 0 )
+    {
+        bgzf_slot * slot = &self->slots[ self->fill_nr % self->slot_count ];
+        size_t to_copy = BGZF_BLOCK_SIZE - slot->usize;
+        if ( to_copy > size )
+            to_copy = size;
+        memmove( slot->udata + slot->usize, src, to_copy );
+        slot->usize += ( uint32_t )to_copy;
+        src += to_copy;
+        size -= to_copy;
+        if ( slot->usize == BGZF_BLOCK_SIZE )
+            rc = submit_block( self );
+    }
+    return rc;
+}
+
+
+rc_t bgzf_writer_reserve( struct bgzf_writer * self, size_t size )
+{
+    rc_t rc = 0;
+    const bgzf_slot * slot = &self->slots[ self->fill_nr % self->slot_count ];
+    if ( slot->usize > 0 && slot->usize + size > BGZF_BLOCK_SIZE )
+        rc = submit_block( self );
+    return rc;
+}
+
+
+uint64_t bgzf_writer_tell( const struct bgzf_writer * self )
+{
+    const bgzf_slot * slot = &self->slots[ self->fill_nr % self->slot_count ];
+    return ( self->fill_nr << 16 ) | slot->usize;
+}
+
+
+rc_t finish_bgzf_writer( struct bgzf_writer * self )
+{
+    rc_t rc = 0;
+    if ( self->slots[ self->fill_nr % self->slot_count ].usize > 0 )
+        rc = submit_block( self );
+
+    if ( self->thread_count > 0 )
+        stop_workers( self );
+    while ( self->write_nr < self->fill_nr )
+    {
+        rc_t rc1 = write_oldest( self );
+        if ( rc == 0 )
+            rc = rc1;
+    }
+
+    /* a block-offset pointing behind the last block */
+    if ( rc == 0 )
+        rc = record_block_offset( self, self->fill_nr );
+    if ( rc == 0 )
+        rc = write_raw( self, bgzf_eof, sizeof bgzf_eof );
+    return rc;
+}
+
+
+uint64_t bgzf_writer_voffset( const struct bgzf_writer * self, uint64_t block_offset )
+{
+    uint64_t block_nr = block_offset >> 16;
+    if ( block_nr >= self->offsets_size )
+        return 0;
+    return ( self->offsets[ block_nr ] << 16 ) | ( block_offset & 0xFFFF );
+}
+
+
+void release_bgzf_writer( struct bgzf_writer * self )
+{
+    if ( self != NULL )
+    {
+        if ( self->thread_count > 0 )
+            stop_workers( self );
+        if ( self->threads != NULL )
+            free( self->threads );
+        if ( self->block_done != NULL )
+            KConditionRelease( self->block_done );
+        if ( self->block_full != NULL )
+            KConditionRelease( self->block_full );
+        if ( self->lock != NULL )
+            KLockRelease( self->lock );
+        if ( self->slots != NULL )
+            free( self->slots );
+        if ( self->offsets != NULL )
+            free( self->offsets );
+        free( self );
+    }
+}
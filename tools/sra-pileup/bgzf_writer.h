@@ -0,0 +1,77 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_bgzf_writer_
+#define _h_bgzf_writer_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/writer.h>
+
+/* the largest amount of uncompressed data in one BGZF-block ( same as samtools ) */
+#define BGZF_BLOCK_SIZE 0xff00
+
+/*
+    writes BGZF ( blocked gzip ) through a KWrtWriter
+    with threads > 1 the blocks are compressed by a pool of worker-threads,
+    the blocks are written in order by the thread calling the bgzf_writer-functions
+
+    virtual offsets cannot be known before the blocks are compressed, the writer
+    hands out 'block-offsets' ( block-number << 16 | offset in block ) instead,
+    after finish_bgzf_writer() they can be translated into virtual offsets
+*/
+struct bgzf_writer;
+
+rc_t make_bgzf_writer( struct bgzf_writer ** self, KWrtWriter writer, void * writer_data, uint32_t threads );
+
+/* append data, a new block is started whenever the current one is full */
+rc_t bgzf_writer_write( struct bgzf_writer * self, const void * data, size_t size );
+
+/* starts a new block, if size bytes do not fit into the current one */
+rc_t bgzf_writer_reserve( struct bgzf_writer * self, size_t size );
+
+/* the block-offset of the next byte written */
+uint64_t bgzf_writer_tell( const struct bgzf_writer * self );
+
+/* compresses and writes everything pending and appends the EOF-marker */
+rc_t finish_bgzf_writer( struct bgzf_writer * self );
+
+/* translates a block-offset into a virtual offset, only valid after finish_bgzf_writer() */
+uint64_t bgzf_writer_voffset( const struct bgzf_writer * self, uint64_t block_offset );
+
+void release_bgzf_writer( struct bgzf_writer * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -668,36 +668,61 @@ static rc_t prepare_reflist( prepare_ctx *ctx )
 }
 
 
+rc_t prepare_open( prepare_ctx *ctx,
+                   const VDBManager *vdb_mgr,
+                   VSchema *vdb_schema,
+                   const char * path )
+{
+    rc_t rc;
+    ctx->reflist = NULL;
+    rc = prepare_db_table( ctx, vdb_mgr, vdb_schema, path );
+    if ( rc == 0 )
+        rc = prepare_reflist( ctx );
+    return rc;
+}
+
+
+rc_t prepare_sections( prepare_ctx *ctx, BSTree * regions )
+{
+    rc_t rc;
+    if ( ctx->reflist == NULL || count_ref_regions( regions ) == 0 )
+    {
+        /* the user has not specified a reference-range : use the whole file... */
+        rc = prepare_whole_file( ctx );
+    }
+    else
+    {
+        /* pick only the requested ranges... */
+        rc = foreach_ref_region( regions, prepare_region_cb, ctx ); /* ref_regions.c */
+    }
+    return rc;
+}
+
+
+void prepare_close( prepare_ctx *ctx )
+{
+    if ( ctx->reflist != NULL )
+    {
+        ReferenceList_Release( ctx->reflist );
+        ctx->reflist = NULL;
+    }
+    VTableRelease ( ctx->seq_tab );
+    ctx->seq_tab = NULL;
+    VDatabaseRelease ( ctx->db );
+    ctx->db = NULL;
+}
+
+
 rc_t prepare_ref_iter( prepare_ctx *ctx,
                        const VDBManager *vdb_mgr,
                        VSchema *vdb_schema,
                        const char * path,
                        BSTree * regions )
 {
-    rc_t rc = prepare_db_table( ctx, vdb_mgr, vdb_schema, path );
+    rc_t rc = prepare_open( ctx, vdb_mgr, vdb_schema, path );
     if ( rc == 0 )
-    {
-        rc = prepare_reflist( ctx );
-        if( rc == 0 )
-        {
-            if ( ctx->reflist == NULL || count_ref_regions( regions ) == 0 )
-            {
-                /* the user has not specified a reference-range : use the whole file... */
-                rc = prepare_whole_file( ctx );
-            }
-            else
-            {
-                /* pick only the requested ranges... */
-                rc = foreach_ref_region( regions, prepare_region_cb, ctx ); /* ref_regions.c */
-            }
-        }
-        if ( ctx->reflist != NULL )
-        {
-            ReferenceList_Release( ctx->reflist );
-        }
-    }
-    VTableRelease ( ctx->seq_tab );
-    VDatabaseRelease ( ctx->db );
+        rc = prepare_sections( ctx, regions );
+    prepare_close( ctx );
     return rc;
 }
 
@@ -127,6 +127,19 @@ typedef struct prepare_ctx
 
 
 
+/* prepare_ref_iter() opens the database, adds the placements of the regions to ctx->ref_iter
+   and closes the database again, a caller that walks many sections of the same input
+   ( the tiles of sra-pileup --threads ) opens it once and calls prepare_sections() per section,
+   the cursors created by ctx->on_section() are released by the caller */
+rc_t prepare_open( prepare_ctx *ctx,
+                   const VDBManager *vdb_mgr,
+                   VSchema *vdb_schema,
+                   const char * path );
+
+rc_t prepare_sections( prepare_ctx *ctx, BSTree * regions );
+
+void prepare_close( prepare_ctx *ctx );
+
 rc_t prepare_ref_iter( prepare_ctx *ctx,
                        const VDBManager *vdb_mgr,
                        VSchema *vdb_schema,
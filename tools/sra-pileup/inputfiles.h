@@ -58,12 +58,15 @@ extern "C" {
 */
 
 
+struct sam_proj;
+
 typedef struct input_database
 {
     uint32_t db_idx;
     char * path;
     const VDatabase * db;
     const ReferenceList *reflist;
+    const struct sam_proj * proj; /* optional SAM-projection-cache, not owned */
     void * prim_ctx;
     void * sec_ctx;
     void * ev_ctx;
@@ -84,6 +87,9 @@ typedef struct input_files
     uint32_t table_count;
     uint32_t not_found_count;
 
+    /* the options the reference-lists have been created with */
+    uint32_t reflist_options;
+
     Vector dbs;
     Vector tabs;
     VNamelist * not_found;
@@ -0,0 +1,357 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "mate_hash.h"
+
+#include <klib/sort.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MATE_HASH_MIN_CAPACITY 1024
+
+/* fibonacci-hashing: the upper bits of the product are well mixed */
+static uint64_t mate_hash_slot( const mate_hash * self, int64_t key )
+{
+    return ( ( uint64_t )key * 0x9E3779B97F4A7C15ULL ) >> self->shift;
+}
+
+
+static uint32_t mate_hash_shift( uint64_t capacity )
+{
+    uint32_t bits = 0;
+    while ( ( ( uint64_t )1 << bits ) < capacity )
+        bits++;
+    return 64 - bits;
+}
+
+
+/* the key is known not to be in the table, there is a free slot */
+static void mate_hash_insert_new( mate_hash * self, const mate_hash_entry * entry )
+{
+    uint64_t mask = self->capacity - 1;
+    uint64_t idx = mate_hash_slot( self, entry->key );
+    while ( self->entries[ idx ].key != 0 )
+        idx = ( idx + 1 ) & mask;
+    self->entries[ idx ] = *entry;
+    self->count++;
+}
+
+
+static rc_t mate_hash_resize( mate_hash * self, uint64_t capacity )
+{
+    rc_t rc = 0;
+    mate_hash_entry * entries = calloc( capacity, sizeof * entries );
+    if ( entries == NULL )
+    {
+        rc = RC( rcApp, rcNoTarg, rcResizing, rcMemory, rcExhausted );
+        (void)LOGERR( klogErr, rc, "cannot resize mate-hash" );
+    }
+    else
+    {
+        mate_hash_entry * old = self->entries;
+        uint64_t old_capacity = self->capacity;
+        uint64_t old_count = self->count;
+        bool old_sorted = self->sorted;
+        uint64_t idx;
+
+        self->entries = entries;
+        self->capacity = capacity;
+        self->shift = mate_hash_shift( capacity );
+        self->count = 0;
+        self->sorted = false;
+        if ( old != NULL )
+        {
+            if ( old_sorted )
+            {
+                for ( idx = 0; idx < old_count; ++idx )
+                    mate_hash_insert_new( self, &old[ idx ] );
+            }
+            else
+            {
+                for ( idx = 0; idx < old_capacity; ++idx )
+                {
+                    if ( old[ idx ].key != 0 )
+                        mate_hash_insert_new( self, &old[ idx ] );
+                }
+            }
+            free( old );
+        }
+    }
+    return rc;
+}
+
+
+rc_t init_mate_hash( mate_hash * self, uint64_t capacity )
+{
+    rc_t rc = 0;
+    memset( self, 0, sizeof * self );
+    if ( capacity > 0 )
+    {
+        uint64_t c = MATE_HASH_MIN_CAPACITY;
+        while ( c < capacity )
+            c <<= 1;
+        rc = mate_hash_resize( self, c );
+    }
+    return rc;
+}
+
+
+void release_mate_hash( mate_hash * self )
+{
+    if ( self != NULL )
+    {
+        free( self->entries );
+        memset( self, 0, sizeof * self );
+    }
+}
+
+
+void mate_hash_clear( mate_hash * self )
+{
+    release_mate_hash( self );
+}
+
+
+rc_t mate_hash_put( mate_hash * self, int64_t key, uint64_t value, uint64_t aux )
+{
+    rc_t rc = 0;
+    if ( key == 0 )
+    {
+        rc = RC( rcApp, rcNoTarg, rcInserting, rcParam, rcInvalid );
+        (void)LOGERR( klogErr, rc, "cannot insert key 0 into mate-hash" );
+    }
+    else
+    {
+        /* keep the load-factor below 3/4, the probe-sequences stay short */
+        if ( self->sorted || ( self->count + 1 ) * 4 > self->capacity * 3 )
+        {
+            uint64_t capacity = ( self->capacity < MATE_HASH_MIN_CAPACITY ) ? MATE_HASH_MIN_CAPACITY : self->capacity;
+            while ( ( self->count + 1 ) * 4 > capacity * 3 )
+                capacity <<= 1;
+            rc = mate_hash_resize( self, capacity );
+        }
+        if ( rc == 0 )
+        {
+            uint64_t mask = self->capacity - 1;
+            uint64_t idx = mate_hash_slot( self, key );
+            while ( self->entries[ idx ].key != 0 && self->entries[ idx ].key != key )
+                idx = ( idx + 1 ) & mask;
+            if ( self->entries[ idx ].key == 0 )
+            {
+                self->entries[ idx ].key = key;
+                self->count++;
+            }
+            self->entries[ idx ].value = value;
+            self->entries[ idx ].aux = aux;
+        }
+    }
+    return rc;
+}
+
+
+static mate_hash_entry * mate_hash_find( const mate_hash * self, int64_t key )
+{
+    if ( self->entries == NULL || key == 0 )
+        return NULL;
+    if ( self->sorted )
+    {
+        uint64_t lo = 0, hi = self->count;
+        while ( lo < hi )
+        {
+            uint64_t mid = lo + ( hi - lo ) / 2;
+            int64_t k = self->entries[ mid ].key;
+            if ( k == key )
+                return &self->entries[ mid ];
+            else if ( k < key )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    }
+    else
+    {
+        uint64_t mask = self->capacity - 1;
+        uint64_t idx = mate_hash_slot( self, key );
+        while ( self->entries[ idx ].key != 0 )
+        {
+            if ( self->entries[ idx ].key == key )
+                return &self->entries[ idx ];
+            idx = ( idx + 1 ) & mask;
+        }
+    }
+    return NULL;
+}
+
+
+bool mate_hash_get( const mate_hash * self, int64_t key, uint64_t * value, uint64_t * aux )
+{
+    const mate_hash_entry * entry = mate_hash_find( self, key );
+    if ( entry == NULL )
+        return false;
+    if ( value != NULL )
+        *value = entry->value;
+    if ( aux != NULL )
+        *aux = entry->aux;
+    return true;
+}
+
+
+/* backward-shift deletion: no tombstones, the following entries of the
+   cluster move up if their home-slot allows it */
+static void mate_hash_delete_slot( mate_hash * self, uint64_t idx )
+{
+    uint64_t mask = self->capacity - 1;
+    uint64_t next = idx;
+    while ( true )
+    {
+        uint64_t home;
+        next = ( next + 1 ) & mask;
+        if ( self->entries[ next ].key == 0 )
+            break;
+        home = mate_hash_slot( self, self->entries[ next ].key );
+        /* can the entry at next move into the hole at idx? ( home not cyclically in ( idx, next ] ) */
+        if ( ( next > idx && ( home <= idx || home > next ) ) ||
+             ( next < idx && ( home <= idx && home > next ) ) )
+        {
+            self->entries[ idx ] = self->entries[ next ];
+            idx = next;
+        }
+    }
+    self->entries[ idx ].key = 0;
+    self->count--;
+}
+
+
+bool mate_hash_remove( mate_hash * self, int64_t key )
+{
+    mate_hash_entry * entry = mate_hash_find( self, key );
+    if ( entry == NULL )
+        return false;
+    if ( self->sorted )
+    {
+        uint64_t idx = entry - self->entries;
+        memmove( entry, entry + 1, ( self->count - idx - 1 ) * sizeof * entry );
+        self->count--;
+        self->entries[ self->count ].key = 0;
+    }
+    else
+        mate_hash_delete_slot( self, entry - self->entries );
+    return true;
+}
+
+
+uint64_t mate_hash_evict( mate_hash * self,
+                          bool ( CC * f ) ( const mate_hash_entry * entry, void * data ),
+                          void * data )
+{
+    uint64_t removed = 0;
+    uint64_t idx = 0;
+    if ( self->entries == NULL )
+        return 0;
+    if ( self->sorted )
+    {
+        uint64_t dst = 0;
+        for ( idx = 0; idx < self->count; ++idx )
+        {
+            if ( f( &self->entries[ idx ], data ) )
+                removed++;
+            else
+                self->entries[ dst++ ] = self->entries[ idx ];
+        }
+        for ( idx = dst; idx < self->count; ++idx )
+            self->entries[ idx ].key = 0;
+        self->count = dst;
+    }
+    else
+    {
+        /* the slot is examined again after a delete, an entry of the cluster has moved into it */
+        while ( idx < self->capacity )
+        {
+            if ( self->entries[ idx ].key != 0 && f( &self->entries[ idx ], data ) )
+            {
+                mate_hash_delete_slot( self, idx );
+                removed++;
+            }
+            else
+                idx++;
+        }
+
+        /* give memory back if the table is mostly empty now */
+        if ( self->count == 0 )
+            mate_hash_clear( self );
+        else
+        {
+            uint64_t capacity = self->capacity;
+            while ( capacity > MATE_HASH_MIN_CAPACITY && self->count * 8 < capacity * 3 )
+                capacity >>= 1;
+            if ( capacity < self->capacity )
+                mate_hash_resize( self, capacity ); /* keeps the old table if that fails */
+        }
+    }
+    return removed;
+}
+
+
+static int64_t CC cmp_mate_hash_entry( const void * a, const void * b, void * data )
+{
+    const mate_hash_entry * ea = a;
+    const mate_hash_entry * eb = b;
+    if ( ea->key < eb->key )
+        return -1;
+    return ( ea->key > eb->key ) ? 1 : 0;
+}
+
+
+void mate_hash_sort( mate_hash * self )
+{
+    if ( self->entries != NULL && !self->sorted )
+    {
+        uint64_t dst = 0;
+        uint64_t idx;
+        for ( idx = 0; idx < self->capacity; ++idx )
+        {
+            if ( self->entries[ idx ].key != 0 )
+            {
+                if ( dst != idx )
+                {
+                    self->entries[ dst ] = self->entries[ idx ];
+                    self->entries[ idx ].key = 0;
+                }
+                dst++;
+            }
+        }
+        ksort( self->entries, self->count, sizeof self->entries[ 0 ], cmp_mate_hash_entry, NULL );
+        self->sorted = true;
+    }
+}
+
+
+uint64_t mate_hash_bytes( const mate_hash * self )
+{
+    return self->capacity * sizeof self->entries[ 0 ];
+}
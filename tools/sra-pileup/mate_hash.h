@@ -0,0 +1,90 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_mate_hash_
+#define _h_mate_hash_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <klib/log.h>
+
+/* one slot of the table, the values are stored inline */
+typedef struct mate_hash_entry
+{
+    int64_t key;        /* row-id, 0 marks an empty slot */
+    uint64_t value;
+    uint64_t aux;
+} mate_hash_entry;
+
+
+/* open-addressing hash-table ( linear probing ) with int64-keys,
+   after mate_hash_sort() the entries[ 0 ... count - 1 ] are sorted by key */
+typedef struct mate_hash
+{
+    mate_hash_entry * entries;
+    uint64_t capacity;      /* power of 2, or 0 if nothing allocated yet */
+    uint64_t count;
+    uint32_t shift;
+    bool sorted;
+} mate_hash;
+
+
+rc_t init_mate_hash( mate_hash * self, uint64_t capacity );
+
+void release_mate_hash( mate_hash * self );
+
+/* frees the slots, the table can be used again */
+void mate_hash_clear( mate_hash * self );
+
+/* inserts or overwrites */
+rc_t mate_hash_put( mate_hash * self, int64_t key, uint64_t value, uint64_t aux );
+
+bool mate_hash_get( const mate_hash * self, int64_t key, uint64_t * value, uint64_t * aux );
+
+bool mate_hash_remove( mate_hash * self, int64_t key );
+
+/* removes all entries the callback returns true for, returns how many have been removed */
+uint64_t mate_hash_evict( mate_hash * self,
+                          bool ( CC * f ) ( const mate_hash_entry * entry, void * data ),
+                          void * data );
+
+/* compacts and sorts the entries by key, a following put() turns it back into a hash-table */
+void mate_hash_sort( mate_hash * self );
+
+/* how much memory the slots occupy */
+uint64_t mate_hash_bytes( const mate_hash * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
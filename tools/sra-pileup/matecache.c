@@ -25,8 +25,25 @@
 */
 
 #include "matecache.h"
+
+#include <kfs/directory.h>
+
 #include <sysalloc.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* the same-ref-caches are not scanned for passed mates before they have this many entries */
+#define MATECACHE_MIN_EVICT 65536
+
+/* a spill distributes the cold entries over this many runs, by the position of their mate */
+#define MATECACHE_SPILL_RUNS 8
+
+/* entries written/read to/from the spill-file at once */
+#define MATECACHE_SPILL_BUF 4096
+
+#define MATE_POS( aux ) ( ( INSDC_coord_zero )( ( aux ) >> 32 ) )
+
 
 void release_matecache( matecache * const self )
 {
@@ -37,24 +54,20 @@ void release_matecache( matecache * const self )
             uint32_t idx;
             for ( idx = 0; idx < self->count; ++idx )
             {
-                if ( self->per_file[ idx ].same_ref_64 != NULL )
-                    KVectorRelease( self->per_file[ idx ].same_ref_64 );
-                if ( self->per_file[ idx ].same_ref_16 != NULL )
-                    KVectorRelease( self->per_file[ idx ].same_ref_16 );
-
-                if ( self->per_file[ idx ].unaligned_64_a != NULL )
-                    KVectorRelease( self->per_file[ idx ].unaligned_64_a );
-                if ( self->per_file[ idx ].unaligned_64_b != NULL )
-                    KVectorRelease( self->per_file[ idx ].unaligned_64_b );
+                release_mate_hash( &self->per_file[ idx ].same_ref );
+                release_mate_hash( &self->per_file[ idx ].unaligned );
+                free( self->per_file[ idx ].runs );
             }
             free( self->per_file );
         }
+        if ( self->spill_file != NULL )
+            KFileRelease( self->spill_file );
         free( self );
     }
 }
 
 
-rc_t make_matecache( matecache **self, uint32_t count )
+rc_t make_matecache( matecache **self, uint32_t count, size_t mem_limit )
 {
     rc_t rc = 0;
 
@@ -68,6 +81,7 @@ rc_t make_matecache( matecache **self, uint32_t count )
     else
     {
         mc->count = count;
+        mc->mem_limit = mem_limit;
         mc->per_file = calloc( sizeof *(mc->per_file), count );
         if ( mc->per_file == NULL )
         {
@@ -76,33 +90,11 @@ rc_t make_matecache( matecache **self, uint32_t count )
         }
         else
         {
+            /* the hash-tables allocate their slots on the first insert */
             uint32_t idx;
-            for ( idx = 0; idx < count && rc == 0; ++idx )
-            {
-                rc = KVectorMake( &( mc->per_file[ idx ].same_ref_64 ) );
-                if ( rc != 0 )
-                    (void)LOGERR( klogErr, rc, "cannot create KVector (same-ref) U64" );
-                else
-                {
-                    rc = KVectorMake( &( mc->per_file[ idx ].same_ref_16 ) );
-                    if ( rc != 0 )
-                        (void)LOGERR( klogErr, rc, "cannot create KVector (same-ref) U16" );
-                    else
-                    {
-                        rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_a ) );
-                        if ( rc != 0 )
-                            (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned a) U64" );
-                        else
-                        {
-                            rc = KVectorMake( &( mc->per_file[ idx ].unaligned_64_b ) );
-                            if ( rc != 0 )
-                                (void)LOGERR( klogErr, rc, "cannot create KVector (unaligned b) U64" );
-                        }
-                    }
-                }
-            }
-            if ( rc == 0 )
-                *self = mc;
+            for ( idx = 0; idx < count; ++idx )
+                mc->per_file[ idx ].evict_at = MATECACHE_MIN_EVICT;
+            *self = mc;
         }
         if ( rc != 0 )
             release_matecache( mc );
@@ -153,43 +145,41 @@ static rc_t matecache_check( const matecache * const self, uint32_t db_idx, mate
         (void)LOGERR( klogErr, rc, "cannot insert into same-ref-cache" );
     }
     else if ( db_idx < self->count )
-    {
         *mcpf = &self->per_file[ db_idx ];
-        if ( mcpf == NULL )
-        {
-            rc = RC( rcApp, rcNoTarg, rcAccessing, rcParam, rcInvalid );
-            (void)LOGERR( klogErr, rc, "cannot insert into same-ref-cache" );
-        }
+    else
+    {
+        rc = RC( rcApp, rcNoTarg, rcAccessing, rcParam, rcInvalid );
+        (void)LOGERR( klogErr, rc, "cannot insert into same-ref-cache" );
     }
     return rc;
 }
 
 
+static rc_t matecache_enforce_mem_limit( matecache * const self );
+
 rc_t matecache_insert_same_ref( matecache * const self,
-        uint32_t db_idx, int64_t key, INSDC_coord_zero ref_pos, uint32_t flags, INSDC_coord_len tlen )
+        uint32_t db_idx, int64_t key, INSDC_coord_zero ref_pos, uint32_t flags, INSDC_coord_len tlen,
+        INSDC_coord_zero mate_pos )
 {
     matecache_per_file * mcpf = NULL;
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
         uint64_t ref_pos_and_tlen = ref_pos;
+        uint64_t mate_pos_and_flags = ( uint32_t )mate_pos;
         ref_pos_and_tlen <<= 32;
         ref_pos_and_tlen |= tlen;
-        rc = KVectorSetU64( mcpf->same_ref_64, key, ref_pos_and_tlen );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot insert into KVector (same-ref) U64" );
-        else
-        {
-            rc = KVectorSetU16( mcpf->same_ref_16, key, flags );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot insert into KVector (same-ref) U16" );
-        }
+        mate_pos_and_flags <<= 32;
+        mate_pos_and_flags |= flags;
+        rc = mate_hash_put( &mcpf->same_ref, key, ref_pos_and_tlen, mate_pos_and_flags );
         if ( rc == 0 )
         {
-            mcpf->stat_same_ref.count++;
+            mcpf->stat_same_ref.count = mcpf->same_ref.count;
             if ( mcpf->stat_same_ref.count > mcpf->maxcount_same_ref )
                 mcpf->maxcount_same_ref = mcpf->stat_same_ref.count;
             mcpf->stat_same_ref.inserts++;
+            if ( self->mem_limit > 0 )
+                rc = matecache_enforce_mem_limit( self );
         }
     }
     return rc;
@@ -203,78 +193,400 @@ rc_t matecache_lookup_same_ref( const matecache * const self, uint32_t db_idx, i
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t value64;
+        uint64_t value, aux;
         mcpf->stat_same_ref.lookups++;
-        rc = KVectorGetU64( mcpf->same_ref_64, key, &value64 );
-        if ( rc != 0 )
+        if ( !mate_hash_get( &mcpf->same_ref, key, &value, &aux ) )
+            rc = RC( rcApp, rcNoTarg, rcAccessing, rcItem, rcNotFound );
+        else
         {
-            if ( GetRCState( rc ) != rcNotFound )
-                (void)LOGERR( klogErr, rc, "cannot retrieve value (same-ref) U64" );
+            *ref_pos = ( value >> 32 );
+            *tlen = ( value & 0xFFFFFFFF );
+            *flags = ( aux & 0xFFFF );
+            mcpf->stat_same_ref.finds++;
         }
-        else
+    }
+    return rc;
+}
+
+
+rc_t matecache_remove_same_ref( matecache * const self, uint32_t db_idx, int64_t key )
+{
+    matecache_per_file * mcpf = NULL;
+    rc_t rc = matecache_check( self, db_idx, &mcpf );
+    if ( rc == 0 )
+    {
+        mate_hash_remove( &mcpf->same_ref, key );
+        mcpf->stat_same_ref.count = mcpf->same_ref.count;
+    }
+    return rc;
+}
+
+
+/* ----------------------------------------------------------------------------------- */
+
+static bool CC mate_passed( const mate_hash_entry * entry, void * data )
+{
+    const INSDC_coord_zero * pos = data;
+    return ( MATE_POS( entry->aux ) < *pos );
+}
+
+
+static rc_t matecache_open_spill_file( matecache * const self )
+{
+    KDirectory * dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot create native directory for mate-cache spill-file" );
+    else
+    {
+        char template[ 4096 ];
+        size_t written;
+        const char * tmp_dir = getenv( "TMPDIR" );
+        if ( tmp_dir == NULL || tmp_dir[ 0 ] == 0 )
+            tmp_dir = "/tmp";
+        rc = string_printf( template, sizeof template, &written, "%s/sam-dump-mates.XXXXXX", tmp_dir );
+        if ( rc == 0 )
         {
-            uint16_t value16;
-            rc = KVectorGetU16( mcpf->same_ref_16, key, &value16 );
-            if ( rc != 0 )
+            int fd = mkstemp( template );
+            if ( fd < 0 )
             {
-                if ( GetRCState( rc ) != rcNotFound )
-                    (void)LOGERR( klogErr, rc, "cannot retrieve value (same-ref) U16" );
+                rc = RC( rcApp, rcFile, rcCreating, rcFile, rcUnknown );
+                (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create mate-cache spill-file '$(f)'", "f=%s", template ) );
             }
             else
             {
-                *ref_pos = ( value64 >> 32 );
-                *tlen = ( value64 & 0xFFFFFFFF );
-                *flags = value16;
-                mcpf->stat_same_ref.finds++;
+                rc = KDirectoryOpenFileWrite( dir, &self->spill_file, true, "%s", template );
+                if ( rc != 0 )
+                    (void)PLOGERR( klogErr, ( klogErr, rc, "cannot open mate-cache spill-file '$(f)'", "f=%s", template ) );
+                close( fd );
+                unlink( template ); /* vanishes when the KFile is released */
             }
         }
+        KDirectoryRelease( dir );
     }
     return rc;
 }
 
 
-rc_t matecache_remove_same_ref( matecache * const self, uint32_t db_idx, int64_t key )
+typedef struct spill_ctx
 {
-    matecache_per_file * mcpf = NULL;
-    rc_t rc = matecache_check( self, db_idx, &mcpf );
-    if ( rc == 0 )
+    matecache * mc;
+    mate_hash_entry buf[ MATECACHE_SPILL_BUF ];
+    uint32_t buf_count;
+    INSDC_coord_zero from, to;  /* spill entries with from <= mate-pos < to */
+    INSDC_coord_zero min_mate_pos;
+    uint64_t count;
+    rc_t rc;
+} spill_ctx;
+
+
+static rc_t spill_flush( spill_ctx * sctx )
+{
+    if ( sctx->rc == 0 && sctx->buf_count > 0 )
     {
-        rc = KVectorUnset( mcpf->same_ref_64, key );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache (64bit)" );
+        size_t to_write = sctx->buf_count * sizeof sctx->buf[ 0 ];
+        size_t written;
+        sctx->rc = KFileWriteAll( sctx->mc->spill_file, sctx->mc->spill_pos, sctx->buf, to_write, &written );
+        if ( sctx->rc == 0 && written != to_write )
+            sctx->rc = RC( rcApp, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        if ( sctx->rc != 0 )
+            (void)LOGERR( klogErr, sctx->rc, "cannot write to mate-cache spill-file" );
+        sctx->mc->spill_pos += written;
+        sctx->buf_count = 0;
+    }
+    return sctx->rc;
+}
+
+
+static bool CC spill_entry( const mate_hash_entry * entry, void * data )
+{
+    spill_ctx * sctx = data;
+    INSDC_coord_zero mate_pos = MATE_POS( entry->aux );
+    if ( sctx->rc != 0 || mate_pos < sctx->from || mate_pos >= sctx->to )
+        return false;
+    if ( sctx->buf_count == MATECACHE_SPILL_BUF && spill_flush( sctx ) != 0 )
+        return false;
+    sctx->buf[ sctx->buf_count++ ] = *entry;
+    if ( sctx->count == 0 || mate_pos < sctx->min_mate_pos )
+        sctx->min_mate_pos = mate_pos;
+    sctx->count++;
+    return true;
+}
+
+
+static rc_t matecache_add_run( matecache_per_file * mcpf, uint64_t offset, uint64_t count, INSDC_coord_zero min_mate_pos )
+{
+    rc_t rc = 0;
+    if ( mcpf->run_count >= mcpf->run_capacity )
+    {
+        uint32_t new_capacity = mcpf->run_capacity == 0 ? 16 : mcpf->run_capacity * 2;
+        matecache_spill_run * tmp = realloc( mcpf->runs, new_capacity * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcResizing, rcMemory, rcExhausted );
+            (void)LOGERR( klogErr, rc, "cannot grow list of mate-cache spill-runs" );
+        }
         else
         {
-            rc = KVectorUnset( mcpf->same_ref_16, key );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot remove from same-ref-cache (16bit)" );
+            mcpf->runs = tmp;
+            mcpf->run_capacity = new_capacity;
         }
-        if ( rc == 0 && mcpf->stat_same_ref.count > 0 )
-            mcpf->stat_same_ref.count--;
+    }
+    if ( rc == 0 )
+    {
+        matecache_spill_run * run = &mcpf->runs[ mcpf->run_count++ ];
+        run->offset = offset;
+        run->count = count;
+        run->min_mate_pos = min_mate_pos;
+        if ( mcpf->run_count == 1 || min_mate_pos < mcpf->next_reload )
+            mcpf->next_reload = min_mate_pos;
     }
     return rc;
 }
 
 
-static rc_t matecache_clear_same_ref_per_file( matecache_per_file * const mcpf )
+/* moves the entries with the most distant mates into the spill-file:
+   the 3/4 of the entries ahead of the walker whose mates are farthest away, that is
+   enough for the hash-table to shrink, they are written in MATECACHE_SPILL_RUNS runs
+   by mate-position, each run is reloaded on its own */
+static rc_t matecache_spill( matecache * const self, matecache_per_file * mcpf )
 {
-    rc_t rc = KVectorRelease( mcpf->same_ref_64 );
-    if ( rc != 0 )
-        (void)LOGERR( klogErr, rc, "cannot release same-ref-cache (64bit)" );
-    else
+    rc_t rc = 0;
+    INSDC_coord_zero lo = mcpf->pos, hi = mcpf->pos;
+    uint64_t idx, ahead = 0;
+    const mate_hash * h = &mcpf->same_ref;
+
+    /* how far ahead are the mates? */
+    for ( idx = 0; idx < h->capacity; ++idx )
     {
-        rc = KVectorRelease( mcpf->same_ref_16 );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot release same-ref-cache (16bit)" );
-        else
+        if ( h->entries[ idx ].key != 0 )
         {
-            rc = KVectorMake( &mcpf->same_ref_64 );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot make same-ref-cache (64bit)" );
+            INSDC_coord_zero mate_pos = MATE_POS( h->entries[ idx ].aux );
+            if ( mate_pos > mcpf->pos )
+            {
+                if ( mate_pos > hi ) hi = mate_pos;
+                ahead++;
+            }
+        }
+    }
+
+    if ( ahead > 0 )
+    {
+        /* find the lower quartile of the mate-positions ahead with a coarse histogram */
+        uint64_t histo[ 256 ];
+        uint64_t span = ( uint64_t )( hi - lo ) + 1;
+        uint64_t sum = 0;
+        INSDC_coord_zero cutoff;
+        uint32_t bucket;
+
+        memset( histo, 0, sizeof histo );
+        for ( idx = 0; idx < h->capacity; ++idx )
+        {
+            if ( h->entries[ idx ].key != 0 )
+            {
+                INSDC_coord_zero mate_pos = MATE_POS( h->entries[ idx ].aux );
+                if ( mate_pos > lo )
+                    histo[ ( ( uint64_t )( mate_pos - lo ) * 256 ) / span ]++;
+            }
+        }
+        for ( bucket = 0; bucket < 255 && sum + histo[ bucket ] < ahead / 4; ++bucket )
+            sum += histo[ bucket ];
+        cutoff = lo + ( INSDC_coord_zero )( ( bucket * span ) / 256 );
+        if ( cutoff <= mcpf->pos )
+            cutoff = mcpf->pos + 1;
+
+        if ( self->spill_file == NULL )
+            rc = matecache_open_spill_file( self );
+
+        if ( rc == 0 )
+        {
+            spill_ctx * sctx = malloc( sizeof * sctx );
+            if ( sctx == NULL )
+            {
+                rc = RC( rcApp, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+                (void)LOGERR( klogErr, rc, "cannot allocate mate-cache spill-buffer" );
+            }
             else
             {
-                rc = KVectorMake( &mcpf->same_ref_16 );
+                uint64_t run_span = ( ( uint64_t )( hi - cutoff ) + MATECACHE_SPILL_RUNS ) / MATECACHE_SPILL_RUNS;
+                uint32_t run;
+                sctx->mc = self;
+                sctx->rc = 0;
+                for ( run = 0; run < MATECACHE_SPILL_RUNS && rc == 0; ++run )
+                {
+                    uint64_t offset = self->spill_pos;
+                    sctx->buf_count = 0;
+                    sctx->count = 0;
+                    sctx->from = cutoff + ( INSDC_coord_zero )( run * run_span );
+                    sctx->to = ( run + 1 == MATECACHE_SPILL_RUNS ) ? hi + 1 : sctx->from + ( INSDC_coord_zero )run_span;
+                    if ( sctx->from > hi )
+                        break;
+                    mate_hash_evict( &mcpf->same_ref, spill_entry, sctx );
+                    rc = spill_flush( sctx );
+                    if ( rc == 0 && sctx->count > 0 )
+                    {
+                        rc = matecache_add_run( mcpf, offset, sctx->count, sctx->min_mate_pos );
+                        mcpf->spilled += sctx->count;
+                    }
+                }
+                free( sctx );
+                self->spills++;
+            }
+        }
+    }
+    mcpf->stat_same_ref.count = mcpf->same_ref.count;
+    return rc;
+}
+
+
+/* brings back the runs whose first mate is due, entries whose mate has been passed are dropped */
+static rc_t matecache_reload( matecache * const self, matecache_per_file * mcpf )
+{
+    rc_t rc = 0;
+    uint32_t idx = 0;
+    mate_hash_entry * buf = NULL;
+
+    while ( rc == 0 && idx < mcpf->run_count )
+    {
+        matecache_spill_run * run = &mcpf->runs[ idx ];
+        if ( run->min_mate_pos > mcpf->pos )
+            idx++;
+        else
+        {
+            uint64_t done = 0;
+            if ( buf == NULL )
+            {
+                buf = malloc( MATECACHE_SPILL_BUF * sizeof buf[ 0 ] );
+                if ( buf == NULL )
+                {
+                    rc = RC( rcApp, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+                    (void)LOGERR( klogErr, rc, "cannot allocate mate-cache reload-buffer" );
+                }
+            }
+            while ( rc == 0 && done < run->count )
+            {
+                uint64_t n = run->count - done;
+                size_t to_read, num_read;
+                if ( n > MATECACHE_SPILL_BUF )
+                    n = MATECACHE_SPILL_BUF;
+                to_read = n * sizeof buf[ 0 ];
+                rc = KFileReadAll( self->spill_file, run->offset + done * sizeof buf[ 0 ], buf, to_read, &num_read );
+                if ( rc == 0 && num_read != to_read )
+                    rc = RC( rcApp, rcFile, rcReading, rcTransfer, rcIncomplete );
                 if ( rc != 0 )
-                    (void)LOGERR( klogErr, rc, "cannot make same-ref-cache (16bit)" );
+                    (void)LOGERR( klogErr, rc, "cannot read from mate-cache spill-file" );
+                else
+                {
+                    uint64_t i;
+                    for ( i = 0; rc == 0 && i < n; ++i )
+                    {
+                        if ( MATE_POS( buf[ i ].aux ) >= mcpf->pos )
+                            rc = mate_hash_put( &mcpf->same_ref, buf[ i ].key, buf[ i ].value, buf[ i ].aux );
+                        else
+                            mcpf->evicted++;
+                    }
+                    mcpf->reloaded += n;
+                    done += n;
+                }
+            }
+            /* the run is done, the last one takes its place */
+            mcpf->runs[ idx ] = mcpf->runs[ --mcpf->run_count ];
+        }
+    }
+    free( buf );
+
+    for ( idx = 0; idx < mcpf->run_count; ++idx )
+    {
+        if ( idx == 0 || mcpf->runs[ idx ].min_mate_pos < mcpf->next_reload )
+            mcpf->next_reload = mcpf->runs[ idx ].min_mate_pos;
+    }
+    mcpf->stat_same_ref.count = mcpf->same_ref.count;
+    return rc;
+}
+
+
+static size_t matecache_same_ref_bytes( const matecache * const self )
+{
+    size_t res = 0;
+    uint32_t idx;
+    for ( idx = 0; idx < self->count; ++idx )
+        res += mate_hash_bytes( &self->per_file[ idx ].same_ref );
+    return res;
+}
+
+
+/* called after every insert: a table only grows by resizing, so the limit is only
+   acted upon if the caches have grown since the last call, the largest table
+   drops its passed mates and, if that is not enough, spills its cold entries */
+static rc_t matecache_enforce_mem_limit( matecache * const self )
+{
+    rc_t rc = 0;
+    size_t bytes = matecache_same_ref_bytes( self );
+    if ( bytes > self->mem_limit && bytes > self->same_ref_bytes )
+    {
+        matecache_per_file * largest = &self->per_file[ 0 ];
+        uint32_t idx;
+        for ( idx = 1; idx < self->count; ++idx )
+        {
+            if ( mate_hash_bytes( &self->per_file[ idx ].same_ref ) > mate_hash_bytes( &largest->same_ref ) )
+                largest = &self->per_file[ idx ];
+        }
+
+        largest->evicted += mate_hash_evict( &largest->same_ref, mate_passed, &largest->pos );
+        largest->stat_same_ref.count = largest->same_ref.count;
+        if ( matecache_same_ref_bytes( self ) > self->mem_limit )
+            rc = matecache_spill( self, largest );
+        bytes = matecache_same_ref_bytes( self );
+    }
+    self->same_ref_bytes = bytes;
+    return rc;
+}
+
+
+static bool matecache_has_runs( const matecache * const self )
+{
+    uint32_t idx;
+    for ( idx = 0; idx < self->count; ++idx )
+    {
+        if ( self->per_file[ idx ].run_count > 0 )
+            return true;
+    }
+    return false;
+}
+
+
+rc_t matecache_advance_same_ref( matecache * const self, INSDC_coord_zero pos )
+{
+    rc_t rc = 0;
+    if ( self == NULL )
+    {
+        rc = RC( rcApp, rcNoTarg, rcAccessing, rcSelf, rcNull );
+        (void)LOGERR( klogErr, rc, "cannot advance same-ref-cache" );
+    }
+    else
+    {
+        uint32_t idx;
+        for ( idx = 0; idx < self->count && rc == 0; ++idx )
+        {
+            matecache_per_file * mcpf = &self->per_file[ idx ];
+            mcpf->pos = pos;
+
+            if ( mcpf->run_count > 0 && mcpf->next_reload <= pos )
+            {
+                rc = matecache_reload( self, mcpf );
+                if ( rc == 0 && !matecache_has_runs( self ) )
+                    self->spill_pos = 0;
+            }
+
+            /* batched: the table is only scanned after it has doubled since the last time */
+            if ( rc == 0 && mcpf->same_ref.count >= mcpf->evict_at )
+            {
+                mcpf->evicted += mate_hash_evict( &mcpf->same_ref, mate_passed, &mcpf->pos );
+                mcpf->stat_same_ref.count = mcpf->same_ref.count;
+
+                mcpf->evict_at = mcpf->same_ref.count * 2;
+                if ( mcpf->evict_at < MATECACHE_MIN_EVICT )
+                    mcpf->evict_at = MATECACHE_MIN_EVICT;
             }
         }
     }
@@ -293,10 +605,18 @@ rc_t matecache_clear_same_ref( matecache * const self )
     else
     {
         uint32_t idx;
-        for ( idx = 0; idx < self->count && rc == 0; ++idx )
+        for ( idx = 0; idx < self->count; ++idx )
         {
-            rc = matecache_clear_same_ref_per_file( &self->per_file[ idx ] );
+            matecache_per_file * mcpf = &self->per_file[ idx ];
+            mate_hash_clear( &mcpf->same_ref );
+            mcpf->run_count = 0;
+            mcpf->pos = 0;
+            mcpf->evict_at = MATECACHE_MIN_EVICT;
+            mcpf->stat_same_ref.count = 0;
         }
+        /* the spill-file is reused from the start for the next reference */
+        self->spill_pos = 0;
+        self->same_ref_bytes = 0;
         self->flashes++;
    }
     return rc;
@@ -316,26 +636,35 @@ rc_t matecache_report( const matecache * const self )
         uint32_t idx;
         for ( idx = 0; idx < self->count && rc == 0; ++idx )
         {
+            const matecache_per_file * mcpf = &self->per_file[ idx ];
             rc = KOutMsg( "on same reference:\n" );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].maxcount = %,lu\n", idx, self->per_file[ idx ].maxcount_same_ref );
+                rc = KOutMsg( "matecache[ %u ].maxcount = %,lu\n", idx, mcpf->maxcount_same_ref );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].inserts = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.inserts );
+                rc = KOutMsg( "matecache[ %u ].inserts = %,lu\n", idx, mcpf->stat_same_ref.inserts );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].lookups = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.lookups );
+                rc = KOutMsg( "matecache[ %u ].lookups = %,lu\n", idx, mcpf->stat_same_ref.lookups );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, self->per_file[ idx ].stat_same_ref.finds );
+                rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, mcpf->stat_same_ref.finds );
+            if ( rc == 0 )
+                rc = KOutMsg( "matecache[ %u ].evicted = %,lu\n", idx, mcpf->evicted );
+            if ( rc == 0 )
+                rc = KOutMsg( "matecache[ %u ].spilled = %,lu\n", idx, mcpf->spilled );
+            if ( rc == 0 )
+                rc = KOutMsg( "matecache[ %u ].reloaded = %,lu\n", idx, mcpf->reloaded );
             if ( rc == 0 )
                 rc = KOutMsg( "unaligned:\n" );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].count = %,lu\n", idx, self->per_file[ idx ].stat_unaligned.count );
+                rc = KOutMsg( "matecache[ %u ].count = %,lu\n", idx, mcpf->stat_unaligned.count );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].lookups = %,lu\n", idx, self->per_file[ idx ].stat_unaligned.lookups );
+                rc = KOutMsg( "matecache[ %u ].lookups = %,lu\n", idx, mcpf->stat_unaligned.lookups );
             if ( rc == 0 )
-                rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, self->per_file[ idx ].stat_unaligned.finds );
+                rc = KOutMsg( "matecache[ %u ].finds = %,lu\n", idx, mcpf->stat_unaligned.finds );
         }
         if ( rc == 0 )
-            rc = KOutMsg( "matecache.flashes = %,lu\n", idx, self->flashes );
+            rc = KOutMsg( "matecache.flashes = %,u\n", self->flashes );
+        if ( rc == 0 )
+            rc = KOutMsg( "matecache.spills = %,u\n", self->spills );
     }
     return rc;
 }
@@ -351,18 +680,10 @@ rc_t matecache_insert_unaligned( matecache * const self,
         uint64_t ref_pos_and_ref_idx = ref_pos;
         ref_pos_and_ref_idx <<= 32;
         ref_pos_and_ref_idx |= ref_idx;
-        rc = KVectorSetU64( mcpf->unaligned_64_a, key, ref_pos_and_ref_idx );
-        if ( rc != 0 )
-            (void)LOGERR( klogErr, rc, "cannot insert into KVector (unaligned a) U64" );
-        else
-        {
-            rc = KVectorSetU64( mcpf->unaligned_64_b, key, seq_id );
-            if ( rc != 0 )
-                (void)LOGERR( klogErr, rc, "cannot insert into KVector (unaligned b) U64" );
-        }
+        rc = mate_hash_put( &mcpf->unaligned, key, ref_pos_and_ref_idx, ( uint64_t )seq_id );
         if ( rc == 0 )
         {
-            mcpf->stat_unaligned.count++;
+            mcpf->stat_unaligned.count = mcpf->unaligned.count;
             mcpf->stat_unaligned.inserts++;
         }
     }
@@ -377,50 +698,22 @@ rc_t matecache_lookup_unaligned( const matecache * const self, uint32_t db_idx,
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        uint64_t value64_a;
+        uint64_t value, aux;
         mcpf->stat_unaligned.lookups++;
-        rc = KVectorGetU64( mcpf->unaligned_64_a, key, &value64_a );
-        if ( rc != 0 )
-        {
-            if ( GetRCState( rc ) != rcNotFound )
-                (void)LOGERR( klogErr, rc, "cannot retrieve value (unaligned a) U64" );
-        }
+        if ( !mate_hash_get( &mcpf->unaligned, key, &value, &aux ) )
+            rc = RC( rcApp, rcNoTarg, rcAccessing, rcItem, rcNotFound );
         else
         {
-            uint64_t value64_b;
-            rc = KVectorGetU64( mcpf->unaligned_64_b, key, &value64_b );
-            if ( rc != 0 )
-            {
-                if ( GetRCState( rc ) != rcNotFound )
-                    (void)LOGERR( klogErr, rc, "cannot retrieve value (unaligned b) U64" );
-            }
-            else
-            {
-                *seq_id = ( int64_t )value64_b;
-                *ref_pos = ( value64_a >> 32 );
-                *ref_idx = ( value64_a & 0xFFFFFFFF );
-                mcpf->stat_unaligned.finds++;
-            }
+            *seq_id = ( int64_t )aux;
+            *ref_pos = ( value >> 32 );
+            *ref_idx = ( value & 0xFFFFFFFF );
+            mcpf->stat_unaligned.finds++;
         }
     }
     return rc;
 }
 
 
-typedef struct visit_ctx
-{
-    rc_t ( CC * f ) ( int64_t seq_id, int64_t al_id, void * user_data );
-    void * user_data;
-} visit_ctx;
-
-
-static rc_t CC on_seq_id( uint64_t key, int64_t value, void *user_data )
-{
-    visit_ctx * vctx = user_data;
-    return vctx->f( value, ( int64_t )key, vctx->user_data );
-}
-
-
 rc_t foreach_unaligned_entry( const matecache * const self,
                               uint32_t db_idx,
                               rc_t ( CC * f ) ( int64_t seq_id, int64_t al_id, void * user_data ),
@@ -430,10 +723,65 @@ rc_t foreach_unaligned_entry( const matecache * const self,
     rc_t rc = matecache_check( self, db_idx, &mcpf );
     if ( rc == 0 )
     {
-        visit_ctx vctx;
-        vctx.f = f;
-        vctx.user_data = user_data;
-        rc = KVectorVisitI64 ( mcpf->unaligned_64_b, false, on_seq_id, &vctx );
+        /* visit in the order of the alignment-id, lookups still work on the sorted table */
+        uint64_t idx;
+        mate_hash_sort( &mcpf->unaligned );
+        for ( idx = 0; idx < mcpf->unaligned.count && rc == 0; ++idx )
+        {
+            const mate_hash_entry * entry = &mcpf->unaligned.entries[ idx ];
+            rc = f( ( int64_t )entry->aux, entry->key, user_data );
+        }
+    }
+    return rc;
+}
+
+
+rc_t matecache_merge_unaligned( matecache * const self, const matecache * const src )
+{
+    rc_t rc = 0;
+    if ( self == NULL || src == NULL )
+    {
+        rc = RC( rcApp, rcNoTarg, rcAccessing, rcSelf, rcNull );
+        (void)LOGERR( klogErr, rc, "cannot merge unaligned-cache" );
+    }
+    else
+    {
+        uint32_t idx;
+        for ( idx = 0; idx < self->count && idx < src->count && rc == 0; ++idx )
+        {
+            matecache_per_file * dst = &self->per_file[ idx ];
+            const matecache_per_file * s = &src->per_file[ idx ];
+            uint64_t i, n = s->unaligned.sorted ? s->unaligned.count : s->unaligned.capacity;
+            for ( i = 0; i < n && rc == 0; ++i )
+            {
+                const mate_hash_entry * entry = &s->unaligned.entries[ i ];
+                if ( entry->key != 0 )
+                {
+                    rc = mate_hash_put( &dst->unaligned, entry->key, entry->value, entry->aux );
+                    if ( rc == 0 )
+                        dst->stat_unaligned.inserts++;
+                }
+            }
+            if ( rc == 0 )
+            {
+                dst->stat_unaligned.count = dst->unaligned.count;
+                dst->stat_unaligned.lookups += s->stat_unaligned.lookups;
+                dst->stat_unaligned.finds += s->stat_unaligned.finds;
+                dst->stat_same_ref.inserts += s->stat_same_ref.inserts;
+                dst->stat_same_ref.lookups += s->stat_same_ref.lookups;
+                dst->stat_same_ref.finds += s->stat_same_ref.finds;
+                dst->evicted += s->evicted;
+                dst->spilled += s->spilled;
+                dst->reloaded += s->reloaded;
+                if ( s->maxcount_same_ref > dst->maxcount_same_ref )
+                    dst->maxcount_same_ref = s->maxcount_same_ref;
+            }
+        }
+        if ( rc == 0 )
+        {
+            self->flashes += src->flashes;
+            self->spills += src->spills;
+        }
     }
     return rc;
 }
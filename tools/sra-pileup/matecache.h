@@ -33,14 +33,17 @@ extern "C" {
 }
 #endif
 
-#include <klib/vector.h>
 #include <klib/out.h>
 #include <klib/text.h>
 #include <klib/rc.h>
 #include <klib/log.h>
 
+#include <kfs/file.h>
+
 #include <insdc/sra.h>
 
+#include "mate_hash.h"
+
 typedef struct matecache_stat
 {
     uint64_t count;
@@ -50,31 +53,58 @@ typedef struct matecache_stat
 } matecache_stat;
 
 
+/* a block of same-ref-entries written to the spill-file,
+   all of them have their mate at or after min_mate_pos */
+typedef struct matecache_spill_run
+{
+    uint64_t offset;
+    uint64_t count;
+    INSDC_coord_zero min_mate_pos;
+} matecache_spill_run;
+
+
 typedef struct matecache_per_file
 {
-    KVector *same_ref_64;   /* ref-pos and ref-idx */
-    KVector *same_ref_16;   /* flags */
+    /* key: row-id, value: ref-pos and tlen, aux: mate-pos and flags */
+    mate_hash same_ref;
+
+    /* key: row-id, value: ref-pos and ref-idx, aux: seq_spot_id */
+    mate_hash unaligned;
+
+    matecache_spill_run * runs;
+    uint32_t run_count;
+    uint32_t run_capacity;
 
-    KVector *unaligned_64_a;  /* ref-pos and ref-idx */
-    KVector *unaligned_64_b;  /* seq_spot_id */
+    INSDC_coord_zero pos;       /* where the walker is on the current reference */
+    INSDC_coord_zero next_reload;  /* smallest min_mate_pos of the runs */
+    uint64_t evict_at;          /* count of same_ref that triggers the next eviction */
 
     matecache_stat stat_same_ref;
     matecache_stat stat_unaligned;
     uint64_t maxcount_same_ref;
+    uint64_t evicted;
+    uint64_t spilled;
+    uint64_t reloaded;
 } matecache_per_file;
 
 
 typedef struct matecache
 {
     matecache_per_file *per_file;
+    KFile * spill_file;         /* created on the first spill */
+    uint64_t spill_pos;
+    size_t mem_limit;           /* 0 ... unlimited */
+    size_t same_ref_bytes;      /* used by the same-ref-caches when the limit was last checked */
     uint32_t count;
     uint32_t flashes;
+    uint32_t spills;
 } matecache;
 
 
 /* general cache functions */
 
-rc_t make_matecache( matecache **self, uint32_t count );
+/* mem_limit ... bytes the same-ref-caches may use before entries are spilled to disk, 0 = no limit */
+rc_t make_matecache( matecache **self, uint32_t count, size_t mem_limit );
 
 void release_matecache( matecache * const self );
 
@@ -85,14 +115,21 @@ rc_t matecache_report( const matecache * const self );
 
 /* cache functions for aligned mates on the same reference */
 
+/* mate_pos ... where the mate will be found, the entry is dropped when the walker has passed it */
 rc_t matecache_insert_same_ref( matecache * const self,
-        uint32_t db_idx, int64_t key, INSDC_coord_zero ref_pos, uint32_t flags, INSDC_coord_len tlen );
+        uint32_t db_idx, int64_t key, INSDC_coord_zero ref_pos, uint32_t flags, INSDC_coord_len tlen,
+        INSDC_coord_zero mate_pos );
 
 rc_t matecache_lookup_same_ref( const matecache * const self, uint32_t db_idx, int64_t key,
                        INSDC_coord_zero *ref_pos, uint32_t *flags, INSDC_coord_len *tlen );
 
 rc_t matecache_remove_same_ref( matecache * const self, uint32_t db_idx, int64_t key );
 
+/* the walker has arrived at pos on the current reference:
+   evicts entries whose mate has been passed, reloads spilled entries whose mate is due
+   ( entries are spilled by matecache_insert_same_ref() to stay within mem_limit ) */
+rc_t matecache_advance_same_ref( matecache * const self, INSDC_coord_zero pos );
+
 
 /* cache functions for half aligned mates */
 
@@ -115,5 +152,9 @@ rc_t foreach_unaligned_entry( const matecache * const self,
                               rc_t ( CC * f ) ( int64_t seq_id, int64_t al_id, void * user_data ),
                               void * user_data );
 
+/* copies the unaligned entries ( and the statistics ) of src into self,
+   used to collect the caches of the worker-threads */
+rc_t matecache_merge_unaligned( matecache * const self, const matecache * const src );
+
 
 #endif
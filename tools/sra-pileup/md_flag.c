@@ -157,14 +157,57 @@ void free_cigar_t( struct cigar_t * c )
 }
 
 
-static rc_t kout_delete( int count, int *match_count,
+/* the tag is printed via KOutMsg(), or collected in a buffer ( for the BAM-output ) */
+struct md_sink
+{
+	char * data;
+	size_t used;
+	size_t size;
+	bool to_buffer;
+};
+
+
+static rc_t md_put( struct md_sink * sink, const char * s, size_t len )
+{
+	if ( !sink->to_buffer )
+		return KOutMsg( "%.*s", ( uint32_t )len, s );
+	if ( sink->used + len > sink->size )
+	{
+		size_t new_size = ( sink->size > 0 ) ? sink->size * 2 : 256;
+		char * tmp;
+		while ( new_size < sink->used + len )
+			new_size *= 2;
+		tmp = realloc( sink->data, new_size );
+		if ( tmp == NULL )
+			return RC( rcExe, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+		sink->data = tmp;
+		sink->size = new_size;
+	}
+	memmove( sink->data + sink->used, s, len );
+	sink->used += len;
+	return 0;
+}
+
+
+static rc_t md_num( struct md_sink * sink, int value )
+{
+	char tmp[ 32 ];
+	size_t num_writ;
+	rc_t rc = string_printf( tmp, sizeof tmp, &num_writ, "%d", value );
+	if ( rc == 0 )
+		rc = md_put( sink, tmp, num_writ );
+	return rc;
+}
+
+
+static rc_t kout_delete( struct md_sink * sink, int count, int *match_count,
 						 const uint8_t * ref, const INSDC_coord_len ref_len, int *ref_idx )
 {
 	rc_t rc = 0;
 	
 	if ( *match_count > 0 )
 	{
-		rc = KOutMsg( "%d", *match_count );
+		rc = md_num( sink, *match_count );
 		*match_count = 0;
 	}
 	
@@ -172,7 +215,9 @@ static rc_t kout_delete( int count, int *match_count,
 	{
 		if ( ( *ref_idx + count ) < ref_len )
 		{
-			rc = KOutMsg( "^%.*s", count, &(ref[ *ref_idx ] ) );
+			rc = md_put( sink, "^", 1 );
+			if ( rc == 0 )
+				rc = md_put( sink, ( const char * )&( ref[ *ref_idx ] ), count );
 			(*ref_idx) += count;
 		}
 		else
@@ -182,7 +227,7 @@ static rc_t kout_delete( int count, int *match_count,
 }
 
 
-static rc_t kout_match( int count, int *match_count,
+static rc_t kout_match( struct md_sink * sink, int count, int *match_count,
 						const char * read, size_t read_len, int *read_idx,
 						const uint8_t *ref, const INSDC_coord_len ref_len, int *ref_idx )
 {
@@ -198,7 +243,9 @@ static rc_t kout_match( int count, int *match_count,
 			}
 			else
 			{
-				rc = KOutMsg( "%d%c", *match_count, ref[ *ref_idx ] );
+				rc = md_num( sink, *match_count );
+				if ( rc == 0 )
+					rc = md_put( sink, ( const char * )&( ref[ *ref_idx ] ), 1 );
 				*match_count = 0;
 			}
 			(*ref_idx)++;
@@ -210,7 +257,8 @@ static rc_t kout_match( int count, int *match_count,
 }
 
 
-static rc_t kout_tag( const struct cigar_t * c,
+static rc_t kout_tag( struct md_sink * sink,
+					  const struct cigar_t * c,
 					  const char * read,
 					  const size_t read_len,
 					  const uint8_t * ref,
@@ -219,7 +267,8 @@ static rc_t kout_tag( const struct cigar_t * c,
 	rc_t rc = 0;
 	if ( c != NULL && read != NULL && read_len > 0 && ref != NULL && ref_len > 0 )
 	{
-		rc = KOutMsg( "\tMD:Z:" );
+		if ( !sink->to_buffer )
+			rc = KOutMsg( "\tMD:Z:" );
 		if ( rc == 0 )
 		{
 			int read_idx = 0;
@@ -231,15 +280,15 @@ static rc_t kout_tag( const struct cigar_t * c,
 				int count = c->count[ cigar_idx ];
 				switch ( c->op[ cigar_idx ] )
 				{
-					case 'D' : rc = kout_delete( count, &match_count, ref, ref_len, &ref_idx ); break;
+					case 'D' : rc = kout_delete( sink, count, &match_count, ref, ref_len, &ref_idx ); break;
 					
 					case 'I' : read_idx += count; break;
 
-					case 'M' : rc = kout_match( count, &match_count, read, read_len, &read_idx, ref, ref_len, &ref_idx ); break;
+					case 'M' : rc = kout_match( sink, count, &match_count, read, read_len, &read_idx, ref, ref_len, &ref_idx ); break;
 				}
 			}
 			if ( rc == 0 && match_count > 0 )
-				rc = KOutMsg( "%d", match_count );
+				rc = md_num( sink, match_count );
 		}
 	}
 	else
@@ -261,8 +310,44 @@ rc_t kout_md_tag_from_cigar_string( const char * cigar_str,
 		rc = RC( rcExe, rcNoTarg, rcAllocating, rcItem, rcIncomplete );
 	else
 	{
-		rc = kout_tag( cigar, read, read_len, ref, ref_len );
+		struct md_sink sink;
+		memset( &sink, 0, sizeof sink );
+		rc = kout_tag( &sink, cigar, read, read_len, ref, ref_len );
 		free_cigar_t( cigar );
 	}
 	return rc;
 }
+
+
+rc_t md_tag_from_cigar_string( const char * cigar_str,
+							   const size_t cigar_len,
+							   const char * read,
+							   const size_t read_len,
+							   const uint8_t * ref,
+							   const INSDC_coord_len ref_len,
+							   char ** value,
+							   size_t * value_len )
+{
+	rc_t rc = 0;
+	struct cigar_t * cigar = make_cigar_t( cigar_str, cigar_len );
+	*value = NULL;
+	*value_len = 0;
+	if ( cigar == NULL )
+		rc = RC( rcExe, rcNoTarg, rcAllocating, rcItem, rcIncomplete );
+	else
+	{
+		struct md_sink sink;
+		memset( &sink, 0, sizeof sink );
+		sink.to_buffer = true;
+		rc = kout_tag( &sink, cigar, read, read_len, ref, ref_len );
+		free_cigar_t( cigar );
+		if ( rc == 0 )
+		{
+			*value = sink.data;
+			*value_len = sink.used;
+		}
+		else if ( sink.data != NULL )
+			free( sink.data );
+	}
+	return rc;
+}
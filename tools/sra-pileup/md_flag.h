@@ -41,6 +41,16 @@ rc_t kout_md_tag_from_cigar_string( const char * cigar_str,
 									const uint8_t * ref,
 									const INSDC_coord_len ref_len );
 
+/* the value of the same tag ( without "MD:Z:" ) in a buffer, to be released with free() */
+rc_t md_tag_from_cigar_string( const char * cigar_str,
+							   const size_t cigar_len,
+							   const char * read,
+							   const size_t read_len,
+							   const uint8_t * ref,
+							   const INSDC_coord_len ref_len,
+							   char ** value,
+							   size_t * value_len );
+
 #ifdef __cplusplus
 }
 #endif
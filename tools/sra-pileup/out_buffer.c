@@ -0,0 +1,151 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "out_buffer.h"
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the buffer attached to the calling thread */
+#if defined( _MSC_VER )
+static __declspec( thread ) out_buffer * tl_out_buffer = NULL;
+#else
+static __thread out_buffer * tl_out_buffer = NULL;
+#endif
+
+
+rc_t init_out_buffer( out_buffer * self, size_t size )
+{
+    rc_t rc = 0;
+    self->used = 0;
+    self->size = 0;
+    self->data = malloc( size );
+    if ( self->data == NULL )
+    {
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        LOGERR( klogErr, rc, "cannot allocate output-buffer" );
+    }
+    else
+        self->size = size;
+    return rc;
+}
+
+
+void release_out_buffer( out_buffer * self )
+{
+    if ( self->data != NULL )
+        free( self->data );
+    self->data = NULL;
+    self->used = 0;
+    self->size = 0;
+}
+
+
+static rc_t append_to_out_buffer( out_buffer * self, const char * buffer, size_t bufsize )
+{
+    if ( self->used + bufsize > self->size )
+    {
+        size_t new_size = ( self->size > 0 ) ? self->size : 4096;
+        char * tmp;
+        while ( new_size < self->used + bufsize )
+            new_size *= 2;
+        tmp = realloc( self->data, new_size );
+        if ( tmp == NULL )
+            return RC( rcApp, rcNoTarg, rcWriting, rcMemory, rcExhausted );
+        self->data = tmp;
+        self->size = new_size;
+    }
+    memmove( self->data + self->used, buffer, bufsize );
+    self->used += bufsize;
+    return 0;
+}
+
+
+static rc_t CC out_buffer_callback( void * self, const char * buffer, size_t bufsize, size_t * num_writ )
+{
+    rc_t rc;
+    out_buffer * ob = tl_out_buffer;
+    if ( ob == NULL )
+    {
+        out_buffer_redir * redir = ( out_buffer_redir * )self;
+        rc = redir->org_writer( redir->org_data, buffer, bufsize, num_writ );
+    }
+    else
+    {
+        rc = append_to_out_buffer( ob, buffer, bufsize );
+        *num_writ = ( rc == 0 ) ? bufsize : 0;
+    }
+    return rc;
+}
+
+
+rc_t init_out_buffer_redir( out_buffer_redir * self )
+{
+    rc_t rc;
+    self->org_writer = KOutWriterGet();
+    self->org_data = KOutDataGet();
+    rc = KOutHandlerSet( out_buffer_callback, self );
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "KOutHandlerSet() failed" );
+        self->org_writer = NULL;
+    }
+    return rc;
+}
+
+
+void release_out_buffer_redir( out_buffer_redir * self )
+{
+    if( self->org_writer != NULL )
+    {
+        KOutHandlerSet( self->org_writer, self->org_data );
+    }
+    self->org_writer = NULL;
+}
+
+
+void attach_out_buffer( out_buffer * buffer )
+{
+    tl_out_buffer = buffer;
+}
+
+
+rc_t flush_out_buffer( const out_buffer_redir * self, out_buffer * buffer )
+{
+    rc_t rc = 0;
+    size_t written = 0;
+    while ( rc == 0 && written < buffer->used )
+    {
+        size_t num_writ = 0;
+        rc = self->org_writer( self->org_data, buffer->data + written, buffer->used - written, &num_writ );
+        if ( rc == 0 && num_writ == 0 )
+            rc = RC( rcApp, rcNoTarg, rcWriting, rcTransfer, rcIncomplete );
+        written += num_writ;
+    }
+    buffer->used = 0;
+    return rc;
+}
@@ -0,0 +1,78 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_out_buffer_
+#define _h_out_buffer_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/out.h>
+#include <klib/rc.h>
+#include <klib/log.h>
+
+/* a growing memory-buffer, collecting the output of one worker-thread-job */
+typedef struct out_buffer
+{
+    char * data;
+    size_t used;
+    size_t size;
+} out_buffer;
+
+
+rc_t init_out_buffer( out_buffer * self, size_t size );
+
+void release_out_buffer( out_buffer * self );
+
+
+/* GLOBAL VARIABLES
+   while installed, everything printed via KOutMsg() by a thread that has an out_buffer
+   attached goes into that buffer, threads without a buffer write into the original writer */
+typedef struct out_buffer_redir
+{
+    KWrtWriter org_writer;
+    void* org_data;
+} out_buffer_redir;
+
+
+rc_t init_out_buffer_redir( out_buffer_redir * self );
+
+void release_out_buffer_redir( out_buffer_redir * self );
+
+/* attach the buffer to the calling thread, NULL detaches */
+void attach_out_buffer( out_buffer * buffer );
+
+/* write the content of the buffer into the original writer, and empty the buffer */
+rc_t flush_out_buffer( const out_buffer_redir * self, out_buffer * buffer );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
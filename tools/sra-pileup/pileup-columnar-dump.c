@@ -0,0 +1,90 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/* example for the columnar reader: prints the blocks as tab-separated text,
+   one line per position
+
+   pileup-columnar-dump file [ file ... ]
+*/
+
+#include "pileup_columnar_reader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int dump_file( const char * path )
+{
+    pcol_reader * reader;
+    int res = pcol_reader_open( &reader, path );
+    if ( res != 0 )
+        fprintf( stderr, "cannot open '%s' : %s\n", path, strerror( res ) );
+    else
+    {
+        pcol_block block;
+        while ( ( res = pcol_reader_next( reader, &block ) ) > 0 )
+        {
+            uint32_t idx;
+            for ( idx = 0; idx < block.count; ++idx )
+            {
+                printf( "%.*s\t%u\t%c\t%u\tA:%u\tC:%u\tG:%u\tT:%u\tN:%u\tI:%u\tD:%u\t+%u\t-%u\n",
+                        ( int )block.ref_name_len, block.ref_name,
+                        block.column[ pcol_pos ][ idx ],
+                        block.ref_base[ idx ],
+                        block.column[ pcol_depth ][ idx ],
+                        block.column[ pcol_base_a ][ idx ],
+                        block.column[ pcol_base_c ][ idx ],
+                        block.column[ pcol_base_g ][ idx ],
+                        block.column[ pcol_base_t ][ idx ],
+                        block.column[ pcol_base_n ][ idx ],
+                        block.column[ pcol_ins ][ idx ],
+                        block.column[ pcol_del ][ idx ],
+                        block.column[ pcol_fwd ][ idx ],
+                        block.column[ pcol_rev ][ idx ] );
+            }
+        }
+        if ( res < 0 )
+            fprintf( stderr, "corrupt block in '%s' : %s\n", path, strerror( -res ) );
+        pcol_reader_close( reader );
+    }
+    return res;
+}
+
+
+int main ( int argc, char *argv [] )
+{
+    int i, res = 0;
+
+    if ( argc < 2 )
+    {
+        fprintf( stderr, "usage: %s file [ file ... ]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    for ( i = 1; i < argc && res == 0; ++i )
+        res = dump_file( argv[ i ] );
+
+    return ( res == 0 ) ? 0 : 2;
+}
@@ -0,0 +1,308 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <klib/out.h>
+#include <klib/text.h>
+#include <klib/log.h>
+#include <klib/rc.h>
+
+#include "ref_walker_0.h"
+#include "4na_ascii.h"
+#include "pileup_columnar.h"
+#include "pileup_columnar_fmt.h"
+#include "pileup_histogram.h"
+
+#include <zlib.h>
+
+typedef struct columnar_block
+{
+    uint32_t * columns[ pcol_u32_columns ];
+    uint8_t * ref_bases;
+    uint32_t count;
+    pileup_codes codes;     /* the alignments at the current position */
+
+    uint8_t * raw;          /* the serialized payload */
+    uint8_t * packed;       /* the deflated payload */
+    uLong packed_size;
+    bool deflate;
+} columnar_block;
+
+
+static rc_t make_columnar_block( columnar_block * self, bool deflate )
+{
+    rc_t rc = 0;
+    uint32_t i;
+
+    memset( self, 0, sizeof * self );
+    init_pileup_codes( &self->codes );
+    self->deflate = deflate;
+    for ( i = 0; i < pcol_u32_columns && rc == 0; ++i )
+    {
+        self->columns[ i ] = malloc( PCOL_BLOCK_POSITIONS * sizeof( uint32_t ) );
+        if ( self->columns[ i ] == NULL )
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    if ( rc == 0 )
+    {
+        self->ref_bases = malloc( PCOL_BLOCK_POSITIONS );
+        self->raw = malloc( PCOL_PAD8( PCOL_RAW_SIZE( PCOL_BLOCK_POSITIONS ) ) );
+        if ( self->ref_bases == NULL || self->raw == NULL )
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    if ( rc == 0 && deflate )
+    {
+        self->packed_size = compressBound( PCOL_RAW_SIZE( PCOL_BLOCK_POSITIONS ) );
+        self->packed = malloc( PCOL_PAD8( self->packed_size ) );
+        if ( self->packed == NULL )
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+    }
+    if ( rc != 0 )
+    {
+        LOGERR( klogErr, rc, "cannot allocate columnar block" );
+    }
+    return rc;
+}
+
+
+static void release_columnar_block( columnar_block * self )
+{
+    uint32_t i;
+    for ( i = 0; i < pcol_u32_columns; ++i )
+        free( self->columns[ i ] );
+    free( self->ref_bases );
+    free( self->raw );
+    free( self->packed );
+    release_pileup_codes( &self->codes );
+}
+
+
+/* the binary data bypasses KOutMsg(), it goes directly into the installed writer */
+static rc_t write_columnar_bytes( const void * data, size_t size )
+{
+    rc_t rc = 0;
+    KWrtWriter writer = KOutWriterGet();
+    void * writer_data = KOutDataGet();
+    const char * p = data;
+
+    while ( rc == 0 && size > 0 )
+    {
+        size_t num_writ = 0;
+        rc = writer( writer_data, p, size, &num_writ );
+        if ( rc != 0 )
+        {
+            LOGERR( klogErr, rc, "cannot write columnar block" );
+        }
+        else if ( num_writ == 0 )
+        {
+            rc = RC( rcApp, rcFile, rcWriting, rcTransfer, rcIncomplete );
+            LOGERR( klogErr, rc, "cannot write columnar block" );
+        }
+        else
+        {
+            p += num_writ;
+            size -= num_writ;
+        }
+    }
+    return rc;
+}
+
+
+static rc_t write_columnar_padded( const void * data, size_t size )
+{
+    static const uint8_t zeros[ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    rc_t rc = write_columnar_bytes( data, size );
+    if ( rc == 0 && PCOL_PAD8( size ) > size )
+        rc = write_columnar_bytes( zeros, PCOL_PAD8( size ) - size );
+    return rc;
+}
+
+
+static rc_t flush_columnar_block( columnar_block * self, const char * ref_name )
+{
+    rc_t rc = 0;
+    if ( self->count > 0 )
+    {
+        pcol_block_header hdr;
+        const uint8_t * payload = self->raw;
+        uint8_t * dst = self->raw;
+        size_t col_size = self->count * sizeof( uint32_t );
+        uint32_t i;
+
+        /* the columns are kept at full size while the block fills up, pack them */
+        for ( i = 0; i < pcol_u32_columns; ++i )
+        {
+#ifdef PCOL_BIG_ENDIAN_HOST
+            uint32_t j;
+            for ( j = 0; j < self->count; ++j )
+                ( ( uint32_t * )dst )[ j ] = pcol_le32( self->columns[ i ][ j ] );
+#else
+            memmove( dst, self->columns[ i ], col_size );
+#endif
+            dst += col_size;
+        }
+        memmove( dst, self->ref_bases, self->count );
+
+        memmove( hdr.magic, PCOL_MAGIC, sizeof hdr.magic );
+        hdr.version = PCOL_VERSION;
+        hdr.flags = 0;
+        hdr.name_len = string_size( ref_name );
+        hdr.count = self->count;
+        hdr.raw_size = PCOL_RAW_SIZE( self->count );
+        hdr.payload_size = hdr.raw_size;
+
+        if ( self->deflate )
+        {
+            uLongf packed_size = self->packed_size;
+            int zrc = compress2( self->packed, &packed_size, self->raw, hdr.raw_size, Z_DEFAULT_COMPRESSION );
+            /* incompressible blocks are stored as they are */
+            if ( zrc == Z_OK && packed_size < hdr.raw_size )
+            {
+                hdr.flags |= PCOL_FLAG_DEFLATE;
+                hdr.payload_size = packed_size;
+                payload = self->packed;
+            }
+        }
+
+        {
+            pcol_block_header file_hdr = hdr;
+            PCOL_HEADER_LE( &file_hdr );
+            rc = write_columnar_bytes( &file_hdr, sizeof file_hdr );
+        }
+        if ( rc == 0 )
+            rc = write_columnar_padded( ref_name, hdr.name_len );
+        if ( rc == 0 )
+            rc = write_columnar_padded( payload, hdr.payload_size );
+        self->count = 0;
+    }
+    return rc;
+}
+
+
+/* ........................................................................................... */
+
+
+static rc_t CC walk_columnar_enter_ref_pos( walk_data * data )
+{
+    rc_t rc = 0;
+    columnar_block * block = data->data;
+
+    if ( block->count >= PCOL_BLOCK_POSITIONS )
+        rc = flush_columnar_block( block, data->ref_name );
+    block->codes.count = 0;
+    if ( rc == 0 )
+        rc = reserve_pileup_codes( &block->codes, data->depth ); /* pileup_histogram.c */
+    return rc;
+}
+
+
+/* the collected alignments are counted in one go */
+static rc_t CC walk_columnar_exit_ref_pos( walk_data * data )
+{
+    columnar_block * block = data->data;
+    uint32_t idx = block->count;
+    uint32_t base[ 5 ];
+    pileup_hist hist;
+    char ref_base = _4na_to_ascii( data->ref_base, false );
+    uint32_t i;
+
+    count_pileup_codes( &block->codes, &hist ); /* pileup_histogram.c */
+    for ( i = 0; i < 5; ++i )
+        base[ i ] = hist.bases[ phist_a + i ][ 0 ] + hist.bases[ phist_a + i ][ 1 ];
+
+    /* a match is a base equal to the reference */
+    switch( ref_base )
+    {
+        case 'A' : i = phist_a; break;
+        case 'C' : i = phist_c; break;
+        case 'G' : i = phist_g; break;
+        case 'T' : i = phist_t; break;
+        default  : i = phist_n; break;
+    }
+    base[ i ] += hist.bases[ phist_match ][ 0 ] + hist.bases[ phist_match ][ 1 ];
+
+    block->columns[ pcol_pos ][ idx ] = data->ref_pos + 1;
+    block->columns[ pcol_depth ][ idx ] = data->depth;
+    block->columns[ pcol_base_a ][ idx ] = base[ phist_a ];
+    block->columns[ pcol_base_c ][ idx ] = base[ phist_c ];
+    block->columns[ pcol_base_g ][ idx ] = base[ phist_g ];
+    block->columns[ pcol_base_t ][ idx ] = base[ phist_t ];
+    block->columns[ pcol_base_n ][ idx ] = base[ phist_n ];
+    block->columns[ pcol_ins ][ idx ] = hist.inserts;
+    block->columns[ pcol_del ][ idx ] = hist.deletes;
+    block->columns[ pcol_fwd ][ idx ] = block->codes.count - hist.reverse;
+    block->columns[ pcol_rev ][ idx ] = hist.reverse;
+    block->ref_bases[ idx ] = ref_base;
+    block->count++;
+    return 0;
+}
+
+
+static rc_t CC walk_columnar_placement( walk_data * data )
+{
+    columnar_block * block = data->data;
+    return add_pileup_code( &block->codes, data ); /* pileup_histogram.c */
+}
+
+
+/* a block never spans two windows or two references */
+static rc_t CC walk_columnar_exit_ref_window( walk_data * data )
+{
+    return flush_columnar_block( data->data, data->ref_name );
+}
+
+
+rc_t walk_columnar( ReferenceIterator *ref_iter, pileup_options *options )
+{
+    walk_data data;
+    walk_funcs funcs;
+    columnar_block block;
+
+    rc_t rc = make_columnar_block( &block, options->columnar_deflate );
+    if ( rc == 0 )
+    {
+        data.ref_iter = ref_iter;
+        data.options = options;
+        data.data = &block;
+
+        funcs.on_enter_ref = NULL;
+        funcs.on_exit_ref = NULL;
+
+        funcs.on_enter_ref_window = NULL;
+        funcs.on_exit_ref_window = walk_columnar_exit_ref_window;
+
+        funcs.on_enter_ref_pos = walk_columnar_enter_ref_pos;
+        funcs.on_exit_ref_pos = walk_columnar_exit_ref_pos;
+
+        funcs.on_enter_spotgroup = NULL;
+        funcs.on_exit_spotgroup = NULL;
+
+        funcs.on_placement = walk_columnar_placement;
+
+        rc = walk_0( &data, &funcs );
+    }
+    release_columnar_block( &block );
+    return rc;
+}
@@ -0,0 +1,133 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_pileup_columnar_fmt_
+#define _h_pileup_columnar_fmt_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* the columnar binary pileup-format ( sra-pileup --function columnar )
+
+   the file is a sequence of blocks, every block covers up to PCOL_BLOCK_POSITIONS
+   positions of one reference ( never more than one reference-window ):
+
+        pcol_block_header       32 bytes
+        reference-name          name_len bytes, zero-padded to a multiple of 8
+        payload                 payload_size bytes, zero-padded to a multiple of 8
+
+   the ( inflated ) payload is a struct of arrays, every array has 'count' elements:
+
+        pcol_u32_columns x uint32_t in the order of enum pcol_column
+        1 x uint8_t : the reference-base as ascii-character
+
+   all numbers are little-endian, the arrays start 4-byte-aligned and the blocks
+   8-byte-aligned, that way an uncompressed file can be mmap'ed and the columns
+   can be used in place ( on big-endian hosts writer and reader swap the numbers,
+   the reader then copies the columns instead of using them in place )
+*/
+
+#define PCOL_MAGIC "SPCB"
+#define PCOL_VERSION 1
+#define PCOL_BLOCK_POSITIONS ( 64 * 1024 )
+
+/* flags in pcol_block_header.flags */
+#define PCOL_FLAG_DEFLATE 0x0001  /* the payload is a zlib-stream */
+
+enum pcol_column
+{
+    pcol_pos = 0,       /* 1-based position on the reference */
+    pcol_depth,         /* coverage */
+    pcol_base_a,        /* bases seen in the alignments ( matches and mismatches ),
+                           without the bases below --minbaseq */
+    pcol_base_c,
+    pcol_base_g,
+    pcol_base_t,
+    pcol_base_n,        /* everything else */
+    pcol_ins,           /* alignments with an insertion after this position */
+    pcol_del,           /* alignments with a deletion after this position */
+    pcol_fwd,           /* alignments in reference-orientation */
+    pcol_rev,           /* alignments in reverse orientation */
+    pcol_u32_columns    /* the number of uint32_t-columns */
+};
+
+typedef struct pcol_block_header
+{
+    char magic[ 4 ];        /* PCOL_MAGIC */
+    uint16_t version;       /* PCOL_VERSION */
+    uint16_t flags;         /* PCOL_FLAG_xxx */
+    uint32_t name_len;      /* length of the reference-name, without padding */
+    uint32_t count;         /* number of positions in the block */
+    uint64_t payload_size;  /* size of the stored payload, without padding */
+    uint64_t raw_size;      /* size of the inflated payload */
+} pcol_block_header;
+
+#define PCOL_PAD8( x ) ( ( ( x ) + 7 ) & ~( ( uint64_t )7 ) )
+
+#define PCOL_RAW_SIZE( count ) ( ( ( uint64_t )( count ) * ( 4 * pcol_u32_columns + 1 ) ) )
+
+/* conversion between host-order and the little-endian file-order ( the same in both directions ) */
+#if defined( __BYTE_ORDER__ ) && defined( __ORDER_BIG_ENDIAN__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+#define PCOL_BIG_ENDIAN_HOST 1
+
+static __inline__ uint16_t pcol_le16( uint16_t x )
+{
+    return ( uint16_t )( ( x >> 8 ) | ( x << 8 ) );
+}
+
+static __inline__ uint32_t pcol_le32( uint32_t x )
+{
+    return ( x >> 24 ) | ( ( x >> 8 ) & 0xFF00 ) | ( ( x << 8 ) & 0xFF0000 ) | ( x << 24 );
+}
+
+static __inline__ uint64_t pcol_le64( uint64_t x )
+{
+    return ( ( uint64_t )pcol_le32( ( uint32_t )x ) << 32 ) | pcol_le32( ( uint32_t )( x >> 32 ) );
+}
+#else
+#define pcol_le16( x ) ( x )
+#define pcol_le32( x ) ( x )
+#define pcol_le64( x ) ( x )
+#endif
+
+/* converts the numbers of a header in place */
+#define PCOL_HEADER_LE( hdr )                               \
+    do {                                                    \
+        ( hdr )->version = pcol_le16( ( hdr )->version );   \
+        ( hdr )->flags = pcol_le16( ( hdr )->flags );       \
+        ( hdr )->name_len = pcol_le32( ( hdr )->name_len ); \
+        ( hdr )->count = pcol_le32( ( hdr )->count );       \
+        ( hdr )->payload_size = pcol_le64( ( hdr )->payload_size ); \
+        ( hdr )->raw_size = pcol_le64( ( hdr )->raw_size ); \
+    } while ( 0 )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  _h_pileup_columnar_fmt_ */
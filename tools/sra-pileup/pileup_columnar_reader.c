@@ -0,0 +1,205 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "pileup_columnar_reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+struct pcol_reader
+{
+    const uint8_t * map;
+    size_t map_size;
+    size_t pos;             /* offset of the next block */
+
+    uint8_t * inflated;     /* payload of the current compressed block */
+    size_t inflated_size;
+};
+
+
+int pcol_reader_open( pcol_reader ** reader, const char * path )
+{
+    int res = 0;
+    pcol_reader * self = calloc( 1, sizeof * self );
+    if ( self == NULL )
+        res = ENOMEM;
+    else
+    {
+        int fd = open( path, O_RDONLY );
+        if ( fd < 0 )
+            res = errno;
+        else
+        {
+            struct stat st;
+            if ( fstat( fd, &st ) != 0 )
+                res = errno;
+            else if ( st.st_size > 0 )
+            {
+                void * map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                if ( map == MAP_FAILED )
+                    res = errno;
+                else
+                {
+                    /* the blocks are scanned front to back */
+                    madvise( map, st.st_size, MADV_SEQUENTIAL );
+                    self->map = map;
+                    self->map_size = st.st_size;
+                }
+            }
+            close( fd );
+        }
+        if ( res != 0 )
+            free( self );
+        else
+            *reader = self;
+    }
+    return res;
+}
+
+
+/* hdr->raw_size is bounded by PCOL_BLOCK_POSITIONS */
+static int pcol_reserve( pcol_reader * self, const pcol_block_header * hdr )
+{
+    if ( self->inflated_size < hdr->raw_size )
+    {
+        uint8_t * tmp = realloc( self->inflated, hdr->raw_size );
+        if ( tmp == NULL )
+            return -ENOMEM;
+        self->inflated = tmp;
+        self->inflated_size = hdr->raw_size;
+    }
+    return 0;
+}
+
+
+/* hdr->payload_size is checked against the file */
+static int pcol_inflate( pcol_reader * self, const pcol_block_header * hdr, const uint8_t * src )
+{
+    uLongf dst_size;
+    int res = pcol_reserve( self, hdr );
+    if ( res != 0 )
+        return res;
+    dst_size = hdr->raw_size;
+    if ( uncompress( self->inflated, &dst_size, src, hdr->payload_size ) != Z_OK ||
+         dst_size != hdr->raw_size )
+        return -EINVAL;
+    return 0;
+}
+
+
+int pcol_reader_next( pcol_reader * self, pcol_block * block )
+{
+    pcol_block_header hdr;
+    const uint8_t * payload;
+    uint64_t name_ofs, payload_ofs, end;
+    uint32_t i;
+
+    if ( self == NULL || block == NULL )
+        return -EINVAL;
+    if ( self->pos >= self->map_size )
+        return 0;
+    if ( self->map_size - self->pos < sizeof hdr )
+        return -EINVAL;
+
+    memcpy( &hdr, self->map + self->pos, sizeof hdr );
+    PCOL_HEADER_LE( &hdr );
+    if ( memcmp( hdr.magic, PCOL_MAGIC, sizeof hdr.magic ) != 0 || hdr.version != PCOL_VERSION )
+        return -EINVAL;
+    if ( hdr.count > PCOL_BLOCK_POSITIONS || hdr.raw_size != PCOL_RAW_SIZE( hdr.count ) )
+        return -EINVAL;
+
+    /* the sizes come from the file: check them against what is left of it,
+       before they are padded ( that could wrap around ) or handed to uncompress */
+    name_ofs = self->pos + sizeof hdr;
+    if ( hdr.name_len > self->map_size - name_ofs )
+        return -EINVAL;
+    payload_ofs = name_ofs + PCOL_PAD8( ( uint64_t )hdr.name_len );
+    if ( payload_ofs > self->map_size || hdr.payload_size > self->map_size - payload_ofs )
+        return -EINVAL;
+    end = payload_ofs + PCOL_PAD8( hdr.payload_size );
+    if ( end > self->map_size )
+        return -EINVAL;
+
+    if ( ( hdr.flags & PCOL_FLAG_DEFLATE ) == PCOL_FLAG_DEFLATE )
+    {
+        int res = pcol_inflate( self, &hdr, self->map + payload_ofs );
+        if ( res != 0 )
+            return res;
+        payload = self->inflated;
+    }
+    else if ( hdr.payload_size == hdr.raw_size )
+    {
+#ifdef PCOL_BIG_ENDIAN_HOST
+        /* the columns have to be swapped: they cannot be used in place */
+        int res = pcol_reserve( self, &hdr );
+        if ( res != 0 )
+            return res;
+        memcpy( self->inflated, self->map + payload_ofs, hdr.raw_size );
+        payload = self->inflated;
+#else
+        payload = self->map + payload_ofs;
+#endif
+    }
+    else
+        return -EINVAL;
+
+#ifdef PCOL_BIG_ENDIAN_HOST
+    {
+        uint32_t * values = ( uint32_t * )self->inflated;
+        uint64_t n = ( uint64_t )pcol_u32_columns * hdr.count;
+        for ( i = 0; i < n; ++i )
+            values[ i ] = pcol_le32( values[ i ] );
+    }
+#endif
+
+    block->ref_name = ( const char * )( self->map + name_ofs );
+    block->ref_name_len = hdr.name_len;
+    block->count = hdr.count;
+    for ( i = 0; i < pcol_u32_columns; ++i )
+        block->column[ i ] = ( const uint32_t * )( payload + ( ( size_t )i * hdr.count * sizeof( uint32_t ) ) );
+    block->ref_base = payload + ( ( size_t )pcol_u32_columns * hdr.count * sizeof( uint32_t ) );
+
+    self->pos = end;
+    return 1;
+}
+
+
+void pcol_reader_close( pcol_reader * self )
+{
+    if ( self != NULL )
+    {
+        if ( self->map != NULL )
+            munmap( ( void * )self->map, self->map_size );
+        free( self->inflated );
+        free( self );
+    }
+}
@@ -0,0 +1,67 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_pileup_columnar_reader_
+#define _h_pileup_columnar_reader_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a reader for the output of sra-pileup --function columnar,
+   it depends only on libc and zlib, it can be copied into downstream tools */
+
+#include "pileup_columnar_fmt.h"
+
+#include <stddef.h>
+
+typedef struct pcol_block
+{
+    const char * ref_name;      /* not 0-terminated */
+    uint32_t ref_name_len;
+    uint32_t count;             /* number of positions */
+    const uint32_t * column[ pcol_u32_columns ];    /* index with enum pcol_column */
+    const uint8_t * ref_base;
+} pcol_block;
+
+typedef struct pcol_reader pcol_reader;
+
+/* maps the file into memory, returns 0 or an errno-value */
+int pcol_reader_open( pcol_reader ** reader, const char * path );
+
+/* returns 1 and fills the block, 0 at the end of the file, or a negative errno-value,
+   the columns stay valid until the next call: uncompressed blocks point
+   into the mapped file, compressed blocks ( and all blocks on big-endian hosts )
+   into a buffer of the reader */
+int pcol_reader_next( pcol_reader * self, pcol_block * block );
+
+void pcol_reader_close( pcol_reader * self );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  _h_pileup_columnar_reader_ */
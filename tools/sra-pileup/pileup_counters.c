@@ -28,6 +28,7 @@
 
 #include "ref_walker_0.h"
 #include "4na_ascii.h"
+#include "pileup_histogram.h"
 
 static uint32_t percent( uint32_t v1, uint32_t v2 )
 {
@@ -186,6 +187,7 @@ typedef struct pileup_counters
     uint32_t ending;
     BSTree insert_fragments;
     BSTree delete_fragments;
+    pileup_codes codes;     /* one byte per alignment at the current position */
 } pileup_counters;
 
 
@@ -204,41 +206,23 @@ static void clear_counters( pileup_counters * counters )
     counters->ending = 0;
     BSTreeInit( &(counters->insert_fragments) );
     BSTreeInit( &(counters->delete_fragments) );
+    counters->codes.count = 0;
 }
 
 
-static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool reverse,
-                                pileup_counters * counters )
+/* matches, mismatches and strands are only collected here and counted in one go
+   by count_counter_states(), the indel-fragments are rare and handled directly */
+static rc_t walk_counter_state( walk_data * data, pileup_counters * counters )
 {
-    if ( ( state & align_iter_invalid ) == align_iter_invalid )
-        return;
-
-    if ( ( state & align_iter_skip ) != align_iter_skip )
-    {
-        if ( ( state & align_iter_match ) == align_iter_match )
-            (counters->matches)++;
-        else
-        {
-            char c = _4na_to_ascii( state, false );
-            switch( c )
-            {
-                case 'A' : ( counters->mismatches[ 0 ] )++; break;
-                case 'C' : ( counters->mismatches[ 1 ] )++; break;
-                case 'G' : ( counters->mismatches[ 2 ] )++; break;
-                case 'T' : ( counters->mismatches[ 3 ] )++; break;
-            }
-        }
-    }
-
-    if ( reverse )
-        (counters->reverse)++;
-    else
-        (counters->forward)++;
+    int32_t state = data->state;
+    rc_t rc = add_pileup_code( &counters->codes, data );
+    if ( rc != 0 || ( state & align_iter_invalid ) == align_iter_invalid )
+        return rc;
 
     if ( ( state & align_iter_insert ) == align_iter_insert )
     {
         const INSDC_4na_bin *bases;
-        uint32_t n = ReferenceIteratorBasesInserted ( ref_iter, &bases );
+        uint32_t n = ReferenceIteratorBasesInserted ( data->ref_iter, &bases );
         (counters->inserts) += n;
         count_indel_fragment( &(counters->insert_fragments), bases, n );
     }
@@ -247,7 +231,7 @@ static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool
     {
         const INSDC_4na_bin *bases;
         INSDC_coord_zero ref_pos;
-        uint32_t n = ReferenceIteratorBasesDeleted ( ref_iter, &ref_pos, &bases );
+        uint32_t n = ReferenceIteratorBasesDeleted ( data->ref_iter, &ref_pos, &bases );
         if ( bases != NULL )
         {
             (counters->deletes) += n;
@@ -261,6 +245,22 @@ static void walk_counter_state( ReferenceIterator *ref_iter, int32_t state, bool
 
     if ( ( state & align_iter_last ) == align_iter_last )
         ( counters->ending)++;
+
+    return rc;
+}
+
+
+static void count_counter_states( pileup_counters * counters )
+{
+    pileup_hist hist;
+    uint32_t i;
+
+    count_pileup_codes( &counters->codes, &hist ); /* pileup_histogram.c */
+    counters->matches = hist.bases[ phist_match ][ 0 ] + hist.bases[ phist_match ][ 1 ];
+    for ( i = 0; i < 4; ++i )
+        counters->mismatches[ i ] = hist.bases[ phist_a + i ][ 0 ] + hist.bases[ phist_a + i ][ 1 ];
+    counters->reverse = hist.reverse;
+    counters->forward = counters->codes.count - hist.reverse;
 }
 
 
@@ -323,20 +323,22 @@ static rc_t print_counter_line( const char * ref_name,
 
 static rc_t CC walk_counters_enter_ref_pos( walk_data * data )
 {
-    clear_counters( data->data );
-    return 0;
+    pileup_counters * counters = data->data;
+    clear_counters( counters );
+    return reserve_pileup_codes( &counters->codes, data->depth );
 }
 
 static rc_t CC walk_counters_exit_ref_pos( walk_data * data )
 {
-    rc_t rc = print_counter_line( data->ref_name, data->ref_pos, data->ref_base, data->depth, data->data );
+    rc_t rc;
+    count_counter_states( data->data );
+    rc = print_counter_line( data->ref_name, data->ref_pos, data->ref_base, data->depth, data->data );
     return rc;
 }
 
 static rc_t CC walk_counters_placement( walk_data * data )
 {
-    walk_counter_state( data->ref_iter, data->state, data->xrec->reverse, data->data );
-    return 0;
+    return walk_counter_state( data, data->data );
 }
 
 rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
@@ -344,6 +346,7 @@ rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
     walk_data data;
     walk_funcs funcs;
     pileup_counters counters;
+    rc_t rc;
 
     data.ref_iter = ref_iter;
     data.options = options;
@@ -363,7 +366,10 @@ rc_t walk_counters( ReferenceIterator *ref_iter, pileup_options *options )
 
     funcs.on_placement = walk_counters_placement;
 
-    return walk_0( &data, &funcs );
+    init_pileup_codes( &counters.codes );
+    rc = walk_0( &data, &funcs );
+    release_pileup_codes( &counters.codes );
+    return rc;
 }
 
 
@@ -401,21 +407,23 @@ static rc_t print_mismatches_line( const char * ref_name,
 
 static rc_t CC walk_mismatches_enter_ref_pos( walk_data * data )
 {
-    clear_counters( data->data );
-    return 0;
+    pileup_counters * counters = data->data;
+    clear_counters( counters );
+    return reserve_pileup_codes( &counters->codes, data->depth );
 }
 
 static rc_t CC walk_mismatches_exit_ref_pos( walk_data * data )
 {
-    rc_t rc = print_mismatches_line( data->ref_name, data->ref_pos,
-                                     data->depth, data->options->min_mismatch, data->data );
+    rc_t rc;
+    count_counter_states( data->data );
+    rc = print_mismatches_line( data->ref_name, data->ref_pos,
+                                data->depth, data->options->min_mismatch, data->data );
     return rc;
 }
 
 static rc_t CC walk_mismatches_placement( walk_data * data )
 {
-    walk_counter_state( data->ref_iter, data->state, data->xrec->reverse, data->data );
-    return 0;
+    return walk_counter_state( data, data->data );
 }
 
 
@@ -424,6 +432,7 @@ rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options )
     walk_data data;
     walk_funcs funcs;
     pileup_counters counters;
+    rc_t rc;
 
     data.ref_iter = ref_iter;
     data.options = options;
@@ -443,5 +452,8 @@ rc_t walk_mismatches( ReferenceIterator *ref_iter, pileup_options * options )
 
     funcs.on_placement = walk_mismatches_placement;
 
-    return walk_0( &data, &funcs );
+    init_pileup_codes( &counters.codes );
+    rc = walk_0( &data, &funcs );
+    release_pileup_codes( &counters.codes );
+    return rc;
 }
@@ -0,0 +1,388 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "pileup_histogram.h"
+
+#include <klib/rc.h>
+#include <klib/log.h>
+
+/* the mismatch-class of a 4na-state, ambiguity-codes count as N */
+static const uint8_t x4na_to_class[ 16 ] =
+{
+/*  0x0     0x01    0x02    0x03    0x04    0x05    0x06    0x07 */
+    phist_n, phist_a, phist_c, phist_n, phist_g, phist_n, phist_n, phist_n,
+/*  0x08    0x09    0x0A    0x0B    0x0C    0x0D    0x0E    0x0F */
+    phist_t, phist_n, phist_n, phist_n, phist_n, phist_n, phist_n, phist_n
+};
+
+
+void init_pileup_codes( pileup_codes * self )
+{
+    self->codes = NULL;
+    self->count = 0;
+    self->capacity = 0;
+}
+
+
+void release_pileup_codes( pileup_codes * self )
+{
+    free( self->codes );
+    init_pileup_codes( self );
+}
+
+
+rc_t reserve_pileup_codes( pileup_codes * self, uint32_t n )
+{
+    rc_t rc = 0;
+    if ( n > self->capacity )
+    {
+        uint32_t new_capacity = ( self->capacity > 0 ) ? self->capacity : 1024;
+        uint8_t * tmp;
+        while ( new_capacity < n )
+            new_capacity *= 2;
+        tmp = realloc( self->codes, new_capacity );
+        if ( tmp == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot allocate pileup-codes" );
+        }
+        else
+        {
+            self->codes = tmp;
+            self->capacity = new_capacity;
+        }
+    }
+    return rc;
+}
+
+
+rc_t add_pileup_code( pileup_codes * self, const walk_data * data )
+{
+    rc_t rc = 0;
+    int32_t state = data->state;
+    if ( ( state & align_iter_invalid ) != align_iter_invalid )
+    {
+        const tool_rec * xrec = data->xrec;
+        uint8_t code;
+
+        if ( ( state & align_iter_skip ) == align_iter_skip )
+            code = phist_skip;
+        else if ( ( state & align_iter_match ) == align_iter_match )
+            code = phist_match;
+        else
+            code = x4na_to_class[ state & 0x0F ];
+
+        code |= ( xrec->reverse ? PHIST_REVERSE : 0 );
+        code |= ( ( state & align_iter_insert ) == align_iter_insert ) ? PHIST_INSERT : 0;
+        code |= ( ( state & align_iter_delete ) == align_iter_delete ) ? PHIST_DELETE : 0;
+
+        if ( data->options->min_base_qual > 0 &&
+             xrec->quality != NULL &&
+             ( uint32_t )data->seq_pos < xrec->quality_len &&
+             xrec->quality[ data->seq_pos ] < data->options->min_base_qual )
+        {
+            code |= PHIST_LOW_QUAL;
+        }
+
+        if ( self->count >= self->capacity )
+            rc = reserve_pileup_codes( self, self->count + 1 );
+        if ( rc == 0 )
+            self->codes[ self->count++ ] = code;
+    }
+    return rc;
+}
+
+
+/* --------------------------------------------------------------------------------------------
+    histogram-kernels:
+    the portable version counts every byte-value in a table and folds the table,
+    the SSE2 / AVX2 versions compare 16 / 32 bytes at once against every counted
+    value and sum the matches in byte-lanes, which are widened every 255 rounds,
+    they are compiled via target-attributes ( no special compiler-flags needed )
+    and are selected at runtime, when the CPU supports them
+-------------------------------------------------------------------------------------------- */
+
+#if defined( __GNUC__ ) && !defined( __INTEL_COMPILER ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define X86_HIST_KERNELS 1
+#include <immintrin.h>
+#endif
+
+typedef void ( * pileup_hist_kernel )( const uint8_t * codes, uint32_t count, pileup_hist * hist );
+
+/* 12 class/strand-counters + 4 flag-counters */
+#define HIST_LANES ( PHIST_COUNTED_CLASSES * 2 + 4 )
+
+
+static void clear_hist( pileup_hist * hist )
+{
+    memset( hist, 0, sizeof * hist );
+}
+
+
+/* lanes 0..11 are class * 2 + strand, then reverse, low-quality, inserts, deletes */
+static void add_lanes_to_hist( const uint64_t * lanes, pileup_hist * hist )
+{
+    uint32_t cls;
+    for ( cls = 0; cls < PHIST_COUNTED_CLASSES; ++cls )
+    {
+        hist->bases[ cls ][ 0 ] += ( uint32_t )lanes[ cls * 2 ];
+        hist->bases[ cls ][ 1 ] += ( uint32_t )lanes[ cls * 2 + 1 ];
+    }
+    hist->reverse += ( uint32_t )lanes[ PHIST_COUNTED_CLASSES * 2 ];
+    hist->low_quality += ( uint32_t )lanes[ PHIST_COUNTED_CLASSES * 2 + 1 ];
+    hist->inserts += ( uint32_t )lanes[ PHIST_COUNTED_CLASSES * 2 + 2 ];
+    hist->deletes += ( uint32_t )lanes[ PHIST_COUNTED_CLASSES * 2 + 3 ];
+}
+
+
+static void pileup_hist_portable( const uint8_t * codes, uint32_t count, pileup_hist * hist )
+{
+    uint32_t table[ 128 ];
+    uint64_t lanes[ HIST_LANES ];
+    uint32_t i;
+
+    memset( table, 0, sizeof table );
+    for ( i = 0; i < count; ++i )
+        table[ codes[ i ] & 0x7F ]++;
+
+    memset( lanes, 0, sizeof lanes );
+    for ( i = 0; i < 128; ++i )
+    {
+        uint32_t n = table[ i ];
+        if ( n > 0 )
+        {
+            uint32_t cls = i & PHIST_CLASS_MASK;
+            uint32_t strand = ( i & PHIST_REVERSE ) ? 1 : 0;
+            if ( cls < PHIST_COUNTED_CLASSES && ( i & PHIST_LOW_QUAL ) == 0 )
+                lanes[ cls * 2 + strand ] += n;
+            if ( i & PHIST_REVERSE ) lanes[ PHIST_COUNTED_CLASSES * 2 ] += n;
+            if ( i & PHIST_LOW_QUAL ) lanes[ PHIST_COUNTED_CLASSES * 2 + 1 ] += n;
+            if ( i & PHIST_INSERT ) lanes[ PHIST_COUNTED_CLASSES * 2 + 2 ] += n;
+            if ( i & PHIST_DELETE ) lanes[ PHIST_COUNTED_CLASSES * 2 + 3 ] += n;
+        }
+    }
+    add_lanes_to_hist( lanes, hist );
+}
+
+#ifdef X86_HIST_KERNELS
+
+/* the value a code must have ( after masking ) to be counted in a lane,
+   the last 4 lanes test a single bit: mask and value are the bit */
+#define LANE_KEY_MASK ( PHIST_CLASS_MASK | PHIST_REVERSE | PHIST_LOW_QUAL )
+
+static uint8_t lane_mask( uint32_t lane )
+{
+    static const uint8_t bits[ 4 ] = { PHIST_REVERSE, PHIST_LOW_QUAL, PHIST_INSERT, PHIST_DELETE };
+    return ( lane < PHIST_COUNTED_CLASSES * 2 ) ? LANE_KEY_MASK : bits[ lane - PHIST_COUNTED_CLASSES * 2 ];
+}
+
+static uint8_t lane_value( uint32_t lane )
+{
+    if ( lane < PHIST_COUNTED_CLASSES * 2 )
+        return ( uint8_t )( ( lane / 2 ) | ( ( lane & 1 ) ? PHIST_REVERSE : 0 ) );
+    return lane_mask( lane );
+}
+
+
+__attribute__ (( target( "sse2" ) ))
+static void pileup_hist_sse2( const uint8_t * codes, uint32_t count, pileup_hist * hist )
+{
+    __m128i masks[ HIST_LANES ];
+    __m128i values[ HIST_LANES ];
+    uint64_t lanes[ HIST_LANES ];
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i = 0, lane;
+
+    for ( lane = 0; lane < HIST_LANES; ++lane )
+    {
+        masks[ lane ] = _mm_set1_epi8( ( char )lane_mask( lane ) );
+        values[ lane ] = _mm_set1_epi8( ( char )lane_value( lane ) );
+        lanes[ lane ] = 0;
+    }
+
+    while ( i + 16 <= count )
+    {
+        __m128i acc[ HIST_LANES ];
+        uint32_t rounds = ( count - i ) / 16;
+        uint32_t r;
+        if ( rounds > 255 ) rounds = 255;   /* a byte-lane counts up to 255 */
+
+        for ( lane = 0; lane < HIST_LANES; ++lane )
+            acc[ lane ] = zero;
+
+        for ( r = 0; r < rounds; ++r, i += 16 )
+        {
+            __m128i v = _mm_loadu_si128( ( const __m128i * )&codes[ i ] );
+            for ( lane = 0; lane < HIST_LANES; ++lane )
+            {
+                /* cmpeq yields -1 per hit, subtracting it counts up */
+                __m128i hit = _mm_cmpeq_epi8( _mm_and_si128( v, masks[ lane ] ), values[ lane ] );
+                acc[ lane ] = _mm_sub_epi8( acc[ lane ], hit );
+            }
+        }
+
+        for ( lane = 0; lane < HIST_LANES; ++lane )
+        {
+            __m128i sums = _mm_sad_epu8( acc[ lane ], zero );
+            lanes[ lane ] += ( uint64_t )_mm_cvtsi128_si32( sums ) +
+                             ( uint64_t )_mm_cvtsi128_si32( _mm_srli_si128( sums, 8 ) );
+        }
+    }
+    add_lanes_to_hist( lanes, hist );
+    pileup_hist_portable( &codes[ i ], count - i, hist );
+}
+
+
+__attribute__ (( target( "avx2" ) ))
+static void pileup_hist_avx2( const uint8_t * codes, uint32_t count, pileup_hist * hist )
+{
+    __m256i masks[ HIST_LANES ];
+    __m256i values[ HIST_LANES ];
+    uint64_t lanes[ HIST_LANES ];
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i = 0, lane;
+
+    for ( lane = 0; lane < HIST_LANES; ++lane )
+    {
+        masks[ lane ] = _mm256_set1_epi8( ( char )lane_mask( lane ) );
+        values[ lane ] = _mm256_set1_epi8( ( char )lane_value( lane ) );
+        lanes[ lane ] = 0;
+    }
+
+    while ( i + 32 <= count )
+    {
+        __m256i acc[ HIST_LANES ];
+        uint32_t rounds = ( count - i ) / 32;
+        uint32_t r;
+        if ( rounds > 255 ) rounds = 255;
+
+        for ( lane = 0; lane < HIST_LANES; ++lane )
+            acc[ lane ] = zero;
+
+        for ( r = 0; r < rounds; ++r, i += 32 )
+        {
+            __m256i v = _mm256_loadu_si256( ( const __m256i * )&codes[ i ] );
+            for ( lane = 0; lane < HIST_LANES; ++lane )
+            {
+                __m256i hit = _mm256_cmpeq_epi8( _mm256_and_si256( v, masks[ lane ] ), values[ lane ] );
+                acc[ lane ] = _mm256_sub_epi8( acc[ lane ], hit );
+            }
+        }
+
+        for ( lane = 0; lane < HIST_LANES; ++lane )
+        {
+            uint64_t sums[ 4 ];
+            _mm256_storeu_si256( ( __m256i * )sums, _mm256_sad_epu8( acc[ lane ], zero ) );
+            lanes[ lane ] += sums[ 0 ] + sums[ 1 ] + sums[ 2 ] + sums[ 3 ];
+        }
+    }
+    add_lanes_to_hist( lanes, hist );
+    pileup_hist_sse2( &codes[ i ], count - i, hist );
+}
+
+#endif /* X86_HIST_KERNELS */
+
+static pileup_hist_kernel hist_kernel = NULL;
+static const char * hist_kernel_name = NULL;
+
+/* all threads come to the same result, a race here is harmless */
+static void select_hist_kernel( void )
+{
+    pileup_hist_kernel k = pileup_hist_portable;
+    const char * name = "portable";
+#ifdef X86_HIST_KERNELS
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        k = pileup_hist_avx2;
+        name = "avx2";
+    }
+    else if ( __builtin_cpu_supports( "sse2" ) )
+    {
+        k = pileup_hist_sse2;
+        name = "sse2";
+    }
+#endif
+    hist_kernel_name = name;
+    hist_kernel = k;
+}
+
+
+const char * get_pileup_hist_kernel_name( void )
+{
+    if ( hist_kernel_name == NULL )
+        select_hist_kernel();
+    return hist_kernel_name;
+}
+
+
+bool set_pileup_hist_kernel( const char * name )
+{
+    bool res = false;
+    if ( name != NULL )
+    {
+        if ( 0 == strcmp( name, "portable" ) )
+        {
+            hist_kernel = pileup_hist_portable;
+            hist_kernel_name = "portable";
+            res = true;
+        }
+#ifdef X86_HIST_KERNELS
+        else
+        {
+            __builtin_cpu_init();
+            if ( 0 == strcmp( name, "sse2" ) && __builtin_cpu_supports( "sse2" ) )
+            {
+                hist_kernel = pileup_hist_sse2;
+                hist_kernel_name = "sse2";
+                res = true;
+            }
+            else if ( 0 == strcmp( name, "avx2" ) && __builtin_cpu_supports( "avx2" ) )
+            {
+                hist_kernel = pileup_hist_avx2;
+                hist_kernel_name = "avx2";
+                res = true;
+            }
+        }
+#endif
+    }
+    return res;
+}
+
+
+void pileup_hist_count( const uint8_t * codes, uint32_t count, pileup_hist * hist )
+{
+    if ( hist_kernel == NULL )
+        select_hist_kernel();
+    clear_hist( hist );
+    hist_kernel( codes, count, hist );
+}
+
+
+void count_pileup_codes( const pileup_codes * self, pileup_hist * hist )
+{
+    pileup_hist_count( self->codes, self->count, hist );
+}
@@ -0,0 +1,112 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_pileup_histogram_
+#define _h_pileup_histogram_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ref_walker_0.h"
+
+/* the alignments at one reference-position are collected as one byte each,
+   the bytes are counted afterwards by a ( vectorized ) histogram-kernel
+
+   bits 0..2 : the class of the base in the alignment
+   bit 3     : the alignment is in reverse orientation
+   bit 4     : the alignment has an insert after this position
+   bit 5     : the alignment has a delete after this position
+   bit 6     : the quality of the base is below --minbaseq
+*/
+
+enum pileup_class
+{
+    phist_a = 0,        /* mismatches */
+    phist_c,
+    phist_g,
+    phist_t,
+    phist_n,
+    phist_match,        /* the base matches the reference */
+    phist_skip,         /* the alignment has a deletion at this position */
+    phist_classes
+};
+
+#define PHIST_COUNTED_CLASSES 6     /* phist_skip is not counted by class */
+
+#define PHIST_CLASS_MASK 0x07
+#define PHIST_REVERSE    0x08
+#define PHIST_INSERT     0x10
+#define PHIST_DELETE     0x20
+#define PHIST_LOW_QUAL   0x40
+
+
+typedef struct pileup_hist
+{
+    uint32_t bases[ PHIST_COUNTED_CLASSES ][ 2 ];  /* [ class ][ forward / reverse ], without low-quality bases */
+    uint32_t reverse;       /* all alignments in reverse orientation */
+    uint32_t low_quality;   /* bases below the quality-threshold */
+    uint32_t inserts;       /* alignments with an insert */
+    uint32_t deletes;       /* alignments with a delete */
+} pileup_hist;
+
+
+/* the bytes of one position, the buffer is reused for the next position */
+typedef struct pileup_codes
+{
+    uint8_t * codes;
+    uint32_t count;
+    uint32_t capacity;
+} pileup_codes;
+
+
+void init_pileup_codes( pileup_codes * self );
+void release_pileup_codes( pileup_codes * self );
+
+/* makes room for n bytes, called with the depth before the placements are visited */
+rc_t reserve_pileup_codes( pileup_codes * self, uint32_t n );
+
+/* adds the current placement of the walker, invalid placements are not added */
+rc_t add_pileup_code( pileup_codes * self, const walk_data * data );
+
+/* counts the collected bytes */
+void count_pileup_codes( const pileup_codes * self, pileup_hist * hist );
+
+/* the kernel used by count_pileup_codes(): "portable", "sse2" or "avx2" */
+const char * get_pileup_hist_kernel_name( void );
+
+/* force a kernel ( "avx2", "sse2" or "portable" ) - for tests,
+   returns false if the name is unknown or the CPU does not support it */
+bool set_pileup_hist_kernel( const char * name );
+
+/* the kernel itself, for benchmarks */
+void pileup_hist_count( const uint8_t * codes, uint32_t count, pileup_hist * hist );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  _h_pileup_histogram_ */
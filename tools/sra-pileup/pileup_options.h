@@ -45,12 +45,17 @@ typedef struct pileup_options
     bool div_by_spotgrp;
 	bool depth_per_spotgrp;
     bool use_seq_name;
+    bool columnar_deflate;  /* compress the blocks of sra_pileup_columnar */
     uint32_t minmapq;
+    uint32_t min_base_qual; /* bases below are not counted by the counting functions */
     uint32_t min_mismatch;
     uint32_t merge_dist;
     uint32_t source_table;
     uint32_t function;  /* sra_pileup_samtools, sra_pileup_counters, sra_pileup_stat, 
                            sra_pileup_report_ref, sra_pileup_report_ref_ext, sra_pileup_debug, etc */
+    uint32_t threads;   /* worker-threads for the tiles of the references, 1 = single-threaded */
+    uint64_t tile_start;    /* only positions inside the tile are printed ( 1-based, inclusive ), */
+    uint64_t tile_end;      /* tile_end == 0 means no tile */
     struct skiplist * skiplist;     /* from ref_regions.h */
 } pileup_options;
 
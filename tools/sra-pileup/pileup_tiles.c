@@ -0,0 +1,206 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "pileup_tiles.h"
+
+#include <klib/rc.h>
+#include <klib/log.h>
+#include <klib/text.h>
+#include <klib/sort.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+void init_tile_plan( tile_plan * self )
+{
+    self->refs = NULL;
+    self->ref_count = 0;
+    self->ref_capacity = 0;
+}
+
+
+void release_tile_plan( tile_plan * self )
+{
+    uint32_t idx;
+    for ( idx = 0; idx < self->ref_count; ++idx )
+    {
+        free( self->refs[ idx ].name );
+        free( self->refs[ idx ].sections );
+    }
+    free( self->refs );
+    init_tile_plan( self );
+}
+
+
+static tile_ref * find_tile_ref( tile_plan * self, const char * ref_name )
+{
+    uint32_t idx;
+    /* the sections of one reference arrive together: look at the last one first */
+    if ( self->ref_count > 0 && strcmp( self->refs[ self->ref_count - 1 ].name, ref_name ) == 0 )
+        return &self->refs[ self->ref_count - 1 ];
+    for ( idx = 0; idx < self->ref_count; ++idx )
+    {
+        if ( strcmp( self->refs[ idx ].name, ref_name ) == 0 )
+            return &self->refs[ idx ];
+    }
+    return NULL;
+}
+
+
+static rc_t add_tile_ref( tile_plan * self, const char * ref_name, tile_ref ** ref )
+{
+    rc_t rc = 0;
+    if ( self->ref_count >= self->ref_capacity )
+    {
+        uint32_t new_capacity = ( self->ref_capacity > 0 ) ? self->ref_capacity * 2 : 64;
+        tile_ref * tmp = realloc( self->refs, new_capacity * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot create reference-list of tile-plan" );
+        }
+        else
+        {
+            self->refs = tmp;
+            self->ref_capacity = new_capacity;
+        }
+    }
+    if ( rc == 0 )
+    {
+        tile_ref * r = &self->refs[ self->ref_count ];
+        memset( r, 0, sizeof * r );
+        r->name = string_dup_measure( ref_name, NULL );
+        if ( r->name == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot create reference of tile-plan" );
+        }
+        else
+        {
+            self->ref_count++;
+            *ref = r;
+        }
+    }
+    return rc;
+}
+
+
+rc_t tile_plan_add_section( tile_plan * self, const char * ref_name, uint32_t start, uint32_t end )
+{
+    rc_t rc = 0;
+    tile_ref * ref = find_tile_ref( self, ref_name );
+    if ( ref == NULL )
+        rc = add_tile_ref( self, ref_name, &ref );
+    if ( rc == 0 && ref->section_count >= ref->section_capacity )
+    {
+        uint32_t new_capacity = ( ref->section_capacity > 0 ) ? ref->section_capacity * 2 : 4;
+        tile_section * tmp = realloc( ref->sections, new_capacity * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot create section of tile-plan" );
+        }
+        else
+        {
+            ref->sections = tmp;
+            ref->section_capacity = new_capacity;
+        }
+    }
+    if ( rc == 0 )
+    {
+        ref->sections[ ref->section_count ].start = start;
+        ref->sections[ ref->section_count ].end = end;
+        ref->section_count++;
+    }
+    return rc;
+}
+
+
+static int64_t CC cmp_tile_section( const void * a, const void * b, void * data )
+{
+    const tile_section * sa = a;
+    const tile_section * sb = b;
+    if ( sa->start != sb->start )
+        return ( sa->start < sb->start ) ? -1 : 1;
+    if ( sa->end != sb->end )
+        return ( sa->end < sb->end ) ? -1 : 1;
+    return 0;
+}
+
+
+/* sorts the sections and merges the overlapping / adjacent ones, in place */
+static void merge_tile_sections( tile_ref * ref )
+{
+    if ( ref->section_count > 1 )
+    {
+        uint32_t src, dst = 0;
+        ksort( ref->sections, ref->section_count, sizeof ref->sections[ 0 ], cmp_tile_section, NULL );
+        for ( src = 1; src < ref->section_count; ++src )
+        {
+            tile_section * last = &ref->sections[ dst ];
+            const tile_section * s = &ref->sections[ src ];
+            if ( last->end == 0xFFFFFFFF || s->start <= last->end + 1 )
+            {
+                if ( s->end > last->end )
+                    last->end = s->end;
+            }
+            else
+                ref->sections[ ++dst ] = *s;
+        }
+        ref->section_count = dst + 1;
+    }
+}
+
+
+rc_t tile_plan_foreach_tile( tile_plan * self, uint32_t tile_len, on_tile_cb on_tile, void * data )
+{
+    rc_t rc = 0;
+    uint32_t r_idx;
+    for ( r_idx = 0; r_idx < self->ref_count && rc == 0; ++r_idx )
+    {
+        tile_ref * ref = &self->refs[ r_idx ];
+        uint32_t s_idx;
+        merge_tile_sections( ref );
+        for ( s_idx = 0; s_idx < ref->section_count && rc == 0; ++s_idx )
+        {
+            uint32_t start = ref->sections[ s_idx ].start;
+            uint32_t end = ref->sections[ s_idx ].end;
+            uint32_t tile_start;
+            for ( tile_start = start; tile_start <= end && rc == 0; tile_start += tile_len )
+            {
+                uint32_t tile_end = tile_start + ( tile_len - 1 );
+                if ( tile_end > end || tile_end < tile_start )
+                    tile_end = end;
+                rc = on_tile( ref->name, tile_start, tile_end, data );
+                if ( tile_end == end )
+                    break;
+            }
+        }
+    }
+    return rc;
+}
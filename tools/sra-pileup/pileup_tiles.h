@@ -0,0 +1,90 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_pileup_tiles_
+#define _h_pileup_tiles_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _h_klib_rc_
+#include <klib/rc.h>
+#endif
+
+/* the tiles of sra-pileup --threads, in the order of the single-threaded walk
+
+   the single-threaded walk puts the sections of all input-files into one
+   reference-iterator, which groups them by reference: a reference comes at the
+   place where it was added first ( by whatever input-file ), the sections of
+   later input-files for the same reference are walked together with it
+
+   the plan reproduces that order:
+        - the references in the order of their first appearance over all input-files
+        - the sections of one reference merged into non-overlapping ranges
+          ( a position is walked only once ), in position-order
+        - the ranges cut into tiles of a fixed length
+*/
+
+typedef struct tile_section
+{
+    uint32_t start;     /* 1-based, inclusive */
+    uint32_t end;
+} tile_section;
+
+
+typedef struct tile_ref
+{
+    char * name;
+    tile_section * sections;
+    uint32_t section_count;
+    uint32_t section_capacity;
+} tile_ref;
+
+
+typedef struct tile_plan
+{
+    tile_ref * refs;
+    uint32_t ref_count;
+    uint32_t ref_capacity;
+} tile_plan;
+
+
+void init_tile_plan( tile_plan * self );
+void release_tile_plan( tile_plan * self );
+
+/* called for every section of every input-file, in the order the input-files are walked */
+rc_t tile_plan_add_section( tile_plan * self, const char * ref_name, uint32_t start, uint32_t end );
+
+typedef rc_t ( CC * on_tile_cb )( const char * ref_name, uint32_t start, uint32_t end, void * data );
+
+/* merges the sections of every reference and calls on_tile for every tile in walk-order */
+rc_t tile_plan_foreach_tile( tile_plan * self, uint32_t tile_len, on_tile_cb on_tile, void * data );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  _h_pileup_tiles_ */
@@ -780,9 +780,10 @@ bool skiplist_is_skip_position( struct skiplist * list, uint64_t pos )
         struct skiplist_ref_node * cur_node = list->current;
         if ( cur_node != NULL )
         {
-            const struct skip_range * curr_skip_range = cur_node->current_skip_range;
-            if ( curr_skip_range != NULL )
+            /* a tile of a worker-thread can start behind several skip-ranges, catch up */
+            while ( cur_node->current_skip_range != NULL )
             {
+                const struct skip_range * curr_skip_range = cur_node->current_skip_range;
                 if ( pos < curr_skip_range->start ) return false;
                 if ( pos <= curr_skip_range->end ) return true;
                 cur_node->current_id++;
@@ -27,6 +27,10 @@
 #include <align/manager.h>
 #include <align/iterator.h>
 #include <kapp/main.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <klib/printf.h>
 #include <ctype.h>
 #include <sysalloc.h>
 
@@ -35,6 +39,9 @@
 #include "rna_splice_log.h"
 #include "sam-aligned.h"
 #include "md_flag.h"
+#include "out_buffer.h"
+#include "sam-projection.h"
+#include "bam_out.h"
 
 const char * PRIM_TABLE = "PRIMARY_ALIGNMENT";
 const char * SEC_TABLE = "SECONDARY_ALIGNMENT";
@@ -108,6 +115,8 @@ const char * EV_AL_TABLE = "EVIDENCE_ALIGNMENT";
 #define COL_ALIGN_GROUP "(ascii)ALIGN_GROUP"
 #define COL_RNA_ORIENTATION "(ascii)RNA_ORIENTATION"
 #define COL_LNK_GROUP "(ascii)LINKAGE_GROUP"
+#define COL_REF_NAME "(ascii)REF_NAME"
+#define COL_REF_LEN "(INSDC:coord:len)REF_LEN"
 
 enum align_table_type
 {
@@ -179,6 +188,9 @@ typedef struct align_table_context
 
     /* the common part repeats for evidence-alignment */
     align_cmn_context eval;
+
+    /* prim/sec: pre-computed CIGAR/READ/QUALITY/NM/MD, cursor is NULL if not available */
+    sam_proj_cursor proj;
 } align_table_context;
 
 
@@ -228,6 +240,7 @@ static void init_align_table_context( align_table_context * const atx,
     atx->ref_obj = ref_obj;
     atx->cig_op_buffer = NULL;
     atx->cig_op_buffer_len = 0;
+    atx->proj.cursor = NULL;
     invalidate_all_column_idx( atx );
 }
 
@@ -241,6 +254,7 @@ static void free_align_table_context( align_table_context * atx )
 
         VCursorRelease( atx->cmn.cursor );
         VCursorRelease( atx->eval.cursor );
+        sam_proj_close_cursor( &atx->proj ); /* sam-projection.c */
         free( atx );
     }
 }
@@ -592,6 +606,8 @@ static rc_t add_table_pl_iter( const samdump_opts * const opts,
                                             rc = prepare_evidence_table_cursor( opts, idb->db, table_name, atx );
                                             break;
             }
+            if ( rc == 0 && idb->proj != NULL && atx->align_table_type != att_evidence )
+                rc = sam_proj_open_cursor( idb->proj, &atx->proj, table_name, opts->cursor_cache_size ); /* sam-projection.c */
         }
         if ( rc == 0 )
         {
@@ -873,25 +889,23 @@ static rc_t print_qslice( const samdump_opts * const opts,
 }
 
 
-static rc_t modify_and_print_cigar( const char * cigar,
-                                    size_t cigar_len,
-                                    CigOps *ref_cig,
-                                    int32_t ref_cig_len,
-                                    INSDC_coord_zero ref_pos,
-                                    uint32_t read_len )
+/* cigbuf has MAX_CG_CIGAR_LEN characters */
+static void modify_cigar( char * cigbuf,
+                          const char * cigar,
+                          size_t cigar_len,
+                          CigOps *ref_cig,
+                          int32_t ref_cig_len,
+                          INSDC_coord_zero ref_pos,
+                          uint32_t read_len )
 {
-    rc_t rc;
     if ( cigar_len > 0 )
     {
-        char cigbuf[ MAX_CG_CIGAR_LEN ];
         CigOps al_cig[ 1024 ];
         ExplodeCIGAR( al_cig, 1024, cigar, cigar_len );
         CombineCIGAR( cigbuf, al_cig, read_len, ref_pos, ref_cig, ref_cig_len );
-        rc = KOutMsg( "%s\t", cigbuf );
     }
     else
-        rc = KOutMsg( "*\t" );
-    return rc;
+        strcpy( cigbuf, "*" );
 }
 
 
@@ -975,12 +989,8 @@ static rc_t cg_cigar_treatments( enum cigar_treatment what_treatment,
 }
 
 
-static rc_t print_quality_or_star( const samdump_opts * const opts,
-                                   const char * const q,
-                                   uint32_t q_len,
-                                   uint32_t r_len )
+static bool is_star_quality( const char * const q, uint32_t q_len, uint32_t r_len )
 {
-    rc_t rc;
     bool star_qual = ( q_len == 0 || q_len != r_len );
     if ( !star_qual && q[ 0 ] == 255 )
     {
@@ -988,8 +998,17 @@ static rc_t print_quality_or_star( const samdump_opts * const opts,
         while ( i < q_len && q[ i ] == 255 ) i++;
         star_qual = ( i == q_len );
     }
-    
-    if ( star_qual )
+    return star_qual;
+}
+
+
+static rc_t print_quality_or_star( const samdump_opts * const opts,
+                                   const char * const q,
+                                   uint32_t q_len,
+                                   uint32_t r_len )
+{
+    rc_t rc;
+    if ( is_star_quality( q, q_len, r_len ) )
         rc = KOutMsg( "*" );
     else
         rc = dump_quality_33( opts, q, q_len, false ); /* sam-dump-opts.c */
@@ -1014,6 +1033,11 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
     const char * seq_name, * spot_group;
     int32_t mapq;
     cg_cigar_output cgc_output;
+    char cigbuf[ MAX_CG_CIGAR_LEN ];
+    /* if the output is turned into BAM, the fields go directly into the encoder */
+    struct bam_out * bam = bam_redir_current(); /* bam_out.c */
+    char qname[ 256 ] = "*";
+    size_t qname_len = 1;
 
     rc_t rc = read_char_ptr( align_id, cursor, atx->seq_name_idx, &seq_name, &seq_name_len, "SEQ_NAME" );
     if ( rc == 0 && atx->eval.seq_spot_group_idx != COL_NOT_AVAILABLE )
@@ -1024,15 +1048,26 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
         if ( opts->print_cg_names )
         {
             if ( spot_group_len > 0 )
+            {
                 /* SAM-FIELD: QNAME     constructed from spot-group/seq-name */
-                rc = KOutMsg( "%.*s-1:%.*s\t", spot_group_len, spot_group, seq_name_len, seq_name );
-
+                if ( bam != NULL )
+                    rc = string_printf( qname, sizeof qname, &qname_len, "%.*s-1:%.*s",
+                                        spot_group_len, spot_group, seq_name_len, seq_name );
+                else
+                    rc = KOutMsg( "%.*s-1:%.*s\t", spot_group_len, spot_group, seq_name_len, seq_name );
+            }
         }
         else
         {
             if ( seq_name_len > 0 )
+            {
                 /* SAM-FIELD: QNAME     constructed from allel-id/sub-id */
-                rc = KOutMsg( "%.*s/ALLELE_%li.%u\t", seq_name_len, seq_name, rec->id, ploidy_idx );
+                if ( bam != NULL )
+                    rc = string_printf( qname, sizeof qname, &qname_len, "%.*s/ALLELE_%li.%u",
+                                        seq_name_len, seq_name, rec->id, ploidy_idx );
+                else
+                    rc = KOutMsg( "%.*s/ALLELE_%li.%u\t", seq_name_len, seq_name, rec->id, ploidy_idx );
+            }
         }
     }
 
@@ -1059,7 +1094,7 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
     /* SAM-FIELD: RNAME     SRA-column: ALLEL-NAME.ploidy_idx */
     /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
     /* SAM-FIELD: MAPQ      SRA-column: MAPQ ( from evidence-alignment-table, not from allel! ) */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = KOutMsg( "%u\t%s\t%i\t%d\t", sam_flags, ref_name, allele_pos + ref_pos + 1, mapq );
 
     /* get READ, QUALITY and EIDT_DIST before cigar manipulation because we need/change these values */
@@ -1074,32 +1109,83 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
         if ( rc == 0 )
             rc = cg_cigar_treatments( opts->cigar_treatment, &cgc_input, &cgc_output, align_id, &atx->eval );
         if ( rc == 0 )
-            rc = modify_and_print_cigar( cgc_output.p_cigar.ptr, cgc_output.p_cigar.len,
-                                         atx->cig_op_buffer, ref_cig_len, ref_pos, cgc_output.p_read.len );
+        {
+            modify_cigar( cigbuf, cgc_output.p_cigar.ptr, cgc_output.p_cigar.len,
+                          atx->cig_op_buffer, ref_cig_len, ref_pos, cgc_output.p_read.len );
+            if ( bam == NULL )
+                rc = KOutMsg( "%s\t", cigbuf );
+        }
     }
 
     /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME '*' no mates! */
     /* SAM-FIELD: PNEXT     SRA-column: MATE_REF_POS + 1 '0' no mates */
     /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN '0' not in table */
     /* SAM-FIELD: SEQ       SRA-column: READ  */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = KOutMsg( "*\t0\t0\t%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
 
     /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = print_quality_or_star( opts, cgc_output.p_quality.ptr, cgc_output.p_quality.len, cgc_output.p_read.len ); /* above */
-    
+
+    if ( rc == 0 && bam != NULL )
+    {
+        bam_rec_fields f;
+        memset( &f, 0, sizeof f );
+        f.qname = qname;
+        f.qname_len = ( uint32_t )qname_len;
+        f.flag = sam_flags;
+        f.rname = ref_name;
+        f.rname_len = string_size( ref_name );
+        f.pos = allele_pos + ref_pos;
+        f.mapq = ( uint32_t )mapq;
+        f.cigar = cigbuf;
+        f.cigar_len = string_size( cigbuf );
+        f.rnext = "*";
+        f.rnext_len = 1;
+        f.pnext = -1;
+        f.seq = cgc_output.p_read.ptr;
+        f.seq_len = cgc_output.p_read.len;
+        if ( !is_star_quality( cgc_output.p_quality.ptr, cgc_output.p_quality.len, cgc_output.p_read.len ) )
+        {
+            f.qual = cgc_output.p_quality.ptr;
+            f.qual_len = cgc_output.p_quality.len;
+        }
+        f.qual_map = ( opts->qual_quant != NULL ) ? opts->qual_quant_matrix : NULL;
+        f.qual_offset = 33;
+        rc = bam_out_begin_record( bam, &f ); /* bam_out.c */
+    }
+
     /* OPT SAM-FIELD: RG     SRA-column: SEQ_SPOT_GROUP */
     if ( rc == 0 && spot_group_len > 0 )
-        rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_string( bam, "RG", spot_group, spot_group_len );
+        else
+            rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
+    }
 
     if ( rc == 0 && cgc_output.p_tags.len > 0 )
-        rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_text( bam, cgc_output.p_tags.ptr, cgc_output.p_tags.len );
+        else
+            rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    }
 
     /* OPT SAM-FIELD: ZI     SRA-column: rec->id */
     /* OPT SAM-FIELD: ZA     SRA-column: ploidy_idx */
     if ( rc == 0 )
-        rc = KOutMsg( "\tZI:i:%li\tZA:i:%u", rec->id, ploidy_idx );
+    {
+        if ( bam != NULL )
+        {
+            rc = bam_out_tag_int( bam, "ZI", rec->id );
+            if ( rc == 0 )
+                rc = bam_out_tag_int( bam, "ZA", ploidy_idx );
+        }
+        else
+            rc = KOutMsg( "\tZI:i:%li\tZA:i:%u", rec->id, ploidy_idx );
+    }
 
     /* OPT SAM-FIELD: NH     SRA-column: ALIGNMENT_COUNT */
     if ( rc == 0 && atx->eval.al_count_idx != COL_NOT_AVAILABLE )
@@ -1108,19 +1194,39 @@ static rc_t print_evidence_alignment_cg_sam( const samdump_opts * const opts,
         uint32_t al_count_len;
         rc = read_uint8_ptr( align_id, cursor, atx->eval.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
         if ( rc == 0 && al_count_len > 0 )
-            rc = KOutMsg( "\tNH:i:%u", *al_count );
+        {
+            if ( bam != NULL )
+                rc = bam_out_tag_int( bam, "NH", *al_count );
+            else
+                rc = KOutMsg( "\tNH:i:%u", *al_count );
+        }
     }
 
     /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE */
     if ( rc == 0 )
-        rc = KOutMsg( "\tNM:i:%u", cgc_output.edit_dist );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_int( bam, "NM", ( uint32_t )cgc_output.edit_dist );
+        else
+            rc = KOutMsg( "\tNM:i:%u", cgc_output.edit_dist );
+    }
 
     /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
     if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-        rc = KOutMsg( "\tXI:i:%u", align_id );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_int( bam, "XI", ( uint32_t )align_id );
+        else
+            rc = KOutMsg( "\tXI:i:%u", align_id );
+    }
 
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+    {
+        if ( bam != NULL )
+            rc = bam_out_end_record( bam ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\n" );
+    }
 
     return rc;
 }
@@ -1396,18 +1502,23 @@ static rc_t print_alignment_sam_ev( const samdump_opts * const opts,
 }
 
 
-static rc_t opt_field_spot_group( const VCursor * cursor, uint32_t col_id, int64_t row_id )
+static rc_t opt_field_spot_group( struct bam_out * bam, const VCursor * cursor, uint32_t col_id, int64_t row_id )
 {
     const char * value = NULL;
     uint32_t len;    
     rc_t rc = read_char_ptr( row_id, cursor, col_id, &value, &len, "SPOT_GROUP" );
     if ( rc == 0 && len > 0 )
-        rc = KOutMsg( "\tRG:Z:%.*s", len, value );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_string( bam, "RG", value, len ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\tRG:Z:%.*s", len, value );
+    }
     return rc;
 }
 
 
-static rc_t opt_field_lnk_group( const VCursor * cursor, uint32_t col_id, int64_t row_id )
+static rc_t opt_field_lnk_group( struct bam_out * bam, const VCursor * cursor, uint32_t col_id, int64_t row_id )
 {
     const char * value = NULL;
     uint32_t len;    
@@ -1449,7 +1560,18 @@ static rc_t opt_field_lnk_group( const VCursor * cursor, uint32_t col_id, int64_
             }
         }
         
-        if ( CB.addr == NULL && UB.addr == NULL )
+        if ( bam != NULL )
+        {
+            if ( CB.addr == NULL && UB.addr == NULL )
+                rc = bam_out_tag_string( bam, "BX", value, len ); /* bam_out.c */
+            else
+            {
+                rc = bam_out_tag_string( bam, "CB", CB.addr, CB.size );
+                if ( rc == 0 )
+                    rc = bam_out_tag_string( bam, "UB", UB.addr, UB.size );
+            }
+        }
+        else if ( CB.addr == NULL && UB.addr == NULL )
             { rc = KOutMsg( "\tBX:Z:%.*s", len, value ); }
         else
             { rc = KOutMsg( "\tCB:Z:%S\tUB:Z:%S", &CB, &UB ); }
@@ -1475,10 +1597,21 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     cg_cigar_output cgc_output;
     rna_splice_candidates candidates; /* in cg_tools.h */
     bool rna_not_homogeneous_flag = false;
+    bool projected = ( atx->proj.cursor != NULL );
+    sam_proj_row prow;
+    char * temp_cigar = NULL;
+    /* if the output is turned into BAM, the fields go directly into the encoder */
+    struct bam_out * bam = bam_redir_current(); /* bam_out.c */
+    char qname[ 256 ] = "*";
+    size_t qname_len = 1;
 
     /* SAM-FIELD: NONE      SRA-column: MATE_ALIGN_ID ( int64 ) ... for cache lookup's */
     rc_t rc = read_int64( id, cursor, atx->mate_align_id_idx, &mate_align_id, 0, "MATE_ALIGN_ID" );
 
+    /* the projection-cache has the values computed below already stored */
+    if ( rc == 0 && projected )
+        rc = sam_proj_read( &atx->proj, id, &prow ); /* sam-projection.c */
+
     candidates.count = 0;
     candidates.fwd_matched = 0;
     candidates.rev_matched = 0;
@@ -1546,7 +1679,12 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             if ( rc == 0 )
                 rc = read_INSDC_coord_len( id, cursor, atx->tlen_idx, &tlen, 0, "TLEN" );
             if ( rc == 0 )
-                rc = read_uint32( id, cursor, atx->sam_flags_idx, &sam_flags, 0, "SAM_FLAGS" );
+            {
+                if ( projected )
+                    sam_flags = prow.sam_flags;
+                else
+                    rc = read_uint32( id, cursor, atx->sam_flags_idx, &sam_flags, 0, "SAM_FLAGS" );
+            }
 
             if ( rc == 0 )
             {
@@ -1569,7 +1707,7 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                     {
                         /* now that we have the data, store it in sam-ref-cache it the mate is on the same ref. */
                         uint32_t mate_flags = calc_mate_flags( sam_flags );
-                        rc = matecache_insert_same_ref( mc, atx->db_idx, id, pos, mate_flags, -tlen );
+                        rc = matecache_insert_same_ref( mc, atx->db_idx, id, pos, mate_flags, -tlen, mate_ref_pos );
                     }
 
                     if ( mate_align_id == 0 && mate_ref_name_len == 0 && opts->print_half_unaligned_reads &&
@@ -1591,22 +1729,24 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     {
         if ( seq_spot_id_len > 0 )
         {
+            const char * spot_group = NULL;
+            uint32_t spot_group_len = 0;
             if ( opts->print_spot_group_in_name | opts->print_cg_names )
-            {
-                const char * spot_group;
-                uint32_t spot_group_len;
                 rc = read_char_ptr( id, cursor, atx->cmn.seq_spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
-                if ( rc == 0 )
+            if ( rc == 0 )
+            {
+                if ( bam != NULL )
+                    rc = format_name( opts, qname, sizeof qname, &qname_len,
+                                      *seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
+                else
                     rc = dump_name( opts, *seq_spot_id, spot_group, spot_group_len ); /* sam-dump-opts.c */
             }
-            else
-                rc = dump_name( opts, *seq_spot_id, NULL, 0 ); /* sam-dump-opts.c */
         }
-        else
+        else if ( bam == NULL )
             rc = KOutMsg( "*" );
     }
 
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = KOutMsg( "\t" );
 
     /* massage the sam-flag if we are not dumping unaligned reads... */
@@ -1621,18 +1761,33 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     /* SAM-FIELD: RNAME     SRA-column: REF_NAME / REF_SEQ_ID ( char * ) */
     /* SAM-FIELD: POS       SRA-column: REF_POS + 1 */
     /* SAM-FIELD: MAPQ      SRA-column: MAPQ */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = KOutMsg( "%u\t%s\t%u\t%d\t", sam_flags, ref_name, pos + 1, rec->mapq );
 
+    /* SAM-FIELD: CIGAR     from the projection-cache, already treated */
+    if ( rc == 0 && projected )
+    {
+        cgc_output.p_read.ptr = prow.read;
+        cgc_output.p_read.len = prow.read_len;
+        cgc_output.p_quality.ptr = prow.quality;
+        cgc_output.p_quality.len = prow.quality_len;
+        cgc_output.p_cigar.ptr = prow.cigar;
+        cgc_output.p_cigar.len = prow.cigar_len;
+        cgc_output.p_tags.ptr = prow.tags;
+        cgc_output.p_tags.len = prow.tags_len;
+        cgc_output.edit_dist = prow.nm;
+        if ( bam == NULL )
+            rc = KOutMsg( "%.*s\t", cgc_output.p_cigar.len, cgc_output.p_cigar.ptr );
+    }
+
     /* get READ, QUALITY and EIDT_DIST before cigar manipulation because we need/change these values */
-    if ( rc == 0 )
+    if ( rc == 0 && !projected )
         rc = get_READ_QUALITY_EDIT_DIST( &cgc_output, id, &atx->cmn );
 
     /* SAM-FIELD: CIGAR     SRA-column: CIGAR_SHORT / with or without treatment */
-    if ( rc == 0 )
+    if ( rc == 0 && !projected )
     {
         cg_cigar_input cgc_input;
-        char * temp_cigar = NULL;
         static char const *bogus_quality = "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!";
 
         rc = read_char_ptr( id, cursor, atx->cmn.cigar_idx, &cgc_input.p_cigar.ptr, &cgc_input.p_cigar.len, "CIGAR" );
@@ -1707,17 +1862,14 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             if ( candidates.cigops != NULL )
                 free( ( void * ) candidates.cigops );
         }
-        if ( rc == 0 )
+        if ( rc == 0 && bam == NULL )
             rc = KOutMsg( "%.*s\t", cgc_output.p_cigar.len, cgc_output.p_cigar.ptr );
-
-        if ( temp_cigar != NULL )
-            free( temp_cigar );
     }
 
     /* SAM-FIELD: RNEXT     SRA-column: MATE_REF_NAME ( !!! row_len can be zero !!! ) */
     /* SAM-FIELD: PNEXT     SRA-column: MATE_REF_POS + 1 ( !!! row_len can be zero !!! ) */
     /* SAM-FIELD: TLEN      SRA-column: TEMPLATE_LEN ( !!! row_len can be zero !!! ) */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
     {
         if ( mate_ref_name_len > 0 )
         {
@@ -1733,27 +1885,81 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     }
 
     /* SAM-FIELD: SEQ       SRA-column: READ */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = KOutMsg( "%.*s\t", cgc_output.p_read.len, cgc_output.p_read.ptr );
 
     /* SAM-FIELD: QUAL      SRA-column: SAM_QUALITY */
-    if ( rc == 0 )
+    if ( rc == 0 && bam == NULL )
         rc = print_quality_or_star( opts, cgc_output.p_quality.ptr, cgc_output.p_quality.len, cgc_output.p_read.len ); /* above */    
 
+    /* the same fields as values, the optional fields below follow */
+    if ( rc == 0 && bam != NULL )
+    {
+        bam_rec_fields f;
+        f.qname = qname;
+        f.qname_len = ( uint32_t )qname_len;
+        f.flag = sam_flags;
+        f.rname = ref_name;
+        f.rname_len = string_size( ref_name );
+        f.pos = pos;
+        f.mapq = ( uint32_t )rec->mapq;
+        f.cigar = cgc_output.p_cigar.ptr;
+        f.cigar_len = cgc_output.p_cigar.len;
+        if ( mate_ref_name_len > 0 )
+        {
+            f.rnext = mate_ref_name;
+            f.rnext_len = mate_ref_name_len;
+            f.pnext = mate_ref_pos;
+        }
+        else
+        {
+            f.rnext = "*";
+            f.rnext_len = 1;
+            f.pnext = ( mate_ref_pos_len == 0 ) ? -1 : ( int64_t )mate_ref_pos - 1;
+        }
+        f.tlen = ( int32_t )tlen;
+        f.seq = cgc_output.p_read.ptr;
+        f.seq_len = cgc_output.p_read.len;
+        if ( is_star_quality( cgc_output.p_quality.ptr, cgc_output.p_quality.len, cgc_output.p_read.len ) )
+        {
+            f.qual = NULL;
+            f.qual_len = 0;
+        }
+        else
+        {
+            f.qual = cgc_output.p_quality.ptr;
+            f.qual_len = cgc_output.p_quality.len;
+        }
+        f.qual_map = ( opts->qual_quant != NULL ) ? opts->qual_quant_matrix : NULL;
+        f.qual_offset = 33;
+        f.reverse = false;
+        rc = bam_out_begin_record( bam, &f ); /* bam_out.c */
+    }
+
     /* OPT SAM-FIELD: RG     SRA-column: SPOT_GROUP */
     if ( rc == 0 && ( atx->cmn.seq_spot_group_idx != COL_NOT_AVAILABLE ) )
-        rc = opt_field_spot_group( cursor, atx->cmn.seq_spot_group_idx, id );
+        rc = opt_field_spot_group( bam, cursor, atx->cmn.seq_spot_group_idx, id );
 
     /* OPT SAM-FIELD: BZ     SRA-column: LINKAGE_GROUP */
     if ( rc == 0 && ( atx->lnk_group_idx != COL_NOT_AVAILABLE ) )
-        rc = opt_field_lnk_group( cursor, atx->lnk_group_idx, id );
+        rc = opt_field_lnk_group( bam, cursor, atx->lnk_group_idx, id );
 
     if ( rc == 0 && cgc_output.p_tags.len > 0 )
-        rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_text( bam, cgc_output.p_tags.ptr, cgc_output.p_tags.len ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\t%.*s", cgc_output.p_tags.len, cgc_output.p_tags.ptr );
+    }
 
     /* OPT SAM-FIELD: XI     SRA-column: ALIGN_ID */
     if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-        rc = KOutMsg( "\tXI:i:%u", id );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_int( bam, "XI", ( uint32_t )id );
+        else
+            rc = KOutMsg( "\tXI:i:%u", id );
+    }
 
     /* to match sam-tools output: in case we are dumping this in CG-mode.... */
     if ( rc == 0 && ( opts->cigar_treatment != ct_unchanged ) && ( atx->al_group_idx != COL_NOT_AVAILABLE ) )
@@ -1768,7 +1974,17 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             {
                 if ( align_grp[ i ] == '_' )
                 {
-                    rc = KOutMsg( "\tZI:i:%.*s\tZA:i:%.1s", i, align_grp, align_grp + i + 1 );
+                    if ( bam != NULL )
+                    {
+                        char zi_za[ 64 ];
+                        size_t num_writ;
+                        rc = string_printf( zi_za, sizeof zi_za, &num_writ, "ZI:i:%.*s\tZA:i:%.1s",
+                                            i, align_grp, align_grp + i + 1 );
+                        if ( rc == 0 )
+                            rc = bam_out_tag_text( bam, zi_za, num_writ ); /* bam_out.c */
+                    }
+                    else
+                        rc = KOutMsg( "\tZI:i:%.*s\tZA:i:%.1s", i, align_grp, align_grp + i + 1 );
                     break;
                 }
             }
@@ -1782,12 +1998,22 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         uint32_t al_count_len;
         rc = read_uint8_ptr( id, cursor, atx->cmn.al_count_idx, &al_count, &al_count_len, "ALIGNMENT_COUNT" );
         if ( rc == 0 && al_count_len > 0 )
-            rc = KOutMsg( "\tNH:i:%u", *al_count );
+        {
+            if ( bam != NULL )
+                rc = bam_out_tag_int( bam, "NH", *al_count );
+            else
+                rc = KOutMsg( "\tNH:i:%u", *al_count );
+        }
     }
 
     /* OPT SAM-FIELD: NM     SRA-column: EDIT_DISTANCE */
     if ( rc == 0 )
-        rc = KOutMsg( "\tNM:i:%u", ( cgc_output.edit_dist - NM_adjustments ) );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_int( bam, "NM", ( uint32_t )( cgc_output.edit_dist - NM_adjustments ) );
+        else
+            rc = KOutMsg( "\tNM:i:%u", ( cgc_output.edit_dist - NM_adjustments ) );
+    }
 
     /* OPT SAM-FIELD: XS:A:+/-  SRA-column: RNA-SPLICING detected via computation, or from the RNA_ORIENTATION - column */
     if ( rc == 0 )
@@ -1797,7 +2023,9 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
             /* analysis of rna-splicing explicitly requested at the commandline */
             if ( candidates.fwd_matched > 0 || candidates.rev_matched > 0 )
             {
-                if ( candidates.fwd_matched > 0 )
+                if ( bam != NULL )
+                    rc = bam_out_tag_char( bam, "XS", candidates.fwd_matched > 0 ? '+' : '-' );
+                else if ( candidates.fwd_matched > 0 )
                     rc = KOutMsg( "\tXS:A:+" );
                 else 
                     rc = KOutMsg( "\tXS:A:-" );
@@ -1814,14 +2042,24 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
                                     &rna_orientation, &rna_orientation_len, "RNA_ORIENTATION" );
                 if ( rc == 0 && rna_orientation_len > 0 )
                 {
-                    rc = KOutMsg( "\tXS:A:%c", rna_orientation[ 0 ] );
+                    if ( bam != NULL )
+                        rc = bam_out_tag_char( bam, "XS", rna_orientation[ 0 ] );
+                    else
+                        rc = KOutMsg( "\tXS:A:%c", rna_orientation[ 0 ] );
                 }
             }
         }
     }
 
     /* OPT SAM_FIELD: MD    reports Mismatches and Deletions */
-    if ( rc == 0 && opts->with_md_flag )
+    if ( rc == 0 && opts->with_md_flag && projected )
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_text( bam, prow.md, prow.md_len ); /* bam_out.c */
+        else
+            rc = KOutMsg( "%.*s", prow.md_len, prow.md );
+    }
+    else if ( rc == 0 && opts->with_md_flag )
     {
         uint8_t * alig_ref = malloc( rec->len );
         if ( alig_ref == NULL )
@@ -1830,7 +2068,20 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
         {
             INSDC_coord_len ref_len;
             rc = ReferenceObj_Read( rec->ref, pos, rec->len, alig_ref, &ref_len );
-            if ( rc == 0 )
+            if ( rc == 0 && bam != NULL )
+            {
+                char * md;
+                size_t md_len;
+                rc = md_tag_from_cigar_string( cgc_output.p_cigar.ptr, cgc_output.p_cigar.len,
+                        cgc_output.p_read.ptr, cgc_output.p_read.len,
+                        alig_ref, ref_len, &md, &md_len ); /* md_flag.c */
+                if ( rc == 0 )
+                {
+                    rc = bam_out_tag_string( bam, "MD", md, md_len ); /* bam_out.c */
+                    free( md );
+                }
+            }
+            else if ( rc == 0 )
             {
                 rc = kout_md_tag_from_cigar_string( cgc_output.p_cigar.ptr, cgc_output.p_cigar.len, /* cigar */
                         cgc_output.p_read.ptr, cgc_output.p_read.len,                               /* read */
@@ -1841,7 +2092,15 @@ static rc_t print_alignment_sam_ps( const samdump_opts * const opts,
     }
     
     if ( rc == 0 )
-        rc = KOutMsg( "\n" );
+    {
+        if ( bam != NULL )
+            rc = bam_out_end_record( bam ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\n" );
+    }
+
+    if ( temp_cigar != NULL )
+        free( temp_cigar );
 
     /* print a log-info if have to because RNA-splicing is requested and we have not homogeneous bits */
     if ( rna_not_homogeneous_flag )
@@ -2069,7 +2328,11 @@ static rc_t walk_window( const samdump_opts * const opts,
             }
             else
             {
-                rc = walk_position( opts, set_iter, ref_name, pos, mc, splice_dict, first_pos, len );
+                /* drops/spills/reloads same-ref-mates, the table is only scanned from time to time */
+                if ( mc != NULL && opts->use_mate_cache )
+                    rc = matecache_advance_same_ref( mc, pos );
+                if ( rc == 0 )
+                    rc = walk_position( opts, set_iter, ref_name, pos, mc, splice_dict, first_pos, len );
             }
         }
     }
@@ -2198,11 +2461,13 @@ static void CC destroy_align_table_context( void *item, void *data )
 }
 
 
-static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * const opts,
-                                                       const input_database * const ids,
-                                                       matecache * const mc,
-                                                       const AlignMgr * const a_mgr,
-                                                       const ReferenceObj * const ref_obj )
+static rc_t print_aligned_spots_of_this_window( const samdump_opts * const opts,
+                                                const input_database * const ids,
+                                                matecache * const mc,
+                                                const AlignMgr * const a_mgr,
+                                                const ReferenceObj * const ref_obj,
+                                                INSDC_coord_zero ref_pos,
+                                                INSDC_coord_len ref_len )
 {
     PlacementSetIterator * set_iter;
     /* the we ask the alignment-manager to produce a placement-set-iterator... */
@@ -2215,22 +2480,17 @@ static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * cons
     {
         /* here we need a vector to passed along into the creation of the iterators */
         Vector context_list;
-        INSDC_coord_len ref_len;
 
         VectorInit ( &context_list, 0, 5 );
 
-        rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+        rc = add_pl_iters( opts, set_iter, ref_obj, ids,
+            ref_pos,            /* where it starts on the reference */
+            ref_len,            /* the length of the window on this reference/chromosome */
+            NULL,               /* no spotgroup re-grouping (yet) */
+            &context_list
+            );
         if ( rc == 0 )
-        {
-            rc = add_pl_iters( opts, set_iter, ref_obj, ids,
-                0,                  /* where it starts on the reference */
-                ref_len,            /* the whole length of this reference/chromosome */
-                NULL,               /* no spotgroup re-grouping (yet) */
-                &context_list
-                );
-            if ( rc == 0 )
-                rc = walk_placements( opts, set_iter, mc );
-        }
+            rc = walk_placements( opts, set_iter, mc );
 
         /* walk the context_list to free the align_table_context records, close/free the cursors... */
         VectorWhack ( &context_list, destroy_align_table_context, NULL );
@@ -2240,6 +2500,20 @@ static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * cons
 }
 
 
+static rc_t print_all_aligned_spots_of_this_reference( const samdump_opts * const opts,
+                                                       const input_database * const ids,
+                                                       matecache * const mc,
+                                                       const AlignMgr * const a_mgr,
+                                                       const ReferenceObj * const ref_obj )
+{
+    INSDC_coord_len ref_len;
+    rc_t rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+    if ( rc == 0 )
+        rc = print_aligned_spots_of_this_window( opts, ids, mc, a_mgr, ref_obj, 0, ref_len );
+    return rc;
+}
+
+
 /*
    the user did not specify regions, print all alignments from all input-files
    this is strategy #1 to do this, create a ref_iter for every reference each
@@ -2281,6 +2555,427 @@ static rc_t print_all_aligned_spots_0( const samdump_opts * const opts,
 }
 
 
+/*
+   the user did not specify regions, print all alignments from all input-files
+   this is strategy #1 on a pool of worker-threads:
+   every reference is cut into windows, each window is a job, the jobs are processed
+   by the workers with their own cursors, mate-cache and output-buffer
+   the main-thread writes the output-buffers in the order of the jobs, that makes
+   the output identical to the single-threaded strategy #1
+    + ... multiple references or windows of large references are processed in parallel
+    - ... more memory: the output of finished jobs waits for the main-thread, a worker
+          does not start a new job while that exceeds --thread-mem, unless it is the
+          job the main-thread waits for. up to 2 x threads jobs are in flight
+    - ... mates on the same reference, but in different windows, are not found in the
+          mate-cache, they are read from the table instead
+   the size of the windows is --thread-window, dense references produce more output
+   per window: a smaller window keeps the output of a job smaller
+*/
+
+#define MT_BUFFER_SIZE ( 1024 * 1024 )
+
+typedef struct mt_job
+{
+    uint32_t db_idx;
+    uint32_t ref_idx;
+    INSDC_coord_zero ref_pos;
+    INSDC_coord_len ref_len;
+
+    out_buffer buffer;      /* what the job has printed */
+    matecache * mc;         /* the unaligned mates the job has found */
+    rc_t rc;
+    bool done;
+} mt_job;
+
+
+typedef struct mt_ctx
+{
+    const samdump_opts * opts;
+    const input_files * ifs;
+
+    mt_job * jobs;
+    uint32_t job_count;
+    uint32_t next_job;      /* the next job to be taken by a worker */
+    uint32_t next_out;      /* the next job to be written by the main-thread */
+    uint32_t max_ahead;     /* how many jobs can be ahead of the main-thread */
+    size_t buffered;        /* output of finished jobs not yet written */
+    size_t max_buffered;    /* no new jobs beyond the next one to be written while above */
+    struct bam_out * bam;   /* the output is turned into BAM: every worker encodes with its own encoder */
+
+    KLock * lock;
+    KCondition * job_done;      /* a worker finished a job */
+    KCondition * job_written;   /* the main-thread has written a job */
+    bool quit;
+} mt_ctx;
+
+
+static rc_t mt_add_job( mt_ctx * ctx, uint32_t * capacity, uint32_t db_idx, uint32_t ref_idx,
+                        INSDC_coord_zero ref_pos, INSDC_coord_len ref_len )
+{
+    rc_t rc = 0;
+    if ( ctx->job_count >= *capacity )
+    {
+        uint32_t new_capacity = ( *capacity > 0 ) ? *capacity * 2 : 64;
+        mt_job * tmp = realloc( ctx->jobs, new_capacity * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+        {
+            rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            (void)LOGERR( klogErr, rc, "cannot create job-list" );
+        }
+        else
+        {
+            ctx->jobs = tmp;
+            *capacity = new_capacity;
+        }
+    }
+    if ( rc == 0 )
+    {
+        mt_job * job = &ctx->jobs[ ctx->job_count++ ];
+        memset( job, 0, sizeof * job );
+        job->db_idx = db_idx;
+        job->ref_idx = ref_idx;
+        job->ref_pos = ref_pos;
+        job->ref_len = ref_len;
+    }
+    return rc;
+}
+
+
+/* cut every reference of every input-database into windows of --thread-window bases */
+static rc_t mt_make_jobs( mt_ctx * ctx )
+{
+    rc_t rc = 0;
+    uint32_t capacity = 0;
+    uint32_t db_idx;
+    for ( db_idx = 0; db_idx < ctx->ifs->database_count && rc == 0; ++db_idx )
+    {
+        const input_database * ids = VectorGet( &ctx->ifs->dbs, db_idx );
+        if ( ids != NULL )
+        {
+            uint32_t refobj_count;
+            rc = ReferenceList_Count( ids->reflist, &refobj_count );
+            if ( rc == 0 && refobj_count > 0 )
+            {
+                uint32_t ref_idx;
+                for ( ref_idx = 0; ref_idx < refobj_count && rc == 0; ++ref_idx )
+                {
+                    const ReferenceObj * ref_obj;
+                    rc = ReferenceList_Get( ids->reflist, &ref_obj, ref_idx );
+                    if ( rc == 0 && ref_obj != NULL )
+                    {
+                        INSDC_coord_len ref_len;
+                        rc = ReferenceObj_SeqLength( ref_obj, &ref_len );
+                        if ( rc == 0 )
+                        {
+                            INSDC_coord_len pos = 0;
+                            do
+                            {
+                                INSDC_coord_len len = ref_len - pos;
+                                if ( len > ctx->opts->thread_window )
+                                    len = ctx->opts->thread_window;
+                                rc = mt_add_job( ctx, &capacity, db_idx, ref_idx, pos, len );
+                                pos += len;
+                            } while ( rc == 0 && pos < ref_len );
+                        }
+                        ReferenceObj_Release( ref_obj );
+                    }
+                }
+            }
+        }
+    }
+    return rc;
+}
+
+
+/* a job is processed with the alignment-manager and the reference-lists of the worker */
+static rc_t mt_process_job( mt_ctx * ctx, mt_job * job,
+                            const AlignMgr * a_mgr, const ReferenceList ** reflists )
+{
+    const input_database * ids = VectorGet( &ctx->ifs->dbs, job->db_idx );
+    rc_t rc = init_out_buffer( &job->buffer, MT_BUFFER_SIZE ); /* out_buffer.c */
+
+    if ( rc == 0 && reflists[ job->db_idx ] == NULL )
+    {
+        /* the placement-iterators read through the cursor of the reference-list,
+           that is why every worker needs its own reference-list */
+        rc = ReferenceList_MakeDatabase( &reflists[ job->db_idx ], ids->db, ctx->ifs->reflist_options, 0, NULL, 0 );
+        if ( rc != 0 )
+        {
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create reflist for '$(t)'", "t=%s", ids->path ) );
+        }
+    }
+
+    if ( rc == 0 && ctx->opts->use_mate_cache )
+        rc = make_matecache( &job->mc, ctx->ifs->database_count,
+                             ctx->opts->mate_cache_mem / ctx->opts->threads ); /* matecache.c */
+
+    if ( rc == 0 )
+    {
+        const ReferenceObj * ref_obj;
+        rc = ReferenceList_Get( reflists[ job->db_idx ], &ref_obj, job->ref_idx );
+        if ( rc == 0 && ref_obj != NULL )
+        {
+            attach_out_buffer( &job->buffer ); /* out_buffer.c */
+            rc = print_aligned_spots_of_this_window( ctx->opts, ids, job->mc, a_mgr, ref_obj,
+                                                     job->ref_pos, job->ref_len );
+            attach_out_buffer( NULL );
+            ReferenceObj_Release( ref_obj );
+        }
+    }
+    return rc;
+}
+
+
+static rc_t CC mt_worker( const KThread * self, void * data )
+{
+    mt_ctx * ctx = data;
+    const AlignMgr * a_mgr = NULL;
+    const ReferenceList ** reflists = NULL;
+    struct bam_out * bam = NULL;
+
+    rc_t rc = AlignMgrMakeRead( &a_mgr );
+    if ( rc != 0 )
+    {
+        (void)LOGERR( klogErr, rc, "cannot create alignment-manager" );
+    }
+    else
+    {
+        reflists = calloc( ctx->ifs->database_count, sizeof * reflists );
+        if ( reflists == NULL )
+        {
+            rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            (void)LOGERR( klogErr, rc, "cannot create reflist-array" );
+        }
+    }
+
+    /* the records go as binary frames into the out_buffers, the main-thread only compresses them */
+    if ( rc == 0 && ctx->bam != NULL )
+    {
+        rc = make_bam_out_worker( &bam, ctx->bam ); /* bam_out.c */
+        if ( rc == 0 )
+            attach_bam_out( bam ); /* bam_out.c */
+    }
+
+    while ( rc == 0 )
+    {
+        mt_job * job = NULL;
+
+        KLockAcquire( ctx->lock );
+        while ( !ctx->quit &&
+                ctx->next_job < ctx->job_count &&
+                ( ctx->next_job >= ctx->next_out + ctx->max_ahead ||
+                  ( ctx->buffered >= ctx->max_buffered && ctx->next_job > ctx->next_out ) ) )
+        {
+            KConditionWait( ctx->job_written, ctx->lock );
+        }
+        if ( !ctx->quit && ctx->next_job < ctx->job_count )
+            job = &ctx->jobs[ ctx->next_job++ ];
+        KLockUnlock( ctx->lock );
+
+        if ( job == NULL )
+            break;
+
+        rc = mt_process_job( ctx, job, a_mgr, reflists );
+
+        KLockAcquire( ctx->lock );
+        job->rc = rc;
+        job->done = true;
+        ctx->buffered += job->buffer.used;
+        KConditionBroadcast( ctx->job_done );
+        KLockUnlock( ctx->lock );
+    }
+
+    if ( rc != 0 )
+    {
+        KLockAcquire( ctx->lock );
+        ctx->quit = true;
+        KConditionBroadcast( ctx->job_done );
+        KConditionBroadcast( ctx->job_written );
+        KLockUnlock( ctx->lock );
+    }
+
+    if ( bam != NULL )
+    {
+        attach_bam_out( NULL ); /* bam_out.c */
+        release_bam_out( bam ); /* bam_out.c */
+    }
+    if ( reflists != NULL )
+    {
+        uint32_t idx;
+        for ( idx = 0; idx < ctx->ifs->database_count; ++idx )
+        {
+            if ( reflists[ idx ] != NULL )
+                ReferenceList_Release( reflists[ idx ] );
+        }
+        free( ( void * )reflists );
+    }
+    if ( a_mgr != NULL )
+        AlignMgrRelease( a_mgr );
+    return rc;
+}
+
+
+/* the main-thread writes the output of the jobs in order, and collects the unaligned mates */
+static rc_t mt_write_jobs( mt_ctx * ctx, const out_buffer_redir * redir, matecache * const mc )
+{
+    rc_t rc = 0;
+    uint32_t idx;
+    size_t buffered;
+    for ( idx = 0; idx < ctx->job_count && rc == 0; ++idx )
+    {
+        mt_job * job = &ctx->jobs[ idx ];
+
+        KLockAcquire( ctx->lock );
+        while ( !job->done && !ctx->quit )
+            KConditionWait( ctx->job_done, ctx->lock );
+        if ( !job->done )
+        {
+            /* a worker may still be on it, it is released after the workers are gone */
+            rc = RC( rcExe, rcNoTarg, rcProcessing, rcThread, rcCanceled );
+            KLockUnlock( ctx->lock );
+            break;
+        }
+        rc = job->rc;
+        buffered = job->buffer.used;
+        KLockUnlock( ctx->lock );
+
+        if ( rc == 0 )
+            rc = flush_out_buffer( redir, &job->buffer ); /* out_buffer.c */
+        release_out_buffer( &job->buffer );
+
+        if ( rc == 0 && mc != NULL && job->mc != NULL )
+            rc = matecache_merge_unaligned( mc, job->mc ); /* matecache.c */
+        release_matecache( job->mc );
+        job->mc = NULL;
+
+        KLockAcquire( ctx->lock );
+        ctx->next_out = idx + 1;
+        ctx->buffered -= buffered;
+        if ( rc != 0 )
+            ctx->quit = true;
+        KConditionBroadcast( ctx->job_written );
+        KLockUnlock( ctx->lock );
+    }
+    return rc;
+}
+
+
+static rc_t print_all_aligned_spots_mt( const samdump_opts * const opts,
+                                        const input_files * const ifs,
+                                        matecache * const mc )
+{
+    mt_ctx ctx;
+    rc_t rc;
+
+    memset( &ctx, 0, sizeof ctx );
+    ctx.opts = opts;
+    ctx.ifs = ifs;
+    ctx.max_ahead = opts->threads * 2;
+    ctx.max_buffered = opts->thread_mem;
+
+    rc = mt_make_jobs( &ctx );
+    if ( rc == 0 && ctx.job_count > 0 )
+    {
+        rc = KLockMake( &ctx.lock );
+        if ( rc != 0 )
+            (void)LOGERR( klogInt, rc, "KLockMake() failed" );
+        else
+        {
+            rc = KConditionMake( &ctx.job_done );
+            if ( rc != 0 )
+                (void)LOGERR( klogInt, rc, "KConditionMake() failed" );
+            else
+            {
+                rc = KConditionMake( &ctx.job_written );
+                if ( rc != 0 )
+                    (void)LOGERR( klogInt, rc, "KConditionMake() failed" );
+            }
+        }
+    }
+
+    /* the BAM-encoder of the main-thread has to be found before the out_buffer_redir hides it,
+       the header has to be complete before the workers make their encoders */
+    if ( rc == 0 && ctx.job_count > 0 )
+    {
+        ctx.bam = bam_redir_current(); /* bam_out.c */
+        if ( ctx.bam != NULL )
+            rc = bam_out_write_header( ctx.bam ); /* bam_out.c */
+    }
+
+    if ( rc == 0 && ctx.job_count > 0 )
+    {
+        out_buffer_redir redir; /* from out_buffer.h */
+        rc = init_out_buffer_redir( &redir ); /* out_buffer.c */
+        if ( rc == 0 )
+        {
+            uint32_t thread_count = opts->threads;
+            KThread ** threads;
+
+            if ( thread_count > ctx.job_count )
+                thread_count = ctx.job_count;
+            threads = calloc( thread_count, sizeof * threads );
+            if ( threads == NULL )
+            {
+                rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+                (void)LOGERR( klogErr, rc, "cannot create thread-array" );
+            }
+            else
+            {
+                uint32_t idx;
+                for ( idx = 0; idx < thread_count && rc == 0; ++idx )
+                {
+                    rc = KThreadMake( &threads[ idx ], mt_worker, &ctx );
+                    if ( rc != 0 )
+                        (void)LOGERR( klogInt, rc, "KThreadMake() failed" );
+                }
+
+                if ( rc == 0 )
+                    rc = mt_write_jobs( &ctx, &redir, mc );
+
+                if ( rc != 0 )
+                {
+                    KLockAcquire( ctx.lock );
+                    ctx.quit = true;
+                    KConditionBroadcast( ctx.job_written );
+                    KLockUnlock( ctx.lock );
+                }
+
+                for ( idx = 0; idx < thread_count; ++idx )
+                {
+                    if ( threads[ idx ] != NULL )
+                    {
+                        rc_t rc_thread;
+                        KThreadWait( threads[ idx ], &rc_thread );
+                        KThreadRelease( threads[ idx ] );
+                    }
+                }
+                free( threads );
+            }
+            release_out_buffer_redir( &redir ); /* out_buffer.c */
+        }
+    }
+
+    if ( ctx.jobs != NULL )
+    {
+        /* the jobs not written because of an error */
+        uint32_t idx;
+        for ( idx = 0; idx < ctx.job_count; ++idx )
+        {
+            release_out_buffer( &ctx.jobs[ idx ].buffer );
+            release_matecache( ctx.jobs[ idx ].mc );
+        }
+        free( ctx.jobs );
+    }
+    if ( ctx.job_written != NULL )
+        KConditionRelease( ctx.job_written );
+    if ( ctx.job_done != NULL )
+        KConditionRelease( ctx.job_done );
+    if ( ctx.lock != NULL )
+        KLockRelease( ctx.lock );
+    return rc;
+}
+
+
 /*
    the user did not specify regions, print all alignments from all input-files
    this is strategy #2 to do this, throw all iterators for all input-files and all there references
@@ -2357,6 +3052,16 @@ static rc_t print_selected_aligned_spots( const samdump_opts * const opts,
 }
 
 
+/* the worker-threads cannot share the rna-splice-log and the perf-log */
+static bool use_worker_threads( const samdump_opts * const opts )
+{
+    return ( opts->threads > 1 &&
+             !opts->no_mt &&
+             opts->rna_splice_log == NULL &&
+             opts->perf_log == NULL );
+}
+
+
 /*
    this is called from sam-dump3.c, it prepares the iterators and then walks them
    ---> only entry into this module <--- 
@@ -2386,7 +3091,11 @@ rc_t print_aligned_spots( const samdump_opts * const opts,
             /* the user did not specify regions to be printed ==> print all alignments */
             switch( opts->dump_mode )
             {
-                case dm_one_ref_at_a_time : rc = print_all_aligned_spots_0( opts, ifs, mc, a_mgr ); break;
+                case dm_one_ref_at_a_time : if ( use_worker_threads( opts ) )
+                                                rc = print_all_aligned_spots_mt( opts, ifs, mc );
+                                            else
+                                                rc = print_all_aligned_spots_0( opts, ifs, mc, a_mgr );
+                                            break;
                 case dm_prepare_all_refs  : rc = print_all_aligned_spots_1( opts, ifs, mc, a_mgr ); break;
             }
         }
@@ -2405,3 +3114,253 @@ rc_t print_aligned_spots( const samdump_opts * const opts,
 
     return rc;
 }
+
+
+/* -------------------------------------------------------------------------------------------
+    --build-projection : computes CIGAR/READ/QUALITY/NM/MD of every prim/sec-alignment once,
+    in row-id-order, and writes them into the SAM-projection-cache ( sam-projection.c )
+   ------------------------------------------------------------------------------------------- */
+
+typedef struct proj_build_ctx
+{
+    const ReferenceList * reflist;
+    const ReferenceObj * ref_obj;   /* the reference of the last row, the rows are mostly sorted by it */
+    const char * ref_name;
+    uint8_t * ref_buffer;
+    INSDC_coord_len ref_buffer_len;
+    out_buffer md_buffer;           /* captures what kout_md_tag_from_cigar_string() prints */
+    uint32_t ref_name_idx;
+    uint32_t ref_pos_idx;
+    uint32_t ref_len_idx;
+} proj_build_ctx;
+
+
+static rc_t proj_find_ref( proj_build_ctx * pbc, const char * name, uint32_t name_len )
+{
+    rc_t rc = 0;
+    if ( pbc->ref_obj == NULL ||
+         string_cmp( pbc->ref_name, string_size( pbc->ref_name ), name, name_len, UINT32_MAX ) != 0 )
+    {
+        if ( pbc->ref_obj != NULL )
+        {
+            ReferenceObj_Release( pbc->ref_obj );
+            pbc->ref_obj = NULL;
+        }
+        rc = ReferenceList_Find( pbc->reflist, &pbc->ref_obj, name, name_len );
+        if ( rc == 0 )
+            rc = ReferenceObj_Name( pbc->ref_obj, &pbc->ref_name );
+        if ( rc != 0 )
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot find reference '$(r)'", "r=%.*s", name_len, name ) );
+    }
+    return rc;
+}
+
+
+static rc_t proj_md_tag( proj_build_ctx * pbc, int64_t id, const VCursor * cursor,
+                         const cg_cigar_output * cgc_output, sam_proj_row * prow )
+{
+    const char * ref_name;
+    uint32_t ref_name_len;
+    INSDC_coord_zero ref_pos;
+    INSDC_coord_len ref_len;
+    rc_t rc = read_char_ptr( id, cursor, pbc->ref_name_idx, &ref_name, &ref_name_len, "REF_NAME" );
+    if ( rc == 0 )
+        rc = read_INSDC_coord_zero( id, cursor, pbc->ref_pos_idx, &ref_pos, 0, "REF_POS" );
+    if ( rc == 0 )
+        rc = read_INSDC_coord_len( id, cursor, pbc->ref_len_idx, &ref_len, 0, "REF_LEN" );
+    if ( rc == 0 )
+        rc = proj_find_ref( pbc, ref_name, ref_name_len );
+    if ( rc == 0 && pbc->ref_buffer_len < ref_len )
+    {
+        uint8_t * tmp = realloc( pbc->ref_buffer, ref_len );
+        if ( tmp == NULL )
+            rc = RC( rcExe, rcNoTarg, rcAllocating, rcMemory, rcExhausted );
+        else
+        {
+            pbc->ref_buffer = tmp;
+            pbc->ref_buffer_len = ref_len;
+        }
+    }
+    if ( rc == 0 )
+    {
+        INSDC_coord_len written;
+        rc = ReferenceObj_Read( pbc->ref_obj, ref_pos, ref_len, pbc->ref_buffer, &written );
+        if ( rc == 0 )
+        {
+            pbc->md_buffer.used = 0;
+            attach_out_buffer( &pbc->md_buffer ); /* out_buffer.c */
+            rc = kout_md_tag_from_cigar_string( cgc_output->p_cigar.ptr, cgc_output->p_cigar.len, /* cigar */
+                    cgc_output->p_read.ptr, cgc_output->p_read.len,                                 /* read */
+                    pbc->ref_buffer, written );                                                     /* reference */
+            attach_out_buffer( NULL );
+            prow->md = pbc->md_buffer.data;
+            prow->md_len = ( uint32_t )pbc->md_buffer.used;
+        }
+    }
+    return rc;
+}
+
+
+/* the same computation as in print_alignment_sam_ps(), without RNA-splicing */
+static rc_t proj_alignment( const samdump_opts * const opts, proj_build_ctx * pbc,
+                            const align_table_context * const atx, int64_t id,
+                            sam_proj_row * prow )
+{
+    cg_cigar_output cgc_output;
+    cg_cigar_input cgc_input;
+    static char const *bogus_quality = "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!";
+    const VCursor * cursor = atx->cmn.cursor;
+    rc_t rc = get_READ_QUALITY_EDIT_DIST( &cgc_output, id, &atx->cmn );
+    if ( rc == 0 )
+        rc = read_char_ptr( id, cursor, atx->cmn.cigar_idx, &cgc_input.p_cigar.ptr, &cgc_input.p_cigar.len, "CIGAR" );
+    if ( rc == 0 )
+    {
+        if ( cgc_output.p_quality.len == 0 )
+        {
+            cgc_output.p_quality.ptr = bogus_quality;
+            cgc_output.p_quality.len = 35;
+        }
+        rc = cg_cigar_treatments( opts->cigar_treatment, &cgc_input, &cgc_output, id, &atx->cmn );
+    }
+    if ( rc == 0 )
+        rc = read_uint32( id, cursor, atx->sam_flags_idx, &prow->sam_flags, 0, "SAM_FLAGS" );
+    if ( rc == 0 )
+    {
+        prow->cigar = cgc_output.p_cigar.ptr;
+        prow->cigar_len = cgc_output.p_cigar.len;
+        prow->read = cgc_output.p_read.ptr;
+        prow->read_len = cgc_output.p_read.len;
+        prow->quality = cgc_output.p_quality.ptr;
+        prow->quality_len = cgc_output.p_quality.len;
+        prow->tags = cgc_output.p_tags.ptr;
+        prow->tags_len = cgc_output.p_tags.len;
+        prow->nm = ( uint32_t )cgc_output.edit_dist;
+        prow->md = NULL;
+        prow->md_len = 0;
+        if ( opts->with_md_flag )
+            rc = proj_md_tag( pbc, id, cursor, &cgc_output, prow );
+    }
+    return rc;
+}
+
+
+static rc_t build_projection_table( const samdump_opts * const opts,
+                                    const input_database * idb,
+                                    struct sam_proj_writer * writer,
+                                    const char * table_name,
+                                    enum align_table_type table_type )
+{
+    rc_t rc = 0;
+    const VTable * tbl;
+    align_table_context * atx;
+
+    /* the secondary table is optional */
+    if ( VDatabaseOpenTableRead( idb->db, &tbl, "%s", table_name ) != 0 )
+        return 0;
+    VTableRelease( tbl );
+
+    atx = calloc( 1, sizeof * atx );
+    if ( atx == NULL )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        (void)PLOGERR( klogInt, ( klogInt, rc, "align-context-allocation for $(tn) failed", "tn=%s", table_name ) );
+    }
+    else
+    {
+        proj_build_ctx pbc;
+
+        memset( &pbc, 0, sizeof pbc );
+        pbc.reflist = idb->reflist;
+        init_align_table_context( atx, idb->db_idx, NULL );
+        atx->align_table_type = table_type;
+        rc = prepare_prim_sec_table_cursor( opts, idb->db, table_name, atx );
+        if ( rc == 0 && opts->with_md_flag )
+        {
+            rc = add_column( atx->cmn.cursor, COL_REF_NAME, &pbc.ref_name_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( atx->cmn.cursor, COL_REF_POS, &pbc.ref_pos_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( atx->cmn.cursor, COL_REF_LEN, &pbc.ref_len_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = init_out_buffer( &pbc.md_buffer, 4096 ); /* out_buffer.c */
+        }
+        if ( rc == 0 )
+        {
+            rc = VCursorOpen( atx->cmn.cursor );
+            if ( rc != 0 )
+                (void)PLOGERR( klogInt, ( klogInt, rc, "VCursorOpen( $(tn) ) failed", "tn=%s", table_name ) );
+        }
+        if ( rc == 0 )
+        {
+            int64_t first, row_id;
+            uint64_t count;
+            rc = VCursorIdRange( atx->cmn.cursor, atx->sam_flags_idx, &first, &count );
+            if ( rc != 0 )
+                (void)PLOGERR( klogInt, ( klogInt, rc, "VCursorIdRange( $(tn) ) failed", "tn=%s", table_name ) );
+            else
+                rc = sam_proj_writer_open_table( writer, table_name, first, count ); /* sam-projection.c */
+
+            for ( row_id = first; rc == 0 && row_id < first + ( int64_t )count; ++row_id )
+            {
+                sam_proj_row prow;
+                rc = proj_alignment( opts, &pbc, atx, row_id, &prow );
+                if ( rc == 0 )
+                    rc = sam_proj_writer_write( writer, &prow ); /* sam-projection.c */
+                if ( rc == 0 )
+                    rc = Quitting();
+            }
+
+            if ( rc == 0 )
+                rc = sam_proj_writer_close_table( writer ); /* sam-projection.c */
+            else
+                sam_proj_writer_close_table( writer );
+        }
+        if ( pbc.ref_obj != NULL )
+            ReferenceObj_Release( pbc.ref_obj );
+        if ( pbc.ref_buffer != NULL )
+            free( pbc.ref_buffer );
+        if ( pbc.md_buffer.data != NULL )
+            release_out_buffer( &pbc.md_buffer ); /* out_buffer.c */
+        free_align_table_context( atx );
+    }
+    return rc;
+}
+
+
+/* this is called from sam-dump3.c if --build-projection is given */
+rc_t build_sam_projection( const samdump_opts * const opts,
+                           const input_files * const ifs,
+                           KDirectory * dir )
+{
+    rc_t rc = 0;
+    if ( ifs->database_count != 1 )
+    {
+        rc = RC( rcExe, rcNoTarg, rcConstructing, rcParam, rcInvalid );
+        (void)LOGERR( klogErr, rc, "--build-projection needs exactly one input-database" );
+    }
+    else
+    {
+        const input_database * idb = VectorGet( &ifs->dbs, 0 );
+        struct sam_proj_writer * writer;
+
+        if ( opts->rna_splicing )
+            (void)LOGMSG( klogWarn, "--rna-splicing is not part of a projection, it is ignored" );
+
+        rc = make_sam_proj_writer( &writer, dir, opts->build_projection, opts,
+                                   idb->db, idb->path ); /* sam-projection.c */
+        if ( rc == 0 )
+        {
+            out_buffer_redir redir;
+            rc = init_out_buffer_redir( &redir ); /* out_buffer.c */
+            if ( rc == 0 )
+            {
+                rc = build_projection_table( opts, idb, writer, PRIM_TABLE, att_primary );
+                if ( rc == 0 )
+                    rc = build_projection_table( opts, idb, writer, SEC_TABLE, att_secondary );
+                release_out_buffer_redir( &redir ); /* out_buffer.c */
+            }
+            release_sam_proj_writer( writer ); /* sam-projection.c */
+        }
+    }
+    return rc;
+}
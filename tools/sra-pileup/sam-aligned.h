@@ -33,6 +33,8 @@ extern "C" {
 }
 #endif
 
+#include <kfs/directory.h>
+
 #include "sam-dump-opts.h"
 #include "inputfiles.h"
 #include "matecache.h"
@@ -43,4 +45,9 @@ rc_t print_aligned_spots( const samdump_opts * const opts,
                           const input_files * const ifs,
                           matecache * const mc );
 
+/* computes the projection of the one input-database into opts->build_projection */
+rc_t build_sam_projection( const samdump_opts * const opts,
+                           const input_files * const ifs,
+                           KDirectory * dir );
+
 #endif
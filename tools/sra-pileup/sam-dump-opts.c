@@ -29,6 +29,7 @@
 #include "perf_log.h"
 
 #include <klib/time.h>
+#include <klib/printf.h>
 #include <align/quality-quantizer.h>
 #include <sysalloc.h>
 
@@ -742,6 +743,20 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
             opts->output_compression = oc_bzip2;
     }
 
+    {
+        bool bam;
+
+        /* do we have to produce BAM instead of SAM ? */
+        rc = get_bool_option( args, OPT_BAM, &bam );
+        if ( rc != 0 ) return rc;
+        if ( bam )
+            opts->output_compression = oc_bam;
+
+        /* do we have to write an index for the BAM-file ? */
+        rc = get_bool_option( args, OPT_BAM_INDEX, &opts->bam_index );
+        if ( rc != 0 ) return rc;
+    }
+
 
     {
         bool fasta, fastq;
@@ -823,6 +838,18 @@ static rc_t gather_flag_options( Args * args, samdump_opts * opts )
             opts->force_new = false;
         }
     }
+
+    /* BAM is encoded from the SAM-text produced by the new code-path, it needs the @SQ-lines */
+    if ( rc == 0 && opts->output_compression == oc_bam )
+    {
+        if ( opts->output_format != of_sam || opts->force_legacy )
+        {
+            rc = RC( rcExe, rcNoTarg, rcValidating, rcParam, rcInvalid );
+            (void)LOGERR( klogErr, rc, "--bam can only be used for SAM-output of the new code-path" );
+        }
+        else if ( opts->header_mode == hm_none )
+            opts->header_mode = hm_recalc;
+    }
     return rc;
 }
 
@@ -928,6 +955,14 @@ static rc_t gather_int_options( Args * args, samdump_opts * opts )
             opts->cursor_cache_size = ( size_t )cs;
     }
 
+    if ( rc == 0 )
+    {
+        uint32_t mb;
+        rc = get_uint32_option( args, OPT_MATE_CACHE_MEM, 0, &mb, false );
+        if ( rc == 0 )
+            opts->mate_cache_mem = ( size_t )mb * 1024 * 1024;
+    }
+
     if ( rc == 0 )
     {
         uint32_t mode;
@@ -949,6 +984,23 @@ static rc_t gather_int_options( Args * args, samdump_opts * opts )
     if ( rc == 0 )
         rc = get_uint32_option( args, OPT_RNA_SPLICEL, 0, &opts->rna_splice_level, true );
 
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPT_THREADS, 1, &opts->threads, true );
+
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPT_THREAD_WINDOW, 8 * 1024 * 1024, &opts->thread_window, true );
+
+    if ( rc == 0 )
+    {
+        uint32_t mb;
+        rc = get_uint32_option( args, OPT_THREAD_MEM, 256, &mb, true );
+        if ( rc == 0 )
+            opts->thread_mem = ( size_t )mb * 1024 * 1024;
+    }
+
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPT_BAM_THREADS, 1, &opts->bam_threads, true );
+
     return rc;
 }
 
@@ -1129,6 +1181,34 @@ static rc_t gather_string_options( Args * args, samdump_opts * opts )
             opts->rna_splice_log = make_rna_splice_log( opts->rna_splice_log_file, "sam-dump" );
     }
 
+    if ( rc == 0 )
+    {
+        rc = get_str_option( args, OPT_BUILD_PROJ, &s );
+        if ( rc == 0 && s != NULL )
+        {
+            opts->build_projection = string_dup_measure( s, NULL );
+            if ( opts->build_projection == NULL )
+            {
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcMemory, rcExhausted );
+                (void)LOGERR( klogErr, rc, "error storing build-projection-PATH into sam-dump-options" );
+            }
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        rc = get_str_option( args, OPT_PROJECTION, &s );
+        if ( rc == 0 && s != NULL )
+        {
+            opts->projection = string_dup_measure( s, NULL );
+            if ( opts->projection == NULL )
+            {
+                rc = RC( rcExe, rcNoTarg, rcValidating, rcMemory, rcExhausted );
+                (void)LOGERR( klogErr, rc, "error storing projection-PATH into sam-dump-options" );
+            }
+        }
+    }
+
     return rc;
 }
 
@@ -1247,6 +1327,7 @@ void report_options( const samdump_opts * opts )
         case oc_none  : KOutMsg( "output-compression    : none\n" ); break;
         case oc_gzip  : KOutMsg( "output-compression    : gzip\n" ); break;
         case oc_bzip2 : KOutMsg( "output-compression    : bzip2\n" ); break;
+        case oc_bam   : KOutMsg( "output-compression    : bam\n" ); break;
         default       : KOutMsg( "output-compression    : unknown\n" ); break;
     }
 
@@ -1335,14 +1416,22 @@ void report_options( const samdump_opts * opts )
     KOutMsg( "cursor-cache-size     : %u\n",  opts->cursor_cache_size );
 
     KOutMsg( "use mate-cache        : %s\n",  opts->use_mate_cache ? "YES" : "NO" );
+    KOutMsg( "mate-cache-mem        : %lu\n", opts->mate_cache_mem );
     KOutMsg( "force legacy code     : %s\n",  opts->force_legacy ? "YES" : "NO" );
     KOutMsg( "use min-mapq          : %s\n",  opts->use_min_mapq ? "YES" : "NO" );
     KOutMsg( "min-mapq              : %i\n",  opts->min_mapq );
     KOutMsg( "rna-splicing          : %s\n",  opts->rna_splicing ? "YES" : "NO" );
     KOutMsg( "rna-splice-level      : %u\n",  opts->rna_splice_level );
     KOutMsg( "rna-splice-log        : %s\n",  opts->rna_splice_log_file );
+    KOutMsg( "build-projection      : %s\n",  opts->build_projection );
+    KOutMsg( "projection            : %s\n",  opts->projection );
 
     KOutMsg( "multithreading        : %s\n",  opts->no_mt ? "NO" : "YES" );  
+    KOutMsg( "threads               : %u\n",  opts->threads );
+    KOutMsg( "thread-window         : %u\n",  opts->thread_window );
+    KOutMsg( "thread-mem            : %lu\n", opts->thread_mem );
+    KOutMsg( "bam-index             : %s\n",  opts->bam_index ? "YES" : "NO" );
+    KOutMsg( "bam-threads           : %u\n",  opts->bam_threads );
     KOutMsg( "with-MD-flag          : %s\n",  opts->with_md_flag ? "NO" : "YES" );
 	
 #if _DEBUGGING
@@ -1373,6 +1462,10 @@ void release_options( samdump_opts * opts )
         free( (void*)opts->timing_file );
     if( opts->rna_splice_log_file != NULL )
         free( (void*)opts->rna_splice_log_file );
+    if( opts->build_projection != NULL )
+        free( (void*)opts->build_projection );
+    if( opts->projection != NULL )
+        free( (void*)opts->projection );
 
 #if _DEBUGGING
     if ( opts->perf_log != NULL )
@@ -1469,6 +1562,40 @@ rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
 }
 
 
+rc_t format_name( const samdump_opts * opts, char * buffer, size_t buffer_size, size_t * written,
+                  int64_t seq_spot_id, const char * spot_group, uint32_t spot_group_len )
+{
+    rc_t rc;
+
+    if ( opts->print_cg_names )
+    {
+        if ( spot_group != NULL && spot_group_len != 0 )
+            rc = string_printf( buffer, buffer_size, written, "%.*s-1:%lu", spot_group_len, spot_group, seq_spot_id );
+        else
+            rc = string_printf( buffer, buffer_size, written, "%lu", seq_spot_id );
+    }
+    else
+    {
+        if ( opts->qname_prefix != NULL )
+        {
+            if ( opts->print_spot_group_in_name && spot_group != NULL && spot_group_len > 0 )
+                rc = string_printf( buffer, buffer_size, written, "%s.%lu.%.*s",
+                                    opts->qname_prefix, seq_spot_id, spot_group_len, spot_group );
+            else
+                rc = string_printf( buffer, buffer_size, written, "%s.%lu", opts->qname_prefix, seq_spot_id );
+        }
+        else
+        {
+            if ( opts->print_spot_group_in_name && spot_group != NULL && spot_group_len > 0 )
+                rc = string_printf( buffer, buffer_size, written, "%lu.%.*s", seq_spot_id, spot_group_len, spot_group );
+            else
+                rc = string_printf( buffer, buffer_size, written, "%lu", seq_spot_id );
+        }
+    }
+    return rc;
+}
+
+
 rc_t dump_name_legacy( const samdump_opts * opts, const char * name, size_t name_len,
                        const char * spot_group, uint32_t spot_group_len )
 {
@@ -99,6 +99,15 @@ extern "C" {
 #define OPT_NO_MT       "disable-multithreading"
 #define OPT_TIMING      "timing"
 #define OPT_MD_FLAG     "with-md-flag"
+#define OPT_THREADS     "threads"
+#define OPT_THREAD_WINDOW "thread-window"
+#define OPT_THREAD_MEM  "thread-mem"
+#define OPT_BAM         "bam"
+#define OPT_BAM_INDEX   "bam-index"
+#define OPT_BAM_THREADS "bam-threads"
+#define OPT_MATE_CACHE_MEM "mate-cache-mem"
+#define OPT_BUILD_PROJ  "build-projection"
+#define OPT_PROJECTION  "projection"
 
 typedef struct range
 {
@@ -134,7 +143,8 @@ enum output_compression
 {
     oc_none = 0,    /* do not compress output */
     oc_gzip,        /* compress output with gzip */
-    oc_bzip2        /* compress output with bzip2 */
+    oc_bzip2,       /* compress output with bzip2 */
+    oc_bam          /* encode output as BAM ( BGZF-compressed ) */
 };
 
 enum cigar_treatment
@@ -188,6 +198,10 @@ typedef struct samdump_opts
     /* log file for rna-splicing-events */
     const char * rna_splice_log_file;
 
+    /* SAM-projection-cache: build it at this path, or use the one at this path */
+    const char * build_projection;
+    const char * projection;
+
     /* timing-performane-log, created if timing_file given */
     struct perf_log * perf_log;
 
@@ -206,8 +220,23 @@ typedef struct samdump_opts
     /* mate's farther apart than this are not cached */
     uint32_t mape_gap_cache_limit;
 
+    /* how many worker-threads produce aligned reads, 1 = single-threaded */
+    uint32_t threads;
+
+    /* how many bases of a reference a worker-thread processes per job */
+    uint32_t thread_window;
+
+    /* bytes of finished output the worker-threads may keep ahead of the writer */
+    size_t thread_mem;
+
+    /* how many threads compress the BGZF-blocks of the BAM-output */
+    uint32_t bam_threads;
+
     size_t cursor_cache_size;
 
+    /* bytes the same-ref mate-cache may use before it spills to disk, 0 = unlimited */
+    size_t mate_cache_mem;
+
     /* how the sam-headers are treated */
     enum header_mode header_mode;
 
@@ -228,6 +257,9 @@ typedef struct samdump_opts
     bool force_legacy;
     bool force_new;
 
+    /* write a BAI/CSI-index next to the BAM-output-file */
+    bool bam_index;
+
     /* which tables have to be processed/dumped */
     bool dump_primary_alignments;
     bool dump_secondary_alignments;
@@ -296,6 +328,10 @@ bool is_this_alignment_requested( const samdump_opts * opts, const char *refname
 rc_t dump_name( const samdump_opts * opts, int64_t seq_spot_id,
                 const char * spot_group, uint32_t spot_group_len );
 
+/* the same name as dump_name(), into a buffer ( for the BAM-output ) */
+rc_t format_name( const samdump_opts * opts, char * buffer, size_t buffer_size, size_t * written,
+                  int64_t seq_spot_id, const char * spot_group, uint32_t spot_group_len );
+
 rc_t dump_name_legacy( const samdump_opts * opts, const char * name, size_t name_len,
                        const char * spot_group, uint32_t spot_group_len );
 
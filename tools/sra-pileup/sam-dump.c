@@ -75,6 +75,7 @@
 #include <assert.h>
 
 #include "debug.h"
+#include "mate_hash.h"
 
 #if _ARCH_BITS == 64
 #define USE_MATE_CACHE 1
@@ -199,8 +200,8 @@ typedef struct STable_struct
 
 typedef struct SCursCache_struct
 {
-    KVector* cache;
-    KVector* cache_unaligned_mate; /* keeps unaligned-mate for a half-aligned spots */
+    mate_hash cache;                /* packed mate-record, see Cache_Add() */
+    mate_hash cache_unaligned_mate; /* keeps unaligned-mate for a half-aligned spots */
     uint32_t sam_flags;
     INSDC_coord_zero pnext;
     int32_t tlen;
@@ -428,12 +429,8 @@ static rc_t Cache_Init( SCursCache* c )
 {
     if ( c != NULL )
     {
-	rc_t rc;
+        /* the tables allocate their slots on the first insert */
         memset( c, 0, sizeof( *c ) );
-        rc=KVectorMake( &c->cache );
-	if(rc == 0){
-		rc=KVectorMake( &c->cache_unaligned_mate );
-	}
     }
     return 0;
 }
@@ -443,8 +440,8 @@ static void Cache_Close( char const *name, SCursCache* c )
 {
     if ( c != NULL )
     {
-        KVectorRelease( c->cache );
-        KVectorRelease( c->cache_unaligned_mate );
+        release_mate_hash( &c->cache );
+        release_mate_hash( &c->cache_unaligned_mate );
         if ( c->added > 0 )
         {
             SAM_DUMP_DBG( 2, ( "%s cache stats: projected %lu added of those %lu; "
@@ -541,7 +538,7 @@ static rc_t Cache_Add( uint64_t key, SCurs const *curs, SCol const *cols )
             if ( !( ref_proj & 0xFFFFF800 ) )
             {
                 val = ( pos_delta64 << 32 ) | ( ref_proj << 21 ) | ( cols[ alg_SAM_FLAGS ].base.u32[ 0 ] << 10 ) | rid;
-                rc = KVectorSetU64( curs->cache->cache, key, val );
+                rc = mate_hash_put( &curs->cache->cache, key, val, 0 );
             }
         }
     }
@@ -564,14 +561,18 @@ static rc_t Cache_Add( uint64_t key, SCurs const *curs, SCol const *cols )
 
 static rc_t Cache_Get( SCurs const *curs, uint64_t key, uint64_t* val )
 {
-    rc_t rc = KVectorGetU64( curs->cache->cache, key, val );
-    if ( rc == 0 )
+    rc_t rc = 0;
+    if ( !mate_hash_get( &curs->cache->cache, key, val, NULL ) )
+    {
+        rc = RC( rcExe, rcNoTarg, rcSearching, rcItem, rcNotFound );
+    }
+    else
     {
         uint32_t id = ( *val & 0x3FF );
 #if _DEBUGGING
         curs->cache->hit++;
 #endif
-        KVectorUnset( curs->cache->cache, key );
+        mate_hash_remove( &curs->cache->cache, key );
         rc = ReferenceList_Get( gRefList, &curs->cache->ref, id );
         if ( rc != 0 )
         {
@@ -1186,7 +1187,7 @@ static rc_t Cursor_ReadAlign( SCurs const *curs, int64_t row_id, SCol* cols, uin
           rc = Cache_Add( row_id, curs, cols );
         }
 	if(param->unaligned == true && mate_align_id == 0 ){
-	  rc = KVectorSetBool( curs->cache->cache_unaligned_mate, cols[alg_SEQ_SPOT_ID].base.i64[0], true );
+	  rc = mate_hash_put( &curs->cache->cache_unaligned_mate, cols[alg_SEQ_SPOT_ID].base.i64[0], 1, 0 );
         }
     }
     else
@@ -3354,9 +3355,15 @@ static rc_t FlushUnalignedRead_cb (uint64_t key, bool value,void *user_data)
 	}
         return rc;
 }
-static rc_t FlushUnaligned( SAM_dump_ctx_t *const ctx, const SCursCache * cache )
+static rc_t FlushUnaligned( SAM_dump_ctx_t *const ctx, SCursCache * cache )
 {
-    return KVectorVisitBool (cache->cache_unaligned_mate, false, FlushUnalignedRead_cb, ctx );
+    /* visit the spots in ascending order */
+    rc_t rc = 0;
+    uint64_t idx;
+    mate_hash_sort( &cache->cache_unaligned_mate );
+    for ( idx = 0; rc == 0 && idx < cache->cache_unaligned_mate.count; ++idx )
+        rc = FlushUnalignedRead_cb( cache->cache_unaligned_mate.entries[ idx ].key, true, ctx );
+    return rc;
 }
 #endif
 
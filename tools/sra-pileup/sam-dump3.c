@@ -36,8 +36,10 @@
 #include "matecache.h"
 #include "cg_tools.h"
 #include "out_redir.h"
+#include "bam_out.h"
 #include "sam-aligned.h"
 #include "sam-unaligned.h"
+#include "sam-projection.h"
 
 
 char const *sd_unaligned_usage[]      = { "Output unaligned reads along with aligned reads",
@@ -165,6 +167,40 @@ char const *rna_splice_log_usage[]    = { "file, into which rna-splice events ar
 char const *no_mt_usage[]             = { "disable multithreading", NULL };
 
 char const *with_md_flag_usage[]      = { "print MD-flag", NULL };
+
+char const *threads_usage[]           = { "number of threads producing aligned reads (default=1)",
+                                           "references are split into windows, output is in reference order",
+                                       NULL };
+
+char const *thread_window_usage[]     = { "bases of a reference per job of a thread (default=8388608)",
+                                       NULL };
+
+char const *thread_mem_usage[]        = { "memory in MB for output the threads produce ahead of",
+                                           "the output in reference order (default=256)",
+                                       NULL };
+
+char const *bam_usage[]               = { "produce BAM instead of SAM",
+                                       NULL };
+
+char const *bam_index_usage[]         = { "write a BAI ( or CSI ) index next to the BAM-output-file",
+                                           "needs --output-file and output sorted by coordinate",
+                                       NULL };
+
+char const *bam_threads_usage[]       = { "number of threads compressing the BAM-output (default=1)",
+                                       NULL };
+
+char const *mate_cache_mem_usage[]    = { "memory for the mate-cache in MB, mates farther away are",
+                                           "spilled to a temp. file in $TMPDIR (default=0, unlimited)",
+                                       NULL };
+
+char const *build_projection_usage[]  = { "compute CIGAR/READ/QUALITY/NM/MD of all alignments once and",
+                                           "store them in a projection-database at this path, nothing is dumped",
+                                           "( the input needs the md5-checksums of its columns )",
+                                       NULL };
+
+char const *projection_usage[]        = { "use a projection-database built with --build-projection",
+                                           "and the same cigar/md-options instead of computing these values",
+                                       NULL };
                                       
 OptDef SamDumpArgs[] =
 {
@@ -209,6 +245,15 @@ OptDef SamDumpArgs[] =
     { OPT_RNA_SPLICE_LOG,  NULL, NULL, rna_splice_log_usage, 0, true,  false },  /* filename to log rna-splice events into */
     { OPT_NO_MT,        NULL, NULL, no_mt_usage,              0, false, false },   /* force new code-path */    
     { OPT_MD_FLAG,		NULL, NULL, with_md_flag_usage,       0, false, false },    /* print the MD-flag */	
+    { OPT_THREADS,      NULL, NULL, threads_usage,           0, true,  false },  /* number of worker-threads */
+    { OPT_THREAD_WINDOW, NULL, NULL, thread_window_usage,    0, true,  false },  /* bases per job of a worker-thread */
+    { OPT_THREAD_MEM,   NULL, NULL, thread_mem_usage,        0, true,  false },  /* memory for output ahead of the writer */
+    { OPT_BAM,          NULL, NULL, bam_usage,               0, false, false },  /* produce BAM */
+    { OPT_BAM_INDEX,    NULL, NULL, bam_index_usage,         0, false, false },  /* write BAI/CSI-index for BAM */
+    { OPT_BAM_THREADS,  NULL, NULL, bam_threads_usage,       0, true,  false },  /* threads compressing the BAM-output */
+    { OPT_MATE_CACHE_MEM, NULL, NULL, mate_cache_mem_usage,  0, true,  false },  /* memory-limit for the mate-cache */
+    { OPT_BUILD_PROJ,   NULL, NULL, build_projection_usage,  0, true,  false },  /* build a SAM-projection-cache */
+    { OPT_PROJECTION,   NULL, NULL, projection_usage,        0, true,  false },  /* use a SAM-projection-cache */
     { OPT_DUMP_MODE,    NULL, NULL, NULL,                    0, true,  false },  /* how to produce aligned reads if no regions given */
     { OPT_CIGAR_TEST,   NULL, NULL, NULL,                    0, true,  false },  /* test cg-treatment of cigar string */
     { OPT_LEGACY,       NULL, NULL, NULL,                    0, false, false },  /* force legacy code-path */
@@ -259,6 +304,15 @@ char const *sd_usage_params[] =
     NULL,                       /* file to log rna-splice-events into */
     NULL,                       /* no-mt */
     NULL,                       /* with-md-flag */	
+    "count",                    /* threads */
+    "bases",                    /* thread-window */
+    "MB",                       /* thread-mem */
+    NULL,                       /* bam */
+    NULL,                       /* bam-index */
+    "count",                    /* bam-threads */
+    "MB",                       /* mate-cache-mem */
+    "path",                     /* build-projection */
+    "path",                     /* projection */
     NULL,                       /* dump_mode */
     NULL,                       /* cigar test */
     NULL,                       /* force legacy code path */
@@ -336,6 +390,30 @@ static uint32_t tabsel_2_ReferenceList_Options( const samdump_opts * opts )
 }
 
 
+/* a projection is made for exactly one database, it is attached to that one */
+static const struct sam_proj * attach_projection( const samdump_opts * const opts,
+                                                  const VDBManager * mgr,
+                                                  input_files * ifs )
+{
+    const struct sam_proj * proj = NULL;
+    if ( opts->projection != NULL )
+    {
+        if ( ifs->database_count != 1 )
+            (void)LOGMSG( klogWarn, "--projection needs exactly one input-database, not used" );
+        else if ( opts->rna_splicing )
+            (void)LOGMSG( klogWarn, "--projection cannot be used together with --rna-splicing, not used" );
+        else
+        {
+            input_database * idb = VectorGet( &ifs->dbs, 0 );
+            if ( idb != NULL &&
+                 open_sam_proj( &proj, mgr, opts->projection, idb->db, idb->path, opts ) == 0 ) /* sam-projection.c */
+                idb->proj = proj;
+        }
+    }
+    return proj;
+}
+
+
 static rc_t print_samdump( const samdump_opts * const opts )
 {
     KDirectory *dir;
@@ -379,12 +457,19 @@ static rc_t print_samdump( const samdump_opts * const opts )
                         rc = RC( rcExe, rcFile, rcReading, rcItem, rcNotFound );
                         (void)LOGERR( klogErr, rc, "input object(s) not found" );
                     }
+                    else if ( opts->build_projection != NULL )
+                    {
+                        /* ------------------------------------------------------ */
+                        rc = build_sam_projection( opts, ifs, dir ); /* sam-aligned.c */
+                        /* ------------------------------------------------------ */
+                    }
                     else
                     {
                         matecache * mc = NULL;
+                        const struct sam_proj * proj = attach_projection( opts, mgr, ifs );
 
                         if ( opts->use_mate_cache )
-                            rc = make_matecache( &mc, ifs->database_count );
+                            rc = make_matecache( &mc, ifs->database_count, opts->mate_cache_mem );
 
                         if ( rc == 0 )
                         {
@@ -422,6 +507,7 @@ static rc_t print_samdump( const samdump_opts * const opts )
                                 release_matecache( mc ); /* matecache.c */
                             }
                         }
+                        release_sam_proj( proj ); /* sam-projection.c */
                     }
                     release_input_files( ifs ); /* inputfiles.c */
                 }
@@ -472,6 +558,7 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
         case oc_none  : mode = orm_uncompressed; break;
         case oc_gzip  : mode = orm_gzip; break;
         case oc_bzip2 : mode = orm_bzip2; break;
+        case oc_bam   : mode = orm_uncompressed; break;
     }
 
     rc = init_out_redir( &redir, mode, opts->outputfile, opts->output_buffer_size ); /* from out_redir.c */
@@ -493,6 +580,28 @@ static rc_t samdump_main( Args * args, const samdump_opts * const opts )
                 (void)LOGERR( klogErr, rc, "no inputfiles given at commandline" );
                 Usage( args );
             }
+            else if ( opts->output_compression == oc_bam )
+            {
+                bam_redir bredir; /* from bam_out.h */
+                const char * bam_filename = NULL;
+
+                if ( opts->bam_index )
+                {
+                    if ( opts->outputfile != NULL )
+                        bam_filename = opts->outputfile;
+                    else
+                        (void)LOGMSG( klogWarn, "--bam-index needs --output-file, no index written" );
+                }
+
+                rc = init_bam_redir( &bredir, opts->bam_threads, bam_filename ); /* from bam_out.c */
+                if ( rc == 0 )
+                {
+                    rc = print_samdump( opts );
+                    if ( rc == 0 )
+                        rc = finish_bam_redir( &bredir ); /* from bam_out.c */
+                    release_bam_redir( &bredir ); /* from bam_out.c */
+                }
+            }
             else
             {
             /* ------------------------------------------------------ */
@@ -0,0 +1,882 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "sam-projection.h"
+#include "read_fkt.h"
+
+#include <klib/text.h>
+#include <klib/printf.h>
+#include <klib/namelist.h>
+#include <kfs/file.h>
+#include <kfs/md5.h>
+#include <kdb/database.h>
+#include <kdb/meta.h>
+#include <vdb/schema.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SAM_PROJ_VERSION 2
+#define SAM_PROJ_DB_TYPE "NCBI:align:db:sam_projection"
+
+static const char sam_proj_schema_text[] =
+"version 1;"
+"include 'vdb/vdb.vschema';"
+
+"table NCBI:align:tbl:sam_projection #1 {"
+"    extern column ascii CIGAR = .CIGAR;"
+"    physical column < ascii > zip_encoding .CIGAR = CIGAR;"
+
+"    extern column ascii READ = .READ;"
+"    physical column < ascii > zip_encoding .READ = READ;"
+
+"    extern column ascii QUALITY = .QUALITY;"
+"    physical column < ascii > zip_encoding .QUALITY = QUALITY;"
+
+"    extern column ascii TAGS = .TAGS;"
+"    physical column < ascii > zip_encoding .TAGS = TAGS;"
+
+"    extern column ascii MD = .MD;"
+"    physical column < ascii > zip_encoding .MD = MD;"
+
+"    extern column U32 NM = .NM;"
+"    physical column < U32 > izip_encoding .NM = NM;"
+
+"    extern column U32 SAM_FLAGS = .SAM_FLAGS;"
+"    physical column < U32 > izip_encoding .SAM_FLAGS = SAM_FLAGS;"
+"};"
+
+"database NCBI:align:db:sam_projection #1 {"
+"    table NCBI:align:tbl:sam_projection #1 PRIMARY_ALIGNMENT;"
+"    table NCBI:align:tbl:sam_projection #1 SECONDARY_ALIGNMENT;"
+"};";
+
+
+/* the options a projection depends on, stored in the db-metadata */
+typedef struct sam_proj_fingerprint
+{
+    uint32_t version;
+    uint32_t cigar_treatment;
+    uint8_t long_cigar;
+    uint8_t equal_sign;
+    uint8_t md;
+} sam_proj_fingerprint;
+
+
+static void make_fingerprint( sam_proj_fingerprint * fp, const samdump_opts * opts )
+{
+    fp->version = SAM_PROJ_VERSION;
+    fp->cigar_treatment = ( uint32_t )opts->cigar_treatment;
+    fp->long_cigar = opts->use_long_cigar ? 1 : 0;
+    fp->equal_sign = opts->print_matches_as_equal_sign ? 1 : 0;
+    fp->md = opts->with_md_flag ? 1 : 0;
+}
+
+
+static rc_t write_meta_u32( KMDataNode * root, const char * name, uint32_t value )
+{
+    KMDataNode * node;
+    rc_t rc = KMDataNodeOpenNodeUpdate( root, &node, "%s", name );
+    if ( rc == 0 )
+    {
+        rc = KMDataNodeWriteB32( node, &value );
+        KMDataNodeRelease( node );
+    }
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot write projection-metadata '$(n)'", "n=%s", name ) );
+    return rc;
+}
+
+
+static rc_t write_meta_str( KMDataNode * root, const char * name, const char * value )
+{
+    KMDataNode * node;
+    rc_t rc = KMDataNodeOpenNodeUpdate( root, &node, "%s", name );
+    if ( rc == 0 )
+    {
+        rc = KMDataNodeWrite( node, value, string_size( value ) );
+        KMDataNodeRelease( node );
+    }
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot write projection-metadata '$(n)'", "n=%s", name ) );
+    return rc;
+}
+
+
+static rc_t read_meta_u32( const KMDataNode * root, const char * name, uint32_t * value )
+{
+    const KMDataNode * node;
+    rc_t rc = KMDataNodeOpenNodeRead( root, &node, "%s", name );
+    if ( rc == 0 )
+    {
+        rc = KMDataNodeReadB32( node, value );
+        KMDataNodeRelease( node );
+    }
+    return rc;
+}
+
+
+static rc_t read_meta_str( const KMDataNode * root, const char * name, char * value, size_t value_size )
+{
+    const KMDataNode * node;
+    rc_t rc = KMDataNodeOpenNodeRead( root, &node, "%s", name );
+    if ( rc == 0 )
+    {
+        size_t num_read, remaining;
+        rc = KMDataNodeRead( node, 0, value, value_size - 1, &num_read, &remaining );
+        if ( rc == 0 && remaining != 0 )
+            rc = RC( rcApp, rcMetadata, rcReading, rcBuffer, rcInsufficient );
+        if ( rc == 0 )
+            value[ num_read ] = 0;
+        KMDataNodeRelease( node );
+    }
+    return rc;
+}
+
+
+/* a local input is identified by its absolute path, an accession as it is given */
+rc_t sam_proj_source_id( const KDirectory * dir, const char * src_path, char * id, size_t id_size )
+{
+    rc_t rc;
+    if ( KDirectoryPathType( dir, "%s", src_path ) != kptNotFound )
+        rc = KDirectoryResolvePath( dir, true, id, id_size, "%s", src_path );
+    else
+        rc = string_printf( id, id_size, NULL, "%s", src_path );
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot resolve input '$(p)'", "p=%s", src_path ) );
+    return rc;
+}
+
+
+static int CC cmp_names( const void * a, const void * b )
+{
+    return strcmp( *( const char * const * )a, *( const char * const * )b );
+}
+
+
+static rc_t stamp_file( const KDirectory * dir, const char * path, MD5State * md5 )
+{
+    const KFile * f;
+    rc_t rc = KDirectoryOpenFileRead( dir, &f, "%s", path );
+    if ( rc == 0 )
+    {
+        char buffer[ 4096 ];
+        uint64_t pos = 0;
+        size_t num_read = 1;
+        /* the path too: the same checksum in another column is another content */
+        MD5StateAppend( md5, path, string_size( path ) + 1 );
+        while ( rc == 0 && num_read > 0 )
+        {
+            rc = KFileReadAll( f, pos, buffer, sizeof buffer, &num_read );
+            if ( rc == 0 )
+            {
+                MD5StateAppend( md5, buffer, num_read );
+                pos += num_read;
+            }
+        }
+        KFileRelease( f );
+    }
+    return rc;
+}
+
+
+/* walks the directory in sorted order, every file named md5 goes into the stamp */
+static rc_t stamp_dir( const KDirectory * dir, const char * path, MD5State * md5, uint32_t * files )
+{
+    KNamelist * list;
+    rc_t rc = KDirectoryList( dir, &list, NULL, NULL, "%s", path );
+    if ( rc == 0 )
+    {
+        uint32_t count;
+        rc = KNamelistCount( list, &count );
+        if ( rc == 0 && count > 0 )
+        {
+            const char ** names = calloc( count, sizeof * names );
+            if ( names == NULL )
+                rc = RC( rcApp, rcDirectory, rcVisiting, rcMemory, rcExhausted );
+            else
+            {
+                uint32_t i;
+                for ( i = 0; rc == 0 && i < count; ++i )
+                    rc = KNamelistGet( list, i, &names[ i ] );
+                if ( rc == 0 )
+                    qsort( names, count, sizeof * names, cmp_names );
+                for ( i = 0; rc == 0 && i < count; ++i )
+                {
+                    char sub[ 4096 ];
+                    rc = string_printf( sub, sizeof sub, NULL, "%s/%s", path, names[ i ] );
+                    if ( rc == 0 )
+                    {
+                        /* aliases are not followed into directories */
+                        uint32_t type = KDirectoryPathType( dir, "%s", sub );
+                        if ( type == kptDir )
+                            rc = stamp_dir( dir, sub, md5, files );
+                        else if ( ( type & ~kptAlias ) == kptFile && strcmp( names[ i ], "md5" ) == 0 )
+                        {
+                            rc = stamp_file( dir, sub, md5 );
+                            ( *files )++;
+                        }
+                    }
+                }
+                free( names );
+            }
+        }
+        KNamelistRelease( list );
+    }
+    return rc;
+}
+
+
+rc_t sam_proj_source_stamp( const KDirectory * db_dir, char * stamp, size_t stamp_size )
+{
+    MD5State md5;
+    uint32_t files = 0;
+    rc_t rc;
+
+    MD5StateInit( &md5 );
+    rc = stamp_dir( db_dir, ".", &md5, &files );
+    if ( rc == 0 && files == 0 )
+        rc = RC( rcApp, rcDatabase, rcValidating, rcChecksum, rcNotFound );
+    if ( rc == 0 && stamp_size < 2 * 16 + 1 )
+        rc = RC( rcApp, rcDatabase, rcValidating, rcBuffer, rcInsufficient );
+    if ( rc == 0 )
+    {
+        static const char hex[] = "0123456789abcdef";
+        uint8_t digest[ 16 ];
+        uint32_t i;
+        MD5StateFinish( &md5, digest );
+        for ( i = 0; i < 16; ++i )
+        {
+            stamp[ 2 * i ] = hex[ digest[ i ] >> 4 ];
+            stamp[ 2 * i + 1 ] = hex[ digest[ i ] & 0x0F ];
+        }
+        stamp[ 2 * 16 ] = 0;
+    }
+    return rc;
+}
+
+
+static rc_t source_stamp( const VDatabase * src, char * stamp, size_t stamp_size )
+{
+    const KDatabase * kdb;
+    rc_t rc = VDatabaseOpenKDatabaseRead( src, &kdb );
+    if ( rc == 0 )
+    {
+        const KDirectory * db_dir;
+        rc = KDatabaseOpenDirectoryRead( kdb, &db_dir );
+        if ( rc == 0 )
+        {
+            rc = sam_proj_source_stamp( db_dir, stamp, stamp_size );
+            KDirectoryRelease( db_dir );
+        }
+        KDatabaseRelease( kdb );
+    }
+    return rc;
+}
+
+
+static bool no_stamp( rc_t rc )
+{
+    return ( GetRCObject( rc ) == rcChecksum && GetRCState( rc ) == rcNotFound );
+}
+
+
+/* ---------------------------------------------------------------------------------- */
+
+typedef struct sam_proj_writer
+{
+    VDBManager * mgr;
+    VSchema * schema;
+    VDatabase * db;
+    VTable * tbl;
+    VCursor * cursor;
+    sam_proj_cursor idx;    /* only the column-idx are used */
+} sam_proj_writer;
+
+
+void release_sam_proj_writer( sam_proj_writer * self )
+{
+    if ( self != NULL )
+    {
+        sam_proj_writer_close_table( self );
+        if ( self->db != NULL )
+            VDatabaseRelease( self->db );
+        if ( self->schema != NULL )
+            VSchemaRelease( self->schema );
+        if ( self->mgr != NULL )
+            VDBManagerRelease( self->mgr );
+        free( self );
+    }
+}
+
+
+static rc_t write_fingerprint( VDatabase * db, const samdump_opts * opts,
+                               const char * src_id, const char * src_stamp )
+{
+    KMetadata * meta;
+    rc_t rc = VDatabaseOpenMetadataUpdate( db, &meta );
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot open projection-metadata" );
+    else
+    {
+        KMDataNode * root;
+        rc = KMetadataOpenNodeUpdate( meta, &root, "SAM_PROJECTION" );
+        if ( rc != 0 )
+            (void)LOGERR( klogErr, rc, "cannot open projection-metadata-root" );
+        else
+        {
+            sam_proj_fingerprint fp;
+            make_fingerprint( &fp, opts );
+            rc = write_meta_u32( root, "version", fp.version );
+            if ( rc == 0 )
+                rc = write_meta_u32( root, "cigar-treatment", fp.cigar_treatment );
+            if ( rc == 0 )
+                rc = write_meta_u32( root, "long-cigar", fp.long_cigar );
+            if ( rc == 0 )
+                rc = write_meta_u32( root, "equal-sign", fp.equal_sign );
+            if ( rc == 0 )
+                rc = write_meta_u32( root, "md", fp.md );
+            if ( rc == 0 )
+                rc = write_meta_str( root, "source", src_id );
+            if ( rc == 0 )
+                rc = write_meta_str( root, "source-stamp", src_stamp );
+            KMDataNodeRelease( root );
+        }
+        KMetadataRelease( meta );
+    }
+    return rc;
+}
+
+
+rc_t make_sam_proj_writer( sam_proj_writer ** self, KDirectory * dir,
+                           const char * path, const samdump_opts * opts,
+                           const VDatabase * src, const char * src_path )
+{
+    char src_id[ 4096 ];
+    char src_stamp[ 64 ];
+    sam_proj_writer * w = NULL;
+    rc_t rc = sam_proj_source_id( dir, src_path, src_id, sizeof src_id );
+    *self = NULL;
+    if ( rc == 0 )
+    {
+        /* a projection that could never be matched to its source is not built */
+        rc = source_stamp( src, src_stamp, sizeof src_stamp );
+        if ( no_stamp( rc ) )
+            (void)PLOGERR( klogErr, ( klogErr, rc,
+                "input '$(p)' has no column-checksums to identify it, cannot build a projection", "p=%s", src_path ) );
+        else if ( rc != 0 )
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot compute the content-stamp of input '$(p)'", "p=%s", src_path ) );
+    }
+    if ( rc == 0 )
+    {
+        w = calloc( 1, sizeof * w );
+        if ( w == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            (void)LOGERR( klogErr, rc, "cannot create projection-writer" );
+        }
+    }
+    if ( w != NULL )
+    {
+        rc = VDBManagerMakeUpdate( &w->mgr, dir );
+        if ( rc != 0 )
+            (void)LOGERR( klogErr, rc, "cannot create vdb-update-manager" );
+        else
+        {
+            rc = VDBManagerMakeSchema( w->mgr, &w->schema );
+            if ( rc != 0 )
+                (void)LOGERR( klogErr, rc, "VDBManagerMakeSchema() failed" );
+            else
+            {
+                rc = VSchemaParseText( w->schema, "sam_projection_schema",
+                                       sam_proj_schema_text, string_size( sam_proj_schema_text ) );
+                if ( rc != 0 )
+                    (void)LOGERR( klogErr, rc, "VSchemaParseText() failed for projection-schema" );
+            }
+        }
+
+        if ( rc == 0 )
+        {
+            rc = VDBManagerCreateDB( w->mgr, &w->db, w->schema, SAM_PROJ_DB_TYPE,
+                                     kcmInit | kcmParents | kcmMD5, "%s", path );
+            if ( rc != 0 )
+                (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create projection '$(p)'", "p=%s", path ) );
+            else
+                rc = write_fingerprint( w->db, opts, src_id, src_stamp );
+        }
+
+        if ( rc == 0 )
+            *self = w;
+        else
+            release_sam_proj_writer( w );
+    }
+    return rc;
+}
+
+
+static rc_t add_write_column( VCursor * cursor, const char * name, uint32_t * idx )
+{
+    rc_t rc = VCursorAddColumn( cursor, idx, "%s", name );
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot add projection-column '$(c)'", "c=%s", name ) );
+    return rc;
+}
+
+
+static rc_t write_row_count( VTable * tbl, uint64_t row_count )
+{
+    KMetadata * meta;
+    rc_t rc = VTableOpenMetadataUpdate( tbl, &meta );
+    if ( rc == 0 )
+    {
+        KMDataNode * node;
+        rc = KMetadataOpenNodeUpdate( meta, &node, "SAM_PROJECTION/source-rows" );
+        if ( rc == 0 )
+        {
+            rc = KMDataNodeWriteB64( node, &row_count );
+            KMDataNodeRelease( node );
+        }
+        KMetadataRelease( meta );
+    }
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot write projection-row-count" );
+    return rc;
+}
+
+
+rc_t sam_proj_writer_open_table( sam_proj_writer * self, const char * table_name,
+                                 int64_t first_row, uint64_t row_count )
+{
+    rc_t rc = VDatabaseCreateTable( self->db, &self->tbl, table_name, kcmInit | kcmMD5, "%s", table_name );
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create projection-table '$(t)'", "t=%s", table_name ) );
+    else
+    {
+        rc = write_row_count( self->tbl, row_count );
+        if ( rc == 0 )
+        {
+            rc = VTableCreateCursorWrite( self->tbl, &self->cursor, kcmInsert );
+            if ( rc != 0 )
+                (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create cursor on projection-table '$(t)'", "t=%s", table_name ) );
+        }
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "CIGAR", &self->idx.cigar_idx );
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "READ", &self->idx.read_idx );
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "QUALITY", &self->idx.quality_idx );
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "TAGS", &self->idx.tags_idx );
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "MD", &self->idx.md_idx );
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "NM", &self->idx.nm_idx );
+        if ( rc == 0 )
+            rc = add_write_column( self->cursor, "SAM_FLAGS", &self->idx.sam_flags_idx );
+        if ( rc == 0 )
+        {
+            rc = VCursorOpen( self->cursor );
+            if ( rc != 0 )
+                (void)LOGERR( klogErr, rc, "cannot open cursor on projection-table" );
+            else if ( first_row != 1 )
+            {
+                /* the row-id's have to match the source-table */
+                rc = VCursorSetRowId( self->cursor, first_row );
+                if ( rc != 0 )
+                    (void)LOGERR( klogErr, rc, "cannot set first row-id of projection-table" );
+            }
+        }
+    }
+    return rc;
+}
+
+
+static rc_t write_ascii( VCursor * cursor, uint32_t idx, const char * s, uint32_t len )
+{
+    return VCursorWrite( cursor, idx, 8, s, 0, len );
+}
+
+
+rc_t sam_proj_writer_write( sam_proj_writer * self, const sam_proj_row * row )
+{
+    rc_t rc = VCursorOpenRow( self->cursor );
+    if ( rc == 0 )
+    {
+        rc = write_ascii( self->cursor, self->idx.cigar_idx, row->cigar, row->cigar_len );
+        if ( rc == 0 )
+            rc = write_ascii( self->cursor, self->idx.read_idx, row->read, row->read_len );
+        if ( rc == 0 )
+            rc = write_ascii( self->cursor, self->idx.quality_idx, row->quality, row->quality_len );
+        if ( rc == 0 )
+            rc = write_ascii( self->cursor, self->idx.tags_idx, row->tags, row->tags_len );
+        if ( rc == 0 )
+            rc = write_ascii( self->cursor, self->idx.md_idx, row->md, row->md_len );
+        if ( rc == 0 )
+            rc = VCursorWrite( self->cursor, self->idx.nm_idx, 32, &row->nm, 0, 1 );
+        if ( rc == 0 )
+            rc = VCursorWrite( self->cursor, self->idx.sam_flags_idx, 32, &row->sam_flags, 0, 1 );
+        if ( rc == 0 )
+            rc = VCursorCommitRow( self->cursor );
+        VCursorCloseRow( self->cursor );
+    }
+    if ( rc != 0 )
+        (void)LOGERR( klogErr, rc, "cannot write row into projection" );
+    return rc;
+}
+
+
+rc_t sam_proj_writer_close_table( sam_proj_writer * self )
+{
+    rc_t rc = 0;
+    if ( self->cursor != NULL )
+    {
+        rc = VCursorCommit( self->cursor );
+        if ( rc != 0 )
+            (void)LOGERR( klogErr, rc, "cannot commit projection-table" );
+        VCursorRelease( self->cursor );
+        self->cursor = NULL;
+    }
+    if ( self->tbl != NULL )
+    {
+        VTableRelease( self->tbl );
+        self->tbl = NULL;
+    }
+    return rc;
+}
+
+
+/* ---------------------------------------------------------------------------------- */
+
+typedef struct sam_proj
+{
+    const VDatabase * db;
+    bool prim_ok;
+    bool sec_ok;
+} sam_proj;
+
+
+static bool fingerprint_matches( const VDatabase * db, const samdump_opts * opts, const char * path )
+{
+    bool res = false;
+    const KMetadata * meta;
+    rc_t rc = VDatabaseOpenMetadataRead( db, &meta );
+    if ( rc == 0 )
+    {
+        const KMDataNode * root;
+        rc = KMetadataOpenNodeRead( meta, &root, "SAM_PROJECTION" );
+        if ( rc == 0 )
+        {
+            sam_proj_fingerprint want;
+            uint32_t version = 0, cigar_treatment = 0, long_cigar = 0, equal_sign = 0, md = 0;
+            rc = read_meta_u32( root, "version", &version );
+            if ( rc == 0 )
+                rc = read_meta_u32( root, "cigar-treatment", &cigar_treatment );
+            if ( rc == 0 )
+                rc = read_meta_u32( root, "long-cigar", &long_cigar );
+            if ( rc == 0 )
+                rc = read_meta_u32( root, "equal-sign", &equal_sign );
+            if ( rc == 0 )
+                rc = read_meta_u32( root, "md", &md );
+            if ( rc == 0 )
+            {
+                make_fingerprint( &want, opts );
+                res = ( version == want.version &&
+                        cigar_treatment == want.cigar_treatment &&
+                        long_cigar == want.long_cigar &&
+                        equal_sign == want.equal_sign &&
+                        md == want.md );
+                if ( !res )
+                    (void)PLOGMSG( klogWarn, ( klogWarn,
+                        "projection '$(p)' was built with different options, not used", "p=%s", path ) );
+            }
+            KMDataNodeRelease( root );
+        }
+        KMetadataRelease( meta );
+    }
+    if ( rc != 0 )
+        (void)PLOGERR( klogWarn, ( klogWarn, rc, "'$(p)' is not a sam-projection, not used", "p=%s", path ) );
+    return res;
+}
+
+
+/* the projection has to be built from the same source: same input, same content */
+static bool source_matches( const VDatabase * db, const VDatabase * src,
+                            const char * src_path, const char * path )
+{
+    bool res = false;
+    char src_id[ 4096 ];
+    char src_stamp[ 64 ];
+    KDirectory * dir;
+    rc_t rc = KDirectoryNativeDir( &dir );
+    if ( rc == 0 )
+    {
+        rc = sam_proj_source_id( dir, src_path, src_id, sizeof src_id );
+        KDirectoryRelease( dir );
+    }
+    if ( rc == 0 )
+    {
+        rc = source_stamp( src, src_stamp, sizeof src_stamp );
+        if ( no_stamp( rc ) )
+            (void)PLOGERR( klogWarn, ( klogWarn, rc,
+                "input '$(s)' has no column-checksums to identify it, projection '$(p)' not used",
+                "s=%s,p=%s", src_path, path ) );
+        else if ( rc != 0 )
+            (void)PLOGERR( klogWarn, ( klogWarn, rc,
+                "cannot compute the content-stamp of input '$(s)', projection '$(p)' not used",
+                "s=%s,p=%s", src_path, path ) );
+    }
+    if ( rc == 0 )
+    {
+        const KMetadata * meta;
+        rc = VDatabaseOpenMetadataRead( db, &meta );
+        if ( rc == 0 )
+        {
+            const KMDataNode * root;
+            rc = KMetadataOpenNodeRead( meta, &root, "SAM_PROJECTION" );
+            if ( rc == 0 )
+            {
+                char id[ 4096 ];
+                char stamp[ 64 ];
+                rc = read_meta_str( root, "source", id, sizeof id );
+                if ( rc == 0 )
+                    rc = read_meta_str( root, "source-stamp", stamp, sizeof stamp );
+                if ( rc == 0 )
+                {
+                    res = ( strcmp( id, src_id ) == 0 && stamp[ 0 ] != 0 && strcmp( stamp, src_stamp ) == 0 );
+                    if ( !res )
+                        (void)PLOGMSG( klogWarn, ( klogWarn,
+                            "projection '$(p)' was built from '$(s)', not from this input, not used",
+                            "p=%s,s=%s", path, id ) );
+                }
+                KMDataNodeRelease( root );
+            }
+            KMetadataRelease( meta );
+        }
+        if ( rc != 0 )
+            (void)PLOGERR( klogWarn, ( klogWarn, rc, "projection '$(p)' does not identify its source, not used", "p=%s", path ) );
+    }
+    return res;
+}
+
+
+static uint64_t proj_row_count( const VTable * tbl )
+{
+    uint64_t res = 0;
+    const KMetadata * meta;
+    if ( VTableOpenMetadataRead( tbl, &meta ) == 0 )
+    {
+        const KMDataNode * node;
+        if ( KMetadataOpenNodeRead( meta, &node, "SAM_PROJECTION/source-rows" ) == 0 )
+        {
+            if ( KMDataNodeReadB64( node, &res ) != 0 )
+                res = 0;
+            KMDataNodeRelease( node );
+        }
+        KMetadataRelease( meta );
+    }
+    return res;
+}
+
+
+static uint64_t src_row_count( const VTable * tbl )
+{
+    uint64_t res = 0;
+    const VCursor * cursor;
+    if ( VTableCreateCursorRead( tbl, &cursor ) == 0 )
+    {
+        uint32_t idx;
+        if ( VCursorAddColumn( cursor, &idx, "SAM_FLAGS" ) == 0 &&
+             VCursorOpen( cursor ) == 0 )
+        {
+            int64_t first;
+            if ( VCursorIdRange( cursor, idx, &first, &res ) != 0 )
+                res = 0;
+        }
+        VCursorRelease( cursor );
+    }
+    return res;
+}
+
+
+/* the table is usable if it exists in both databases with the same number of rows */
+static bool table_matches( const VDatabase * proj, const VDatabase * src, const char * table_name )
+{
+    bool res = false;
+    const VTable * p_tbl;
+    if ( VDatabaseOpenTableRead( proj, &p_tbl, "%s", table_name ) == 0 )
+    {
+        const VTable * s_tbl;
+        if ( VDatabaseOpenTableRead( src, &s_tbl, "%s", table_name ) == 0 )
+        {
+            uint64_t count = proj_row_count( p_tbl );
+            res = ( count > 0 && count == src_row_count( s_tbl ) );
+            if ( !res )
+                (void)PLOGMSG( klogWarn, ( klogWarn,
+                    "projection-table '$(t)' does not match the input, not used", "t=%s", table_name ) );
+            VTableRelease( s_tbl );
+        }
+        VTableRelease( p_tbl );
+    }
+    return res;
+}
+
+
+rc_t open_sam_proj( const sam_proj ** self, const VDBManager * mgr,
+                    const char * path, const VDatabase * src, const char * src_path,
+                    const samdump_opts * opts )
+{
+    const VDatabase * db;
+    rc_t rc = VDBManagerOpenDBRead( mgr, &db, NULL, "%s", path );
+    *self = NULL;
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot open projection '$(p)'", "p=%s", path ) );
+    else if ( !fingerprint_matches( db, opts, path ) ||
+              !source_matches( db, src, src_path, path ) )
+        VDatabaseRelease( db );
+    else
+    {
+        sam_proj * p = calloc( 1, sizeof * p );
+        if ( p == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            (void)LOGERR( klogErr, rc, "cannot create projection" );
+            VDatabaseRelease( db );
+        }
+        else
+        {
+            p->db = db;
+            p->prim_ok = table_matches( db, src, "PRIMARY_ALIGNMENT" );
+            p->sec_ok = table_matches( db, src, "SECONDARY_ALIGNMENT" );
+            *self = p;
+        }
+    }
+    return rc;
+}
+
+
+void release_sam_proj( const sam_proj * self )
+{
+    if ( self != NULL )
+    {
+        VDatabaseRelease( self->db );
+        free( ( void * )self );
+    }
+}
+
+
+rc_t sam_proj_open_cursor( const sam_proj * self, sam_proj_cursor * cur,
+                           const char * table_name, size_t cursor_cache_size )
+{
+    rc_t rc = 0;
+    const VTable * tbl;
+    bool usable = false;
+
+    memset( cur, 0, sizeof * cur );
+    if ( self != NULL )
+    {
+        if ( strcmp( table_name, "PRIMARY_ALIGNMENT" ) == 0 )
+            usable = self->prim_ok;
+        else if ( strcmp( table_name, "SECONDARY_ALIGNMENT" ) == 0 )
+            usable = self->sec_ok;
+    }
+    if ( !usable )
+        return 0; /* the values are computed as usual */
+
+    rc = VDatabaseOpenTableRead( self->db, &tbl, "%s", table_name );
+    if ( rc != 0 )
+        (void)PLOGERR( klogErr, ( klogErr, rc, "cannot open projection-table '$(t)'", "t=%s", table_name ) );
+    else
+    {
+        const VCursor * cursor;
+        if ( cursor_cache_size == 0 )
+            rc = VTableCreateCursorRead( tbl, &cursor );
+        else
+            rc = VTableCreateCachedCursorRead( tbl, &cursor, cursor_cache_size );
+        if ( rc != 0 )
+            (void)PLOGERR( klogErr, ( klogErr, rc, "cannot create cursor on projection-table '$(t)'", "t=%s", table_name ) );
+        else
+        {
+            rc = add_column( cursor, "CIGAR", &cur->cigar_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( cursor, "READ", &cur->read_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( cursor, "QUALITY", &cur->quality_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( cursor, "TAGS", &cur->tags_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( cursor, "MD", &cur->md_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( cursor, "NM", &cur->nm_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+                rc = add_column( cursor, "SAM_FLAGS", &cur->sam_flags_idx ); /* read_fkt.c */
+            if ( rc == 0 )
+            {
+                rc = VCursorOpen( cursor );
+                if ( rc != 0 )
+                    (void)PLOGERR( klogErr, ( klogErr, rc, "cannot open cursor on projection-table '$(t)'", "t=%s", table_name ) );
+            }
+            if ( rc == 0 )
+                cur->cursor = cursor;
+            else
+                VCursorRelease( cursor );
+        }
+        VTableRelease( tbl );
+    }
+    return rc;
+}
+
+
+rc_t sam_proj_read( const sam_proj_cursor * cur, int64_t row_id, sam_proj_row * row )
+{
+    rc_t rc;
+    /* read_char_ptr() does not touch the pointer for empty cells */
+    row->cigar = row->read = row->quality = row->tags = row->md = "";
+    rc = read_char_ptr( row_id, cur->cursor, cur->cigar_idx, &row->cigar, &row->cigar_len, "CIGAR" );
+    if ( rc == 0 )
+        rc = read_char_ptr( row_id, cur->cursor, cur->read_idx, &row->read, &row->read_len, "READ" );
+    if ( rc == 0 )
+        rc = read_char_ptr( row_id, cur->cursor, cur->quality_idx, &row->quality, &row->quality_len, "QUALITY" );
+    if ( rc == 0 )
+        rc = read_char_ptr( row_id, cur->cursor, cur->tags_idx, &row->tags, &row->tags_len, "TAGS" );
+    if ( rc == 0 )
+        rc = read_char_ptr( row_id, cur->cursor, cur->md_idx, &row->md, &row->md_len, "MD" );
+    if ( rc == 0 )
+        rc = read_uint32( row_id, cur->cursor, cur->nm_idx, &row->nm, 0, "NM" );
+    if ( rc == 0 )
+        rc = read_uint32( row_id, cur->cursor, cur->sam_flags_idx, &row->sam_flags, 0, "SAM_FLAGS" );
+    return rc;
+}
+
+
+void sam_proj_close_cursor( sam_proj_cursor * cur )
+{
+    if ( cur->cursor != NULL )
+    {
+        VCursorRelease( cur->cursor );
+        cur->cursor = NULL;
+    }
+}
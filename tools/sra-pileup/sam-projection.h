@@ -0,0 +1,150 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#ifndef _h_sam_projection_
+#define _h_sam_projection_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+}
+#endif
+
+#include <klib/rc.h>
+#include <klib/log.h>
+
+#include <kfs/directory.h>
+
+#include <vdb/manager.h>
+#include <vdb/database.h>
+#include <vdb/table.h>
+#include <vdb/cursor.h>
+
+#include "sam-dump-opts.h"
+
+/*
+    the SAM-projection-cache is a separate database, built once by sam-dump --build-projection
+    it has a PRIMARY_ALIGNMENT- and a SECONDARY_ALIGNMENT-table, the row-id's are the
+    same as in the source-tables, each row holds what sam-dump computes for an alignment:
+    the final CIGAR ( after CG-treatment ), READ and QUALITY ( changed by CG-merge ),
+    the CG-tags, the NM-value, the MD-tag ( as printed ) and the SAM-flags
+
+    the options that change these values are stored in the metadata, a projection is only
+    used if it has been built with the same options, and from the same source: the resolved
+    input ( absolute path or accession ) and a stamp of its content are stored in the metadata
+    too. the stamp is the MD5 over the md5-files the loaders write for every column ( kcmMD5 ),
+    an input without them gets no projection
+*/
+
+
+/* one row, the pointers are valid until the next read/write */
+typedef struct sam_proj_row
+{
+    const char * cigar;
+    const char * read;
+    const char * quality;
+    const char * tags;
+    const char * md;
+    uint32_t cigar_len;
+    uint32_t read_len;
+    uint32_t quality_len;
+    uint32_t tags_len;
+    uint32_t md_len;
+    uint32_t nm;
+    uint32_t sam_flags;
+} sam_proj_row;
+
+
+/* ---------------------------------------------------------------------------------- */
+
+/* a local input is identified by its absolute path, an accession as it is given */
+rc_t sam_proj_source_id( const KDirectory * dir, const char * src_path,
+                         char * id, size_t id_size );
+
+/* the content-stamp of the database in db_dir, 32 hex-digits ( stamp_size >= 33 ),
+   rcChecksum/rcNotFound if the database has no md5-files */
+rc_t sam_proj_source_stamp( const KDirectory * db_dir, char * stamp, size_t stamp_size );
+
+
+/* ---------------------------------------------------------------------------------- */
+
+struct sam_proj_writer;
+
+rc_t make_sam_proj_writer( struct sam_proj_writer ** self, KDirectory * dir,
+                           const char * path, const samdump_opts * opts,
+                           const VDatabase * src, const char * src_path );
+
+/* the rows of the table must be written in order, starting with first_row */
+rc_t sam_proj_writer_open_table( struct sam_proj_writer * self, const char * table_name,
+                                 int64_t first_row, uint64_t row_count );
+
+rc_t sam_proj_writer_write( struct sam_proj_writer * self, const sam_proj_row * row );
+
+rc_t sam_proj_writer_close_table( struct sam_proj_writer * self );
+
+void release_sam_proj_writer( struct sam_proj_writer * self );
+
+
+/* ---------------------------------------------------------------------------------- */
+
+struct sam_proj;
+
+/* *self is NULL if the projection does not match the options, was not built from src
+   or src has no content-stamp, a warning is logged. a table of the projection is only
+   used if it has as many rows as the table of src */
+rc_t open_sam_proj( const struct sam_proj ** self, const VDBManager * mgr,
+                    const char * path, const VDatabase * src, const char * src_path,
+                    const samdump_opts * opts );
+
+void release_sam_proj( const struct sam_proj * self );
+
+
+typedef struct sam_proj_cursor
+{
+    const VCursor * cursor;     /* NULL if the table is not in the projection */
+    uint32_t cigar_idx;
+    uint32_t read_idx;
+    uint32_t quality_idx;
+    uint32_t tags_idx;
+    uint32_t md_idx;
+    uint32_t nm_idx;
+    uint32_t sam_flags_idx;
+} sam_proj_cursor;
+
+
+/* cur->cursor stays NULL if the projection does not have a usable table of this name */
+rc_t sam_proj_open_cursor( const struct sam_proj * self, sam_proj_cursor * cur,
+                           const char * table_name, size_t cursor_cache_size );
+
+rc_t sam_proj_read( const sam_proj_cursor * cur, int64_t row_id, sam_proj_row * row );
+
+void sam_proj_close_cursor( sam_proj_cursor * cur );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
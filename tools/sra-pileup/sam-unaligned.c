@@ -26,7 +26,9 @@
 
 #include "read_fkt.h"
 #include "sam-unaligned.h"
+#include "bam_out.h"
 #include <kapp/main.h>
+#include <klib/printf.h>
 #include <sysalloc.h>
 #include <ctype.h>
 
@@ -425,16 +427,21 @@ static rc_t print_sliced_quality( const samdump_opts * const opts,
 }
 
 
-static rc_t dump_the_other_read( const seq_table_ctx * const stx,
-                                 const prim_table_ctx * const ptx,
-                                 const int64_t row_id,
-                                 const uint32_t mate_idx )
+/* RNEXT and PNEXT ( 1-based ) of the mate, *ref_name is NULL if the rows are incomplete */
+static rc_t get_the_other_read( const seq_table_ctx * const stx,
+                                const prim_table_ctx * const ptx,
+                                const int64_t row_id,
+                                const uint32_t mate_idx,
+                                const char ** mate_ref_name,
+                                uint32_t * mate_ref_name_len,
+                                INSDC_coord_zero * mate_ref_pos )
 {
     uint32_t row_len;
     const int64_t *prim_al_id_ptr;
 
     /* read from the SEQUENCE-table the value of the colum "PRIMARY_ALIGNMENT_ID"[ mate_idx ] */
     rc_t rc = read_int64_ptr( row_id, stx->cursor, stx->prim_al_id_idx, &prim_al_id_ptr, &row_len, "PRIM_AL_ID" );
+    *mate_ref_name = NULL;
     if ( rc == 0 )
     {
         if ( row_len == 0 )
@@ -451,7 +458,9 @@ static rc_t dump_the_other_read( const seq_table_ctx * const stx,
             int64_t a_row_id = prim_al_id_ptr[ mate_idx ];
             if ( a_row_id == 0 )
             {
-                rc = KOutMsg( "*\t0\t" );
+                *mate_ref_name = ref_name_star;
+                *mate_ref_name_len = 1;
+                *mate_ref_pos = 0;
             }
             else
             {
@@ -470,7 +479,9 @@ static rc_t dump_the_other_read( const seq_table_ctx * const stx,
                         rc = read_INSDC_coord_zero_ptr( a_row_id, ptx->cursor, ptx->ref_pos_idx, &ref_pos, &row_len, "REF_POS" );
                         if ( rc == 0 )
                         {
-                            rc = KOutMsg( "%.*s\t%i\t", ref_name_len, ref_name, ref_pos[ 0 ] + 1 );
+                            *mate_ref_name = ref_name;
+                            *mate_ref_name_len = ref_name_len;
+                            *mate_ref_pos = ref_pos[ 0 ] + 1;
                         }
                     }
                 }
@@ -481,6 +492,21 @@ static rc_t dump_the_other_read( const seq_table_ctx * const stx,
 }
 
 
+static rc_t dump_the_other_read( const seq_table_ctx * const stx,
+                                 const prim_table_ctx * const ptx,
+                                 const int64_t row_id,
+                                 const uint32_t mate_idx )
+{
+    const char * mate_ref_name;
+    uint32_t mate_ref_name_len;
+    INSDC_coord_zero mate_ref_pos;
+    rc_t rc = get_the_other_read( stx, ptx, row_id, mate_idx, &mate_ref_name, &mate_ref_name_len, &mate_ref_pos );
+    if ( rc == 0 && mate_ref_name != NULL )
+        rc = KOutMsg( "%.*s\t%i\t", mate_ref_name_len, mate_ref_name, mate_ref_pos );
+    return rc;
+}
+
+
 static uint32_t calc_mate_idx( const uint32_t n_reads, const uint32_t read_idx )
 {
     if ( read_idx == ( n_reads - 1 ) )
@@ -566,26 +592,121 @@ static bool calc_reverse_flag( const samdump_opts * const opts,
 }
 
 
-static rc_t opt_field_spot_group( const seq_table_ctx * const stx, int64_t row_id )
+static rc_t opt_field_spot_group( struct bam_out * bam, const seq_table_ctx * const stx, int64_t row_id )
 {
     const char * spot_group = NULL;
     uint32_t spot_group_len;    
     rc_t rc = read_char_ptr( row_id, stx->cursor, stx->spot_group_idx, &spot_group, &spot_group_len, "SPOT_GROUP" );
     if ( rc == 0 && spot_group_len > 0 )
-        rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_string( bam, "RG", spot_group, spot_group_len ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\tRG:Z:%.*s", spot_group_len, spot_group );
+    }
     return rc;
 }
 
-static rc_t opt_field_lnk_group( const seq_table_ctx * const stx, int64_t row_id )
+static rc_t opt_field_lnk_group( struct bam_out * bam, const seq_table_ctx * const stx, int64_t row_id )
 {
     const char * lnk_grp;
     uint32_t lnk_grp_len;
     rc_t rc = read_char_ptr( row_id, stx->cursor, stx->lnk_group_idx, &lnk_grp, &lnk_grp_len, "LINKAGE_GROUP" );
     if ( rc == 0 && lnk_grp_len > 0 )
-        rc = KOutMsg( "\tBX:Z:%.*s", lnk_grp_len, lnk_grp );
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_string( bam, "BX", lnk_grp, lnk_grp_len ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\tBX:Z:%.*s", lnk_grp_len, lnk_grp );
+    }
     return rc;
 }
 
+
+/* the optional fields of an unaligned read, and the end of it */
+static rc_t unaligned_opt_fields( struct bam_out * bam,
+                                  const samdump_opts * const opts,
+                                  const seq_table_ctx * const stx,
+                                  int64_t row_id )
+{
+    rc_t rc = 0;
+
+    /* OPT SAM-FIELD:       SRA-column: ALIGN_ID */
+    if ( opts->print_alignment_id_in_column_xi )
+    {
+        if ( bam != NULL )
+            rc = bam_out_tag_int( bam, "XI", ( uint32_t )row_id ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\tXI:i:%u", row_id );
+    }
+
+    /* OPT SAM-FIELD:       SRA-column: SPOT_GROUP */
+    if ( rc == 0 && stx->spot_group_idx != COL_NOT_AVAILABLE )
+        rc = opt_field_spot_group( bam, stx, row_id );
+
+    /* OPT SAM-FIELD:       SRA-column: LINKAGE_GROUP */
+    if ( rc == 0 && stx->lnk_group_idx != COL_NOT_AVAILABLE )
+        rc = opt_field_lnk_group( bam, stx, row_id );
+
+    if ( rc == 0 )
+    {
+        if ( bam != NULL )
+            rc = bam_out_end_record( bam ); /* bam_out.c */
+        else
+            rc = KOutMsg( "\n" );
+    }
+    return rc;
+}
+
+
+/* the fixed fields of an unaligned read handed over to the BAM-encoder, instead of printed as text
+   ( RNAME, POS, MAPQ, CIGAR and TLEN are empty ), pnext is 1-based, 0 ... none */
+static rc_t bam_unaligned_read( struct bam_out * bam,
+                                const samdump_opts * const opts,
+                                const char * qname,
+                                size_t qname_len,
+                                uint32_t sam_flags,
+                                const char * mate_ref_name,
+                                uint32_t mate_ref_name_len,
+                                INSDC_coord_zero pnext,
+                                const INSDC_dna_text * read,
+                                const char * quality,
+                                uint32_t read_idx,
+                                bool reverse,
+                                const INSDC_coord_zero * read_start,
+                                const INSDC_coord_len * read_len )
+{
+    bam_rec_fields f;
+    memset( &f, 0, sizeof f );
+    f.qname = qname;
+    f.qname_len = ( uint32_t )qname_len;
+    f.flag = sam_flags;
+    f.rname = ref_name_star;
+    f.rname_len = 1;
+    f.pos = -1;
+    f.cigar = ref_name_star;
+    f.cigar_len = 1;
+    if ( mate_ref_name != NULL && mate_ref_name_len > 0 )
+    {
+        f.rnext = mate_ref_name;
+        f.rnext_len = mate_ref_name_len;
+    }
+    else
+    {
+        f.rnext = ref_name_star;
+        f.rnext_len = 1;
+    }
+    f.pnext = ( int64_t )pnext - 1;
+    f.seq = read + read_start[ read_idx ];
+    f.seq_len = read_len[ read_idx ];
+    f.qual = quality + read_start[ read_idx ];
+    f.qual_len = read_len[ read_idx ];
+    f.qual_offset = 0;      /* QUALITY has the phred-values */
+    f.qual_map = ( opts->qual_quant != NULL ) ? opts->qual_quant_matrix : NULL;
+    f.reverse = reverse;
+    return bam_out_begin_record( bam, &f ); /* bam_out.c */
+}
+
 static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
                                        const seq_table_ctx * const stx,
                                        const prim_table_ctx * const ptx,
@@ -602,6 +723,7 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
     const INSDC_read_filter * read_filter = NULL;
     const INSDC_coord_zero * read_start = NULL;
     const INSDC_coord_len * read_len;
+    struct bam_out * bam = bam_redir_current(); /* bam_out.c */
 
     rc_t rc = read_int64_ptr( row_id, stx->cursor, stx->prim_al_id_idx, &prim_align_ids, &prim_align_ids_len, "PRIM_AL_ID" );
     if ( rc == 0 && nreads != prim_align_ids_len )
@@ -650,9 +772,10 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
                         else
                         {
                             bool reverse = false;
+                            uint32_t sam_flags = 0;
 
                             /* SAM-FIELD: QNAME     SRA-column: SPOT_ID ( int64 ) */
-                            if ( rc == 0 )
+                            if ( rc == 0 && bam == NULL )
                                 rc = KOutMsg( "%ld\t", seq_spot_id );
 
                             if ( rc == 0 && read_type == NULL )
@@ -667,25 +790,26 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
                             /* SAM-FIELD: FLAG      SRA-column: calculated from READ_TYPE, READ_FILTER etc. */
                             if ( rc == 0 )
                             {
-                                uint32_t sam_flags = calculate_unaligned_sam_flags_db( nreads, read_idx, mate_idx, 
-                                                                                    align_id, read_type, reverse, read_filter );
-                                rc = KOutMsg( "%u\t", sam_flags );
+                                sam_flags = calculate_unaligned_sam_flags_db( nreads, read_idx, mate_idx, 
+                                                                              align_id, read_type, reverse, read_filter );
+                                if ( bam == NULL )
+                                    rc = KOutMsg( "%u\t", sam_flags );
                             }
 
                             /* SAM-FIELD: RNAME     SRA-column: none, fix '*' */
                             /* SAM-FIELD: POS       SRA-column: none, fix '0' */
                             /* SAM-FIELD: MAPQ      SRA-column: none, fix '0' */
                             /* SAM-FIELD: CIGAR     SRA-column: none, fix '*' */
-                            if ( rc == 0 )
+                            if ( rc == 0 && bam == NULL )
                                 rc = KOutMsg( "*\t0\t0\t*\t" );
 
                             /* SAM-FIELD: RNEXT     SRA-column: found in cache */
                             /* SAM-FIELD: POS       SRA-column: found in cache */
-                            if ( rc == 0 )
+                            if ( rc == 0 && bam == NULL )
                                 rc = KOutMsg( "%s\t%li\t", mate_ref_name, mate_ref_pos + 1 );
 
                             /* SAM-FIELD: TLEN      SRA-column: none, fix '0' */
-                            if ( rc == 0 )
+                            if ( rc == 0 && bam == NULL )
                                 rc = KOutMsg( "0\t" );
 
                             if ( rc == 0 && read == NULL )
@@ -695,30 +819,32 @@ static rc_t dump_seq_row_sam_filtered( const samdump_opts * const opts,
                             if ( rc == 0 && read_start == NULL )
                                 rc = read_read_start( stx, row_id, &read_start, nreads );
 
-                            /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
-                            if ( rc == 0 )
-                                rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
-                            if ( rc == 0 )
-                                rc = KOutMsg( "\t" );
-
-                            /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
-                            if ( rc == 0 )
-                                rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
-
-                            /* OPT SAM-FIELD:       SRA-column: ALIGN_ID */
-                            if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                                rc = KOutMsg( "\tXI:i:%u", row_id );
-
-                            /* OPT SAM-FIELD:      SRA-column: SPOT_GROUP */
-                            if ( rc == 0 && stx->spot_group_idx != COL_NOT_AVAILABLE )
-                                rc = opt_field_spot_group( stx, row_id );
+                            if ( rc == 0 && bam != NULL )
+                            {
+                                char qname[ 32 ];
+                                size_t qname_len;
+                                rc = string_printf( qname, sizeof qname, &qname_len, "%ld", seq_spot_id );
+                                if ( rc == 0 )
+                                    rc = bam_unaligned_read( bam, opts, qname, qname_len, sam_flags,
+                                                             mate_ref_name, ( uint32_t )string_size( mate_ref_name ), mate_ref_pos + 1,
+                                                             read, quality, read_idx, reverse, read_start, read_len );
+                            }
+                            else
+                            {
+                                /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
+                                if ( rc == 0 )
+                                    rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
+                                if ( rc == 0 )
+                                    rc = KOutMsg( "\t" );
+
+                                /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
+                                if ( rc == 0 )
+                                    rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
+                            }
 
-                            /* OPT SAM-FIELD:       SRA-column: LINKAGE_GROUP */
-                            if ( rc == 0 && stx->lnk_group_idx != COL_NOT_AVAILABLE )
-                                rc = opt_field_lnk_group( stx, row_id );
-                            
+                            /* OPT SAM-FIELD:       SRA-column: ALIGN_ID, SPOT_GROUP, LINKAGE_GROUP */
                             if ( rc == 0 )
-                                rc = KOutMsg( "\n" );
+                                rc = unaligned_opt_fields( bam, opts, stx, row_id );
                         }
                     }
                 }
@@ -749,6 +875,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
     const INSDC_read_filter * read_filter = NULL;
     const INSDC_coord_zero * read_start = NULL;
     const INSDC_coord_len * read_len;
+    struct bam_out * bam = bam_redir_current(); /* bam_out.c */
 
     rc_t rc = read_int64_ptr( row_id, stx->cursor, stx->prim_al_id_idx, &prim_align_ids, &prim_align_ids_len, "PRIM_AL_ID" );
     if ( rc == 0 && nreads != prim_align_ids_len )
@@ -762,8 +889,11 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
              read_len[ read_idx ] > 0 )             /* and has a length! */
         {
             bool reverse = false, mate_available = false;
-            uint32_t mate_idx = 0;
+            uint32_t mate_idx = 0, sam_flags = 0;
             int64_t mate_id = 0;
+            const char * mate_ref_name = NULL;
+            uint32_t mate_ref_name_len = 0;
+            INSDC_coord_zero mate_ref_pos = 0;
 
             if ( nreads > 1 )
             {
@@ -786,13 +916,12 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
                 rc = read_read_filter( stx, row_id, &read_filter, nreads );
 
             /* SAM-FIELD: QNAME     SRA-column: SPOT_ID ( int64 ) */
-            if ( rc == 0 )
+            if ( rc == 0 && bam == NULL )
                 rc = KOutMsg( "%ld\t", row_id );
 
             /* SAM-FIELD: FLAG      SRA-column: calculated from READ_TYPE, READ_FILTER etc. */
             if ( rc == 0 )
             {
-                uint32_t sam_flags;
                 if ( stx->prim_al_id_idx != INVALID_COLUMN )
                 {
                     uint32_t temp_nreads = nreads;
@@ -807,14 +936,15 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
                     else
                         sam_flags = 0x04;
                 }
-                rc = KOutMsg( "%u\t", sam_flags );
+                if ( bam == NULL )
+                    rc = KOutMsg( "%u\t", sam_flags );
             }
 
             /* SAM-FIELD: RNAME     SRA-column: none, fix '*' */
             /* SAM-FIELD: POS       SRA-column: none, fix '0' */
             /* SAM-FIELD: MAPQ      SRA-column: none, fix '0' */
             /* SAM-FIELD: CIGAR     SRA-column: none, fix '*' */
-            if ( rc == 0 )
+            if ( rc == 0 && bam == NULL )
                 rc = KOutMsg( "*\t0\t0\t*\t" );
 
             /* SAM-FIELD: RNEXT     SRA-column: look up in cache, or none */
@@ -823,20 +953,19 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
             {
                 if ( ptx == NULL )
                 {
-                    rc = KOutMsg( "0\t0\t" );   /* no way to get that without PRIM_ALIGN-table */
+                    if ( bam == NULL )
+                        rc = KOutMsg( "0\t0\t" );   /* no way to get that without PRIM_ALIGN-table */
                 }
                 else
                 {
                     if ( opts->use_mate_cache && mc != NULL && ids != NULL )
                     {
-                        const char * mate_ref_name;
-                        uint32_t mate_ref_name_len;
-                        INSDC_coord_zero mate_ref_pos;
-
                         rc = get_mate_info( ptx, mc, ids, row_id, mate_id, nreads, &mate_ref_name, &mate_ref_name_len, &mate_ref_pos );
-                        if ( rc == 0 )
+                        if ( rc == 0 && bam == NULL )
                             rc = KOutMsg( "%.*s\t%li\t", mate_ref_name_len, mate_ref_name, mate_ref_pos );
                     }
+                    else if ( bam != NULL )
+                        rc = get_the_other_read( stx, ptx, row_id, mate_idx, &mate_ref_name, &mate_ref_name_len, &mate_ref_pos );
                     else
                     {
                         /* print the mate info */
@@ -847,7 +976,7 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
 
 
             /* SAM-FIELD: TLEN      SRA-column: none, fix '0' */
-            if ( rc == 0 )
+            if ( rc == 0 && bam == NULL )
                 rc = KOutMsg( "0\t" );
 
             if ( rc == 0 && read == NULL )
@@ -855,33 +984,38 @@ static rc_t dump_seq_prim_row_sam( const samdump_opts * const opts,
             if ( rc == 0 && read_start == NULL )
                 rc = read_read_start( stx, row_id, &read_start, nreads );
 
-            /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
-            if ( rc == 0 )
-                rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
-            if ( rc == 0 )
-                rc = KOutMsg( "\t" );
-
-            if ( rc == 0 && quality == NULL )
-                rc = read_quality( stx, row_id, &quality, rd_len );
-
-            /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
-            if ( rc == 0 )
-                rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
-
-            /* OPT SAM-FIIELD:      SRA-column: ALIGN_ID */
-            if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                rc = KOutMsg( "\tXI:i:%u", row_id );
+            if ( rc == 0 && bam != NULL )
+            {
+                char qname[ 32 ];
+                size_t qname_len;
+                if ( quality == NULL )
+                    rc = read_quality( stx, row_id, &quality, rd_len );
+                if ( rc == 0 )
+                    rc = string_printf( qname, sizeof qname, &qname_len, "%ld", row_id );
+                if ( rc == 0 )
+                    rc = bam_unaligned_read( bam, opts, qname, qname_len, sam_flags,
+                                             mate_ref_name, mate_ref_name_len, mate_ref_pos,
+                                             read, quality, read_idx, reverse, read_start, read_len );
+            }
+            else
+            {
+                /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
+                if ( rc == 0 )
+                    rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
+                if ( rc == 0 )
+                    rc = KOutMsg( "\t" );
 
-            /* OPT SAM-FIIELD:      SRA-column: SPOT_GROUP */
-            if ( rc == 0 && stx->spot_group_idx != COL_NOT_AVAILABLE )
-                rc = opt_field_spot_group( stx, row_id );
+                if ( rc == 0 && quality == NULL )
+                    rc = read_quality( stx, row_id, &quality, rd_len );
 
-            /* OPT SAM-FIELD:       SRA-column: LINKAGE_GROUP */
-            if ( rc == 0 && stx->lnk_group_idx != COL_NOT_AVAILABLE )
-                rc = opt_field_lnk_group( stx, row_id );
+                /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
+                if ( rc == 0 )
+                    rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
+            }
 
+            /* OPT SAM-FIELD:       SRA-column: ALIGN_ID, SPOT_GROUP, LINKAGE_GROUP */
             if ( rc == 0 )
-                rc = KOutMsg( "\n" );
+                rc = unaligned_opt_fields( bam, opts, stx, row_id );
         }
     }
     return rc;
@@ -902,6 +1036,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
     const INSDC_read_filter * read_filter = NULL;
     const INSDC_coord_zero * read_start = NULL;
     const INSDC_coord_len * read_len;
+    struct bam_out * bam = bam_redir_current(); /* bam_out.c */
 
     rc_t rc = read_read_len( stx, row_id, &read_len, nreads );
     if ( rc == 0 )
@@ -920,7 +1055,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
              ( ( read_type[ read_idx ] & READ_TYPE_BIOLOGICAL ) == READ_TYPE_BIOLOGICAL ) )
         {
             bool reverse = false;
-            uint32_t mate_idx = 0;
+            uint32_t mate_idx = 0, sam_flags = 0;
 
             if ( nreads > 1 )
             {
@@ -937,7 +1072,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
                 rc = read_read_filter( stx, row_id, &read_filter, nreads );
 
             /* SAM-FIELD: QNAME     SRA-column: SPOT_ID ( int64 ) */
-            if ( rc == 0 )
+            if ( rc == 0 && bam == NULL )
             {
                 if ( name != NULL && name_len > 0 )
                     rc = KOutMsg( "%.*s\t", name_len, name );
@@ -948,9 +1083,10 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
             /* SAM-FIELD: FLAG      SRA-column: calculated from READ_TYPE, READ_FILTER etc. */
             if ( rc == 0 )
             {
-                uint32_t sam_flags = calculate_unaligned_sam_flags_db( nreads, read_idx, mate_idx, 
+                sam_flags = calculate_unaligned_sam_flags_db( nreads, read_idx, mate_idx, 
                                             0, read_type, reverse, read_filter );
-                rc = KOutMsg( "%u\t", sam_flags );
+                if ( bam == NULL )
+                    rc = KOutMsg( "%u\t", sam_flags );
             }
 
             /* SAM-FIELD: RNAME     SRA-column: none, fix '*' */
@@ -961,7 +1097,7 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
             /* SAM-FIELD: POS       SRA-column: none, fix '0' */
             /* SAM-FIELD: TLEN      SRA-column: none, fix '0' */
 
-            if ( rc == 0 )
+            if ( rc == 0 && bam == NULL )
                 rc = KOutMsg( "*\t0\t0\t*\t*\t0\t0\t" );
 
             if ( rc == 0 && read == NULL )
@@ -969,33 +1105,42 @@ static rc_t dump_seq_row_sam( const samdump_opts * const opts,
             if ( rc == 0 && read_start == NULL )
                 rc = read_read_start( stx, row_id, &read_start, nreads );
 
-            /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
-            if ( rc == 0 )
-                rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
-            if ( rc == 0 )
-                rc = KOutMsg( "\t" );
-
-            if ( rc == 0 && quality == NULL )
-                rc = read_quality( stx, row_id, &quality, rd_len );
-
-            /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
-            if ( rc == 0 )
-                rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
-
-            /* OPT SAM-FIIELD:      SRA-column: ALIGN_ID */
-            if ( rc == 0 && opts->print_alignment_id_in_column_xi )
-                rc = KOutMsg( "\tXI:i:%u", row_id );
+            if ( rc == 0 && bam != NULL )
+            {
+                char qname[ 32 ];
+                size_t qname_len = name_len;
+                const char * qname_ptr = name;
+                if ( quality == NULL )
+                    rc = read_quality( stx, row_id, &quality, rd_len );
+                if ( rc == 0 && ( name == NULL || name_len == 0 ) )
+                {
+                    rc = string_printf( qname, sizeof qname, &qname_len, "%lu", row_id );
+                    qname_ptr = qname;
+                }
+                if ( rc == 0 )
+                    rc = bam_unaligned_read( bam, opts, qname_ptr, qname_len, sam_flags,
+                                             NULL, 0, 0,
+                                             read, quality, read_idx, reverse, read_start, read_len );
+            }
+            else
+            {
+                /* SAM-FIELD: SEQ       SRA-column: READ, sliced by READ_START/READ_LEN */
+                if ( rc == 0 )
+                    rc = print_sliced_read( read, read_idx, reverse, read_start, read_len );
+                if ( rc == 0 )
+                    rc = KOutMsg( "\t" );
 
-            /* OPT SAM-FIIELD:      SRA-column: SPOT_GROUP */
-            if ( rc == 0 && stx->spot_group_idx != COL_NOT_AVAILABLE )
-                rc = opt_field_spot_group( stx, row_id );
+                if ( rc == 0 && quality == NULL )
+                    rc = read_quality( stx, row_id, &quality, rd_len );
 
-            /* OPT SAM-FIELD:       SRA-column: LINKAGE_GROUP */
-            if ( rc == 0 && stx->lnk_group_idx != COL_NOT_AVAILABLE )
-                rc = opt_field_lnk_group( stx, row_id );
+                /* SAM-FIELD: QUAL      SRA-column: QUALITY, sliced by READ_START/READ_LEN */
+                if ( rc == 0 )
+                    rc = print_sliced_quality( opts, quality, read_idx, reverse, read_start, read_len );
+            }
 
+            /* OPT SAM-FIELD:       SRA-column: ALIGN_ID, SPOT_GROUP, LINKAGE_GROUP */
             if ( rc == 0 )
-                rc = KOutMsg( "\n" );
+                rc = unaligned_opt_fields( bam, opts, stx, row_id );
         }
     }
     return rc;
@@ -41,6 +41,9 @@
 #include "pileup_indels.h"
 #include "pileup_stat.h"
 #include "pileup_v2.h"
+#include "pileup_columnar.h"
+#include "out_buffer.h"
+#include "pileup_tiles.h"
 
 #include <kapp/main.h>
 
@@ -48,12 +51,17 @@
 #include <klib/printf.h>
 #include <klib/report.h>
 #include <klib/vector.h>
+#include <klib/text.h>
 
 #include <kfs/file.h>
 #include <kfs/buffile.h>
 #include <kfs/bzip.h>
 #include <kfs/gzip.h>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 #include <insdc/sra.h>
 
 #include <kdb/manager.h>
@@ -78,6 +86,8 @@
 #define OPTION_MINMAPQ "minmapq"
 #define ALIAS_MINMAPQ  "q"
 
+#define OPTION_MINBASEQ "minbaseq"
+
 #define OPTION_DUPS    "duplicates"
 #define ALIAS_DUPS     "d"
 
@@ -101,6 +111,10 @@
 
 #define OPTION_DEPTH_PER_SPOTGRP	"depth-per-spotgroup"
 
+#define OPTION_THREADS "threads"
+
+#define OPTION_COL_DEFLATE "columnar-deflate"
+
 #define OPTION_FUNC    "function"
 #define ALIAS_FUNC     NULL
 
@@ -115,6 +129,7 @@
 #define FUNC_VARCOUNT   "varcount"
 #define FUNC_DELETES    "deletes"
 #define FUNC_INDELS     "indels"
+#define FUNC_COLUMNAR   "columnar"
 
 enum
 {
@@ -129,13 +144,17 @@ enum
     sra_pileup_test = 8,
     sra_pileup_varcount = 9,
     sra_pileup_deletes = 10,
-	sra_pileup_indels = 11
+	sra_pileup_indels = 11,
+    sra_pileup_columnar = 12
 };
 
 static const char * minmapq_usage[]         = { "Minimum mapq-value, ", 
                                                 "alignments with lower mapq",
                                                 "will be ignored (default=0)", NULL };
 
+static const char * minbaseq_usage[]        = { "Minimum base-quality, bases below are not counted ",
+                                                "by the functions count, mismatch and columnar", NULL };
+
 static const char * dups_usage[]            = { "process duplicates 0..off/1..on", NULL };
 
 static const char * noqual_usage[]          = { "Omit qualities in output", NULL };
@@ -158,6 +177,11 @@ static const char * merge_usage[]           = { "If adjacent slices are closer t
 
 static const char * no_qual_usage[]         = { "omit qualities", NULL };
 
+static const char * threads_usage[]         = { "number of worker-threads, the references are cut into tiles ",
+                                                "which are processed in parallel, default is 1", NULL };
+
+static const char * col_deflate_usage[]     = { "compress the blocks of function columnar", NULL };
+
 static const char * func_ref_usage[]        = { "list references", NULL };
 static const char * func_ref_ex_usage[]     = { "list references + coverage", NULL };
 static const char * func_count_usage[]      = { "sort pileup with counters", NULL };
@@ -172,6 +196,8 @@ static const char * func_varcount_usage[]   = { "variation counters: ",
                                                 "deletes, inserts,",
                                                 "ins after A, ins after C, ins after G, ins after T", NULL };
 
+static const char * func_columnar_usage[]   = { "binary blocks of columns: position, depth, base-, indel- and strand-counts",
+                                                "( see pileup_columnar_fmt.h )", NULL };
 static const char * func_deletes_usage[]    = { "list deletions greater then 20", NULL };
 
 static const char * func_usage[]            = { "alternative functionality", NULL };
@@ -189,6 +215,9 @@ OptDef MyOptions[] =
     { OPTION_SEQNAME,	ALIAS_SEQNAME,	NULL,	seqname_usage,	1,        false,       false },
     { OPTION_MIN_M,		NULL,			NULL,	min_m_usage,	1,        true,        false },
     { OPTION_MERGE,		NULL,			NULL,	merge_usage,	1,        true,        false },
+    { OPTION_THREADS,	NULL,			NULL,	threads_usage,	1,        true,        false },
+    { OPTION_MINBASEQ,	NULL,			NULL,	minbaseq_usage,	1,        true,        false },
+    { OPTION_COL_DEFLATE,	NULL,		NULL,	col_deflate_usage,	1,    false,       false },
     { OPTION_FUNC,		ALIAS_FUNC,		NULL,	func_usage,		1,        true,        false }
 };
 
@@ -275,15 +304,23 @@ static rc_t get_pileup_options( Args * args, pileup_options *opts )
 {
     rc_t rc = get_common_options( args, &opts->cmn );
     opts->function = sra_pileup_samtools;
+    opts->tile_start = 0;
+    opts->tile_end = 0;
 
     if ( rc == 0 )
         rc = get_uint32_option( args, OPTION_MINMAPQ, &opts->minmapq, 0 );
 
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPTION_MINBASEQ, &opts->min_base_qual, 0 );
+
     if ( rc == 0 )
         rc = get_uint32_option( args, OPTION_MIN_M, &opts->min_mismatch, 5 );
 
     if ( rc == 0 )
         rc = get_uint32_option( args, OPTION_MERGE, &opts->merge_dist, 10000 );
+
+    if ( rc == 0 )
+        rc = get_uint32_option( args, OPTION_THREADS, &opts->threads, 1 );
         
     if ( rc == 0 )
         rc = get_bool_option( args, OPTION_DUPS, &opts->process_dups, false );
@@ -306,6 +343,9 @@ static rc_t get_pileup_options( Args * args, pileup_options *opts )
     if ( rc == 0 )
         rc = get_bool_option( args, OPTION_SEQNAME, &opts->use_seq_name, false );
 
+    if ( rc == 0 )
+        rc = get_bool_option( args, OPTION_COL_DEFLATE, &opts->columnar_deflate, false );
+
     if ( rc == 0 )
     {
         const char * fkt = NULL;
@@ -334,6 +374,8 @@ static rc_t get_pileup_options( Args * args, pileup_options *opts )
                 opts->function = sra_pileup_deletes;
             else if ( cmp_pchar( fkt, FUNC_INDELS ) == 0 )
                 opts->function = sra_pileup_indels;
+            else if ( cmp_pchar( fkt, FUNC_COLUMNAR ) == 0 )
+                opts->function = sra_pileup_columnar;
         }
     }
     return rc;
@@ -376,6 +418,7 @@ rc_t CC Usage ( const Args * args )
     KOutMsg ( "Options:\n" );
     print_common_helplines();
     HelpOptionLine ( ALIAS_MINMAPQ, OPTION_MINMAPQ, "min. mapq", minmapq_usage );
+    HelpOptionLine ( NULL, OPTION_MINBASEQ, "min. base-quality", minbaseq_usage );
     HelpOptionLine ( ALIAS_DUPS, OPTION_DUPS, "dup-mode", dups_usage );
     HelpOptionLine ( ALIAS_SPOTGRP, OPTION_SPOTGRP, NULL, spotgrp_usage );
     HelpOptionLine ( NULL, OPTION_DEPTH_PER_SPOTGRP, NULL, dpgrp_usage );	
@@ -383,6 +426,8 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( NULL, OPTION_MIN_M, NULL, min_m_usage );
     HelpOptionLine ( NULL, OPTION_MERGE, NULL, merge_usage );
     HelpOptionLine ( ALIAS_NOQUAL, OPTION_NOQUAL, NULL, no_qual_usage );
+    HelpOptionLine ( NULL, OPTION_THREADS, "count", threads_usage );
+    HelpOptionLine ( NULL, OPTION_COL_DEFLATE, NULL, col_deflate_usage );
 
     HelpOptionLine ( NULL, "function ref",      NULL, func_ref_usage );
     HelpOptionLine ( NULL, "function ref-ex",   NULL, func_ref_ex_usage );
@@ -393,6 +438,7 @@ rc_t CC Usage ( const Args * args )
     HelpOptionLine ( NULL, "function varcount", NULL, func_varcount_usage );
     HelpOptionLine ( NULL, "function deletes",  NULL, func_deletes_usage );
     HelpOptionLine ( NULL, "function indels",   NULL, func_indels_usage );
+    HelpOptionLine ( NULL, "function columnar", NULL, func_columnar_usage );
 	
     KOutMsg ( "\nGrouping of accessions into artificial spotgroups:\n" );
     KOutMsg ( "  sra-pileup SRRXXXXXX=a SRRYYYYYY=b SRRZZZZZZ=a\n\n" );
@@ -805,7 +851,11 @@ static rc_t walk_position( ReferenceIterator *ref_iter,
     }
     else if ( ( depth > 0 )||( options->no_skip ) )
     {
-        bool skip = skiplist_is_skip_position( options->skiplist, pos + 1 );
+        /* with worker-threads every position belongs to exactly one tile */
+        bool skip = ( options->tile_end > 0 &&
+                      ( ( uint64_t )pos + 1 < options->tile_start || ( uint64_t )pos + 1 > options->tile_end ) );
+        if ( !skip )
+            skip = skiplist_is_skip_position( options->skiplist, pos + 1 );
         if ( !skip )
         {
             rc = expand_dyn_string( line, ( 5 * depth ) + 100 );
@@ -1120,6 +1170,29 @@ static rc_t make_cursor_ids( Vector *cursor_id_vector, pileup_col_ids ** cursor_
 }
 
 
+/* the 1-based, inclusive bounds of a section, range == NULL means the whole reference */
+static void get_section_bounds( INSDC_coord_len len, const struct reference_range * range,
+                                uint32_t * start, uint32_t * end )
+{
+    if ( range == NULL )
+    {
+        *start = 1;
+        *end = ( len - *start ) + 1;
+    }
+    else
+    {
+        *start = get_ref_range_start( range );
+        *end   = get_ref_range_end( range );
+    }
+
+    if ( *start == 0 ) *start = 1;
+    if ( ( *end == 0 )||( *end > len + 1 ) )
+    {
+        *end = ( len - *start ) + 1;
+    }
+}
+
+
 static rc_t CC prepare_section_cb( prepare_ctx * ctx, const struct reference_range * range )
 {
     rc_t rc = 0;
@@ -1144,23 +1217,8 @@ static rc_t CC prepare_section_cb( prepare_ctx * ctx, const struct reference_ran
             uint32_t start, end;
             rc_t rc1 = 0, rc2 = 0, rc3 = 0;
 
-            if ( range == NULL )
-            {
-                start = 1;
-                end = ( len - start ) + 1;
-            }
-            else
-            {
-                start = get_ref_range_start( range );
-                end   = get_ref_range_end( range );
-            }
+            get_section_bounds( len, range, &start, &end );
 
-            if ( start == 0 ) start = 1;
-            if ( ( end == 0 )||( end > len + 1 ) )
-            {
-                end = ( len - start ) + 1;
-            }
-            
             /* depending on ctx->select prepare primary, secondary or both... */
             if ( ctx->use_primary_alignments )
             {
@@ -1289,7 +1347,8 @@ typedef struct foreach_arg_ctx
     VSchema *vdb_schema;
     ReferenceIterator *ref_iter;
     BSTree *ranges;
-    Vector *cursor_ids;
+    rc_t ( CC * on_section ) ( prepare_ctx * ctx, const struct reference_range * range );
+    void * section_data;    /* the cursor-ids-vector for prepare_section_cb() */
 } foreach_arg_ctx;
 
 
@@ -1334,8 +1393,8 @@ static rc_t CC on_argument( const char * path, const char * spot_group, void * d
                 prep.use_evidence_alignments = ( ( ctx->options->cmn.tab_select & evidence_ats ) == evidence_ats );
                 prep.ref_iter = ctx->ref_iter;
                 prep.spot_group = spot_group;
-                prep.on_section = prepare_section_cb;
-                prep.data = ctx->cursor_ids;
+                prep.on_section = ctx->on_section;
+                prep.data = ctx->section_data;
                 prep.path = path;
                 prep.db = NULL;
                 prep.prim_cur = NULL;
@@ -1366,12 +1425,561 @@ static void CC cur_id_vector_entry_whack( void *item, void *data )
 }
 
 
+/* =========================================================================================== */
+
+/*
+   the pileup on a pool of worker-threads:
+   every requested section of every reference is cut into tiles, each tile is a job,
+   the jobs are in the order of the single-threaded walk ( see pileup_tiles.h ),
+   the jobs are processed by the workers with their own reference-iterator and
+   output-buffer, the main-thread writes the output-buffers in the order of the jobs
+    + ... tiles of one or multiple references are processed in parallel
+    + ... an alignment overlapping two tiles is placed into both reference-iterators,
+          but every position is only printed by the tile it belongs to, so each
+          alignment is counted exactly once per position
+    - ... every worker opens the input-files and creates its own reference-lists and
+          cursors, it keeps them open for all of its tiles
+    - ... more memory, up to 2 x threads output-buffers are kept in flight
+*/
+
+#define MT_TILE_LEN ( 4 * 1024 * 1024 )
+#define MT_BUFFER_SIZE ( 1024 * 1024 )
+
+typedef struct mt_job
+{
+    char * ref_name;        /* the seq-id of the reference */
+    uint32_t start;         /* 1-based, inclusive */
+    uint32_t end;
+
+    out_buffer buffer;      /* what the job has printed */
+    rc_t rc;
+    bool done;
+} mt_job;
+
+
+/* an input-file as foreach_argument() has resolved it, the workers open it from here */
+typedef struct mt_input
+{
+    char * path;
+    char * spot_group;      /* NULL if the argument has none */
+} mt_input;
+
+
+typedef struct mt_ctx
+{
+    const foreach_arg_ctx * arg_ctx;    /* vdb-manager, schema and options */
+    Vector inputs;                      /* mt_input, in the order of the arguments */
+    BSTree * regions;                   /* the regions the user requested, for the skiplist */
+
+    tile_plan plan;         /* the sections of all input-files, merged into tiles */
+    mt_job * jobs;
+    uint32_t job_count;
+    uint32_t job_capacity;
+    uint32_t next_job;      /* the next job to be taken by a worker */
+    uint32_t next_out;      /* the next job to be written by the main-thread */
+    uint32_t max_ahead;     /* how many jobs can be ahead of the main-thread */
+
+    KLock * lock;
+    KCondition * job_done;      /* a worker finished a job */
+    KCondition * job_written;   /* the main-thread has written a job */
+    bool quit;
+} mt_ctx;
+
+
+static bool use_worker_threads( const pileup_options * options )
+{
+    return ( options->threads > 1 &&
+             !options->cmn.no_mt &&
+             options->function == sra_pileup_samtools );
+}
+
+
+/* called by tile_plan_foreach_tile() in the order of the single-threaded walk */
+static rc_t CC mt_add_job( const char * ref_name, uint32_t start, uint32_t end, void * data )
+{
+    rc_t rc = 0;
+    mt_ctx * ctx = data;
+
+    if ( ctx->job_count >= ctx->job_capacity )
+    {
+        uint32_t new_capacity = ( ctx->job_capacity > 0 ) ? ctx->job_capacity * 2 : 64;
+        mt_job * tmp = realloc( ctx->jobs, new_capacity * ( sizeof * tmp ) );
+        if ( tmp == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot create job-list" );
+        }
+        else
+        {
+            ctx->jobs = tmp;
+            ctx->job_capacity = new_capacity;
+        }
+    }
+    if ( rc == 0 )
+    {
+        mt_job * job = &ctx->jobs[ ctx->job_count ];
+        memset( job, 0, sizeof * job );
+        job->ref_name = string_dup_measure( ref_name, NULL );
+        if ( job->ref_name == NULL )
+        {
+            rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+            LOGERR( klogErr, rc, "cannot create job" );
+        }
+        else
+        {
+            job->start = start;
+            job->end = end;
+            ctx->job_count++;
+        }
+    }
+    return rc;
+}
+
+
+static void CC mt_input_whack( void * item, void * data )
+{
+    mt_input * input = item;
+    if ( input != NULL )
+    {
+        free( input->path );
+        free( input->spot_group );
+        free( input );
+    }
+}
+
+
+/* remember the input-file for the workers, then collect its sections */
+static rc_t CC mt_collect_argument( const char * path, const char * spot_group, void * data )
+{
+    foreach_arg_ctx * collect_ctx = data;
+    mt_ctx * ctx = collect_ctx->section_data;
+    rc_t rc = 0;
+    mt_input * input = calloc( 1, sizeof * input );
+    if ( input != NULL )
+    {
+        input->path = string_dup_measure( path, NULL );
+        if ( spot_group != NULL )
+            input->spot_group = string_dup_measure( spot_group, NULL );
+    }
+    if ( input == NULL || input->path == NULL || ( spot_group != NULL && input->spot_group == NULL ) )
+    {
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        LOGERR( klogErr, rc, "cannot store input-file" );
+        mt_input_whack( input, NULL );
+    }
+    else
+    {
+        rc = VectorAppend( &ctx->inputs, NULL, input );
+        if ( rc != 0 )
+        {
+            LOGERR( klogErr, rc, "cannot store input-file" );
+            mt_input_whack( input, NULL );
+        }
+    }
+    if ( rc == 0 )
+        rc = on_argument( path, spot_group, data );
+    return rc;
+}
+
+
+/* instead of adding placements, record the section in the tile-plan */
+static rc_t CC mt_collect_section_cb( prepare_ctx * ctx, const struct reference_range * range )
+{
+    rc_t rc = 0;
+    if ( ctx->db != NULL && ctx->refobj != NULL )
+    {
+        INSDC_coord_len len;
+        rc = ReferenceObj_SeqLength( ctx->refobj, &len );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "ReferenceObj_SeqLength() failed" );
+        }
+        else
+        {
+            const char * ref_name;
+            rc = ReferenceObj_SeqId( ctx->refobj, &ref_name );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "ReferenceObj_SeqId() failed" );
+            }
+            else
+            {
+                mt_ctx * mt = ctx->data;
+                uint32_t start, end;
+                get_section_bounds( len, range, &start, &end );
+                if ( start <= end )
+                    rc = tile_plan_add_section( &mt->plan, ref_name, start, end ); /* pileup_tiles.c */
+            }
+        }
+    }
+    return rc;
+}
+
+
+/* the input-files of one worker, opened once and used for all of its tiles */
+typedef struct mt_worker_inputs
+{
+    prepare_ctx * prep;         /* one per input-file */
+    uint32_t count;
+    Vector cur_ids_vector;      /* the cursor-ids-blocks of prepare_section_cb() */
+} mt_worker_inputs;
+
+
+/* called when the worker takes its first job */
+static rc_t mt_open_inputs( const mt_ctx * ctx, mt_worker_inputs * wi )
+{
+    const pileup_options * options = ctx->arg_ctx->options;
+    uint32_t count = VectorLength( &ctx->inputs );
+    uint32_t idx;
+    rc_t rc = 0;
+
+    VectorInit ( &wi->cur_ids_vector, 0, 20 );
+    wi->count = 0;
+    wi->prep = calloc( count > 0 ? count : 1, sizeof * wi->prep );
+    if ( wi->prep == NULL )
+    {
+        rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+        LOGERR( klogErr, rc, "cannot create input-list of worker" );
+    }
+
+    for ( idx = 0; idx < count && rc == 0; ++idx )
+    {
+        const mt_input * input = VectorGet( &ctx->inputs, idx );
+        prepare_ctx * prep = &wi->prep[ idx ];
+
+        /* as in on_argument(), but the reference-iterator is set per tile */
+        prep->omit_qualities = options->omit_qualities;
+        prep->read_tlen = options->read_tlen;
+        prep->use_primary_alignments = ( ( options->cmn.tab_select & primary_ats ) == primary_ats );
+        prep->use_secondary_alignments = ( ( options->cmn.tab_select & secondary_ats ) == secondary_ats );
+        prep->use_evidence_alignments = ( ( options->cmn.tab_select & evidence_ats ) == evidence_ats );
+        prep->spot_group = input->spot_group;
+        prep->on_section = prepare_section_cb;
+        prep->data = &wi->cur_ids_vector;
+        prep->path = input->path;
+
+        wi->count = idx + 1;    /* opened or not, it is closed by mt_close_inputs() */
+        rc = prepare_open( prep, ctx->arg_ctx->vdb_mgr, ctx->arg_ctx->vdb_schema, input->path ); /* cmdline_cmn.c */
+        if ( rc == 0 && prep->db == NULL )
+        {
+            rc = RC ( rcApp, rcNoTarg, rcOpening, rcSelf, rcInvalid );
+            LOGERR( klogInt, rc, "unsupported source" );
+        }
+    }
+    return rc;
+}
+
+
+static void mt_close_inputs( mt_worker_inputs * wi )
+{
+    uint32_t idx;
+    for ( idx = 0; idx < wi->count; ++idx )
+    {
+        prepare_ctx * prep = &wi->prep[ idx ];
+        if ( prep->prim_cur != NULL ) VCursorRelease( prep->prim_cur );
+        if ( prep->sec_cur != NULL ) VCursorRelease( prep->sec_cur );
+        if ( prep->ev_cur != NULL ) VCursorRelease( prep->ev_cur );
+        prepare_close( prep ); /* cmdline_cmn.c */
+    }
+    free( wi->prep );
+    VectorWhack ( &wi->cur_ids_vector, cur_id_vector_entry_whack, NULL );
+}
+
+
+/* a job loads a reference-iterator of its own with the tile from the inputs of the worker and walks it,
+   the cursors of the inputs are created by the first tile and reused by the following ones */
+static rc_t mt_process_job( mt_ctx * ctx, mt_job * job, const AlignMgr * almgr, mt_worker_inputs * wi )
+{
+    pileup_options options = *( ctx->arg_ctx->options );
+    pileup_callback_data cb_data;
+    ReferenceIterator * ref_iter = NULL;
+    BSTree regions;
+
+    rc_t rc = init_out_buffer( &job->buffer, MT_BUFFER_SIZE ); /* out_buffer.c */
+
+    BSTreeInit( &regions );
+    cb_data.almgr = almgr;
+    cb_data.options = &options;
+    options.tile_start = job->start;
+    options.tile_end = job->end;
+    options.skiplist = NULL;
+
+    if ( rc == 0 )
+    {
+        PlacementRecordExtendFuncs cb_block;
+
+        cb_block.data = &cb_data;
+        cb_block.destroy = NULL;
+        cb_block.populate = populate_tooldata;
+        cb_block.alloc_size = alloc_size;
+        cb_block.fixed_size = 0;
+
+        rc = AlignMgrMakeReferenceIterator ( almgr, &ref_iter, &cb_block, options.minmapq );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "AlignMgrMakeReferenceIterator() failed" );
+        }
+    }
+
+    if ( rc == 0 )
+        rc = add_region( &regions, job->ref_name, job->start, job->end ); /* ref_regions.c */
+
+    if ( rc == 0 )
+    {
+        uint32_t idx;
+        options.skiplist = skiplist_make( ctx->regions ); /* ref_regions.c */
+        for ( idx = 0; idx < wi->count && rc == 0; ++idx )
+        {
+            wi->prep[ idx ].ref_iter = ref_iter;
+            rc = prepare_sections( &wi->prep[ idx ], &regions ); /* cmdline_cmn.c */
+            wi->prep[ idx ].ref_iter = NULL;
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        attach_out_buffer( &job->buffer ); /* out_buffer.c */
+        rc = walk_ref_iter( ref_iter, &options );
+        attach_out_buffer( NULL );
+    }
+
+    if ( options.skiplist != NULL ) skiplist_release( options.skiplist );
+    if ( ref_iter != NULL ) ReferenceIteratorRelease( ref_iter );
+    free_ref_regions( &regions );
+    return rc;
+}
+
+
+static rc_t CC mt_worker( const KThread * self, void * data )
+{
+    mt_ctx * ctx = data;
+    const AlignMgr * almgr = NULL;
+    mt_worker_inputs inputs;
+
+    rc_t rc = AlignMgrMakeRead ( &almgr );
+    if ( rc != 0 )
+    {
+        LOGERR( klogInt, rc, "AlignMgrMake() failed" );
+    }
+
+    memset( &inputs, 0, sizeof inputs );
+
+    while ( rc == 0 )
+    {
+        mt_job * job = NULL;
+
+        KLockAcquire( ctx->lock );
+        while ( !ctx->quit &&
+                ctx->next_job < ctx->job_count &&
+                ctx->next_job >= ctx->next_out + ctx->max_ahead )
+        {
+            KConditionWait( ctx->job_written, ctx->lock );
+        }
+        if ( !ctx->quit && ctx->next_job < ctx->job_count )
+            job = &ctx->jobs[ ctx->next_job++ ];
+        KLockUnlock( ctx->lock );
+
+        if ( job == NULL )
+            break;
+
+        /* a worker that does not get a job does not open the input-files */
+        if ( inputs.prep == NULL )
+            rc = mt_open_inputs( ctx, &inputs );
+        if ( rc == 0 )
+            rc = mt_process_job( ctx, job, almgr, &inputs );
+
+        KLockAcquire( ctx->lock );
+        job->rc = rc;
+        job->done = true;
+        KConditionBroadcast( ctx->job_done );
+        KLockUnlock( ctx->lock );
+    }
+
+    if ( rc != 0 )
+    {
+        KLockAcquire( ctx->lock );
+        ctx->quit = true;
+        KConditionBroadcast( ctx->job_done );
+        KConditionBroadcast( ctx->job_written );
+        KLockUnlock( ctx->lock );
+    }
+
+    if ( almgr != NULL ) AlignMgrRelease ( almgr );
+    mt_close_inputs( &inputs );
+    return rc;
+}
+
+
+/* the main-thread writes the output of the jobs in order */
+static rc_t mt_write_jobs( mt_ctx * ctx, const out_buffer_redir * redir )
+{
+    rc_t rc = 0;
+    uint32_t idx;
+    for ( idx = 0; idx < ctx->job_count && rc == 0; ++idx )
+    {
+        mt_job * job = &ctx->jobs[ idx ];
+        bool done;
+
+        KLockAcquire( ctx->lock );
+        while ( !job->done && !ctx->quit )
+            KConditionWait( ctx->job_done, ctx->lock );
+        done = job->done;
+        if ( !done )
+            rc = RC( rcApp, rcNoTarg, rcProcessing, rcThread, rcCanceled );
+        else
+            rc = job->rc;
+        KLockUnlock( ctx->lock );
+
+        if ( rc == 0 )
+            rc = flush_out_buffer( redir, &job->buffer ); /* out_buffer.c */
+        /* a worker may still print into the buffer of a job that is not done,
+           it is released after the workers have been joined */
+        if ( done )
+            release_out_buffer( &job->buffer );
+
+        KLockAcquire( ctx->lock );
+        ctx->next_out = idx + 1;
+        if ( rc != 0 )
+            ctx->quit = true;
+        KConditionBroadcast( ctx->job_written );
+        KLockUnlock( ctx->lock );
+    }
+    return rc;
+}
+
+
+static rc_t pileup_mt( Args * args, KDirectory * dir, const foreach_arg_ctx * arg_ctx,
+                       BSTree * regions, bool * empty )
+{
+    mt_ctx ctx;
+    foreach_arg_ctx collect_ctx = *arg_ctx;
+    rc_t rc;
+
+    memset( &ctx, 0, sizeof ctx );
+    ctx.arg_ctx = arg_ctx;
+    VectorInit ( &ctx.inputs, 0, 4 );
+    ctx.regions = regions;
+    ctx.max_ahead = arg_ctx->options->threads * 2;
+    init_tile_plan( &ctx.plan ); /* pileup_tiles.c */
+
+    /* (1) walk the input-files to collect the sections, cut them into tiles in walk-order */
+    collect_ctx.on_section = mt_collect_section_cb;
+    collect_ctx.section_data = &ctx;
+    rc = foreach_argument( args, dir, arg_ctx->options->div_by_spotgrp, empty, mt_collect_argument, &collect_ctx ); /* cmdline_cmn.c */
+    if ( rc == 0 )
+        rc = tile_plan_foreach_tile( &ctx.plan, MT_TILE_LEN, mt_add_job, &ctx ); /* pileup_tiles.c */
+    release_tile_plan( &ctx.plan );
+
+    if ( rc == 0 && ctx.job_count > 0 )
+    {
+        rc = KLockMake( &ctx.lock );
+        if ( rc != 0 )
+        {
+            LOGERR( klogInt, rc, "KLockMake() failed" );
+        }
+        else
+        {
+            rc = KConditionMake( &ctx.job_done );
+            if ( rc != 0 )
+            {
+                LOGERR( klogInt, rc, "KConditionMake() failed" );
+            }
+            else
+            {
+                rc = KConditionMake( &ctx.job_written );
+                if ( rc != 0 )
+                {
+                    LOGERR( klogInt, rc, "KConditionMake() failed" );
+                }
+            }
+        }
+    }
+
+    /* (2) process the tiles on the worker-threads, write their output in order */
+    if ( rc == 0 && ctx.job_count > 0 )
+    {
+        out_buffer_redir redir; /* from out_buffer.h */
+        rc = init_out_buffer_redir( &redir ); /* out_buffer.c */
+        if ( rc == 0 )
+        {
+            uint32_t thread_count = arg_ctx->options->threads;
+            KThread ** threads;
+
+            if ( thread_count > ctx.job_count )
+                thread_count = ctx.job_count;
+            threads = calloc( thread_count, sizeof * threads );
+            if ( threads == NULL )
+            {
+                rc = RC( rcApp, rcNoTarg, rcConstructing, rcMemory, rcExhausted );
+                LOGERR( klogErr, rc, "cannot create thread-array" );
+            }
+            else
+            {
+                uint32_t idx;
+                for ( idx = 0; idx < thread_count && rc == 0; ++idx )
+                {
+                    rc = KThreadMake( &threads[ idx ], mt_worker, &ctx );
+                    if ( rc != 0 )
+                    {
+                        LOGERR( klogInt, rc, "KThreadMake() failed" );
+                    }
+                }
+
+                if ( rc == 0 )
+                    rc = mt_write_jobs( &ctx, &redir );
+
+                if ( rc != 0 )
+                {
+                    KLockAcquire( ctx.lock );
+                    ctx.quit = true;
+                    KConditionBroadcast( ctx.job_written );
+                    KLockUnlock( ctx.lock );
+                }
+
+                for ( idx = 0; idx < thread_count; ++idx )
+                {
+                    if ( threads[ idx ] != NULL )
+                    {
+                        rc_t rc_thread = 0;
+                        KThreadWait( threads[ idx ], &rc_thread );
+                        KThreadRelease( threads[ idx ] );
+                        /* the main-thread only saw that the workers quit, report why */
+                        if ( rc_thread != 0 && GetRCState( rc ) == rcCanceled )
+                            rc = rc_thread;
+                    }
+                }
+                free( threads );
+            }
+            release_out_buffer_redir( &redir ); /* out_buffer.c */
+        }
+    }
+
+    if ( ctx.jobs != NULL )
+    {
+        /* the jobs not written because of an error */
+        uint32_t idx;
+        for ( idx = 0; idx < ctx.job_count; ++idx )
+        {
+            release_out_buffer( &ctx.jobs[ idx ].buffer );
+            free( ctx.jobs[ idx ].ref_name );
+        }
+        free( ctx.jobs );
+    }
+    VectorWhack ( &ctx.inputs, mt_input_whack, NULL );
+    if ( ctx.job_written != NULL ) KConditionRelease( ctx.job_written );
+    if ( ctx.job_done != NULL ) KConditionRelease( ctx.job_done );
+    if ( ctx.lock != NULL ) KLockRelease( ctx.lock );
+    return rc;
+}
+
+
 static rc_t pileup_main( Args * args, pileup_options *options )
 {
     foreach_arg_ctx arg_ctx;
     pileup_callback_data cb_data;
     KDirectory * dir = NULL;
     Vector cur_ids_vector;
+    bool walked = false;    /* the worker-threads have already performed the pileup */
 
     /* (1) make the align-manager ( necessary to make a ReferenceIterator... ) */
     rc_t rc = AlignMgrMakeRead ( &cb_data.almgr );
@@ -1384,7 +1992,8 @@ static rc_t pileup_main( Args * args, pileup_options *options )
     cb_data.options = options;
     arg_ctx.options = options;
     arg_ctx.vdb_schema = NULL;
-    arg_ctx.cursor_ids = &cur_ids_vector;
+    arg_ctx.on_section = prepare_section_cb;
+    arg_ctx.section_data = &cur_ids_vector;
 
     /* (2) make the reference-iterator */
     if ( rc == 0 )
@@ -1460,7 +2069,7 @@ static rc_t pileup_main( Args * args, pileup_options *options )
     {
         switch( options->function )
         {
-            case sra_pileup_counters    : options->omit_qualities = true;
+            case sra_pileup_counters    : options->omit_qualities = ( options->min_base_qual == 0 );
                                           options->read_tlen = false;
                                           break;
 
@@ -1475,7 +2084,7 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             case sra_pileup_samtools    : options->read_tlen = false;
                                           break;
                                           
-            case sra_pileup_mismatch    : options->omit_qualities = true;
+            case sra_pileup_mismatch    : options->omit_qualities = ( options->min_base_qual == 0 );
                                           options->read_tlen = false;
                                           break;
 
@@ -1486,6 +2095,10 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             case sra_pileup_varcount   : options->omit_qualities = true;
                                           options->read_tlen = false;
                                           break;
+
+            case sra_pileup_columnar   : options->omit_qualities = ( options->min_base_qual == 0 );
+                                          options->read_tlen = false;
+                                          break;
         }
     }
 
@@ -1502,7 +2115,13 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             options->skiplist = skiplist_make( &regions ); /* create skiplist for neighboring slices */
 
             arg_ctx.ranges = &regions;
-            rc = foreach_argument( args, dir, options->div_by_spotgrp, &empty, on_argument, &arg_ctx ); /* cmdline_cmn.c */
+            if ( use_worker_threads( options ) )
+            {
+                rc = pileup_mt( args, dir, &arg_ctx, &regions, &empty );
+                walked = true;
+            }
+            else
+                rc = foreach_argument( args, dir, options->div_by_spotgrp, &empty, on_argument, &arg_ctx ); /* cmdline_cmn.c */
             if ( empty )
             {
                 Usage ( args );
@@ -1513,7 +2132,7 @@ static rc_t pileup_main( Args * args, pileup_options *options )
     }
 
     /* (6) walk the "loaded" ref-iterator ===> perform the pileup */
-    if ( rc == 0 )
+    if ( rc == 0 && !walked )
     {
         /* ============================================== */
         switch( options->function )
@@ -1525,6 +2144,7 @@ static rc_t pileup_main( Args * args, pileup_options *options )
             case sra_pileup_index       : rc = walk_index( arg_ctx.ref_iter, options ); break;
             case sra_pileup_varcount    : rc = walk_varcount( arg_ctx.ref_iter, options ); break;
 			case sra_pileup_indels      : rc = walk_indels( arg_ctx.ref_iter, options ); break;
+            case sra_pileup_columnar    : rc = walk_columnar( arg_ctx.ref_iter, options ); break;
             default :  rc = walk_ref_iter( arg_ctx.ref_iter, options ); break;
         }
         /* ============================================== */
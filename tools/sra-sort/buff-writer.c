@@ -119,6 +119,18 @@ void BufferedPairColWriterWhack ( BufferedPairColWriter *self, const ctx_t *ctx
     MemFree ( ctx, self, sizeof * self );
 }
 
+/* RowSetIterator
+ *  the iterator bound to this column for the current copy,
+ *  or the one last handed out by the table when unbound
+ */
+static
+const RowSetIterator *BufferedPairColWriterRowSetIterator ( const BufferedPairColWriter *self )
+{
+    if ( self -> dad . rsi != NULL )
+        return self -> dad . rsi;
+    return self -> tbl -> rsi;
+}
+
 static
 const char *BufferedPairColWriterFullSpec ( const BufferedPairColWriter *self, const ctx_t *ctx )
 {
@@ -275,7 +287,7 @@ void BufferedPairColWriterWriteMapped ( BufferedPairColWriter *self, const ctx_t
     {
         /* get map and content length from table */
         assert ( self -> idx != NULL );
-        ON_FAIL ( self -> u . map = RowSetIteratorGetIdxMapping ( self -> tbl -> rsi, ctx, & self -> num_items ) )
+        ON_FAIL ( self -> u . map = RowSetIteratorGetIdxMapping ( BufferedPairColWriterRowSetIterator ( self ), ctx, & self -> num_items ) )
         {
             ANNOTATE ( "failed to get ( old_id, new_id ) map for column '%s'", ColumnWriterFullSpec ( self -> cw, ctx ) );
             return;
@@ -452,7 +464,7 @@ void BufferedPairColWriterWriteUnmapped ( BufferedPairColWriter *self, const ctx
     {
         /* get ids, ord and content length from table */
         assert ( self -> idx == NULL );
-        ON_FAIL ( self -> u . ids = RowSetIteratorGetSourceIds ( self -> tbl -> rsi, ctx, & self -> ord, & self -> num_items ) )
+        ON_FAIL ( self -> u . ids = RowSetIteratorGetSourceIds ( BufferedPairColWriterRowSetIterator ( self ), ctx, & self -> ord, & self -> num_items ) )
         {
             ANNOTATE ( "failed to get old_id, ord maps for column '%s'", ColumnWriterFullSpec ( self -> cw, ctx ) );
             return;
@@ -82,6 +82,8 @@ void CapsInit ( Caps *caps, const ctx_t *ctx )
                         else
                         {
                             caps -> tool = orig -> tool;
+                            caps -> ckpt = orig -> ckpt;
+                            caps -> num_threads = orig -> num_threads;
                         }
                     }
                 }
@@ -102,6 +104,7 @@ void CapsWhack ( Caps *self, const ctx_t *ctx )
         MemBank *mem;
 
         self -> tool = NULL;
+        self -> ckpt = NULL;
 
         rc = VDBManagerRelease ( self -> vdb );
         if ( rc != 0 )
@@ -39,6 +39,7 @@ struct KConfig;
 struct KDBManager;
 struct VDBManager;
 struct Tool;
+struct Checkpoint;
 
 
 /*--------------------------------------------------------------------------
@@ -53,6 +54,13 @@ struct Caps
     struct KDBManager *kdb;
     struct VDBManager *vdb;
     struct Tool const *tool;
+
+    /* borrowed, NULL unless resuming */
+    struct Checkpoint *ckpt;
+
+    /* threads available to nested work such as sorting,
+       or 0 to use the tool setting */
+    uint32_t num_threads;
 };
 
 
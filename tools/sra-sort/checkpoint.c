@@ -0,0 +1,798 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#include "checkpoint.h"
+#include "ctx.h"
+#include "caps.h"
+#include "mem.h"
+#include "except.h"
+#include "status.h"
+#include "sra-sort.h"
+
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <klib/vector.h>
+#include <klib/printf.h>
+#include <klib/text.h>
+#include <klib/rc.h>
+
+#include <string.h>
+
+#if ! WINDOWS
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#if LINUX
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
+
+FILE_ENTRY ( checkpoint );
+
+
+/*--------------------------------------------------------------------------
+ * Checkpoint
+ *  a manifest of work committed to the destination object
+ *
+ *  the manifest is a text file of newline terminated records:
+ *    source <src-path>
+ *    stamp <src-mtime> <src-size>
+ *    column <tbl-spec>.<column-name>
+ *    map <map-name> <header>
+ *  appended and synced as work is committed. a record without
+ *  its newline was cut short by a dying process and is discarded
+ *  on load. the stamp is "-" when the source is not a local path.
+ *
+ *  the files a record describes are synced before the record is
+ *  written. the header of an id map is opaque here, see map-file.c
+ */
+#define CKPT_SOURCE "source "
+#define CKPT_STAMP "stamp "
+#define CKPT_COLUMN "column "
+#define CKPT_MAP "map "
+
+struct Checkpoint
+{
+    KDirectory *wd;
+    KFile *f;
+    uint64_t eof;
+
+    /* descriptor used only to sync the manifest */
+    int fd;
+
+    /* keys of committed columns */
+    Vector done;
+
+    /* "<map-name> <header>" of completed id maps */
+    Vector maps;
+
+    /* id map files handed out by MapPath */
+    Vector map_files;
+
+    /* id maps are kept in "tmpdir" only if it survives a reboot,
+       under names tagged with a hash of the manifest path */
+    bool durable_maps;
+    uint32_t map_tag;
+
+    char path [ 4096 ];
+    char tmpdir [ 4096 ];
+};
+
+
+/* MakeKey
+ *  "<tbl-spec>.<column-name>", without any typecast
+ */
+static
+bool CheckpointMakeKey ( char *key, size_t bsize, const char *tbl_spec, const char *colspec )
+{
+    const char *name = strrchr ( colspec, ')' );
+    if ( name ++ == NULL )
+        name = colspec;
+
+    return string_printf ( key, bsize, NULL, "%s.%s", tbl_spec, name ) == 0;
+}
+
+
+/* HasKey
+ */
+static
+bool CheckpointHasKey ( const Vector *keys, const char *key )
+{
+    uint32_t i, count = VectorLength ( keys );
+    for ( i = 0; i < count; ++ i )
+    {
+        if ( strcmp ( VectorGet ( keys, i ), key ) == 0 )
+            return true;
+    }
+    return false;
+}
+
+
+/* AddKey
+ */
+static
+void CheckpointAddKey ( Vector *keys, const ctx_t *ctx, const char *key )
+{
+    FUNC_ENTRY ( ctx );
+
+    char *copy;
+    size_t size = string_size ( key );
+
+    TRY ( copy = MemAlloc ( ctx, size + 1, false ) )
+    {
+        rc_t rc;
+
+        memcpy ( copy, key, size + 1 );
+        rc = VectorAppend ( keys, NULL, copy );
+        if ( rc != 0 )
+        {
+            SYSTEM_ERROR ( rc, "failed to record checkpoint for '%s'", key );
+            MemFree ( ctx, copy, size + 1 );
+        }
+    }
+}
+
+
+/* WhackKey
+ */
+static
+void CC CheckpointWhackKey ( void *item, void *data )
+{
+    const ctx_t *ctx = ( const void* ) data;
+    FUNC_ENTRY ( ctx );
+    MemFree ( ctx, item, string_size ( item ) + 1 );
+}
+
+
+/* Append
+ *  write a single record at end of manifest
+ */
+static
+void CheckpointAppend ( Checkpoint *self, const ctx_t *ctx, const char *tag, const char *value )
+{
+    FUNC_ENTRY ( ctx );
+
+    char line [ 4096 + 64 ];
+    size_t size, num_writ;
+
+    rc_t rc = string_printf ( line, sizeof line, & size, "%s%s\n", tag, value );
+    if ( rc != 0 )
+        INTERNAL_ERROR ( rc, "checkpoint record for '%s' is too long", value );
+    else
+    {
+        rc = KFileWriteAll ( self -> f, self -> eof, line, size, & num_writ );
+        if ( rc == 0 && num_writ != size )
+            rc = RC ( rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete );
+        if ( rc != 0 )
+            SYSTEM_ERROR ( rc, "failed to write checkpoint manifest '%s'", self -> path );
+        else
+        {
+#if ! WINDOWS
+            /* a record must reach the disk before the work it
+               describes is relied upon by a later run */
+            if ( self -> fd >= 0 && fsync ( self -> fd ) != 0 )
+            {
+                rc = RC ( rcExe, rcFile, rcCommitting, rcFile, rcFailed );
+                SYSTEM_ERROR ( rc, "failed to sync checkpoint manifest '%s'", self -> path );
+                return;
+            }
+#endif
+            self -> eof += size;
+        }
+    }
+}
+
+
+/* MakeStamp
+ *  identify the source by modification time and size,
+ *  so that a manifest is not reused after it has been replaced
+ */
+static
+void CheckpointMakeStamp ( const Checkpoint *self, const ctx_t *ctx,
+    char *stamp, size_t bsize, const char *src_path )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    KTime_t mtime;
+    uint64_t size = 0;
+
+    switch ( KDirectoryPathType ( self -> wd, "%s", src_path ) & ~ kptAlias )
+    {
+    case kptFile:
+        rc = KDirectoryFileSize ( self -> wd, & size, "%s", src_path );
+        if ( rc != 0 )
+        {
+            SYSTEM_ERROR ( rc, "failed to size source '%s'", src_path );
+            return;
+        }
+        /* no break */
+    case kptDir:
+        rc = KDirectoryDate ( self -> wd, & mtime, "%s", src_path );
+        if ( rc != 0 )
+            SYSTEM_ERROR ( rc, "failed to date source '%s'", src_path );
+        else
+        {
+            rc = string_printf ( stamp, bsize, NULL, "%ld %lu", ( long ) mtime, size );
+            if ( rc != 0 )
+                INTERNAL_ERROR ( rc, "failed to format stamp for source '%s'", src_path );
+        }
+        break;
+    default:
+        /* an accession, resolved elsewhere */
+        string_copy_measure ( stamp, bsize, "-" );
+    }
+}
+
+
+/* Hash
+ *  FNV-1a, tags the id maps of one manifest
+ */
+static
+uint32_t CheckpointHash ( const char *str )
+{
+    uint32_t h = 2166136261U;
+    for ( ; * str != 0; ++ str )
+    {
+        h ^= ( uint8_t ) * str;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+
+/* InitMaps
+ *  id maps are kept beside the other temporary files,
+ *  unless those are lost on a reboot along with the work
+ *  the manifest describes. a missing directory counts as lost
+ */
+static
+void CheckpointInitMaps ( Checkpoint *self, const ctx_t *ctx )
+{
+    FUNC_ENTRY ( ctx );
+
+    const char *tmpdir = ctx -> caps -> tool -> tmpdir;
+    rc_t rc = KDirectoryResolvePath ( self -> wd, true, self -> tmpdir, sizeof self -> tmpdir, "%s", tmpdir );
+    if ( rc == 0 )
+    {
+#if LINUX
+        struct statfs st;
+        if ( statfs ( self -> tmpdir, & st ) == 0 &&
+             st . f_type != TMPFS_MAGIC && st . f_type != RAMFS_MAGIC )
+        {
+            self -> durable_maps = true;
+        }
+#endif
+    }
+
+    if ( self -> durable_maps )
+        STATUS ( 2, "keeping id maps in '%s' for a resume", self -> tmpdir );
+    else
+        STATUS ( 2, "id maps in '%s' are rebuilt on a resume", tmpdir );
+}
+
+
+/* SyncPath
+ *  push a file or directory entry to the disk, and with "recurse"
+ *  everything below a directory first
+ */
+static
+rc_t CheckpointSyncPath ( const char *native, bool recurse )
+{
+    rc_t rc = 0;
+#if ! WINDOWS
+    int fd;
+    struct stat st;
+
+    if ( lstat ( native, & st ) != 0 )
+        return RC ( rcExe, rcPath, rcCommitting, rcPath, rcNotFound );
+    if ( S_ISLNK ( st . st_mode ) )
+        return 0;
+
+    if ( recurse && S_ISDIR ( st . st_mode ) )
+    {
+        DIR *dir = opendir ( native );
+        if ( dir == NULL )
+            return RC ( rcExe, rcDirectory, rcCommitting, rcDirectory, rcUnauthorized );
+        else
+        {
+            struct dirent *ent;
+            while ( rc == 0 && ( ent = readdir ( dir ) ) != NULL )
+            {
+                char path [ 4096 ];
+                if ( strcmp ( ent -> d_name, "." ) == 0 || strcmp ( ent -> d_name, ".." ) == 0 )
+                    continue;
+                rc = string_printf ( path, sizeof path, NULL, "%s/%s", native, ent -> d_name );
+                if ( rc == 0 )
+                    rc = CheckpointSyncPath ( path, true );
+            }
+            closedir ( dir );
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        fd = open ( native, O_RDONLY );
+        if ( fd < 0 )
+            rc = RC ( rcExe, rcFile, rcCommitting, rcFile, rcUnauthorized );
+        else
+        {
+            if ( fsync ( fd ) != 0 )
+                rc = RC ( rcExe, rcFile, rcCommitting, rcFile, rcFailed );
+            close ( fd );
+        }
+    }
+#endif
+    return rc;
+}
+
+
+/* SyncColumn
+ *  the files of a column, and its entry in the table, reach the disk
+ *  before its record does. a column stored under another physical
+ *  name is not found by name: then the whole table is synced
+ */
+void CheckpointSyncColumn ( const Checkpoint *self, const ctx_t *ctx,
+    const KDirectory *tbl_dir, const char *colspec )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    char native [ 4096 ];
+    bool by_name;
+
+    if ( self == NULL )
+        return;
+
+    const char *name = strrchr ( colspec, ')' );
+    if ( name ++ == NULL )
+        name = colspec;
+
+    by_name = ( KDirectoryPathType ( tbl_dir, "col/%s", name ) & ~ kptAlias ) == kptDir;
+    if ( by_name )
+        rc = KDirectoryResolvePath ( tbl_dir, true, native, sizeof native, "col/%s", name );
+    else
+        rc = KDirectoryResolvePath ( tbl_dir, true, native, sizeof native, "." );
+    if ( rc != 0 )
+        SYSTEM_ERROR ( rc, "failed to locate the files of column '%s'", name );
+    else
+    {
+        rc = CheckpointSyncPath ( native, true );
+        if ( rc == 0 && by_name )
+        {
+            rc = KDirectoryResolvePath ( tbl_dir, true, native, sizeof native, "col" );
+            if ( rc == 0 )
+                rc = CheckpointSyncPath ( native, false );
+        }
+        if ( rc != 0 )
+            SYSTEM_ERROR ( rc, "failed to sync '%s' for checkpoint manifest '%s'", native, self -> path );
+    }
+}
+
+
+/* SyncMap
+ *  the files of id map "name" handed out by MapPath,
+ *  and their entries in the temporary directory
+ */
+static
+void CheckpointSyncMap ( const Checkpoint *self, const ctx_t *ctx, const char *name )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    char prefix [ 4096 ];
+    size_t prefix_size;
+
+    rc = string_printf ( prefix, sizeof prefix, & prefix_size, "%s/sra-sort-%s.", self -> tmpdir, name );
+    if ( rc != 0 )
+        INTERNAL_ERROR ( rc, "id map name '%s' is too long to checkpoint", name );
+    else
+    {
+        uint32_t i, count = VectorLength ( & self -> map_files );
+        for ( i = 0; rc == 0 && i < count; ++ i )
+        {
+            const char *map_path = VectorGet ( & self -> map_files, i );
+            if ( strncmp ( map_path, prefix, prefix_size ) == 0 )
+            {
+                rc = CheckpointSyncPath ( map_path, false );
+                if ( rc != 0 )
+                    SYSTEM_ERROR ( rc, "failed to sync id map file '%s'", map_path );
+            }
+        }
+
+        if ( rc == 0 )
+        {
+            rc = CheckpointSyncPath ( self -> tmpdir, false );
+            if ( rc != 0 )
+                SYSTEM_ERROR ( rc, "failed to sync temporary directory '%s'", self -> tmpdir );
+        }
+    }
+}
+
+
+/* Load
+ *  read records left by an earlier run
+ *  or tag a new manifest with its source
+ */
+static
+void CheckpointLoad ( Checkpoint *self, const ctx_t *ctx, const char *src_path )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    char stamp [ 128 ];
+
+    ON_FAIL ( CheckpointMakeStamp ( self, ctx, stamp, sizeof stamp, src_path ) )
+        return;
+
+    rc = KFileSize ( self -> f, & self -> eof );
+    if ( rc != 0 )
+        SYSTEM_ERROR ( rc, "failed to size checkpoint manifest '%s'", self -> path );
+    else if ( self -> eof == 0 )
+    {
+        TRY ( CheckpointAppend ( self, ctx, CKPT_SOURCE, src_path ) )
+        {
+            CheckpointAppend ( self, ctx, CKPT_STAMP, stamp );
+        }
+    }
+    else
+    {
+        char *text;
+        size_t size = ( size_t ) self -> eof;
+
+        TRY ( text = MemAlloc ( ctx, size + 1, false ) )
+        {
+            size_t num_read;
+            rc = KFileReadAll ( self -> f, 0, text, size, & num_read );
+            if ( rc != 0 )
+                SYSTEM_ERROR ( rc, "failed to read checkpoint manifest '%s'", self -> path );
+            else
+            {
+                char *line, *end;
+                bool stamped = false;
+
+                text [ num_read ] = 0;
+                for ( line = text; ! FAILED () && ( end = strchr ( line, '\n' ) ) != NULL; line = end + 1 )
+                {
+                    * end = 0;
+                    if ( strncmp ( line, CKPT_SOURCE, sizeof CKPT_SOURCE - 1 ) == 0 )
+                    {
+                        line += sizeof CKPT_SOURCE - 1;
+                        if ( strcmp ( line, src_path ) != 0 )
+                        {
+                            rc = RC ( rcExe, rcFile, rcValidating, rcData, rcInconsistent );
+                            ERROR ( rc, "checkpoint manifest '%s' was written for source '%s'", self -> path, line );
+                        }
+                    }
+                    else if ( strncmp ( line, CKPT_STAMP, sizeof CKPT_STAMP - 1 ) == 0 )
+                    {
+                        line += sizeof CKPT_STAMP - 1;
+                        if ( strcmp ( line, stamp ) != 0 )
+                        {
+                            rc = RC ( rcExe, rcFile, rcValidating, rcData, rcInconsistent );
+                            ERROR ( rc, "source '%s' has changed since checkpoint manifest '%s' was written", src_path, self -> path );
+                        }
+                        stamped = true;
+                    }
+                    else if ( strncmp ( line, CKPT_COLUMN, sizeof CKPT_COLUMN - 1 ) == 0 )
+                    {
+                        CheckpointAddKey ( & self -> done, ctx, line + sizeof CKPT_COLUMN - 1 );
+                    }
+                    else if ( strncmp ( line, CKPT_MAP, sizeof CKPT_MAP - 1 ) == 0 )
+                    {
+                        CheckpointAddKey ( & self -> maps, ctx, line + sizeof CKPT_MAP - 1 );
+                    }
+                }
+
+                if ( ! FAILED () && ! stamped )
+                {
+                    rc = RC ( rcExe, rcFile, rcValidating, rcData, rcIncomplete );
+                    ERROR ( rc, "checkpoint manifest '%s' does not identify its source", self -> path );
+                }
+
+                /* drop any partial record so appends start clean */
+                if ( ! FAILED () && ( uint64_t ) ( line - text ) != self -> eof )
+                {
+                    self -> eof = line - text;
+                    rc = KFileSetSize ( self -> f, self -> eof );
+                    if ( rc != 0 )
+                        SYSTEM_ERROR ( rc, "failed to truncate checkpoint manifest '%s'", self -> path );
+                }
+
+                if ( ! FAILED () )
+                    STATUS ( 1, "resuming with %u columns already committed", VectorLength ( & self -> done ) );
+            }
+
+            MemFree ( ctx, text, size + 1 );
+        }
+    }
+}
+
+
+/* Make
+ *  opens the manifest for "dst_path", loading any records
+ *  left by an earlier run on the same source
+ */
+Checkpoint *CheckpointMake ( const ctx_t *ctx, const char *src_path, const char *dst_path )
+{
+    FUNC_ENTRY ( ctx );
+
+    Checkpoint *ckpt;
+
+    TRY ( ckpt = MemAlloc ( ctx, sizeof * ckpt, true ) )
+    {
+        rc_t rc = string_printf ( ckpt -> path, sizeof ckpt -> path, NULL, "%s.sra-sort-ckpt", dst_path );
+        if ( rc != 0 )
+            ERROR ( rc, "destination path '%s' is too long to checkpoint", dst_path );
+        else
+        {
+            rc = KDirectoryNativeDir ( & ckpt -> wd );
+            if ( rc != 0 )
+                SYSTEM_ERROR ( rc, "KDirectoryNativeDir failed" );
+            else
+            {
+                rc = KDirectoryCreateFile ( ckpt -> wd, & ckpt -> f, true,
+                    0664, kcmOpen | kcmParents, "%s", ckpt -> path );
+                if ( rc != 0 )
+                    SYSTEM_ERROR ( rc, "failed to open checkpoint manifest '%s'", ckpt -> path );
+                else
+                {
+                    ckpt -> fd = -1;
+#if ! WINDOWS
+                    {
+                        char native [ 4096 ];
+                        rc = KDirectoryResolvePath ( ckpt -> wd, true, native, sizeof native, "%s", ckpt -> path );
+                        if ( rc == 0 )
+                        {
+                            ckpt -> fd = open ( native, O_WRONLY );
+                            ckpt -> map_tag = CheckpointHash ( native );
+                        }
+                        if ( ckpt -> fd < 0 )
+                            WARN ( "checkpoint manifest '%s' cannot be synced", ckpt -> path );
+                        else
+                            CheckpointInitMaps ( ckpt, ctx );
+                    }
+#endif
+                    VectorInit ( & ckpt -> done, 0, 64 );
+                    VectorInit ( & ckpt -> maps, 0, 4 );
+                    VectorInit ( & ckpt -> map_files, 0, 16 );
+
+                    STATUS ( 2, "using checkpoint manifest '%s'", ckpt -> path );
+                    TRY ( CheckpointLoad ( ckpt, ctx, src_path ) )
+                    {
+                        return ckpt;
+                    }
+
+                    VectorWhack ( & ckpt -> done, CheckpointWhackKey, ( void* ) ctx );
+                    VectorWhack ( & ckpt -> maps, CheckpointWhackKey, ( void* ) ctx );
+                    VectorWhack ( & ckpt -> map_files, CheckpointWhackKey, ( void* ) ctx );
+#if ! WINDOWS
+                    if ( ckpt -> fd >= 0 )
+                        close ( ckpt -> fd );
+#endif
+                    KFileRelease ( ckpt -> f );
+                }
+
+                KDirectoryRelease ( ckpt -> wd );
+            }
+        }
+
+        MemFree ( ctx, ckpt, sizeof * ckpt );
+    }
+
+    return NULL;
+}
+
+
+/* Release
+ *  closes the manifest
+ *  removes it if "complete" is true
+ */
+void CheckpointRelease ( Checkpoint *self, const ctx_t *ctx, bool complete )
+{
+    FUNC_ENTRY ( ctx );
+
+    if ( self != NULL )
+    {
+        rc_t rc;
+        uint32_t i;
+
+        /* the id maps are only worth keeping while the manifest is */
+        if ( complete )
+        {
+            for ( i = 0; i < VectorLength ( & self -> map_files ); ++ i )
+            {
+                const char *map_path = VectorGet ( & self -> map_files, i );
+                rc = KDirectoryRemove ( self -> wd, false, "%s", map_path );
+                if ( rc != 0 && GetRCState ( rc ) != rcNotFound )
+                    WARN ( "failed to remove id map file '%s'", map_path );
+            }
+        }
+
+        VectorWhack ( & self -> done, CheckpointWhackKey, ( void* ) ctx );
+        VectorWhack ( & self -> maps, CheckpointWhackKey, ( void* ) ctx );
+        VectorWhack ( & self -> map_files, CheckpointWhackKey, ( void* ) ctx );
+
+#if ! WINDOWS
+        if ( self -> fd >= 0 )
+            close ( self -> fd );
+#endif
+        rc = KFileRelease ( self -> f );
+        if ( rc != 0 )
+            WARN ( "KFileRelease failed on checkpoint manifest '%s'", self -> path );
+        else if ( complete )
+        {
+            STATUS ( 2, "removing checkpoint manifest '%s'", self -> path );
+            rc = KDirectoryRemove ( self -> wd, false, "%s", self -> path );
+            if ( rc != 0 )
+                WARN ( "failed to remove checkpoint manifest '%s'", self -> path );
+        }
+
+        KDirectoryRelease ( self -> wd );
+        MemFree ( ctx, self, sizeof * self );
+    }
+}
+
+
+/* ColumnDone
+ *  true if column "colspec" of table "tbl_spec" was committed
+ *  by an earlier run. any typecast on "colspec" is ignored.
+ */
+bool CheckpointColumnDone ( const Checkpoint *self, const ctx_t *ctx,
+    const char *tbl_spec, const char *colspec )
+{
+    char key [ 4096 ];
+
+    if ( self == NULL )
+        return false;
+
+    if ( ! CheckpointMakeKey ( key, sizeof key, tbl_spec, colspec ) )
+        return false;
+
+    return CheckpointHasKey ( & self -> done, key );
+}
+
+
+/* RecordColumn
+ *  append a record for a column whose writer has been
+ *  committed and released, and whose files have been synced
+ */
+void CheckpointRecordColumn ( Checkpoint *self, const ctx_t *ctx,
+    const char *tbl_spec, const char *colspec )
+{
+    FUNC_ENTRY ( ctx );
+
+    char key [ 4096 ];
+
+    if ( self == NULL )
+        return;
+
+    if ( ! CheckpointMakeKey ( key, sizeof key, tbl_spec, colspec ) )
+    {
+        rc_t rc = RC ( rcExe, rcName, rcFormatting, rcBuffer, rcInsufficient );
+        INTERNAL_ERROR ( rc, "column name '%s.%s' is too long to checkpoint", tbl_spec, colspec );
+    }
+    else if ( ! CheckpointHasKey ( & self -> done, key ) )
+    {
+        TRY ( CheckpointAppend ( self, ctx, CKPT_COLUMN, key ) )
+        {
+            CheckpointAddKey ( & self -> done, ctx, key );
+            STATUS ( 4, "checkpointed column '%s'", key );
+        }
+    }
+}
+
+
+/* MapPath
+ *  the path of fork "fork" of id map "name" when it is to be kept
+ *  for a resume, returns false when it is not
+ */
+bool CheckpointMapPath ( Checkpoint *self, const ctx_t *ctx,
+    char *path, size_t bsize, const char *name, const char *fork )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+
+    if ( self == NULL || ! self -> durable_maps )
+        return false;
+
+    rc = string_printf ( path, bsize, NULL, "%s/sra-sort-%s.%s.%08x",
+        self -> tmpdir, name, fork, self -> map_tag );
+    if ( rc != 0 )
+    {
+        WARN ( "id map '%s' has too long a path to be kept", name );
+        return false;
+    }
+
+    if ( ! CheckpointHasKey ( & self -> map_files, path ) )
+    {
+        ON_FAIL ( CheckpointAddKey ( & self -> map_files, ctx, path ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+/* MapDone
+ *  true if id map "name" was recorded complete,
+ *  copies the header of its last record into "header"
+ */
+bool CheckpointMapDone ( const Checkpoint *self, const ctx_t *ctx,
+    const char *name, char *header, size_t bsize )
+{
+    uint32_t i;
+    size_t len;
+
+    if ( self == NULL || ! self -> durable_maps )
+        return false;
+
+    len = strlen ( name );
+    for ( i = VectorLength ( & self -> maps ); i > 0; -- i )
+    {
+        const char *rec = VectorGet ( & self -> maps, i - 1 );
+        if ( strncmp ( rec, name, len ) == 0 && rec [ len ] == ' ' )
+            return string_printf ( header, bsize, NULL, "%s", rec + len + 1 ) == 0;
+    }
+
+    return false;
+}
+
+
+/* RecordMap
+ *  append a record for an id map whose buffers have been flushed.
+ *  the files MapPath handed out for "name" are synced first
+ */
+void CheckpointRecordMap ( Checkpoint *self, const ctx_t *ctx,
+    const char *name, const char *header )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    char rec [ 4096 ];
+
+    if ( self == NULL || ! self -> durable_maps )
+        return;
+
+    rc = string_printf ( rec, sizeof rec, NULL, "%s %s", name, header );
+    if ( rc != 0 )
+        INTERNAL_ERROR ( rc, "id map record '%s' is too long to checkpoint", name );
+    else
+    {
+        TRY ( CheckpointSyncMap ( self, ctx, name ) )
+        {
+            TRY ( CheckpointAppend ( self, ctx, CKPT_MAP, rec ) )
+        {
+                CheckpointAddKey ( & self -> maps, ctx, rec );
+                STATUS ( 4, "checkpointed id map '%s'", name );
+            }
+        }
+    }
+}
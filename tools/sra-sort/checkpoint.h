@@ -0,0 +1,117 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#ifndef _h_sra_sort_checkpoint_
+#define _h_sra_sort_checkpoint_
+
+#ifndef _h_sra_sort_defs_
+#include "sort-defs.h"
+#endif
+
+
+/*--------------------------------------------------------------------------
+ * forwards
+ */
+struct KDirectory;
+
+
+/*--------------------------------------------------------------------------
+ * Checkpoint
+ *  a manifest of work committed to the destination object
+ *  kept beside it as "<dst>.sra-sort-ckpt" while a sort is resumable,
+ *  and removed once the object has been completely written
+ *
+ *  records are only made and consulted on the main thread
+ */
+typedef struct Checkpoint Checkpoint;
+
+
+/* Make
+ *  opens the manifest for "dst_path", loading any records
+ *  left by an earlier run on the same source
+ */
+Checkpoint *CheckpointMake ( const ctx_t *ctx, const char *src_path, const char *dst_path );
+
+
+/* Release
+ *  closes the manifest
+ *  removes it if "complete" is true
+ */
+void CheckpointRelease ( Checkpoint *self, const ctx_t *ctx, bool complete );
+
+
+/* ColumnDone
+ *  true if column "colspec" of table "tbl_spec" was committed
+ *  by an earlier run. any typecast on "colspec" is ignored.
+ */
+bool CheckpointColumnDone ( const Checkpoint *self, const ctx_t *ctx,
+    const char *tbl_spec, const char *colspec );
+
+
+/* SyncColumn
+ *  push the files of column "colspec" under "tbl_dir", the
+ *  directory of a destination table, to the disk. a column is
+ *  synced before it, or anything that depends upon it, is recorded
+ */
+void CheckpointSyncColumn ( const Checkpoint *self, const ctx_t *ctx,
+    struct KDirectory const *tbl_dir, const char *colspec );
+
+
+/* RecordColumn
+ *  append a record for a column whose writer has been
+ *  committed and released, and whose files have been synced
+ */
+void CheckpointRecordColumn ( Checkpoint *self, const ctx_t *ctx,
+    const char *tbl_spec, const char *colspec );
+
+
+/* MapPath
+ *  the path of fork "fork" of id map "name" when id maps outlive
+ *  the process, i.e. the temporary directory is on durable storage.
+ *  returns false otherwise, and when "self" is NULL.
+ *  the files are removed with the manifest once the object is complete
+ */
+bool CheckpointMapPath ( Checkpoint *self, const ctx_t *ctx,
+    char *path, size_t bsize, const char *name, const char *fork );
+
+
+/* MapDone
+ *  true if id map "name" was recorded as complete by an
+ *  earlier run, and copies the header recorded with it
+ */
+bool CheckpointMapDone ( const Checkpoint *self, const ctx_t *ctx,
+    const char *name, char *header, size_t bsize );
+
+
+/* RecordMap
+ *  append a record for an id map whose buffers have been flushed.
+ *  the files MapPath handed out for "name" are synced first
+ */
+void CheckpointRecordMap ( Checkpoint *self, const ctx_t *ctx,
+    const char *name, const char *header );
+
+
+#endif /* _h_sra_sort_checkpoint_ */
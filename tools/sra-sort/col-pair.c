@@ -33,6 +33,7 @@ typedef struct SimpleColumnWriter SimpleColumnWriter;
 #include "col-pair.h"
 #include "tbl-pair.h"
 #include "row-set.h"
+#include "map-file.h"
 #include "ctx.h"
 #include "caps.h"
 #include "except.h"
@@ -581,6 +582,7 @@ void ColumnWriterInit ( ColumnWriter *self, const ctx_t *ctx, const ColumnWriter
     else
     {
         self -> vt = vt;
+        self -> rsi = NULL;
         KRefcountInit ( & self -> refcount, 1, "ColumnWriter", "init", "" );
         self -> mapped = mapped;
         memset ( self -> align, 0, sizeof self -> align );
@@ -603,6 +605,7 @@ void ColumnPairWhack ( ColumnPair *self, const ctx_t *ctx )
 
     ColumnReaderRelease ( self -> reader, ctx );
     ColumnWriterRelease ( self -> writer, ctx );
+    MapFileRelease ( self -> ckpt_idx, ctx );
     MemFree ( ctx, self, sizeof * self + self -> full_spec_size );
 }
 
@@ -633,6 +636,8 @@ ColumnPair *TablePairMakeColumnPair ( TablePair *self, const ctx_t *ctx,
                 col -> is_mapped = writer -> mapped;
                 col -> presorted = reader -> presorted;
                 col -> large = large;
+                col -> resumable = false;
+                col -> ckpt_idx = NULL;
 
                 rc = string_printf ( col -> full_spec, full_spec_size + 1, NULL,
                     "%s.%s", self -> full_spec, colspec );
@@ -742,6 +747,19 @@ void ColumnPairPostCopy ( const ColumnPair *self, const ctx_t *ctx )
 }
 
 
+/* BindRowSetIterator
+ *  tells the writer which iterator produces the RowSets it will see
+ */
+void ColumnPairBindRowSetIterator ( ColumnPair *self, const ctx_t *ctx, const RowSetIterator *rsi )
+{
+    FUNC_ENTRY ( ctx );
+
+    assert ( self != NULL );
+    assert ( self -> writer != NULL );
+    self -> writer -> rsi = rsi;
+}
+
+
 /* Copy
  *  copy from source to destination column
  */
@@ -40,8 +40,10 @@
  * forwards
  */
 struct VCursor;
+struct MapFile;
 struct TablePair;
 struct RowSet;
+struct RowSetIterator;
 
 
 /*--------------------------------------------------------------------------
@@ -154,6 +156,11 @@ typedef struct ColumnWriter ColumnWriter;
 struct ColumnWriter
 {
     const ColumnWriter_vt *vt;
+
+    /* borrowed reference to the iterator producing
+       the RowSets being copied, or NULL if unbound */
+    struct RowSetIterator const *rsi;
+
     KRefcount refcount;
     bool mapped;
     uint8_t align [ 3 ];
@@ -275,6 +282,13 @@ struct ColumnPair
 
     bool large;
 
+    /* matched by name from the source schema,
+       so it may be checkpointed and skipped on resume */
+    bool resumable;
+
+    /* id map filled by this column, to be kept along with it */
+    struct MapFile *ckpt_idx;
+
     char full_spec [ 1 ];
 };
 
@@ -308,6 +322,15 @@ void ColumnPairPreCopy ( const ColumnPair *self, const ctx_t *ctx );
 void ColumnPairPostCopy ( const ColumnPair *self, const ctx_t *ctx );
 
 
+/* BindRowSetIterator
+ *  tells the writer which iterator produces the RowSets it will see
+ *  needed when several iterators walk the same table concurrently
+ *  the iterator is borrowed and must outlive the copy
+ */
+void ColumnPairBindRowSetIterator ( ColumnPair *self, const ctx_t *ctx,
+    struct RowSetIterator const *rsi );
+
+
 /* Copy
  *  copy from source to destination column
  */
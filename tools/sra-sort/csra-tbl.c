@@ -37,6 +37,7 @@ struct cSRATblPair;
 #include "meta-pair.h"
 #include "map-file.h"
 #include "xcheck.h"
+#include "checkpoint.h"
 #include "ctx.h"
 #include "caps.h"
 #include "except.h"
@@ -77,25 +78,55 @@ void cSRATblPairDummyStub ( cSRATblPair *self, const ctx_t *ctx )
 
 /* REFERENCE table
  */
+
+/* MakeAlignIdColPair
+ *  the id map of an alignment table is filled while copying its
+ *  *_ALIGNMENT_IDS column, and a kept map is recorded with it.
+ *  a map restored from an earlier run comes with its column
+ *  committed. a committed column without its map is written again
+ */
 static
-ColumnPair *cSRATblPairMakePrimAlignIdColPair ( cSRATblPair *self, const ctx_t *ctx )
+ColumnPair *cSRATblPairMakeAlignIdColPair ( cSRATblPair *self, const ctx_t *ctx,
+    TablePair *align, MapFile *idx, const char *colspec )
 {
     FUNC_ENTRY ( ctx );
 
     ColumnPair *col = NULL;
-    cSRAPair *csra = self -> csra;
-
     ColumnReader *reader;
-    const char *colspec = "(I64)PRIMARY_ALIGNMENT_IDS";
 
-    TRY ( reader = TablePairMakeAlignIdReader ( & self -> dad, ctx,
-              csra -> prim_align, csra -> pa_idx, colspec ) )
+    if ( MapFileRestored ( idx ) )
+    {
+        STATUS ( 3, "skipping checkpointed column 'dst.%s.%s'", self -> dad . full_spec, colspec );
+        return NULL;
+    }
+
+    if ( CheckpointColumnDone ( ctx -> caps -> ckpt, ctx, self -> dad . full_spec, colspec ) )
+    {
+        ON_FAIL ( TablePairDropColumn ( & self -> dad, ctx, colspec ) )
+            return NULL;
+    }
+
+    TRY ( reader = TablePairMakeAlignIdReader ( & self -> dad, ctx, align, idx, colspec ) )
     {
         ColumnWriter *writer;
         TRY ( writer = TablePairMakeColumnWriter ( & self -> dad, ctx, NULL, colspec ) )
         {
-            col = TablePairMakeColumnPair ( & self -> dad, ctx, reader, writer, colspec, false );
-                
+            TRY ( col = TablePairMakeColumnPair ( & self -> dad, ctx, reader, writer, colspec, false ) )
+            {
+                if ( MapFileKept ( idx ) )
+                {
+                    TRY ( col -> ckpt_idx = MapFileDuplicate ( idx, ctx ) )
+                    {
+                        col -> resumable = true;
+                    }
+                    CATCH_ALL ()
+                    {
+                        ColumnPairRelease ( col, ctx );
+                        col = NULL;
+                    }
+                }
+            }
+
             ColumnWriterRelease ( writer, ctx );
         }
 
@@ -106,34 +137,28 @@ ColumnPair *cSRATblPairMakePrimAlignIdColPair ( cSRATblPair *self, const ctx_t *
 }
 
 static
-ColumnPair *cSRATblPairMakeSecAlignIdColPair ( cSRATblPair *self, const ctx_t *ctx )
+ColumnPair *cSRATblPairMakePrimAlignIdColPair ( cSRATblPair *self, const ctx_t *ctx )
 {
     FUNC_ENTRY ( ctx );
 
-    ColumnPair *col = NULL;
     cSRAPair *csra = self -> csra;
 
-    if ( csra -> sec_align != NULL )
-    {
-        ColumnReader *reader;
-        const char *colspec = "(I64)SECONDARY_ALIGNMENT_IDS";
+    return cSRATblPairMakeAlignIdColPair ( self, ctx,
+        csra -> prim_align, csra -> pa_idx, "(I64)PRIMARY_ALIGNMENT_IDS" );
+}
 
-        TRY ( reader = TablePairMakeAlignIdReader ( & self -> dad, ctx,
-                  csra -> sec_align, csra -> sa_idx, colspec ) )
-        {
-            ColumnWriter *writer;
-            TRY ( writer = TablePairMakeColumnWriter ( & self -> dad, ctx, NULL, colspec ) )
-            {
-                col = TablePairMakeColumnPair ( & self -> dad, ctx, reader, writer, colspec, false );
-                
-                ColumnWriterRelease ( writer, ctx );
-            }
-            
-            ColumnReaderRelease ( reader, ctx );
-        }
-    }
+static
+ColumnPair *cSRATblPairMakeSecAlignIdColPair ( cSRATblPair *self, const ctx_t *ctx )
+{
+    FUNC_ENTRY ( ctx );
 
-    return col;
+    cSRAPair *csra = self -> csra;
+
+    if ( csra -> sec_align == NULL )
+        return NULL;
+
+    return cSRATblPairMakeAlignIdColPair ( self, ctx,
+        csra -> sec_align, csra -> sa_idx, "(I64)SECONDARY_ALIGNMENT_IDS" );
 }
 
 static
@@ -322,14 +347,19 @@ void cSRATblPairPreExplodeAlign ( cSRATblPair *self, const ctx_t *ctx )
 {
     FUNC_ENTRY ( ctx );
     cSRAPair *csra = self -> csra;
+    Checkpoint *ckpt = ctx -> caps -> ckpt;
 
+    /* a map kept by an earlier run is only taken up
+       if the column that filled it was committed */
     switch ( self -> align_idx )
     {
     case 1:
-        csra -> pa_idx = MapFileMakeForPoslen ( ctx, csra -> prim_align -> name );
+        csra -> pa_idx = MapFileMakeForPoslen ( ctx, csra -> prim_align -> name,
+            CheckpointColumnDone ( ckpt, ctx, csra -> reference -> full_spec, "PRIMARY_ALIGNMENT_IDS" ) );
         break;
     case 2:
-        csra -> sa_idx = MapFileMakeForPoslen ( ctx, csra -> sec_align -> name );
+        csra -> sa_idx = MapFileMakeForPoslen ( ctx, csra -> sec_align -> name,
+            CheckpointColumnDone ( ckpt, ctx, csra -> reference -> full_spec, "SECONDARY_ALIGNMENT_IDS" ) );
         break;
     }
 }
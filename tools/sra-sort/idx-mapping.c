@@ -25,6 +25,7 @@
  */
 
 #include "idx-mapping.h"
+#include "radix-sort.h"
 #include "ctx.h"
 
 #include <klib/sort.h>
@@ -61,13 +62,16 @@ int64_t CC IdxMappingCmpNew ( const void *a, const void *b, void *data )
 
 #define SWAP( a, b, off, size ) KSORT_TSWAP ( IdxMapping, a, b )
 
+/* large maps go through an LSD radix sort on the 64-bit id,
+   falling back to KSORT when small or short on memory */
 
 void IdxMappingSortOld ( IdxMapping *self, const ctx_t *ctx, size_t count )
 {
 #define CMP( a, b ) \
     ( ( T ( a ) -> old_id < T ( b ) -> old_id ) ? -1 : ( T ( a ) -> old_id > T ( b ) -> old_id ) )
 
-    KSORT ( self, count, sizeof * self, 0, sizeof * self );
+    if ( ! RadixSort16 ( self, ctx, count, 0, true ) )
+        KSORT ( self, count, sizeof * self, 0, sizeof * self );
 
 #undef CMP
 }
@@ -77,7 +81,8 @@ void IdxMappingSortNew ( IdxMapping *self, const ctx_t *ctx, size_t count )
 #define CMP( a, b ) \
     ( ( T ( a ) -> new_id < T ( b ) -> new_id ) ? -1 : ( T ( a ) -> new_id > T ( b ) -> new_id ) )
 
-    KSORT ( self, count, sizeof * self, 0, sizeof * self );
+    if ( ! RadixSort16 ( self, ctx, count, 1, true ) )
+        KSORT ( self, count, sizeof * self, 0, sizeof * self );
 
 #undef CMP
 }
@@ -31,18 +31,28 @@
 #include "status.h"
 #include "mem.h"
 #include "sra-sort.h"
+#include "checkpoint.h"
 
 #include <kfs/directory.h>
 #include <kfs/file.h>
 #include <kfs/buffile.h>
 #include <klib/refcount.h>
 #include <klib/sort.h>
+#include <klib/printf.h>
+#include <klib/text.h>
 #include <klib/rc.h>
 
+#include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include <endian.h>
 #include <byteswap.h>
 
+#if ! WINDOWS
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 #include "except.h"
 
 FILE_ENTRY ( map-file );
@@ -59,18 +69,81 @@ struct MapFile
     uint64_t num_mapped_ids;
     int64_t max_new_id;
     KFile *f_old, *f_new, *f_pos;
+    /* the unbuffered files underneath, they read with pread
+       so readers on other threads can wrap buffers of their own */
+    KFile *b_old, *b_new, *b_pos;
+    size_t bsize;
     size_t id_size;
+    bool read_only;
+    size_t prefetch;
+    /* read-only descriptors onto the same files,
+       used only to issue read-ahead advice, or -1 */
+    int fd_old, fd_new, fd_pos;
     KRefcount refcount;
+
+    /* the files are kept for a resume, see MapFileCheckpoint.
+       a restored map was read back from an earlier run */
+    bool persistent;
+    bool restored;
+    bool checkpointed;
+    char name [ 64 ];
 };
 
 
+/* CloseAdvisory
+ */
+static
+void MapFileCloseAdvisory ( int fd )
+{
+#if ! WINDOWS
+    if ( fd >= 0 )
+        close ( fd );
+#endif
+}
+
+
+/* Prefetch
+ *  the maps are read front to back in chunks
+ *  when a read crosses into a new window, ask the kernel to
+ *  start reading the following window into page cache so the
+ *  next synchronous read does not stall on the disk
+ */
+static
+void MapFilePrefetch ( const MapFile *self, int fd, uint64_t pos, size_t bytes, uint64_t eof )
+{
+#if LINUX
+    uint64_t window = self -> prefetch;
+    uint64_t end = pos + bytes;
+    if ( fd >= 0 && window != 0 && ( pos == 0 || pos / window != end / window ) )
+    {
+        uint64_t from = ( pos == 0 ) ? 0 : end;
+        uint64_t to = ( end / window + 2 ) * window;
+        if ( to > eof )
+            to = eof;
+        if ( from < to )
+            posix_fadvise ( fd, ( off_t ) from, ( off_t ) ( to - from ), POSIX_FADV_WILLNEED );
+    }
+#endif
+}
+
+
 /* Whack
  */
 static
 void MapFileWhack ( MapFile *self, const ctx_t *ctx )
 {
     FUNC_ENTRY ( ctx );
-    rc_t rc = KFileRelease ( self -> f_old );
+    rc_t rc;
+
+    MapFileCloseAdvisory ( self -> fd_old );
+    MapFileCloseAdvisory ( self -> fd_new );
+    MapFileCloseAdvisory ( self -> fd_pos );
+
+    KFileRelease ( self -> b_old );
+    KFileRelease ( self -> b_new );
+    KFileRelease ( self -> b_pos );
+
+    rc = KFileRelease ( self -> f_old );
     if ( rc != 0 )
         SYSTEM_ERROR ( rc, "KFileRelease failed on old=>new" );
     else
@@ -94,27 +167,41 @@ void MapFileWhack ( MapFile *self, const ctx_t *ctx )
  *  creates an id map
  */
 static
-void MapFileMakeFork ( KFile **fp, const ctx_t *ctx, const char *name,
-    KDirectory *wd, const char *tmpdir, int pid, size_t bsize, const char *fork )
+void MapFileMakeFork ( KFile **fp, KFile **bp, int *fd, const ctx_t *ctx, const char *name,
+    KDirectory *wd, const char *path, bool keep, bool restore, size_t bsize, const char *fork )
 {
     FUNC_ENTRY ( ctx );
 
-    /* create temporary KFile */
+    /* create temporary KFile, or reopen a kept one */
     rc_t rc;
     KFile *backing;
 
+    * fd = -1;
+    * bp = NULL;
+
     rc = KDirectoryCreateFile ( wd, & backing, true,
-        0600, kcmInit | kcmParents, "%s/sra-sort-%s.%s.%d", tmpdir, name, fork, pid );
+        0600, ( restore ? kcmOpen : kcmInit ) | kcmParents, "%s", path );
     if ( rc != 0 )
         SYSTEM_ERROR ( rc, "failed to create %s id map file '%s'", fork, name );
     else
     {
 #if ! WINDOWS
-        /* never try to remove files on Windows */
-        if ( ctx -> caps -> tool -> unlink_idx_files )
+        /* open a second descriptor for read-ahead advice
+           before the name can disappear. failure only costs prefetch */
+        if ( ctx -> caps -> tool -> map_file_prefetch != 0 )
+        {
+            char native [ 4096 ];
+            rc = KDirectoryResolvePath ( wd, true, native, sizeof native, "%s", path );
+            if ( rc == 0 )
+                * fd = open ( native, O_RDONLY );
+        }
+
+        /* never try to remove files on Windows,
+           nor those kept for a resume */
+        if ( ctx -> caps -> tool -> unlink_idx_files && ! keep )
         {
             /* unlink KFile */
-            rc = KDirectoryRemove ( wd, false, "%s/sra-sort-%s.%s.%d", tmpdir, name, fork, pid );
+            rc = KDirectoryRemove ( wd, false, "%s", path );
             if ( rc != 0 )
                 WARN ( "failed to unlink %s id map file '%s'", fork, name );
         }
@@ -123,14 +210,106 @@ void MapFileMakeFork ( KFile **fp, const ctx_t *ctx, const char *name,
         /* create a read/write buffer file */
         rc = KBufFileMakeWrite ( fp, backing, true, bsize );
         if ( rc != 0 )
+        {
             INTERNAL_ERROR ( rc, "failed to create buffer for %s id map file '%s'", fork, name );
+            MapFileCloseAdvisory ( * fd );
+            * fd = -1;
+            KFileRelease ( backing );
+        }
+        else
+        {
+            /* keep the reference for MapFileMakeReader */
+            * bp = backing;
+        }
+    }
+}
+
+/* ForkPaths
+ *  the files of a map are temporary files of this process,
+ *  unless all of them can be kept by the checkpoint
+ */
+static
+bool MapFileForkPaths ( char paths [ 3 ] [ 4096 ], const ctx_t *ctx, const char *name, bool keep )
+{
+    static const char *forks [ 3 ] = { "old", "new", "pos" };
+
+    uint32_t i;
+    const Tool *tp = ctx -> caps -> tool;
 
-        KFileRelease ( backing );
+    for ( i = 0; keep && i < 3; ++ i )
+        keep = CheckpointMapPath ( ctx -> caps -> ckpt, ctx, paths [ i ], sizeof paths [ i ], name, forks [ i ] );
+
+    if ( ! keep )
+    {
+        for ( i = 0; i < 3; ++ i )
+            string_printf ( paths [ i ], sizeof paths [ i ], NULL, "%s/sra-sort-%s.%s.%d", tp -> tmpdir, name, forks [ i ], tp -> pid );
     }
+
+    return keep;
 }
 
+
+/* Restore
+ *  take up a map kept by an earlier run from its recorded header,
+ *  "first-id num-ids num-mapped-ids max-new-id id-size" followed by
+ *  the sizes of the forks. the forks are emptied if they do not match
+ */
 static
-MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool for_poslen )
+void MapFileRestore ( MapFile *self, const ctx_t *ctx, const char *header )
+{
+    FUNC_ENTRY ( ctx );
+
+    int64_t first_id, max_new_id;
+    uint64_t num_ids, num_mapped_ids, size [ 3 ], eof [ 3 ];
+    unsigned int id_size;
+
+    KFile *forks [ 3 ];
+    uint32_t i;
+
+    forks [ 0 ] = self -> b_old;
+    forks [ 1 ] = self -> b_new;
+    forks [ 2 ] = self -> b_pos;
+
+    if ( sscanf ( header, "%" SCNd64 " %" SCNu64 " %" SCNu64 " %" SCNd64 " %u %" SCNu64 " %" SCNu64 " %" SCNu64,
+             & first_id, & num_ids, & num_mapped_ids, & max_new_id, & id_size,
+             & size [ 0 ], & size [ 1 ], & size [ 2 ] ) == 8 &&
+         id_size >= 1 && id_size <= 8 )
+    {
+        for ( i = 0; i < 3; ++ i )
+        {
+            if ( KFileSize ( forks [ i ], & eof [ i ] ) != 0 || eof [ i ] != size [ i ] )
+                break;
+        }
+
+        if ( i == 3 )
+        {
+            self -> first_id = first_id;
+            self -> num_ids = num_ids;
+            self -> num_mapped_ids = num_mapped_ids;
+            self -> max_new_id = max_new_id;
+            self -> id_size = id_size;
+            self -> restored = true;
+            self -> checkpointed = true;
+
+            STATUS ( 2, "restored id map '%s' of %lu ids", self -> name, num_ids );
+            return;
+        }
+    }
+
+    WARN ( "id map '%s' kept by an earlier run does not match its record - rebuilding", self -> name );
+    for ( i = 0; i < 3; ++ i )
+    {
+        rc_t rc = KFileSetSize ( forks [ i ], 0 );
+        if ( rc != 0 )
+        {
+            SYSTEM_ERROR ( rc, "failed to empty id map file '%s'", self -> name );
+            break;
+        }
+    }
+}
+
+static
+MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool for_poslen, bool restore )
 {
     MapFile *mf;
     TRY ( mf = MemAlloc ( ctx, sizeof * mf, true ) )
@@ -145,13 +324,35 @@ MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool
             const Tool *tp = ctx -> caps -> tool;
             size_t bsize = random ? tp -> map_file_random_bsize : tp -> map_file_bsize;
 
+            char paths [ 3 ] [ 4096 ];
+            char header [ 256 ];
+
+            mf -> prefetch = tp -> map_file_prefetch;
+            mf -> bsize = bsize;
+            mf -> fd_pos = -1;
+
+            /* only the poslen maps of whole tables are kept,
+               they are complete once their column is committed */
+            if ( string_copy_measure ( mf -> name, sizeof mf -> name, name ) < sizeof mf -> name )
+                mf -> persistent = MapFileForkPaths ( paths, ctx, name, for_poslen );
+            else
+                MapFileForkPaths ( paths, ctx, name, false );
+            restore = restore && mf -> persistent &&
+                CheckpointMapDone ( ctx -> caps -> ckpt, ctx, name, header, sizeof header );
+
             /* create old=>new id file */
-            TRY ( MapFileMakeFork ( & mf -> f_old, ctx, name, wd, tp -> tmpdir, tp -> pid, bsize, "old" ) )
+            TRY ( MapFileMakeFork ( & mf -> f_old, & mf -> b_old, & mf -> fd_old, ctx, name, wd, paths [ 0 ], mf -> persistent, restore, bsize, "old" ) )
             {
-                TRY ( MapFileMakeFork ( & mf -> f_new, ctx, name, wd, tp -> tmpdir, tp -> pid, 32 * 1024, "new" ) )
+                TRY ( MapFileMakeFork ( & mf -> f_new, & mf -> b_new, & mf -> fd_new, ctx, name, wd, paths [ 1 ], mf -> persistent, restore, 32 * 1024, "new" ) )
                 {
                     if ( for_poslen )
-                        MapFileMakeFork ( & mf -> f_pos, ctx, name, wd, tp -> tmpdir, tp -> pid, 32 * 1024, "pos" );
+                    {
+                        TRY ( MapFileMakeFork ( & mf -> f_pos, & mf -> b_pos, & mf -> fd_pos, ctx, name, wd, paths [ 2 ], mf -> persistent, restore, 32 * 1024, "pos" ) )
+                        {
+                            if ( restore )
+                                MapFileRestore ( mf, ctx, header );
+                        }
+                    }
 
                     KDirectoryRelease ( wd );
 
@@ -164,9 +365,13 @@ MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool
                     }
 
                     KFileRelease ( mf -> f_new );
+                    KFileRelease ( mf -> b_new );
+                    MapFileCloseAdvisory ( mf -> fd_new );
                 }
 
                 KFileRelease ( mf -> f_old );
+                KFileRelease ( mf -> b_old );
+                MapFileCloseAdvisory ( mf -> fd_old );
             }
 
             KDirectoryRelease ( wd );
@@ -181,7 +386,7 @@ MapFile *MapFileMakeInt ( const ctx_t *ctx, const char *name, bool random, bool
 MapFile *MapFileMake ( const ctx_t *ctx, const char *name, bool random )
 {
     FUNC_ENTRY ( ctx );
-    return MapFileMakeInt ( ctx, name, random, false );
+    return MapFileMakeInt ( ctx, name, random, false, false );
 }
 
 /* MakeForPoslen
@@ -191,10 +396,28 @@ MapFile *MapFileMake ( const ctx_t *ctx, const char *name, bool random )
  *  we drop it to a file after its generation so that it can be
  *  picked up later when copying the corresponding alignment table.
  */
-MapFile *MapFileMakeForPoslen ( const ctx_t *ctx, const char *name )
+MapFile *MapFileMakeForPoslen ( const ctx_t *ctx, const char *name, bool restore )
 {
     FUNC_ENTRY ( ctx );
-    return MapFileMakeInt ( ctx, name, false, true );
+    return MapFileMakeInt ( ctx, name, false, true, restore );
+}
+
+
+/* Kept
+ *  true if the files of the map are kept for a resume
+ */
+bool MapFileKept ( const MapFile *self )
+{
+    return self != NULL && self -> persistent;
+}
+
+
+/* Restored
+ *  true if the map was read back from an earlier run
+ */
+bool MapFileRestored ( const MapFile *self )
+{
+    return self != NULL && self -> restored;
 }
 
 
@@ -250,6 +473,176 @@ MapFile *MapFileDuplicate ( const MapFile *self, const ctx_t *ctx )
 }
 
 
+/* FlushFork
+ *  releasing the buffer writes its dirty page to the backing file,
+ *  a new one is put on top for further writes
+ */
+static
+void MapFileFlushFork ( KFile **fp, KFile *backing, const ctx_t *ctx, size_t bsize, const char *fork )
+{
+    FUNC_ENTRY ( ctx );
+
+    if ( * fp != NULL )
+    {
+        rc_t rc = KFileRelease ( * fp );
+        * fp = NULL;
+        if ( rc != 0 )
+            SYSTEM_ERROR ( rc, "failed to flush %s id map file", fork );
+        else
+        {
+            rc = KBufFileMakeWrite ( fp, backing, true, bsize );
+            if ( rc != 0 )
+                INTERNAL_ERROR ( rc, "failed to create buffer for %s id map file", fork );
+        }
+    }
+}
+
+
+/* Checkpoint
+ *  record a completely written map that is kept for a resume
+ */
+void MapFileCheckpoint ( MapFile *self, const ctx_t *ctx )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    char header [ 256 ];
+    uint64_t size [ 3 ];
+
+    if ( self == NULL || ! self -> persistent || self -> checkpointed )
+        return;
+
+    ON_FAIL ( MapFileFlushFork ( & self -> f_old, self -> b_old, ctx, self -> bsize, "old" ) )
+        return;
+    ON_FAIL ( MapFileFlushFork ( & self -> f_new, self -> b_new, ctx, 32 * 1024, "new" ) )
+        return;
+    ON_FAIL ( MapFileFlushFork ( & self -> f_pos, self -> b_pos, ctx, 32 * 1024, "pos" ) )
+        return;
+
+    rc = KFileSize ( self -> b_old, & size [ 0 ] );
+    if ( rc == 0 )
+        rc = KFileSize ( self -> b_new, & size [ 1 ] );
+    if ( rc == 0 )
+        rc = KFileSize ( self -> b_pos, & size [ 2 ] );
+    if ( rc != 0 )
+        SYSTEM_ERROR ( rc, "failed to size id map '%s'", self -> name );
+    else
+    {
+        rc = string_printf ( header, sizeof header, NULL, "%ld %lu %lu %ld %u %lu %lu %lu",
+            self -> first_id, self -> num_ids, self -> num_mapped_ids, self -> max_new_id,
+            ( uint32_t ) self -> id_size, size [ 0 ], size [ 1 ], size [ 2 ] );
+        if ( rc != 0 )
+            INTERNAL_ERROR ( rc, "failed to format id map header" );
+        else
+        {
+            TRY ( CheckpointRecordMap ( ctx -> caps -> ckpt, ctx, self -> name, header ) )
+            {
+                self -> checkpointed = true;
+            }
+        }
+    }
+}
+
+
+/* MakeReaderFork
+ */
+static
+void MapFileMakeReaderFork ( KFile **fp, KFile **bp, int *fd, const ctx_t *ctx,
+    KFile *backing, int src_fd, size_t bsize, const char *fork )
+{
+    FUNC_ENTRY ( ctx );
+
+    if ( backing != NULL )
+    {
+        const KFile *f;
+        rc_t rc = KBufFileMakeRead ( & f, backing, bsize );
+        if ( rc != 0 )
+            INTERNAL_ERROR ( rc, "failed to create read buffer for %s id map file", fork );
+        else
+        {
+            /* never written through, see read_only */
+            * fp = ( KFile* ) f;
+
+            rc = KFileAddRef ( backing );
+            if ( rc != 0 )
+                INTERNAL_ERROR ( rc, "failed to attach %s id map file", fork );
+            else
+                * bp = backing;
+#if ! WINDOWS
+            if ( src_fd >= 0 )
+                * fd = dup ( src_fd );
+#endif
+        }
+    }
+}
+
+
+/* MakeReader
+ *  a read-only MapFile onto the same files with buffers of its own,
+ *  for a reader that must not share the single buffered position
+ *  of each file with other readers, e.g. on another thread
+ *
+ *  sees everything written to "self" before the call, but nothing after.
+ *  flushes "self", which must not be in use on another thread meanwhile.
+ */
+const MapFile *MapFileMakeReader ( const MapFile *self, const ctx_t *ctx )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    MapFile *mf, *src = ( MapFile* ) self;
+
+    if ( self == NULL )
+    {
+        rc = RC ( rcExe, rcFile, rcOpening, rcSelf, rcNull );
+        INTERNAL_ERROR ( rc, "bad self reference" );
+        return NULL;
+    }
+
+    if ( ! self -> read_only )
+    {
+        ON_FAIL ( MapFileFlushFork ( & src -> f_old, src -> b_old, ctx, src -> bsize, "old" ) )
+            return NULL;
+        ON_FAIL ( MapFileFlushFork ( & src -> f_new, src -> b_new, ctx, 32 * 1024, "new" ) )
+            return NULL;
+        ON_FAIL ( MapFileFlushFork ( & src -> f_pos, src -> b_pos, ctx, 32 * 1024, "pos" ) )
+            return NULL;
+    }
+
+    TRY ( mf = MemAlloc ( ctx, sizeof * mf, true ) )
+    {
+        mf -> first_id = self -> first_id;
+        mf -> num_ids = self -> num_ids;
+        mf -> num_mapped_ids = self -> num_mapped_ids;
+        mf -> max_new_id = self -> max_new_id;
+        mf -> bsize = self -> bsize;
+        mf -> id_size = self -> id_size;
+        mf -> prefetch = self -> prefetch;
+        mf -> read_only = true;
+        mf -> fd_old = mf -> fd_new = mf -> fd_pos = -1;
+        KRefcountInit ( & mf -> refcount, 1, "MapFile", "make-reader", "" );
+
+        TRY ( MapFileMakeReaderFork ( & mf -> f_old, & mf -> b_old, & mf -> fd_old, ctx,
+                  self -> b_old, self -> fd_old, self -> bsize, "old" ) )
+        {
+            TRY ( MapFileMakeReaderFork ( & mf -> f_new, & mf -> b_new, & mf -> fd_new, ctx,
+                      self -> b_new, self -> fd_new, 32 * 1024, "new" ) )
+            {
+                TRY ( MapFileMakeReaderFork ( & mf -> f_pos, & mf -> b_pos, & mf -> fd_pos, ctx,
+                          self -> b_pos, self -> fd_pos, 32 * 1024, "pos" ) )
+                {
+                    return mf;
+                }
+            }
+        }
+
+        MapFileWhack ( mf, ctx );
+    }
+
+    return NULL;
+}
+
+
 /* SsetIdRange
  *  required second-stage initialization
  *  must be called before any writes occur
@@ -521,6 +914,7 @@ size_t MapFileReadPoslen ( const MapFile *self, const ctx_t *ctx,
             size_t num_read, to_read = max_count * sizeof * poslen;
             uint64_t pos = ( start_id - self -> first_id ) * sizeof * poslen;
             rc = KFileReadAll ( self -> f_pos, pos, poslen, to_read, & num_read );
+            MapFilePrefetch ( self, self -> fd_pos, pos, to_read, self -> num_ids * sizeof * poslen );
             if ( rc != 0 )
                 SYSTEM_ERROR ( rc, "failed to read new=>old map" );
             else
@@ -638,6 +1032,7 @@ int64_t MapFileAllocMissingNewIds ( MapFile *self, const ctx_t *ctx )
 
                         /* read as many bytes as we can */
                         rc = KFileReadAll ( self -> f_old, pos, scan_buffer, to_read, & num_read );
+                        MapFilePrefetch ( self, self -> fd_old, pos, to_read, eof );
                         if ( rc != 0 )
                         {
                             SYSTEM_ERROR ( rc, "failed to read old=>new map" );
@@ -796,6 +1191,7 @@ size_t MapFileReadNewToOld ( const MapFile *self, const ctx_t *ctx,
             size_t num_read, to_read = max_count * self -> id_size;
             uint64_t pos = ( start_id - self -> first_id ) * self -> id_size;
             rc = KFileReadAll ( self -> f_new, pos, ids, to_read, & num_read );
+            MapFilePrefetch ( self, self -> fd_new, pos, to_read, self -> num_ids * self -> id_size );
             if ( rc != 0 )
                 SYSTEM_ERROR ( rc, "failed to read new=>old map" );
             else
@@ -868,6 +1264,7 @@ size_t MapFileSelectOldToNewPairs ( const MapFile *self, const ctx_t *ctx,
         if ( pos + to_read > eof )
             to_read = ( size_t ) ( eof - pos );
         rc = KFileReadAll ( self -> f_old, pos, buff, to_read, & num_read );
+        MapFilePrefetch ( self, self -> fd_old, pos, to_read, eof );
         if ( rc != 0 )
         {
             SYSTEM_ERROR ( rc, "failed to read old=>new map" );
@@ -950,6 +1347,7 @@ size_t MapFileSelectOldToNewSingle ( const MapFile *self, const ctx_t *ctx,
         if ( pos + to_read > eof )
             to_read = ( size_t ) ( eof - pos );
         rc = KFileReadAll ( self -> f_old, pos, buff, to_read, & num_read );
+        MapFilePrefetch ( self, self -> fd_old, pos, to_read, eof );
         if ( rc != 0 )
         {
             SYSTEM_ERROR ( rc, "failed to read old=>new map" );
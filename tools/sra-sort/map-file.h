@@ -57,8 +57,33 @@ MapFile *MapFileMake ( const ctx_t *ctx, const char *name, bool random_access );
  *  that use *_ALIGNMENT global position and length as a sorting key
  *  we drop it to a file after its generation so that it can be
  *  picked up later when copying the corresponding alignment table.
+ *
+ *  when checkpointing to durable storage the files are kept for a
+ *  resume. with "restore", a map recorded by an earlier run is
+ *  read back instead of being created empty, see MapFileRestored
+ */
+MapFile *MapFileMakeForPoslen ( const ctx_t *ctx, const char *name, bool restore );
+
+
+/* Restored
+ *  true if the map was read back from an earlier run,
+ *  it is complete and must not be written again
+ */
+bool MapFileRestored ( const MapFile *self );
+
+
+/* Kept
+ *  true if the files of the map are kept for a resume
  */
-MapFile *MapFileMakeForPoslen ( const ctx_t *ctx, const char *name );
+bool MapFileKept ( const MapFile *self );
+
+
+/* Checkpoint
+ *  flush a completely written map and record it in the
+ *  checkpoint manifest, if its files are kept for a resume.
+ *  the column that filled it must already be synced
+ */
+void MapFileCheckpoint ( MapFile *self, const ctx_t *ctx );
 
 
 /* Release
@@ -70,6 +95,15 @@ void MapFileRelease ( const MapFile *self, const ctx_t *ctx );
 MapFile *MapFileDuplicate ( const MapFile *self, const ctx_t *ctx );
 
 
+/* MakeReader
+ *  creates a read-only id map onto the same files with buffers of its own,
+ *  so that it can be read while "self" is read or written on another thread
+ *  sees what was written to "self" before the call. "self" is flushed,
+ *  it must not be in use on another thread during the call.
+ */
+const MapFile *MapFileMakeReader ( const MapFile *self, const ctx_t *ctx );
+
+
 /* SetIdRange
  *  required second-stage initialization
  *  must be called before any writes occur
@@ -480,7 +480,10 @@ RowSetIterator * MapFileMakeMappingRowSetIterator ( const MapFile *self, const c
             {
                 TRY ( rsi -> last_excl = rsi -> row_id + MapFileCount ( self, ctx ) )
                 {
-                    TRY ( rsi -> idx = MapFileDuplicate ( self, ctx ) )
+                    /* a reader of its own: iterators may run on
+                       several threads, and a sequential scan should
+                       not evict the page used by random lookups */
+                    TRY ( rsi -> idx = MapFileMakeReader ( self, ctx ) )
                     {
                         rsi -> large = large;
                         return & rsi -> dad;
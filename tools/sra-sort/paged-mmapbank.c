@@ -45,6 +45,10 @@ typedef struct PagedMMapBank PagedMMapBank;
 #include <stdlib.h>
 #include <string.h>
 
+#if ! WINDOWS
+#include <sys/mman.h>
+#endif
+
 FILE_ENTRY ( paged-mmapbank );
 
 
@@ -88,10 +92,17 @@ struct PagedMMapBank
     size_t quota;
     size_t used;
     size_t pgsize;
+    size_t prefetch;
     KFile *backing;
     SLList pages;
 };
 
+/* huge page granularity
+ *  pages are sized in multiples of this so that a bank
+ *  placed on hugetlbfs maps cleanly, and THP can back them whole
+ */
+#define HUGE_PAGE_SIZE ( ( size_t ) 2 * 1024 * 1024 )
+
 
 /* Whack
  */
@@ -254,6 +265,12 @@ void PagedMMapBankMapPage ( PagedMMapBank *self, const ctx_t *ctx, MMapPage *pg
                 INTERNAL_ERROR ( rc, "KMMapSize failed" );
             else
             {
+#if LINUX && defined MADV_HUGEPAGE
+                /* sorts touch these pages randomly, so TLB reach matters.
+                   honored when mmapdir is on tmpfs with shmem THP enabled,
+                   and harmlessly ignored elsewhere */
+                madvise ( pg -> addr, pg -> size, MADV_HUGEPAGE );
+#endif
                 pg -> used = 0;
                 self -> used += self -> pgsize;
                 STATUS ( 4, "total mem-mapped buffer space: %,zu bytes", self -> used );
@@ -267,6 +284,30 @@ void PagedMMapBankMapPage ( PagedMMapBank *self, const ctx_t *ctx, MMapPage *pg
 }
 
 
+/* Prefetch
+ *  allocation walks each page front to back
+ *  when it crosses into a new window, ask for the following one
+ *  so that faults on the backing file are taken ahead of use
+ */
+static
+void PagedMMapBankPrefetch ( const PagedMMapBank *self, const MMapPage *pg, size_t start, size_t end )
+{
+#if ! WINDOWS
+    size_t window = self -> prefetch;
+    if ( window != 0 && ( start == 0 || start / window != end / window ) )
+    {
+        size_t from = ( start == 0 ) ? 0 : ( end / window + 1 ) * window;
+        size_t to = ( end / window + 2 ) * window;
+        if ( to > pg -> size )
+            to = pg -> size;
+
+        if ( from < to )
+            madvise ( & pg -> addr [ from ], to - from, MADV_WILLNEED );
+    }
+#endif
+}
+
+
 /* Alloc
  *  allocates some memory from bank
  */
@@ -289,6 +330,7 @@ void *PagedMMapBankAlloc ( PagedMMapBank *self, const ctx_t *ctx, size_t bytes,
         {
             /* got the memory */
             mem = & pg -> addr [ pg -> used ];
+            PagedMMapBankPrefetch ( self, pg, pg -> used, pg -> used + bytes );
             pg -> used += bytes;
 
             /* zero it out if so requested */
@@ -324,6 +366,7 @@ void *PagedMMapBankAlloc ( PagedMMapBank *self, const ctx_t *ctx, size_t bytes,
 
                     /* clear memory of asked */
                     mem = pg  -> addr;
+                    PagedMMapBankPrefetch ( self, pg, 0, bytes );
                     pg -> used = bytes;
                     if ( clear )
                         memset ( mem, 0, bytes );
@@ -380,6 +423,9 @@ MemBank *MemBankMakePagedMMap ( const ctx_t *ctx, size_t quota, size_t pgsize )
     if ( pgsize < 256 * 1024 * 1024 )
         pgsize = 256 * 1024 * 1024;
 
+    /* round up to whole huge pages */
+    pgsize = ( pgsize + HUGE_PAGE_SIZE - 1 ) & ~ ( HUGE_PAGE_SIZE - 1 );
+
     if ( quota < pgsize )
         quota = pgsize;
 
@@ -389,6 +435,9 @@ MemBank *MemBankMakePagedMMap ( const ctx_t *ctx, size_t quota, size_t pgsize )
         {
             mem -> quota = quota;
             mem -> pgsize = pgsize;
+            /* keep prefetch windows page-aligned for madvise */
+            mem -> prefetch = ( ctx -> caps -> tool -> map_file_prefetch
+                + HUGE_PAGE_SIZE - 1 ) & ~ ( HUGE_PAGE_SIZE - 1 );
             return & mem -> dad;
         }
 
@@ -0,0 +1,397 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+#include "radix-sort.h"
+#include "ctx.h"
+#include "caps.h"
+#include "except.h"
+#include "status.h"
+#include "mem.h"
+#include "sra-sort.h"
+
+#include <kproc/thread.h>
+#include <klib/rc.h>
+
+#include <string.h>
+
+FILE_ENTRY ( radix-sort );
+
+
+/* below this, KSORT is just as fast and needs no scratch */
+#define RADIX_MIN_COUNT 4096
+
+/* below this, starting threads costs more than it saves */
+#define RADIX_MT_MIN_COUNT ( 1024 * 1024 )
+#define RADIX_MAX_THREADS 64
+
+#define RADIX_BITS 8
+#define RADIX_SIZE ( 1 << RADIX_BITS )
+#define RADIX_PASSES ( 64 / RADIX_BITS )
+
+#define RADIX_DIGIT( rec, key_word, flip, shift ) \
+    ( ( size_t ) ( ( ( ( rec ) -> w [ key_word ] ^ ( flip ) ) >> ( shift ) ) & ( RADIX_SIZE - 1 ) ) )
+
+
+/*--------------------------------------------------------------------------
+ * RadixRec
+ *  IdxMapping and IdPosLen as seen by the sort
+ */
+typedef struct RadixRec RadixRec;
+struct RadixRec
+{
+    uint64_t w [ 2 ];
+};
+
+
+/* Survey
+ *  counts every digit of a range of records in one sweep
+ */
+static
+void RadixSurvey ( const RadixRec *recs, size_t start, size_t end,
+    uint32_t key_word, uint64_t flip, size_t hist [ RADIX_PASSES ] [ RADIX_SIZE ] )
+{
+    size_t i;
+    uint32_t p;
+
+    memset ( hist, 0, sizeof hist [ 0 ] * RADIX_PASSES );
+
+    for ( i = start; i < end; ++ i )
+    {
+        uint64_t key = recs [ i ] . w [ key_word ] ^ flip;
+        for ( p = 0; p < RADIX_PASSES; ++ p )
+            ++ hist [ p ] [ ( key >> ( p * RADIX_BITS ) ) & ( RADIX_SIZE - 1 ) ];
+    }
+}
+
+
+/* Scatter
+ *  moves a range of records into their buckets
+ *  "off" holds the next free slot of each bucket
+ */
+static
+void RadixScatter ( const RadixRec *src, RadixRec *dst, size_t start, size_t end,
+    uint32_t key_word, uint64_t flip, uint32_t shift, size_t off [ RADIX_SIZE ] )
+{
+    size_t i;
+
+    for ( i = start; i < end; ++ i )
+    {
+        size_t d = RADIX_DIGIT ( & src [ i ], key_word, flip, shift );
+        dst [ off [ d ] ++ ] = src [ i ];
+    }
+}
+
+
+/* SortSerial
+ *  returns the buffer holding the sorted records
+ */
+static
+const RadixRec *RadixSortSerial ( RadixRec *recs, RadixRec *scratch,
+    size_t count, uint32_t key_word, uint64_t flip )
+{
+    uint32_t p;
+    RadixRec *src = recs, *dst = scratch;
+    size_t hist [ RADIX_PASSES ] [ RADIX_SIZE ];
+
+    /* the digits of the keys do not change as records move,
+       so a single survey serves every pass */
+    RadixSurvey ( recs, 0, count, key_word, flip, hist );
+
+    for ( p = 0; p < RADIX_PASSES; ++ p )
+    {
+        RadixRec *tmp;
+        size_t b, sum, off [ RADIX_SIZE ];
+        uint32_t shift = p * RADIX_BITS;
+
+        /* all keys share this digit - nothing would move */
+        if ( hist [ p ] [ RADIX_DIGIT ( & src [ 0 ], key_word, flip, shift ) ] == count )
+            continue;
+
+        for ( sum = b = 0; b < RADIX_SIZE; ++ b )
+        {
+            off [ b ] = sum;
+            sum += hist [ p ] [ b ];
+        }
+
+        RadixScatter ( src, dst, 0, count, key_word, flip, shift, off );
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    return src;
+}
+
+
+/*--------------------------------------------------------------------------
+ * RadixWorker
+ *  one contiguous slice of the array per thread
+ *
+ *  each pass counts the current digit per slice, then turns the
+ *  counts into bucket-major, slice-minor offsets so that slices
+ *  scatter concurrently without breaking stability.
+ */
+enum RadixPhase
+{
+    radix_survey,
+    radix_count,
+    radix_scatter
+};
+
+typedef struct RadixWorker RadixWorker;
+struct RadixWorker
+{
+    const RadixRec *src;
+    RadixRec *dst;
+    size_t start, end;
+
+    /* per-digit counts from the survey */
+    size_t hist [ RADIX_PASSES ] [ RADIX_SIZE ];
+
+    /* bucket counts for the current pass, then next free slots */
+    size_t counts [ RADIX_SIZE ];
+
+    KThread *t;
+    uint64_t flip;
+    uint32_t key_word;
+    uint32_t shift;
+    uint32_t phase;
+};
+
+static
+rc_t CC RadixWorkerRun ( const KThread *self, void *data )
+{
+    RadixWorker *w = data;
+
+    switch ( w -> phase )
+    {
+    case radix_survey:
+        RadixSurvey ( w -> src, w -> start, w -> end, w -> key_word, w -> flip, w -> hist );
+        break;
+    case radix_count:
+    {
+        size_t i;
+        memset ( w -> counts, 0, sizeof w -> counts );
+        for ( i = w -> start; i < w -> end; ++ i )
+            ++ w -> counts [ RADIX_DIGIT ( & w -> src [ i ], w -> key_word, w -> flip, w -> shift ) ];
+        break;
+    }
+    case radix_scatter:
+        RadixScatter ( w -> src, w -> dst, w -> start, w -> end, w -> key_word, w -> flip, w -> shift, w -> counts );
+        break;
+    }
+
+    return 0;
+}
+
+/* RunWorkers
+ *  runs one phase on every slice and waits for it
+ *  the first slice runs on the calling thread, as does any
+ *  slice whose thread could not be started
+ */
+static
+void RadixRunWorkers ( RadixWorker *w, uint32_t num_workers,
+    const RadixRec *src, RadixRec *dst, uint32_t phase, uint32_t shift )
+{
+    uint32_t i;
+
+    for ( i = 0; i < num_workers; ++ i )
+    {
+        w [ i ] . src = src;
+        w [ i ] . dst = dst;
+        w [ i ] . phase = phase;
+        w [ i ] . shift = shift;
+        w [ i ] . t = NULL;
+
+        if ( i != 0 && KThreadMake ( & w [ i ] . t, RadixWorkerRun, & w [ i ] ) != 0 )
+        {
+            w [ i ] . t = NULL;
+            RadixWorkerRun ( NULL, & w [ i ] );
+        }
+    }
+
+    RadixWorkerRun ( NULL, & w [ 0 ] );
+
+    for ( i = 1; i < num_workers; ++ i )
+    {
+        if ( w [ i ] . t != NULL )
+        {
+            KThreadWait ( w [ i ] . t, NULL );
+            KThreadRelease ( w [ i ] . t );
+        }
+    }
+}
+
+/* SortParallel
+ *  returns the buffer holding the sorted records
+ */
+static
+const RadixRec *RadixSortParallel ( const ctx_t *ctx, RadixRec *recs, RadixRec *scratch,
+    size_t count, uint32_t key_word, uint64_t flip, uint32_t num_workers )
+{
+    FUNC_ENTRY ( ctx );
+
+    uint32_t i, p;
+    RadixWorker *w;
+    RadixRec *src = recs, *dst = scratch;
+    size_t total [ RADIX_PASSES ] [ RADIX_SIZE ];
+    bool surveyed;
+
+    if ( num_workers > RADIX_MAX_THREADS )
+        num_workers = RADIX_MAX_THREADS;
+
+    ON_FAIL ( w = MemAlloc ( ctx, sizeof w [ 0 ] * num_workers, true ) )
+    {
+        CLEAR ();
+        return RadixSortSerial ( recs, scratch, count, key_word, flip );
+    }
+
+    STATUS ( 4, "radix sorting %,zu records on %u threads", count, num_workers );
+
+    for ( i = 0; i < num_workers; ++ i )
+    {
+        w [ i ] . start = ( size_t ) ( ( uint64_t ) count * i / num_workers );
+        w [ i ] . end = ( size_t ) ( ( uint64_t ) count * ( i + 1 ) / num_workers );
+        w [ i ] . key_word = key_word;
+        w [ i ] . flip = flip;
+    }
+
+    /* survey once to find the passes that would move nothing */
+    RadixRunWorkers ( w, num_workers, src, dst, radix_survey, 0 );
+    memset ( total, 0, sizeof total );
+    for ( i = 0; i < num_workers; ++ i )
+    {
+        size_t b;
+        for ( p = 0; p < RADIX_PASSES; ++ p )
+        {
+            for ( b = 0; b < RADIX_SIZE; ++ b )
+                total [ p ] [ b ] += w [ i ] . hist [ p ] [ b ];
+        }
+    }
+
+    /* slice counts from the survey hold until records first move */
+    surveyed = true;
+
+    for ( p = 0; p < RADIX_PASSES; ++ p )
+    {
+        RadixRec *tmp;
+        size_t b, sum;
+        uint32_t shift = p * RADIX_BITS;
+
+        if ( total [ p ] [ RADIX_DIGIT ( & src [ 0 ], key_word, flip, shift ) ] == count )
+            continue;
+
+        if ( surveyed )
+        {
+            for ( i = 0; i < num_workers; ++ i )
+                memcpy ( w [ i ] . counts, w [ i ] . hist [ p ], sizeof w [ i ] . counts );
+        }
+        else
+        {
+            RadixRunWorkers ( w, num_workers, src, dst, radix_count, shift );
+        }
+
+        for ( sum = b = 0; b < RADIX_SIZE; ++ b )
+        {
+            for ( i = 0; i < num_workers; ++ i )
+            {
+                size_t n = w [ i ] . counts [ b ];
+                w [ i ] . counts [ b ] = sum;
+                sum += n;
+            }
+        }
+
+        RadixRunWorkers ( w, num_workers, src, dst, radix_scatter, shift );
+        surveyed = false;
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    MemFree ( ctx, w, sizeof w [ 0 ] * num_workers );
+
+    return src;
+}
+
+
+/*--------------------------------------------------------------------------
+ * RadixSort
+ */
+
+/* Sort16
+ *  sorts "count" records at "recs" on word "key_word"
+ */
+bool RadixSort16 ( void *recs, const ctx_t *ctx, size_t count, uint32_t key_word, bool is_signed )
+{
+    FUNC_ENTRY ( ctx );
+
+    RadixRec *scratch;
+    const RadixRec *sorted;
+    size_t in_use, quota, bytes = count * sizeof scratch [ 0 ];
+    uint64_t flip = is_signed ? ( ( uint64_t ) 1 << 63 ) : 0;
+    uint32_t num_threads = 1;
+
+    assert ( key_word < 2 );
+
+    if ( count < RADIX_MIN_COUNT )
+        return false;
+
+    /* prefer KSORT over failing on quota */
+    in_use = MemInUse ( ctx, & quota );
+    if ( ( quota + 1 ) != 0 && ( in_use > quota || quota - in_use < bytes ) )
+    {
+        STATUS ( 4, "no room for %,zu bytes of radix sort scratch - using KSORT", bytes );
+        return false;
+    }
+
+    ON_FAIL ( scratch = MemAlloc ( ctx, bytes, false ) )
+    {
+        CLEAR ();
+        return false;
+    }
+
+    if ( ctx -> caps -> tool != NULL && count >= RADIX_MT_MIN_COUNT )
+    {
+        num_threads = ctx -> caps -> num_threads;
+        if ( num_threads == 0 )
+            num_threads = ctx -> caps -> tool -> num_threads;
+    }
+
+    if ( num_threads > 1 )
+        sorted = RadixSortParallel ( ctx, recs, scratch, count, key_word, flip, num_threads );
+    else
+        sorted = RadixSortSerial ( recs, scratch, count, key_word, flip );
+
+    if ( sorted != recs )
+        memcpy ( recs, sorted, bytes );
+
+    MemFree ( ctx, scratch, bytes );
+
+    return true;
+}
@@ -0,0 +1,60 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+
+#ifndef _h_sra_sort_radix_sort_
+#define _h_sra_sort_radix_sort_
+
+#ifndef _h_sra_sort_defs_
+#include "sort-defs.h"
+#endif
+
+
+/*--------------------------------------------------------------------------
+ * RadixSort
+ *  LSD radix sort of 16-byte records keyed on one of their 64-bit words,
+ *  i.e. IdxMapping { old_id, new_id } and ( id, poslen ) pairs.
+ *
+ *  the sort is stable, so records already ordered on one word
+ *  come out ordered on ( key, other word ).
+ */
+
+
+/* Sort16
+ *  sorts "count" records at "recs" on word "key_word" ( 0 or 1 )
+ *  "is_signed" orders the key as int64_t rather than uint64_t
+ *
+ *  needs a scratch copy of the array. returns false without
+ *  touching "recs" when the array is too small to benefit or when
+ *  the scratch memory would not fit within the MemBank quota,
+ *  in which case the caller is expected to use KSORT.
+ *
+ *  runs on Tool "num_threads" threads for large arrays.
+ */
+bool RadixSort16 ( void *recs, const ctx_t *ctx, size_t count, uint32_t key_word, bool is_signed );
+
+
+#endif /* _h_sra_sort_radix_sort_ */
@@ -37,6 +37,7 @@ struct AlignIdColReader;
 #include "status.h"
 #include "mem.h"
 #include "idx-mapping.h"
+#include "radix-sort.h"
 #include "map-file.h"
 #include "sra-sort.h"
 
@@ -87,7 +88,7 @@ int64_t CC cmp_int64_t ( const void *a, const void *b, void *data )
 #else
 
 static
-void ksort_IdPosLen_pos ( IdPosLen *pbase, size_t total_elems )
+void ksort_IdPosLen_pos ( IdPosLen *pbase, const ctx_t *ctx, size_t total_elems )
 {
 #define SWAP( a, b, off, size )                               \
     do                                                        \
@@ -105,7 +106,10 @@ void ksort_IdPosLen_pos ( IdPosLen *pbase, size_t total_elems )
        : ( ( ( const IdPosLen* ) ( a ) ) -> poslen < ( ( const IdPosLen* ) ( b ) ) -> poslen ) ? -1 : \
        ( ( ( const IdPosLen* ) ( a ) ) -> poslen > ( ( const IdPosLen* ) ( b ) ) -> poslen ) )
 
-    KSORT ( pbase, total_elems, sizeof * pbase, 0, sizeof * pbase );
+    /* tuples arrive in id order, so a stable radix sort
+       on poslen alone yields ( poslen, id ) order */
+    if ( ! RadixSort16 ( pbase, ctx, total_elems, 1, false ) )
+        KSORT ( pbase, total_elems, sizeof * pbase, 0, sizeof * pbase );
 
 #undef SWAP
 #undef CMP
@@ -479,7 +483,7 @@ const void *AlignIdColReaderRead ( AlignIdColReader *self, const ctx_t *ctx,
 #if USE_OLD_KSORT
         ksort ( self -> u . id_poslen, self -> num_elems, sizeof self -> u . id_poslen [ 0 ], IdPosLenCmpPos, ( void* ) ctx );
 #else
-        ksort_IdPosLen_pos ( self -> u . id_poslen, self -> num_elems );
+        ksort_IdPosLen_pos ( self -> u . id_poslen, ctx, self -> num_elems );
 #endif
 
         /* write poslen to temp column */
@@ -30,6 +30,7 @@
 #include "except.h"
 #include "status.h"
 #include "sra-sort.h"
+#include "checkpoint.h"
 
 #include <kapp/main.h>
 #include <kapp/args.h>
@@ -73,14 +74,17 @@ rc_t CC UsageSummary ( const char *prog_name )
 
 #define OPT_IGNORE_FAILURE "ignore-failure"
 #define OPT_FORCE "force"
+#define OPT_RESUME "resume"
 #define OPT_MEM_LIMIT "mem-limit"
 #define OPT_MAP_FILE_BSIZE "map-file-bsize"
+#define OPT_MAP_FILE_PREFETCH "map-file-prefetch"
 #define OPT_MAX_IDX_IDS "max-idx-ids"
 #define OPT_MAX_REF_IDX_IDS "max-ref-idx-ids"
 #define OPT_MAX_LARGE_IDX_IDS "max-large-idx-ids"
 #define OPT_TEMP_DIR "tempdir"
 #define OPT_MMAP_DIR "mmapdir"
 #define OPT_UNSORTED_OLD_NEW "unsorted-old-new"
+#define OPT_THREADS "threads"
 
 #define OPT_COLUMN_MD5 "column-md5"
 #define OPT_NO_COLUMN_CHECKSUM "no-column-checksum"
@@ -95,14 +99,19 @@ rc_t CC UsageSummary ( const char *prog_name )
 static const char *hlp_ignore_failure [] = { "ignore failure when sorting multiple objects",
                                              "i.e. continue in spite of previous errors", NULL };
 static const char *hlp_force [] = { "force overwrite of existing destination", NULL };
+static const char *hlp_resume [] = { "keep a checkpoint manifest beside the destination",
+                                     "and continue an interrupted sort from it", NULL };
 static const char *hlp_mem_limit [] = { "sets limit on dynamic memory usage", NULL };
 static const char *hlp_map_file_bsize [] = { "sets id map-file cache size", NULL };
+static const char *hlp_map_file_prefetch [] = { "sets id map-file read-ahead window, 0 to disable", NULL };
 static const char *hlp_max_idx_ids [] = { "sets number of join-index ids to process at a time", NULL };
 static const char *hlp_max_ref_idx_ids [] = { "sets number of join-index ids to process within REFERENCE table", NULL };
 static const char *hlp_max_large_idx_ids [] = { "sets number of rows to process with large columns", NULL };
 static const char *hlp_temp_dir [] = { "sets a specific directory to use for temporary files", NULL };
 static const char *hlp_mmap_dir [] = { "sets a specific directory to use for memory-mapped buffers", NULL };
 static const char *hlp_unsorted_old_new [] = { "write old=>new index in unsorted order", NULL };
+static const char *hlp_threads [] = { "sets number of threads copying columns concurrently",
+                                      "limited by --mem-limit", NULL };
 
 static const char *hlp_column_md5 [] = { "generate md5sum compatible checksum files for each column [default]", NULL };
 static const char *hlp_no_column_checksum [] = { "disable generation of column checksums", NULL };
@@ -128,14 +137,17 @@ static OptDef options [] =
     */
     { OPT_IGNORE_FAILURE, "i", NULL, hlp_ignore_failure, 1, false, false }
   , { OPT_FORCE, "f", NULL, hlp_force, 1, false, false }
+  , { OPT_RESUME, NULL, NULL, hlp_resume, 1, false, false }
   , { OPT_MEM_LIMIT, NULL, NULL, hlp_mem_limit, 1, true, false }
   , { OPT_MAP_FILE_BSIZE, NULL, NULL, hlp_map_file_bsize, 1, true, false }
+  , { OPT_MAP_FILE_PREFETCH, NULL, NULL, hlp_map_file_prefetch, 1, true, false }
   , { OPT_MAX_IDX_IDS, NULL, NULL, hlp_max_idx_ids, 1, true, false }
   , { OPT_MAX_REF_IDX_IDS, NULL, NULL, hlp_max_ref_idx_ids, 1, true, false }
   , { OPT_MAX_LARGE_IDX_IDS, NULL, NULL, hlp_max_large_idx_ids, 1, true, false }
   , { OPT_TEMP_DIR, NULL, NULL, hlp_temp_dir, 1, true, false }
   , { OPT_MMAP_DIR, NULL, NULL, hlp_mmap_dir, 1, true, false }
   , { OPT_UNSORTED_OLD_NEW, NULL, NULL, hlp_unsorted_old_new, 1, false, false }
+  , { OPT_THREADS, NULL, NULL, hlp_threads, 1, true, false }
 
   , { OPT_COLUMN_MD5, NULL, NULL, hlp_column_md5, 1, false, false }
   , { OPT_NO_COLUMN_CHECKSUM, NULL, NULL, hlp_no_column_checksum, 1, false, false }
@@ -152,14 +164,17 @@ static const char *option_params [] =
 {
     NULL
   , NULL
+  , NULL
   , "bytes"
   , "cache-size"
+  , "bytes"
   , "num-ids"
   , "num-ids"
   , "num-ids"
   , "path-to-tmp"
   , "path-to-mmaps"
   , NULL
+  , "count"
   , NULL
   , NULL
   , NULL
@@ -333,12 +348,18 @@ void initialize_params ( const ctx_t *ctx, Caps *caps, Tool *tp, Selection *sel,
     tp -> map_file_bsize = 64 * 1024 * 1024;
     tp -> map_file_random_bsize = tp -> map_file_bsize;
 
+    /* default read-ahead window for map cache */
+    tp -> map_file_prefetch = 8 * 1024 * 1024;
+
     /* default max index ids to gather at a time */
     tp -> max_ref_idx_ids = tp -> max_large_idx_ids = tp -> max_idx_ids = 256 * 1024 * 1024;
     tp -> max_poslen_ids = 64 * 1024 * 1024;
     tp -> min_idx_ids =  64 * 1024 * 1024;
     tp -> max_missing_ids = tp -> max_idx_ids;
 
+    /* copy one column at a time unless asked */
+    tp -> num_threads = 1;
+
 #if 0
     /* refpos cache size */
     tp -> refpos_cache_capacity = 100 * 1024 * 1024;
@@ -364,6 +385,9 @@ void initialize_params ( const ctx_t *ctx, Caps *caps, Tool *tp, Selection *sel,
     /* normally do not force overwrite */
     tp -> force = false;
 
+    /* normally start from scratch */
+    tp -> resume = false;
+
     /* not needed under normal circumstances */
     tp -> write_new_to_old = false;
 tp->write_new_to_old=true;
@@ -391,6 +415,11 @@ tp->write_new_to_old=true;
     if ( found )
         tp -> map_file_random_bsize = ( size_t ) val;
 
+    ON_FAIL ( val = KConfigGetNodeU64 ( ctx, "sra-sort/map_file_prefetch", & found ) )
+        return;
+    if ( found )
+        tp -> map_file_prefetch = ( size_t ) val;
+
     ON_FAIL ( val = KConfigGetNodeU64 ( ctx, "sra-sort/max_idx_ids", & found ) )
         return;
     if ( found )
@@ -416,6 +445,11 @@ tp->write_new_to_old=true;
         return;
     if ( count != 0 )
         tp -> map_file_random_bsize = ( size_t ) val;
+
+    ON_FAIL ( val = ArgsGetOptU64 ( args, ctx, OPT_MAP_FILE_PREFETCH, & count ) )
+        return;
+    if ( count != 0 )
+        tp -> map_file_prefetch = ( size_t ) val;
    
     ON_FAIL ( val = ArgsGetOptU64 ( args, ctx, OPT_MAX_IDX_IDS, & count ) )
         return;
@@ -432,6 +466,11 @@ tp->write_new_to_old=true;
     if ( count != 0 )
         tp -> max_large_idx_ids = ( size_t ) val;
 
+    ON_FAIL ( val = ArgsGetOptU64 ( args, ctx, OPT_THREADS, & count ) )
+        return;
+    if ( count != 0 && val != 0 )
+        tp -> num_threads = ( uint32_t ) val;
+
     ON_FAIL ( found = ArgsGetOptBool ( args, ctx, OPT_IGNORE_FAILURE, & count ) )
         return;
     if ( count != 0 )
@@ -441,6 +480,11 @@ tp->write_new_to_old=true;
         return;
     if ( count != 0 )
         tp -> force = true;
+
+    ON_FAIL ( found = ArgsGetOptBool ( args, ctx, OPT_RESUME, & count ) )
+        return;
+    if ( count != 0 )
+        tp -> resume = true;
    
     ON_FAIL ( found = ArgsGetOptBool ( args, ctx, OPT_UNSORTED_OLD_NEW, & count ) )
         return;
@@ -525,6 +569,34 @@ void initialize_caps ( const ctx_t *ctx, Caps *caps, Args *args )
     }
 }
 
+/* run_resumable
+ *  brackets run with a checkpoint manifest when resuming
+ *  the manifest is removed only once the destination is complete
+ */
+static
+void run_resumable ( const ctx_t *ctx, Caps *caps )
+{
+    FUNC_ENTRY ( ctx );
+
+    const Tool *tp = caps -> tool;
+
+    if ( ! tp -> resume )
+        run ( ctx );
+    else
+    {
+        TRY ( caps -> ckpt = CheckpointMake ( ctx, tp -> src_path, tp -> dst_path ) )
+        {
+            bool complete;
+
+            run ( ctx );
+            complete = ! FAILED ();
+
+            CheckpointRelease ( caps -> ckpt, ctx, complete );
+            caps -> ckpt = NULL;
+        }
+    }
+}
+
 rc_t CC KMain ( int argc, char *argv [] )
 {
     DECLARE_CTX_INFO ();
@@ -628,7 +700,13 @@ rc_t CC KMain ( int argc, char *argv [] )
                                                 rc_t first_rc = 0;
                                                 bool issue_divider_line;
 
-                                                if ( tp . force )
+                                                if ( tp . resume )
+                                                {
+                                                    /* open what an earlier run left, or create */
+                                                    tp . db . cmode = kcmOpen | ( tp . db . cmode & ~ kcmValueMask );
+                                                    tp . tbl . cmode = kcmOpen | ( tp . tbl . cmode & ~ kcmValueMask );
+                                                }
+                                                else if ( tp . force )
                                                 {
                                                     tp . db . cmode = kcmInit | ( tp . db . cmode & ~ kcmValueMask );
                                                     tp . tbl . cmode = kcmInit | ( tp . tbl . cmode & ~ kcmValueMask );
@@ -672,7 +750,7 @@ rc_t CC KMain ( int argc, char *argv [] )
                                                                 STATUS ( 1, "################################################################" );
 
                                                             tp . dst_path = dst_path;
-                                                            ON_FAIL ( run ( ctx ) )
+                                                            ON_FAIL ( run_resumable ( ctx, & caps ) )
                                                             {
                                                                 if ( ! tp . ignore )
                                                                     break;
@@ -711,6 +789,11 @@ rc_t CC KMain ( int argc, char *argv [] )
                                                             rc = RC ( rcExe, rcArgv, rcParsing, rcArgv, rcIncorrect );
                                                             ERROR ( rc, "source and destination object types are not compatible" );
                                                         }
+                                                        else if ( tp . resume )
+                                                        {
+                                                            tp . db . cmode = kcmOpen | ( tp . db . cmode & ~ kcmValueMask );
+                                                            tp . tbl . cmode = kcmOpen | ( tp . tbl . cmode & ~ kcmValueMask );
+                                                        }
                                                         else if ( ! tp . force )
                                                         {
                                                             rc = RC ( rcExe, targ, rcCopying, targ, rcExists );
@@ -724,7 +807,7 @@ rc_t CC KMain ( int argc, char *argv [] )
                                                     }
 
                                                     if ( ! FAILED () )
-                                                        run ( ctx );
+                                                        run_resumable ( ctx, & caps );
                                                 }
                                             }
                                         }
@@ -85,6 +85,9 @@ struct Tool
     size_t map_file_bsize;
     size_t map_file_random_bsize;
 
+    /* read-ahead window for id map files and mmap pages, 0 disables */
+    size_t map_file_prefetch;
+
     /* the number of ids to gather at a time */
     size_t max_ref_idx_ids;
     size_t max_large_idx_ids;
@@ -95,6 +98,9 @@ struct Tool
     /* the number of missing SEQUENCE ids to gather at a time */
     size_t max_missing_ids;
 
+    /* the number of threads copying independent columns */
+    uint32_t num_threads;
+
     /* pid of tool */
     int pid;
 
@@ -121,6 +127,9 @@ struct Tool
     /* ignore failure on multiple sorts */
     bool ignore;
 
+    /* keep a checkpoint manifest and skip committed columns */
+    bool resume;
+
     /* force overwrite */
     bool force;
 
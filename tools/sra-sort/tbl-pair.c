@@ -32,6 +32,8 @@ typedef struct TablePair StdTblPair;
 #include "db-pair.h"
 #include "meta-pair.h"
 #include "row-set-priv.h"
+#include "checkpoint.h"
+#include "map-file.h"
 #include "ctx.h"
 #include "caps.h"
 #include "except.h"
@@ -43,9 +45,12 @@ typedef struct TablePair StdTblPair;
 #include <vdb/cursor.h>
 #include <vdb/vdb-priv.h>
 #include <kdb/meta.h>
+#include <kdb/table.h>
+#include <kfs/directory.h>
 #include <klib/printf.h>
 #include <klib/text.h>
 #include <klib/namelist.h>
+#include <kproc/thread.h>
 #include <klib/rc.h>
 
 #include <string.h>
@@ -215,6 +220,299 @@ void CC TablePairReleaseColumnPair ( void *item, void *data )
 }
 
 
+/* ReleaseColumns
+ *  releases the column pairs of a finished phase
+ *  when "committed" and checkpointing, each column is
+ *  recorded only once its writer has been released
+ *  and its files synced, after any id map it filled
+ */
+static
+void TablePairReleaseColumns ( TablePair *self, const ctx_t *ctx, Vector *cols, bool committed )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    const KTable *ktbl;
+    const KDirectory *tbl_dir;
+    Checkpoint *ckpt = ctx -> caps -> ckpt;
+
+    if ( ckpt == NULL || ! committed )
+    {
+        VectorWhack ( cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        return;
+    }
+
+    rc = VTableOpenKTableRead ( self -> dtbl, & ktbl );
+    if ( rc != 0 )
+        ERROR ( rc, "VTableOpenKTableRead failed on 'dst.%s'", self -> full_spec );
+    else
+    {
+        rc = KTableOpenDirectoryRead ( ktbl, & tbl_dir );
+        if ( rc != 0 )
+            ERROR ( rc, "KTableOpenDirectoryRead failed on 'dst.%s'", self -> full_spec );
+        else
+        {
+            uint32_t i, count = VectorLength ( cols );
+            for ( i = 0; i < count; ++ i )
+            {
+                char colspec [ 256 ];
+                ColumnPair *col = VectorGet ( cols, i );
+                size_t size = string_copy_measure ( colspec, sizeof colspec, col -> colspec );
+
+                /* special columns are always rebuilt, and a name
+                   too long to hold is simply copied again on resume */
+                bool resumable = col -> resumable && size < sizeof colspec;
+
+                /* a map kept with the column is recorded between the two,
+                   it is only taken up again when both were recorded */
+                MapFile *idx = col -> ckpt_idx;
+                col -> ckpt_idx = NULL;
+
+                ColumnPairRelease ( col, ctx );
+
+                if ( ! FAILED () && resumable )
+                {
+                    TRY ( CheckpointSyncColumn ( ckpt, ctx, tbl_dir, colspec ) )
+                    {
+                        TRY ( MapFileCheckpoint ( idx, ctx ) )
+                        {
+                            CheckpointRecordColumn ( ckpt, ctx, self -> full_spec, colspec );
+                        }
+                    }
+                }
+
+                MapFileRelease ( idx, ctx );
+            }
+
+            VectorWhack ( cols, NULL, NULL );
+            KDirectoryRelease ( tbl_dir );
+        }
+
+        KTableRelease ( ktbl );
+    }
+
+    /* still owned if the table could not be opened */
+    VectorWhack ( cols, TablePairReleaseColumnPair, ( void* ) ctx );
+}
+
+
+/* CopyColumnSlice
+ *  walks RowSets from "rsi", copying every "stride"th column
+ *  starting at "first". the serial case is ( 0, 1 ).
+ *
+ *  writers are bound to "rsi" so that any that look at the
+ *  iterator's id maps see the one producing their RowSets.
+ */
+static
+void TablePairCopyColumnSlice ( TablePair *self, const ctx_t *ctx,
+    RowSetIterator *rsi, const Vector *cols, uint32_t first, uint32_t stride )
+{
+    FUNC_ENTRY ( ctx );
+
+    uint32_t i, count = VectorLength ( cols );
+
+    for ( i = first; i < count; i += stride )
+    {
+        ColumnPair *col = VectorGet ( cols, i );
+        assert ( col != NULL );
+        ColumnPairBindRowSetIterator ( col, ctx, rsi );
+    }
+
+    while ( ! FAILED () )
+    {
+        RowSet *rs;
+        ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
+            break;
+        if ( rs == NULL )
+            break;
+
+        for ( i = first; i < count; i += stride )
+        {
+            ColumnPair *col = VectorGet ( cols, i );
+            ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
+                break;
+        }
+
+        RowSetRelease ( rs, ctx );
+    }
+
+    for ( i = first; i < count; i += stride )
+        ColumnPairBindRowSetIterator ( VectorGet ( cols, i ), ctx, NULL );
+}
+
+
+/* ColumnWorkers
+ *  the number of threads to copy a vector of unmapped columns
+ *
+ *  every worker walks the table with its own RowSetIterator,
+ *  which allocates an old-id/new-ord map per RowSet, and the
+ *  column it is copying may stage a RowSet worth of
+ *  ( value, new-id ) pairs in a paged MemBank drawn from the
+ *  same quota. admit only as many workers as the quota allows.
+ */
+static
+uint32_t TablePairColumnWorkers ( const TablePair *self, const ctx_t *ctx,
+    const Vector *cols, bool is_large )
+{
+    FUNC_ENTRY ( ctx );
+
+    const Tool *tp = ctx -> caps -> tool;
+    uint32_t num_workers = tp -> num_threads;
+    uint32_t count = VectorLength ( cols );
+
+    if ( num_workers > count )
+        num_workers = count;
+
+    if ( num_workers > 1 )
+    {
+        size_t in_use, quota;
+        uint64_t num_rows = self -> last_excl - self -> first_id;
+        size_t num_elems = is_large ? tp -> max_large_idx_ids : tp -> max_idx_ids;
+        size_t per_worker;
+
+        if ( ( uint64_t ) num_elems > num_rows )
+            num_elems = ( size_t ) num_rows;
+        per_worker = num_elems * ( sizeof ( int64_t ) + sizeof ( uint32_t ) + 2 * sizeof ( int64_t ) );
+
+        /* the iterators of cSRA tables select rows from a MapFile,
+           each through a reader with buffers of its own */
+        if ( self -> vt != & StdTblPair_vt )
+        {
+            per_worker += ( tp -> map_file_bsize > tp -> map_file_random_bsize ) ?
+                tp -> map_file_bsize : tp -> map_file_random_bsize;
+            per_worker += 2 * 32 * 1024;
+        }
+
+        in_use = MemInUse ( ctx, & quota );
+        if ( ( quota + 1 ) != 0 && per_worker != 0 )
+        {
+            size_t avail = ( in_use < quota ) ? quota - in_use : 0;
+            if ( avail / per_worker < num_workers )
+            {
+                num_workers = ( uint32_t ) ( avail / per_worker );
+                STATUS ( 3, "memory quota limits column copy to %u threads", num_workers );
+            }
+        }
+    }
+
+    return num_workers == 0 ? 1 : num_workers;
+}
+
+
+/* CopyColumnsParallel
+ *  copies independent columns on a pool of threads
+ *  each thread owns a RowSetIterator and a slice of the columns
+ */
+typedef struct TablePairColumnWorker TablePairColumnWorker;
+struct TablePairColumnWorker
+{
+    Caps caps;
+    TablePair *tbl;
+    RowSetIterator *rsi;
+    const Vector *cols;
+    KThread *t;
+    uint32_t first, stride;
+};
+
+static
+rc_t CC TablePairColumnWorkerRun ( const KThread *self, void *data )
+{
+    TablePairColumnWorker *pb = data;
+
+    DECLARE_CTX_INFO ();
+    ctx_t thread_ctx = { & pb -> caps, NULL, & ctx_info };
+    const ctx_t *ctx = & thread_ctx;
+
+    STATUS ( 3, "copying column slice %u of %u on background thread", pb -> first + 1, pb -> stride );
+
+    TablePairCopyColumnSlice ( pb -> tbl, ctx, pb -> rsi, pb -> cols, pb -> first, pb -> stride );
+
+    return ctx -> rc;
+}
+
+static
+void TablePairCopyColumnsParallel ( TablePair *self, const ctx_t *ctx,
+    const Vector *cols, bool is_mapped, bool is_large, uint32_t num_workers )
+{
+    FUNC_ENTRY ( ctx );
+
+    TablePairColumnWorker *workers;
+
+    STATUS ( 3, "copying %u columns on %u threads", VectorLength ( cols ), num_workers );
+
+    TRY ( workers = MemAlloc ( ctx, sizeof workers [ 0 ] * num_workers, true ) )
+    {
+        uint32_t i, prepared, started;
+
+        /* iterators are created here rather than on the threads,
+           since a table may cache the one it hands out last, and
+           all of them before the first thread starts, since making
+           one flushes the MapFile it reads from */
+        for ( prepared = 0; prepared < num_workers; ++ prepared )
+        {
+            TablePairColumnWorker *pb = & workers [ prepared ];
+
+            pb -> tbl = self;
+            pb -> cols = cols;
+            pb -> first = prepared;
+            pb -> stride = num_workers;
+
+            TRY ( CapsInit ( & pb -> caps, ctx ) )
+            {
+                /* share the thread budget rather than multiply it */
+                pb -> caps . num_threads = ctx -> caps -> tool -> num_threads / num_workers;
+                if ( pb -> caps . num_threads == 0 )
+                    pb -> caps . num_threads = 1;
+
+                TRY ( pb -> rsi = TablePairGetRowSetIterator ( self, ctx, is_mapped, is_large ) )
+                {
+                    continue;
+                }
+
+                CapsWhack ( & pb -> caps, ctx );
+            }
+
+            break;
+        }
+
+        for ( started = 0; started < prepared && ! FAILED (); ++ started )
+        {
+            TablePairColumnWorker *pb = & workers [ started ];
+            rc_t rc = KThreadMake ( & pb -> t, TablePairColumnWorkerRun, pb );
+            if ( rc != 0 )
+            {
+                SYSTEM_ERROR ( rc, "failed to start column copy thread" );
+                break;
+            }
+        }
+
+        /* join every thread that was started, even after a failure */
+        for ( i = 0; i < started; ++ i )
+        {
+            TablePairColumnWorker *pb = & workers [ i ];
+
+            rc_t status = 0;
+            rc_t rc = KThreadWait ( pb -> t, & status );
+            if ( rc == 0 )
+                rc = status;
+            if ( rc != 0 && ! FAILED () )
+                ERROR ( rc, "failed to copy column slice %u of %u", i + 1, num_workers );
+
+            KThreadRelease ( pb -> t );
+        }
+
+        for ( i = 0; i < prepared; ++ i )
+        {
+            TablePairColumnWorker *pb = & workers [ i ];
+            RowSetIteratorRelease ( pb -> rsi, ctx );
+            CapsWhack ( & pb -> caps, ctx );
+        }
+
+        MemFree ( ctx, workers, sizeof workers [ 0 ] * num_workers );
+    }
+}
+
+
 /* Copy
  *  the table has to obtain a RowSetIterator
  *  which it walks vertically
@@ -283,7 +581,7 @@ void TablePairCopyStaticColumns ( TablePair *self, const ctx_t *ctx )
 
         /* douse columns */
         STATUS ( 3, "releasing static columns" );
-        VectorWhack ( & self -> static_cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        TablePairReleaseColumns ( self, ctx, & self -> static_cols, ! FAILED () );
     }
 }
 
@@ -334,7 +632,7 @@ void TablePairCopyPresortColumns ( TablePair *self, const ctx_t *ctx )
 
         /* douse columns */
         STATUS ( 3, "releasing presorted columns" );
-        VectorWhack ( & self -> presort_cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        TablePairReleaseColumns ( self, ctx, & self -> presort_cols, ! FAILED () );
     }
 }
 
@@ -387,7 +685,7 @@ void TablePairCopyMappedColumns ( TablePair *self, const ctx_t *ctx )
 
         /* douse columns */
         STATUS ( 3, "releasing mapped columns" );
-        VectorWhack ( & self -> mapped_cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        TablePairReleaseColumns ( self, ctx, & self -> mapped_cols, ! FAILED () );
     }
 }
 
@@ -403,32 +701,22 @@ void TablePairCopyLargeColumns ( TablePair *self, const ctx_t *ctx )
         RowSetIterator *rsi;
         const bool is_mapped = false;
         const bool is_large = true;
-        TRY ( rsi = TablePairGetRowSetIterator ( self, ctx, is_mapped, is_large ) )
+        uint32_t num_workers;
+
+        TRY ( num_workers = TablePairColumnWorkers ( self, ctx, & self -> large_cols, is_large ) )
         {
             STATUS ( 2, "copying '%s' large columns", self -> full_spec );
 
-            while ( ! FAILED () )
+            if ( num_workers > 1 )
+                TablePairCopyColumnsParallel ( self, ctx, & self -> large_cols, is_mapped, is_large, num_workers );
+            else
             {
-                uint32_t i;
-
-                RowSet *rs;
-                ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
-                    break;
-                if ( rs == NULL )
-                    break;
-
-                for ( i = 0; i < count; ++ i )
+                TRY ( rsi = TablePairGetRowSetIterator ( self, ctx, is_mapped, is_large ) )
                 {
-                    ColumnPair *col = VectorGet ( & self -> large_cols, i );
-                    assert ( col != NULL );
-                    ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
-                        break;
+                    TablePairCopyColumnSlice ( self, ctx, rsi, & self -> large_cols, 0, 1 );
+                    RowSetIteratorRelease ( rsi, ctx );
                 }
-
-                RowSetRelease ( rs, ctx );
             }
-
-            RowSetIteratorRelease ( rsi, ctx );
         }
 
         /* commit columns */
@@ -440,7 +728,7 @@ void TablePairCopyLargeColumns ( TablePair *self, const ctx_t *ctx )
 
         /* douse columns */
         STATUS ( 3, "releasing large columns" );
-        VectorWhack ( & self -> large_cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        TablePairReleaseColumns ( self, ctx, & self -> large_cols, ! FAILED () );
     }
 }
 
@@ -493,7 +781,7 @@ void TablePairCopyLargeMappedColumns ( TablePair *self, const ctx_t *ctx )
 
         /* douse columns */
         STATUS ( 3, "releasing large mapped columns" );
-        VectorWhack ( & self -> large_mapped_cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        TablePairReleaseColumns ( self, ctx, & self -> large_mapped_cols, ! FAILED () );
     }
 }
 
@@ -509,32 +797,22 @@ void TablePairCopyNormalColumns ( TablePair *self, const ctx_t *ctx )
         RowSetIterator *rsi;
         const bool is_mapped = false;
         const bool is_large = false;
-        TRY ( rsi = TablePairGetRowSetIterator ( self, ctx, is_mapped, is_large ) )
+        uint32_t num_workers;
+
+        TRY ( num_workers = TablePairColumnWorkers ( self, ctx, & self -> normal_cols, is_large ) )
         {
             STATUS ( 2, "copying '%s' columns", self -> full_spec );
 
-            while ( ! FAILED () )
+            if ( num_workers > 1 )
+                TablePairCopyColumnsParallel ( self, ctx, & self -> normal_cols, is_mapped, is_large, num_workers );
+            else
             {
-                uint32_t i;
-
-                RowSet *rs;
-                ON_FAIL ( rs = RowSetIteratorNext ( rsi, ctx ) )
-                    break;
-                if ( rs == NULL )
-                    break;
-
-                for ( i = 0; i < count; ++ i )
+                TRY ( rsi = TablePairGetRowSetIterator ( self, ctx, is_mapped, is_large ) )
                 {
-                    ColumnPair *col = VectorGet ( & self -> normal_cols, i );
-                    assert ( col != NULL );
-                    ON_FAIL ( ColumnPairCopy ( col, ctx, rs ) )
-                        break;
+                    TablePairCopyColumnSlice ( self, ctx, rsi, & self -> normal_cols, 0, 1 );
+                    RowSetIteratorRelease ( rsi, ctx );
                 }
-
-                RowSetRelease ( rs, ctx );
             }
-
-            RowSetIteratorRelease ( rsi, ctx );
         }
 
         /* commit columns */
@@ -546,7 +824,7 @@ void TablePairCopyNormalColumns ( TablePair *self, const ctx_t *ctx )
 
         /* douse columns */
         STATUS ( 3, "releasing columns" );
-        VectorWhack ( & self -> normal_cols, TablePairReleaseColumnPair, ( void* ) ctx );
+        TablePairReleaseColumns ( self, ctx, & self -> normal_cols, ! FAILED () );
     }
 }
 
@@ -649,6 +927,14 @@ ColumnPair *TablePairMatchColumnPair ( TablePair *self, const ctx_t *ctx, const
     KNamelist *types;
     ColumnPair *col = NULL;
 
+    /* a column committed by an earlier run is left alone.
+       anything else it left behind was dropped by TablePairInit */
+    if ( CheckpointColumnDone ( ctx -> caps -> ckpt, ctx, self -> full_spec, name ) )
+    {
+        STATUS ( 3, "skipping checkpointed column 'dst.%s.%s'", self -> full_spec, name );
+        return NULL;
+    }
+
     rc = VTableListWritableDatatypes ( self -> dtbl, name, & types );
     if ( rc != 0 )
         ERROR ( rc, "VTableListWritableDatatypes failed listing 'dst.%s.%s' datatypes", self -> full_spec, name );
@@ -751,7 +1037,9 @@ ColumnPair *TablePairMatchColumnPair ( TablePair *self, const ctx_t *ctx, const
                             }
                         }
 
-                        if ( col == NULL && ! FAILED () )
+                        if ( col != NULL )
+                            col -> resumable = true;
+                        else if ( ! FAILED () )
                             ANNOTATE ( "column '%s' cannot be written", name );
                     }
                 }
@@ -943,6 +1231,95 @@ void TablePairAddColumnPair ( TablePair *self, const ctx_t *ctx, ColumnPair *col
 }
 
 
+/* DropColumn
+ *  drop a column of the destination table that an earlier run
+ *  committed, but that has to be written again
+ */
+void TablePairDropColumn ( TablePair *self, const ctx_t *ctx, const char *colspec )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    KTable *ktbl;
+
+    const char *name = strrchr ( colspec, ')' );
+    if ( name ++ == NULL )
+        name = colspec;
+
+    rc = VTableOpenKTableUpdate ( self -> dtbl, & ktbl );
+    if ( rc != 0 )
+        ERROR ( rc, "VTableOpenKTableUpdate failed on 'dst.%s'", self -> full_spec );
+    else
+    {
+        STATUS ( 3, "dropping checkpointed column 'dst.%s.%s'", self -> full_spec, name );
+        rc = KTableDropColumn ( ktbl, "%s", name );
+        if ( rc != 0 && GetRCState ( rc ) != rcNotFound )
+            ERROR ( rc, "KTableDropColumn failed on 'dst.%s.%s'", self -> full_spec, name );
+
+        KTableRelease ( ktbl );
+    }
+}
+
+
+/* DropUncommittedColumns
+ *  on resume, drop every column of the destination table
+ *  that an earlier run did not record as committed, so that
+ *  partially written columns are never reopened
+ */
+static
+void TablePairDropUncommittedColumns ( TablePair *self, const ctx_t *ctx )
+{
+    FUNC_ENTRY ( ctx );
+
+    rc_t rc;
+    KTable *ktbl;
+    Checkpoint *ckpt = ctx -> caps -> ckpt;
+
+    if ( ckpt == NULL )
+        return;
+
+    rc = VTableOpenKTableUpdate ( self -> dtbl, & ktbl );
+    if ( rc != 0 )
+        ERROR ( rc, "VTableOpenKTableUpdate failed on 'dst.%s'", self -> full_spec );
+    else
+    {
+        KNamelist *names;
+        rc = KTableListCol ( ktbl, & names );
+        if ( rc != 0 )
+            ERROR ( rc, "KTableListCol failed on 'dst.%s'", self -> full_spec );
+        else
+        {
+            uint32_t count;
+            rc = KNamelistCount ( names, & count );
+            if ( rc != 0 )
+                ERROR ( rc, "KNamelistCount failed listing 'dst.%s' columns", self -> full_spec );
+            else
+            {
+                uint32_t i;
+                for ( i = 0; ! FAILED () && i < count; ++ i )
+                {
+                    const char *name;
+                    rc = KNamelistGet ( names, i, & name );
+                    if ( rc != 0 )
+                        ERROR ( rc, "KNamelistGet ( %u ) failed listing 'dst.%s' columns", i, self -> full_spec );
+                    else if ( ! CheckpointColumnDone ( ckpt, ctx, self -> full_spec, name ) )
+                    {
+                        STATUS ( 3, "dropping uncommitted column 'dst.%s.%s'", self -> full_spec, name );
+                        rc = KTableDropColumn ( ktbl, "%s", name );
+                        if ( rc != 0 )
+                            ERROR ( rc, "KTableDropColumn failed on 'dst.%s.%s'", self -> full_spec, name );
+                    }
+                }
+            }
+
+            KNamelistRelease ( names );
+        }
+
+        KTableRelease ( ktbl );
+    }
+}
+
+
 /* Init
  */
 void TablePairInit ( TablePair *self, const ctx_t *ctx, const TablePair_vt *vt,
@@ -1009,9 +1386,17 @@ void TablePairInit ( TablePair *self, const ctx_t *ctx, const TablePair_vt *vt,
                     /* record reordering */
                     self -> reorder = reorder;
 
-                    KRefcountInit ( & self -> refcount, 1, "TablePair", "init", name );
-                    return;
+                    /* clear out what an interrupted run left behind */
+                    TRY ( TablePairDropUncommittedColumns ( self, ctx ) )
+                    {
+                        KRefcountInit ( & self -> refcount, 1, "TablePair", "init", name );
+                        return;
+                    }
+
+                    self -> full_spec = self -> name = NULL;
                 }
+
+                MemFree ( ctx, full_spec, self -> full_spec_size + 1 );
             }
 
             VTableRelease ( self -> dtbl );
@@ -178,6 +178,13 @@ void TablePairExplode ( TablePair *self, const ctx_t *ctx );
 void TablePairAddColumnPair ( TablePair *self, const ctx_t *ctx, struct ColumnPair *col );
 
 
+/* DropColumn
+ *  drop a column of the destination table that an earlier run
+ *  committed, but that has to be written again
+ */
+void TablePairDropColumn ( TablePair *self, const ctx_t *ctx, const char *colspec );
+
+
 /* PreCopy
  * PostCopy
  *  give table a chance to prepare and cleanup